@@ -1,9 +1,17 @@
 #include "devices/block.h"
+#include <atomic.h>
+#include <bitmap.h>
+#include <crc32.h>
 #include <list.h>
+#include <sched-stats.h>
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vmalloc.h"
 
 /* A block device. */
 struct block
@@ -17,8 +25,26 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
+    /* Counted atomically, without turning interrupts off. */
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Request statistics, in timer_cycles() units.  Updated with
+       interrupts off, since requests are submitted by one thread
+       and completed by another. */
+    unsigned long long request_cnt;     /* Requests completed. */
+    unsigned long long latency[BLOCK_LATENCY_BUCKETS];
+                                        /* Histogram of latencies. */
+    unsigned in_flight;                 /* Requests now in flight. */
+    uint64_t busy;                      /* Time with IN_FLIGHT > 0. */
+    uint64_t depth;                     /* IN_FLIGHT integrated over time. */
+    uint64_t last_change;               /* When IN_FLIGHT last changed. */
+    uint64_t start;                     /* When registered. */
+
+    /* Set by block_enable_checksums(). */
+    uint32_t *sums;                     /* CRC-32 of each sector. */
+    struct bitmap *summed;              /* Sectors whose SUMS are known. */
+    unsigned long long cksum_errors;    /* Mismatches found. */
   };
 
 /* List of all block devices. */
@@ -28,6 +54,11 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void account (struct block *, int in_flight_change);
+static void record_sums (struct block *, block_sector_t, size_t cnt,
+                         const uint8_t *buffer);
+static void verify_sums (struct block *, block_sector_t, size_t cnt,
+                         const uint8_t *buffer);
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -99,20 +130,159 @@ block_get_by_name (const char *name)
   return NULL;
 }
 
-/* Verifies that SECTOR is a valid offset within BLOCK.
-   Panics if not. */
+/* Verifies that the CNT sectors starting at SECTOR are all
+   within BLOCK.  Panics if not. */
 static void
-check_sector (struct block *block, block_sector_t sector)
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
 {
-  if (sector >= block->size)
+  if (cnt > block->size || sector > block->size - cnt)
     {
       /* We do not use ASSERT because we want to panic here
          regardless of whether NDEBUG is defined. */
-      PANIC ("Access past end of device %s (sector=%"PRDSNu", "
-             "size=%"PRDSNu")\n", block_name (block), sector, block->size);
+      PANIC ("Access past end of device %s (sector=%"PRDSNu", cnt=%zu, "
+             "size=%"PRDSNu")\n", block_name (block), sector, cnt,
+             block->size);
+    }
+}
+
+/* Initializes R as a request to transfer the CNT sectors
+   starting at SECTOR between BLOCK and BUFFER, which must have
+   room for CNT * BLOCK_SECTOR_SIZE bytes, writing to BLOCK if
+   WRITE is true.  R has no completion function; the caller may
+   set R's `done' and `aux' members before submitting it. */
+void
+block_request_init (struct block_request *r, struct block *block,
+                    block_sector_t sector, size_t cnt, void *buffer,
+                    bool write)
+{
+  r->block = block;
+  r->sector = sector;
+  r->cnt = cnt;
+  r->buffer = buffer;
+  r->write = write;
+  r->done = NULL;
+  r->aux = NULL;
+  r->origin = NULL;
+  sema_init (&r->sema, 0);
+}
+
+/* Starts request R and returns without waiting for it to
+   finish, unless the driver cannot queue requests, in which
+   case the transfer is done before returning.  Either way, R
+   completes as described in block.h.  Drivers may change R's
+   `block' and `sector' members along the way. */
+void
+block_submit (struct block_request *r)
+{
+  struct block *block = r->block;
+
+  check_sectors (block, r->sector, r->cnt);
+  if (r->write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+      atomic64_add (&block->write_cnt, r->cnt);
+    }
+  else
+    atomic64_add (&block->read_cnt, r->cnt);
+
+  /* When a request passes through a partition to its disk, both
+     devices account for it, timed from the first submission. */
+  if (r->origin == NULL)
+    {
+      r->origin = block;
+      r->origin_sector = r->sector;
+      r->submit_time = timer_ticks ();
+      r->submit_cycles = timer_cycles ();
+
+      /* Charge the sectors to the thread asking for them, and
+         give the request its priority: the thread's effective
+         priority, donations included, or the lowest for a batch
+         thread. */
+      r->priority = PRI_DEFAULT;
+      if (!intr_context ())
+        {
+          struct thread *t = thread_current ();
+          struct rusage *u = &t->usage;
+          if (r->write)
+            u->write_sectors += r->cnt;
+          else
+            u->read_sectors += r->cnt;
+          r->priority = (t->sched_class == SCHED_BATCH
+                         ? PRI_MIN : t->priority);
+        }
+      if (r->write && block->sums != NULL)
+        record_sums (block, r->sector, r->cnt, r->buffer);
+    }
+  account (block, 1);
+
+  r->driver_aux = block->aux;
+  if (block->ops->submit != NULL)
+    block->ops->submit (block->aux, r);
+  else
+    {
+      const struct block_operations *ops = block->ops;
+      uint8_t *buffer = r->buffer;
+      size_t i;
+
+      if (r->write && ops->write_multiple != NULL)
+        ops->write_multiple (block->aux, r->sector, r->cnt, buffer);
+      else if (!r->write && ops->read_multiple != NULL)
+        ops->read_multiple (block->aux, r->sector, r->cnt, buffer);
+      else
+        for (i = 0; i < r->cnt; i++)
+          if (r->write)
+            ops->write (block->aux, r->sector + i,
+                        buffer + i * BLOCK_SECTOR_SIZE);
+          else
+            ops->read (block->aux, r->sector + i,
+                       buffer + i * BLOCK_SECTOR_SIZE);
+      block_complete (r);
     }
 }
 
+/* Waits for submitted request R, which must not have a
+   completion function, to finish. */
+void
+block_wait (struct block_request *r)
+{
+  ASSERT (r->done == NULL);
+  sema_down (&r->sema);
+}
+
+/* Called by a driver when request R is done. */
+void
+block_complete (struct block_request *r)
+{
+  uint64_t latency = timer_cycles () - r->submit_cycles;
+  int bucket = 0;
+  enum intr_level old_level;
+
+  while (bucket < BLOCK_LATENCY_BUCKETS - 1 && latency >= 2)
+    {
+      latency >>= 1;
+      bucket++;
+    }
+
+  old_level = intr_disable ();
+  account (r->block, -1);
+  r->block->request_cnt++;
+  r->block->latency[bucket]++;
+  if (r->origin != r->block)
+    {
+      account (r->origin, -1);
+      r->origin->request_cnt++;
+      r->origin->latency[bucket]++;
+    }
+  intr_set_level (old_level);
+
+  if (!r->write && r->origin->sums != NULL)
+    verify_sums (r->origin, r->origin_sector, r->cnt, r->buffer);
+  if (r->done != NULL)
+    r->done (r);
+  else
+    sema_up (&r->sema);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
    Internally synchronizes accesses to block devices, so external
@@ -120,9 +290,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multiple (block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +301,42 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block_write_multiple (block, sector, 1, buffer);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from
+   BLOCK into BUFFER, which must have room for
+   CNT * BLOCK_SECTOR_SIZE bytes.  If the driver supports it, the
+   sectors are read in as few requests as possible, which is much
+   faster than reading them one by one.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_read_multiple (struct block *block, block_sector_t sector, size_t cnt,
+                     void *buffer)
+{
+  struct block_request r;
+
+  block_request_init (&r, block, sector, cnt, buffer, false);
+  block_submit (&r);
+  block_wait (&r);
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes,
+   as block_read_multiple() does for reading.  Returns after the
+   block device has acknowledged receiving all of the data.
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      size_t cnt, const void *buffer)
+{
+  struct block_request r;
+
+  block_request_init (&r, block, sector, cnt, (void *) buffer, true);
+  block_submit (&r);
+  block_wait (&r);
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,7 +360,126 @@ block_type (struct block *block)
   return block->type;
 }
 
-/* Prints statistics for each block device used for a Pintos role. */
+/* Returns an identifier for the channel through which BLOCK
+   transfers data.  Devices with the same channel compete for
+   it, but devices on different channels can transfer at the
+   same time.  A device whose driver does not say has a channel
+   of its own. */
+void *
+block_channel (struct block *block)
+{
+  return (block->ops->channel != NULL
+          ? block->ops->channel (block->aux)
+          : block);
+}
+
+/* Brings BLOCK's busy and depth times up to date and then adds
+   IN_FLIGHT_CHANGE to its number of requests in flight. */
+static void
+account (struct block *block, int in_flight_change)
+{
+  enum intr_level old_level = intr_disable ();
+  uint64_t now = timer_cycles ();
+  uint64_t delta = now - block->last_change;
+
+  if (block->in_flight > 0)
+    block->busy += delta;
+  block->depth += delta * block->in_flight;
+  block->last_change = now;
+  block->in_flight += in_flight_change;
+  intr_set_level (old_level);
+}
+
+/* Starts keeping checksums of BLOCK's sectors, as described in
+   block.h.  Returns true if successful, false if memory for them
+   could not be allocated.  Must be called before BLOCK is used. */
+bool
+block_enable_checksums (struct block *block)
+{
+  ASSERT (block->sums == NULL);
+
+  block->summed = bitmap_create (block->size);
+  block->sums = vmalloc (block->size * sizeof *block->sums);
+  if (block->summed == NULL || block->sums == NULL)
+    {
+      bitmap_destroy (block->summed);
+      vfree (block->sums);
+      block->summed = NULL;
+      block->sums = NULL;
+      return false;
+    }
+  return true;
+}
+
+/* Records the checksums of the CNT sectors starting at SECTOR
+   that BLOCK is being given in BUFFER.  Requests in flight do
+   not overlap, so each entry of SUMS has one user at a time, and
+   bitmap_mark() is atomic. */
+static void
+record_sums (struct block *block, block_sector_t sector, size_t cnt,
+             const uint8_t *buffer)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      block->sums[sector + i] = crc32 (0, buffer + i * BLOCK_SECTOR_SIZE,
+                                       BLOCK_SECTOR_SIZE);
+      bitmap_mark (block->summed, sector + i);
+    }
+}
+
+/* Checks the CNT sectors starting at SECTOR just read from BLOCK
+   into BUFFER against their checksums, and records the checksums
+   of any that have none yet. */
+static void
+verify_sums (struct block *block, block_sector_t sector, size_t cnt,
+             const uint8_t *buffer)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      uint32_t sum = crc32 (0, buffer + i * BLOCK_SECTOR_SIZE,
+                            BLOCK_SECTOR_SIZE);
+      if (!bitmap_test (block->summed, sector + i))
+        {
+          block->sums[sector + i] = sum;
+          bitmap_mark (block->summed, sector + i);
+        }
+      else if (block->sums[sector + i] != sum)
+        {
+          atomic64_add (&block->cksum_errors, 1);
+          printf ("%s: checksum mismatch in sector %"PRDSNu"\n",
+                  block->name, sector + i);
+        }
+    }
+}
+
+/* Stores a snapshot of BLOCK's statistics in *STATS. */
+void
+block_get_stats (struct block *block, struct block_stats *stats)
+{
+  enum intr_level old_level = intr_disable ();
+  int i;
+
+  account (block, 0);
+  strlcpy (stats->name, block->name, sizeof stats->name);
+  stats->read_cnt = atomic64_load (&block->read_cnt);
+  stats->write_cnt = atomic64_load (&block->write_cnt);
+  stats->request_cnt = block->request_cnt;
+  for (i = 0; i < BLOCK_LATENCY_BUCKETS; i++)
+    stats->latency[i] = block->latency[i];
+  stats->busy = block->busy;
+  stats->depth = block->depth;
+  stats->elapsed = block->last_change - block->start;
+  intr_set_level (old_level);
+}
+
+/* Prints statistics for each block device used for a Pintos role:
+   sectors transferred, then the latency histogram as
+   "log2(cycles):count" pairs, the share of time busy and the
+   mean number of requests in flight. */
 void
 block_print_stats (void)
 {
@@ -171,9 +490,30 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
+          struct block_stats s;
+          uint64_t busy_pct = 0, depth_100 = 0;
+          int j;
+
           printf ("%s (%s): %llu reads, %llu writes\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  atomic64_load (&block->read_cnt),
+                  atomic64_load (&block->write_cnt));
+
+          block_get_stats (block, &s);
+          printf ("%s: %"PRIu64" requests, latency", s.name, s.request_cnt);
+          for (j = 0; j < BLOCK_LATENCY_BUCKETS; j++)
+            if (s.latency[j] > 0)
+              printf (" %d:%"PRIu64, j, s.latency[j]);
+          if (s.elapsed > 0)
+            {
+              busy_pct = s.busy * 100 / s.elapsed;
+              depth_100 = s.depth * 100 / s.elapsed;
+            }
+          printf (", %"PRIu64"%% busy, depth %"PRIu64".%02"PRIu64"\n",
+                  busy_pct, depth_100 / 100, depth_100 % 100);
+          if (block->sums != NULL)
+            printf ("%s: %llu checksum mismatches\n", block->name,
+                    atomic64_load (&block->cksum_errors));
         }
     }
 }
@@ -200,6 +540,14 @@ block_register (const char *name, enum block_type type,
   block->aux = aux;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  block->request_cnt = 0;
+  memset (block->latency, 0, sizeof block->latency);
+  block->in_flight = 0;
+  block->busy = block->depth = 0;
+  block->start = block->last_change = timer_cycles ();
+  block->sums = NULL;
+  block->summed = NULL;
+  block->cksum_errors = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -1,8 +1,12 @@
 #ifndef DEVICES_BLOCK_H
 #define DEVICES_BLOCK_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <inttypes.h>
+#include <block-stats.h>
+#include <list.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,20 +57,109 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
+void *block_channel (struct block *);
+
+/* Asynchronous requests.
+
+   A request describes a transfer of CNT consecutive sectors.
+   block_submit() queues it with the device's driver and returns
+   at once, possibly before the transfer has started.  When the
+   transfer is done, the block layer calls the request's DONE
+   function if it has one, and otherwise wakes up block_wait().
+   DONE runs in a kernel thread, never in an interrupt handler,
+   but it may be a driver's thread, so it should not sleep long.
+   The request and its buffer must stay put until then.
+
+   Requests in flight at the same time may be carried out in any
+   order, so they should not overlap.  Each carries the priority
+   of the thread that submitted it, which a driver that queues
+   requests may use to serve more urgent ones first. */
+
+struct block_request;
+typedef void block_done_func (struct block_request *);
+
+struct block_request
+  {
+    struct block *block;        /* Block device. */
+    block_sector_t sector;      /* First sector. */
+    size_t cnt;                 /* Number of sectors. */
+    void *buffer;               /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    bool write;                 /* True to write, false to read. */
+    block_done_func *done;      /* Completion function, or null. */
+    void *aux;                  /* For use by DONE. */
+
+    /* Owned by the block layer and the driver. */
+    struct list_elem elem;      /* Element in a driver queue. */
+    struct block *origin;       /* Device first submitted to. */
+    block_sector_t origin_sector; /* First sector within ORIGIN. */
+    void *driver_aux;           /* Driver's data for the device. */
+    int64_t submit_time;        /* Timer tick when submitted. */
+    int priority;               /* Submitter's I/O priority. */
+    uint64_t submit_cycles;     /* timer_cycles() when submitted. */
+    struct semaphore sema;      /* Up'd on completion if DONE is null. */
+  };
+
+void block_request_init (struct block_request *, struct block *,
+                         block_sector_t, size_t cnt, void *buffer,
+                         bool write);
+void block_submit (struct block_request *);
+void block_wait (struct block_request *);
+
+/* Integrity checking.
+
+   Once block_enable_checksums() is called on a device, the block
+   layer keeps the CRC-32 of each of its sectors, taken as the
+   sector is written or, for one not written since boot, the
+   first time it is read, and checks each sector read against
+   it, reporting a mismatch on the console.  Every read from a
+   device is a miss in whatever cache sits above it, so this
+   costs nothing on a cache hit. */
+bool block_enable_checksums (struct block *);
 
 /* Statistics. */
+void block_get_stats (struct block *, struct block_stats *);
 void block_print_stats (void);
 
-/* Lower-level interface to block device drivers. */
+/* Lower-level interface to block device drivers.
+
+   A driver that queues requests supplies submit, which must
+   arrange for block_complete() to be called on the request once
+   it is done, and may leave the other operations null.  The
+   block layer has already checked the request and set its
+   `driver_aux' to the driver's AUX.
+
+   Otherwise, the driver supplies read and write, which transfer
+   one sector before returning.  A driver that can move several
+   consecutive sectors at once also supplies read_multiple and
+   write_multiple; if these are null, the block layer transfers
+   the sectors one at a time.
+
+   A driver may also supply channel, which returns an identifier
+   for the hardware path, such as an IDE channel, that the
+   device shares with any others giving the same identifier.
+   Transfers to devices on different channels can proceed at the
+   same time. */
 
 struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
+    void (*submit) (void *aux, struct block_request *);
+    void *(*channel) (void *aux);
   };
 
+void block_complete (struct block_request *);
+
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
@@ -5,13 +5,40 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/loader.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   Where the controller is a PCI bus-master IDE controller, as in
+   Bochs and QEMU, sectors move by DMA: the controller copies the
+   data to or from memory itself, described by a table of
+   physical regions, and the requesting thread sleeps until the
+   completion interrupt.  Otherwise, or if a DMA transfer fails,
+   the CPU copies each sector through the data register ("PIO").
+
+   Requests for each channel wait in a queue, serviced by a
+   kernel thread per channel that carries them out and then calls
+   their completion functions.  A thread that submits a request
+   need not wait for it.  The queue is kept sorted by disk and
+   sector, and the thread takes requests in C-LOOK order: the
+   next one at or beyond the sector where the last transfer
+   ended, sweeping back to the lowest once there is none.
+   Requests for the sectors right after it are merged into the
+   same command.  Requests of the highest priority waiting are
+   served before the rest, so that a low-priority scan does not
+   hold up an interactive read, and the sweep passes over the
+   others.  A request that has waited DEADLINE_TICKS goes first
+   regardless, so that neither a busy region of the disk nor a
+   stream of urgent requests can starve the rest. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -34,6 +61,7 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +77,51 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Bus master IDE port addresses. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRDT address. */
+
+/* Bus master Command Register bits. */
+#define BMC_START 0x01          /* Start transfer. */
+#define BMC_READ 0x08           /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BMS_ERROR 0x02          /* Transfer failed (write 1 to clear). */
+#define BMS_INTR 0x04           /* Interrupt raised (write 1 to clear). */
+
+/* Physical region descriptor: one physically contiguous piece of
+   a DMA buffer, which must not cross a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address. */
+    uint16_t size;              /* Size in bytes, 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT in the table's last entry. */
+  };
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_CNT 16              /* Entries in a channel's table. */
+
+/* Most sectors moved by a single READ or WRITE command.  The
+   Sector Count register can ask for up to 256, but 128 sectors
+   (64 kB) always fit in the physical region table. */
+#define MAX_XFER_SECTORS 128
+
+/* Most requests merged into a single command. */
+#define MERGE_MAX 8
+
+/* Timer ticks after which a waiting request is serviced ahead of
+   C-LOOK order. */
+#define DEADLINE_TICKS (TIMER_FREQ / 2)
+
+/* Part of a transfer: CNT sectors to or from BUFFER. */
+struct segment
+  {
+    uint8_t *buffer;            /* Data. */
+    size_t cnt;                 /* Number of sectors. */
+  };
 
 /* An ATA device. */
 struct ata_disk
@@ -57,6 +130,11 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    bool dma;                   /* Use DMA for transfers? */
+
+    /* From IDENTIFY DEVICE, for registering the disk. */
+    block_sector_t capacity;    /* Size in sectors. */
+    char info[128];             /* Model and serial number. */
   };
 
 /* An ATA channel (aka controller).
@@ -72,6 +150,23 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    /* Bus mastering. */
+    uint16_t bm_base;           /* Base I/O port, or 0 if no DMA. */
+    struct prd prdt[PRD_CNT] __attribute__ ((aligned (sizeof (struct prd)
+                                                      * PRD_CNT)));
+
+    /* Request queue. */
+    struct list queue;          /* Pending requests, by request_key(). */
+    struct lock queue_lock;     /* Protects `queue' and `head_key'. */
+    struct condition queue_cond;    /* Signaled when `queue' grows. */
+    uint32_t head_key;          /* Key just past the last transfer. */
+
+    /* Statistics. */
+    unsigned long long request_cnt;     /* Requests serviced. */
+    unsigned long long command_cnt;     /* Commands issued for them. */
+    unsigned long long sector_cnt;      /* Sectors transferred. */
+    int64_t busy_ticks;         /* Timer ticks spent transferring. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -81,11 +176,16 @@ static struct channel channels[CHANNEL_CNT];
 
 static struct block_operations ide_operations;
 
+static thread_func probe_channel;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static void register_ata_device (struct ata_disk *);
+
+/* Up'd by each channel's probe thread when it is done. */
+static struct semaphore probe_done;
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -95,14 +195,29 @@ static bool wait_while_busy (const struct ata_disk *);
 static void select_device (const struct ata_disk *);
 static void select_device_wait (const struct ata_disk *);
 
+static uint16_t find_bus_master (void);
+static bool dma_buffer_ok (const void *, size_t size);
+static bool dma_transfer (struct ata_disk *, block_sector_t,
+                          const struct segment[], size_t seg_cnt,
+                          bool write);
+
+static thread_func channel_thread NO_RETURN;
 static void interrupt_handler (struct intr_frame *);
 
-/* Initialize the disk subsystem and detect disks. */
+/* Initialize the disk subsystem and detect disks.
+   Probing a channel means waiting for its disks to reset, so the
+   channels are probed by a thread apiece at the same time.  The
+   disks are registered afterward, in a fixed order, so that
+   default device roles do not depend on which probe finished
+   first. */
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
+  sema_init (&probe_done, 0);
+
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
     {
       struct channel *c = &channels[chan_no];
@@ -126,6 +241,13 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->bm_base = bm_base != 0 ? bm_base + 8 * chan_no : 0;
+      list_init (&c->queue);
+      lock_init (&c->queue_lock);
+      cond_init (&c->queue_cond);
+      c->head_key = 0;
+      c->request_cnt = c->command_cnt = c->sector_cnt = 0;
+      c->busy_ticks = 0;
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,29 +258,83 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->dma = false;
         }
 
-      /* Register interrupt handler. */
+      /* Register interrupt handler and start servicing the
+         request queue. */
       intr_register_ext (c->irq, interrupt_handler, c->name);
+      thread_create (c->name, PRI_MAX, channel_thread, c);
 
-      /* Reset hardware. */
-      reset_channel (c);
+      /* Find out what is attached. */
+      thread_create ("ide-probe", PRI_DEFAULT, probe_channel, c);
+    }
 
-      /* Distinguish ATA hard disks from other devices. */
-      if (check_device_type (&c->devices[0]))
-        check_device_type (&c->devices[1]);
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    sema_down (&probe_done);
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+      int dev_no;
 
-      /* Read hard disk identity information. */
       for (dev_no = 0; dev_no < 2; dev_no++)
         if (c->devices[dev_no].is_ata)
-          identify_ata_device (&c->devices[dev_no]);
+          register_ata_device (&c->devices[dev_no]);
     }
 }
 
+/* Prints the number of requests each channel with a disk on it
+   has serviced, and the share of time it spent transferring.
+   Busy time counts the timer ticks that passed during each
+   transfer, so it is only accurate over many transfers. */
+void
+ide_print_stats (void)
+{
+  int64_t ticks = timer_ticks ();
+  size_t chan_no;
+
+  for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
+    {
+      struct channel *c = &channels[chan_no];
+
+      if (!c->devices[0].is_ata && !c->devices[1].is_ata)
+        continue;
+      printf ("%s: %llu requests in %llu commands, %llu sectors, "
+              "busy %"PRId64" of %"PRId64" ticks (%"PRId64"%%)\n",
+              c->name, c->request_cnt, c->command_cnt, c->sector_cnt,
+              c->busy_ticks, ticks,
+              ticks > 0 ? c->busy_ticks * 100 / ticks : 0);
+    }
+}
+
 /* Disk detection and identification. */
 
 static char *descramble_ata_string (char *, int size);
 
+/* Thread function that resets channel C_, identifies the ATA
+   disks attached to it, and ups probe_done. */
+static void
+probe_channel (void *c_) 
+{
+  struct channel *c = c_;
+  int dev_no;
+
+  /* Reset hardware. */
+  reset_channel (c);
+
+  /* Distinguish ATA hard disks from other devices. */
+  if (check_device_type (&c->devices[0]))
+    check_device_type (&c->devices[1]);
+
+  /* Read hard disk identity information. */
+  for (dev_no = 0; dev_no < 2; dev_no++)
+    if (c->devices[dev_no].is_ata)
+      identify_ata_device (&c->devices[dev_no]);
+
+  sema_up (&probe_done);
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -254,17 +430,13 @@ check_device_type (struct ata_disk *d)
 }
 
 /* Sends an IDENTIFY DEVICE command to disk D and reads the
-   response.  Registers the disk with the block device
-   layer. */
+   response into D. */
 static void
 identify_ata_device (struct ata_disk *d) 
 {
   struct channel *c = d->channel;
   char id[BLOCK_SECTOR_SIZE];
-  block_sector_t capacity;
   char *model, *serial;
-  char extra_info[128];
-  struct block *block;
 
   ASSERT (d->is_ata);
 
@@ -283,28 +455,42 @@ identify_ata_device (struct ata_disk *d)
 
   /* Calculate capacity.
      Read model name and serial number. */
-  capacity = *(uint32_t *) &id[60 * 2];
+  d->capacity = *(uint32_t *) &id[60 * 2];
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
-  snprintf (extra_info, sizeof extra_info,
+  snprintf (d->info, sizeof d->info,
             "model \"%s\", serial \"%s\"", model, serial);
 
+  /* Use DMA if the controller can master the bus and the disk
+     supports DMA (IDENTIFY word 49, bit 8). */
+  d->dma = c->bm_base != 0 && (*(uint16_t *) &id[49 * 2] & 0x100) != 0;
+}
+
+/* Registers identified disk D with the block device layer and
+   scans it for partitions. */
+static void
+register_ata_device (struct ata_disk *d) 
+{
+  struct block *block;
+
+  ASSERT (d->is_ata);
+
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
      allow access to those, we're less likely to scribble on
      someone's important data.  You can disable this check by
      hand if you really want to do so. */
-  if (capacity >= 1024 * 1024 * 1024 / BLOCK_SECTOR_SIZE)
+  if (d->capacity >= 1024 * 1024 * 1024 / BLOCK_SECTOR_SIZE)
     {
       printf ("%s: ignoring ", d->name);
-      print_human_readable_size (capacity * 512);
+      print_human_readable_size (d->capacity * 512);
       printf ("disk for safety\n");
       d->is_ata = false;
       return;
     }
 
   /* Register. */
-  block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
+  block = block_register (d->name, BLOCK_RAW, d->info, d->capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
@@ -337,63 +523,281 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
+/* Returns the position of request R in the scheduling order:
+   its device number, then its first sector. */
+static uint32_t
+request_key (const struct block_request *r)
+{
+  const struct ata_disk *d = r->driver_aux;
+  return ((uint32_t) d->dev_no << 28) | r->sector;
+}
+
+/* Returns true if request A precedes request B in the scheduling
+   order. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a = list_entry (a_, struct block_request, elem);
+  const struct block_request *b = list_entry (b_, struct block_request, elem);
+
+  return request_key (a) < request_key (b);
+}
+
+/* Queues request R for disk D.  The block layer has already
+   checked it. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_submit (void *d_, struct block_request *r)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
-  lock_release (&c->lock);
+
+  lock_acquire (&c->queue_lock);
+  list_insert_ordered (&c->queue, &r->elem, request_less, NULL);
+  cond_signal (&c->queue_cond, &c->queue_lock);
+  lock_release (&c->queue_lock);
 }
 
-/* Write sector SEC_NO to disk D from BUFFER, which must contain
-   BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
-   acknowledged receiving the data.
-   Internally synchronizes accesses to disks, so external
-   per-disk locking is unneeded. */
-static void
-ide_write (void *d_, block_sector_t sec_no, const void *buffer)
+/* Returns the channel that disk D is attached to. */
+static void *
+ide_channel (void *d_)
 {
   struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  return d->channel;
 }
 
 static struct block_operations ide_operations =
   {
-    ide_read,
-    ide_write
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    ide_submit,
+    ide_channel
   };
-
+
+/* Transfers the sectors starting at SEC_NO of disk D to the
+   SEG_CNT segments in SEGS, or from them if WRITE is true, by PIO
+   in a single command, taking one interrupt per sector. */
+static void
+pio_transfer (struct ata_disk *d, block_sector_t sec_no,
+              const struct segment segs[], size_t seg_cnt, bool write)
+{
+  struct channel *c = d->channel;
+  size_t cnt = 0;
+  size_t i, j;
+
+  for (i = 0; i < seg_cnt; i++)
+    cnt += segs[i].cnt;
+
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, (write
+                         ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY));
+  for (i = 0; i < seg_cnt; i++)
+    for (j = 0; j < segs[i].cnt; j++, sec_no++)
+      {
+        uint8_t *sector = segs[i].buffer + j * BLOCK_SECTOR_SIZE;
+
+        if (!write)
+          sema_down (&c->completion_wait);
+        if (!wait_while_busy (d))
+          PANIC ("%s: disk %s failed, sector=%"PRDSNu,
+                 d->name, write ? "write" : "read", sec_no);
+        if (write)
+          {
+            output_sector (c, sector);
+            sema_down (&c->completion_wait);
+          }
+        else
+          input_sector (c, sector);
+      }
+}
+
+/* Transfers the sectors starting at SEC_NO of disk D to or from
+   SEGS, as pio_transfer() does, by DMA if possible and otherwise
+   by PIO.  D's channel must be locked. */
+static void
+transfer (struct ata_disk *d, block_sector_t sec_no,
+          const struct segment segs[], size_t seg_cnt, bool write)
+{
+  size_t cnt = 0;
+  size_t i;
+
+  for (i = 0; i < seg_cnt; i++)
+    cnt += segs[i].cnt;
+
+  TRACE (write ? TRACE_IDE_WRITE : TRACE_IDE_READ, sec_no, cnt);
+  if (!d->dma || !dma_transfer (d, sec_no, segs, seg_cnt, write))
+    pio_transfer (d, sec_no, segs, seg_cnt, write);
+  TRACE (TRACE_IDE_DONE, sec_no, cnt);
+}
+
+/* Carries out the N requests in BATCH on disk D.  If N > 1, the
+   requests are for consecutive runs of sectors, together no
+   more than MAX_XFER_SECTORS, and move in a single command.  A
+   single request is split into commands of up to
+   MAX_XFER_SECTORS sectors.  D's channel must be locked. */
+static void
+ide_transfer (struct ata_disk *d, struct block_request *batch[], size_t n)
+{
+  struct segment segs[MERGE_MAX];
+  block_sector_t sec_no = batch[0]->sector;
+  bool write = batch[0]->write;
+  size_t i;
+
+  if (n == 1)
+    {
+      uint8_t *buffer = batch[0]->buffer;
+      size_t cnt = batch[0]->cnt;
+
+      while (cnt > 0)
+        {
+          segs[0].buffer = buffer;
+          segs[0].cnt = cnt < MAX_XFER_SECTORS ? cnt : MAX_XFER_SECTORS;
+          transfer (d, sec_no, segs, 1, write);
+
+          sec_no += segs[0].cnt;
+          buffer += segs[0].cnt * BLOCK_SECTOR_SIZE;
+          cnt -= segs[0].cnt;
+        }
+      return;
+    }
+
+  for (i = 0; i < n; i++)
+    {
+      segs[i].buffer = batch[i]->buffer;
+      segs[i].cnt = batch[i]->cnt;
+    }
+  transfer (d, sec_no, segs, n, write);
+}
+
+/* Removes and returns the request that channel C should service
+   next: the oldest request if it has waited DEADLINE_TICKS,
+   otherwise, among the requests of the highest priority waiting,
+   the first at or after `head_key', or failing that the first in
+   the queue.  C's queue must be locked and not empty. */
+static struct block_request *
+next_request (struct channel *c)
+{
+  struct list_elem *oldest = list_begin (&c->queue);
+  struct list_elem *first = NULL;
+  struct list_elem *next = NULL;
+  struct list_elem *e;
+  int priority = PRI_MIN;
+
+  for (e = list_begin (&c->queue); e != list_end (&c->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+
+      if (r->priority > priority || first == NULL)
+        {
+          priority = r->priority;
+          first = e;
+          next = NULL;
+        }
+      if (r->priority == priority && next == NULL
+          && request_key (r) >= c->head_key)
+        next = e;
+      if (r->submit_time
+          < list_entry (oldest, struct block_request, elem)->submit_time)
+        oldest = e;
+    }
+
+  if (timer_elapsed (list_entry (oldest, struct block_request,
+                                 elem)->submit_time) >= DEADLINE_TICKS)
+    next = oldest;
+  else if (next == NULL)
+    next = first;
+  list_remove (next);
+  return list_entry (next, struct block_request, elem);
+}
+
+/* Moves requests that continue BATCH[0] from channel C's queue
+   into BATCH: requests in the same direction for the sectors
+   right after it, up to MERGE_MAX requests and MAX_XFER_SECTORS
+   sectors in all.  Returns the number of requests in BATCH.  C's
+   queue must be locked. */
+static size_t
+merge_requests (struct channel *c, struct block_request *batch[])
+{
+  size_t cnt = batch[0]->cnt;
+  uint32_t end = request_key (batch[0]) + cnt;
+  size_t n = 1;
+  struct list_elem *e;
+
+  e = list_begin (&c->queue);
+  while (e != list_end (&c->queue) && n < MERGE_MAX)
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      uint32_t key = request_key (r);
+
+      if (key > end)
+        break;
+      if (key == end && r->write == batch[0]->write
+          && cnt + r->cnt <= MAX_XFER_SECTORS)
+        {
+          e = list_remove (e);
+          batch[n++] = r;
+          cnt += r->cnt;
+          end += r->cnt;
+        }
+      else
+        e = list_next (e);
+    }
+  return n;
+}
+
+/* Services channel C_'s request queue, forever. */
+static void
+channel_thread (void *c_)
+{
+  struct channel *c = c_;
+
+  for (;;)
+    {
+      struct block_request *batch[MERGE_MAX];
+      struct block_request *last;
+      int64_t start;
+      size_t n, i;
+
+      lock_acquire (&c->queue_lock);
+      while (list_empty (&c->queue))
+        cond_wait (&c->queue_cond, &c->queue_lock);
+      batch[0] = next_request (c);
+      n = merge_requests (c, batch);
+      last = batch[n - 1];
+      c->head_key = request_key (last) + last->cnt;
+      lock_release (&c->queue_lock);
+
+      lock_acquire (&c->lock);
+      start = timer_ticks ();
+      ide_transfer (batch[0]->driver_aux, batch, n);
+      c->busy_ticks += timer_elapsed (start);
+      c->request_cnt += n;
+      c->command_cnt++;
+      for (i = 0; i < n; i++)
+        c->sector_cnt += batch[i]->cnt;
+      lock_release (&c->lock);
+      for (i = 0; i < n; i++)
+        block_complete (batch[i]);
+    }
+}
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the number of sectors CNT, between 1 and 256,
+   to the disk's sector selection registers.  (We use LBA
+   mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= 256);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -430,6 +834,146 @@ output_sector (struct channel *c, const void *sector)
   outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Bus-master DMA. */
+
+/* Looks on PCI bus 0 for an IDE controller that can do bus-master
+   DMA, enables bus mastering on it, and returns the base I/O port
+   of its bus master registers.  Returns 0 if there is none. */
+static uint16_t
+find_bus_master (void) 
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t class = pci_read_config (dev, func, PCI_REG_CLASS);
+        uint32_t bar4;
+
+        /* Skip empty slots. */
+        if ((pci_read_config (dev, func, PCI_REG_ID) & 0xffff) == 0xffff)
+          continue;
+
+        /* Mass storage (class 1), IDE (subclass 1), bus master
+           capable (bit 7 of the programming interface). */
+        if ((class >> 16) != 0x0101 || !(class & 0x8000))
+          continue;
+
+        /* The bus master registers are at I/O space BAR 4. */
+        bar4 = pci_read_config (dev, func, PCI_REG_BAR0 + 16);
+        if (!(bar4 & 1) || (bar4 & ~3u) == 0)
+          continue;
+
+        pci_enable (dev, func, PCI_CMD_IO | PCI_CMD_MASTER);
+        return bar4 & ~3u;
+      }
+  return 0;
+}
+
+/* Returns true if the SIZE bytes at BUFFER can be the target of
+   a DMA transfer, that is, if they are word-aligned and lie in
+   the kernel's mapping of physical memory, so that they are
+   physically contiguous. */
+static bool
+dma_buffer_ok (const void *buffer, size_t size) 
+{
+  return (is_kernel_vaddr (buffer)
+          && vtop (buffer) + size <= init_ram_pages * PGSIZE
+          && ((uintptr_t) buffer & 1) == 0);
+}
+
+/* Fills in channel C's physical region descriptor table to
+   describe the SEG_CNT segments in SEGS, which must be at kernel
+   addresses.  Returns false if that needs more than PRD_CNT
+   entries. */
+static bool
+fill_prdt (struct channel *c, const struct segment segs[], size_t seg_cnt)
+{
+  size_t i = 0;
+  size_t k;
+
+  for (k = 0; k < seg_cnt; k++)
+    {
+      uintptr_t addr = vtop (segs[k].buffer);
+      size_t size = segs[k].cnt * BLOCK_SECTOR_SIZE;
+
+      while (size > 0)
+        {
+          size_t chunk = 0x10000 - (addr & 0xffff);
+
+          if (i >= PRD_CNT)
+            return false;
+          if (chunk > size)
+            chunk = size;
+          c->prdt[i].addr = addr;
+          c->prdt[i].size = chunk & 0xffff;
+          c->prdt[i].flags = 0;
+          addr += chunk;
+          size -= chunk;
+          i++;
+        }
+    }
+  c->prdt[i - 1].flags = PRD_EOT;
+  return true;
+}
+
+/* Transfers the sectors starting at SEC_NO of disk D to the
+   SEG_CNT segments in SEGS, or from them if WRITE is true, by
+   bus-master DMA in a single command.  Returns true if
+   successful.  Returns false without doing anything if a segment
+   fails dma_buffer_ok() or the segments need too many physical
+   regions.  If the transfer itself fails, prints a message,
+   turns off DMA for D, so that the caller and later transfers
+   fall back to PIO, and returns false.  D's channel must be
+   locked. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no,
+              const struct segment segs[], size_t seg_cnt, bool write) 
+{
+  struct channel *c = d->channel;
+  uint8_t direction = write ? 0 : BMC_READ;
+  uint8_t bm_status, status;
+  size_t cnt = 0;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  for (i = 0; i < seg_cnt; i++)
+    {
+      if (!dma_buffer_ok (segs[i].buffer, segs[i].cnt * BLOCK_SECTOR_SIZE))
+        return false;
+      cnt += segs[i].cnt;
+    }
+  if (!fill_prdt (c, segs, seg_cnt))
+    return false;
+
+  /* Point the controller at the table and clear old status. */
+  outl (reg_bm_prdt (c), vtop (c->prdt));
+  outb (reg_bm_command (c), direction);
+  outb (reg_bm_status (c), BMS_ERROR | BMS_INTR);
+
+  /* Issue the command, start the transfer, and sleep until the
+     disk interrupts at the end. */
+  select_sector (d, sec_no, cnt);
+  issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+  outb (reg_bm_command (c), direction | BMC_START);
+  sema_down (&c->completion_wait);
+
+  /* Stop the engine and check how it went. */
+  outb (reg_bm_command (c), direction);
+  bm_status = inb (reg_bm_status (c));
+  outb (reg_bm_status (c), BMS_ERROR | BMS_INTR);
+  status = inb (reg_alt_status (c));
+  if ((bm_status & BMS_ERROR) || (status & STA_ERR))
+    {
+      printf ("%s: DMA %s failed, sector=%"PRDSNu", using PIO\n",
+              d->name, write ? "write" : "read", sec_no);
+      d->dma = false;
+      return false;
+    }
+  return true;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -2,15 +2,28 @@
 #include <debug.h>
 #include "devices/intq.h"
 #include "devices/serial.h"
+#include "threads/synch.h"
+#include "threads/waitq.h"
 
-/* Stores keys from the keyboard and serial port. */
-static struct intq buffer;
+/* Stores keys from the keyboard and serial port.  The keyboard
+   and serial interrupt handlers add keys (external interrupts do
+   not nest, so there is only one producer at a time) and threads
+   remove them, one thread at a time under consumer_lock, without
+   turning interrupts off.  Threads in poll() wait on WAITERS
+   for keys to arrive. */
+static struct intq_spsc buffer;
+static struct lock consumer_lock;
+static struct wait_queue waiters;
+
+static void notify_serial (void);
 
 /* Initializes the input buffer. */
 void
 input_init (void) 
 {
-  intq_init (&buffer);
+  intq_spsc_init (&buffer);
+  lock_init (&consumer_lock);
+  waitq_init (&waiters);
 }
 
 /* Adds a key to the input buffer.
@@ -18,11 +31,14 @@ input_init (void)
 void
 input_putc (uint8_t key) 
 {
+  size_t cnt UNUSED;
+
   ASSERT (intr_get_level () == INTR_OFF);
-  ASSERT (!intq_full (&buffer));
 
-  intq_putc (&buffer, key);
+  cnt = intq_put_bytes (&buffer, &key, 1);
+  ASSERT (cnt == 1);
   serial_notify ();
+  waitq_wake (&waiters);
 }
 
 /* Retrieves a key from the input buffer.
@@ -30,23 +46,90 @@ input_putc (uint8_t key)
 uint8_t
 input_getc (void) 
 {
-  enum intr_level old_level;
   uint8_t key;
 
-  old_level = intr_disable ();
-  key = intq_getc (&buffer);
-  serial_notify ();
-  intr_set_level (old_level);
-  
+  input_read (&key, 1, INPUT_RAW);
   return key;
 }
 
+/* Reads up to SIZE keys into BUF and returns the number read.
+   Keys already in the input buffer are taken in bulk, without
+   turning interrupts off.
+   With INPUT_RAW, waits for keys until SIZE have been read.
+   With INPUT_LINE, also stops after a new-line; a carriage
+   return, which is what Enter sends, is stored as a new-line.
+   With INPUT_NONBLOCK, never waits, and returns 0 if no key has
+   been typed. */
+size_t
+input_read (uint8_t *buf, size_t size, enum input_mode mode) 
+{
+  size_t cnt = 0;
+
+  lock_acquire (&consumer_lock);
+  while (cnt < size)
+    {
+      size_t n;
+
+      /* A line must end at its new-line, so take keys one at a
+         time, otherwise as many as are there. */
+      n = intq_get_bytes (&buffer, buf + cnt,
+                          mode == INPUT_LINE ? 1 : size - cnt);
+      if (n == 0)
+        {
+          /* Let the serial port refill the buffer, which may have
+             stopped it while full. */
+          notify_serial ();
+          if (mode == INPUT_NONBLOCK)
+            break;
+          intq_spsc_wait (&buffer);
+          continue;
+        }
+
+      if (mode == INPUT_LINE)
+        {
+          uint8_t *key = &buf[cnt];
+          if (*key == '\r')
+            *key = '\n';
+          if (*key == '\n')
+            {
+              cnt++;
+              break;
+            }
+        }
+      cnt += n;
+    }
+  lock_release (&consumer_lock);
+  notify_serial ();
+
+  return cnt;
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
-   Interrupts must be off. */
+   Only meaningful to the interrupt handlers that add keys. */
 bool
 input_full (void) 
 {
-  ASSERT (intr_get_level () == INTR_OFF);
-  return intq_full (&buffer);
+  return intq_spsc_full (&buffer);
+}
+
+/* Returns true if a key can be read without waiting.  If PT is
+   nonnull, first puts it on the queue woken when a key
+   arrives. */
+bool
+input_poll (struct poll_table *pt)
+{
+  if (pt != NULL)
+    poll_register (pt, &waiters);
+  return !intq_spsc_empty (&buffer);
+}
+
+/* Tells the serial driver that keys have been removed from the
+   buffer, so that it may resume receiving. */
+static void
+notify_serial (void)
+{
+  enum intr_level old_level = intr_disable ();
+  serial_notify ();
+  intr_set_level (old_level);
 }
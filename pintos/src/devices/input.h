@@ -2,11 +2,24 @@
 #define DEVICES_INPUT_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+struct poll_table;
+
+/* How input_read() decides it has read enough. */
+enum input_mode
+  {
+    INPUT_RAW,                  /* Wait for all SIZE keys. */
+    INPUT_LINE,                 /* Stop after a new-line. */
+    INPUT_NONBLOCK              /* Take only keys already typed. */
+  };
+
 void input_init (void);
 void input_putc (uint8_t);
 uint8_t input_getc (void);
+size_t input_read (uint8_t *, size_t size, enum input_mode);
 bool input_full (void);
+bool input_poll (struct poll_table *);
 
 #endif /* devices/input.h */
@@ -112,3 +112,100 @@ signal (struct intq *q UNUSED, struct thread **waiter)
       *waiter = NULL;
     }
 }
+
+/* Lock-free single-producer, single-consumer queues.
+
+   HEAD and TAIL count bytes since initialization and wrap around
+   freely; their difference is the number of bytes in the queue.
+   Each side reads the other's index with acquire semantics and
+   publishes its own with release semantics, so that the bytes
+   are seen to arrive before HEAD moves past them and leave
+   before TAIL does. */
+
+/* Initializes single-producer, single-consumer queue Q. */
+void
+intq_spsc_init (struct intq_spsc *q)
+{
+  q->head = q->tail = 0;
+  sema_init (&q->not_empty, 0);
+}
+
+/* Returns the number of bytes in Q. */
+static unsigned
+spsc_used (const struct intq_spsc *q)
+{
+  return (__atomic_load_n (&q->head, __ATOMIC_ACQUIRE)
+          - __atomic_load_n (&q->tail, __ATOMIC_ACQUIRE));
+}
+
+/* Returns true if Q is empty.  Only the consumer can rely on a
+   false result, since only it removes bytes. */
+bool
+intq_spsc_empty (const struct intq_spsc *q)
+{
+  return spsc_used (q) == 0;
+}
+
+/* Returns true if Q is full.  Only the producer can rely on a
+   false result, since only it adds bytes. */
+bool
+intq_spsc_full (const struct intq_spsc *q)
+{
+  return spsc_used (q) == INTQ_BUFSIZE;
+}
+
+/* Adds up to N bytes from BUF to the end of Q and returns the
+   number added, which is less than N only if Q fills up.  Only
+   Q's producer may call this. */
+size_t
+intq_put_bytes (struct intq_spsc *q, const uint8_t *buf, size_t n)
+{
+  unsigned head = q->head;
+  unsigned tail = __atomic_load_n (&q->tail, __ATOMIC_ACQUIRE);
+  size_t room = INTQ_BUFSIZE - (head - tail);
+  size_t i;
+
+  if (n > room)
+    n = room;
+  for (i = 0; i < n; i++)
+    q->buf[(head + i) % INTQ_BUFSIZE] = buf[i];
+  __atomic_store_n (&q->head, head + n, __ATOMIC_RELEASE);
+
+  /* Wake a consumer that may be waiting for the first byte. */
+  if (n > 0 && head == tail)
+    sema_up (&q->not_empty);
+  return n;
+}
+
+/* Removes up to N bytes from the front of Q into BUF and returns
+   the number removed, which is less than N only if Q runs out.
+   Only Q's consumer may call this. */
+size_t
+intq_get_bytes (struct intq_spsc *q, uint8_t *buf, size_t n)
+{
+  unsigned tail = q->tail;
+  unsigned head = __atomic_load_n (&q->head, __ATOMIC_ACQUIRE);
+  size_t used = head - tail;
+  size_t i;
+
+  if (n > used)
+    n = used;
+  for (i = 0; i < n; i++)
+    buf[i] = q->buf[(tail + i) % INTQ_BUFSIZE];
+  __atomic_store_n (&q->tail, tail + n, __ATOMIC_RELEASE);
+  return n;
+}
+
+/* Sleeps until Q is not empty.  Only Q's consumer may call this,
+   and not from an interrupt handler. */
+void
+intq_spsc_wait (struct intq_spsc *q)
+{
+  ASSERT (!intr_context ());
+
+  /* The producer ups the semaphore whenever it adds to an empty
+     queue, so a wake-up left over from earlier costs at most one
+     extra trip around this loop. */
+  while (intq_spsc_empty (q))
+    sema_down (&q->not_empty);
+}
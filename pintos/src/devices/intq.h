@@ -1,6 +1,8 @@
 #ifndef DEVICES_INTQ_H
 #define DEVICES_INTQ_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 
@@ -17,8 +19,10 @@
    protect kernel threads from one another, not from interrupt
    handlers. */
 
-/* Queue buffer size, in bytes. */
-#define INTQ_BUFSIZE 64
+/* Queue buffer size, in bytes.  Must be a power of 2.  Large enough that a burst of
+   console output queues up for the serial port rather than making
+   the writer wait for the UART. */
+#define INTQ_BUFSIZE 1024
 
 /* A circular queue of bytes. */
 struct intq
@@ -40,4 +44,33 @@ bool intq_full (const struct intq *);
 uint8_t intq_getc (struct intq *);
 void intq_putc (struct intq *, uint8_t);
 
+/* A lock-free variant for a single producer and a single
+   consumer, which need not turn interrupts off.
+
+   At any time, at most one thread or interrupt handler may be
+   adding bytes and at most one removing them.  Typically the
+   producer is an interrupt handler and the consumer a kernel
+   thread, with a lock if several threads might consume.  Each
+   side writes only its own index, and publishes it only after
+   the bytes it covers are in place, so the two sides never need
+   to exclude each other.
+
+   Neither side ever blocks inside intq_put_bytes() or
+   intq_get_bytes().  A consumer that finds the queue empty may
+   sleep in intq_spsc_wait() until the producer adds more. */
+struct intq_spsc
+  {
+    uint8_t buf[INTQ_BUFSIZE];  /* Buffer. */
+    unsigned head;              /* Bytes ever added, by producer. */
+    unsigned tail;              /* Bytes ever removed, by consumer. */
+    struct semaphore not_empty; /* Up'd when Q stops being empty. */
+  };
+
+void intq_spsc_init (struct intq_spsc *);
+bool intq_spsc_empty (const struct intq_spsc *);
+bool intq_spsc_full (const struct intq_spsc *);
+size_t intq_put_bytes (struct intq_spsc *, const uint8_t *, size_t);
+size_t intq_get_bytes (struct intq_spsc *, uint8_t *, size_t);
+void intq_spsc_wait (struct intq_spsc *);
+
 #endif /* devices/intq.h */
@@ -0,0 +1,153 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include <stddef.h>
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Interface to the local APIC (Advanced Programmable Interrupt
+   Controller) built into each processor.  Refer to [IA32-v3a]
+   chapter 10 "Advanced Programmable Interrupt Controller".
+
+   For now the local APIC is used only to send the interprocessor
+   interrupts that start the application processors.  Device
+   interrupts still arrive through the 8259A PIC, which the BIOS
+   leaves wired to the bootstrap processor's LINT0 pin. */
+
+/* Kernel virtual address at which the local APIC's registers are
+   mapped.  This is the last page of the address space, well
+   above the mapping of physical memory at PHYS_BASE. */
+#define LAPIC_VADDR ((void *) 0xfffff000)
+
+/* Register offsets, in bytes. */
+#define LAPIC_ID     0x020      /* Local APIC ID. */
+#define LAPIC_SVR    0x0f0      /* Spurious interrupt vector. */
+#define LAPIC_ESR    0x280      /* Error status. */
+#define LAPIC_ICRLO  0x300      /* Interrupt command, low word. */
+#define LAPIC_ICRHI  0x310      /* Interrupt command, high word. */
+
+/* LAPIC_SVR bits. */
+#define SVR_ENABLE   0x100      /* APIC software enable. */
+#define SVR_VECTOR   0xff       /* Spurious interrupt vector. */
+
+/* LAPIC_ICRLO bits. */
+#define ICR_INIT     0x00500    /* INIT delivery mode. */
+#define ICR_STARTUP  0x00600    /* Start-up delivery mode. */
+#define ICR_PENDING  0x01000    /* Delivery status: send pending. */
+#define ICR_ASSERT   0x04000    /* Level assert. */
+#define ICR_LEVEL    0x08000    /* Level triggered. */
+
+/* Mapped registers, or a null pointer if there is no local
+   APIC. */
+static volatile uint32_t *lapic;
+
+/* Reads the register at byte offset REG. */
+static inline uint32_t
+lapic_read (size_t reg)
+{
+  return lapic[reg / sizeof *lapic];
+}
+
+/* Writes VALUE to the register at byte offset REG, then reads
+   back the ID register to wait for the write to finish. */
+static inline void
+lapic_write (size_t reg, uint32_t value)
+{
+  lapic[reg / sizeof *lapic] = value;
+  lapic_read (LAPIC_ID);
+}
+
+/* Maps the local APIC, whose registers are at physical address
+   PADDR, into the kernel address space and enables the local
+   APIC of the processor that calls this function.  Must be
+   called before any page directory is created from
+   init_page_dir, because only init_page_dir gets the new
+   mapping. */
+void
+lapic_init (uintptr_t paddr)
+{
+  uint32_t *pde, *pt;
+
+  ASSERT (pg_ofs ((void *) paddr) == 0);
+
+  pde = &init_page_dir[pd_no (LAPIC_VADDR)];
+  ASSERT (!(*pde & PTE_PS));
+  if (*pde == 0)
+    {
+      pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+      *pde = pde_create (pt);
+    }
+  else
+    pt = pde_get_pt (*pde);
+
+  /* Device registers must never be cached. */
+  pt[pt_no (LAPIC_VADDR)] = paddr | PTE_PCD | PTE_PWT | PTE_W | PTE_P;
+  asm volatile ("invlpg (%0)" : : "r" (LAPIC_VADDR) : "memory");
+  lapic = LAPIC_VADDR;
+
+  lapic_enable ();
+}
+
+/* Returns true if lapic_init() has mapped a local APIC. */
+bool
+lapic_present (void)
+{
+  return lapic != NULL;
+}
+
+/* Software-enables the calling processor's local APIC.  The local
+   interrupt pins keep the configuration the BIOS gave them. */
+void
+lapic_enable (void)
+{
+  ASSERT (lapic != NULL);
+  lapic_write (LAPIC_SVR, lapic_read (LAPIC_SVR) | SVR_ENABLE | SVR_VECTOR);
+  lapic_write (LAPIC_ESR, 0);
+}
+
+/* Returns the APIC ID of the calling processor. */
+uint8_t
+lapic_id (void)
+{
+  ASSERT (lapic != NULL);
+  return lapic_read (LAPIC_ID) >> 24;
+}
+
+/* Sends an interprocessor interrupt with command word LO to the
+   processor with APIC ID APIC_ID and waits until it has been
+   delivered. */
+static void
+send_ipi (uint8_t apic_id, uint32_t lo)
+{
+  lapic_write (LAPIC_ICRHI, (uint32_t) apic_id << 24);
+  lapic_write (LAPIC_ICRLO, lo);
+  while (lapic_read (LAPIC_ICRLO) & ICR_PENDING)
+    continue;
+}
+
+/* Starts the application processor with APIC ID APIC_ID running
+   real-mode code at physical address ENTRY, which must be
+   page-aligned and below 1 MB.  Follows the INIT-SIPI-SIPI
+   sequence in [MP] appendix B.4 "Application Processor
+   Startup". */
+void
+lapic_start_ap (uint8_t apic_id, uintptr_t entry)
+{
+  int i;
+
+  ASSERT (lapic != NULL);
+  ASSERT (entry % PGSIZE == 0 && entry < 0x100000);
+
+  send_ipi (apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+  timer_udelay (200);
+  send_ipi (apic_id, ICR_INIT | ICR_LEVEL);
+  timer_msleep (10);
+
+  for (i = 0; i < 2; i++)
+    {
+      send_ipi (apic_id, ICR_STARTUP | (entry >> 12));
+      timer_udelay (200);
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Usual physical address of the local APIC's registers. */
+#define LAPIC_DEFAULT_PADDR 0xfee00000
+
+void lapic_init (uintptr_t paddr);
+bool lapic_present (void);
+void lapic_enable (void);
+uint8_t lapic_id (void);
+void lapic_start_ap (uint8_t apic_id, uintptr_t entry);
+
+#endif /* devices/lapic.h */
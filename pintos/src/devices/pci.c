@@ -0,0 +1,61 @@
+#include "devices/pci.h"
+#include "threads/io.h"
+
+/* PCI configuration space access, for the devices on bus 0,
+   through configuration mechanism #1.  Which is all that the
+   emulators we run on provide. */
+
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Returns the 32-bit register at byte offset REG in the
+   configuration space of PCI function FUNC of device DEV on
+   bus 0. */
+uint32_t
+pci_read_config (int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit register at byte offset REG in the
+   configuration space of PCI function FUNC of device DEV on
+   bus 0. */
+void
+pci_write_config (int dev, int func, int reg, uint32_t value)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Looks on bus 0 for the next function with the given VENDOR and
+   DEVICE IDs, starting at device *DEV, function *FUNC.  If one is
+   found, stores its location in *DEV and *FUNC and returns true;
+   otherwise returns false.  To find every match, start at 0, 0
+   and then just past each match found. */
+bool
+pci_find_device (uint16_t vendor, uint16_t device, int *dev, int *func)
+{
+  uint32_t id = ((uint32_t) device << 16) | vendor;
+  int d, f;
+
+  for (d = *dev; d < 32; d++)
+    for (f = d == *dev ? *func : 0; f < 8; f++)
+      if (pci_read_config (d, f, PCI_REG_ID) == id)
+        {
+          *dev = d;
+          *func = f;
+          return true;
+        }
+  return false;
+}
+
+/* Sets the bits in COMMAND in the command register of function
+   FUNC of device DEV.  The upper half of the register is status,
+   whose bits clear on writing 1, so it is written as 0. */
+void
+pci_enable (int dev, int func, uint16_t command)
+{
+  uint32_t old = pci_read_config (dev, func, PCI_REG_COMMAND) & 0xffff;
+  pci_write_config (dev, func, PCI_REG_COMMAND, old | command);
+}
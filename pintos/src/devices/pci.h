@@ -0,0 +1,24 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Offsets of registers in a function's configuration space. */
+#define PCI_REG_ID 0x00         /* Device ID (high), vendor ID (low). */
+#define PCI_REG_COMMAND 0x04    /* Status (high), command (low). */
+#define PCI_REG_CLASS 0x08      /* Class, subclass, interface, rev. */
+#define PCI_REG_BAR0 0x10       /* First of six base address registers. */
+#define PCI_REG_INTR 0x3c       /* Interrupt pin and line, low bytes. */
+
+/* Command register bits. */
+#define PCI_CMD_IO 0x0001       /* Respond to I/O space accesses. */
+#define PCI_CMD_MASTER 0x0004   /* Allow bus mastering. */
+
+uint32_t pci_read_config (int dev, int func, int reg);
+void pci_write_config (int dev, int func, int reg, uint32_t value);
+bool pci_find_device (uint16_t vendor, uint16_t device, int *dev,
+                      int *func);
+void pci_enable (int dev, int func, uint16_t command);
+
+#endif /* devices/pci.h */
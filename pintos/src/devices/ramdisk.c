@@ -0,0 +1,81 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/vmalloc.h"
+
+/* A block device held in kernel memory.
+
+   Its contents start out zeroed and are lost at shutdown, so it
+   suits scratch space and file system benchmarks that should not
+   depend on the speed of the emulated disk.  It registers as a
+   raw device named "ram0", which the "-filesys" or "-scratch"
+   option can then name to put it in that role. */
+
+/* Kernel virtual address of the contents. */
+static uint8_t *ram_base;
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a RAM disk of KB kilobytes, rounded down to whole
+   sectors, or does nothing if KB is 0. */
+void
+ramdisk_init (size_t kb)
+{
+  block_sector_t size = kb * 1024 / BLOCK_SECTOR_SIZE;
+
+  if (size == 0)
+    return;
+
+  ram_base = vmalloc ((size_t) size * BLOCK_SECTOR_SIZE);
+  if (ram_base == NULL)
+    PANIC ("ramdisk: cannot allocate %zu kB", kb);
+  memset (ram_base, 0, (size_t) size * BLOCK_SECTOR_SIZE);
+
+  block_register ("ram0", BLOCK_RAW, "RAM disk", size,
+                  &ramdisk_operations, NULL);
+}
+
+/* Reads the CNT sectors starting at SECTOR into BUFFER. */
+static void
+ramdisk_read_multiple (void *aux UNUSED, block_sector_t sector, size_t cnt,
+                       void *buffer)
+{
+  memcpy (buffer, ram_base + (size_t) sector * BLOCK_SECTOR_SIZE,
+          cnt * BLOCK_SECTOR_SIZE);
+}
+
+/* Writes the CNT sectors starting at SECTOR from BUFFER. */
+static void
+ramdisk_write_multiple (void *aux UNUSED, block_sector_t sector,
+                        size_t cnt, const void *buffer)
+{
+  memcpy (ram_base + (size_t) sector * BLOCK_SECTOR_SIZE, buffer,
+          cnt * BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SECTOR into BUFFER. */
+static void
+ramdisk_read (void *aux, block_sector_t sector, void *buffer)
+{
+  ramdisk_read_multiple (aux, sector, 1, buffer);
+}
+
+/* Writes SECTOR from BUFFER. */
+static void
+ramdisk_write (void *aux, block_sector_t sector, const void *buffer)
+{
+  ramdisk_write_multiple (aux, sector, 1, buffer);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    ramdisk_read_multiple,
+    ramdisk_write_multiple,
+    NULL,
+    NULL
+  };
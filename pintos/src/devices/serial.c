@@ -33,6 +33,17 @@
 #define MCR_REG (IO_BASE + 4)   /* MODEM Control Register. */
 #define LSR_REG (IO_BASE + 5)   /* Line Status Register (read-only). */
 
+/* Interrupt Identification Register bits. */
+#define IIR_FIFO 0xc0           /* FIFOs enabled (both bits set). */
+
+/* FIFO Control Register bits. */
+#define FCR_ENABLE 0x01         /* Enable FIFOs. */
+#define FCR_CLEAR_RX 0x02       /* Clear receive FIFO. */
+#define FCR_CLEAR_TX 0x04       /* Clear transmit FIFO. */
+
+/* Size of the 16550A's transmit FIFO. */
+#define FIFO_SIZE 16
+
 /* Interrupt Enable Register bits. */
 #define IER_RECV 0x01           /* Interrupt when data received. */
 #define IER_XMIT 0x02           /* Interrupt when transmit finishes. */
@@ -54,8 +65,13 @@ static enum { UNINIT, POLL, QUEUE } mode;
 /* Data to be transmitted. */
 static struct intq txq;
 
+/* Bytes we may write to THR each time it empties: FIFO_SIZE if
+   the UART has a working FIFO, otherwise 1. */
+static int xmit_burst;
+
 static void set_serial (int bps);
 static void putc_poll (uint8_t);
+static void fill_fifo (void);
 static void write_ier (void);
 static intr_handler_func serial_interrupt;
 
@@ -68,7 +84,11 @@ init_poll (void)
 {
   ASSERT (mode == UNINIT);
   outb (IER_REG, 0);                    /* Turn off all interrupts. */
-  outb (FCR_REG, 0);                    /* Disable FIFO. */
+  outb (FCR_REG, FCR_ENABLE | FCR_CLEAR_RX | FCR_CLEAR_TX);
+  xmit_burst = ((inb (IIR_REG) & IIR_FIFO) == IIR_FIFO
+                ? FIFO_SIZE : 1);       /* Only a 16550A has FIFOs. */
+  if (xmit_burst == 1)
+    outb (FCR_REG, 0);                  /* Leave broken FIFO off. */
   set_serial (9600);                    /* 9.6 kbps, N-8-1. */
   outb (MCR_REG, MCR_OUT2);             /* Required to enable interrupts. */
   intq_init (&txq);
@@ -117,9 +137,11 @@ serial_putc (uint8_t byte)
           /* Interrupts are off and the transmit queue is full.
              If we wanted to wait for the queue to empty,
              we'd have to reenable interrupts.
-             That's impolite, so we'll send a character via
-             polling instead. */
-          putc_poll (intq_getc (&txq)); 
+             That's impolite, so we'll wait for the UART and
+             refill its FIFO via polling instead. */
+          while ((inb (LSR_REG) & LSR_THRE) == 0)
+            continue;
+          fill_fifo ();
         }
 
       intq_putc (&txq, byte); 
@@ -129,6 +151,48 @@ serial_putc (uint8_t byte)
   intr_set_level (old_level);
 }
 
+/* Sends the N bytes in BUFFER to the serial port, as if by
+   calling serial_putc() for each of them, but setting the
+   interrupt level and the interrupt enable register only once
+   for the whole buffer where possible. */
+void
+serial_putbuf (const uint8_t *buffer, size_t n)
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (mode != QUEUE)
+    {
+      if (mode == UNINIT)
+        init_poll ();
+      while (n-- > 0)
+        putc_poll (*buffer++);
+    }
+  else
+    {
+      while (n-- > 0)
+        {
+          if (intq_full (&txq))
+            {
+              /* Make sure the transmit interrupt is on before
+                 waiting for it to drain the queue, or drain it
+                 by polling if we must not wait, as in
+                 serial_putc(). */
+              write_ier ();
+              if (old_level == INTR_OFF)
+                {
+                  while ((inb (LSR_REG) & LSR_THRE) == 0)
+                    continue;
+                  fill_fifo ();
+                }
+            }
+          intq_putc (&txq, *buffer++);
+        }
+      write_ier ();
+    }
+
+  intr_set_level (old_level);
+}
+
 /* Flushes anything in the serial buffer out the port in polling
    mode. */
 void
@@ -136,7 +200,11 @@ serial_flush (void)
 {
   enum intr_level old_level = intr_disable ();
   while (!intq_empty (&txq))
-    putc_poll (intq_getc (&txq));
+    {
+      while ((inb (LSR_REG) & LSR_THRE) == 0)
+        continue;
+      fill_fifo ();
+    }
   intr_set_level (old_level);
 }
 
@@ -205,6 +273,20 @@ putc_poll (uint8_t byte)
   outb (THR_REG, byte);
 }
 
+/* Moves up to xmit_burst bytes from the transmit queue into the
+   UART, which must be ready to accept them: THR, and the FIFO if
+   there is one, must be empty. */
+static void
+fill_fifo (void)
+{
+  int i;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (i = 0; i < xmit_burst && !intq_empty (&txq); i++)
+    outb (THR_REG, intq_getc (&txq));
+}
+
 /* Serial interrupt handler. */
 static void
 serial_interrupt (struct intr_frame *f UNUSED) 
@@ -218,10 +300,11 @@ serial_interrupt (struct intr_frame *f UNUSED)
   while (!input_full () && (inb (LSR_REG) & LSR_DR) != 0)
     input_putc (inb (RBR_REG));
 
-  /* As long as we have a byte to transmit, and the hardware is
-     ready to accept a byte for transmission, transmit a byte. */
-  while (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0) 
-    outb (THR_REG, intq_getc (&txq));
+  /* If the hardware is ready to accept bytes for transmission,
+     fill its FIFO in one go.  THRE means the FIFO is empty, so it
+     reports nothing more until the whole FIFO has drained. */
+  if (!intq_empty (&txq) && (inb (LSR_REG) & LSR_THRE) != 0)
+    fill_fifo ();
 
   /* Update interrupt enable register based on queue status. */
   write_ier ();
@@ -1,31 +1,102 @@
 #include "devices/timer.h"
 #include <debug.h>
+#include <heap.h>
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
 #include "devices/pit.h"
 #include "threads/interrupt.h"
+#include "threads/profile.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
   
 /* See [8254] for hardware details of the 8254 timer chip. */
 
-#if TIMER_FREQ < 19
-#error 8254 timer requires TIMER_FREQ >= 19
-#endif
-#if TIMER_FREQ > 1000
-#error TIMER_FREQ <= 1000 recommended
-#endif
+/* Number of timer interrupts per second.  May be changed only
+   before timer_init(). */
+int timer_freq = TIMER_FREQ_DEFAULT;
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted.  Only the timer
+   interrupt and timer_idle_exit() change it, with interrupts
+   off, inside TICKS_SEQ, so that timer_ticks() can read it
+   without turning interrupts off. */
 static int64_t ticks;
+static struct seqlock ticks_seq;
+
+/* Sleeping threads, a heap ordered by ascending wakeup_tick.
+   Threads in this heap are in THREAD_BLOCKED state. */
+static struct heap sleep_heap;
+
+/* Hierarchical timing wheel for timer_arm().
+
+   Level 0 has one slot per tick for the next WHEEL_SLOTS ticks.
+   Each slot of level N covers WHEEL_SLOTS times as many ticks as
+   a slot of level N - 1.  When level 0 wraps around, the next
+   slot of level 1 is "cascaded", that is, its timeouts are
+   redistributed into level 0, and so on up the hierarchy.  Thus
+   arming and cancelling are O(1), and each timeout is moved at
+   most WHEEL_LEVELS - 1 times before it fires. */
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4
+#define WHEEL_SPAN ((int64_t) 1 << (WHEEL_BITS * WHEEL_LEVELS))
+static struct list wheel[WHEEL_LEVELS][WHEEL_SLOTS];
+
+/* Next tick to be processed by the timing wheel. */
+static int64_t wheel_tick;
 
 /* Number of loops per timer tick.
    Initialized by timer_calibrate(). */
 static unsigned loops_per_tick;
 
+/* Number of timer_cycles() per second.
+   Initialized by timer_calibrate(). */
+static uint64_t cycles_per_sec;
+
+/* Loops and timer_cycles() per second as timer_calibrate() found
+   them on an earlier boot, passed back with the "-lps" and "-cps"
+   kernel command-line options to skip measuring them, or 0. */
+uint64_t timer_preset_lps;
+uint64_t timer_preset_cps;
+
+/* Number of loops timed by calibrate_loops(). */
+#define CALIBRATE_LOOPS 65536
+
+/* Wakes sleepers and fires timeouts after the timer interrupt. */
+static struct intr_deferred timer_deferred;
+
+/* Tickless idle.
+
+   When only the idle thread can run, ticks that would find
+   nothing to do are a waste, especially of the host's CPU under
+   a virtual machine.  So, just before it halts, the idle thread
+   calls timer_idle_enter(), which switches the PIT to a one-shot
+   count that ends at the next tick with work to do: a thread to
+   wake, a timeout to fire, a timing wheel cascade, or, under the
+   4.4BSD scheduler, a once-a-second recalculation.  The PIT
+   counts only 65536 cycles at most, so a long idle spell still
+   takes an interrupt every few ticks.
+
+   The next external interrupt, whatever its source, calls
+   timer_idle_exit() before its handler runs.  That adds the
+   ticks that went by to `ticks' and restarts the periodic
+   count.  A fraction of a tick is lost whenever another device
+   ends the spell early. */
+#define PIT_CYCLES_PER_TICK ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+#define IDLE_MAX_TICKS (65535 / PIT_CYCLES_PER_TICK)
+static int idle_tick_cnt;       /* Length of one-shot count, or 0. */
+
 static intr_handler_func timer_interrupt;
-static bool too_many_loops (unsigned loops);
+static intr_deferred_func timer_expire;
+static bool wakeup_less (const struct heap_elem *, const struct heap_elem *,
+                         void *aux);
+static void wheel_insert (struct timeout *);
+static int wheel_cascade (int level);
+static void wheel_run (void);
+static int64_t next_event (int64_t limit);
+static void calibrate_cycles (void);
+static void calibrate_loops (void);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
 static void real_time_delay (int64_t num, int32_t denom);
@@ -35,44 +106,61 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
+  int level, slot;
+
+  ASSERT (TIMER_FREQ >= TIMER_FREQ_MIN && TIMER_FREQ <= TIMER_FREQ_MAX);
+
+  seq_init (&ticks_seq);
+  heap_init (&sleep_heap, wakeup_less, NULL);
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    for (slot = 0; slot < WHEEL_SLOTS; slot++)
+      list_init (&wheel[level][slot]);
+  wheel_tick = 1;
+  intr_deferred_init (&timer_deferred, timer_expire, NULL);
+
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates cycles_per_sec, used to convert timer_cycles() to
+   real time, and loops_per_tick, used to implement brief delays.
+   Measuring takes only a few ticks, and none at all for a rate
+   preset with "-lps" or "-cps". */
 void
 timer_calibrate (void) 
 {
-  unsigned high_bit, test_bit;
-
   ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
 
-  /* Approximate loops_per_tick as the largest power-of-two
-     still less than one timer tick. */
-  loops_per_tick = 1u << 10;
-  while (!too_many_loops (loops_per_tick << 1)) 
-    {
-      loops_per_tick <<= 1;
-      ASSERT (loops_per_tick != 0);
-    }
+  if (timer_preset_cps != 0)
+    cycles_per_sec = timer_preset_cps;
+  else
+    calibrate_cycles ();
 
-  /* Refine the next 8 bits of loops_per_tick. */
-  high_bit = loops_per_tick;
-  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-    if (!too_many_loops (high_bit | test_bit))
-      loops_per_tick |= test_bit;
+  if (timer_preset_lps != 0)
+    loops_per_tick = timer_preset_lps / TIMER_FREQ;
+  else
+    calibrate_loops ();
+  if (loops_per_tick == 0)
+    loops_per_tick = 1;
 
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+  printf ("%'"PRIu64" loops/s, %'"PRIu64" cycles/s.\n",
+          (uint64_t) loops_per_tick * TIMER_FREQ, cycles_per_sec);
 }
 
 /* Returns the number of timer ticks since the OS booted. */
 int64_t
 timer_ticks (void) 
 {
-  enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
-  intr_set_level (old_level);
+  unsigned seq;
+  int64_t t;
+
+  do
+    {
+      seq = seq_read_begin (&ticks_seq);
+      t = ticks;
+    }
+  while (seq_read_retry (&ticks_seq, seq));
   return t;
 }
 
@@ -84,16 +172,66 @@ timer_elapsed (int64_t then)
   return timer_ticks () - then;
 }
 
+/* Returns the CPU's time-stamp counter, which counts processor
+   cycles.  Finer grained than timer_ticks(), for measuring short
+   intervals. */
+uint64_t
+timer_cycles (void)
+{
+  uint64_t tsc;
+
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+/* Returns the number of timer_cycles() per second, as measured
+   by timer_calibrate(). */
+uint64_t
+timer_cycles_per_sec (void)
+{
+  return cycles_per_sec;
+}
+
+/* Converts CYCLES, a count of timer_cycles(), to nanoseconds.
+   Divides in two steps so that the product cannot overflow. */
+uint64_t
+timer_cycles_to_ns (uint64_t cycles)
+{
+  ASSERT (cycles_per_sec != 0);
+  return (cycles / cycles_per_sec * 1000000000
+          + cycles % cycles_per_sec * 1000000000 / cycles_per_sec);
+}
+
+/* Returns the number of nanoseconds since the time-stamp counter
+   started, typically at power on.  Much finer grained than
+   timer_ticks(), for measuring latencies. */
+uint64_t
+timer_ns (void)
+{
+  return timer_cycles_to_ns (timer_cycles ());
+}
+
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The current thread is blocked and put in sleep_heap, ordered
+   by the absolute tick at which it should wake up, so that it
+   takes no CPU time until timer_interrupt() unblocks it. */
 void
 timer_sleep (int64_t ticks) 
 {
-  int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_tick = ticks + timer_ticks ();
+  heap_push (&sleep_heap, &cur->sleep_elem);
+  thread_block ();
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -159,6 +297,107 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Arms timeout T to call FUNC with auxiliary data AUX, from the
+   timer interrupt handler, after approximately TICKS timer
+   ticks.  A TICKS value of 0 or less fires at the next tick.
+   T must not already be armed.
+
+   This function may be called from an interrupt handler. */
+void
+timer_arm (struct timeout *t, int64_t ticks, timeout_func *func, void *aux)
+{
+  enum intr_level old_level;
+
+  ASSERT (t != NULL);
+  ASSERT (func != NULL);
+
+  old_level = intr_disable ();
+  ASSERT (!t->armed);
+  t->expires = timer_ticks () + (ticks > 0 ? ticks : 1);
+  t->func = func;
+  t->aux = aux;
+  t->armed = true;
+  wheel_insert (t);
+  intr_set_level (old_level);
+}
+
+/* Cancels timeout T.  Returns true if T was armed and has now
+   been cancelled, false if it had already fired or was never
+   armed.
+
+   This function may be called from an interrupt handler. */
+bool
+timer_cancel (struct timeout *t)
+{
+  enum intr_level old_level;
+  bool was_armed;
+
+  ASSERT (t != NULL);
+
+  old_level = intr_disable ();
+  was_armed = t->armed;
+  if (was_armed)
+    {
+      list_remove (&t->elem);
+      t->armed = false;
+    }
+  intr_set_level (old_level);
+  return was_armed;
+}
+
+/* Called by the idle thread, with interrupts off, just before it
+   halts.  If no tick before the next one with work to do needs a
+   timer interrupt, switches the timer to a one-shot count that
+   ends at that tick. */
+void
+timer_idle_enter (void)
+{
+  int64_t cnt;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (idle_tick_cnt == 0);
+
+  cnt = next_event (ticks + IDLE_MAX_TICKS) - ticks;
+  if (cnt > 1)
+    {
+      idle_tick_cnt = cnt;
+      pit_start_oneshot (0, cnt * PIT_CYCLES_PER_TICK);
+    }
+}
+
+/* Called at the start of every external interrupt.  If the timer
+   is counting down a one-shot count started by
+   timer_idle_enter(), accounts for the ticks that have gone by
+   since and restarts the periodic timer interrupt. */
+void
+timer_idle_exit (void)
+{
+  int64_t skipped;
+  uint16_t count;
+  bool out;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (idle_tick_cnt == 0)
+    return;
+
+  /* If the count has ended, a timer interrupt is being handled
+     or will be next, and it counts the last tick itself. */
+  count = pit_read_count (0, &out);
+  if (out)
+    skipped = idle_tick_cnt - 1;
+  else
+    skipped = (idle_tick_cnt * PIT_CYCLES_PER_TICK - count)
+               / PIT_CYCLES_PER_TICK;
+  pit_configure_channel (0, 2, TIMER_FREQ);
+  idle_tick_cnt = 0;
+
+  seq_write_begin (&ticks_seq);
+  ticks += skipped;
+  seq_write_end (&ticks_seq);
+  thread_idle_ticks (skipped);
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) 
@@ -166,31 +405,216 @@ timer_print_stats (void)
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
 }
 
-/* Timer interrupt handler. */
+/* Timer interrupt handler.  Leaves waking sleepers and firing
+   timeouts to timer_expire(), which runs with interrupts on. */
 static void
-timer_interrupt (struct intr_frame *args UNUSED)
+timer_interrupt (struct intr_frame *args)
 {
+  seq_write_begin (&ticks_seq);
   ticks++;
+  seq_write_end (&ticks_seq);
   thread_tick ();
+  if (profile_enabled)
+    profile_sample (args);
+  intr_defer (&timer_deferred);
+}
+
+/* Deferred part of the timer interrupt.  Wakes up every thread
+   whose wakeup tick has arrived and fires every timeout that has
+   expired.  Each wakeup and timeout is handled with interrupts
+   off, as before, but interrupts are let in between them. */
+static void
+timer_expire (void *aux UNUSED)
+{
+  intr_disable ();
+
+  /* The heap yields threads in order of wakeup, so we can stop at
+     the first thread still sleeping. */
+  while (!heap_empty (&sleep_heap))
+    {
+      struct thread *t = heap_entry (heap_min (&sleep_heap),
+                                     struct thread, sleep_elem);
+      if (t->wakeup_tick > ticks)
+        break;
+      heap_pop_min (&sleep_heap);
+      thread_unblock (t);
+      intr_enable ();
+      intr_disable ();
+    }
+
+  wheel_run ();
+  intr_enable ();
 }
 
-/* Returns true if LOOPS iterations waits for more than one timer
-   tick, otherwise false. */
+/* Puts armed timeout T into the timing wheel slot that will be
+   processed at (or, for far-off timeouts, cascaded before)
+   T->expires.  Interrupts must be off. */
+static void
+wheel_insert (struct timeout *t)
+{
+  int64_t expires = t->expires < wheel_tick ? wheel_tick : t->expires;
+  int64_t delta = expires - wheel_tick;
+  int level;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Timeouts past the end of the top level are parked in its last
+     slot and re-filed each time they are cascaded. */
+  if (delta >= WHEEL_SPAN)
+    expires = wheel_tick + WHEEL_SPAN - 1;
+
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    if (delta < (int64_t) 1 << (WHEEL_BITS * (level + 1)))
+      break;
+  list_push_back (&wheel[level][(expires >> (WHEEL_BITS * level))
+                                & WHEEL_MASK],
+                  &t->elem);
+}
+
+/* Redistributes the timeouts in the current slot of LEVEL into
+   lower levels.  Returns the index of that slot. */
+static int
+wheel_cascade (int level)
+{
+  int slot = (wheel_tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+  struct list *bucket = &wheel[level][slot];
+  struct list pending;
+
+  list_init (&pending);
+  while (!list_empty (bucket))
+    list_push_back (&pending, list_pop_front (bucket));
+  while (!list_empty (&pending))
+    wheel_insert (list_entry (list_pop_front (&pending),
+                              struct timeout, elem));
+  return slot;
+}
+
+/* Returns the earliest tick, after the current one but no later
+   than LIMIT, at which the timer interrupt has work to do other
+   than counting the tick.  Interrupts must be off. */
+static int64_t
+next_event (int64_t limit)
+{
+  int64_t t;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  /* Timeouts and wakeups of earlier ticks still waiting for
+     timer_expire(). */
+  if (wheel_tick <= ticks)
+    return ticks + 1;
+
+  /* Next sleeping thread to wake up. */
+  if (!heap_empty (&sleep_heap))
+    {
+      struct thread *s = heap_entry (heap_min (&sleep_heap),
+                                     struct thread, sleep_elem);
+      if (s->wakeup_tick < limit)
+        limit = s->wakeup_tick > ticks ? s->wakeup_tick : ticks + 1;
+    }
+
+  /* Next recalculation of the load average and recent_cpu. */
+  if (thread_mlfqs)
+    {
+      int64_t second = (ticks / TIMER_FREQ + 1) * TIMER_FREQ;
+      if (second < limit)
+        limit = second;
+    }
+
+  /* Next level 0 slot with timeouts in it, or next cascade from
+     the levels above, which happens when level 0 wraps around. */
+  for (t = wheel_tick; t < limit; t++)
+    if ((t & WHEEL_MASK) == 0 || !list_empty (&wheel[0][t & WHEEL_MASK]))
+      return t;
+  return limit;
+}
+
+/* Processes every wheel tick up to and including the current
+   tick, firing the timeouts that are due.  Runs in
+   timer_expire() with interrupts off, but turns them on briefly
+   after each timeout. */
+static void
+wheel_run (void)
+{
+  while (wheel_tick <= ticks)
+    {
+      struct list *bucket = &wheel[0][wheel_tick & WHEEL_MASK];
+      int level;
+
+      /* When a level wraps around, pull down the next slot of the
+         level above, and so on. */
+      if ((wheel_tick & WHEEL_MASK) == 0)
+        for (level = 1; level < WHEEL_LEVELS; level++)
+          if (wheel_cascade (level) != 0)
+            break;
+
+      wheel_tick++;
+      while (!list_empty (bucket))
+        {
+          struct timeout *t = list_entry (list_pop_front (bucket),
+                                          struct timeout, elem);
+          t->armed = false;
+          t->func (t, t->aux);
+          intr_enable ();
+          intr_disable ();
+        }
+    }
+}
+
+/* Returns true if thread A should wake up before thread B. */
 static bool
-too_many_loops (unsigned loops) 
+wakeup_less (const struct heap_elem *a_, const struct heap_elem *b_,
+             void *aux UNUSED)
+{
+  const struct thread *a = heap_entry (a_, struct thread, sleep_elem);
+  const struct thread *b = heap_entry (b_, struct thread, sleep_elem);
+
+  return a->wakeup_tick < b->wakeup_tick;
+}
+
+/* Sets cycles_per_sec by counting timer_cycles() across about
+   1/20 second of timer ticks, starting just as one begins. */
+static void
+calibrate_cycles (void)
 {
-  /* Wait for a timer tick. */
-  int64_t start = ticks;
+  int64_t tick_cnt = DIV_ROUND_UP (TIMER_FREQ, 20);
+  int64_t start;
+  uint64_t tsc;
+
+  start = ticks;
   while (ticks == start)
     barrier ();
-
-  /* Run LOOPS loops. */
   start = ticks;
-  busy_wait (loops);
+  tsc = timer_cycles ();
+  while (ticks - start < tick_cnt)
+    barrier ();
+  cycles_per_sec = (timer_cycles () - tsc) * TIMER_FREQ / tick_cnt;
+}
+
+/* Sets loops_per_tick from the cycles that CALIBRATE_LOOPS loops
+   take, which is much quicker than counting how many loops fit in
+   a tick.  Times the loops with interrupts off, so that none
+   inflates the count, and keeps the fastest of a few runs. */
+static void
+calibrate_loops (void)
+{
+  uint64_t best = UINT64_MAX;
+  int i;
 
-  /* If the tick count changed, we iterated too long. */
-  barrier ();
-  return start != ticks;
+  for (i = 0; i < 3; i++)
+    {
+      enum intr_level old_level = intr_disable ();
+      uint64_t start = timer_cycles ();
+      uint64_t cycles;
+
+      busy_wait (CALIBRATE_LOOPS);
+      cycles = timer_cycles () - start;
+      intr_set_level (old_level);
+      if (cycles < best)
+        best = cycles;
+    }
+  loops_per_tick = (uint64_t) CALIBRATE_LOOPS * cycles_per_sec
+                   / TIMER_FREQ / (best > 0 ? best : 1);
 }
 
 /* Iterates through a simple loop LOOPS times, for implementing
@@ -1,17 +1,55 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
+/* Number of timer interrupts per second, by default and at
+   least and at most.  The 8254 cannot count slowly enough for
+   fewer than 19, and more than 1000 leaves little time between
+   interrupts.  The "-hz" kernel command-line option sets it. */
+#define TIMER_FREQ_DEFAULT 100
+#define TIMER_FREQ_MIN 19
+#define TIMER_FREQ_MAX 1000
+extern int timer_freq;
+
+/* Rates found by an earlier timer_calibrate(), to reuse, or 0. */
+extern uint64_t timer_preset_lps;
+extern uint64_t timer_preset_cps;
+
 /* Number of timer interrupts per second. */
-#define TIMER_FREQ 100
+#define TIMER_FREQ timer_freq
+
+struct timeout;
+
+/* Function called when a timeout expires.  Runs with interrupts
+   off in the deferred part of the timer interrupt handler, so it
+   must not sleep. */
+typedef void timeout_func (struct timeout *, void *aux);
+
+/* A one-shot timeout, armed with timer_arm().
+   The caller owns the storage; it must stay valid until the
+   timeout fires or is cancelled with timer_cancel(). */
+struct timeout
+  {
+    struct list_elem elem;      /* Element in a timer wheel slot. */
+    int64_t expires;            /* Absolute tick at which to fire. */
+    timeout_func *func;         /* Function to call on expiry. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool armed;                 /* True while on the timer wheel. */
+  };
 
 void timer_init (void);
 void timer_calibrate (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
+uint64_t timer_cycles (void);
+uint64_t timer_cycles_per_sec (void);
+uint64_t timer_cycles_to_ns (uint64_t cycles);
+uint64_t timer_ns (void);
 
 /* Sleep and yield the CPU to other threads. */
 void timer_sleep (int64_t ticks);
@@ -24,6 +62,14 @@ void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* Timeouts. */
+void timer_arm (struct timeout *, int64_t ticks, timeout_func *, void *aux);
+bool timer_cancel (struct timeout *);
+
+/* Tickless idle. */
+void timer_idle_enter (void);
+void timer_idle_exit (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
@@ -0,0 +1,486 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "threads/vmalloc.h"
+
+/* Driver for the virtio block devices that QEMU provides with
+   "-drive if=virtio", through the legacy virtio PCI interface
+   described in [VIRTIO] section 4.1.
+
+   Requests reach the device through a single virtqueue: a table
+   of descriptors, each naming a physically contiguous piece of
+   memory, and two rings, "available" for the chains of
+   descriptors the driver hands to the device and "used" for the
+   chains the device hands back once it has carried them out.  A
+   chain is a header giving the operation and first sector, the
+   data, one descriptor per page, and a status byte that the
+   device writes last.  The device raises an interrupt after using
+   chains, and the interrupt handler completes their requests, so
+   submitting a request does not wait for it.
+
+   A request that needs more descriptors than are free is carried
+   out in pieces, one after another, each as large as the free
+   descriptors allow, up to MAX_SEGS pages.  Requests that find
+   too few descriptors free wait in a queue until some come back.
+   Every chain holds at least MIN_DESCS descriptors, so that the
+   next piece of a request can always start as soon as the one
+   before completes. */
+
+/* PCI IDs of a legacy (or transitional) virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy virtio registers, at offsets in I/O space BAR 0. */
+#define REG_DEVICE_FEATURES 0x00 /* Features offered (32 bits). */
+#define REG_GUEST_FEATURES 0x04 /* Features accepted (32 bits). */
+#define REG_QUEUE_PFN 0x08      /* Selected queue's page (32 bits). */
+#define REG_QUEUE_SIZE 0x0c     /* Selected queue's size (16 bits). */
+#define REG_QUEUE_SELECT 0x0e   /* Queue to configure (16 bits). */
+#define REG_QUEUE_NOTIFY 0x10   /* Queue with new chains (16 bits). */
+#define REG_STATUS 0x12         /* Device status (8 bits). */
+#define REG_ISR 0x13            /* Interrupt status, read clears (8). */
+#define REG_CAPACITY 0x14       /* Size in sectors (64 bits). */
+
+/* Device status bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* Driver has noticed the device. */
+#define STATUS_DRIVER 0x02      /* Driver knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+
+/* Alignment of the used ring, and unit of REG_QUEUE_PFN. */
+#define VRING_ALIGN 4096
+
+/* Virtqueue descriptor. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address. */
+    uint32_t len;               /* Length in bytes. */
+    uint16_t flags;             /* VRING_DESC_F_* flags. */
+    uint16_t next;              /* Next descriptor, with F_NEXT. */
+  };
+#define VRING_DESC_F_NEXT 1     /* Chain continues at `next'. */
+#define VRING_DESC_F_WRITE 2    /* Device writes, rather than reads. */
+
+/* Available ring, written by the driver. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the next entry goes. */
+    uint16_t ring[];            /* First descriptors of chains. */
+  };
+
+/* Used ring, written by the device. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* First descriptor of chain. */
+    uint32_t len;               /* Bytes written to it. */
+  };
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the next entry goes. */
+    struct vring_used_elem ring[];
+  };
+
+/* Header of a request. */
+struct vblk_header
+  {
+    uint32_t type;              /* VIRTIO_BLK_T_*. */
+    uint32_t reserved;
+    uint64_t sector;            /* First sector. */
+  };
+#define VIRTIO_BLK_T_IN 0       /* Read. */
+#define VIRTIO_BLK_T_OUT 1      /* Write. */
+#define VIRTIO_BLK_S_OK 0       /* Success, in the status byte. */
+
+/* Most data descriptors in a chain, and fewest descriptors that a
+   chain holds: a header, two pages for a sector that straddles a
+   page boundary, and the status. */
+#define MAX_SEGS 32
+#define MIN_DESCS 4
+
+/* Most devices driven. */
+#define VBLK_MAX 4
+
+/* A chain in flight, indexed by its first descriptor. */
+struct vblk_slot
+  {
+    struct block_request *r;    /* Request it does a piece of. */
+    size_t end;                 /* Sectors of R done once it is. */
+    uint16_t desc_cnt;          /* Descriptors held. */
+  };
+
+/* A virtio block device.  Members after `irq' change with
+   interrupts off. */
+struct vblk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* Base I/O port. */
+    uint8_t irq;                /* Interrupt vector. */
+
+    uint16_t qsize;             /* Entries in the virtqueue. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    volatile struct vring_used *used; /* Used ring. */
+    uint16_t free_head;         /* First free descriptor. */
+    uint16_t free_cnt;          /* Number of free descriptors. */
+    uint16_t last_used;         /* Used ring entries handled. */
+
+    struct vblk_slot *slots;    /* Per first descriptor. */
+    struct vblk_header *headers; /* Per first descriptor. */
+    uint8_t *statuses;          /* Per first descriptor. */
+    struct list queue;          /* Requests waiting for descriptors. */
+  };
+
+static struct vblk disks[VBLK_MAX];
+static size_t disk_cnt;
+
+static struct block_operations vblk_operations;
+
+static bool probe (struct vblk *, int dev, int func);
+static bool issue (struct vblk *, struct block_request *, size_t start);
+static void start_queued (struct vblk *);
+static void free_chain (struct vblk *, uint16_t head, uint16_t cnt);
+static uintptr_t kvtop (const void *);
+static intr_handler_func interrupt_handler;
+
+/* Finds the virtio block devices on PCI bus 0, sets them up and
+   registers them, along with their partitions. */
+void
+virtio_blk_init (void)
+{
+  int dev = 0;
+  int func = 0;
+
+  while (disk_cnt < VBLK_MAX
+         && pci_find_device (VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, &dev, &func))
+    {
+      struct vblk *d = &disks[disk_cnt];
+      uint64_t capacity;
+
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) disk_cnt);
+      if (probe (d, dev, func))
+        {
+          struct block *block;
+
+          disk_cnt++;
+          capacity = (inl (d->io_base + REG_CAPACITY)
+                      | (uint64_t) inl (d->io_base + REG_CAPACITY + 4) << 32);
+          if (capacity > UINT32_MAX)
+            capacity = UINT32_MAX;
+          block = block_register (d->name, BLOCK_RAW, "virtio", capacity,
+                                  &vblk_operations, d);
+          partition_scan (block);
+        }
+
+      if (++func == 8)
+        {
+          func = 0;
+          dev++;
+        }
+    }
+}
+
+/* Resets the device at function FUNC of PCI device DEV, sets up
+   D to drive it and tells the device that the driver is ready.
+   Returns false if that fails. */
+static bool
+probe (struct vblk *d, int dev, int func)
+{
+  uint32_t bar0 = pci_read_config (dev, func, PCI_REG_BAR0);
+  uint8_t line = pci_read_config (dev, func, PCI_REG_INTR) & 0xff;
+  size_t q, used_ofs, ring_size, extra_pages, i;
+  uint8_t *ring, *extra;
+
+  if (!(bar0 & 1) || line >= 16)
+    {
+      printf ("%s: no I/O ports or interrupt line, ignoring\n", d->name);
+      return false;
+    }
+  d->io_base = bar0 & ~3u;
+  d->irq = 0x20 + line;
+  pci_enable (dev, func, PCI_CMD_IO | PCI_CMD_MASTER);
+
+  /* Reset the device and say hello.  We need none of its
+     optional features. */
+  outb (d->io_base + REG_STATUS, 0);
+  outb (d->io_base + REG_STATUS, STATUS_ACKNOWLEDGE);
+  outb (d->io_base + REG_STATUS, STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  outl (d->io_base + REG_GUEST_FEATURES, 0);
+
+  /* Queue 0 carries requests.  Its size is up to the device. */
+  outw (d->io_base + REG_QUEUE_SELECT, 0);
+  q = d->qsize = inw (d->io_base + REG_QUEUE_SIZE);
+  if (q < MIN_DESCS)
+    {
+      printf ("%s: virtqueue too small, ignoring\n", d->name);
+      return false;
+    }
+  used_ofs = ROUND_UP (q * sizeof (struct vring_desc)
+                       + sizeof (struct vring_avail) + (q + 1) * 2,
+                       VRING_ALIGN);
+  ring_size = used_ofs + ROUND_UP (sizeof (struct vring_used)
+                                   + q * sizeof (struct vring_used_elem)
+                                   + 2, VRING_ALIGN);
+  extra_pages = DIV_ROUND_UP (q * (sizeof (struct vblk_header) + 1),
+                              PGSIZE);
+
+  ring = palloc_get_multiple (PAL_ZERO, ring_size / PGSIZE);
+  extra = palloc_get_multiple (PAL_ZERO, extra_pages);
+  d->slots = calloc (q, sizeof *d->slots);
+  if (ring == NULL || extra == NULL || d->slots == NULL)
+    {
+      printf ("%s: out of memory, ignoring\n", d->name);
+      if (ring != NULL)
+        palloc_free_multiple (ring, ring_size / PGSIZE);
+      if (extra != NULL)
+        palloc_free_multiple (extra, extra_pages);
+      free (d->slots);
+      return false;
+    }
+
+  d->desc = (struct vring_desc *) ring;
+  d->avail = (struct vring_avail *) (ring + q * sizeof *d->desc);
+  d->used = (struct vring_used *) (ring + used_ofs);
+  for (i = 0; i < q; i++)
+    d->desc[i].next = i + 1;
+  d->free_head = 0;
+  d->free_cnt = q;
+  d->last_used = 0;
+  d->headers = (struct vblk_header *) extra;
+  d->statuses = (uint8_t *) (d->headers + q);
+  list_init (&d->queue);
+
+  /* Devices may share an interrupt line. */
+  for (i = 0; i < disk_cnt; i++)
+    if (disks[i].irq == d->irq)
+      break;
+  if (i == disk_cnt)
+    intr_register_ext (d->irq, interrupt_handler, d->name);
+
+  outl (d->io_base + REG_QUEUE_PFN, vtop (ring) / VRING_ALIGN);
+  outb (d->io_base + REG_STATUS,
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+  return true;
+}
+
+/* Starts request R on device D_, or queues it until descriptors
+   are free. */
+static void
+vblk_submit (void *d_, struct block_request *r)
+{
+  struct vblk *d = d_;
+  enum intr_level old_level = intr_disable ();
+
+  list_push_back (&d->queue, &r->elem);
+  start_queued (d);
+  intr_set_level (old_level);
+}
+
+/* Starts the requests queued on D, in order, while there are
+   descriptors for them.  Interrupts must be off. */
+static void
+start_queued (struct vblk *d)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (!list_empty (&d->queue))
+    {
+      struct block_request *r = list_entry (list_front (&d->queue),
+                                            struct block_request, elem);
+      if (!issue (d, r, 0))
+        break;
+      list_pop_front (&d->queue);
+    }
+}
+
+/* Hands D a chain for the sectors of R from START on, as many as
+   the free descriptors allow, up to MAX_SEGS pages of them.
+   Returns false, doing nothing, if fewer than MIN_DESCS
+   descriptors are free.  Interrupts must be off. */
+static bool
+issue (struct vblk *d, struct block_request *r, size_t start)
+{
+  uint8_t *buffer = (uint8_t *) r->buffer + start * BLOCK_SECTOR_SIZE;
+  size_t left = (r->cnt - start) * BLOCK_SECTOR_SIZE;
+  size_t seg_len[MAX_SEGS];
+  uint16_t ids[MAX_SEGS + 2];
+  size_t seg_max, seg_cnt, desc_cnt, bytes, excess, i;
+  struct vblk_header *h;
+  struct vblk_slot *s;
+  uint16_t head;
+  uint8_t *p;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (start < r->cnt);
+
+  if (d->free_cnt < MIN_DESCS)
+    return false;
+  seg_max = d->free_cnt - 2 < MAX_SEGS ? d->free_cnt - 2 : MAX_SEGS;
+
+  /* Split the data at page boundaries, since consecutive virtual
+     pages need not be consecutive in physical memory, then trim
+     it to whole sectors. */
+  seg_cnt = bytes = 0;
+  while (left > 0 && seg_cnt < seg_max)
+    {
+      size_t n = PGSIZE - pg_ofs (buffer + bytes);
+      if (n > left)
+        n = left;
+      seg_len[seg_cnt++] = n;
+      bytes += n;
+      left -= n;
+    }
+  excess = bytes % BLOCK_SECTOR_SIZE;
+  bytes -= excess;
+  while (excess >= seg_len[seg_cnt - 1])
+    excess -= seg_len[--seg_cnt];
+  seg_len[seg_cnt - 1] -= excess;
+
+  /* Take the descriptors. */
+  desc_cnt = seg_cnt + 2 > MIN_DESCS ? seg_cnt + 2 : MIN_DESCS;
+  for (i = 0; i < desc_cnt; i++)
+    {
+      uint16_t id = d->free_head;
+      d->free_head = d->desc[id].next;
+      if (i < seg_cnt + 2)
+        ids[i] = id;
+    }
+  d->free_cnt -= desc_cnt;
+  head = ids[0];
+
+  s = &d->slots[head];
+  s->r = r;
+  s->end = start + bytes / BLOCK_SECTOR_SIZE;
+  s->desc_cnt = desc_cnt;
+
+  h = &d->headers[head];
+  h->type = r->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+  h->reserved = 0;
+  h->sector = r->sector + start;
+  d->statuses[head] = 0xff;
+
+  /* Fill them in.  Descriptors held beyond the status stay linked
+     after it, through `next', for free_chain(). */
+  d->desc[head].addr = kvtop (h);
+  d->desc[head].len = sizeof *h;
+  d->desc[head].flags = VRING_DESC_F_NEXT;
+  d->desc[head].next = ids[1];
+  for (i = 0, p = buffer; i < seg_cnt; p += seg_len[i], i++)
+    {
+      struct vring_desc *desc = &d->desc[ids[i + 1]];
+      desc->addr = kvtop (p);
+      desc->len = seg_len[i];
+      desc->flags = VRING_DESC_F_NEXT | (r->write ? 0 : VRING_DESC_F_WRITE);
+      desc->next = ids[i + 2];
+    }
+  d->desc[ids[seg_cnt + 1]].addr = kvtop (&d->statuses[head]);
+  d->desc[ids[seg_cnt + 1]].len = 1;
+  d->desc[ids[seg_cnt + 1]].flags = VRING_DESC_F_WRITE;
+
+  /* Publish the chain, then tell the device. */
+  d->avail->ring[d->avail->idx % d->qsize] = head;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (d->io_base + REG_QUEUE_NOTIFY, 0);
+  return true;
+}
+
+/* Returns the CNT descriptors of the chain starting at HEAD, in
+   the order they are linked, to D's free list.  Interrupts must
+   be off. */
+static void
+free_chain (struct vblk *d, uint16_t head, uint16_t cnt)
+{
+  uint16_t last = head;
+  uint16_t i;
+
+  for (i = 1; i < cnt; i++)
+    last = d->desc[last].next;
+  d->desc[last].next = d->free_head;
+  d->free_head = head;
+  d->free_cnt += cnt;
+}
+
+/* Returns the physical address of kernel virtual address VADDR,
+   which may lie in the vmalloc() window as well as in the
+   kernel's mapping of physical memory. */
+static uintptr_t
+kvtop (const void *vaddr)
+{
+  if (is_vmalloc_vaddr (vaddr))
+    {
+      uint32_t *pt = pde_get_pt (init_page_dir[pd_no (vaddr)]);
+      return vtop (pte_get_page (pt[pt_no (vaddr)])) + pg_ofs (vaddr);
+    }
+  return vtop (vaddr);
+}
+
+/* Virtio block interrupt handler.  For each device on the
+   interrupt's line that raised it, takes back the chains it has
+   used, starting the next piece of each request that has more or
+   completing it, then starts queued requests. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < disk_cnt; i++)
+    {
+      struct vblk *d = &disks[i];
+
+      if (d->irq != f->vec_no || !(inb (d->io_base + REG_ISR) & 1))
+        continue;
+
+      while (d->last_used != d->used->idx)
+        {
+          uint16_t head;
+          struct block_request *r;
+          size_t end;
+
+          barrier ();
+          head = d->used->ring[d->last_used % d->qsize].id;
+          r = d->slots[head].r;
+          end = d->slots[head].end;
+          if (d->statuses[head] != VIRTIO_BLK_S_OK)
+            PANIC ("%s: I/O error at sector %"PRIu64, d->name,
+                   d->headers[head].sector);
+          free_chain (d, head, d->slots[head].desc_cnt);
+          d->last_used++;
+
+          if (end < r->cnt)
+            {
+              bool started = issue (d, r, end);
+              ASSERT (started);
+            }
+          else
+            block_complete (r);
+        }
+      start_queued (d);
+    }
+}
+
+static struct block_operations vblk_operations =
+  {
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    vblk_submit,
+    NULL
+  };
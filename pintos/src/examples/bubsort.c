@@ -5,27 +5,41 @@
    Intention is to stress virtual memory system.
  
    Ideally, we could read the unsorted array off of the file
-   system, and store the result back to the file system! */
+   system, and store the result back to the file system!
+
+   An argument, if given, overrides SORT_SIZE.  tests/vm/bench
+   runs a version of this program at sizes chosen against the
+   user pool. */
+#include <malloc.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 /* Size of array to sort. */
 #define SORT_SIZE 128
 
 int
-main (void)
+main (int argc, char *argv[])
 {
-  /* Array to sort.  Static to reduce stack usage. */
-  static int array[SORT_SIZE];
+  int size = argc > 1 ? atoi (argv[1]) : SORT_SIZE;
+
+  /* Array to sort.  On the heap to reduce stack usage. */
+  int *array = malloc (size * sizeof *array);
 
   int i, j, tmp;
 
+  if (size <= 0 || array == NULL)
+    {
+      printf ("sort: can't make an array of %d ints\n", size);
+      return -1;
+    }
+
   /* First initialize the array in descending order. */
-  for (i = 0; i < SORT_SIZE; i++)
-    array[i] = SORT_SIZE - i - 1;
+  for (i = 0; i < size; i++)
+    array[i] = size - i - 1;
 
   /* Then sort in ascending order. */
-  for (i = 0; i < SORT_SIZE - 1; i++)
-    for (j = 0; j < SORT_SIZE - 1 - i; j++)
+  for (i = 0; i < size - 1; i++)
+    for (j = 0; j < size - 1 - i; j++)
       if (array[j] > array[j + 1])
 	{
 	  tmp = array[j];
@@ -0,0 +1,146 @@
+#include "filesys/archive.h"
+#include <debug.h>
+#include <round.h>
+#include <string.h>
+#include "threads/malloc.h"
+
+/* Reading ustar archives in place.
+
+   The archive is walked one header at a time, straight off the
+   block device: archive_next() reads only the header sector of
+   each file and skips over its data, reporting where the data
+   starts, so that listing or finding a file costs one sector per
+   file before it.  archive_read() then reads any range of a
+   file's data, moving whole sectors straight into the caller's
+   buffer with one request and going through a bounce buffer only
+   for a partial sector at either end.  Nothing is copied into
+   the file system first, so the archive can also be read as it
+   is, as a read-only file system. */
+
+/* Starts reading AR, the archive at the beginning of BLOCK. */
+void
+archive_open (struct archive *ar, struct block *block)
+{
+  ar->block = block;
+  ar->sector = 0;
+}
+
+/* Reads the header for the next file in AR into *ENTRY and
+   advances AR past the file's data.  At the end of the archive,
+   sets ENTRY->type to USTAR_EOF.  Returns a null pointer if
+   successful, otherwise a human-readable error message, in which
+   case AR is not advanced. */
+const char *
+archive_next (struct archive *ar, struct archive_entry *entry)
+{
+  char *header;
+  const char *file_name;
+  const char *error;
+  enum ustar_type type;
+  block_sector_t data_sectors;
+  int size;
+
+  if (ar->sector >= block_size (ar->block))
+    return "archive runs past end of device";
+
+  header = malloc (USTAR_HEADER_SIZE);
+  if (header == NULL)
+    return "out of memory";
+  block_read (ar->block, ar->sector, header);
+  error = ustar_parse_header (header, &file_name, &type, &size);
+  if (error == NULL)
+    {
+      data_sectors = DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+      if (data_sectors > block_size (ar->block) - ar->sector - 1)
+        error = "file runs past end of device";
+    }
+  if (error == NULL)
+    {
+      strlcpy (entry->name, file_name != NULL ? file_name : "",
+               sizeof entry->name);
+      entry->type = type;
+      entry->size = size;
+      entry->sector = ar->sector + 1;
+      if (type != USTAR_EOF)
+        ar->sector += 1 + data_sectors;
+    }
+  free (header);
+  return error;
+}
+
+/* Looks for a regular file named NAME in the archive on BLOCK
+   and stores its entry in *ENTRY.  Returns true if successful,
+   false if there is no such file or the archive is corrupt
+   before it. */
+bool
+archive_find (struct block *block, const char *name,
+              struct archive_entry *entry)
+{
+  struct archive ar;
+
+  archive_open (&ar, block);
+  while (archive_next (&ar, entry) == NULL && entry->type != USTAR_EOF)
+    if (entry->type == USTAR_REGULAR && !strcmp (entry->name, name))
+      return true;
+  return false;
+}
+
+/* Reads SIZE bytes of data of ENTRY, a file in the archive on
+   BLOCK, into BUFFER, starting at byte OFFSET in the file.
+   Returns the number of bytes read, which is less than SIZE if
+   the end of the file comes first, or if memory for a bounce
+   buffer runs out. */
+off_t
+archive_read (struct block *block, const struct archive_entry *entry,
+              void *buffer_, off_t size, off_t offset)
+{
+  uint8_t *buffer = buffer_;
+  uint8_t *bounce = NULL;
+  off_t bytes_read = 0;
+
+  ASSERT (offset >= 0);
+
+  if (offset >= entry->size)
+    return 0;
+  if (size > entry->size - offset)
+    size = entry->size - offset;
+
+  while (size > 0)
+    {
+      block_sector_t sector = entry->sector + offset / BLOCK_SECTOR_SIZE;
+      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+
+      if (sector_ofs == 0 && size >= BLOCK_SECTOR_SIZE)
+        {
+          /* Whole sectors, straight into BUFFER. */
+          size_t cnt = size / BLOCK_SECTOR_SIZE;
+          off_t chunk = cnt * BLOCK_SECTOR_SIZE;
+
+          block_read_multiple (block, sector, cnt, buffer + bytes_read);
+          bytes_read += chunk;
+          offset += chunk;
+          size -= chunk;
+        }
+      else
+        {
+          /* Part of a sector, through BOUNCE. */
+          int chunk = BLOCK_SECTOR_SIZE - sector_ofs;
+
+          if (chunk > size)
+            chunk = size;
+          if (bounce == NULL)
+            {
+              bounce = malloc (BLOCK_SECTOR_SIZE);
+              if (bounce == NULL)
+                break;
+            }
+          block_read (block, sector, bounce);
+          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk);
+          bytes_read += chunk;
+          offset += chunk;
+          size -= chunk;
+        }
+    }
+  free (bounce);
+  return bytes_read;
+}
@@ -0,0 +1,34 @@
+#ifndef FILESYS_ARCHIVE_H
+#define FILESYS_ARCHIVE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <ustar.h>
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+/* A ustar archive, read in place on a block device. */
+struct archive
+  {
+    struct block *block;        /* Device holding the archive. */
+    block_sector_t sector;      /* Sector of the next header. */
+  };
+
+/* A file in an archive.  Its data is SIZE bytes in consecutive
+   sectors starting at SECTOR, the last one padded with zeros. */
+struct archive_entry
+  {
+    char name[100];             /* File name, null-terminated. */
+    enum ustar_type type;       /* File type, or USTAR_EOF at end. */
+    off_t size;                 /* Size in bytes. */
+    block_sector_t sector;      /* First sector of data. */
+  };
+
+void archive_open (struct archive *, struct block *);
+const char *archive_next (struct archive *, struct archive_entry *);
+bool archive_find (struct block *, const char *name,
+                   struct archive_entry *);
+off_t archive_read (struct block *, const struct archive_entry *,
+                    void *buffer, off_t size, off_t offset);
+
+#endif /* filesys/archive.h */
@@ -0,0 +1,790 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <list.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/ghost.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Milliseconds between write-behind passes. */
+#define WRITE_BEHIND_MS 1000
+
+/* Number of pending read-ahead requests that can be queued. */
+#define READ_AHEAD_CNT 32
+
+/* Most consecutive sectors read ahead at once. */
+#define READ_AHEAD_RUN 8
+
+/* Most read-ahead runs in flight at once. */
+#define READ_AHEAD_BATCH 2
+
+/* Most sector writes cache_flush() has in flight at once. */
+#define FLUSH_BATCH 8
+
+/* Dirty sectors at which write-back starts in the background, and
+   at which writers are made to write back before going on, so
+   that they cannot dirty the cache faster than the disk takes
+   it. */
+#define DIRTY_LOW (CACHE_SIZE / 4)
+#define DIRTY_HIGH (CACHE_SIZE / 2)
+
+/* Most entries on probation before eviction takes them in
+   preference to protected ones, and number of sectors evicted
+   from probation that are remembered, as in 2Q. */
+#define COLD_MAX (CACHE_SIZE / 4)
+#define GHOST_CNT (CACHE_SIZE / 2)
+
+/* A cached sector of the file system device. */
+struct cache_entry
+  {
+    block_sector_t sector;              /* Cached sector. */
+    bool valid;                         /* Holds a sector at all? */
+    bool dirty;                         /* Modified since written? */
+    bool accessed;                      /* Used since clock hand passed? */
+    bool hot;                           /* Protected, not on probation? */
+    bool pinned;                        /* Kept from disk by the journal? */
+    bool prefetched;                    /* Read ahead, not used since? */
+    struct list_elem dirty_elem;        /* Element in `dirty_list'. */
+    struct lock lock;                   /* Protects DATA and flags. */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+/* The cache itself.
+   cache_lock protects the mapping from sectors to entries (the
+   `valid' and `sector' members), the `hot' and `prefetched'
+   members, the clock hand, the probation count and ghost list,
+   and the statistics.  A thread
+   holding an entry's lock never waits for cache_lock, so it is
+   safe to wait for an entry's lock while holding cache_lock.
+
+   Replacement follows 2Q, so that a scan through many sectors
+   that are used once cannot flush out the ones used over and
+   over.  A sector enters the cache on probation, and probation
+   entries are evicted first while there are more than COLD_MAX
+   of them.  A sector that misses soon after being evicted from
+   probation, which the ghost list tells, comes back protected.
+   Protected entries are evicted by the clock algorithm. */
+static struct cache_entry cache[CACHE_SIZE];
+static struct lock cache_lock;
+static size_t clock_hand;
+static size_t cold_cnt;         /* Valid entries on probation. */
+static struct ghost_list ghosts;
+static uint64_t ghost_keys[GHOST_CNT];
+static struct cache_stats stats;
+
+/* Entries that are dirty, in the order they became so, so that
+   flushing need not look at clean ones.  An entry is on the list
+   exactly when its `dirty' member is true.  dirty_lock protects
+   the list; it is taken while holding an entry's lock, and
+   nothing else is acquired while holding it. */
+static struct list dirty_list;
+static size_t dirty_cnt;        /* Number of entries in dirty_list. */
+static struct lock dirty_lock;
+
+/* Queue of sectors to read ahead, serviced by read_ahead_work.
+   Requests are dropped when the queue is full. */
+static block_sector_t read_ahead_queue[READ_AHEAD_CNT];
+static size_t read_ahead_head, read_ahead_cnt;
+static struct lock read_ahead_lock;
+
+/* Deferred work for write-behind, for write-back past DIRTY_LOW,
+   and for read-ahead. */
+static struct work flush_work;
+static struct work write_back_work;
+static struct work read_ahead_work;
+
+static struct cache_entry *cache_lookup (block_sector_t);
+static struct cache_entry *cache_evict (bool wait);
+static bool may_evict (struct cache_entry *, size_t scanned);
+static void cache_fill (struct cache_entry *, block_sector_t);
+static struct cache_entry *cache_get (block_sector_t, bool fill);
+static void mark_dirty (struct cache_entry *);
+static void mark_clean (struct cache_entry *);
+static void flush_entries (struct cache_entry *[], size_t cnt);
+static void cache_throttle (void);
+static block_done_func flush_done;
+static work_func flush_behind;
+static work_func write_back;
+static work_func read_ahead;
+
+/* Initializes the buffer cache and starts its periodic
+   write-behind. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  ghost_init (&ghosts, ghost_keys, GHOST_CNT);
+  list_init (&dirty_list);
+  lock_init (&dirty_lock);
+  for (i = 0; i < CACHE_SIZE; i++)
+    {
+      cache[i].valid = false;
+      cache[i].dirty = false;
+      cache[i].hot = false;
+      cache[i].pinned = false;
+      cache[i].prefetched = false;
+      lock_init (&cache[i].lock);
+    }
+
+  lock_init (&read_ahead_lock);
+
+  work_init (&read_ahead_work, WORK_HIGH);
+  work_init (&flush_work, WORK_NORMAL);
+  work_init (&write_back_work, WORK_NORMAL);
+  work_queue_delayed (&flush_work, WRITE_BEHIND_MS * TIMER_FREQ / 1000,
+                      flush_behind, NULL);
+}
+
+/* Writes every dirty sector back to disk.  Called when the file
+   system is shut down. */
+void
+cache_done (void)
+{
+  work_cancel (&flush_work);
+  work_cancel (&write_back_work);
+  cache_flush ();
+}
+
+/* Reads SIZE bytes starting at byte OFS within SECTOR into
+   BUFFER, going to disk only if SECTOR is not cached. */
+void
+cache_read (block_sector_t sector, void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&e->lock);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR into
+   BUFFER.  Sectors that are cached are copied out of the cache;
+   each run of the others is read from disk straight into BUFFER
+   with a single request, without passing through the cache or
+   displacing anything in it.  Meant for large reads that would
+   otherwise flush the cache to no purpose.  Any sector missing
+   from the cache while cache_lock is held is up to date on disk,
+   because eviction writes back under that lock. */
+void
+cache_read_direct (block_sector_t sector, size_t cnt, void *buffer_)
+{
+  uint8_t *buffer = buffer_;
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      size_t n = 0;
+
+      lock_acquire (&cache_lock);
+      while (i + n < cnt && cache_lookup (sector + i + n) == NULL)
+        n++;
+      stats.miss_cnt += n;
+      lock_release (&cache_lock);
+
+      if (n > 0)
+        block_read_multiple (fs_device, sector + i, n,
+                             buffer + i * BLOCK_SECTOR_SIZE);
+      else
+        {
+          cache_read (sector + i, buffer + i * BLOCK_SECTOR_SIZE, 0,
+                      BLOCK_SECTOR_SIZE);
+          n = 1;
+        }
+      i += n;
+    }
+}
+
+/* Writes SIZE bytes from BUFFER into SECTOR starting at byte
+   OFS.  The data reaches disk later, when the sector is evicted
+   or flushed.  A write of a whole sector does not read the old
+   contents from disk. */
+void
+cache_write (block_sector_t sector, const void *buffer, int ofs, int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  mark_dirty (e);
+  lock_release (&e->lock);
+  cache_throttle ();
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR from
+   BUFFER.  Sectors that are cached are written into the cache, as
+   by cache_write(); each run of the others is written to disk
+   straight from BUFFER with a single request, holding cache_lock
+   so that nobody can read the old contents into the cache
+   meanwhile.  Used by the page cache, which writes back whole
+   pages. */
+void
+cache_write_direct (block_sector_t sector, size_t cnt,
+                    const void *buffer_)
+{
+  const uint8_t *buffer = buffer_;
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      size_t n = 0;
+
+      lock_acquire (&cache_lock);
+      while (i + n < cnt && cache_lookup (sector + i + n) == NULL)
+        n++;
+      if (n > 0)
+        block_write_multiple (fs_device, sector + i, n,
+                              buffer + i * BLOCK_SECTOR_SIZE);
+      stats.writeback_cnt += n;
+      lock_release (&cache_lock);
+
+      if (n == 0)
+        {
+          cache_write (sector + i, buffer + i * BLOCK_SECTOR_SIZE, 0,
+                       BLOCK_SECTOR_SIZE);
+          n = 1;
+        }
+      i += n;
+    }
+}
+
+/* Like cache_write(), but also pins SECTOR: it is neither written
+   back nor evicted until cache_unpin() is called.  The journal
+   pins the metadata sectors of a transaction until the
+   transaction has been committed. */
+void
+cache_write_pinned (block_sector_t sector, const void *buffer, int ofs,
+                    int size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_get (sector, size < BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  mark_dirty (e);
+  e->pinned = true;
+  lock_release (&e->lock);
+}
+
+/* Unpins SECTOR, which must have been pinned by
+   cache_write_pinned(). */
+void
+cache_unpin (block_sector_t sector)
+{
+  struct cache_entry *e = cache_get (sector, true);
+
+  ASSERT (e->pinned);
+  e->pinned = false;
+  lock_release (&e->lock);
+}
+
+/* Asks for SECTOR to be brought into the cache in the
+   background.  Does not wait. */
+void
+cache_read_ahead (block_sector_t sector)
+{
+  lock_acquire (&read_ahead_lock);
+  if (read_ahead_cnt < READ_AHEAD_CNT)
+    read_ahead_queue[(read_ahead_head + read_ahead_cnt++)
+                     % READ_AHEAD_CNT] = sector;
+  lock_release (&read_ahead_lock);
+  work_queue (&read_ahead_work, read_ahead, NULL);
+}
+
+/* Writes all dirty cached sectors to disk, except pinned ones.
+   Only the entries on the dirty list are looked at. */
+void
+cache_flush (void)
+{
+  struct cache_entry *dirty[CACHE_SIZE];
+  struct list_elem *elem;
+  size_t cnt = 0;
+
+  lock_acquire (&dirty_lock);
+  for (elem = list_begin (&dirty_list); elem != list_end (&dirty_list);
+       elem = list_next (elem))
+    dirty[cnt++] = list_entry (elem, struct cache_entry, dirty_elem);
+  lock_release (&dirty_lock);
+
+  flush_entries (dirty, cnt);
+}
+
+/* Writes those of the CNT sectors in SECTORS that are cached and
+   dirty back to disk, except pinned ones. */
+void
+cache_flush_sectors (const block_sector_t sectors[], size_t cnt)
+{
+  struct cache_entry *dirty[CACHE_SIZE];
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      size_t n = 0;
+
+      lock_acquire (&cache_lock);
+      for (; i < cnt && n < CACHE_SIZE; i++)
+        {
+          struct cache_entry *e = cache_lookup (sectors[i]);
+          if (e != NULL)
+            dirty[n++] = e;
+        }
+      lock_release (&cache_lock);
+
+      flush_entries (dirty, n);
+    }
+}
+
+/* Writes back the CNT entries in ENTRIES that are still valid,
+   dirty, and unpinned by the time their locks are acquired.  Up
+   to FLUSH_BATCH writes are submitted together, holding the
+   entries' locks, before waiting for any of them. */
+static void
+flush_entries (struct cache_entry *entries[], size_t cnt)
+{
+  size_t i = 0;
+
+  while (i < cnt)
+    {
+      struct block_request requests[FLUSH_BATCH];
+      struct cache_entry *held[FLUSH_BATCH];
+      struct semaphore done;
+      size_t n = 0;
+      size_t written;
+
+      sema_init (&done, 0);
+      for (; i < cnt && n < FLUSH_BATCH; i++)
+        {
+          struct cache_entry *e = entries[i];
+
+          lock_acquire (&e->lock);
+          if (e->valid && e->dirty && !e->pinned)
+            {
+              struct block_request *r = &requests[n];
+
+              block_request_init (r, fs_device, e->sector, 1, e->data, true);
+              r->done = flush_done;
+              r->aux = &done;
+              block_submit (r);
+              mark_clean (e);
+              held[n++] = e;
+            }
+          else
+            lock_release (&e->lock);
+        }
+
+      written = n;
+      while (n-- > 0)
+        {
+          sema_down (&done);
+          lock_release (&held[n]->lock);
+        }
+
+      lock_acquire (&cache_lock);
+      stats.writeback_cnt += written;
+      lock_release (&cache_lock);
+    }
+}
+
+/* Copies the cache's statistics into *S. */
+void
+cache_get_stats (struct cache_stats *s)
+{
+  lock_acquire (&cache_lock);
+  *s = stats;
+  lock_release (&cache_lock);
+}
+
+/* Prints the cache's statistics. */
+void
+cache_print_stats (void)
+{
+  printf ("Cache: %"PRIu64" hits, %"PRIu64" misses, %"PRIu64" evictions, "
+          "%"PRIu64" write-backs\n",
+          stats.hit_cnt, stats.miss_cnt, stats.evict_cnt,
+          stats.writeback_cnt);
+  printf ("Cache: %"PRIu64" sectors read ahead, %"PRIu64" used, "
+          "%"PRIu64" wasted\n",
+          stats.read_ahead_cnt, stats.read_ahead_hit_cnt,
+          stats.read_ahead_wasted_cnt);
+}
+
+/* Marks E, whose lock must be held, as dirty. */
+static void
+mark_dirty (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+  if (!e->dirty)
+    {
+      e->dirty = true;
+      lock_acquire (&dirty_lock);
+      list_push_back (&dirty_list, &e->dirty_elem);
+      dirty_cnt++;
+      lock_release (&dirty_lock);
+    }
+}
+
+/* Marks E, whose lock must be held, as clean. */
+static void
+mark_clean (struct cache_entry *e)
+{
+  ASSERT (lock_held_by_current_thread (&e->lock));
+  if (e->dirty)
+    {
+      e->dirty = false;
+      lock_acquire (&dirty_lock);
+      list_remove (&e->dirty_elem);
+      dirty_cnt--;
+      lock_release (&dirty_lock);
+    }
+}
+
+/* Called after a write dirties the cache.  Past DIRTY_LOW dirty
+   sectors, queues write-back in the background; past DIRTY_HIGH,
+   writes them back before returning.  Sectors pinned by the
+   journal count, but are not written. */
+static void
+cache_throttle (void)
+{
+  size_t cnt;
+
+  lock_acquire (&dirty_lock);
+  cnt = dirty_cnt;
+  lock_release (&dirty_lock);
+
+  if (cnt >= DIRTY_HIGH)
+    cache_flush ();
+  else if (cnt >= DIRTY_LOW)
+    work_queue (&write_back_work, write_back, NULL);
+}
+
+/* Completion function for cache_flush()'s writes. */
+static void
+flush_done (struct block_request *r)
+{
+  sema_up (r->aux);
+}
+
+/* Returns the entry caching SECTOR, or a null pointer if there
+   is none.  cache_lock must be held. */
+static struct cache_entry *
+cache_lookup (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < CACHE_SIZE; i++)
+    if (cache[i].valid && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Chooses an entry to reuse as may_evict() decides, writes it
+   back if it is dirty, and returns it with its lock held and
+   `valid' false.  Entries whose locks the caller already holds
+   are passed over, and so are pinned entries.  If every other
+   entry is in use, waits for one if WAIT is true and otherwise
+   returns a null pointer.
+   cache_lock must be held. */
+static struct cache_entry *
+cache_evict (bool wait)
+{
+  struct cache_entry *e;
+  size_t scanned;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  /* Look for an unused or evictable entry, skipping entries that
+     are in use.  Three full sweeps make every entry evictable,
+     so if we get that far every entry is busy and we simply wait
+     for the one under the hand, unless it turns out to be
+     pinned. */
+  for (scanned = 0; ; scanned++)
+    {
+      e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_SIZE;
+
+      if (lock_held_by_current_thread (&e->lock))
+        continue;
+      if (scanned >= 3 * CACHE_SIZE)
+        {
+          if (!wait)
+            return NULL;
+          lock_acquire (&e->lock);
+          if (!e->pinned)
+            break;
+          lock_release (&e->lock);
+          continue;
+        }
+      if (!lock_try_acquire (&e->lock))
+        continue;
+      if (!e->valid)
+        break;
+      if (e->pinned || !may_evict (e, scanned))
+        {
+          lock_release (&e->lock);
+          continue;
+        }
+      break;
+    }
+
+  if (e->valid)
+    {
+      stats.evict_cnt++;
+      if (e->prefetched)
+        stats.read_ahead_wasted_cnt++;
+      if (!e->hot)
+        {
+          cold_cnt--;
+          ghost_add (&ghosts, e->sector);
+        }
+    }
+  e->prefetched = false;
+
+  /* Write back under cache_lock, so that nobody can miss in the
+     cache and read the stale on-disk copy in the meantime. */
+  if (e->valid && e->dirty)
+    {
+      block_write (fs_device, e->sector, e->data);
+      stats.writeback_cnt++;
+    }
+  e->valid = false;
+  mark_clean (e);
+  return e;
+}
+
+/* Returns true if the clock hand, on the SCANNED'th step of its
+   search, may take E, which is valid, unpinned, and locked by the
+   caller.  While probation is over COLD_MAX, the first sweep
+   takes only probation entries; otherwise the first two sweeps
+   take only protected entries not accessed since the hand last
+   passed them, clearing the accessed bits of the others.  Later
+   sweeps take either kind.  cache_lock must be held. */
+static bool
+may_evict (struct cache_entry *e, size_t scanned)
+{
+  size_t sweep = scanned / CACHE_SIZE;
+  bool cold_first = cold_cnt > COLD_MAX;
+
+  if (!e->hot)
+    return cold_first || sweep >= 2;
+  if (cold_first && sweep == 0)
+    return false;
+  if (e->accessed)
+    {
+      e->accessed = false;
+      return false;
+    }
+  return true;
+}
+
+/* Makes E, just returned by cache_evict(), the entry for SECTOR.
+   The sector is protected if it was evicted from probation not
+   long ago, and otherwise goes on probation.  cache_lock must be
+   held. */
+static void
+cache_fill (struct cache_entry *e, block_sector_t sector)
+{
+  e->sector = sector;
+  e->valid = true;
+  e->accessed = true;
+  e->hot = ghost_remove (&ghosts, sector);
+  if (!e->hot)
+    cold_cnt++;
+}
+
+/* Returns the entry for SECTOR with its lock held, bringing
+   SECTOR into the cache if necessary.  If FILL is false, the
+   caller is going to overwrite the whole sector, so a newly
+   cached sector is not read from disk. */
+static struct cache_entry *
+cache_get (block_sector_t sector, bool fill)
+{
+  struct cache_entry *e;
+
+  for (;;)
+    {
+      lock_acquire (&cache_lock);
+      e = cache_lookup (sector);
+      if (e == NULL)
+        break;
+      stats.hit_cnt++;
+      if (e->prefetched)
+        {
+          stats.read_ahead_hit_cnt++;
+          e->prefetched = false;
+        }
+      lock_release (&cache_lock);
+
+      /* The entry may have been recycled while we waited. */
+      lock_acquire (&e->lock);
+      if (e->valid && e->sector == sector)
+        {
+          e->accessed = true;
+          return e;
+        }
+      lock_release (&e->lock);
+    }
+
+  /* Miss.  Claim an entry, then do the read without cache_lock;
+     anyone else after this sector waits on the entry's lock. */
+  stats.miss_cnt++;
+  e = cache_evict (true);
+  cache_fill (e, sector);
+  lock_release (&cache_lock);
+
+  if (fill)
+    block_read (fs_device, sector, e->data);
+  else
+    memset (e->data, 0, BLOCK_SECTOR_SIZE);
+  return e;
+}
+
+/* Write-behind work.  Every WRITE_BEHIND_MS milliseconds,
+   commits the journal and writes dirty sectors back to disk, so
+   that a crash loses at most a few seconds of writes. */
+static void
+flush_behind (struct work *w, void *aux UNUSED)
+{
+  journal_commit ();
+  cache_flush ();
+  work_queue_delayed (w, WRITE_BEHIND_MS * TIMER_FREQ / 1000,
+                      flush_behind, NULL);
+}
+
+/* Write-back work queued by cache_throttle(). */
+static void
+write_back (struct work *w UNUSED, void *aux UNUSED)
+{
+  cache_flush ();
+}
+
+/* Claims entries for the sectors in the run of CNT sectors
+   starting at *SECTOR that are not cached, after skipping any at
+   the start of the run that are.  Stores the claimed entries in
+   RUN with their locks held, sets *SECTOR to the first sector
+   claimed, and returns the number of entries claimed, which are
+   for consecutive sectors.  Stops early at a cached sector, or
+   if no entry is free, rather than wait for one while holding
+   entry locks.  cache_lock must be held. */
+static size_t
+cache_claim_run (block_sector_t *sector, size_t cnt,
+                 struct cache_entry *run[])
+{
+  size_t n;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  while (cnt > 0 && cache_lookup (*sector) != NULL)
+    {
+      ++*sector;
+      cnt--;
+    }
+  for (n = 0; n < cnt; n++)
+    {
+      struct cache_entry *e;
+
+      if (n > 0 && cache_lookup (*sector + n) != NULL)
+        break;
+      e = cache_evict (false);
+      if (e == NULL)
+        break;
+      cache_fill (e, *sector + n);
+      e->prefetched = true;
+      stats.read_ahead_cnt++;
+      run[n] = e;
+    }
+  return n;
+}
+
+/* Removes the first queued read-ahead sector and any that
+   directly follow it on disk, up to READ_AHEAD_RUN in all, from
+   the queue.  Stores the first in *SECTOR and returns the number
+   removed, which is 0 if the queue is empty. */
+static size_t
+read_ahead_pop_run (block_sector_t *sector)
+{
+  size_t cnt = 0;
+
+  lock_acquire (&read_ahead_lock);
+  *sector = read_ahead_queue[read_ahead_head];
+  while (cnt < READ_AHEAD_RUN && read_ahead_cnt > 0
+         && (cnt == 0 || read_ahead_queue[read_ahead_head] == *sector + cnt))
+    {
+      read_ahead_head = (read_ahead_head + 1) % READ_AHEAD_CNT;
+      read_ahead_cnt--;
+      cnt++;
+    }
+  lock_release (&read_ahead_lock);
+  return cnt;
+}
+
+/* Read-ahead work.  Brings queued sectors into the cache until
+   the queue is empty, reading each run of queued sectors that
+   are consecutive on disk with a single request, and keeping up
+   to READ_AHEAD_BATCH such requests in flight.  A work never
+   runs in two workers at once, so BUFFERS may be shared. */
+static void
+read_ahead (struct work *w UNUSED, void *aux UNUSED)
+{
+  static uint8_t buffers[READ_AHEAD_BATCH][READ_AHEAD_RUN
+                                           * BLOCK_SECTOR_SIZE];
+
+  for (;;)
+    {
+      block_sector_t sectors[READ_AHEAD_BATCH];
+      size_t cnts[READ_AHEAD_BATCH];
+      struct cache_entry *runs[READ_AHEAD_BATCH][READ_AHEAD_RUN];
+      struct block_request requests[READ_AHEAD_BATCH];
+      size_t run_cnt, i, j;
+
+      /* Take runs off the queue and claim entries for all of
+         them at once, since we may not wait for cache_lock once
+         we hold entry locks. */
+      for (run_cnt = 0; run_cnt < READ_AHEAD_BATCH; run_cnt++)
+        {
+          cnts[run_cnt] = read_ahead_pop_run (&sectors[run_cnt]);
+          if (cnts[run_cnt] == 0)
+            break;
+        }
+      if (run_cnt == 0)
+        break;
+      lock_acquire (&cache_lock);
+      for (i = 0; i < run_cnt; i++)
+        cnts[i] = cache_claim_run (&sectors[i], cnts[i], runs[i]);
+      lock_release (&cache_lock);
+
+      /* Read the runs, then fill in their entries. */
+      for (i = 0; i < run_cnt; i++)
+        if (cnts[i] > 0)
+          {
+            block_request_init (&requests[i], fs_device, sectors[i], cnts[i],
+                                buffers[i], false);
+            block_submit (&requests[i]);
+          }
+      for (i = 0; i < run_cnt; i++)
+        if (cnts[i] > 0)
+          {
+            block_wait (&requests[i]);
+            for (j = 0; j < cnts[i]; j++)
+              {
+                memcpy (runs[i][j]->data, buffers[i] + j * BLOCK_SECTOR_SIZE,
+                        BLOCK_SECTOR_SIZE);
+                lock_release (&runs[i][j]->lock);
+              }
+          }
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include <fs-stats.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+/* Number of sectors held in the buffer cache. */
+#define CACHE_SIZE 64
+
+void cache_init (void);
+void cache_done (void);
+void cache_read (block_sector_t, void *buffer, int ofs, int size);
+void cache_read_direct (block_sector_t, size_t cnt, void *buffer);
+void cache_write (block_sector_t, const void *buffer, int ofs, int size);
+void cache_write_direct (block_sector_t, size_t cnt, const void *buffer);
+void cache_write_pinned (block_sector_t, const void *buffer, int ofs,
+                         int size);
+void cache_unpin (block_sector_t);
+void cache_read_ahead (block_sector_t);
+void cache_flush (void);
+void cache_flush_sectors (const block_sector_t[], size_t cnt);
+void cache_get_stats (struct cache_stats *);
+void cache_print_stats (void);
+
+#endif /* filesys/cache.h */
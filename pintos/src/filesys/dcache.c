@@ -0,0 +1,253 @@
+#include "filesys/dcache.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/rcu.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Maps a directory, identified by its inode sector, and a name
+   in it to the inode sector of the file the name refers to, or
+   to DCACHE_NEGATIVE if the directory has no such name.  Unlike
+   a directory's own index (see directory.c), which goes away
+   when the directory's inode leaves memory, the cache outlives
+   inodes, so resolving a path does not search every directory
+   along it again each time.
+
+   The directory code looks up, enters and changes the names of a
+   directory only while holding that directory's lock, so a name
+   in the cache always agrees with the directory.  When a
+   directory is removed, its names are purged before its sector
+   can be reused.
+
+   Lookups take no lock.  They run under rcu_read_lock(), and an
+   entry that leaves the hash table is reused only after a grace
+   period, so a lookup never sees an entry change under it.
+   Instead of moving an entry to the end of `lru', a lookup just
+   marks it accessed, and the entry gets a second chance when it
+   reaches the front.  Since evicted entries cannot be reused at
+   once, they are evicted EVICT_BATCH at a time, and a name that
+   finds no free entry is not entered. */
+
+/* Number of hash chains.  Must be a power of 2. */
+#define DCACHE_BUCKETS 128
+
+/* Number of entries evicted at once. */
+#define EVICT_BATCH 16
+
+/* A cached name.  DIR, NAME, and, when changing, SECTOR are
+   written with dcache_lock held and DIR's directory lock held. */
+struct dentry
+  {
+    struct dentry *hash_next;           /* Next in its `dentries' chain. */
+    struct list_elem list_elem;         /* Element in `lru' or `unused'. */
+    struct rcu_head rcu;                /* Frees it after a grace period. */
+    bool valid;                         /* In `dentries'? */
+    bool accessed;                      /* Looked up since it was passed? */
+    block_sector_t dir;                 /* Directory's inode sector. */
+    block_sector_t sector;              /* File's inode sector. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+  };
+
+/* The cache.  `lru' holds the entries in `dentries', from least
+   to most recently used, and `unused' holds the others.  An
+   entry on its way from one to the other, waiting out a grace
+   period, is on neither.  dcache_lock protects changes to all of
+   them. */
+static struct dentry dentries_array[DCACHE_SIZE];
+static struct dentry *dentries[DCACHE_BUCKETS];
+static struct list lru;
+static struct list unused;
+static struct lock dcache_lock;
+
+static struct dentry **bucket (block_sector_t dir, const char *name);
+static struct dentry *find (block_sector_t dir, const char *name);
+static void discard (struct dentry *);
+static void evict (void);
+static rcu_func free_dentry;
+
+/* Initializes the directory entry cache. */
+void
+dcache_init (void)
+{
+  size_t i;
+
+  list_init (&lru);
+  list_init (&unused);
+  lock_init (&dcache_lock);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    {
+      dentries_array[i].valid = false;
+      list_push_back (&unused, &dentries_array[i].list_elem);
+    }
+}
+
+/* Looks up NAME in the directory whose inode is in sector DIR.
+   If the cache knows about NAME, sets *SECTOR to the sector of
+   its inode, or to DCACHE_NEGATIVE if DIR has no file by that
+   name, and returns true.  Otherwise, returns false.
+   The caller must hold DIR's directory lock. */
+bool
+dcache_lookup (block_sector_t dir, const char *name,
+               block_sector_t *sector)
+{
+  struct dentry *d;
+
+  rcu_read_lock ();
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      *sector = __atomic_load_n (&d->sector, __ATOMIC_RELAXED);
+      if (!d->accessed)
+        d->accessed = true;
+    }
+  rcu_read_unlock ();
+
+  return d != NULL;
+}
+
+/* Records that NAME in the directory whose inode is in sector
+   DIR refers to the inode in SECTOR, or that there is no such
+   name if SECTOR is DCACHE_NEGATIVE.  If the cache is full, a
+   batch of the least recently used names is forgotten to make
+   room, and NAME is not recorded this time.
+   The caller must hold DIR's directory lock. */
+void
+dcache_enter (block_sector_t dir, const char *name, block_sector_t sector)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dcache_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      __atomic_store_n (&d->sector, sector, __ATOMIC_RELAXED);
+      list_remove (&d->list_elem);
+    }
+  else if (!list_empty (&unused))
+    {
+      struct dentry **b = bucket (dir, name);
+
+      d = list_entry (list_pop_front (&unused), struct dentry, list_elem);
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      d->sector = sector;
+      d->valid = true;
+      d->hash_next = *b;
+      rcu_assign_pointer (*b, d);
+    }
+  else
+    {
+      evict ();
+      lock_release (&dcache_lock);
+      return;
+    }
+  d->accessed = false;
+  list_push_back (&lru, &d->list_elem);
+  lock_release (&dcache_lock);
+}
+
+/* Forgets every name in the directory whose inode is in sector
+   DIR.  Called when the directory is removed, before its sector
+   can be reused. */
+void
+dcache_purge (block_sector_t dir)
+{
+  size_t i;
+
+  lock_acquire (&dcache_lock);
+  for (i = 0; i < DCACHE_SIZE; i++)
+    {
+      struct dentry *d = &dentries_array[i];
+      if (d->valid && d->dir == dir)
+        discard (d);
+    }
+  lock_release (&dcache_lock);
+}
+
+/* Returns the chain in `dentries' for NAME in DIR. */
+static struct dentry **
+bucket (block_sector_t dir, const char *name)
+{
+  unsigned hash = hash_string (name) ^ hash_int (dir);
+  return &dentries[hash & (DCACHE_BUCKETS - 1)];
+}
+
+/* Returns the cached entry for NAME in DIR, or a null pointer if
+   there is none.  The caller must hold dcache_lock or be in a
+   read-side critical section. */
+static struct dentry *
+find (block_sector_t dir, const char *name)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return NULL;
+  for (d = rcu_dereference (*bucket (dir, name)); d != NULL;
+       d = rcu_dereference (d->hash_next))
+    if (d->dir == dir && !strcmp (d->name, name))
+      return d;
+  return NULL;
+}
+
+/* Removes D from the cache's hash table and from `lru', and
+   puts it on `unused' after a grace period.  The caller must hold
+   dcache_lock. */
+static void
+discard (struct dentry *d)
+{
+  struct dentry **p;
+
+  ASSERT (d->valid);
+  for (p = bucket (d->dir, d->name); *p != d; p = &(*p)->hash_next)
+    continue;
+  rcu_assign_pointer (*p, d->hash_next);
+  list_remove (&d->list_elem);
+  d->valid = false;
+  call_rcu (&d->rcu, free_dentry);
+}
+
+/* Discards up to EVICT_BATCH of the least recently used entries,
+   passing over those accessed since they were last passed.  The
+   caller must hold dcache_lock. */
+static void
+evict (void)
+{
+  size_t evicted = 0;
+  size_t i;
+
+  for (i = 0; i < DCACHE_SIZE && evicted < EVICT_BATCH
+              && !list_empty (&lru); i++)
+    {
+      struct dentry *d = list_entry (list_front (&lru), struct dentry,
+                                     list_elem);
+      if (d->accessed)
+        {
+          d->accessed = false;
+          list_push_back (&lru, list_pop_front (&lru));
+        }
+      else
+        {
+          discard (d);
+          evicted++;
+        }
+    }
+}
+
+/* Makes the discarded entry that contains HEAD free for reuse,
+   after a grace period. */
+static void
+free_dentry (struct rcu_head *head)
+{
+  struct dentry *d = rcu_entry (head, struct dentry, rcu);
+
+  lock_acquire (&dcache_lock);
+  list_push_back (&unused, &d->list_elem);
+  lock_release (&dcache_lock);
+}
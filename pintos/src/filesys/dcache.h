@@ -0,0 +1,21 @@
+#ifndef FILESYS_DCACHE_H
+#define FILESYS_DCACHE_H
+
+#include <stdbool.h>
+#include "devices/block.h"
+
+/* Number of names held in the directory entry cache. */
+#define DCACHE_SIZE 256
+
+/* Inode sector recorded for a name known not to exist.  No
+   directory entry refers to the free map's inode. */
+#define DCACHE_NEGATIVE 0
+
+void dcache_init (void);
+bool dcache_lookup (block_sector_t dir, const char *name,
+                    block_sector_t *sector);
+void dcache_enter (block_sector_t dir, const char *name,
+                   block_sector_t sector);
+void dcache_purge (block_sector_t dir);
+
+#endif /* filesys/dcache.h */
@@ -0,0 +1,110 @@
+#include "filesys/defrag.h"
+#include <block-stats.h>
+#include <debug.h>
+#include <stdint.h>
+#include "devices/block.h"
+#include "devices/timer.h"
+#include "filesys/directory.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#include "threads/workqueue.h"
+
+/* Background defragmenter.
+
+   Low-priority deferred work, so that it only runs when nothing
+   else wants the CPU, runs every DEFRAG_MS milliseconds and
+   checks whether the file system device has completed any
+   requests since its last pass.  If it has not, the disk is
+   quiet, and the work walks the directory tree
+   from the root, asking inode_defragment() to move each file
+   split across several extents into one contiguous run, until
+   it has moved DEFRAG_FILES files.  The next pass starts over
+   from the root; files already moved are skipped quickly, since
+   they have only one extent. */
+
+/* Milliseconds between checks for a quiet disk. */
+#define DEFRAG_MS 2000
+
+/* Most files moved in one pass. */
+#define DEFRAG_FILES 4
+
+/* Deepest directory nesting walked.  Each level takes a little
+   of the worker thread's stack. */
+#define DEFRAG_DEPTH 8
+
+bool defrag_enabled;
+
+static struct work defrag_work;
+
+static work_func defrag_pass;
+static void defrag_dir (struct dir *, int depth, int *budget);
+
+/* Starts the defragmenter. */
+void
+defrag_init (void)
+{
+  work_init (&defrag_work, WORK_LOW);
+  work_queue_delayed (&defrag_work, DEFRAG_MS * TIMER_FREQ / 1000,
+                      defrag_pass, NULL);
+}
+
+/* Defragmenter work. */
+static void
+defrag_pass (struct work *w, void *aux UNUSED)
+{
+  static uint64_t last_cnt = UINT64_MAX;
+  struct block_stats stats;
+
+  block_get_stats (fs_device, &stats);
+  if (stats.request_cnt == last_cnt)
+    {
+      struct dir *root = dir_open_root ();
+      int budget = DEFRAG_FILES;
+
+      if (root != NULL)
+        {
+          defrag_dir (root, 0, &budget);
+          dir_close (root);
+        }
+
+      /* Don't count our own requests as activity. */
+      block_get_stats (fs_device, &stats);
+    }
+  last_cnt = stats.request_cnt;
+
+  work_queue_delayed (w, DEFRAG_MS * TIMER_FREQ / 1000, defrag_pass, NULL);
+}
+
+/* Defragments the files in DIR, which is nested DEPTH levels
+   below the root, and in its subdirectories, until *BUDGET files
+   have been moved. */
+static void
+defrag_dir (struct dir *dir, int depth, int *budget)
+{
+  char name[NAME_MAX + 1];
+  off_t pos = 0;
+
+  while (*budget > 0 && dir_readdir_at (dir_get_inode (dir), &pos, name))
+    {
+      struct inode *inode;
+
+      if (!dir_lookup (dir, name, &inode))
+        continue;
+      if (inode_is_dir (inode))
+        {
+          if (depth < DEFRAG_DEPTH)
+            {
+              struct dir *sub = dir_open (inode);
+              if (sub != NULL)
+                {
+                  defrag_dir (sub, depth + 1, budget);
+                  dir_close (sub);
+                }
+              continue;
+            }
+        }
+      else if (inode_defragment (inode))
+        --*budget;
+      inode_close (inode);
+    }
+}
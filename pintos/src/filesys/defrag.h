@@ -0,0 +1,13 @@
+#ifndef FILESYS_DEFRAG_H
+#define FILESYS_DEFRAG_H
+
+#include <stdbool.h>
+
+/* If true, a background thread moves fragmented files into
+   contiguous runs while the disk is idle.
+   Controlled by kernel command-line option "-defrag". */
+extern bool defrag_enabled;
+
+void defrag_init (void);
+
+#endif /* filesys/defrag.h */
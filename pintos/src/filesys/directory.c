@@ -1,10 +1,15 @@
 #include "filesys/directory.h"
 #include <stdio.h>
 #include <string.h>
+#include <hash.h>
 #include <list.h>
+#include <ohash.h>
+#include <round.h>
+#include "filesys/dcache.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 
 /* A directory. */
 struct dir 
@@ -13,29 +18,149 @@ struct dir
     off_t pos;                          /* Current position. */
   };
 
-/* A single directory entry. */
+/* A directory record on disk.
+
+   A directory is a sequence of sectors, each holding a chain of
+   variable-length records that starts at the beginning of the
+   sector and covers it to the end, so that no record crosses a
+   sector boundary.  A record's NAME is stored without a null
+   terminator, padded so that the next record is 4-byte aligned,
+   and a record may be longer than that if space after it is not
+   yet used.  A free record has INODE_SECTOR 0, which is never a
+   file's inode.  A sector of zeros, as a directory's sectors
+   start out, is a single free record.  Records are never moved,
+   split only at their unused tail, and never merged, so that the
+   offset of a record stays valid as a dir_readdir() position. */
+struct dir_record
+  {
+    block_sector_t inode_sector;        /* Sector of inode, or 0 if free. */
+    uint16_t rec_len;                   /* Bytes to next record, or 0. */
+    uint8_t name_len;                   /* Bytes in NAME. */
+    uint8_t unused;
+    char name[];                        /* NAME_LEN bytes of file name. */
+  };
+
+/* Bytes taken by a record for a name of NAME_LEN bytes. */
+#define RECORD_SIZE(NAME_LEN) \
+        ROUND_UP (sizeof (struct dir_record) + (NAME_LEN), 4)
+
+/* Space left over after splitting a record must hold a record for
+   a 1-byte name, or it is left with the record before it. */
+#define RECORD_MIN RECORD_SIZE (1)
+
+/* Space a new directory reserves per entry, enough for a record
+   with a typical name. */
+#define RECORD_TYPICAL RECORD_SIZE (14)
+
+/* A directory record, as read into memory. */
 struct dir_entry 
   {
     block_sector_t inode_sector;        /* Sector number of header. */
     char name[NAME_MAX + 1];            /* Null terminated file name. */
     bool in_use;                        /* In use or free? */
+    off_t ofs;                          /* Byte offset of record. */
+    size_t rec_len;                     /* Bytes taken by record. */
+  };
+
+/* Reads a directory's records in order, a sector at a time. */
+struct dir_cursor
+  {
+    struct inode *inode;                /* Directory. */
+    off_t pos;                          /* Offset of next record. */
+    off_t sector_ofs;                   /* Offset of sector in BUF, or -1. */
+    uint8_t *buf;                       /* One sector, or null. */
+  };
+
+/* Unused space in a directory: the record at byte offset OFS,
+   of which the first USED bytes hold a name, and the rest are
+   free for a new record.  USED is 0 for a free record. */
+struct dir_hole
+  {
+    off_t ofs;                          /* Offset of record. */
+    uint16_t rec_len;                   /* Bytes taken by record. */
+    uint16_t used;                      /* Bytes in use. */
   };
 
-/* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+/* In-memory index of the entries of a directory.
+
+   The first search of a directory reads its records once and
+   indexes them by name, along with the space free for new
+   records.  The index then stays with the directory's inode,
+   protected by the inode's directory lock, which lookups share,
+   for as long as the inode stays in memory, so lookups,
+   additions and removals no longer read the directory record
+   by record.
+
+   The index is only a cache.  If memory for it runs short, it is
+   discarded and the directory is searched on disk as before. */
+struct dir_index
+  {
+    struct ohash names;                 /* Entries in use, by name. */
+    struct dir_hole *holes;             /* Space for new records. */
+    size_t hole_cnt;                    /* Number of elements in `holes'. */
+    size_t hole_max;                    /* Capacity of `holes'. */
+    off_t end;                          /* Offset just past last sector. */
+  };
+
+/* An entry in a directory index. */
+struct index_entry
+  {
+    struct hash_elem elem;              /* Element in `names'. */
+    block_sector_t inode_sector;        /* Sector number of header. */
+    off_t ofs;                          /* Offset of directory record. */
+    uint16_t rec_len;                   /* Bytes taken by record. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+  };
+
+/* Cache of `struct dir's. */
+static struct kmem_cache *dir_cache;
+
+/* Cache of `struct index_entry's. */
+static struct kmem_cache *index_entry_cache;
+
+static bool is_dot (const char *name);
+static bool is_empty (const struct dir *);
+
+/* Initializes the directory module. */
+void
+dir_init (void) 
+{
+  dir_cache = kmem_cache_create ("dir", sizeof (struct dir), NULL);
+  index_entry_cache = kmem_cache_create ("dir_index",
+                                         sizeof (struct index_entry), NULL);
+  dcache_init ();
+}
+
+/* Creates a directory with space for about ENTRY_CNT entries in
+   the given SECTOR, whose parent directory's inode is in sector
+   PARENT.  The directory starts out with entries "." and ".."
+   for itself and its parent, beyond the ENTRY_CNT.
+   Returns true if successful, false on failure. */
 bool
-dir_create (block_sector_t sector, size_t entry_cnt)
+dir_create (block_sector_t sector, size_t entry_cnt, block_sector_t parent)
 {
-  return inode_create (sector, entry_cnt * sizeof (struct dir_entry));
+  struct dir *dir;
+  bool success;
+
+  if (!inode_create (sector, ROUND_UP ((entry_cnt + 2) * RECORD_TYPICAL,
+                                       BLOCK_SECTOR_SIZE), true))
+    return false;
+  dir = dir_open (inode_open (sector));
+  success = (dir != NULL
+             && dir_add (dir, ".", sector)
+             && dir_add (dir, "..", parent));
+  dir_close (dir);
+  return success;
 }
 
 /* Opens and returns the directory for the given INODE, of which
-   it takes ownership.  Returns a null pointer on failure. */
+   it takes ownership.  Returns a null pointer on failure,
+   including if INODE does not hold a directory. */
 struct dir *
 dir_open (struct inode *inode) 
 {
-  struct dir *dir = calloc (1, sizeof *dir);
-  if (inode != NULL && dir != NULL)
+  struct dir *dir = kmem_cache_alloc (dir_cache);
+  if (inode != NULL && dir != NULL && inode_is_dir (inode))
     {
       dir->inode = inode;
       dir->pos = 0;
@@ -44,7 +169,7 @@ dir_open (struct inode *inode)
   else
     {
       inode_close (inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
       return NULL; 
     }
 }
@@ -72,7 +197,7 @@ dir_close (struct dir *dir)
   if (dir != NULL)
     {
       inode_close (dir->inode);
-      free (dir);
+      kmem_cache_free (dir_cache, dir);
     }
 }
 
@@ -83,29 +208,390 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+
+/* Directory records. */
+
+/* Starts cursor C at byte offset POS of the directory in INODE,
+   which must be the offset of a record.  If BUF is non-null, C
+   reads whole sectors into it, which suits reading many records
+   in a row; otherwise it reads each record by itself. */
+static void
+cursor_init (struct dir_cursor *c, struct inode *inode, off_t pos,
+             uint8_t *buf)
+{
+  c->inode = inode;
+  c->pos = pos;
+  c->sector_ofs = -1;
+  c->buf = buf;
+}
+
+/* Reads the record at C's position into *E and advances C past
+   it.  Returns false at the end of the directory.  The rest of a
+   sector whose chain of records is damaged is skipped. */
+static bool
+cursor_next (struct dir_cursor *c, struct dir_entry *e)
+{
+  uint32_t rec[RECORD_SIZE (NAME_MAX) / sizeof (uint32_t)];
+
+  for (;;)
+    {
+      off_t sector_ofs = c->pos / BLOCK_SECTOR_SIZE * BLOCK_SECTOR_SIZE;
+      size_t ofs = c->pos - sector_ofs;
+      size_t left = BLOCK_SECTOR_SIZE - ofs;
+      const struct dir_record *r;
+
+      if (left < sizeof *r)
+        {
+          c->pos = sector_ofs + BLOCK_SECTOR_SIZE;
+          continue;
+        }
+      if (c->buf != NULL)
+        {
+          if (c->sector_ofs != sector_ofs)
+            {
+              if (inode_read_at (c->inode, c->buf, BLOCK_SECTOR_SIZE,
+                                 sector_ofs) != BLOCK_SECTOR_SIZE)
+                return false;
+              c->sector_ofs = sector_ofs;
+            }
+          r = (const struct dir_record *) (c->buf + ofs);
+        }
+      else
+        {
+          size_t size = left < sizeof rec ? left : sizeof rec;
+          if (inode_read_at (c->inode, rec, size, c->pos) != (off_t) size)
+            return false;
+          r = (const struct dir_record *) rec;
+        }
+
+      if (r->rec_len != 0
+          && (r->rec_len < sizeof *r || r->rec_len > left
+              || r->name_len > NAME_MAX
+              || r->name_len > r->rec_len - sizeof *r))
+        {
+          c->pos = sector_ofs + BLOCK_SECTOR_SIZE;
+          continue;
+        }
+
+      e->ofs = c->pos;
+      e->rec_len = r->rec_len != 0 ? r->rec_len : left;
+      e->in_use = r->inode_sector != 0 && r->name_len > 0;
+      e->inode_sector = r->inode_sector;
+      memcpy (e->name, r->name, e->in_use ? r->name_len : 0);
+      e->name[e->in_use ? r->name_len : 0] = '\0';
+      c->pos += e->rec_len;
+      return true;
+    }
+}
+
+/* Fills in R as a record taking REC_LEN bytes for NAME, whose
+   inode is in INODE_SECTOR, and returns the number of bytes of R
+   to write. */
+static size_t
+fill_record (struct dir_record *r, size_t rec_len, const char *name,
+             block_sector_t inode_sector)
+{
+  size_t name_len = strlen (name);
+
+  r->inode_sector = inode_sector;
+  r->rec_len = rec_len;
+  r->name_len = name_len;
+  r->unused = 0;
+  memcpy (r->name, name, name_len);
+  return sizeof *r + name_len;
+}
+
+/* Returns the number of bytes of hole H free for a new record. */
+static size_t
+hole_space (const struct dir_hole *h)
+{
+  return (size_t) h->rec_len - h->used;
+}
+
+/* Writes a record for NAME, whose inode is in INODE_SECTOR, into
+   hole H of the directory in INODE, where a hole at offset END
+   is a new sector to append.  On success, updates H to describe
+   the new record and the space left after it and returns true.
+   The new record is written before the one it is split from is
+   shortened, so that it cannot appear half written. */
+static bool
+place_record (struct inode *inode, struct dir_hole *h, off_t end,
+              const char *name, block_sector_t inode_sector)
+{
+  off_t ofs = h->ofs + h->used;
+  size_t rec_len = h->rec_len - h->used;
+  uint32_t rec[RECORD_SIZE (NAME_MAX) / sizeof (uint32_t)];
+  bool success;
+
+  if (h->ofs == end)
+    {
+      uint8_t *sector = calloc (1, BLOCK_SECTOR_SIZE);
+      if (sector == NULL)
+        return false;
+      fill_record ((struct dir_record *) sector, rec_len, name,
+                   inode_sector);
+      success = inode_write_at (inode, sector, BLOCK_SECTOR_SIZE, ofs)
+                == BLOCK_SECTOR_SIZE;
+      free (sector);
+    }
+  else
+    {
+      size_t size = fill_record ((struct dir_record *) rec, rec_len, name,
+                                 inode_sector);
+      uint16_t used = h->used;
+
+      success = inode_write_at (inode, rec, size, ofs) == (off_t) size;
+      if (success && used > 0)
+        success = (inode_write_at (inode, &used, sizeof used,
+                                   h->ofs + offsetof (struct dir_record,
+                                                      rec_len))
+                   == sizeof used);
+    }
+  if (!success)
+    return false;
+
+  h->ofs = ofs;
+  h->rec_len = rec_len;
+  h->used = RECORD_SIZE (strlen (name));
+  return true;
+}
+
+/* Marks the record described by E free on disk.  Returns true if
+   successful. */
+static bool
+free_record (struct inode *inode, const struct dir_entry *e)
+{
+  struct dir_record r;
+
+  r.inode_sector = 0;
+  r.rec_len = e->rec_len;
+  r.name_len = 0;
+  r.unused = 0;
+  return inode_write_at (inode, &r, sizeof r, e->ofs) == sizeof r;
+}
+
+/* Directory indexes. */
+
+/* Returns the hash value for index entry E. */
+static unsigned
+index_entry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct index_entry *ie = hash_entry (e, struct index_entry, elem);
+  return hash_string (ie->name);
+}
+
+/* Returns true if index entry A's name precedes B's. */
+static bool
+index_entry_less (const struct hash_elem *a, const struct hash_elem *b,
+                  void *aux UNUSED)
+{
+  const struct index_entry *ia = hash_entry (a, struct index_entry, elem);
+  const struct index_entry *ib = hash_entry (b, struct index_entry, elem);
+  return strcmp (ia->name, ib->name) < 0;
+}
+
+/* Frees index entry E. */
+static void
+index_entry_free (struct hash_elem *e, void *aux UNUSED)
+{
+  kmem_cache_free (index_entry_cache,
+                   hash_entry (e, struct index_entry, elem));
+}
+
+/* Destroys directory index INDEX, if it is non-null. */
+void
+dir_index_destroy (struct dir_index *index)
+{
+  if (index != NULL)
+    {
+      ohash_destroy (&index->names, index_entry_free);
+      free (index->holes);
+      free (index);
+    }
+}
+
+/* Adds the in-use record described by E to INDEX.  Returns true
+   if successful, false if memory is exhausted. */
+static bool
+index_add (struct dir_index *index, const struct dir_entry *e)
+{
+  struct index_entry *ie = kmem_cache_alloc (index_entry_cache);
+  if (ie == NULL)
+    return false;
+  ie->inode_sector = e->inode_sector;
+  ie->ofs = e->ofs;
+  ie->rec_len = e->rec_len;
+  strlcpy (ie->name, e->name, sizeof ie->name);
+  if (ohash_insert (&index->names, &ie->elem) != NULL)
+    {
+      kmem_cache_free (index_entry_cache, ie);
+      return false;
+    }
+  return true;
+}
+
+/* Returns INDEX's entry for NAME, or a null pointer if there is
+   none. */
+static struct index_entry *
+index_find (struct dir_index *index, const char *name)
+{
+  struct index_entry key;
+  struct hash_elem *e;
+
+  if (strnlen (name, NAME_MAX + 1) > NAME_MAX)
+    return NULL;
+  strlcpy (key.name, name, sizeof key.name);
+  e = ohash_find (&index->names, &key.elem);
+  return e != NULL ? hash_entry (e, struct index_entry, elem) : NULL;
+}
+
+/* Records hole H in INDEX, unless it has too little space to
+   matter.  Returns true if successful, false if memory is
+   exhausted. */
+static bool
+index_push_hole (struct dir_index *index, const struct dir_hole *h)
+{
+  if (hole_space (h) < RECORD_MIN)
+    return true;
+  if (index->hole_cnt >= index->hole_max)
+    {
+      size_t new_max = index->hole_max > 0 ? index->hole_max * 2 : 16;
+      struct dir_hole *new_holes = realloc (index->holes,
+                                            new_max * sizeof *new_holes);
+      if (new_holes == NULL)
+        return false;
+      index->holes = new_holes;
+      index->hole_max = new_max;
+    }
+  index->holes[index->hole_cnt++] = *h;
+  return true;
+}
+
+/* Returns the hole in INDEX at byte offset OFS, or a null pointer
+   if there is none. */
+static struct dir_hole *
+index_find_hole (struct dir_index *index, off_t ofs)
+{
+  size_t i;
+
+  for (i = 0; i < index->hole_cnt; i++)
+    if (index->holes[i].ofs == ofs)
+      return &index->holes[i];
+  return NULL;
+}
+
+/* Reads the directory in INODE and returns a new index of it, or
+   a null pointer if memory is exhausted. */
+static struct dir_index *
+index_build (struct inode *inode)
+{
+  struct dir_index *index;
+  struct dir_cursor c;
+  struct dir_entry e;
+  uint8_t *buf;
+
+  index = malloc (sizeof *index);
+  if (index == NULL)
+    return NULL;
+  index->holes = NULL;
+  index->hole_cnt = index->hole_max = 0;
+  if (!ohash_init (&index->names, index_entry_hash, index_entry_less, NULL))
+    {
+      free (index);
+      return NULL;
+    }
+
+  buf = malloc (BLOCK_SECTOR_SIZE);
+  if (buf == NULL)
+    {
+      dir_index_destroy (index);
+      return NULL;
+    }
+
+  /* Like the scans in lookup() and dir_add(), stop at the first
+     short read. */
+  cursor_init (&c, inode, 0, buf);
+  while (cursor_next (&c, &e))
+    {
+      struct dir_hole h;
+
+      h.ofs = e.ofs;
+      h.rec_len = e.rec_len;
+      h.used = e.in_use ? RECORD_SIZE (strlen (e.name)) : 0;
+      if ((e.in_use && !index_add (index, &e))
+          || !index_push_hole (index, &h))
+        {
+          free (buf);
+          dir_index_destroy (index);
+          return NULL;
+        }
+    }
+  index->end = inode_length (inode);
+
+  free (buf);
+  return index;
+}
+
+/* Returns the index of DIR, building it if necessary, or a null
+   pointer if memory is exhausted.  The caller must hold DIR's
+   directory lock, for writing if DIR has no index yet. */
+static struct dir_index *
+get_index (const struct dir *dir)
+{
+  struct dir_index *index = inode_get_dir_index (dir->inode);
+  if (index == NULL)
+    {
+      index = index_build (dir->inode);
+      inode_set_dir_index (dir->inode, index);
+    }
+  return index;
+}
+
+/* Discards DIR's index, which will be rebuilt when next needed. */
+static void
+drop_index (const struct dir *dir)
+{
+  dir_index_destroy (inode_get_dir_index (dir->inode));
+  inode_set_dir_index (dir->inode, NULL);
+}
+
 /* Searches DIR for a file with the given NAME.
-   If successful, returns true, sets *EP to the directory entry
-   if EP is non-null, and sets *OFSP to the byte offset of the
-   directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   If successful, returns true and sets *EP to the directory
+   entry if EP is non-null; otherwise, returns false and ignores
+   EP.  The caller must hold DIR's directory lock. */
 static bool
-lookup (const struct dir *dir, const char *name,
-        struct dir_entry *ep, off_t *ofsp) 
+lookup (const struct dir *dir, const char *name, struct dir_entry *ep) 
 {
+  struct dir_index *index;
+  struct dir_cursor c;
   struct dir_entry e;
-  size_t ofs;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
+  index = get_index (dir);
+  if (index != NULL)
+    {
+      struct index_entry *ie = index_find (index, name);
+      if (ie == NULL)
+        return false;
+      if (ep != NULL)
+        {
+          ep->inode_sector = ie->inode_sector;
+          strlcpy (ep->name, ie->name, sizeof ep->name);
+          ep->in_use = true;
+          ep->ofs = ie->ofs;
+          ep->rec_len = ie->rec_len;
+        }
+      return true;
+    }
+
+  cursor_init (&c, dir->inode, 0, NULL);
+  while (cursor_next (&c, &e))
     if (e.in_use && !strcmp (name, e.name)) 
       {
         if (ep != NULL)
           *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
         return true;
       }
   return false;
@@ -114,20 +600,50 @@ lookup (const struct dir *dir, const char *name,
 /* Searches DIR for a file with the given NAME
    and returns true if one exists, false otherwise.
    On success, sets *INODE to an inode for the file, otherwise to
-   a null pointer.  The caller must close *INODE. */
+   a null pointer.  The caller must close *INODE.
+   A directory that has been removed contains nothing, not even
+   "." and "..".  Names found or not found are remembered in the
+   directory entry cache.
+
+   Lookups share DIR's directory lock with each other, except
+   for the first one after DIR's index was dropped, which builds
+   the index anew and so needs the lock to itself. */
 bool
 dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
+  block_sector_t dir_sector, sector;
   struct dir_entry e;
+  bool exclusive = false;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  if (lookup (dir, name, &e, NULL))
-    *inode = inode_open (e.inode_sector);
+  dir_sector = inode_get_inumber (dir->inode);
+  inode_lock_dir_read (dir->inode);
+  if (!inode_is_removed (dir->inode)
+      && inode_get_dir_index (dir->inode) == NULL
+      && !dcache_lookup (dir_sector, name, &sector))
+    {
+      inode_unlock_dir_read (dir->inode);
+      inode_lock_dir (dir->inode);
+      exclusive = true;
+    }
+
+  if (inode_is_removed (dir->inode))
+    sector = DCACHE_NEGATIVE;
+  else if (!dcache_lookup (dir_sector, name, &sector))
+    {
+      sector = DCACHE_NEGATIVE;
+      if (lookup (dir, name, &e))
+        sector = e.inode_sector;
+      dcache_enter (dir_sector, name, sector);
+    }
+  *inode = sector != DCACHE_NEGATIVE ? inode_open (sector) : NULL;
+  if (exclusive)
+    inode_unlock_dir (dir->inode);
   else
-    *inode = NULL;
+    inode_unlock_dir_read (dir->inode);
 
   return *inode != NULL;
 }
@@ -136,13 +652,17 @@ dir_lookup (const struct dir *dir, const char *name,
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
    Returns true if successful, false on failure.
-   Fails if NAME is invalid (i.e. too long) or a disk or memory
-   error occurs. */
+   Fails if NAME is invalid (i.e. too long), if DIR has been
+   removed, or if a disk or memory error occurs. */
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
+  struct dir_index *index;
+  struct dir_hole *slot = NULL;
+  struct dir_hole h;
   struct dir_entry e;
-  off_t ofs;
+  off_t end;
+  size_t need;
   bool success = false;
 
   ASSERT (dir != NULL);
@@ -151,49 +671,112 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   /* Check NAME for validity. */
   if (*name == '\0' || strlen (name) > NAME_MAX)
     return false;
+  need = RECORD_SIZE (strlen (name));
+
+  inode_lock_dir (dir->inode);
 
-  /* Check that NAME is not in use. */
-  if (lookup (dir, name, NULL, NULL))
+  /* Check that DIR still exists and that NAME is not in use. */
+  if (inode_is_removed (dir->inode) || lookup (dir, name, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
+  /* Find a record that is free or has room at its end for NEED
+     bytes.  If there is none, a new sector goes at the current
+     end-of-file.
      
      inode_read_at() will only return a short read at end of file.
      Otherwise, we'd need to verify that we didn't get a short
      read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  index = inode_get_dir_index (dir->inode);
+  if (index != NULL)
+    {
+      size_t i;
+
+      end = index->end;
+      for (i = 0; i < index->hole_cnt && slot == NULL; i++)
+        if (hole_space (&index->holes[i]) >= need)
+          slot = &index->holes[i];
+    }
+  else
+    {
+      struct dir_cursor c;
+
+      end = inode_length (dir->inode);
+      cursor_init (&c, dir->inode, 0, NULL);
+      while (slot == NULL && cursor_next (&c, &e))
+        {
+          h.ofs = e.ofs;
+          h.rec_len = e.rec_len;
+          h.used = e.in_use ? RECORD_SIZE (strlen (e.name)) : 0;
+          if (hole_space (&h) >= need)
+            slot = &h;
+        }
+    }
+  if (slot == NULL)
+    {
+      h.ofs = end;
+      h.rec_len = BLOCK_SECTOR_SIZE;
+      h.used = 0;
+      slot = &h;
+    }
 
-  /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  /* Write record. */
+  success = place_record (dir->inode, slot, end, name, inode_sector);
+
+  /* Bring the index up to date, or discard it if that fails.  The
+     hole written into now describes the new record. */
+  if (index != NULL)
+    {
+      bool indexed = success;
+
+      e.inode_sector = inode_sector;
+      strlcpy (e.name, name, sizeof e.name);
+      e.in_use = true;
+      e.ofs = slot->ofs;
+      e.rec_len = slot->rec_len;
+      if (indexed && slot == &h)
+        {
+          index->end += BLOCK_SECTOR_SIZE;
+          indexed = index_push_hole (index, &h);
+        }
+      else if (indexed && hole_space (slot) < RECORD_MIN)
+        *slot = index->holes[--index->hole_cnt];
+      if (!indexed || !index_add (index, &e))
+        drop_index (dir);
+    }
+  if (success)
+    dcache_enter (inode_get_inumber (dir->inode), name, inode_sector);
 
  done:
+  inode_unlock_dir (dir->inode);
   return success;
 }
 
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
-   which occurs only if there is no file with the given NAME. */
+   which occurs only if there is no file with the given NAME,
+   NAME is "." or "..", or NAME is a directory that is not
+   empty.  An empty directory may be removed even while it is
+   open or is a process's current directory; it then contains
+   nothing until it is closed for the last time. */
 bool
 dir_remove (struct dir *dir, const char *name) 
 {
+  struct dir_index *index;
   struct dir_entry e;
   struct inode *inode = NULL;
+  struct dir *child = NULL;
   bool success = false;
-  off_t ofs;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  if (is_dot (name))
+    return false;
+
+  inode_lock_dir (dir->inode);
+
   /* Find directory entry. */
-  if (!lookup (dir, name, &e, &ofs))
+  if (!lookup (dir, name, &e))
     goto done;
 
   /* Open inode. */
@@ -201,16 +784,57 @@ dir_remove (struct dir *dir, const char *name)
   if (inode == NULL)
     goto done;
 
-  /* Erase directory entry. */
-  e.in_use = false;
-  if (inode_write_at (dir->inode, &e, sizeof e, ofs) != sizeof e) 
+  /* A directory must be empty.  Hold its lock until it is marked
+     removed, so that nothing is added to it meanwhile. */
+  if (inode_is_dir (inode))
+    {
+      child = dir_open (inode_reopen (inode));
+      if (child == NULL)
+        goto done;
+      inode_lock_dir (child->inode);
+      if (!is_empty (child))
+        goto done;
+    }
+
+  /* Erase directory entry.  Its record stays in place, free. */
+  if (!free_record (dir->inode, &e))
     goto done;
 
-  /* Remove inode. */
+  /* Remove it from the index too, and record its space as free.
+     If that fails, the space stays unused until the index is
+     rebuilt. */
+  index = inode_get_dir_index (dir->inode);
+  if (index != NULL)
+    {
+      struct index_entry *ie = index_find (index, name);
+      struct dir_hole *h = index_find_hole (index, e.ofs);
+
+      ohash_delete (&index->names, &ie->elem);
+      kmem_cache_free (index_entry_cache, ie);
+      if (h != NULL)
+        h->used = 0;
+      else
+        {
+          struct dir_hole free_hole = {e.ofs, e.rec_len, 0};
+          index_push_hole (index, &free_hole);
+        }
+    }
+  dcache_enter (inode_get_inumber (dir->inode), name, DCACHE_NEGATIVE);
+
+  /* Remove inode.  A removed directory's names must be forgotten
+     before its sector can be reused. */
   inode_remove (inode);
+  if (child != NULL)
+    dcache_purge (e.inode_sector);
   success = true;
 
  done:
+  if (child != NULL)
+    {
+      inode_unlock_dir (child->inode);
+      dir_close (child);
+    }
+  inode_unlock_dir (dir->inode);
   inode_close (inode);
   return success;
 }
@@ -221,16 +845,83 @@ dir_remove (struct dir *dir, const char *name)
 bool
 dir_readdir (struct dir *dir, char name[NAME_MAX + 1])
 {
+  return dir_readdir_at (dir->inode, &dir->pos, name);
+}
+
+/* Reads the entry of the directory in INODE that follows byte
+   offset *POS and stores its name in NAME, advancing *POS past
+   it.  Entries "." and ".." are skipped.  Returns true if
+   successful, false if the directory contains no more entries. */
+bool
+dir_readdir_at (struct inode *inode, off_t *pos, char name[NAME_MAX + 1])
+{
+  struct dir_cursor c;
   struct dir_entry e;
+  bool found = false;
 
-  while (inode_read_at (dir->inode, &e, sizeof e, dir->pos) == sizeof e) 
-    {
-      dir->pos += sizeof e;
-      if (e.in_use)
-        {
-          strlcpy (name, e.name, NAME_MAX + 1);
-          return true;
-        } 
-    }
-  return false;
+  inode_lock_dir_read (inode);
+  cursor_init (&c, inode, *pos, NULL);
+  while (cursor_next (&c, &e)) 
+    if (e.in_use && !is_dot (e.name))
+      {
+        strlcpy (name, e.name, NAME_MAX + 1);
+        found = true;
+        break;
+      } 
+  *pos = c.pos;
+  inode_unlock_dir_read (inode);
+  return found;
+}
+
+/* Reads up to CNT entries of the directory in INODE that follow
+   byte offset *POS, skipping "." and "..", and stores their names
+   in NAMES, advancing *POS past the last one stored.  Records are
+   read a sector at a time rather than one by one.  Returns the
+   number of names stored, which is 0 if the directory contains
+   no more entries, or -1 if memory is exhausted. */
+int
+dir_readdir_many (struct inode *inode, off_t *pos,
+                  char names[][NAME_MAX + 1], int cnt)
+{
+  struct dir_cursor c;
+  struct dir_entry e;
+  uint8_t *buf;
+  int found = 0;
+
+  buf = malloc (BLOCK_SECTOR_SIZE);
+  if (buf == NULL)
+    return -1;
+
+  inode_lock_dir_read (inode);
+  cursor_init (&c, inode, *pos, buf);
+  while (found < cnt && cursor_next (&c, &e))
+    if (e.in_use && !is_dot (e.name))
+      strlcpy (names[found++], e.name, NAME_MAX + 1);
+  *pos = c.pos;
+  inode_unlock_dir_read (inode);
+
+  free (buf);
+  return found;
+}
+
+/* Returns true if NAME is "." or "..". */
+static bool
+is_dot (const char *name)
+{
+  return !strcmp (name, ".") || !strcmp (name, "..");
+}
+
+/* Returns true if DIR has no entries other than "." and "..".
+   The caller must hold DIR's directory lock. */
+static bool
+is_empty (const struct dir *dir)
+{
+  struct dir_cursor c;
+  struct dir_entry e;
+
+  cursor_init (&c, dir->inode, 0, NULL);
+  while (cursor_next (&c, &e))
+    if (e.in_use && !is_dot (e.name))
+      return false;
+  return true;
 }
@@ -1,74 +1,191 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include <poll.h>
+#include <round.h>
+#include <uio.h>
+#include "devices/block.h"
 #include "filesys/inode.h"
-#include "threads/malloc.h"
+#include "filesys/pipe.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/vaddr.h"
 
-/* An open file. */
+/* Read-ahead window of a file, in sectors: where it starts, and
+   the most it grows to while reads stay sequential. */
+#define READ_AHEAD_MIN 4
+#define READ_AHEAD_MAX 32
+
+/* An open file, or one end of a pipe.  A pipe end has a null
+   INODE and supports only file_read() or file_write(),
+   file_length(), file_reopen(), and file_close(). */
 struct file 
   {
     struct inode *inode;        /* File's inode. */
+    struct pipe *pipe;          /* Pipe, for a pipe end. */
+    bool pipe_writer;           /* Write end of PIPE? */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    off_t ra_next;              /* Where a sequential read would start. */
+    off_t ra_end;               /* End of data already read ahead. */
+    int ra_window;              /* Read-ahead window, in sectors. */
   };
 
+static off_t read_iov (struct file *, const struct iovec *, int iovcnt,
+                       off_t start);
+static void init_pipe_end (struct file *, struct pipe *, bool writer);
+
+/* Cache of `struct file's. */
+static struct kmem_cache *file_cache;
+
+/* Initializes the file module. */
+void
+file_init (void) 
+{
+  file_cache = kmem_cache_create ("file", sizeof (struct file), NULL);
+}
+
 /* Opens a file for the given INODE, of which it takes ownership,
    and returns the new file.  Returns a null pointer if an
    allocation fails or if INODE is null. */
 struct file *
 file_open (struct inode *inode) 
 {
-  struct file *file = calloc (1, sizeof *file);
+  struct file *file = kmem_cache_alloc (file_cache);
   if (inode != NULL && file != NULL)
     {
       file->inode = inode;
+      file->pipe = NULL;
+      file->pipe_writer = false;
       file->pos = 0;
       file->deny_write = false;
+      file->ra_next = 0;
+      file->ra_end = 0;
+      file->ra_window = READ_AHEAD_MIN;
       return file;
     }
   else
     {
       inode_close (inode);
-      free (file);
+      kmem_cache_free (file_cache, file);
       return NULL; 
     }
 }
 
-/* Opens and returns a new file for the same inode as FILE.
-   Returns a null pointer if unsuccessful. */
+/* Creates a pipe and opens its read end as ENDS[0] and its write
+   end as ENDS[1].  Returns true if successful, false if memory
+   is not available. */
+bool
+file_open_pipe (struct file *ends[2]) 
+{
+  struct pipe *pipe;
+
+  ends[0] = kmem_cache_alloc (file_cache);
+  ends[1] = kmem_cache_alloc (file_cache);
+  pipe = ends[0] != NULL && ends[1] != NULL ? pipe_create () : NULL;
+  if (pipe == NULL)
+    {
+      kmem_cache_free (file_cache, ends[0]);
+      kmem_cache_free (file_cache, ends[1]);
+      return false;
+    }
+  init_pipe_end (ends[0], pipe, false);
+  init_pipe_end (ends[1], pipe, true);
+  return true;
+}
+
+/* Opens and returns a new file for the same inode as FILE, or a
+   new end of the same pipe.  Returns a null pointer if
+   unsuccessful. */
 struct file *
 file_reopen (struct file *file) 
 {
-  return file_open (inode_reopen (file->inode));
+  struct file *end;
+
+  if (file->pipe == NULL)
+    return file_open (inode_reopen (file->inode));
+  end = kmem_cache_alloc (file_cache);
+  if (end != NULL)
+    init_pipe_end (end, file->pipe, file->pipe_writer);
+  return end;
+}
+
+/* Makes FILE another end of PIPE: the write end if WRITER is
+   true, otherwise the read end. */
+static void
+init_pipe_end (struct file *file, struct pipe *pipe, bool writer) 
+{
+  file->inode = NULL;
+  file->pipe = pipe;
+  file->pipe_writer = writer;
+  file->pos = 0;
+  file->deny_write = false;
+  file->ra_next = 0;
+  file->ra_end = 0;
+  file->ra_window = READ_AHEAD_MIN;
+  pipe_open (pipe, writer);
 }
 
 /* Closes FILE. */
 void
 file_close (struct file *file) 
 {
-  if (file != NULL)
+  if (file != NULL && file->pipe != NULL)
+    {
+      pipe_close (file->pipe, file->pipe_writer);
+      kmem_cache_free (file_cache, file);
+    }
+  else if (file != NULL)
     {
       file_allow_write (file);
       inode_close (file->inode);
-      free (file); 
+      kmem_cache_free (file_cache, file);
     }
 }
 
-/* Returns the inode encapsulated by FILE. */
+/* Returns the inode encapsulated by FILE, or a null pointer if
+   FILE is a pipe end. */
 struct inode *
 file_get_inode (struct file *file) 
 {
   return file->inode;
 }
 
+/* Returns true if FILE is an end of a pipe. */
+bool
+file_is_pipe (const struct file *file) 
+{
+  return file->pipe != NULL;
+}
+
+/* Returns the poll() events that are true of FILE, putting PT,
+   if nonnull, on the wait queue of anything FILE may wait for.
+   A file or directory is always ready. */
+int
+file_poll (struct file *file, struct poll_table *pt)
+{
+  if (file->pipe != NULL)
+    return pipe_poll (file->pipe, file->pipe_writer, pt);
+  return POLLIN | POLLOUT;
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
    which may be less than SIZE if end of file is reached.
-   Advances FILE's position by the number of bytes read. */
+   Advances FILE's position by the number of bytes read.
+   From the read end of a pipe, waits for data and reads what is
+   there, up to SIZE bytes; from the write end, returns -1. */
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  struct iovec iov;
+  off_t bytes_read;
+
+  if (file->pipe != NULL)
+    return file->pipe_writer ? -1 : pipe_read (file->pipe, buffer, size);
+  iov.iov_base = buffer;
+  iov.iov_len = size;
+  bytes_read = read_iov (file, &iov, 1, file->pos);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,20 +198,31 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  struct iovec iov;
+
+  iov.iov_base = buffer;
+  iov.iov_len = size;
+  return read_iov (file, &iov, 1, file_ofs);
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at the file's current position.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
-   Advances FILE's position by the number of bytes read. */
+   which may be less than SIZE if the disk fills up.
+   Writing past end of file extends the file.
+   Advances FILE's position by the number of bytes read.
+   To the write end of a pipe, waits for room as needed, and
+   returns -1 if there are no readers; to the read end, returns
+   -1. */
 off_t
 file_write (struct file *file, const void *buffer, off_t size) 
 {
-  off_t bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
+  off_t bytes_written;
+
+  if (file->pipe != NULL)
+    return (file->pipe_writer ? pipe_write (file->pipe, buffer, size)
+            : -1);
+  bytes_written = inode_write_at (file->inode, buffer, size, file->pos);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -102,9 +230,8 @@ file_write (struct file *file, const void *buffer, off_t size)
 /* Writes SIZE bytes from BUFFER into FILE,
    starting at offset FILE_OFS in the file.
    Returns the number of bytes actually written,
-   which may be less than SIZE if end of file is reached.
-   (Normally we'd grow the file in that case, but file growth is
-   not yet implemented.)
+   which may be less than SIZE if the disk fills up.
+   Writing past end of file extends the file.
    The file's current position is unaffected. */
 off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
@@ -113,6 +240,176 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads from FILE into the IOVCNT buffers in IOV in turn,
+   starting at the file's current position.
+   Returns the total number of bytes actually read,
+   which may be less than requested if end of file is reached.
+   Advances FILE's position by the number of bytes read. */
+off_t
+file_readv (struct file *file, const struct iovec *iov, int iovcnt) 
+{
+  off_t bytes_read = read_iov (file, iov, iovcnt, file->pos);
+  file->pos += bytes_read;
+  return bytes_read;
+}
+
+/* Reads from FILE, starting at offset START, into the IOVCNT
+   buffers in IOV, and then reads ahead of the data read.
+   A read that starts where the last one ended doubles FILE's
+   read-ahead window, up to READ_AHEAD_MAX sectors, and any other
+   read shrinks it back to READ_AHEAD_MIN, so that streaming reads
+   keep the disk working well ahead of the reader while random
+   reads waste little.  Only the part of the window not already
+   requested is asked for.  Returns the number of bytes read. */
+static off_t
+read_iov (struct file *file, const struct iovec *iov, int iovcnt,
+          off_t start)
+{
+  off_t bytes_read = inode_readv (file->inode, iov, iovcnt, start);
+  off_t end;
+
+  if (bytes_read == 0)
+    return 0;
+
+  if (start == file->ra_next)
+    {
+      if (file->ra_window < READ_AHEAD_MAX)
+        file->ra_window *= 2;
+    }
+  else
+    {
+      file->ra_window = READ_AHEAD_MIN;
+      file->ra_end = 0;
+    }
+  file->ra_next = start + bytes_read;
+
+  end = (ROUND_UP (file->ra_next, BLOCK_SECTOR_SIZE)
+         + file->ra_window * BLOCK_SECTOR_SIZE);
+  if (file->ra_end < file->ra_next)
+    file->ra_end = file->ra_next;
+  if (end > file->ra_end)
+    {
+      inode_read_ahead (file->inode, file->ra_end, end);
+      file->ra_end = end;
+    }
+  return bytes_read;
+}
+
+/* Like file_readv(), but reads whole sectors that are not
+   cached straight from disk into the buffers in IOV, which must
+   be kernel addresses, leaving the buffer cache alone.  See
+   inode_readv_direct(). */
+off_t
+file_readv_direct (struct file *file, const struct iovec *iov, int iovcnt) 
+{
+  off_t bytes_read = inode_readv_direct (file->inode, iov, iovcnt,
+                                         file->pos);
+  file->pos += bytes_read;
+  return bytes_read;
+}
+
+/* Writes the IOVCNT buffers in IOV, one after another, into FILE,
+   starting at the file's current position.
+   Returns the total number of bytes actually written,
+   which may be less than requested if the disk fills up.
+   Writing past end of file extends the file.
+   Advances FILE's position by the number of bytes written. */
+off_t
+file_writev (struct file *file, const struct iovec *iov, int iovcnt) 
+{
+  off_t bytes_written = inode_writev (file->inode, iov, iovcnt, file->pos);
+  file->pos += bytes_written;
+  return bytes_written;
+}
+
+/* Copies up to SIZE bytes from SRC, starting at its current
+   position, to DST at its current position, a page at a time
+   through a kernel buffer, so that the data never passes through
+   user memory.  Returns the number of bytes actually copied,
+   which may be less than SIZE if SRC reaches end of file or the
+   disk fills up.  Advances both positions by that amount. */
+off_t
+file_copy (struct file *dst, struct file *src, off_t size) 
+{
+  uint8_t *buffer;
+  off_t bytes_copied = 0;
+
+  buffer = palloc_get_page (0);
+  if (buffer == NULL)
+    return 0;
+
+  while (size > 0)
+    {
+      /* Every chunk but the first starts on a page, and so a
+         sector, boundary of SRC. */
+      off_t chunk_size = PGSIZE - src->pos % PGSIZE;
+      off_t bytes_read, bytes_written;
+
+      if (chunk_size > size)
+        chunk_size = size;
+      bytes_read = file_read (src, buffer, chunk_size);
+      bytes_written = file_write (dst, buffer, bytes_read);
+      bytes_copied += bytes_written;
+      size -= bytes_written;
+
+      /* Stop at end of file or when DST is full, leaving SRC
+         just past what was copied. */
+      if (bytes_written < chunk_size)
+        {
+          src->pos -= bytes_read - bytes_written;
+          break;
+        }
+    }
+
+  palloc_free_page (buffer);
+  return bytes_copied;
+}
+
+/* Writes FILE's data and then its metadata to disk, as
+   inode_sync() does. */
+void
+file_sync (struct file *file) 
+{
+  ASSERT (file != NULL);
+  inode_sync (file->inode);
+}
+
+/* Reserves disk space for FILE to grow to LENGTH bytes, without
+   changing its length.  Returns true if successful, false if the
+   disk fills up. */
+bool
+file_preallocate (struct file *file, off_t length) 
+{
+  ASSERT (file != NULL);
+  return inode_preallocate (file->inode, length);
+}
+
+/* Compresses FILE's data on disk, as inode_compress() does.
+   Returns true if successful. */
+bool
+file_compress (struct file *file) 
+{
+  ASSERT (file != NULL);
+  return inode_compress (file->inode);
+}
+
+/* Pins FILE's data in the page cache, as inode_pin() does.
+   Returns true if successful. */
+bool
+file_pin (struct file *file) 
+{
+  ASSERT (file != NULL);
+  return inode_pin (file->inode);
+}
+
+/* Unpins FILE's data, as inode_unpin() does. */
+void
+file_unpin (struct file *file) 
+{
+  ASSERT (file != NULL);
+  inode_unpin (file->inode);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
@@ -140,11 +437,14 @@ file_allow_write (struct file *file)
     }
 }
 
-/* Returns the size of FILE in bytes. */
+/* Returns the size of FILE in bytes, or for a pipe end the
+   number of bytes that can be read without waiting. */
 off_t
 file_length (struct file *file) 
 {
   ASSERT (file != NULL);
+  if (file->pipe != NULL)
+    return pipe_available (file->pipe);
   return inode_length (file->inode);
 }
 
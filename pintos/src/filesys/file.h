@@ -1,21 +1,38 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
+struct iovec;
+struct poll_table;
+
+void file_init (void);
 
 /* Opening and closing files. */
 struct file *file_open (struct inode *);
+bool file_open_pipe (struct file *ends[2]);
 struct file *file_reopen (struct file *);
 void file_close (struct file *);
 struct inode *file_get_inode (struct file *);
+bool file_is_pipe (const struct file *);
+int file_poll (struct file *, struct poll_table *);
 
 /* Reading and writing. */
 off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_readv (struct file *, const struct iovec *, int iovcnt);
+off_t file_readv_direct (struct file *, const struct iovec *, int iovcnt);
+off_t file_writev (struct file *, const struct iovec *, int iovcnt);
+off_t file_copy (struct file *dst, struct file *src, off_t size);
+bool file_preallocate (struct file *, off_t length);
+bool file_compress (struct file *);
+bool file_pin (struct file *);
+void file_unpin (struct file *);
+void file_sync (struct file *);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
@@ -2,14 +2,25 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/defrag.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "filesys/directory.h"
+#include "filesys/journal.h"
+#include "filesys/pcache.h"
+#include "threads/thread.h"
+#ifdef USERPROG
+#include "userprog/process.h"
+#endif
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+static struct dir *resolve (const char *path, char base[NAME_MAX + 1]);
+static struct dir *open_cwd (void);
+static block_sector_t dir_sector (struct dir *);
 static void do_format (void);
 
 /* Initializes the file system module.
@@ -21,13 +32,26 @@ filesys_init (bool format)
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
+  cache_init ();
+  pcache_init ();
   inode_init ();
+  file_init ();
+  dir_init ();
+  journal_init ();
   free_map_init ();
 
   if (format) 
-    do_format ();
+    {
+      do_format ();
+      journal_create ();
+    }
+  else
+    journal_open ();
 
   free_map_open ();
+
+  if (defrag_enabled)
+    defrag_init ();
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -35,9 +59,33 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  pcache_done ();
   free_map_close ();
+  journal_done ();
+  cache_done ();
 }
 
+/* Writes all cached file data to disk, then makes all metadata
+   durable, so that after a crash metadata never points to data
+   that did not reach disk. */
+void
+filesys_sync (void) 
+{
+  pcache_flush ();
+  cache_flush ();
+  journal_sync ();
+}
+
+/* Prints statistics for the buffer cache, the page cache and
+   file I/O. */
+void
+filesys_print_stats (void) 
+{
+  cache_print_stats ();
+  pcache_print_stats ();
+  inode_print_stats ();
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -46,14 +94,98 @@ bool
 filesys_create (const char *name, off_t initial_size) 
 {
   block_sector_t inode_sector = 0;
-  struct dir *dir = dir_open_root ();
-  bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
-                  && inode_create (inode_sector, initial_size)
-                  && dir_add (dir, name, inode_sector));
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = resolve (name, base);
+  success = (dir != NULL
+             && free_map_allocate_inode (dir_sector (dir), false,
+                                         &inode_sector)
+             && inode_create (inode_sector, initial_size, false)
+             && dir_add (dir, base, inode_sector));
   if (!success && inode_sector != 0) 
     free_map_release (inode_sector, 1);
   dir_close (dir);
+  journal_end ();
+
+  return success;
+}
+
+/* Creates a directory named NAME.
+   Returns true if successful, false otherwise.
+   Fails if a file named NAME already exists,
+   or if internal memory allocation fails. */
+bool
+filesys_mkdir (const char *name) 
+{
+  block_sector_t inode_sector = 0;
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = resolve (name, base);
+  success = (dir != NULL
+             && free_map_allocate_inode (dir_sector (dir), true,
+                                         &inode_sector)
+             && dir_create (inode_sector, 0,
+                            inode_get_inumber (dir_get_inode (dir)))
+             && dir_add (dir, base, inode_sector));
+  if (!success && inode_sector != 0) 
+    free_map_release (inode_sector, 1);
+  dir_close (dir);
+  journal_end ();
+
+  return success;
+}
+
+/* Creates a file named TO that is a clone of the file named
+   FROM, sharing FROM's data sectors until either is written.
+   Returns true if successful, false otherwise.
+   Fails if FROM does not exist or is a directory, if a file
+   named TO already exists, or if internal memory allocation
+   fails. */
+bool
+filesys_clone (const char *from, const char *to) 
+{
+  block_sector_t inode_sector = 0;
+  char base[NAME_MAX + 1];
+  struct inode *src = NULL;
+  struct dir *dir;
+  bool cloned = false;
+  bool success;
+
+  journal_begin ();
+  dir = resolve (from, base);
+  if (dir != NULL)
+    dir_lookup (dir, base, &src);
+  dir_close (dir);
+
+  dir = resolve (to, base);
+  success = (src != NULL && !inode_is_dir (src) && dir != NULL
+             && free_map_allocate_inode (dir_sector (dir), false,
+                                         &inode_sector));
+  if (success)
+    success = cloned = inode_clone (src, inode_sector);
+  if (success)
+    success = dir_add (dir, base, inode_sector);
+  if (!success && cloned)
+    {
+      /* Closing the removed clone drops its references. */
+      struct inode *inode = inode_open (inode_sector);
+      if (inode != NULL)
+        {
+          inode_remove (inode);
+          inode_close (inode);
+        }
+    }
+  else if (!success && inode_sector != 0) 
+    free_map_release (inode_sector, 1);
+  dir_close (dir);
+  inode_close (src);
+  journal_end ();
 
   return success;
 }
@@ -66,11 +198,12 @@ filesys_create (const char *name, off_t initial_size)
 struct file *
 filesys_open (const char *name)
 {
-  struct dir *dir = dir_open_root ();
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve (name, base);
   struct inode *inode = NULL;
 
   if (dir != NULL)
-    dir_lookup (dir, name, &inode);
+    dir_lookup (dir, base, &inode);
   dir_close (dir);
 
   return file_open (inode);
@@ -83,20 +216,149 @@ filesys_open (const char *name)
 bool
 filesys_remove (const char *name) 
 {
-  struct dir *dir = dir_open_root ();
-  bool success = dir != NULL && dir_remove (dir, name);
+  char base[NAME_MAX + 1];
+  struct dir *dir;
+  bool success;
+
+  journal_begin ();
+  dir = resolve (name, base);
+  success = dir != NULL && dir_remove (dir, base);
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
-
+
+#ifdef USERPROG
+/* Makes the directory named NAME the current process's working
+   directory.  Returns true if successful, false on failure. */
+bool
+filesys_chdir (const char *name) 
+{
+  struct process *p = thread_current ()->process;
+  char base[NAME_MAX + 1];
+  struct dir *dir = resolve (name, base);
+  struct inode *inode = NULL;
+  struct dir *old;
+
+  if (dir != NULL)
+    dir_lookup (dir, base, &inode);
+  dir_close (dir);
+
+  dir = dir_open (inode);
+  if (dir == NULL)
+    return false;
+
+  /* The process's other threads may be using the old one. */
+  lock_acquire (&p->lock);
+  old = p->cwd;
+  p->cwd = dir;
+  lock_release (&p->lock);
+  dir_close (old);
+  return true;
+}
+#endif
+
+/* Copies the next component of the path at *PATH into NAME,
+   skipping leading slashes, and advances *PATH past it.
+   Returns 1 if successful, 0 at the end of the path, or -1 if
+   the component is longer than NAME_MAX. */
+static int
+next_component (const char **path, char name[NAME_MAX + 1])
+{
+  const char *p = *path;
+  size_t len;
+
+  p += strspn (p, "/");
+  if (*p == '\0')
+    return 0;
+  len = strcspn (p, "/");
+  if (len > NAME_MAX)
+    return -1;
+  memcpy (name, p, len);
+  name[len] = '\0';
+  *path = p + len;
+  return 1;
+}
+
+/* Looks up every component of PATH but the last, starting from
+   the root directory if PATH begins with "/" and from the
+   current directory otherwise.  Returns the directory that holds
+   the last component, which the caller must close, and copies
+   the component into BASE.  A path with no components, such as
+   "/", names its starting directory as ".".
+   Returns a null pointer if PATH is empty, any component is too
+   long, or a component before the last is not a directory. */
+static struct dir *
+resolve (const char *path, char base[NAME_MAX + 1])
+{
+  char next[NAME_MAX + 1];
+  struct dir *dir;
+  int ok;
+
+  if (*path == '\0')
+    return NULL;
+  dir = *path == '/' ? dir_open_root () : open_cwd ();
+
+  ok = next_component (&path, base);
+  if (ok == 0)
+    strlcpy (base, ".", NAME_MAX + 1);
+  while (ok > 0 && dir != NULL && (ok = next_component (&path, next)) > 0)
+    {
+      struct inode *inode;
+
+      dir_lookup (dir, base, &inode);
+      dir_close (dir);
+      dir = dir_open (inode);
+      strlcpy (base, next, NAME_MAX + 1);
+    }
+
+  if (ok < 0)
+    {
+      dir_close (dir);
+      return NULL;
+    }
+  return dir;
+}
+
+/* Opens the current process's working directory, or the root
+   directory if it has none. */
+static struct dir *
+open_cwd (void)
+{
+#ifdef USERPROG
+  struct process *p = thread_current ()->process;
+
+  /* Only chdir () changes a working directory, and never back to
+     none. */
+  if (p != NULL && p->cwd != NULL)
+    {
+      struct dir *cwd;
+
+      lock_acquire (&p->lock);
+      cwd = dir_reopen (p->cwd);
+      lock_release (&p->lock);
+      return cwd;
+    }
+#endif
+  return dir_open_root ();
+}
+
+/* Returns the sector of DIR's inode, near which new inodes in
+   DIR are allocated. */
+static block_sector_t
+dir_sector (struct dir *dir)
+{
+  return inode_get_inumber (dir_get_inode (dir));
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
   printf ("Formatting file system...");
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_SECTOR, 16, ROOT_DIR_SECTOR))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -1,63 +1,492 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <round.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vmalloc.h"
 
 static struct file *free_map_file;   /* Free map file. */
 static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static uint8_t *ref_cnts;            /* Extra references, per sector. */
+static off_t ref_cnts_ofs;           /* Offset of REF_CNTS in the file. */
+static struct lock free_map_lock;    /* Protects the above and below. */
+static size_t free_map_cursor;       /* Next-fit start for free_map. */
 
-/* Initializes the free map. */
+/* A data sector may belong to several files, after one has been
+   cloned from another with inode_clone().  REF_CNTS counts the
+   references to each allocated sector beyond the first, so that
+   it is 0 for an unshared sector, which most are.  It is kept in
+   the free map's file right after the bitmap, and written to it
+   the same way. */
+
+/* Sectors per block group.  New inodes are placed by group, as
+   in ext2: a file's in its directory's group, so that listing a
+   directory and opening its files touch nearby sectors, and a
+   directory's in a group with room to spare for its files.  The
+   free map is also read from disk a group at a time. */
+#define GROUP_SECTORS 1024
+
+/* Summary of the free map, kept in its file after the reference
+   counts.  Mounting reads only the summary.  The bitmap and
+   reference counts of a group are read the first time they are
+   needed, until when its bits in FREE_MAP all read as in use, and
+   the summary's counts tell which groups are worth reading for
+   an allocation. */
+struct free_map_summary
+  {
+    uint32_t magic;                  /* SUMMARY_MAGIC. */
+    uint32_t sector_cnt;             /* Sectors on the device. */
+    uint32_t free_cnt;               /* Free sectors. */
+    uint32_t group_cnt;              /* Block groups. */
+    uint16_t group_free[];           /* Free sectors in each group. */
+  };
+
+#define SUMMARY_MAGIC 0x464d5353     /* Free map summary. */
+
+static struct free_map_summary *summary; /* Summary, always in memory. */
+static size_t summary_size;          /* Bytes in SUMMARY. */
+static off_t summary_ofs;            /* Offset of SUMMARY in the file. */
+static bool summary_on_disk;         /* Is SUMMARY kept in the file? */
+static size_t group_cnt;             /* Number of block groups. */
+static struct bitmap *loaded;        /* Groups read in, one bit each. */
+
+static void write_ref_cnts (block_sector_t, size_t cnt);
+static void count_free (void);
+
+/* Initializes the free map, with every group in memory, as it is
+   for formatting. */
 void
 free_map_init (void) 
 {
+  lock_init (&free_map_lock);
   free_map = bitmap_create (block_size (fs_device));
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
   bitmap_mark (free_map, FREE_MAP_SECTOR);
   bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, JOURNAL_SECTOR, journal_sector_cnt (), true);
+  ref_cnts = vmalloc (block_size (fs_device));
+  if (ref_cnts == NULL)
+    PANIC ("reference count allocation failed");
+  memset (ref_cnts, 0, block_size (fs_device));
+  ref_cnts_ofs = bitmap_file_size (free_map);
+
+  group_cnt = DIV_ROUND_UP (block_size (fs_device), GROUP_SECTORS);
+  summary_size = (sizeof *summary
+                  + group_cnt * sizeof summary->group_free[0]);
+  summary_ofs = ref_cnts_ofs + block_size (fs_device);
+  summary = malloc (summary_size);
+  loaded = bitmap_create (group_cnt);
+  if (summary == NULL || loaded == NULL)
+    PANIC ("free map summary allocation failed");
+  bitmap_set_all (loaded, true);
+  count_free ();
+}
+
+/* Returns the sector just past the end of block group GROUP. */
+static size_t
+group_end (size_t group)
+{
+  size_t end = (group + 1) * GROUP_SECTORS;
+  return end < bitmap_size (free_map) ? end : bitmap_size (free_map);
+}
+
+/* Fills in SUMMARY from FREE_MAP, which must be all in memory. */
+static void
+count_free (void)
+{
+  size_t g;
+
+  summary->magic = SUMMARY_MAGIC;
+  summary->sector_cnt = bitmap_size (free_map);
+  summary->free_cnt = 0;
+  summary->group_cnt = group_cnt;
+  for (g = 0; g < group_cnt; g++)
+    {
+      size_t start = g * GROUP_SECTORS;
+      summary->group_free[g] = bitmap_count (free_map, start,
+                                             group_end (g) - start, false);
+      summary->free_cnt += summary->group_free[g];
+    }
+}
+
+/* Writes the summary's totals and its counts for groups FIRST
+   through LAST to the free map's file. */
+static void
+write_summary (size_t first, size_t last)
+{
+  if (free_map_file == NULL || !summary_on_disk)
+    return;
+  file_write_at (free_map_file, summary, sizeof *summary, summary_ofs);
+  file_write_at (free_map_file, &summary->group_free[first],
+                 (last - first + 1) * sizeof summary->group_free[0],
+                 (summary_ofs + offsetof (struct free_map_summary, group_free)
+                  + first * sizeof summary->group_free[0]));
+}
+
+/* Reads block group GROUP's part of the free map from its file,
+   if that has not been done yet.  FREE_MAP_LOCK must be held. */
+static void
+load_group (size_t group)
+{
+  size_t start = group * GROUP_SECTORS;
+  size_t cnt = group_end (group) - start;
+
+  if (bitmap_test (loaded, group))
+    return;
+  if (!bitmap_read_range (free_map, free_map_file, start, cnt)
+      || (file_read_at (free_map_file, ref_cnts + start, cnt,
+                        ref_cnts_ofs + start) != (off_t) cnt))
+    PANIC ("can't read free map");
+  bitmap_mark (loaded, group);
+}
+
+/* Reads the part of the free map for the CNT sectors starting at
+   SECTOR.  FREE_MAP_LOCK must be held. */
+static void
+load_range (size_t sector, size_t cnt)
+{
+  size_t g;
+
+  if (cnt == 0)
+    return;
+  for (g = sector / GROUP_SECTORS; g <= (sector + cnt - 1) / GROUP_SECTORS;
+       g++)
+    load_group (g);
 }
 
+/* Counts the CNT sectors starting at SECTOR as allocated, if
+   ALLOCATED is true, or as free, in the summary, and writes the
+   summary back.  FREE_MAP_LOCK must be held. */
+static void
+account (size_t sector, size_t cnt, bool allocated)
+{
+  size_t first = sector / GROUP_SECTORS;
+  size_t last = (sector + cnt - 1) / GROUP_SECTORS;
+  size_t g;
+
+  if (cnt == 0)
+    return;
+  for (g = first; g <= last; g++)
+    {
+      size_t lo = sector > g * GROUP_SECTORS ? sector : g * GROUP_SECTORS;
+      size_t hi = sector + cnt < group_end (g) ? sector + cnt : group_end (g);
+
+      if (allocated)
+        summary->group_free[g] -= hi - lo;
+      else
+        summary->group_free[g] += hi - lo;
+    }
+  if (allocated)
+    summary->free_cnt -= cnt;
+  else
+    summary->free_cnt += cnt;
+  write_summary (first, last);
+}
+
+/* Returns the first of CNT consecutive free sectors at or after
+   GOAL, reading in the groups that such a run may start or end
+   in, but passing over groups with no free sectors without
+   reading them.  Returns BITMAP_ERROR if there is no such run.
+   FREE_MAP_LOCK must be held. */
+static size_t
+scan (size_t goal, size_t cnt)
+{
+  size_t size = bitmap_size (free_map);
+  size_t g;
+
+  for (g = goal / GROUP_SECTORS; g < group_cnt; g++)
+    {
+      size_t start = g * GROUP_SECTORS > goal ? g * GROUP_SECTORS : goal;
+      size_t reach = group_end (g) + cnt - 1;
+      size_t sector;
+
+      if (summary->group_free[g] == 0)
+        continue;
+      load_range (start, (reach < size ? reach : size) - start);
+      sector = bitmap_scan (free_map, start, cnt, false);
+      if (sector != BITMAP_ERROR && sector < group_end (g))
+        return sector;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Changes to the free map are written to its file through the
+   buffer cache as they are made, but only the part of the bitmap
+   that changed, so an allocation or release dirties one or two
+   cached sectors of the file instead of all of them.  Like other
+   metadata, they are written through the journal, so the caller
+   must be inside a journaled operation. */
+
 /* Allocates CNT consecutive sectors from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
    sectors were available or if the free_map file could not be
-   written. */
+   written.
+   Searches next fit, starting just past the previous allocation
+   without a goal rather than at the beginning of the disk. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t goal;
+
+  lock_acquire (&free_map_lock);
+  goal = free_map_cursor;
+  lock_release (&free_map_lock);
+  return free_map_allocate_goal (cnt, goal, sectorp);
+}
+
+/* Like free_map_allocate(), but searches for CNT consecutive free
+   sectors starting at sector GOAL before trying the rest of the
+   disk, so that a caller who passes the sector just past its
+   previous allocation gets a contiguous run when one is free. */
+bool
+free_map_allocate_goal (size_t cnt, block_sector_t goal,
+                        block_sector_t *sectorp)
+{
+  block_sector_t sector = BITMAP_ERROR;
+
+  lock_acquire (&free_map_lock);
+  if (goal < bitmap_size (free_map))
+    sector = scan (goal, cnt);
+  if (sector == BITMAP_ERROR && goal != 0)
+    sector = scan (0, cnt);
+  if (sector != BITMAP_ERROR)
+    {
+      bitmap_set_multiple (free_map, sector, cnt, true);
+      if (free_map_file != NULL
+          && !bitmap_write_range (free_map, free_map_file, sector, cnt))
+        {
+          bitmap_set_multiple (free_map, sector, cnt, false);
+          sector = BITMAP_ERROR;
+        }
+    }
+  if (sector != BITMAP_ERROR)
+    {
+      account (sector, cnt, true);
+      *sectorp = sector;
+      free_map_cursor = sector + cnt;
+    }
+  lock_release (&free_map_lock);
+  return sector != BITMAP_ERROR;
+}
+
+/* Returns the block group in which to put a new inode whose
+   directory's inode is in sector PARENT.  A file goes in its
+   directory's group.  So does a directory, if that group has at
+   least the average number of free sectors, except that one in
+   the root directory, which starts a tree of its own, always
+   goes in the group with the most free sectors, as do the others
+   that do not fit.  Uses the summary's counts, so that no group
+   has to be read in to choose one.  FREE_MAP_LOCK must be
+   held. */
+static size_t
+choose_group (block_sector_t parent, bool is_dir)
+{
+  size_t home = parent / GROUP_SECTORS;
+  size_t best = home, best_free = 0;
+  size_t i;
+
+  if (!is_dir)
+    return home;
+  if (parent != ROOT_DIR_SECTOR
+      && summary->group_free[home] * group_cnt >= summary->free_cnt)
+    return home;
+  for (i = 0; i < group_cnt; i++)
     {
-      bitmap_set_multiple (free_map, sector, cnt, false); 
-      sector = BITMAP_ERROR;
+      size_t free_cnt = summary->group_free[i];
+      if (free_cnt > best_free)
+        {
+          best = i;
+          best_free = free_cnt;
+        }
+    }
+  return best;
+}
+
+/* Allocates a sector for the inode of a new file, or a new
+   directory if IS_DIR, in the directory whose inode is in sector
+   PARENT, and stores it into *SECTORP.  The sector is taken from
+   the block group that choose_group() picks, as close after
+   PARENT as possible if that is PARENT's group, or from the
+   groups that follow if it is full.  Returns true if successful,
+   false if the disk is full or the free map file could not be
+   written. */
+bool
+free_map_allocate_inode (block_sector_t parent, bool is_dir,
+                         block_sector_t *sectorp)
+{
+  size_t group, i;
+  size_t sector = BITMAP_ERROR;
+
+  lock_acquire (&free_map_lock);
+  group = choose_group (parent, is_dir);
+  for (i = 0; i < group_cnt && sector == BITMAP_ERROR; i++)
+    {
+      size_t g = (group + i) % group_cnt;
+      size_t start = g * GROUP_SECTORS;
+      size_t end = group_end (g);
+      size_t goal = start;
+
+      if (summary->group_free[g] == 0)
+        continue;
+      load_group (g);
+      if (parent / GROUP_SECTORS == g && parent + 1 < end)
+        goal = parent + 1;
+      sector = bitmap_scan (free_map, goal, 1, false);
+      if (sector >= end && goal != start)
+        sector = bitmap_scan (free_map, start, 1, false);
+      if (sector >= end)
+        sector = BITMAP_ERROR;
+    }
+  if (sector != BITMAP_ERROR)
+    {
+      bitmap_mark (free_map, sector);
+      if (free_map_file != NULL
+          && !bitmap_write_range (free_map, free_map_file, sector, 1))
+        {
+          bitmap_reset (free_map, sector);
+          sector = BITMAP_ERROR;
+        }
     }
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      account (sector, 1, true);
+      *sectorp = sector;
+    }
+  lock_release (&free_map_lock);
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Drops a reference to each of the CNT sectors starting at
+   SECTOR, making the ones that have no other references
+   available for use. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  bool shared = false;
+  size_t i, j;
+
+  lock_acquire (&free_map_lock);
+  load_range (sector, cnt);
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  for (i = 0; i < cnt; i = j)
+    {
+      for (j = i; j < cnt && ref_cnts[sector + j] == 0; j++)
+        continue;
+      if (j > i)
+        {
+          bitmap_set_multiple (free_map, sector + i, j - i, false);
+          journal_release (sector + i, j - i);
+          account (sector + i, j - i, false);
+        }
+      for (; j < cnt && ref_cnts[sector + j] > 0; j++)
+        {
+          ref_cnts[sector + j]--;
+          shared = true;
+        }
+    }
+  bitmap_write_range (free_map, free_map_file, sector, cnt);
+  if (shared)
+    write_ref_cnts (sector, cnt);
+  lock_release (&free_map_lock);
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Adds a reference to each of the CNT allocated sectors starting
+   at SECTOR, which must later be dropped with free_map_release().
+   Returns false, adding none, if a sector already has as many
+   references as can be counted. */
+bool
+free_map_share (block_sector_t sector, size_t cnt)
+{
+  size_t i;
+
+  lock_acquire (&free_map_lock);
+  load_range (sector, cnt);
+  ASSERT (bitmap_all (free_map, sector, cnt));
+  for (i = 0; i < cnt; i++)
+    if (ref_cnts[sector + i] == UINT8_MAX)
+      {
+        lock_release (&free_map_lock);
+        return false;
+      }
+  for (i = 0; i < cnt; i++)
+    ref_cnts[sector + i]++;
+  write_ref_cnts (sector, cnt);
+  lock_release (&free_map_lock);
+  return true;
+}
+
+/* Returns true if any of the CNT sectors starting at SECTOR has
+   more than one reference. */
+bool
+free_map_is_shared (block_sector_t sector, size_t cnt)
+{
+  bool shared = false;
+  size_t i;
+
+  lock_acquire (&free_map_lock);
+  load_range (sector, cnt);
+  for (i = 0; i < cnt && !shared; i++)
+    shared = ref_cnts[sector + i] > 0;
+  lock_release (&free_map_lock);
+  return shared;
+}
+
+/* Writes the reference counts of the CNT sectors starting at
+   SECTOR to the free map's file. */
+static void
+write_ref_cnts (block_sector_t sector, size_t cnt)
+{
+  if (free_map_file != NULL)
+    file_write_at (free_map_file, ref_cnts + sector, cnt,
+                   ref_cnts_ofs + sector);
+}
+
+/* Opens the free map file and reads its summary from disk,
+   leaving the groups to be read in as they are needed. */
 void
 free_map_open (void) 
 {
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
+
+  if (file_length (free_map_file) >= summary_ofs + (off_t) summary_size)
+    {
+      if (file_read_at (free_map_file, summary, summary_size, summary_ofs)
+          != (off_t) summary_size)
+        PANIC ("can't read free map");
+      if (summary->magic != SUMMARY_MAGIC
+          || summary->sector_cnt != bitmap_size (free_map)
+          || summary->group_cnt != group_cnt)
+        PANIC ("free map summary is corrupt");
+      bitmap_set_all (free_map, true);
+      bitmap_set_all (loaded, false);
+      summary_on_disk = true;
+      return;
+    }
+
+  /* A file system formatted before the summary was added is read
+     in whole, and its summary is kept only in memory. */
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+
+  /* One formatted before files could be cloned has no reference
+     counts, and shares no sectors. */
+  if (file_length (free_map_file)
+      >= ref_cnts_ofs + (off_t) block_size (fs_device))
+    file_read_at (free_map_file, ref_cnts, block_size (fs_device),
+                  ref_cnts_ofs);
+  count_free ();
 }
 
 /* Writes the free map to disk and closes the free map file. */
@@ -72,14 +501,27 @@ free_map_close (void)
 void
 free_map_create (void) 
 {
+  struct file *file;
+
   /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map)))
+  if (!inode_create (FREE_MAP_SECTOR, summary_ofs + summary_size, false))
     PANIC ("free map creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
-  if (free_map_file == NULL)
+  /* Write bitmap, reference counts, and summary to file.  The
+     summary is written last, once allocation for the file's own
+     sectors has been counted in it.  The writes
+     allocate the file's sectors, which must not in turn write to
+     the file, so free_map_file is set only afterward. */
+  file = file_open (inode_open (FREE_MAP_SECTOR));
+  if (file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_write (free_map, free_map_file))
+  if (!bitmap_write (free_map, file)
+      || (file_write_at (file, ref_cnts, block_size (fs_device),
+                         ref_cnts_ofs)
+          != (off_t) block_size (fs_device))
+      || (file_write_at (file, summary, summary_size, summary_ofs)
+          != (off_t) summary_size))
     PANIC ("can't write free map");
+  free_map_file = file;
+  summary_on_disk = true;
 }
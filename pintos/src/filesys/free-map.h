@@ -12,6 +12,11 @@ void free_map_open (void);
 void free_map_close (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
+bool free_map_allocate_goal (size_t, block_sector_t goal, block_sector_t *);
+bool free_map_allocate_inode (block_sector_t parent, bool is_dir,
+                              block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+bool free_map_share (block_sector_t, size_t);
+bool free_map_is_shared (block_sector_t, size_t);
 
 #endif /* filesys/free-map.h */
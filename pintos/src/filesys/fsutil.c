@@ -1,16 +1,30 @@
 #include "filesys/fsutil.h"
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ustar.h>
+#include "filesys/archive.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
-#include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
 
+/* Number of pages in the buffer that `extract' and `append' copy
+   file data through, so that each block request and each file
+   write moves many sectors at once. */
+#define COPY_PAGES 4
+#define COPY_SIZE (COPY_PAGES * PGSIZE)
+#define COPY_SECTORS (COPY_SIZE / BLOCK_SECTOR_SIZE)
+
+/* Sector on the scratch device where the next file that `append'
+   or fsutil_append_data() adds goes. */
+static block_sector_t append_sector;
+
+static void write_archive_end (struct block *, void *buffer);
+
 /* List files in the root directory. */
 void
 fsutil_ls (char **argv UNUSED) 
@@ -67,21 +81,40 @@ fsutil_rm (char **argv)
     PANIC ("%s: delete failed\n", file_name);
 }
 
+/* Pins file ARGV[1] in the page cache for as long as the system
+   runs, so that opening, reading and executing it do not wait
+   for the disk, whatever else is read meanwhile. */
+void
+fsutil_pin (char **argv) 
+{
+  const char *file_name = argv[1];
+  struct file *file;
+
+  printf ("Pinning '%s' in the cache...\n", file_name);
+  file = filesys_open (file_name);
+  if (file == NULL)
+    PANIC ("%s: open failed", file_name);
+  if (!file_pin (file))
+    PANIC ("%s: pin failed", file_name);
+  file_close (file);
+}
+
 /* Extracts a ustar-format tar archive from the scratch block
-   device into the Pintos file system. */
+   device into the Pintos file system.  Each file's data is read
+   in place from the archive COPY_SECTORS sectors at a time and
+   written in chunks of the same size into a file whose sectors
+   were preallocated in one go. */
 void
 fsutil_extract (char **argv UNUSED) 
 {
-  static block_sector_t sector = 0;
-
+  struct archive ar;
   struct block *src;
-  void *header, *data;
+  void *data;
 
-  /* Allocate buffers. */
-  header = malloc (BLOCK_SECTOR_SIZE);
-  data = malloc (BLOCK_SECTOR_SIZE);
-  if (header == NULL || data == NULL)
-    PANIC ("couldn't allocate buffers");
+  /* Allocate buffer. */
+  data = palloc_get_multiple (0, COPY_PAGES);
+  if (data == NULL)
+    PANIC ("couldn't allocate buffer");
 
   /* Open source block device. */
   src = block_get_role (BLOCK_SCRATCH);
@@ -91,50 +124,52 @@ fsutil_extract (char **argv UNUSED)
   printf ("Extracting ustar archive from scratch device "
           "into file system...\n");
 
+  archive_open (&ar, src);
   for (;;)
     {
-      const char *file_name;
+      struct archive_entry entry;
+      const char *file_name = entry.name;
       const char *error;
-      enum ustar_type type;
-      int size;
+      off_t ofs;
 
       /* Read and parse ustar header. */
-      block_read (src, sector++, header);
-      error = ustar_parse_header (header, &file_name, &type, &size);
+      error = archive_next (&ar, &entry);
       if (error != NULL)
-        PANIC ("bad ustar header in sector %"PRDSNu" (%s)", sector - 1, error);
+        PANIC ("bad ustar header in sector %"PRDSNu" (%s)", ar.sector, error);
 
-      if (type == USTAR_EOF)
+      if (entry.type == USTAR_EOF)
         {
           /* End of archive. */
           break;
         }
-      else if (type == USTAR_DIRECTORY)
+      else if (entry.type == USTAR_DIRECTORY)
         printf ("ignoring directory %s\n", file_name);
-      else if (type == USTAR_REGULAR)
+      else if (entry.type == USTAR_REGULAR)
         {
           struct file *dst;
 
           printf ("Putting '%s' into the file system...\n", file_name);
 
-          /* Create destination file. */
-          if (!filesys_create (file_name, size))
+          /* Create destination file, with room for all its data. */
+          if (!filesys_create (file_name, 0))
             PANIC ("%s: create failed", file_name);
           dst = filesys_open (file_name);
           if (dst == NULL)
             PANIC ("%s: open failed", file_name);
+          if (!file_preallocate (dst, entry.size))
+            PANIC ("%s: out of space for %"PROTd" bytes",
+                   file_name, entry.size);
 
           /* Do copy. */
-          while (size > 0)
+          for (ofs = 0; ofs < entry.size; ofs += COPY_SIZE)
             {
-              int chunk_size = (size > BLOCK_SECTOR_SIZE
-                                ? BLOCK_SECTOR_SIZE
-                                : size);
-              block_read (src, sector++, data);
-              if (file_write (dst, data, chunk_size) != chunk_size)
-                PANIC ("%s: write failed with %d bytes unwritten",
-                       file_name, size);
-              size -= chunk_size;
+              off_t chunk_size = archive_read (src, &entry, data,
+                                               COPY_SIZE, ofs);
+
+              if (chunk_size <= 0
+                  || file_write (dst, data, chunk_size) != chunk_size)
+                PANIC ("%s: write failed with %"PROTd" bytes unwritten",
+                       file_name, entry.size - ofs);
             }
 
           /* Finish up. */
@@ -147,27 +182,24 @@ fsutil_extract (char **argv UNUSED)
      two blocks because two blocks of zeros are the ustar
      end-of-archive marker. */
   printf ("Erasing ustar archive...\n");
-  memset (header, 0, BLOCK_SECTOR_SIZE);
-  block_write (src, 0, header);
-  block_write (src, 1, header);
+  memset (data, 0, 2 * BLOCK_SECTOR_SIZE);
+  block_write_multiple (src, 0, 2, data);
 
-  free (data);
-  free (header);
+  palloc_free_multiple (data, COPY_PAGES);
 }
 
 /* Copies file FILE_NAME from the file system to the scratch
    device, in ustar format.
 
-   The first call to this function will write starting at the
-   beginning of the scratch device.  Later calls advance across
-   the device.  This position is independent of that used for
-   fsutil_extract(), so `extract' should precede all
-   `append's. */
+   The first call to this function or fsutil_append_data() will
+   write starting at the beginning of the scratch device.  Later
+   calls advance across the device.  This position is
+   independent of that used for fsutil_extract(), so `extract'
+   should precede all `append's.  Data is copied COPY_SECTORS
+   sectors at a time. */
 void
 fsutil_append (char **argv)
 {
-  static block_sector_t sector = 0;
-
   const char *file_name = argv[1];
   void *buffer;
   struct file *src;
@@ -177,7 +209,7 @@ fsutil_append (char **argv)
   printf ("Appending '%s' to ustar archive on scratch device...\n", file_name);
 
   /* Allocate buffer. */
-  buffer = malloc (BLOCK_SECTOR_SIZE);
+  buffer = palloc_get_multiple (0, COPY_PAGES);
   if (buffer == NULL)
     PANIC ("couldn't allocate buffer");
 
@@ -195,29 +227,79 @@ fsutil_append (char **argv)
   /* Write ustar header to first sector. */
   if (!ustar_make_header (file_name, USTAR_REGULAR, size, buffer))
     PANIC ("%s: name too long for ustar format", file_name);
-  block_write (dst, sector++, buffer);
+  block_write (dst, append_sector++, buffer);
 
   /* Do copy. */
   while (size > 0) 
     {
-      int chunk_size = size > BLOCK_SECTOR_SIZE ? BLOCK_SECTOR_SIZE : size;
-      if (sector >= block_size (dst))
+      int chunk_size = size > COPY_SIZE ? COPY_SIZE : size;
+      size_t sectors = DIV_ROUND_UP (chunk_size, BLOCK_SECTOR_SIZE);
+
+      if (append_sector + sectors > block_size (dst))
         PANIC ("%s: out of space on scratch device", file_name);
       if (file_read (src, buffer, chunk_size) != chunk_size)
         PANIC ("%s: read failed with %"PROTd" bytes unread", file_name, size);
-      memset (buffer + chunk_size, 0, BLOCK_SECTOR_SIZE - chunk_size);
-      block_write (dst, sector++, buffer);
+      memset (buffer + chunk_size, 0,
+              sectors * BLOCK_SECTOR_SIZE - chunk_size);
+      block_write_multiple (dst, append_sector, sectors, buffer);
+      append_sector += sectors;
       size -= chunk_size;
     }
 
-  /* Write ustar end-of-archive marker, which is two consecutive
-     sectors full of zeros.  Don't advance our position past
-     them, though, in case we have more files to append. */
-  memset (buffer, 0, BLOCK_SECTOR_SIZE);
-  block_write (dst, sector, buffer);
-  block_write (dst, sector, buffer + 1);
-
   /* Finish up. */
+  write_archive_end (dst, buffer);
   file_close (src);
-  free (buffer);
+  palloc_free_multiple (buffer, COPY_PAGES);
+}
+
+/* Appends the SIZE bytes at DATA to the ustar archive on the
+   scratch device as file NAME, as `append' would a file. */
+void
+fsutil_append_data (const char *name, const void *data_, size_t size)
+{
+  const uint8_t *data = data_;
+  size_t whole = size / BLOCK_SECTOR_SIZE;
+  size_t partial = size % BLOCK_SECTOR_SIZE;
+  struct block *dst;
+  void *buffer;
+
+  printf ("Appending '%s' to ustar archive on scratch device...\n", name);
+
+  dst = block_get_role (BLOCK_SCRATCH);
+  if (dst == NULL)
+    PANIC ("couldn't open scratch device");
+  if (append_sector + 1 + DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE) + 2
+      > block_size (dst))
+    PANIC ("%s: out of space on scratch device", name);
+  buffer = palloc_get_page (PAL_ASSERT);
+
+  /* Write ustar header, then whole sectors straight from DATA,
+     then the last partial sector padded with zeros. */
+  if (!ustar_make_header (name, USTAR_REGULAR, size, buffer))
+    PANIC ("%s: name too long for ustar format", name);
+  block_write (dst, append_sector++, buffer);
+  if (whole > 0)
+    block_write_multiple (dst, append_sector, whole, data);
+  append_sector += whole;
+  if (partial > 0)
+    {
+      memset (buffer, 0, BLOCK_SECTOR_SIZE);
+      memcpy (buffer, data + whole * BLOCK_SECTOR_SIZE, partial);
+      block_write (dst, append_sector++, buffer);
+    }
+
+  write_archive_end (dst, buffer);
+  palloc_free_page (buffer);
+}
+
+/* Writes the ustar end-of-archive marker, which is two
+   consecutive sectors full of zeros, to DST at `append_sector',
+   using BUFFER, which must hold at least two sectors.  Doesn't
+   advance our position past them, though, in case we have more
+   files to append. */
+static void
+write_archive_end (struct block *dst, void *buffer)
+{
+  memset (buffer, 0, 2 * BLOCK_SECTOR_SIZE);
+  block_write_multiple (dst, append_sector, 2, buffer);
 }
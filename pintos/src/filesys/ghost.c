@@ -0,0 +1,47 @@
+#include "filesys/ghost.h"
+#include <debug.h>
+
+/* Initializes G as an empty ghost list that remembers up to
+   CAPACITY keys in KEYS[]. */
+void
+ghost_init (struct ghost_list *g, uint64_t keys[], size_t capacity)
+{
+  ASSERT (capacity > 0);
+
+  g->keys = keys;
+  g->capacity = capacity;
+  g->head = 0;
+  g->cnt = 0;
+}
+
+/* Remembers KEY in G, forgetting the oldest key if G is full. */
+void
+ghost_add (struct ghost_list *g, uint64_t key)
+{
+  if (g->cnt == g->capacity)
+    {
+      g->head = (g->head + 1) % g->capacity;
+      g->cnt--;
+    }
+  g->keys[(g->head + g->cnt++) % g->capacity] = key;
+}
+
+/* Forgets KEY, if G remembers it, and returns true, or returns
+   false if it does not.  The keys after it move up one place, so
+   that the rest keep their order of age. */
+bool
+ghost_remove (struct ghost_list *g, uint64_t key)
+{
+  size_t i;
+
+  for (i = 0; i < g->cnt; i++)
+    if (g->keys[(g->head + i) % g->capacity] == key)
+      {
+        for (; i + 1 < g->cnt; i++)
+          g->keys[(g->head + i) % g->capacity]
+            = g->keys[(g->head + i + 1) % g->capacity];
+        g->cnt--;
+        return true;
+      }
+  return false;
+}
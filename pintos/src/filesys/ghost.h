@@ -0,0 +1,26 @@
+#ifndef FILESYS_GHOST_H
+#define FILESYS_GHOST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A ghost list, 2Q's "A1out": the keys of the last few entries
+   that a cache evicted while they were still on probation, with
+   none of their data.  A miss on a key in the list is the second
+   reference that earns an entry a protected place in the cache;
+   a sequential scan, which touches each key once, never gets
+   one.  The cache serializes access with a lock of its own. */
+struct ghost_list
+  {
+    uint64_t *keys;             /* Ring of CAPACITY keys. */
+    size_t capacity;            /* Most keys remembered. */
+    size_t head;                /* Index of the oldest key. */
+    size_t cnt;                 /* Keys remembered. */
+  };
+
+void ghost_init (struct ghost_list *, uint64_t keys[], size_t capacity);
+void ghost_add (struct ghost_list *, uint64_t key);
+bool ghost_remove (struct ghost_list *, uint64_t key);
+
+#endif /* filesys/ghost.h */
@@ -1,25 +1,153 @@
 #include "filesys/inode.h"
+#include <hash.h>
+#include <inttypes.h>
 #include <list.h>
+#include <radix.h>
 #include <debug.h>
 #include <round.h>
+#include <stdio.h>
 #include <string.h>
+#include <uio.h>
+#include "filesys/cache.h"
+#include "filesys/directory.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
+#include "filesys/lz.h"
+#include "filesys/pcache.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/rcu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/workqueue.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Number of direct sector pointers in an inode. */
+#define DIRECT_CNT 123
+
+/* Number of extents in an extent-mapped inode. */
+#define EXTENT_CNT 62
+
+/* Number of bytes of data an inline inode holds, which is all
+   the room the sector pointers take up. */
+#define INLINE_SIZE ((DIRECT_CNT + 2) * sizeof (block_sector_t))
+
+/* Number of sectors, and bytes, of file data compressed as a
+   unit in a compressed file. */
+#define CLUSTER_SECTORS 8
+#define CLUSTER_SIZE (CLUSTER_SECTORS * BLOCK_SECTOR_SIZE)
+
+/* Number of clusters a compressed inode can describe, which
+   limits a compressed file to about 500 kB. */
+#define CLUSTER_CNT (INLINE_SIZE / sizeof (block_sector_t))
+
+/* Number of sector pointers in an indirect block. */
+#define PTRS_PER_SECTOR (BLOCK_SECTOR_SIZE / sizeof (block_sector_t))
+
+/* Number of data sectors an indexed inode can address. */
+#define INDEX_SECTORS (DIRECT_CNT + PTRS_PER_SECTOR \
+                       + PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+
+/* Sector number meaning "no sector allocated".  Sector 0 always
+   holds the free map's inode, so it can never be a data or index
+   sector. */
+#define NO_SECTOR 0
+
+/* Number of sectors past the end of a read to prefetch. */
+#define READ_AHEAD_SECTORS 4
+
+/* Most sectors inode_sync() hands to the cache at once. */
+#define SYNC_BATCH 64
+
+/* Most sectors read directly into the caller's buffer at once. */
+#define DIRECT_RUN_MAX 64
+
+/* Number of closed inodes kept in memory for reopening. */
+#define CLOSED_INODE_CNT 16
+
+/* Number of hash chains in the table of open inodes.  Must be a
+   power of 2. */
+#define OPEN_INODE_BUCKETS 64
+
+/* Flags for inode_disk's `flags' member. */
+#define INODE_EXTENTS 0x1               /* Data described by extents. */
+#define INODE_DIR 0x2                   /* Holds a directory. */
+#define INODE_INLINE 0x4                /* Data stored in the inode. */
+#define INODE_SHARED 0x8                /* May share data sectors. */
+#define INODE_COMPRESSED 0x10           /* Data compressed in clusters. */
+
+/* A run of LENGTH consecutive data sectors starting at START. */
+struct extent
+  {
+    block_sector_t start;               /* First sector. */
+    uint32_t length;                    /* Number of sectors. */
+  };
+
 /* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+   Must be exactly BLOCK_SECTOR_SIZE bytes long.
+
+   By default, data sectors are found through a multilevel index:
+   the first DIRECT_CNT sectors through DIRECT, the next
+   PTRS_PER_SECTOR through the indirect block INDIRECT, and the
+   rest through the doubly indirect block DOUBLY_INDIRECT, whose
+   entries point to indirect blocks.  Unallocated entries are
+   NO_SECTOR.
+
+   If INODE_EXTENTS is set in FLAGS, the data is instead the
+   concatenation of the first EXTENT_CNT extents in EXTENTS.
+   Growth tries to lengthen the last extent in place, so a file
+   written sequentially on a quiet disk stays in one or a few
+   contiguous runs.
+
+   If INODE_INLINE is set, the file's data, at most INLINE_SIZE
+   bytes, is kept in INLINE_DATA in place of either, so that a
+   small file needs no data sector at all.  It moves out to the
+   layout the other flags call for once it grows past that.
+
+   A file cloned by inode_clone() shares its data sectors with
+   the file it was cloned from, and both have INODE_SHARED set.
+   Index blocks are never shared.  A write to a sector that the
+   free map counts more than one reference to first gives the
+   file a copy of its own (see unshare()).
+
+   If INODE_COMPRESSED is set, inode_compress() has compressed
+   the file's data, CLUSTER_SIZE bytes at a time, and entry I of
+   CLUSTERS describes where cluster I went: a run of up to
+   CLUSTER_SECTORS sectors, whose first sector is in the low 28
+   bits and whose length less 1 is in the 3 bits above them (see
+   cluster_start() and cluster_sectors()).  A run as long as the
+   cluster's uncompressed data holds that data as is, because it
+   did not compress.  A write to a compressed file first moves
+   its data back out to the layout the other flags call for. */
 struct inode_disk
   {
-    block_sector_t start;               /* First data sector. */
+    union
+      {
+        struct
+          {
+            block_sector_t direct[DIRECT_CNT];  /* Direct data sectors. */
+            block_sector_t indirect;            /* Indirect block. */
+            block_sector_t doubly_indirect;     /* Doubly indirect block. */
+          };
+        struct
+          {
+            uint32_t extent_cnt;                /* Extents in use. */
+            struct extent extents[EXTENT_CNT];  /* Data extents. */
+          };
+        uint8_t inline_data[INLINE_SIZE];       /* Inline file data. */
+        block_sector_t clusters[CLUSTER_CNT];   /* Compressed clusters. */
+      };
     off_t length;                       /* File size in bytes. */
+    uint32_t flags;                     /* INODE_* flags. */
     unsigned magic;                     /* Magic number. */
-    uint32_t unused[125];               /* Not used. */
   };
 
+/* If true, new files use the extent layout. */
+bool inode_extents;
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
@@ -31,315 +159,2362 @@ bytes_to_sectors (off_t size)
 /* In-memory inode. */
 struct inode 
   {
-    struct list_elem elem;              /* Element in inode list. */
+    struct inode *hash_next;            /* Next in `open_inodes' chain. */
+    struct list_elem lru_elem;          /* Element in `closed_inodes'. */
+    struct rcu_head rcu;                /* Frees it after a grace period. */
     block_sector_t sector;              /* Sector number of disk location. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct rwlock rw_lock;              /* Shared for I/O, exclusive to grow. */
+    struct rwlock dir_lock;             /* Guards directory contents. */
+    struct dir_index *dir_index;        /* Directory's name index, or null. */
+    uint64_t read_bytes;                /* Bytes read since opened. */
+    uint64_t write_bytes;               /* Bytes written since opened. */
+    struct lock cluster_lock;           /* Protects the next two. */
+    uint8_t *cluster_buf;               /* Decompressed cluster, or null. */
+    size_t cluster_idx;                 /* Cluster in CLUSTER_BUF. */
+    struct lock exec_lock;              /* Protects the next two. */
+    void *exec_plan;                    /* Executable's load plan, or null. */
+    size_t exec_plan_size;              /* Bytes in EXEC_PLAN. */
+    bool pinned;                        /* Pinned by inode_pin()? */
+    struct radix_tree pages;            /* Resident pages, by page index. */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* CLUSTER_IDX when CLUSTER_BUF holds no cluster. */
+#define NO_CLUSTER SIZE_MAX
+
+/* Returns the first sector of compressed cluster entry E. */
+static inline block_sector_t
+cluster_start (block_sector_t e)
+{
+  return e & 0x0fffffff;
+}
+
+/* Returns the number of sectors of compressed cluster entry E. */
+static inline size_t
+cluster_sectors (block_sector_t e)
+{
+  return ((e >> 28) & 7) + 1;
+}
+
+/* Returns the number of bytes of data in cluster IDX of a file
+   LENGTH bytes long. */
+static inline size_t
+cluster_size (off_t length, size_t idx)
+{
+  off_t left = length - (off_t) idx * CLUSTER_SIZE;
+  return left < CLUSTER_SIZE ? left : CLUSTER_SIZE;
+}
+
+/* Bytes read from and written to all inodes since boot. */
+static uint64_t total_read_bytes;
+static uint64_t total_write_bytes;
+
+/* What a newly allocated sector is filled with. */
+enum sector_fill
+  {
+    FILL_NONE,                          /* Nothing: preallocated data. */
+    FILL_DATA,                          /* Zeros, as file data. */
+    FILL_META                           /* Zeros, through the journal. */
+  };
+
+static void write_sector (block_sector_t, const void *buffer, int ofs,
+                          int size, bool meta);
+static bool allocate_sector (block_sector_t *, block_sector_t *goal,
+                             enum sector_fill);
+static block_sector_t slot_get (block_sector_t *, block_sector_t *goal,
+                                enum sector_fill);
+static block_sector_t table_get (block_sector_t table, size_t idx,
+                                 block_sector_t *goal, enum sector_fill);
+static block_sector_t index_to_sector (struct inode_disk *, size_t idx,
+                                       block_sector_t *goal, bool unwritten);
+static block_sector_t extent_to_sector (const struct inode_disk *,
+                                        size_t idx);
+static bool extent_allocate (struct inode_disk *, size_t sectors,
+                             block_sector_t home, bool unwritten);
+static bool inode_allocate (struct inode_disk *, off_t offset, off_t size,
+                            block_sector_t home, bool unwritten);
+static off_t allocated_size (struct inode_disk *, off_t offset, off_t size);
+static void zero_unwritten (struct inode_disk *, off_t old_length,
+                            off_t offset, off_t size);
+static void release_table (block_sector_t table, int level);
+static bool clone_table (block_sector_t table, int level,
+                         block_sector_t *copy, block_sector_t *goal);
+static bool write_shared (struct inode_disk *, off_t offset, off_t size);
+static bool unshare (struct inode *, off_t offset, off_t size);
+static void index_replace (struct inode_disk *, size_t idx,
+                           block_sector_t);
+static void copy_sector (block_sector_t from, block_sector_t to,
+                         size_t idx, off_t offset, off_t size,
+                         void *buffer);
+static void inode_release_sectors (struct inode_disk *);
+static bool inode_uninline (struct inode *);
+static bool load_cluster (const struct inode_disk *, size_t idx,
+                          uint8_t *out, uint8_t *scratch);
+static bool read_compressed (struct inode *, void *buffer, off_t offset,
+                             int size);
+static bool inode_decompress (struct inode *);
+static void count_bytes (uint64_t *, uint64_t *total, off_t);
+static off_t read_iov (struct inode *, const struct iovec *, int iovcnt,
+                       off_t offset, bool direct);
+static size_t direct_run (struct inode *, block_sector_t first,
+                          off_t offset, off_t size);
+static bool uses_pcache (const struct inode *);
+static struct pcache_page *get_page (struct inode *, size_t idx,
+                                     bool whole);
+static void fill_page (struct inode *, struct pcache_page *);
+static off_t read_page (struct inode *, void *buffer, off_t offset,
+                        off_t size, bool direct);
+static off_t write_page (struct inode *, const void *buffer,
+                         off_t offset, off_t size);
+static void drop_exec_plan (struct inode *);
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
-   POS. */
+   POS, or NO_SECTOR if POS is in a hole that reads as zeros.
+   Index blocks are read through the buffer cache, so a lookup
+   costs at most two cached sector reads. */
 static block_sector_t
 byte_to_sector (const struct inode *inode, off_t pos) 
 {
   ASSERT (inode != NULL);
   if (pos < inode->data.length)
-    return inode->data.start + pos / BLOCK_SECTOR_SIZE;
+    return index_to_sector ((struct inode_disk *) &inode->data,
+                            pos / BLOCK_SECTOR_SIZE, NULL, false);
   else
     return -1;
 }
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Writes SIZE bytes from BUFFER into SECTOR starting at byte
+   OFS.  Metadata, as indicated by META, goes through the
+   journal; file data goes straight to the buffer cache. */
+static void
+write_sector (block_sector_t sector, const void *buffer, int ofs, int size,
+              bool meta)
+{
+  if (meta)
+    journal_write (sector, buffer, ofs, size);
+  else
+    cache_write (sector, buffer, ofs, size);
+}
 
-/* Initializes the inode module. */
-void
-inode_init (void) 
+/* Allocates a sector, fills it as FILL says, and stores its
+   number in *SECTORP.  The free map is searched from sector *GOAL
+   on, and *GOAL is advanced just past the sector allocated, so
+   that successive allocations land next to each other.  Returns
+   true if successful, false if the disk is full. */
+static bool
+allocate_sector (block_sector_t *sectorp, block_sector_t *goal,
+                 enum sector_fill fill)
 {
-  list_init (&open_inodes);
+  static char zeros[BLOCK_SECTOR_SIZE];
+
+  if (!free_map_allocate_goal (1, *goal, sectorp))
+    return false;
+  *goal = *sectorp + 1;
+  if (fill != FILL_NONE)
+    write_sector (*sectorp, zeros, 0, BLOCK_SECTOR_SIZE, fill == FILL_META);
+  return true;
 }
 
-/* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   device.
-   Returns true if successful.
-   Returns false if memory or disk allocation fails. */
-bool
-inode_create (block_sector_t sector, off_t length)
+/* Returns the sector in *SLOT.  If *SLOT is empty and GOAL is
+   non-null, first allocates a sector for it near *GOAL, as for
+   allocate_sector().  Returns NO_SECTOR if the slot stays
+   empty. */
+static block_sector_t
+slot_get (block_sector_t *slot, block_sector_t *goal, enum sector_fill fill)
 {
-  struct inode_disk *disk_inode = NULL;
-  bool success = false;
+  if (*slot == NO_SECTOR && goal != NULL)
+    allocate_sector (slot, goal, fill);
+  return *slot;
+}
 
-  ASSERT (length >= 0);
+/* Like slot_get(), for entry IDX of index block TABLE. */
+static block_sector_t
+table_get (block_sector_t table, size_t idx, block_sector_t *goal,
+           enum sector_fill fill)
+{
+  block_sector_t sector;
 
-  /* If this assertion fails, the inode structure is not exactly
-     one sector in size, and you should fix that. */
-  ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+  cache_read (table, &sector, idx * sizeof sector, sizeof sector);
+  if (sector == NO_SECTOR && goal != NULL
+      && allocate_sector (&sector, goal, fill))
+    journal_write (table, &sector, idx * sizeof sector, sizeof sector);
+  return sector;
+}
 
-  disk_inode = calloc (1, sizeof *disk_inode);
-  if (disk_inode != NULL)
+/* Returns the sector holding data sector number IDX of the file
+   described by DISK, or NO_SECTOR if there is none.  If GOAL is
+   non-null, missing data and index sectors are allocated (and
+   DISK may be modified), as described for allocate_sector().
+   Index blocks are zeroed as metadata, and so is the data of a
+   directory.  Other new data sectors are zeroed too, unless
+   UNWRITTEN is true. */
+static block_sector_t
+index_to_sector (struct inode_disk *disk, size_t idx, block_sector_t *goal,
+                 bool unwritten)
+{
+  enum sector_fill fill = (disk->flags & INODE_DIR ? FILL_META
+                           : unwritten ? FILL_NONE : FILL_DATA);
+  block_sector_t table;
+
+  if (disk->flags & INODE_EXTENTS)
     {
-      size_t sectors = bytes_to_sectors (length);
-      disk_inode->length = length;
-      disk_inode->magic = INODE_MAGIC;
-      if (free_map_allocate (sectors, &disk_inode->start)) 
-        {
-          block_write (fs_device, sector, disk_inode);
-          if (sectors > 0) 
-            {
-              static char zeros[BLOCK_SECTOR_SIZE];
-              size_t i;
-              
-              for (i = 0; i < sectors; i++) 
-                block_write (fs_device, disk_inode->start + i, zeros);
-            }
-          success = true; 
-        } 
-      free (disk_inode);
+      if (goal != NULL && !extent_allocate (disk, idx + 1, *goal, unwritten))
+        return NO_SECTOR;
+      return extent_to_sector (disk, idx);
     }
-  return success;
+
+  if (idx < DIRECT_CNT)
+    return slot_get (&disk->direct[idx], goal, fill);
+  idx -= DIRECT_CNT;
+
+  if (idx < PTRS_PER_SECTOR)
+    {
+      table = slot_get (&disk->indirect, goal, FILL_META);
+      return (table != NO_SECTOR ? table_get (table, idx, goal, fill)
+              : NO_SECTOR);
+    }
+  idx -= PTRS_PER_SECTOR;
+
+  if (idx < PTRS_PER_SECTOR * PTRS_PER_SECTOR)
+    {
+      table = slot_get (&disk->doubly_indirect, goal, FILL_META);
+      if (table != NO_SECTOR)
+        table = table_get (table, idx / PTRS_PER_SECTOR, goal, FILL_META);
+      if (table != NO_SECTOR)
+        return table_get (table, idx % PTRS_PER_SECTOR, goal, fill);
+    }
+  return NO_SECTOR;
 }
 
-/* Reads an inode from SECTOR
-   and returns a `struct inode' that contains it.
-   Returns a null pointer if memory allocation fails. */
-struct inode *
-inode_open (block_sector_t sector)
+/* Returns the sector holding data sector number IDX of the
+   extent-mapped file described by DISK, or NO_SECTOR if IDX is
+   past the allocated extents. */
+static block_sector_t
+extent_to_sector (const struct inode_disk *disk, size_t idx)
 {
-  struct list_elem *e;
-  struct inode *inode;
+  size_t i;
+
+  for (i = 0; i < disk->extent_cnt; i++)
+    {
+      const struct extent *e = &disk->extents[i];
+      if (idx < e->length)
+        return e->start + idx;
+      idx -= e->length;
+    }
+  return NO_SECTOR;
+}
+
+/* Grows the extents of DISK until they cover at least SECTORS
+   data sectors, zeroing each new sector unless UNWRITTEN is true
+   and DISK is not a directory.  Each step first asks
+   the free map for all the missing sectors as one run right after
+   the last extent, or from sector HOME on if there are no extents
+   yet, then anywhere, and settles for a single sector if no such
+   run exists.  Returns false if the disk is full or the extent
+   array is exhausted. */
+static bool
+extent_allocate (struct inode_disk *disk, size_t sectors,
+                 block_sector_t home, bool unwritten)
+{
+  static char zeros[BLOCK_SECTOR_SIZE];
+  size_t have = 0;
+  size_t i;
 
-  /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  for (i = 0; i < disk->extent_cnt; i++)
+    have += disk->extents[i].length;
+
+  while (have < sectors)
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      struct extent *last = (disk->extent_cnt > 0
+                             ? &disk->extents[disk->extent_cnt - 1] : NULL);
+      block_sector_t goal = last != NULL ? last->start + last->length : home;
+      block_sector_t start;
+      size_t cnt = sectors - have;
+
+      if (!free_map_allocate_goal (cnt, goal, &start))
         {
-          inode_reopen (inode);
-          return inode; 
+          cnt = 1;
+          if (!free_map_allocate_goal (cnt, goal, &start))
+            return false;
+        }
+
+      if (last != NULL && start == goal)
+        last->length += cnt;
+      else if (disk->extent_cnt < EXTENT_CNT)
+        {
+          disk->extents[disk->extent_cnt].start = start;
+          disk->extents[disk->extent_cnt].length = cnt;
+          disk->extent_cnt++;
+        }
+      else
+        {
+          free_map_release (start, cnt);
+          return false;
         }
+
+      if (!unwritten || (disk->flags & INODE_DIR))
+        for (i = 0; i < cnt; i++)
+          write_sector (start + i, zeros, 0, BLOCK_SECTOR_SIZE,
+                        (disk->flags & INODE_DIR) != 0);
+      have += cnt;
     }
+  return true;
+}
 
-  /* Allocate memory. */
-  inode = malloc (sizeof *inode);
-  if (inode == NULL)
-    return NULL;
+/* Makes sure that the data sectors holding the SIZE bytes
+   starting at byte OFFSET are allocated in DISK's index, which
+   leaves sectors before OFFSET that are not allocated as holes.
+   Extents cannot describe holes, so with the extent layout every
+   sector up to OFFSET + SIZE is allocated.  Newly allocated
+   sectors read as zeros, unless UNWRITTEN is true, in which case
+   file data sectors are left as they are on disk; that is only
+   safe past end of file (see zero_unwritten()).  DISK's length
+   is not changed.
+   Returns false if the disk fills up or OFFSET + SIZE is beyond
+   the largest possible file; sectors allocated so far, which are
+   the first ones in the range, stay in the index and are
+   released along with the inode.
 
-  /* Initialize. */
-  list_push_front (&open_inodes, &inode->elem);
-  inode->sector = sector;
-  inode->open_cnt = 1;
-  inode->deny_write_cnt = 0;
-  inode->removed = false;
-  block_read (fs_device, inode->sector, &inode->data);
-  return inode;
+   New sectors are placed right after the data sector before
+   OFFSET, or right after the inode, in sector INODE_SECTOR, if
+   that sector is a hole, so that a growing file stays contiguous
+   where the disk allows.
+
+   A large allocation may be committed to the journal in several
+   transactions.  After a crash part way through, the sectors
+   already allocated are lost to the free map, but nothing is
+   inconsistent. */
+static bool
+inode_allocate (struct inode_disk *disk, off_t offset, off_t size,
+                block_sector_t inode_sector, bool unwritten)
+{
+  size_t sectors = bytes_to_sectors (offset + size);
+  block_sector_t goal = inode_sector + 1;
+  size_t i;
+
+  if (disk->flags & INODE_EXTENTS)
+    return extent_allocate (disk, sectors, goal, unwritten);
+
+  i = offset / BLOCK_SECTOR_SIZE;
+  if (i > 0)
+    {
+      block_sector_t last = index_to_sector (disk, i - 1, NULL, false);
+      if (last != NO_SECTOR)
+        goal = last + 1;
+    }
+  for (; i < sectors; i++)
+    {
+      if (index_to_sector (disk, i, &goal, unwritten) == NO_SECTOR)
+        return false;
+      journal_restart ();
+    }
+  return true;
 }
 
-/* Reopens and returns INODE. */
-struct inode *
-inode_reopen (struct inode *inode)
+/* Returns the number of the SIZE bytes starting at byte OFFSET
+   in DISK's data that come before the first hole among them. */
+static off_t
+allocated_size (struct inode_disk *disk, off_t offset, off_t size)
 {
-  if (inode != NULL)
-    inode->open_cnt++;
-  return inode;
+  off_t pos = offset;
+
+  while (pos < offset + size
+         && (index_to_sector (disk, pos / BLOCK_SECTOR_SIZE, NULL, false)
+             != NO_SECTOR))
+    pos = ROUND_DOWN (pos, BLOCK_SECTOR_SIZE) + BLOCK_SECTOR_SIZE;
+  return (pos < offset + size ? pos : offset + size) - offset;
 }
 
-/* Returns INODE's inode number. */
-block_sector_t
-inode_get_inumber (const struct inode *inode)
+/* Prepares for a write of SIZE bytes at OFFSET that takes DISK
+   past its old end of file OLD_LENGTH, by zeroing the parts of
+   sectors past OLD_LENGTH that the write will not cover.  Such
+   sectors may have been preallocated by inode_preallocate(), and
+   so hold whatever was on disk before.
+
+   Preallocated sectors always form a single run that starts just
+   past the end of file, because they are allocated from there,
+   and a write that grows the file past them fills in or zeroes
+   the whole run.  So the gap between OLD_LENGTH and OFFSET holds
+   preallocated sectors only up to its first hole. */
+static void
+zero_unwritten (struct inode_disk *disk, off_t old_length, off_t offset,
+                off_t size)
 {
-  return inode->sector;
+  static char zeros[BLOCK_SECTOR_SIZE];
+  bool meta = (disk->flags & INODE_DIR) != 0;
+  size_t eof = bytes_to_sectors (old_length);
+  size_t first = offset / BLOCK_SECTOR_SIZE;
+  size_t last = (offset + size - 1) / BLOCK_SECTOR_SIZE;
+  block_sector_t sector;
+  size_t i;
+
+  for (i = eof; i < first; i++)
+    {
+      sector = index_to_sector (disk, i, NULL, false);
+      if (sector == NO_SECTOR)
+        break;
+      write_sector (sector, zeros, 0, BLOCK_SECTOR_SIZE, meta);
+    }
+
+  /* The first and last sectors written may be covered only in
+     part.  Zeroing all of either is harmless, since the write
+     then fills in its part. */
+  if (first >= eof && offset % BLOCK_SECTOR_SIZE != 0)
+    {
+      sector = index_to_sector (disk, first, NULL, false);
+      write_sector (sector, zeros, 0, BLOCK_SECTOR_SIZE, meta);
+    }
+  if (last >= eof && (offset + size) % BLOCK_SECTOR_SIZE != 0
+      && (last != first || offset % BLOCK_SECTOR_SIZE == 0))
+    {
+      sector = index_to_sector (disk, last, NULL, false);
+      write_sector (sector, zeros, 0, BLOCK_SECTOR_SIZE, meta);
+    }
 }
 
-/* Closes INODE and writes it to disk.
-   If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
-void
-inode_close (struct inode *inode) 
+/* Releases index block TABLE and, recursively, the LEVEL levels
+   of sectors below it. */
+static void
+release_table (block_sector_t table, int level)
 {
-  /* Ignore null pointer. */
-  if (inode == NULL)
+  if (table == NO_SECTOR)
     return;
-
-  /* Release resources if this was the last opener. */
-  if (--inode->open_cnt == 0)
+  if (level > 0)
     {
-      /* Remove from inode list and release lock. */
-      list_remove (&inode->elem);
- 
-      /* Deallocate blocks if removed. */
-      if (inode->removed) 
-        {
-          free_map_release (inode->sector, 1);
-          free_map_release (inode->data.start,
-                            bytes_to_sectors (inode->data.length)); 
-        }
+      size_t i;
 
-      free (inode); 
+      for (i = 0; i < PTRS_PER_SECTOR; i++)
+        release_table (table_get (table, i, NULL, FILL_NONE), level - 1);
     }
+  free_map_release (table, 1);
 }
 
-/* Marks INODE to be deleted when it is closed by the last caller who
-   has it open. */
-void
-inode_remove (struct inode *inode) 
+/* Releases every data and index sector referenced by DISK. */
+static void
+inode_release_sectors (struct inode_disk *disk)
 {
-  ASSERT (inode != NULL);
-  inode->removed = true;
+  size_t i;
+
+  if (disk->flags & INODE_INLINE)
+    return;
+  if (disk->flags & INODE_COMPRESSED)
+    {
+      for (i = 0; i < CLUSTER_CNT; i++)
+        if (disk->clusters[i] != NO_SECTOR)
+          free_map_release (cluster_start (disk->clusters[i]),
+                            cluster_sectors (disk->clusters[i]));
+      return;
+    }
+  if (disk->flags & INODE_EXTENTS)
+    {
+      for (i = 0; i < disk->extent_cnt; i++)
+        free_map_release (disk->extents[i].start, disk->extents[i].length);
+      return;
+    }
+
+  for (i = 0; i < DIRECT_CNT; i++)
+    release_table (disk->direct[i], 0);
+  release_table (disk->indirect, 1);
+  release_table (disk->doubly_indirect, 2);
 }
 
-/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
-   Returns the number of bytes actually read, which may be less
-   than SIZE if an error occurs or end of file is reached. */
-off_t
-inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset) 
+/* Makes *COPY a copy of index block TABLE, which has LEVEL
+   levels of sectors below it, for a clone of the file it belongs
+   to: new index blocks, allocated near *GOAL as for
+   allocate_sector(), that refer to the same data sectors, each of
+   which gains a reference.  A LEVEL of 0 stands for a data
+   sector, which is shared rather than copied.  Returns false if
+   the disk fills up or a sector has too many references; what
+   was copied by then is in *COPY, for the caller to release. */
+static bool
+clone_table (block_sector_t table, int level, block_sector_t *copy,
+             block_sector_t *goal)
 {
-  uint8_t *buffer = buffer_;
-  off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+  block_sector_t *entries;
+  bool success = true;
+  size_t i;
+
+  *copy = NO_SECTOR;
+  if (table == NO_SECTOR)
+    return true;
+  if (level == 0)
+    {
+      if (!free_map_share (table, 1))
+        return false;
+      *copy = table;
+      return true;
+    }
+
+  entries = calloc (PTRS_PER_SECTOR, sizeof *entries);
+  if (entries == NULL || !allocate_sector (copy, goal, FILL_NONE))
+    {
+      free (entries);
+      return false;
+    }
+  for (i = 0; i < PTRS_PER_SECTOR && success; i++)
+    success = clone_table (table_get (table, i, NULL, FILL_NONE),
+                           level - 1, &entries[i], goal);
+  journal_write (*copy, entries, 0, BLOCK_SECTOR_SIZE);
+  journal_restart ();
+  free (entries);
+  return success;
+}
 
-  while (size > 0) 
+/* Returns true if a write of SIZE bytes at OFFSET to DISK would
+   land on a data sector that DISK shares with another file. */
+static bool
+write_shared (struct inode_disk *disk, off_t offset, off_t size)
+{
+  size_t first = offset / BLOCK_SECTOR_SIZE;
+  size_t last = (offset + size - 1) / BLOCK_SECTOR_SIZE;
+  size_t i;
+
+  if (!(disk->flags & INODE_SHARED) || size == 0)
+    return false;
+  for (i = first; i <= last; i++)
     {
-      /* Disk sector to read, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      block_sector_t sector = index_to_sector (disk, i, NULL, false);
+      if (sector != NO_SECTOR && free_map_is_shared (sector, 1))
+        return true;
+    }
+  return false;
+}
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+/* Gives INODE copies of its own of the shared data sectors that
+   a write of SIZE bytes at OFFSET will modify, including any
+   between the end of file and OFFSET, which zero_unwritten() may
+   zero.  The caller must hold INODE's lock for writing and be in
+   a journal transaction, and must have allocated the sectors for
+   the write.  Returns false if the disk fills up.
 
-      /* Number of bytes to actually copy out of this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
+   An indexed file gets a new sector wherever one is shared.  An
+   extent-mapped file gets a new run for the part of each extent
+   that the write touches, which splits the extent in up to three,
+   or for the whole extent if that would use up the extent
+   array. */
+static bool
+unshare (struct inode *inode, off_t offset, off_t size)
+{
+  struct inode_disk *disk = &inode->data;
+  off_t start = offset < disk->length ? offset : disk->length;
+  size_t first = start / BLOCK_SECTOR_SIZE;
+  size_t last = (offset + size - 1) / BLOCK_SECTOR_SIZE;
+  block_sector_t goal = inode->sector + 1;
+  bool success = true;
+  void *buffer;
+  size_t i;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          block_read (fs_device, sector_idx, buffer + bytes_read);
-        }
-      else 
+  if (size == 0)
+    return true;
+  buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    return false;
+
+  if (disk->flags & INODE_EXTENTS)
+    {
+      size_t pos = 0;           /* File sector of extent I's start. */
+
+      for (i = 0; i < disk->extent_cnt && pos <= last && success;
+           pos += disk->extents[i].length, i++)
         {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
+          struct extent e = disk->extents[i];
+          size_t lo, hi, extra, j;
+          block_sector_t new;
+
+          if (pos + e.length <= first)
+            continue;
+          lo = first > pos ? first - pos : 0;
+          hi = last - pos < e.length ? last - pos + 1 : e.length;
+          if (!free_map_is_shared (e.start + lo, hi - lo))
+            continue;
+
+          extra = (lo > 0) + (hi < e.length);
+          if (disk->extent_cnt + extra > EXTENT_CNT)
             {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
+              lo = 0;
+              hi = e.length;
+              extra = 0;
+            }
+          if (!free_map_allocate_goal (hi - lo, goal, &new))
+            {
+              success = false;
+              break;
+            }
+          for (j = lo; j < hi; j++)
+            copy_sector (e.start + j, new + j - lo, pos + j, offset, size,
+                         buffer);
+          free_map_release (e.start + lo, hi - lo);
+
+          memmove (&disk->extents[i + 1 + extra], &disk->extents[i + 1],
+                   (disk->extent_cnt - i - 1) * sizeof *disk->extents);
+          disk->extent_cnt += extra;
+          if (lo > 0)
+            {
+              disk->extents[i].length = lo;
+              pos += lo;
+              i++;
+            }
+          disk->extents[i].start = new;
+          disk->extents[i].length = hi - lo;
+          if (hi < e.length)
+            {
+              disk->extents[i + 1].start = e.start + hi;
+              disk->extents[i + 1].length = e.length - hi;
             }
-          block_read (fs_device, sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
+          goal = new + (hi - lo);
+          journal_restart ();
         }
-      
-      /* Advance. */
-      size -= chunk_size;
-      offset += chunk_size;
-      bytes_read += chunk_size;
     }
-  free (bounce);
+  else
+    for (i = first; i <= last; i++)
+      {
+        block_sector_t old = index_to_sector (disk, i, NULL, false);
+        block_sector_t new;
 
-  return bytes_read;
+        if (old == NO_SECTOR || !free_map_is_shared (old, 1))
+          continue;
+        if (!allocate_sector (&new, &goal, FILL_NONE))
+          {
+            success = false;
+            break;
+          }
+        copy_sector (old, new, i, offset, size, buffer);
+        index_replace (disk, i, new);
+        free_map_release (old, 1);
+        journal_restart ();
+      }
+
+  free (buffer);
+  return success;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs.
-   (Normally a write at end of file would extend the inode, but
-   growth is not yet implemented.) */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+/* Sets data sector number IDX of the indexed file described by
+   DISK, which must already have one, to SECTOR. */
+static void
+index_replace (struct inode_disk *disk, size_t idx, block_sector_t sector)
 {
-  const uint8_t *buffer = buffer_;
-  off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  block_sector_t table;
 
-  if (inode->deny_write_cnt)
-    return 0;
+  if (idx < DIRECT_CNT)
+    {
+      disk->direct[idx] = sector;
+      return;
+    }
+  idx -= DIRECT_CNT;
 
-  while (size > 0) 
+  if (idx < PTRS_PER_SECTOR)
+    table = disk->indirect;
+  else
     {
-      /* Sector to write, starting byte offset within sector. */
-      block_sector_t sector_idx = byte_to_sector (inode, offset);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      idx -= PTRS_PER_SECTOR;
+      table = table_get (disk->doubly_indirect, idx / PTRS_PER_SECTOR,
+                         NULL, FILL_NONE);
+      idx %= PTRS_PER_SECTOR;
+    }
+  journal_write (table, &sector, idx * sizeof sector, sizeof sector);
+}
 
-      /* Bytes left in inode, bytes left in sector, lesser of the two. */
-      off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
-      int min_left = inode_left < sector_left ? inode_left : sector_left;
+/* Copies sector FROM, which holds data sector number IDX of a
+   file, to sector TO, using BUFFER, unless a write of SIZE bytes
+   at OFFSET is about to overwrite all of it. */
+static void
+copy_sector (block_sector_t from, block_sector_t to, size_t idx,
+             off_t offset, off_t size, void *buffer)
+{
+  off_t sector_start = (off_t) idx * BLOCK_SECTOR_SIZE;
 
-      /* Number of bytes to actually write into this sector. */
-      int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0)
-        break;
+  if (sector_start >= offset
+      && sector_start + BLOCK_SECTOR_SIZE <= offset + size)
+    return;
+  cache_read (from, buffer, 0, BLOCK_SECTOR_SIZE);
+  cache_write (to, buffer, 0, BLOCK_SECTOR_SIZE);
+}
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          block_write (fs_device, sector_idx, buffer + bytes_written);
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
+/* Moves the inline data of INODE, which must be inline, out to
+   a data sector of its own, after which INODE uses the layout
+   its other flags call for.  The caller must hold INODE's lock
+   for writing and be in a journal transaction.  Returns false,
+   leaving INODE as it was, if memory or the disk runs out. */
+static bool
+inode_uninline (struct inode *inode)
+{
+  struct inode_disk *disk = &inode->data;
+  uint8_t *data;
 
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            block_read (fs_device, sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          block_write (fs_device, sector_idx, bounce);
-        }
+  ASSERT (disk->flags & INODE_INLINE);
 
-      /* Advance. */
-      size -= chunk_size;
-      offset += chunk_size;
-      bytes_written += chunk_size;
+  data = calloc (1, BLOCK_SECTOR_SIZE);
+  if (data == NULL)
+    return false;
+  memcpy (data, disk->inline_data, disk->length);
+  memset (disk->inline_data, 0, sizeof disk->inline_data);
+  disk->flags &= ~INODE_INLINE;
+  if (disk->length > 0)
+    {
+      if (!inode_allocate (disk, 0, disk->length, inode->sector, true))
+        {
+          memcpy (disk->inline_data, data, disk->length);
+          disk->flags |= INODE_INLINE;
+          free (data);
+          return false;
+        }
+      write_sector (index_to_sector (disk, 0, NULL, false), data, 0,
+                    BLOCK_SECTOR_SIZE, false);
     }
-  free (bounce);
-
-  return bytes_written;
+  free (data);
+  return true;
 }
 
-/* Disables writes to INODE.
-   May be called at most once per inode opener. */
-void
-inode_deny_write (struct inode *inode) 
+/* Reads compressed cluster IDX of the file described by DISK
+   into OUT, which must have room for CLUSTER_SIZE bytes, through
+   the buffer cache, decompressing it with the help of SCRATCH,
+   which must be as large.  Bytes of OUT past the end of file are
+   zeroed.  Returns false if the cluster is not valid compressed
+   data. */
+static bool
+load_cluster (const struct inode_disk *disk, size_t idx, uint8_t *out,
+              uint8_t *scratch)
 {
-  inode->deny_write_cnt++;
-  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  block_sector_t e = disk->clusters[idx];
+  size_t size = cluster_size (disk->length, idx);
+  size_t sectors = cluster_sectors (e);
+  uint8_t *in = sectors < bytes_to_sectors (size) ? scratch : out;
+  size_t i;
+
+  memset (out, 0, CLUSTER_SIZE);
+  for (i = 0; i < sectors; i++)
+    cache_read (cluster_start (e) + i, in + i * BLOCK_SECTOR_SIZE, 0,
+                BLOCK_SECTOR_SIZE);
+  return (in == out
+          || lz_decompress (in, sectors * BLOCK_SECTOR_SIZE, out, size));
 }
 
-/* Re-enables writes to INODE.
-   Must be called once by each inode opener who has called
-   inode_deny_write() on the inode, before closing the inode. */
-void
-inode_allow_write (struct inode *inode) 
+/* Copies SIZE bytes at OFFSET in compressed INODE, which must lie
+   within one cluster, into BUFFER.  The caller must hold INODE's
+   lock.  The last cluster decompressed stays in memory with
+   INODE until it is closed, so that reading a cluster a sector at
+   a time decompresses it just once.  Returns false if memory
+   runs out or the data is corrupt. */
+static bool
+read_compressed (struct inode *inode, void *buffer, off_t offset, int size)
 {
-  ASSERT (inode->deny_write_cnt > 0);
-  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
-  inode->deny_write_cnt--;
+  size_t idx = offset / CLUSTER_SIZE;
+  bool success = true;
+
+  lock_acquire (&inode->cluster_lock);
+  if (inode->cluster_idx != idx)
+    {
+      if (inode->cluster_buf == NULL)
+        inode->cluster_buf = malloc (2 * CLUSTER_SIZE);
+      success = (inode->cluster_buf != NULL
+                 && load_cluster (&inode->data, idx, inode->cluster_buf,
+                                  inode->cluster_buf + CLUSTER_SIZE));
+      inode->cluster_idx = success ? idx : NO_CLUSTER;
+    }
+  if (success)
+    memcpy (buffer, inode->cluster_buf + offset % CLUSTER_SIZE, size);
+  lock_release (&inode->cluster_lock);
+  return success;
 }
 
-/* Returns the length, in bytes, of INODE's data. */
-off_t
-inode_length (const struct inode *inode)
+/* Moves the data of INODE, which must be compressed, back out
+   to the layout its other flags call for, uncompressed.  The
+   caller must hold INODE's lock for writing and be in a journal
+   transaction.  Returns false, leaving INODE as it was, if memory
+   or the disk runs out. */
+static bool
+inode_decompress (struct inode *inode)
 {
-  return inode->data.length;
+  struct inode_disk *disk = &inode->data;
+  struct inode_disk old;
+  uint8_t *buffer;
+  size_t idx, i;
+
+  ASSERT (disk->flags & INODE_COMPRESSED);
+
+  buffer = malloc (2 * CLUSTER_SIZE);
+  if (buffer == NULL)
+    return false;
+  old = *disk;
+  memset (disk->clusters, 0, sizeof disk->clusters);
+  disk->flags &= ~INODE_COMPRESSED;
+  if (!inode_allocate (disk, 0, disk->length, inode->sector, true))
+    {
+      inode_release_sectors (disk);
+      *disk = old;
+      free (buffer);
+      return false;
+    }
+
+  for (idx = 0; idx * CLUSTER_SIZE < (size_t) disk->length; idx++)
+    {
+      /* Corrupt data comes out as zeros. */
+      if (!load_cluster (&old, idx, buffer, buffer + CLUSTER_SIZE))
+        memset (buffer, 0, CLUSTER_SIZE);
+      for (i = 0; i < bytes_to_sectors (cluster_size (disk->length, idx));
+           i++)
+        write_sector (index_to_sector (disk, idx * CLUSTER_SECTORS + i,
+                                       NULL, false),
+                      buffer + i * BLOCK_SECTOR_SIZE, 0, BLOCK_SECTOR_SIZE,
+                      false);
+    }
+  inode_release_sectors (&old);
+
+  lock_acquire (&inode->cluster_lock);
+  inode->cluster_idx = NO_CLUSTER;
+  lock_release (&inode->cluster_lock);
+  free (buffer);
+  return true;
+}
+
+/* Table of inodes in memory, keyed by sector, so that opening a
+   single inode twice returns the same `struct inode'.
+
+   When the last opener of an inode that has not been removed
+   closes it, the inode stays in the table, with an open count of
+   0, on `closed_inodes', which is ordered from least to most
+   recently closed.  Reopening it then needs no disk read and
+   keeps its directory index, if any.  Only the
+   CLOSED_INODE_CNT most recently closed inodes are kept.
+
+   open_inodes_lock protects changes to the table, and
+   `closed_inodes', and the deny-write counts of the inodes in
+   them.  Lookups take no lock: they run under rcu_read_lock(),
+   and an inode is freed only after a grace period once it leaves
+   the table.  An inode's open count is changed atomically; it
+   goes from 0 to 1 or from 1 to 0 only with the lock held, so
+   a lookup that finds an inode with a nonzero count may take a
+   reference to it without the lock, and so may any close but
+   the last. */
+static struct inode *open_inodes[OPEN_INODE_BUCKETS];
+static struct list closed_inodes;
+static size_t closed_inode_cnt;
+static struct lock open_inodes_lock;
+
+/* Serializes inode_pin() and inode_unpin(), and protects the
+   `pinned' member of every inode. */
+static struct lock pin_lock;
+
+/* Cache of `struct inode's, which are just over 512 bytes. */
+static struct kmem_cache *inode_cache;
+
+/* Returns the chain in `open_inodes' for SECTOR. */
+static struct inode **
+open_inode_bucket (block_sector_t sector)
+{
+  return &open_inodes[hash_int (sector) & (OPEN_INODE_BUCKETS - 1)];
+}
+
+/* Returns the inode for SECTOR in `open_inodes', or a null
+   pointer if there is none.  The caller must hold
+   open_inodes_lock or be in a read-side critical section. */
+static struct inode *
+find_open_inode (block_sector_t sector)
+{
+  struct inode *inode;
+
+  for (inode = rcu_dereference (*open_inode_bucket (sector));
+       inode != NULL; inode = rcu_dereference (inode->hash_next))
+    if (inode->sector == sector)
+      return inode;
+  return NULL;
+}
+
+/* Adds one to INODE's open count unless it is 0, that is,
+   unless INODE is closed.  Returns true if successful. */
+static bool
+get_if_open (struct inode *inode)
+{
+  int cnt = __atomic_load_n (&inode->open_cnt, __ATOMIC_RELAXED);
+
+  while (cnt > 0)
+    if (__atomic_compare_exchange_n (&inode->open_cnt, &cnt, cnt + 1,
+                                     true, __ATOMIC_ACQUIRE,
+                                     __ATOMIC_RELAXED))
+      return true;
+  return false;
+}
+
+/* Subtracts one from INODE's open count unless it is 1, that
+   is, unless this is the last close.  Returns true if
+   successful. */
+static bool
+put_if_not_last (struct inode *inode)
+{
+  int cnt = __atomic_load_n (&inode->open_cnt, __ATOMIC_RELAXED);
+
+  while (cnt > 1)
+    if (__atomic_compare_exchange_n (&inode->open_cnt, &cnt, cnt - 1,
+                                     true, __ATOMIC_RELEASE,
+                                     __ATOMIC_RELAXED))
+      return true;
+  return false;
+}
+
+/* Frees the inode that contains HEAD, after a grace period. */
+static void
+free_inode (struct rcu_head *head)
+{
+  kmem_cache_free (inode_cache, rcu_entry (head, struct inode, rcu));
+}
+
+/* Initializes the inode module. */
+void
+inode_init (void) 
+{
+  list_init (&closed_inodes);
+  closed_inode_cnt = 0;
+  lock_init (&open_inodes_lock);
+  lock_init (&pin_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode), NULL);
+}
+
+/* Initializes an inode with LENGTH bytes of data and
+   writes the new inode to sector SECTOR on the file system
+   device.  The inode holds a directory if IS_DIR is true.
+   The data reads as zeros.  An indexed inode's data starts out
+   as a hole, with sectors allocated only as they are written, so
+   creating it takes the same time at any length.  A file of no
+   more than INLINE_SIZE bytes, other than a directory or the
+   free map, starts out with its data inline.
+   Returns true if successful.
+   Returns false if memory or disk allocation fails. */
+bool
+inode_create (block_sector_t sector, off_t length, bool is_dir)
+{
+  struct inode_disk *disk_inode = NULL;
+  bool success = false;
+  bool allocated;
+
+  ASSERT (length >= 0);
+
+  /* If this assertion fails, the inode structure is not exactly
+     one sector in size, and you should fix that. */
+  ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+
+  disk_inode = calloc (1, sizeof *disk_inode);
+  if (disk_inode != NULL)
+    {
+      disk_inode->magic = INODE_MAGIC;
+      if (inode_extents)
+        disk_inode->flags |= INODE_EXTENTS;
+      if (is_dir)
+        disk_inode->flags |= INODE_DIR;
+      else if (length <= (off_t) INLINE_SIZE && sector != FREE_MAP_SECTOR)
+        disk_inode->flags |= INODE_INLINE;
+      if (disk_inode->flags & INODE_INLINE)
+        allocated = true;
+      else if (disk_inode->flags & INODE_EXTENTS)
+        allocated = inode_allocate (disk_inode, 0, length, sector, false);
+      else
+        allocated = bytes_to_sectors (length) <= INDEX_SECTORS;
+      if (allocated) 
+        {
+          disk_inode->length = length;
+          journal_write (sector, disk_inode, 0, BLOCK_SECTOR_SIZE);
+          success = true; 
+        } 
+      else
+        inode_release_sectors (disk_inode);
+      free (disk_inode);
+    }
+  return success;
+}
+
+/* Writes to sector SECTOR a new inode that is a clone of SRC:
+   a file with the same length and contents, which shares SRC's
+   data sectors instead of copying them, so that cloning takes
+   time in proportion to the size of SRC's index, not of its
+   data.  Either file gets copies of shared sectors of its own as
+   it writes to them.  SRC must not be a directory.  The caller
+   must be in a journal transaction.
+   Returns true if successful.
+   Returns false if memory or disk allocation fails, or if a
+   sector is already shared by too many files. */
+bool
+inode_clone (struct inode *src, block_sector_t sector)
+{
+  struct inode_disk *disk;
+  block_sector_t goal = sector + 1;
+  bool success = true;
+  size_t i;
+
+  ASSERT (!inode_is_dir (src));
+
+  disk = calloc (1, sizeof *disk);
+  if (disk == NULL)
+    return false;
+
+  rwlock_acquire_write (&src->rw_lock);
+  pcache_flush_inode (src);
+  disk->length = src->data.length;
+  disk->flags = src->data.flags;
+  disk->magic = INODE_MAGIC;
+  if (src->data.flags & INODE_INLINE)
+    memcpy (disk->inline_data, src->data.inline_data, INLINE_SIZE);
+  else if (src->data.flags & INODE_COMPRESSED)
+    {
+      /* Compressed data is never written in place, so the clone
+         can share it without INODE_SHARED. */
+      for (i = 0; i < CLUSTER_CNT && success; i++)
+        {
+          block_sector_t e = src->data.clusters[i];
+          if (e == NO_SECTOR)
+            continue;
+          success = free_map_share (cluster_start (e), cluster_sectors (e));
+          if (success)
+            disk->clusters[i] = e;
+        }
+    }
+  else if (src->data.flags & INODE_EXTENTS)
+    {
+      for (i = 0; i < src->data.extent_cnt && success; i++)
+        {
+          const struct extent *e = &src->data.extents[i];
+          success = free_map_share (e->start, e->length);
+          if (success)
+            disk->extents[disk->extent_cnt++] = *e;
+        }
+    }
+  else
+    {
+      for (i = 0; i < DIRECT_CNT && success; i++)
+        success = clone_table (src->data.direct[i], 0, &disk->direct[i],
+                               &goal);
+      if (success)
+        success = clone_table (src->data.indirect, 1, &disk->indirect,
+                               &goal);
+      if (success)
+        success = clone_table (src->data.doubly_indirect, 2,
+                               &disk->doubly_indirect, &goal);
+    }
+
+  if (success)
+    {
+      if (!(disk->flags & (INODE_INLINE | INODE_COMPRESSED)))
+        {
+          disk->flags |= INODE_SHARED;
+          src->data.flags |= INODE_SHARED;
+          journal_write (src->sector, &src->data, 0, BLOCK_SECTOR_SIZE);
+        }
+      journal_write (sector, disk, 0, BLOCK_SECTOR_SIZE);
+    }
+  else
+    inode_release_sectors (disk);
+  rwlock_release_write (&src->rw_lock);
+  free (disk);
+  return success;
+}
+
+/* Reads an inode from SECTOR
+   and returns a `struct inode' that contains it.
+   Returns a null pointer if memory allocation fails. */
+struct inode *
+inode_open (block_sector_t sector)
+{
+  struct inode **bucket = open_inode_bucket (sector);
+  struct inode *inode;
+
+  /* Usually the inode is already open, and another reference to
+     it needs no lock. */
+  rcu_read_lock ();
+  inode = find_open_inode (sector);
+  if (inode != NULL && !get_if_open (inode))
+    inode = NULL;
+  rcu_read_unlock ();
+  if (inode != NULL)
+    return inode;
+
+  lock_acquire (&open_inodes_lock);
+
+  /* Check whether this inode is in memory but closed, or was
+     opened since we looked. */
+  inode = find_open_inode (sector);
+  if (inode != NULL)
+    {
+      if (__atomic_fetch_add (&inode->open_cnt, 1, __ATOMIC_ACQUIRE) == 0)
+        {
+          list_remove (&inode->lru_elem);
+          closed_inode_cnt--;
+        }
+      lock_release (&open_inodes_lock);
+      return inode; 
+    }
+
+  /* Allocate memory. */
+  inode = kmem_cache_alloc (inode_cache);
+  if (inode == NULL)
+    {
+      lock_release (&open_inodes_lock);
+      return NULL;
+    }
+
+  /* Initialize. */
+  inode->sector = sector;
+  inode->open_cnt = 1;
+  inode->deny_write_cnt = 0;
+  inode->removed = false;
+  rwlock_init (&inode->rw_lock);
+  rwlock_init (&inode->dir_lock);
+  inode->dir_index = NULL;
+  inode->read_bytes = inode->write_bytes = 0;
+  lock_init (&inode->cluster_lock);
+  inode->cluster_buf = NULL;
+  inode->cluster_idx = NO_CLUSTER;
+  lock_init (&inode->exec_lock);
+  inode->exec_plan = NULL;
+  inode->pinned = false;
+  radix_init (&inode->pages);
+  cache_read (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+
+  /* Publish it to lookups that take no lock. */
+  inode->hash_next = *bucket;
+  rcu_assign_pointer (*bucket, inode);
+  lock_release (&open_inodes_lock);
+  return inode;
+}
+
+/* Reopens and returns INODE. */
+struct inode *
+inode_reopen (struct inode *inode)
+{
+  if (inode != NULL)
+    {
+      ASSERT (inode->open_cnt > 0);
+      __atomic_fetch_add (&inode->open_cnt, 1, __ATOMIC_RELAXED);
+    }
+  return inode;
+}
+
+/* Returns INODE's inode number. */
+block_sector_t
+inode_get_inumber (const struct inode *inode)
+{
+  return inode->sector;
+}
+
+/* Closes INODE and writes it to disk.
+   If this was the last reference to INODE, it is kept in memory
+   among the recently closed inodes, and the least recently
+   closed one beyond CLOSED_INODE_CNT is freed instead.
+   If INODE was also a removed inode, frees its memory and its
+   blocks right away. */
+void
+inode_close (struct inode *inode) 
+{
+  /* Ignore null pointer. */
+  if (inode == NULL)
+    return;
+
+  /* Other closes need no lock. */
+  if (put_if_not_last (inode))
+    return;
+
+  /* Release resources if this was the last opener. */
+  lock_acquire (&open_inodes_lock);
+  if (__atomic_sub_fetch (&inode->open_cnt, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+      struct inode **p;
+
+      free (inode->cluster_buf);
+      inode->cluster_buf = NULL;
+      inode->cluster_idx = NO_CLUSTER;
+      if (!inode->removed)
+        {
+          list_push_back (&closed_inodes, &inode->lru_elem);
+          if (++closed_inode_cnt <= CLOSED_INODE_CNT)
+            {
+              lock_release (&open_inodes_lock);
+              return;
+            }
+          inode = list_entry (list_pop_front (&closed_inodes),
+                              struct inode, lru_elem);
+          closed_inode_cnt--;
+        }
+
+      /* Remove from inode table and release lock. */
+      for (p = open_inode_bucket (inode->sector); *p != inode;
+           p = &(*p)->hash_next)
+        continue;
+      rcu_assign_pointer (*p, inode->hash_next);
+      lock_release (&open_inodes_lock);
+
+      /* Write back cached pages, or discard them if removed. */
+      pcache_drop_inode (inode, !inode->removed);
+ 
+      /* Deallocate blocks if removed. */
+      if (inode->removed) 
+        {
+          journal_begin ();
+          free_map_release (inode->sector, 1);
+          inode_release_sectors (&inode->data);
+          journal_end ();
+        }
+
+      dir_index_destroy (inode->dir_index);
+      free (inode->exec_plan);
+      ASSERT (radix_empty (&inode->pages));
+      radix_destroy (&inode->pages);
+      call_rcu (&inode->rcu, free_inode);
+    }
+  else
+    lock_release (&open_inodes_lock);
+}
+
+/* Marks INODE to be deleted when it is closed by the last caller who
+   has it open. */
+void
+inode_remove (struct inode *inode) 
+{
+  ASSERT (inode != NULL);
+  inode->removed = true;
+}
+
+/* Returns true if INODE has been removed. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
+}
+
+/* Returns true if INODE holds a directory. */
+bool
+inode_is_dir (const struct inode *inode)
+{
+  return (inode->data.flags & INODE_DIR) != 0;
+}
+
+/* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
+   Returns the number of bytes actually read, which may be less
+   than SIZE if an error occurs or end of file is reached.
+   File data comes from the page cache, other data from the
+   buffer cache, and the READ_AHEAD_SECTORS sectors following the
+   last one read are prefetched into the buffer cache in the
+   background.  Open files use a read-ahead window of their own
+   instead (see file.c). */
+off_t
+inode_read_at (struct inode *inode, void *buffer, off_t size, off_t offset) 
+{
+  struct iovec iov;
+
+  off_t bytes_read;
+
+  iov.iov_base = buffer;
+  iov.iov_len = size;
+  bytes_read = inode_readv (inode, &iov, 1, offset);
+  if (bytes_read > 0)
+    inode_read_ahead (inode, offset + bytes_read,
+                      offset + bytes_read
+                      + READ_AHEAD_SECTORS * BLOCK_SECTOR_SIZE);
+  return bytes_read;
+}
+
+/* Reads from INODE, starting at position OFFSET, into the IOVCNT
+   buffers in IOV in turn, filling each before moving to the next.
+   Returns the total number of bytes actually read, which may be
+   less than the total size of the buffers if end of file is
+   reached.  The whole read takes INODE's lock just once.
+   Nothing is read ahead; see inode_read_ahead(). */
+off_t
+inode_readv (struct inode *inode, const struct iovec *iov, int iovcnt,
+             off_t offset) 
+{
+  return read_iov (inode, iov, iovcnt, offset, false);
+}
+
+/* Like inode_readv(), but whole sectors that are not already
+   cached are read from disk straight into the buffers in IOV,
+   which must be kernel addresses, instead of through the buffer
+   cache, and pages missing from the page cache are not added to
+   it.  For large reads, whose data would only push more useful
+   sectors and pages out of the caches. */
+off_t
+inode_readv_direct (struct inode *inode, const struct iovec *iov,
+                    int iovcnt, off_t offset) 
+{
+  return read_iov (inode, iov, iovcnt, offset, true);
+}
+
+/* Asks for the sectors of INODE that hold bytes START through
+   END - 1, apart from one that START falls in the middle of, to
+   be read into the buffer cache in the background, as far as
+   they lie within the file.  Holes and inline data need no
+   reading.  Read-ahead reads runs of the sectors that are
+   consecutive on disk in a single request. */
+void
+inode_read_ahead (struct inode *inode, off_t start, off_t end)
+{
+  off_t pos;
+
+  rwlock_acquire_read (&inode->rw_lock);
+  if (inode->data.flags & INODE_COMPRESSED)
+    for (pos = ROUND_UP (start, CLUSTER_SIZE);
+         pos < end && pos < inode_length (inode); pos += CLUSTER_SIZE)
+      {
+        block_sector_t e = inode->data.clusters[pos / CLUSTER_SIZE];
+        size_t i;
+
+        for (i = 0; i < cluster_sectors (e); i++)
+          cache_read_ahead (cluster_start (e) + i);
+      }
+  else if (!(inode->data.flags & INODE_INLINE))
+    for (pos = ROUND_UP (start, BLOCK_SECTOR_SIZE);
+         pos < end && pos < inode_length (inode); pos += BLOCK_SECTOR_SIZE)
+      {
+        block_sector_t sector = byte_to_sector (inode, pos);
+        if (sector != NO_SECTOR)
+          cache_read_ahead (sector);
+      }
+  rwlock_release_read (&inode->rw_lock);
+}
+
+/* A request from inode_prefetch(). */
+struct prefetch
+  {
+    struct work work;           /* Runs prefetch_pages(). */
+    struct inode *inode;        /* Inode, held open until done. */
+    size_t first, end;          /* Pages FIRST through END - 1. */
+  };
+
+static work_func prefetch_pages;
+
+/* Asks for pages FIRST through END - 1 of INODE's data to be
+   read into the page cache in the background, as far as they lie
+   within the file, and returns at once.  Each page's sectors are
+   read with as few requests as fill_page() can manage.  Does
+   nothing if INODE's data does not go through the page cache or
+   memory is short. */
+void
+inode_prefetch (struct inode *inode, size_t first, size_t end)
+{
+  struct prefetch *pf;
+
+  if (first >= end || !uses_pcache (inode))
+    return;
+  pf = malloc (sizeof *pf);
+  if (pf == NULL)
+    return;
+  pf->inode = inode_reopen (inode);
+  pf->first = first;
+  pf->end = end;
+  work_init (&pf->work, WORK_NORMAL);
+  work_queue (&pf->work, prefetch_pages, pf);
+}
+
+/* Reads in the pages that prefetch PF asks for, leaving them in
+   the page cache unreferenced, and frees PF. */
+static void
+prefetch_pages (struct work *w UNUSED, void *pf_)
+{
+  struct prefetch *pf = pf_;
+  size_t idx;
+
+  for (idx = pf->first; idx < pf->end; idx++)
+    {
+      struct pcache_page *pg = inode_get_page (pf->inode, idx, true);
+      if (pg == NULL)
+        break;
+      pcache_put (pg);
+    }
+  inode_close (pf->inode);
+  free (pf);
+}
+
+/* Does the work for inode_readv() and inode_readv_direct(),
+   bypassing the cache as described for the latter if DIRECT is
+   true. */
+static off_t
+read_iov (struct inode *inode, const struct iovec *iov, int iovcnt,
+          off_t offset, bool direct) 
+{
+  off_t bytes_read = 0;
+  bool is_inline, is_compressed, cached;
+  int i;
+
+  rwlock_acquire_read (&inode->rw_lock);
+  is_inline = (inode->data.flags & INODE_INLINE) != 0;
+  is_compressed = (inode->data.flags & INODE_COMPRESSED) != 0;
+  cached = uses_pcache (inode);
+  for (i = 0; i < iovcnt; i++)
+    {
+      uint8_t *buffer = iov[i].iov_base;
+      off_t size = iov[i].iov_len;
+      off_t seg_read = 0;
+
+      while (size > 0) 
+        {
+          /* Disk sector to read, starting byte offset within sector. */
+          block_sector_t sector_idx
+            = (is_inline || is_compressed || cached
+               ? NO_SECTOR : byte_to_sector (inode, offset));
+          int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+
+          /* Bytes left in inode, bytes left in sector, lesser of the two. */
+          off_t inode_left = inode_length (inode) - offset;
+          int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+          int min_left = inode_left < sector_left ? inode_left : sector_left;
+
+          /* Number of bytes to actually copy out of this sector. */
+          int chunk_size = size < min_left ? size : min_left;
+          if (chunk_size <= 0)
+            break;
+
+          if (cached)
+            {
+              /* The rest of the page, unless it is not cached. */
+              off_t copied = read_page (inode, buffer + seg_read, offset,
+                                        size, direct);
+              if (copied > 0)
+                {
+                  size -= copied;
+                  offset += copied;
+                  seg_read += copied;
+                  continue;
+                }
+              sector_idx = byte_to_sector (inode, offset);
+            }
+
+          if (is_inline)
+            memcpy (buffer + seg_read, inode->data.inline_data + offset,
+                    chunk_size);
+          else if (is_compressed)
+            {
+              if (!read_compressed (inode, buffer + seg_read, offset,
+                                    chunk_size))
+                break;
+            }
+          else if (sector_idx == NO_SECTOR)
+            memset (buffer + seg_read, 0, chunk_size);
+          else if (direct && chunk_size == BLOCK_SECTOR_SIZE)
+            {
+              size_t cnt = direct_run (inode, sector_idx, offset, size);
+              cache_read_direct (sector_idx, cnt, buffer + seg_read);
+              chunk_size = cnt * BLOCK_SECTOR_SIZE;
+            }
+          else
+            cache_read (sector_idx, buffer + seg_read, sector_ofs,
+                        chunk_size);
+      
+          /* Advance. */
+          size -= chunk_size;
+          offset += chunk_size;
+          seg_read += chunk_size;
+        }
+      bytes_read += seg_read;
+
+      /* Stop at end of file. */
+      if (size > 0)
+        break;
+    }
+  count_bytes (&inode->read_bytes, &total_read_bytes, bytes_read);
+
+  rwlock_release_read (&inode->rw_lock);
+
+  return bytes_read;
+}
+
+/* Returns the number of whole sectors, starting with FIRST at
+   OFFSET in INODE, that lie within the next SIZE bytes and within
+   the file and follow one another on disk, up to DIRECT_RUN_MAX.
+   The run stops short of any page in the page cache, which may
+   hold newer data than the disk.  OFFSET must be sector-aligned
+   and the first sector whole, so the result is at least 1. */
+static size_t
+direct_run (struct inode *inode, block_sector_t first, off_t offset,
+            off_t size)
+{
+  off_t left = inode_length (inode) - offset;
+  size_t cnt = 1;
+
+  if (size < left)
+    left = size;
+  while (cnt < DIRECT_RUN_MAX
+         && (off_t) (cnt + 1) * BLOCK_SECTOR_SIZE <= left
+         && byte_to_sector (inode, offset + cnt * BLOCK_SECTOR_SIZE)
+            == first + cnt)
+    {
+      off_t pos = offset + cnt * BLOCK_SECTOR_SIZE;
+      if (pos % PGSIZE == 0 && uses_pcache (inode)
+          && pcache_contains (inode, pos / PGSIZE))
+        break;
+      cnt++;
+    }
+  return cnt;
+}
+
+/* Returns true if INODE's data goes through the page cache.
+   Directories and the free map are written through the journal
+   instead, inline data lives in the inode, and compressed data
+   is cached by cluster. */
+static bool
+uses_pcache (const struct inode *inode)
+{
+  return (!(inode->data.flags & (INODE_INLINE | INODE_COMPRESSED
+                                 | INODE_DIR))
+          && inode->sector != FREE_MAP_SECTOR);
+}
+
+/* Returns page IDX of INODE from the page cache, as pcache_get()
+   does, after reading it in if it is new, unless WHOLE is true
+   because the caller is about to overwrite all of it.  Returns a
+   null pointer if the page cannot be cached.  INODE's lock must
+   be held. */
+static struct pcache_page *
+get_page (struct inode *inode, size_t idx, bool whole)
+{
+  struct pcache_page *pg = pcache_get (inode, idx);
+
+  if (pg != NULL && !pg->valid)
+    {
+      if (whole)
+        {
+          pg->size = 0;
+          pg->valid = true;
+        }
+      else
+        fill_page (inode, pg);
+    }
+  return pg;
+}
+
+/* Reads page PG of INODE in from disk.  Each run of its sectors
+   that are consecutive on disk is read with one call, and holes
+   and bytes past end of file read as zeros.  INODE's lock and
+   PG's lock must be held. */
+static void
+fill_page (struct inode *inode, struct pcache_page *pg)
+{
+  off_t start = (off_t) pg->index * PGSIZE;
+  off_t left = inode_length (inode) - start;
+  size_t size = left <= 0 ? 0 : left < PGSIZE ? (size_t) left : PGSIZE;
+  size_t sectors = DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+  size_t i, n;
+
+  for (i = 0; i < sectors; i += n)
+    {
+      block_sector_t sector
+        = byte_to_sector (inode, start + i * BLOCK_SECTOR_SIZE);
+      uint8_t *data = pg->data + i * BLOCK_SECTOR_SIZE;
+
+      n = 1;
+      if (sector == NO_SECTOR)
+        {
+          memset (data, 0, BLOCK_SECTOR_SIZE);
+          continue;
+        }
+      while (i + n < sectors
+             && byte_to_sector (inode, start + (i + n) * BLOCK_SECTOR_SIZE)
+                == sector + n)
+        n++;
+      cache_read_direct (sector, n, data);
+    }
+  memset (pg->data + size, 0, PGSIZE - size);
+  pg->size = size;
+  pg->valid = true;
+}
+
+/* Copies bytes of INODE from OFFSET on out of the page cache into
+   BUFFER, up to SIZE bytes but no further than the end of file or
+   the end of the page that OFFSET is in.  If DIRECT is true, only
+   a page already cached is used.  Returns the number of bytes
+   copied, or 0 if the page is not cached.  INODE's lock must be
+   held. */
+static off_t
+read_page (struct inode *inode, void *buffer, off_t offset, off_t size,
+           bool direct)
+{
+  int page_ofs = offset % PGSIZE;
+  off_t inode_left = inode_length (inode) - offset;
+  struct pcache_page *pg;
+
+  if (size > inode_left)
+    size = inode_left;
+  if (size > PGSIZE - page_ofs)
+    size = PGSIZE - page_ofs;
+  if (size <= 0)
+    return 0;
+
+  pg = (direct
+        ? pcache_lookup (inode, offset / PGSIZE)
+        : get_page (inode, offset / PGSIZE, false));
+  if (pg == NULL)
+    return 0;
+  memcpy (buffer, pg->data + page_ofs, size);
+  pcache_put (pg);
+  return size;
+}
+
+/* Copies up to SIZE bytes from BUFFER into INODE's page cache at
+   OFFSET, no further than the end of the page that OFFSET is in,
+   and marks the page dirty, recording the sectors that the bytes
+   go to, which must already be allocated and unshared.  BUFFER
+   may be the page's own data, as when the virtual memory system
+   writes back a mapped page.  Returns the number of bytes written,
+   or 0 if the page cannot be cached.  INODE's lock must be
+   held. */
+static off_t
+write_page (struct inode *inode, const void *buffer, off_t offset,
+            off_t size)
+{
+  int page_ofs = offset % PGSIZE;
+  struct pcache_page *pg;
+  off_t pos;
+
+  if (size > PGSIZE - page_ofs)
+    size = PGSIZE - page_ofs;
+  pg = get_page (inode, offset / PGSIZE, size == PGSIZE);
+  if (pg == NULL)
+    return 0;
+
+  if (pg->data + page_ofs != buffer)
+    memcpy (pg->data + page_ofs, buffer, size);
+  for (pos = ROUND_DOWN (offset, BLOCK_SECTOR_SIZE); pos < offset + size;
+       pos += BLOCK_SECTOR_SIZE)
+    pg->sectors[pos % PGSIZE / BLOCK_SECTOR_SIZE]
+      = index_to_sector (&inode->data, pos / BLOCK_SECTOR_SIZE, NULL,
+                         false);
+  if ((size_t) (page_ofs + size) > pg->size)
+    pg->size = page_ofs + size;
+  pcache_mark_dirty (pg);
+  pcache_put (pg);
+  return size;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if the disk fills up or an error occurs.
+   A write past end of file extends the inode; any gap between
+   the old end of file and OFFSET is left as a hole that reads
+   back as zeros.
+   File data goes to the page cache, other data to the buffer
+   cache, and reaches disk later.
+   Writes within the file share INODE's lock with readers and
+   other writers; only writes that grow the file or fill in a
+   hole take it exclusively, as do all writes to an inline file,
+   whose data lives in the inode itself. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer, off_t size,
+                off_t offset) 
+{
+  struct iovec iov;
+
+  iov.iov_base = (void *) buffer;
+  iov.iov_len = size;
+  return inode_writev (inode, &iov, 1, offset);
+}
+
+/* Writes the IOVCNT buffers in IOV, one after another, into INODE
+   starting at OFFSET, as one write in the manner of
+   inode_write_at().  Returns the total number of bytes actually
+   written.  The whole write takes INODE's lock just once, and a
+   write that grows the file allocates all of its sectors up
+   front, as one journaled operation, and so does a write into a
+   hole.  Writes to directories and to the free map are
+   journaled too. */
+off_t
+inode_writev (struct inode *inode, const struct iovec *iov, int iovcnt,
+              off_t offset) 
+{
+  bool meta = inode_is_dir (inode) || inode->sector == FREE_MAP_SECTOR;
+  off_t bytes_written = 0;
+  off_t size = 0;
+  bool allocating, cached;
+  int i;
+
+  if (inode_write_denied (inode))
+    return 0;
+
+  /* A load plan built from the old contents is stale, and so is
+     one that load() builds while we write, so drop it both before
+     and after. */
+  drop_exec_plan (inode);
+
+  for (i = 0; i < iovcnt; i++)
+    size += iov[i].iov_len;
+
+  /* Allocate the sectors for a write past end of file or into a
+     hole up front, and publish the new length only once the data
+     is written, so that readers never see sectors we have not
+     filled in yet. */
+  allocating = size > 0 && offset + size > inode_length (inode);
+  if (!allocating)
+    {
+      rwlock_acquire_read (&inode->rw_lock);
+      if ((inode->data.flags & (INODE_INLINE | INODE_COMPRESSED))
+          || allocated_size (&inode->data, offset, size) < size
+          || write_shared (&inode->data, offset, size))
+        {
+          rwlock_release_read (&inode->rw_lock);
+          allocating = true;
+        }
+    }
+  if (allocating)
+    {
+      journal_begin ();
+      rwlock_acquire_write (&inode->rw_lock);
+      if ((inode->data.flags & INODE_COMPRESSED)
+          && !inode_decompress (inode))
+        size = 0;
+      else if ((inode->data.flags & INODE_INLINE)
+               && offset + size > (off_t) INLINE_SIZE
+               && !inode_uninline (inode))
+        size = 0;
+      else if (inode->data.flags & INODE_INLINE)
+        {
+          /* Stays inline: nothing to allocate. */
+        }
+      else if (!inode_allocate (&inode->data, offset, size, inode->sector,
+                                false))
+        {
+          /* Out of space: write only as far as the first hole. */
+          size = allocated_size (&inode->data, offset, size);
+        }
+      if (size > 0 && (inode->data.flags & INODE_SHARED)
+          && !unshare (inode, offset, size))
+        size = 0;
+      if (size > 0 && offset + size > inode->data.length
+          && !(inode->data.flags & INODE_INLINE))
+        {
+          off_t eof = inode->data.length;
+
+          zero_unwritten (&inode->data, eof, offset, size);
+
+          /* A mapping may have stored past end of file in the last
+             cached page, and those bytes are about to become part
+             of the file. */
+          if (uses_pcache (inode) && eof % PGSIZE != 0)
+            {
+              struct pcache_page *pg = pcache_lookup (inode, eof / PGSIZE);
+              if (pg != NULL)
+                {
+                  memset (pg->data + eof % PGSIZE, 0,
+                          PGSIZE - eof % PGSIZE);
+                  pcache_put (pg);
+                }
+            }
+        }
+    }
+
+  cached = uses_pcache (inode);
+  for (i = 0; i < iovcnt && size > 0; i++)
+    {
+      const uint8_t *buffer = iov[i].iov_base;
+      off_t seg_size = iov[i].iov_len;
+      off_t seg_written = 0;
+
+      if (seg_size > size)
+        seg_size = size;
+      if (inode->data.flags & INODE_INLINE)
+        {
+          /* Goes to disk with the inode, below. */
+          memcpy (inode->data.inline_data + offset, buffer, seg_size);
+          seg_written = seg_size;
+          offset += seg_size;
+          seg_size = 0;
+        }
+      while (cached && seg_size > 0)
+        {
+          off_t chunk_size = write_page (inode, buffer + seg_written,
+                                         offset, seg_size);
+          if (chunk_size == 0)
+            break;
+          seg_size -= chunk_size;
+          offset += chunk_size;
+          seg_written += chunk_size;
+        }
+      while (seg_size > 0) 
+        {
+          /* Sector to write, starting byte offset within sector. */
+          block_sector_t sector_idx
+            = index_to_sector (&inode->data, offset / BLOCK_SECTOR_SIZE,
+                               NULL, false);
+          int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+
+          /* Bytes left in sector, lesser of that and SEG_SIZE.
+             Allocation above has already made room for all
+             SIZE bytes. */
+          int min_left = BLOCK_SECTOR_SIZE - sector_ofs;
+
+          /* Number of bytes to actually write into this sector. */
+          int chunk_size = seg_size < min_left ? seg_size : min_left;
+
+          write_sector (sector_idx, buffer + seg_written, sector_ofs,
+                        chunk_size, meta);
+
+          /* Advance. */
+          seg_size -= chunk_size;
+          offset += chunk_size;
+          seg_written += chunk_size;
+        }
+      size -= seg_written;
+      bytes_written += seg_written;
+    }
+
+  if (allocating)
+    {
+      /* Readers that do not take the lock, such as filesize(), see
+         the new length only after the rest. */
+      if (offset > inode->data.length)
+        __atomic_store_n (&inode->data.length, offset, __ATOMIC_RELEASE);
+      journal_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+      rwlock_release_write (&inode->rw_lock);
+      journal_end ();
+    }
+  else
+    rwlock_release_read (&inode->rw_lock);
+
+  drop_exec_plan (inode);
+  count_bytes (&inode->write_bytes, &total_write_bytes, bytes_written);
+  if (cached)
+    pcache_throttle ();
+  return bytes_written;
+}
+
+/* Allocates the data sectors that INODE needs to grow to LENGTH
+   bytes, without writing them or changing INODE's length, so that
+   writes that later extend the file up to LENGTH find their
+   sectors already in place, and need not update the free map.
+   The sectors follow the file's last data sector on disk where
+   there is room.  An inline file that LENGTH does not fit is
+   first moved out of its inode.  Returns true if successful,
+   false if the disk fills up first; the sectors allocated by then
+   are kept. */
+bool
+inode_preallocate (struct inode *inode, off_t length)
+{
+  off_t start;
+  bool success = true;
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->rw_lock);
+  start = ROUND_UP (inode_length (inode), BLOCK_SECTOR_SIZE);
+  if (inode->data.flags & INODE_COMPRESSED)
+    success = inode_decompress (inode);
+  if (success && (inode->data.flags & INODE_INLINE)
+      && length > (off_t) INLINE_SIZE)
+    success = inode_uninline (inode);
+  if (success && !(inode->data.flags & INODE_INLINE) && length > start)
+    success = inode_allocate (&inode->data, start, length - start,
+                              inode->sector, true);
+  journal_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  rwlock_release_write (&inode->rw_lock);
+  journal_end ();
+  return success;
+}
+
+/* Writes INODE's dirty data sectors back to disk, then makes its
+   metadata durable with journal_sync(), so that after a crash
+   the metadata never points to data that did not reach disk.
+   Its dirty pages are first written back from the page cache,
+   then only cached sectors that are dirty are written.  Metadata
+   cannot be synced one inode at a time, so this commits or
+   flushes the metadata of every file. */
+void
+inode_sync (struct inode *inode)
+{
+  pcache_flush_inode (inode);
+  rwlock_acquire_read (&inode->rw_lock);
+  if (!(inode->data.flags & (INODE_INLINE | INODE_COMPRESSED)))
+    {
+      block_sector_t sectors[SYNC_BATCH];
+      size_t cnt = bytes_to_sectors (inode_length (inode));
+      size_t n = 0;
+      size_t i;
+
+      for (i = 0; i < cnt; i++)
+        {
+          block_sector_t sector = index_to_sector (&inode->data, i, NULL,
+                                                   false);
+          if (sector == NO_SECTOR)
+            continue;
+          sectors[n++] = sector;
+          if (n == SYNC_BATCH)
+            {
+              cache_flush_sectors (sectors, n);
+              n = 0;
+            }
+        }
+      cache_flush_sectors (sectors, n);
+    }
+  rwlock_release_read (&inode->rw_lock);
+
+  journal_sync ();
+}
+
+/* Moves the data of INODE into a single run of consecutive
+   sectors, if it uses the extent layout and is split across more
+   than one extent.  Returns true if INODE was moved.
+
+   The data is copied through the buffer cache, so that dirty
+   cached sectors are moved too, and written back before the
+   inode is updated.  The new extent and the release of the old
+   ones are then committed as one transaction before the journal
+   lock is dropped, so that the old sectors cannot be reused
+   while a crash would still leave the inode pointing to them.
+   Directories, whose data goes through the journal, files using
+   the sector index, and files that may share sectors with a
+   clone, which moving would unshare, are left alone. */
+bool
+inode_defragment (struct inode *inode)
+{
+  struct inode_disk old;
+  block_sector_t sectors[SYNC_BATCH];
+  block_sector_t start;
+  uint8_t *buffer;
+  size_t total = 0;
+  size_t copied = 0;
+  size_t n = 0;
+  size_t i, j;
+
+  buffer = malloc (BLOCK_SECTOR_SIZE);
+  if (buffer == NULL)
+    return false;
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->rw_lock);
+  pcache_flush_inode (inode);
+  if (inode->removed
+      || (inode->data.flags & (INODE_EXTENTS | INODE_DIR | INODE_INLINE
+                               | INODE_SHARED | INODE_COMPRESSED))
+         != INODE_EXTENTS
+      || inode->data.extent_cnt < 2)
+    goto fail;
+  for (i = 0; i < inode->data.extent_cnt; i++)
+    total += inode->data.extents[i].length;
+  if (!free_map_allocate_goal (total, inode->sector + 1, &start))
+    goto fail;
+
+  for (i = 0; i < inode->data.extent_cnt; i++)
+    {
+      const struct extent *e = &inode->data.extents[i];
+      for (j = 0; j < e->length; j++)
+        {
+          cache_read (e->start + j, buffer, 0, BLOCK_SECTOR_SIZE);
+          cache_write (start + copied, buffer, 0, BLOCK_SECTOR_SIZE);
+          sectors[n++] = start + copied++;
+          if (n == SYNC_BATCH)
+            {
+              cache_flush_sectors (sectors, n);
+              n = 0;
+            }
+        }
+    }
+  cache_flush_sectors (sectors, n);
+
+  old = inode->data;
+  inode->data.extent_cnt = 1;
+  inode->data.extents[0].start = start;
+  inode->data.extents[0].length = total;
+  journal_write (inode->sector, &inode->data, 0, BLOCK_SECTOR_SIZE);
+  inode_release_sectors (&old);
+  journal_commit ();
+
+  rwlock_release_write (&inode->rw_lock);
+  journal_end ();
+  free (buffer);
+  return true;
+
+ fail:
+  rwlock_release_write (&inode->rw_lock);
+  journal_end ();
+  free (buffer);
+  return false;
+}
+
+/* Compresses the data of INODE, CLUSTER_SIZE bytes at a time, so
+   that it takes fewer sectors on disk and reading it transfers
+   fewer, at the cost of decompressing each cluster as it is
+   read.  A cluster that does not shrink by at least a sector is
+   stored as is.  INODE keeps its compressed form until it is
+   next written.  Returns true if successful, false if INODE is a
+   directory, is inline or already compressed, is too big for
+   CLUSTER_CNT clusters, or if memory or the disk runs out, in
+   which case INODE is left as it was.
+
+   As in inode_defragment(), the compressed data is written back
+   before the inode, and the change is committed before the
+   uncompressed sectors can be reused. */
+bool
+inode_compress (struct inode *inode)
+{
+  struct inode_disk *disk;
+  block_sector_t goal = inode->sector + 1;
+  block_sector_t sectors[CLUSTER_SECTORS];
+  uint8_t *raw, *out;
+  uint16_t *hash;
+  bool success = false;
+  size_t idx, i;
+
+  disk = calloc (1, sizeof *disk);
+  raw = malloc (CLUSTER_SIZE);
+  out = malloc (CLUSTER_SIZE);
+  hash = malloc (LZ_HASH_SIZE * sizeof *hash);
+  if (disk == NULL || raw == NULL || out == NULL || hash == NULL)
+    goto done;
+
+  journal_begin ();
+  rwlock_acquire_write (&inode->rw_lock);
+  pcache_flush_inode (inode);
+  if (inode->removed || inode->sector == FREE_MAP_SECTOR
+      || (inode->data.flags & (INODE_DIR | INODE_INLINE | INODE_COMPRESSED))
+      || inode->data.length > (off_t) (CLUSTER_CNT * CLUSTER_SIZE))
+    goto unlock;
+
+  disk->length = inode->data.length;
+  disk->flags = (inode->data.flags & ~INODE_SHARED) | INODE_COMPRESSED;
+  disk->magic = INODE_MAGIC;
+  for (idx = 0; idx * CLUSTER_SIZE < (size_t) disk->length; idx++)
+    {
+      size_t size = cluster_size (disk->length, idx);
+      size_t raw_sectors = bytes_to_sectors (size);
+      size_t cnt;
+      block_sector_t start;
+      const uint8_t *data;
+
+      for (i = 0; i < raw_sectors; i++)
+        {
+          block_sector_t sector = index_to_sector (&inode->data,
+                                                   idx * CLUSTER_SECTORS + i,
+                                                   NULL, false);
+          if (sector != NO_SECTOR)
+            cache_read (sector, raw + i * BLOCK_SECTOR_SIZE, 0,
+                        BLOCK_SECTOR_SIZE);
+          else
+            memset (raw + i * BLOCK_SECTOR_SIZE, 0, BLOCK_SECTOR_SIZE);
+        }
+
+      cnt = lz_compress (raw, size, out,
+                         (raw_sectors - 1) * BLOCK_SECTOR_SIZE, hash);
+      if (cnt > 0)
+        {
+          memset (out + cnt, 0, ROUND_UP (cnt, BLOCK_SECTOR_SIZE) - cnt);
+          cnt = bytes_to_sectors (cnt);
+          data = out;
+        }
+      else
+        {
+          cnt = raw_sectors;
+          data = raw;
+        }
+
+      if (!free_map_allocate_goal (cnt, goal, &start))
+        {
+          inode_release_sectors (disk);
+          goto unlock;
+        }
+      for (i = 0; i < cnt; i++)
+        {
+          cache_write (start + i, data + i * BLOCK_SECTOR_SIZE, 0,
+                       BLOCK_SECTOR_SIZE);
+          sectors[i] = start + i;
+        }
+      cache_flush_sectors (sectors, cnt);
+      ASSERT (start <= 0x0fffffff);
+      disk->clusters[idx] = start | ((cnt - 1) << 28);
+      goal = start + cnt;
+      journal_restart ();
+    }
+
+  journal_write (inode->sector, disk, 0, BLOCK_SECTOR_SIZE);
+  inode_release_sectors (&inode->data);
+  inode->data = *disk;
+  journal_commit ();
+  lock_acquire (&inode->cluster_lock);
+  inode->cluster_idx = NO_CLUSTER;
+  lock_release (&inode->cluster_lock);
+  success = true;
+
+ unlock:
+  rwlock_release_write (&inode->rw_lock);
+  journal_end ();
+ done:
+  free (hash);
+  free (out);
+  free (raw);
+  free (disk);
+  return success;
+}
+
+/* Adds N bytes to the counter *CNT of an inode and to the
+   total *TOTAL.  Readers share the inode's lock, so the counters
+   get protection of their own. */
+static void
+count_bytes (uint64_t *cnt, uint64_t *total, off_t n)
+{
+  enum intr_level old_level = intr_disable ();
+  *cnt += n;
+  *total += n;
+  intr_set_level (old_level);
+}
+
+/* Stores the numbers of bytes read from and written to INODE
+   into S. */
+void
+inode_get_stats (struct inode *inode, struct fs_stats *s)
+{
+  enum intr_level old_level = intr_disable ();
+  s->read_bytes = inode->read_bytes;
+  s->write_bytes = inode->write_bytes;
+  intr_set_level (old_level);
+}
+
+/* Prints the numbers of bytes read from and written to files. */
+void
+inode_print_stats (void)
+{
+  printf ("Files: %"PRIu64" bytes read, %"PRIu64" bytes written\n",
+          total_read_bytes, total_write_bytes);
+}
+
+/* Disables writes to INODE.
+   May be called at most once per inode opener. */
+void
+inode_deny_write (struct inode *inode) 
+{
+  lock_acquire (&open_inodes_lock);
+  __atomic_store_n (&inode->deny_write_cnt, inode->deny_write_cnt + 1,
+                    __ATOMIC_RELAXED);
+  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  lock_release (&open_inodes_lock);
+}
+
+/* Re-enables writes to INODE.
+   Must be called once by each inode opener who has called
+   inode_deny_write() on the inode, before closing the inode. */
+void
+inode_allow_write (struct inode *inode) 
+{
+  lock_acquire (&open_inodes_lock);
+  ASSERT (inode->deny_write_cnt > 0);
+  ASSERT (inode->deny_write_cnt <= inode->open_cnt);
+  __atomic_store_n (&inode->deny_write_cnt, inode->deny_write_cnt - 1,
+                    __ATOMIC_RELAXED);
+  lock_release (&open_inodes_lock);
+}
+
+/* Returns true if writes to INODE are denied.  Takes no lock:
+   the count is read atomically, and may change as soon as this
+   returns. */
+bool
+inode_write_denied (const struct inode *inode)
+{
+  return __atomic_load_n (&inode->deny_write_cnt, __ATOMIC_RELAXED) > 0;
+}
+
+/* Returns the length, in bytes, of INODE's data.  Takes no lock:
+   the length is read atomically, and data up to it has been
+   written by the time it is seen. */
+off_t
+inode_length (const struct inode *inode)
+{
+  return __atomic_load_n (&inode->data.length, __ATOMIC_ACQUIRE);
+}
+
+/* Acquires INODE's directory lock for writing, which excludes
+   all other lookups and updates of the directory stored in
+   INODE. */
+void
+inode_lock_dir (struct inode *inode)
+{
+  rwlock_acquire_write (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock, held for writing. */
+void
+inode_unlock_dir (struct inode *inode)
+{
+  rwlock_release_write (&inode->dir_lock);
+}
+
+/* Acquires INODE's directory lock for reading, which allows
+   other readers of the directory stored in INODE but no
+   updates. */
+void
+inode_lock_dir_read (struct inode *inode)
+{
+  rwlock_acquire_read (&inode->dir_lock);
+}
+
+/* Releases INODE's directory lock, held for reading. */
+void
+inode_unlock_dir_read (struct inode *inode)
+{
+  rwlock_release_read (&inode->dir_lock);
+}
+
+/* Returns the name index of the directory stored in INODE, or a
+   null pointer if none has been built.  The caller must hold
+   INODE's directory lock, for reading or writing. */
+struct dir_index *
+inode_get_dir_index (struct inode *inode)
+{
+  return inode->dir_index;
+}
+
+/* Sets the name index of the directory stored in INODE to INDEX,
+   which INODE then owns.  The caller must hold INODE's directory
+   lock for writing. */
+void
+inode_set_dir_index (struct inode *inode, struct dir_index *index)
+{
+  ASSERT (rwlock_held_for_write (&inode->dir_lock));
+  inode->dir_index = index;
+}
+
+/* Returns a copy of the executable load plan cached for INODE,
+   which the caller must free(), and stores its size in *SIZE.
+   Returns a null pointer if there is none or if memory cannot
+   be allocated. */
+void *
+inode_get_exec_plan (struct inode *inode, size_t *size)
+{
+  void *plan = NULL;
+
+  lock_acquire (&inode->exec_lock);
+  if (inode->exec_plan != NULL)
+    {
+      plan = malloc (inode->exec_plan_size);
+      if (plan != NULL)
+        {
+          memcpy (plan, inode->exec_plan, inode->exec_plan_size);
+          *size = inode->exec_plan_size;
+        }
+    }
+  lock_release (&inode->exec_lock);
+  return plan;
+}
+
+/* Caches PLAN, SIZE bytes allocated with malloc(), as the load
+   plan of the executable stored in INODE, replacing any previous
+   one.  INODE owns PLAN from then on, and frees it when INODE is
+   next written. */
+void
+inode_set_exec_plan (struct inode *inode, void *plan, size_t size)
+{
+  void *old;
+
+  lock_acquire (&inode->exec_lock);
+  old = inode->exec_plan;
+  inode->exec_plan = plan;
+  inode->exec_plan_size = size;
+  lock_release (&inode->exec_lock);
+  free (old);
+}
+
+/* Returns INODE's tree of cached pages, indexed by offset
+   divided by PGSIZE.  The tree belongs to filesys/pcache.c, which
+   does its own locking. */
+struct radix_tree *
+inode_get_pages (struct inode *inode)
+{
+  return &inode->pages;
+}
+
+/* Returns page IDX of INODE's data, that is, the bytes from
+   offset IDX * PGSIZE on, from the page cache, read in and with
+   a reference taken but not locked, for the virtual memory system
+   to map.  The caller must drop the reference with pcache_put().
+   If FILL is false, only a page already cached is returned.
+   Returns a null pointer if INODE's data does not go through the
+   page cache, if the file ends before page IDX, or if the page
+   is not or cannot be cached. */
+struct pcache_page *
+inode_get_page (struct inode *inode, size_t idx, bool fill)
+{
+  struct pcache_page *pg = NULL;
+
+  rwlock_acquire_read (&inode->rw_lock);
+  if (uses_pcache (inode)
+      && idx < (size_t) DIV_ROUND_UP (inode_length (inode), PGSIZE))
+    pg = (fill
+          ? get_page (inode, idx, false)
+          : pcache_lookup (inode, idx));
+  rwlock_release_read (&inode->rw_lock);
+
+  if (pg != NULL)
+    lock_release (&pg->lock);
+  return pg;
+}
+
+/* Pins INODE's data in the page cache: reads in every page of it
+   and keeps them there, however much else is read, until
+   inode_unpin() is called, and keeps INODE itself open meanwhile,
+   so that it is read and executed without going to disk.  Pages
+   that the file grows by later are cached as usual.  Returns true
+   if successful or if INODE is pinned already.  Returns false,
+   pinning nothing, if INODE's data does not fit in the share of
+   the page cache left for pinned and mapped pages. */
+bool
+inode_pin (struct inode *inode)
+{
+  bool success = true;
+
+  lock_acquire (&pin_lock);
+  if (!inode->pinned)
+    {
+      rwlock_acquire_read (&inode->rw_lock);
+      if (uses_pcache (inode))
+        {
+          size_t cnt = DIV_ROUND_UP (inode_length (inode), PGSIZE);
+          size_t idx;
+
+          for (idx = 0; success && idx < cnt; idx++)
+            {
+              struct pcache_page *pg = get_page (inode, idx, false);
+              success = pg != NULL && pcache_pin (pg);
+              if (pg != NULL)
+                pcache_put (pg);
+            }
+          if (!success)
+            pcache_unpin_inode (inode);
+        }
+      rwlock_release_read (&inode->rw_lock);
+
+      if (success)
+        {
+          inode->pinned = true;
+          inode_reopen (inode);
+        }
+    }
+  lock_release (&pin_lock);
+  return success;
+}
+
+/* Undoes inode_pin() for INODE, if it is pinned. */
+void
+inode_unpin (struct inode *inode)
+{
+  bool pinned;
+
+  lock_acquire (&pin_lock);
+  pinned = inode->pinned;
+  if (pinned)
+    {
+      inode->pinned = false;
+      pcache_unpin_inode (inode);
+    }
+  lock_release (&pin_lock);
+
+  if (pinned)
+    inode_close (inode);
+}
+
+/* Frees INODE's cached load plan, if any. */
+static void
+drop_exec_plan (struct inode *inode)
+{
+  void *plan;
+
+  if (inode->exec_plan == NULL)
+    return;
+  lock_acquire (&inode->exec_lock);
+  plan = inode->exec_plan;
+  inode->exec_plan = NULL;
+  lock_release (&inode->exec_lock);
+  free (plan);
 }
@@ -1,23 +1,66 @@
 #ifndef FILESYS_INODE_H
 #define FILESYS_INODE_H
 
+#include <fs-stats.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
 #include "devices/block.h"
 
 struct bitmap;
+struct dir_index;
+struct inode;
+struct iovec;
+struct pcache_page;
+struct radix_tree;
+
+/* If true, newly created files describe their data with a list
+   of extents instead of a sector index.
+   Controlled by kernel command-line option "-extents". */
+extern bool inode_extents;
 
 void inode_init (void);
-bool inode_create (block_sector_t, off_t);
+bool inode_create (block_sector_t, off_t, bool is_dir);
+bool inode_clone (struct inode *, block_sector_t);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+bool inode_is_removed (const struct inode *);
+bool inode_is_dir (const struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+off_t inode_readv (struct inode *, const struct iovec *, int iovcnt,
+                   off_t offset);
+void inode_read_ahead (struct inode *, off_t start, off_t end);
+void inode_prefetch (struct inode *, size_t first, size_t end);
+off_t inode_readv_direct (struct inode *, const struct iovec *, int iovcnt,
+                          off_t offset);
+off_t inode_writev (struct inode *, const struct iovec *, int iovcnt,
+                    off_t offset);
+bool inode_preallocate (struct inode *, off_t length);
+void inode_sync (struct inode *);
+bool inode_defragment (struct inode *);
+bool inode_compress (struct inode *);
+bool inode_pin (struct inode *);
+void inode_unpin (struct inode *);
+void inode_get_stats (struct inode *, struct fs_stats *);
+void inode_print_stats (void);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
+bool inode_write_denied (const struct inode *);
 off_t inode_length (const struct inode *);
+void inode_lock_dir (struct inode *);
+void inode_unlock_dir (struct inode *);
+void inode_lock_dir_read (struct inode *);
+void inode_unlock_dir_read (struct inode *);
+struct dir_index *inode_get_dir_index (struct inode *);
+void inode_set_dir_index (struct inode *, struct dir_index *);
+void *inode_get_exec_plan (struct inode *, size_t *size);
+void inode_set_exec_plan (struct inode *, void *, size_t size);
+struct radix_tree *inode_get_pages (struct inode *);
+struct pcache_page *inode_get_page (struct inode *, size_t idx,
+                                    bool fill);
 
 #endif /* filesys/inode.h */
@@ -0,0 +1,516 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "devices/rtc.h"
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "threads/synch.h"
+
+/* Metadata journal.
+
+   Inodes, index blocks, directories and the free map are only
+   ever changed between journal_begin() and journal_end(), and
+   through journal_write() rather than cache_write().  The
+   sectors so written make up the running transaction, which
+   collects the changes of every operation since the last commit.
+   Its sectors are pinned in the buffer cache, so none of them can
+   reach its home location on disk before the transaction does.
+
+   Committing writes the current contents of the transaction's
+   sectors to the log, a circular region of the disk, behind a
+   descriptor record that lists their home sectors, and then a
+   commit record with a checksum of both.  Only then are the
+   sectors unpinned, and the cache writes them home in its own
+   time like any other dirty sector.  So many operations are
+   committed with two or three disk writes, instead of each
+   writing all of its sectors home in some order that a crash
+   could cut short.
+
+   When mounting, every transaction in the log whose commit
+   record is intact is written home again, in order, which brings
+   the metadata to the state after the last such commit.
+   Transactions cut short by a crash are ignored.
+
+   Log space is reclaimed by a checkpoint, which flushes the cache
+   so that everything logged so far is home, and then records in
+   the journal's superblock that the log starts afresh at its
+   current end.  That happens only when the log fills up, or
+   before committing a transaction that frees a sector the log
+   holds a copy of: otherwise replay could write old metadata
+   over whatever data the sector holds by then.
+
+   Operations are serialized by journal_lock, which is taken
+   before any other file system lock, so that a transaction
+   never holds half of an operation, except at journal_restart()
+   points where committing what has been done so far at worst
+   leaks a few sectors.  File data itself is not journaled. */
+
+/* Magic numbers. */
+#define SUPER_MAGIC 0x4a524e4c          /* Journal superblock. */
+#define DESC_MAGIC 0x4a444553           /* Descriptor record. */
+#define COMMIT_MAGIC 0x4a434d54         /* Commit record. */
+
+/* Sectors in the journal, starting at JOURNAL_SECTOR: the
+   superblock, then the log. */
+#define JOURNAL_SECTORS 128
+#define LOG_CNT (JOURNAL_SECTORS - 1)
+
+/* Disks smaller than this many sectors get no journal. */
+#define JOURNAL_MIN_DISK (8 * JOURNAL_SECTORS)
+
+/* Most sectors in one transaction.  Each is pinned in the buffer
+   cache until committed, so this must stay well below
+   CACHE_SIZE. */
+#define TXN_MAX 32
+
+/* An operation that starts, or a long one that reaches a
+   journal_restart() point, with fewer than this many free slots
+   in the running transaction commits it first. */
+#define TXN_RESERVE 12
+
+/* Number of home sectors a record can list. */
+#define RECORD_SECTORS ((BLOCK_SECTOR_SIZE - 4 * sizeof (uint32_t)) \
+                        / sizeof (block_sector_t))
+
+/* Journal superblock, in sector JOURNAL_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_super
+  {
+    uint32_t magic;                     /* SUPER_MAGIC. */
+    uint32_t tail;                      /* Log position to replay from. */
+    uint32_t seq;                       /* Sequence number there. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 3 * sizeof (uint32_t)];
+  };
+
+/* A descriptor or commit record in the log.  A transaction
+   occupies CNT + 2 consecutive log positions: a descriptor
+   listing the CNT home sectors, a copy of each, and a commit
+   record whose checksum covers the descriptor and the copies.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_record
+  {
+    uint32_t magic;                     /* DESC_MAGIC or COMMIT_MAGIC. */
+    uint32_t seq;                       /* Transaction's sequence number. */
+    uint32_t cnt;                       /* Number of sectors logged. */
+    uint32_t checksum;                  /* Commit record only. */
+    block_sector_t sectors[RECORD_SECTORS]; /* Descriptor only. */
+  };
+
+/* A sector in the running transaction. */
+struct txn_sector
+  {
+    block_sector_t sector;              /* Sector number. */
+    bool released;                      /* Freed since written? */
+  };
+
+/* A sector with a copy in the log. */
+struct logged_sector
+  {
+    block_sector_t sector;              /* Sector number. */
+    uint32_t pos;                       /* Log position of latest copy. */
+  };
+
+/* True if the file system has a journal. */
+static bool enabled;
+
+/* Serializes operations.  Its holder has called journal_begin()
+   DEPTH times more than journal_end(). */
+static struct lock journal_lock;
+static int depth;
+
+/* The running transaction.  `txn_checkpoint' is set if it frees
+   a sector that has a copy in the log. */
+static struct txn_sector txn[TXN_MAX];
+static size_t txn_cnt;
+static bool txn_checkpoint;
+
+/* The log, as positions that count up from the last checkpoint
+   and wrap around the LOG_CNT sectors of the region.  Positions
+   TAIL to HEAD hold transactions committed since the last
+   checkpoint, and SEQ is the next transaction's sequence
+   number. */
+static uint32_t head, tail;
+static uint32_t seq;
+static struct logged_sector logged[LOG_CNT];
+static size_t logged_cnt;
+
+/* A descriptor followed by the copies it describes, as staged
+   for commit and for replay. */
+static uint8_t staging[(TXN_MAX + 1) * BLOCK_SECTOR_SIZE];
+static struct journal_record record;
+
+static block_sector_t log_sector (uint32_t pos);
+static void write_log (uint32_t pos, const uint8_t *buffer, size_t cnt);
+static void write_super (void);
+static void recover (void);
+static struct txn_sector *txn_find (block_sector_t);
+static void commit (void);
+static void checkpoint (void);
+
+/* Initializes the journal module.  Until journal_create() or
+   journal_open() finds a journal, metadata writes go straight to
+   the buffer cache. */
+void
+journal_init (void)
+{
+  lock_init (&journal_lock);
+  enabled = false;
+}
+
+/* Returns the number of sectors, starting at JOURNAL_SECTOR,
+   that the journal occupies on a newly formatted file system
+   device, which is 0 if the device is too small to spare them. */
+size_t
+journal_sector_cnt (void)
+{
+  return block_size (fs_device) >= JOURNAL_MIN_DISK ? JOURNAL_SECTORS : 0;
+}
+
+/* Creates an empty journal on a newly formatted file system. */
+void
+journal_create (void)
+{
+  static uint8_t zeros[BLOCK_SECTOR_SIZE];
+
+  if (journal_sector_cnt () == 0)
+    return;
+
+  /* Start from a sequence number unlike any used by a file
+     system formatted earlier on the device, and clear the first
+     log sector, so that nothing left in the log looks like a
+     current transaction. */
+  head = tail = 0;
+  seq = rtc_get_time ();
+  logged_cnt = 0;
+  block_write (fs_device, log_sector (0), zeros);
+  write_super ();
+  enabled = true;
+}
+
+/* Opens the journal of an existing file system, if it has one,
+   and replays the transactions committed to it. */
+void
+journal_open (void)
+{
+  struct journal_super *super = (struct journal_super *) staging;
+
+  ASSERT (sizeof *super == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof record == BLOCK_SECTOR_SIZE);
+
+  if (journal_sector_cnt () == 0)
+    return;
+  block_read (fs_device, JOURNAL_SECTOR, super);
+  if (super->magic != SUPER_MAGIC)
+    return;
+
+  head = tail = super->tail % LOG_CNT;
+  seq = super->seq;
+  logged_cnt = 0;
+  recover ();
+  write_super ();
+  enabled = true;
+}
+
+/* Commits the running transaction and checkpoints the log, so
+   that the journal is empty.  Called when the file system is
+   shut down. */
+void
+journal_done (void)
+{
+  if (!enabled)
+    return;
+  journal_begin ();
+  commit ();
+  checkpoint ();
+  journal_end ();
+}
+
+/* Begins an operation that changes metadata.  Calls may nest;
+   the operation ends with the matching journal_end().  Must be
+   called before taking any other file system lock. */
+void
+journal_begin (void)
+{
+  if (lock_held_by_current_thread (&journal_lock))
+    depth++;
+  else
+    {
+      lock_acquire (&journal_lock);
+      depth = 1;
+      if (txn_cnt > TXN_MAX - TXN_RESERVE)
+        commit ();
+    }
+}
+
+/* Ends an operation begun with journal_begin().  Its changes
+   become durable at the next commit. */
+void
+journal_end (void)
+{
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  if (--depth == 0)
+    lock_release (&journal_lock);
+}
+
+/* Called by long operations at points where the metadata written
+   so far may be committed on its own without making the file
+   system inconsistent.  Commits the running transaction if it is
+   nearly full. */
+void
+journal_restart (void)
+{
+  ASSERT (!enabled || lock_held_by_current_thread (&journal_lock));
+  if (txn_cnt > TXN_MAX - TXN_RESERVE)
+    commit ();
+}
+
+/* Writes SIZE bytes from BUFFER into metadata sector SECTOR
+   starting at byte OFS, as part of the running transaction. */
+void
+journal_write (block_sector_t sector, const void *buffer, int ofs, int size)
+{
+  struct txn_sector *t;
+
+  if (!enabled)
+    {
+      cache_write (sector, buffer, ofs, size);
+      return;
+    }
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+
+  t = txn_find (sector);
+  if (t == NULL)
+    {
+      /* A single operation has overrun the transaction.  Commit
+         it half done, which beats running the cache out of
+         unpinned entries. */
+      if (txn_cnt >= TXN_MAX)
+        commit ();
+      t = &txn[txn_cnt++];
+      t->sector = sector;
+    }
+  t->released = false;
+  cache_write_pinned (sector, buffer, ofs, size);
+}
+
+/* Notes that the CNT sectors starting at SECTOR have been freed.
+   Their contents no longer matter, so sectors of the running
+   transaction among them need not be logged. */
+void
+journal_release (block_sector_t sector, size_t cnt)
+{
+  size_t i;
+
+  if (!enabled)
+    return;
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+
+  for (i = 0; i < txn_cnt; i++)
+    if (txn[i].sector >= sector && txn[i].sector - sector < cnt)
+      txn[i].released = true;
+  for (i = 0; i < logged_cnt; i++)
+    if (logged[i].sector >= sector && logged[i].sector - sector < cnt)
+      txn_checkpoint = true;
+}
+
+/* Commits the running transaction.  The write-behind thread
+   calls this periodically, so that an operation is durable
+   within a few seconds of its end. */
+void
+journal_commit (void)
+{
+  if (!enabled)
+    return;
+  journal_begin ();
+  commit ();
+  journal_end ();
+}
+
+/* Makes every change made through the journal so far durable, by
+   committing the running transaction.  Without a journal, where
+   metadata goes straight to the buffer cache, writes back the
+   whole cache instead. */
+void
+journal_sync (void)
+{
+  if (enabled)
+    journal_commit ();
+  else
+    cache_flush ();
+}
+
+/* Returns the sector holding log position POS. */
+static block_sector_t
+log_sector (uint32_t pos)
+{
+  return JOURNAL_SECTOR + 1 + pos % LOG_CNT;
+}
+
+/* Writes the CNT sectors in BUFFER to the log at positions from
+   POS on, wrapping around the end of the log region. */
+static void
+write_log (uint32_t pos, const uint8_t *buffer, size_t cnt)
+{
+  while (cnt > 0)
+    {
+      size_t n = LOG_CNT - pos % LOG_CNT;
+      if (n > cnt)
+        n = cnt;
+      block_write_multiple (fs_device, log_sector (pos), n, buffer);
+      pos += n;
+      buffer += n * BLOCK_SECTOR_SIZE;
+      cnt -= n;
+    }
+}
+
+/* Writes the superblock, recording that the log starts at
+   position TAIL with sequence number SEQ. */
+static void
+write_super (void)
+{
+  struct journal_super *super = (struct journal_super *) &record;
+
+  memset (super, 0, sizeof *super);
+  super->magic = SUPER_MAGIC;
+  super->tail = tail % LOG_CNT;
+  super->seq = seq;
+  block_write (fs_device, JOURNAL_SECTOR, super);
+}
+
+/* Writes every intact transaction in the log from TAIL on to
+   its home sectors, and advances HEAD and TAIL past them. */
+static void
+recover (void)
+{
+  struct journal_record *desc = (struct journal_record *) staging;
+  uint32_t i;
+
+  for (;;)
+    {
+      block_read (fs_device, log_sector (head), desc);
+      if (desc->magic != DESC_MAGIC || desc->seq != seq
+          || desc->cnt > TXN_MAX)
+        break;
+      for (i = 0; i < desc->cnt; i++)
+        block_read (fs_device, log_sector (head + 1 + i),
+                    staging + (i + 1) * BLOCK_SECTOR_SIZE);
+      block_read (fs_device, log_sector (head + 1 + desc->cnt), &record);
+      if (record.magic != COMMIT_MAGIC || record.seq != seq
+          || record.cnt != desc->cnt
+          || record.checksum != hash_bytes (staging, (desc->cnt + 1)
+                                                     * BLOCK_SECTOR_SIZE))
+        break;
+
+      for (i = 0; i < desc->cnt; i++)
+        block_write (fs_device, desc->sectors[i],
+                     staging + (i + 1) * BLOCK_SECTOR_SIZE);
+      head += desc->cnt + 2;
+      seq++;
+    }
+  tail = head;
+}
+
+/* Returns the running transaction's entry for SECTOR, or a null
+   pointer if it has not written SECTOR. */
+static struct txn_sector *
+txn_find (block_sector_t sector)
+{
+  size_t i;
+
+  for (i = 0; i < txn_cnt; i++)
+    if (txn[i].sector == sector)
+      return &txn[i];
+  return NULL;
+}
+
+/* Writes the running transaction to the log and unpins its
+   sectors.  journal_lock must be held. */
+static void
+commit (void)
+{
+  struct journal_record *desc = (struct journal_record *) staging;
+  size_t cnt = 0;
+  size_t i, j;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  if (txn_cnt == 0)
+    return;
+
+  for (i = 0; i < txn_cnt; i++)
+    if (!txn[i].released)
+      cnt++;
+  if (txn_checkpoint || head - tail + cnt + 2 > LOG_CNT)
+    checkpoint ();
+
+  if (cnt > 0)
+    {
+      /* Stage the descriptor and copies, and log them before the
+         commit record that makes them count. */
+      memset (desc, 0, sizeof *desc);
+      desc->magic = DESC_MAGIC;
+      desc->seq = seq;
+      desc->cnt = cnt;
+      for (i = j = 0; i < txn_cnt; i++)
+        if (!txn[i].released)
+          {
+            desc->sectors[j++] = txn[i].sector;
+            cache_read (txn[i].sector, staging + j * BLOCK_SECTOR_SIZE,
+                        0, BLOCK_SECTOR_SIZE);
+          }
+      write_log (head, staging, cnt + 1);
+
+      memset (&record, 0, sizeof record);
+      record.magic = COMMIT_MAGIC;
+      record.seq = seq;
+      record.cnt = cnt;
+      record.checksum = hash_bytes (staging, (cnt + 1) * BLOCK_SECTOR_SIZE);
+      block_write (fs_device, log_sector (head + cnt + 1), &record);
+
+      /* Remember where the latest copy of each sector is. */
+      for (i = 0; i < cnt; i++)
+        {
+          uint32_t pos = head + 1 + i;
+
+          for (j = 0; j < logged_cnt; j++)
+            if (logged[j].sector == desc->sectors[i])
+              break;
+          if (j == logged_cnt)
+            logged[logged_cnt++].sector = desc->sectors[i];
+          logged[j].pos = pos;
+        }
+      head += cnt + 2;
+      seq++;
+    }
+
+  for (i = 0; i < txn_cnt; i++)
+    cache_unpin (txn[i].sector);
+  txn_cnt = 0;
+}
+
+/* Makes every committed change reach its home sector, then
+   empties the log.  Sectors of the running transaction are
+   pinned with changes that are not committed yet, so those that
+   also have a committed copy in the log are written home from
+   there instead.  journal_lock must be held. */
+static void
+checkpoint (void)
+{
+  size_t i;
+
+  for (i = 0; i < logged_cnt; i++)
+    if (txn_find (logged[i].sector) != NULL)
+      {
+        block_read (fs_device, log_sector (logged[i].pos), staging);
+        block_write (fs_device, logged[i].sector, staging);
+      }
+  cache_flush ();
+
+  head %= LOG_CNT;
+  tail = head;
+  logged_cnt = 0;
+  txn_checkpoint = false;
+  write_super ();
+}
@@ -0,0 +1,21 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+void journal_init (void);
+size_t journal_sector_cnt (void);
+void journal_create (void);
+void journal_open (void);
+void journal_done (void);
+
+void journal_begin (void);
+void journal_end (void);
+void journal_restart (void);
+void journal_write (block_sector_t, const void *buffer, int ofs, int size);
+void journal_release (block_sector_t, size_t cnt);
+void journal_commit (void);
+void journal_sync (void);
+
+#endif /* filesys/journal.h */
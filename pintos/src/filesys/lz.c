@@ -0,0 +1,149 @@
+#include "filesys/lz.h"
+#include <debug.h>
+#include <string.h>
+
+/* LZ compression, in the style of LZSS, for compressed files.
+
+   The compressed data is a sequence of groups, each a control
+   byte followed by up to 8 items.  Bit I of the control byte,
+   counting from the least significant, tells whether item I is a
+   literal, one byte copied to the output as is, or a match, two
+   bytes that say to copy LENGTH bytes starting DISTANCE bytes
+   back in the output produced so far.  A match packs DISTANCE - 1
+   into 12 bits, low 8 bits first, and LENGTH - LZ_MIN_MATCH into
+   the 4 bits left, so DISTANCE may be up to LZ_WINDOW and LENGTH
+   up to LZ_MAX_MATCH.  A match may overlap the bytes it
+   produces, so a run of one repeated byte costs two bytes per
+   LZ_MAX_MATCH.
+
+   The compressor finds matches through a hash table of the last
+   position at which each 3-byte sequence was seen, which keeps
+   it to one probe per input byte at some cost in ratio.  Text,
+   such as log files, typically shrinks to half or less. */
+
+/* Shortest and longest matches. */
+#define LZ_MIN_MATCH 3
+#define LZ_MAX_MATCH (LZ_MIN_MATCH + 15)
+
+/* Empty hash table entry. */
+#define NO_POS UINT16_MAX
+
+/* Returns the hash of the LZ_MIN_MATCH bytes at P. */
+static inline unsigned
+hash3 (const uint8_t *p)
+{
+  unsigned x = (p[0] << 16) | (p[1] << 8) | p[2];
+  return ((x * 2654435761u) >> 20) & (LZ_HASH_SIZE - 1);
+}
+
+/* Compresses the SIZE bytes at IN, which must be at most
+   LZ_WINDOW, into OUT, using HASH as scratch space.  Returns the
+   number of bytes of compressed data, or 0 if it would be longer
+   than CAP bytes. */
+size_t
+lz_compress (const uint8_t *in, size_t size, uint8_t *out, size_t cap,
+             uint16_t hash[LZ_HASH_SIZE])
+{
+  size_t ctrl = 0;
+  size_t pos = 0;
+  size_t o = 0;
+  int bit = 8;
+
+  ASSERT (size <= LZ_WINDOW);
+
+  memset (hash, 0xff, LZ_HASH_SIZE * sizeof *hash);
+  while (pos < size)
+    {
+      size_t len = 0;
+      size_t cand = 0;
+
+      if (bit == 8)
+        {
+          if (o >= cap)
+            return 0;
+          ctrl = o++;
+          out[ctrl] = 0;
+          bit = 0;
+        }
+
+      if (pos + LZ_MIN_MATCH <= size)
+        {
+          unsigned h = hash3 (in + pos);
+          size_t max = size - pos < LZ_MAX_MATCH ? size - pos : LZ_MAX_MATCH;
+
+          if (hash[h] != NO_POS)
+            {
+              cand = hash[h];
+              while (len < max && in[cand + len] == in[pos + len])
+                len++;
+            }
+          hash[h] = pos;
+        }
+
+      if (len >= LZ_MIN_MATCH)
+        {
+          size_t dist = pos - cand - 1;
+          size_t i;
+
+          if (o + 2 > cap)
+            return 0;
+          out[o++] = dist & 0xff;
+          out[o++] = ((dist >> 8) << 4) | (len - LZ_MIN_MATCH);
+          out[ctrl] |= 1 << bit;
+          for (i = pos + 1; i < pos + len && i + LZ_MIN_MATCH <= size; i++)
+            hash[hash3 (in + i)] = i;
+          pos += len;
+        }
+      else
+        {
+          if (o >= cap)
+            return 0;
+          out[o++] = in[pos++];
+        }
+      bit++;
+    }
+  return o;
+}
+
+/* Decompresses data produced by lz_compress() from the IN_SIZE
+   bytes at IN into the SIZE bytes at OUT, stopping once OUT is
+   full, so that IN may have padding after its end.  Returns
+   false if IN ends too soon or is not valid compressed data. */
+bool
+lz_decompress (const uint8_t *in, size_t in_size, uint8_t *out, size_t size)
+{
+  size_t i = 0;
+  size_t o = 0;
+
+  while (o < size)
+    {
+      unsigned ctrl;
+      int bit;
+
+      if (i >= in_size)
+        return false;
+      ctrl = in[i++];
+      for (bit = 0; bit < 8 && o < size; bit++)
+        if (ctrl & (1u << bit))
+          {
+            size_t dist, len;
+
+            if (i + 2 > in_size)
+              return false;
+            dist = (in[i] | ((in[i + 1] >> 4) << 8)) + 1;
+            len = (in[i + 1] & 0xf) + LZ_MIN_MATCH;
+            i += 2;
+            if (dist > o || len > size - o)
+              return false;
+            for (; len > 0; len--, o++)
+              out[o] = out[o - dist];
+          }
+        else
+          {
+            if (i >= in_size)
+              return false;
+            out[o++] = in[i++];
+          }
+    }
+  return true;
+}
@@ -0,0 +1,20 @@
+#ifndef FILESYS_LZ_H
+#define FILESYS_LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Largest input lz_compress() accepts, which is also how far back
+   a match can reach. */
+#define LZ_WINDOW 4096
+
+/* Number of entries in the hash table lz_compress() works in. */
+#define LZ_HASH_SIZE 4096
+
+size_t lz_compress (const uint8_t *in, size_t size, uint8_t *out,
+                    size_t cap, uint16_t hash[LZ_HASH_SIZE]);
+bool lz_decompress (const uint8_t *in, size_t in_size, uint8_t *out,
+                    size_t size);
+
+#endif /* filesys/lz.h */
@@ -0,0 +1,614 @@
+#include "filesys/pcache.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <radix.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/ghost.h"
+#include "filesys/inode.h"
+#include "threads/palloc.h"
+#include "threads/workqueue.h"
+
+/* Milliseconds between write-behind passes. */
+#define WRITE_BEHIND_MS 1000
+
+/* Dirty pages at which write-back starts in the background, and
+   at which writers are made to write back before going on, as
+   for the buffer cache. */
+#define DIRTY_LOW (PCACHE_SIZE / 4)
+#define DIRTY_HIGH (PCACHE_SIZE / 2)
+
+/* Most pages on probation before eviction takes them in
+   preference to protected ones, and number of pages evicted from
+   probation that are remembered, as for the buffer cache. */
+#define COLD_MAX (PCACHE_SIZE / 4)
+#define GHOST_CNT (PCACHE_SIZE / 2)
+
+/* Tag marking dirty pages in an inode's tree of pages. */
+#define TAG_DIRTY 0
+
+/* Page cache statistics, counted in pages since boot. */
+struct pcache_stats
+  {
+    uint64_t hit_cnt;           /* Lookups that found the page. */
+    uint64_t miss_cnt;          /* Lookups that had to read it in. */
+    uint64_t evict_cnt;         /* Pages pushed out of the cache. */
+    uint64_t writeback_cnt;     /* Dirty pages written to disk. */
+  };
+
+/* The cache itself.
+   pcache_lock protects each page's `inode', `index', `ref_cnt',
+   `accessed', `hot', `pinned' and `dirty' members, the inodes'
+   trees of pages, the clock hand, the counts, the ghost list, and
+   the statistics.  A thread holding a
+   page's lock may acquire pcache_lock, but a thread holding
+   pcache_lock only ever tries to acquire a page's lock, and then
+   only for a page that nobody holds a reference to.
+
+   Pages are replaced by 2Q, as sectors are in the buffer cache,
+   so that reading a large file once does not push out the pages
+   of files in constant use.  Pages of pinned files are kept by a
+   reference of their own and not replaced at all. */
+static struct pcache_page cache[PCACHE_SIZE];
+static struct lock pcache_lock;
+static size_t clock_hand;
+static size_t dirty_cnt;        /* Pages with `dirty' set. */
+static size_t mapped_cnt;       /* Pages mapped by pcache_map(). */
+static size_t pinned_cnt;       /* Pages with `pinned' set. */
+static size_t cold_cnt;         /* Cached pages on probation. */
+static struct ghost_list ghosts;
+static uint64_t ghost_keys[GHOST_CNT];
+static struct pcache_stats stats;
+
+/* Broadcast when a page's last reference is dropped. */
+static struct condition page_released;
+
+/* Deferred work for write-behind and for write-back past
+   DIRTY_LOW. */
+static struct work flush_work;
+static struct work write_back_work;
+
+static struct pcache_page *pcache_evict (void);
+static bool may_evict (struct pcache_page *, size_t scanned);
+static uint64_t page_key (struct inode *, size_t index);
+static void discard (struct pcache_page *, bool write);
+static void write_page (struct pcache_page *);
+static void mark_clean (struct pcache_page *);
+static void flush_pages (struct pcache_page *[], size_t cnt);
+static work_func flush_behind;
+static work_func write_back;
+
+/* Initializes the page cache, taking its pages from the kernel
+   pool, and starts its periodic write-behind. */
+void
+pcache_init (void)
+{
+  uint8_t *data = palloc_get_multiple (PAL_ASSERT, PCACHE_SIZE);
+  size_t i;
+
+  lock_init (&pcache_lock);
+  cond_init (&page_released);
+  ghost_init (&ghosts, ghost_keys, GHOST_CNT);
+  for (i = 0; i < PCACHE_SIZE; i++)
+    {
+      struct pcache_page *pg = &cache[i];
+
+      pg->inode = NULL;
+      pg->ref_cnt = 0;
+      pg->accessed = false;
+      pg->hot = false;
+      pg->pinned = false;
+      pg->dirty = false;
+      lock_init (&pg->lock);
+      pg->valid = false;
+      pg->data = data + i * PGSIZE;
+      pg->frame = NULL;
+    }
+
+  work_init (&flush_work, WORK_NORMAL);
+  work_init (&write_back_work, WORK_NORMAL);
+  work_queue_delayed (&flush_work, WRITE_BEHIND_MS * TIMER_FREQ / 1000,
+                      flush_behind, NULL);
+}
+
+/* Writes every dirty page back to the buffer cache.  Called when
+   the file system is shut down, before cache_done(). */
+void
+pcache_done (void)
+{
+  work_cancel (&flush_work);
+  work_cancel (&write_back_work);
+  pcache_flush ();
+}
+
+/* Returns page INDEX of INODE, that is, the bytes of INODE from
+   offset INDEX * PGSIZE on, with a reference taken and its lock
+   held.  If the page was not cached, its `valid' member is false
+   and the caller must read it in, or leave it for the next user
+   to; otherwise, a page that is not cached displaces one that
+   nobody holds a reference to, waiting for one if there is
+   none.  Returns a null pointer if memory
+   for INODE's tree of pages cannot be allocated, in which case
+   the page is not cached at all.
+
+   The caller should hold INODE's lock, so that the file does not
+   change shape underneath it. */
+struct pcache_page *
+pcache_get (struct inode *inode, size_t index)
+{
+  struct radix_tree *tree = inode_get_pages (inode);
+  struct pcache_page *pg;
+
+  lock_acquire (&pcache_lock);
+  for (;;)
+    {
+      pg = radix_lookup (tree, index);
+      if (pg != NULL)
+        {
+          stats.hit_cnt++;
+          pg->ref_cnt++;
+          pg->accessed = true;
+          lock_release (&pcache_lock);
+          lock_acquire (&pg->lock);
+          return pg;
+        }
+
+      pg = pcache_evict ();
+      if (pg != NULL)
+        break;
+      cond_wait (&page_released, &pcache_lock);
+    }
+
+  if (!radix_insert (tree, index, pg))
+    {
+      lock_release (&pg->lock);
+      lock_release (&pcache_lock);
+      return NULL;
+    }
+  stats.miss_cnt++;
+  pg->inode = inode;
+  pg->index = index;
+  pg->ref_cnt = 1;
+  pg->accessed = true;
+  pg->hot = ghost_remove (&ghosts, page_key (inode, index));
+  if (!pg->hot)
+    cold_cnt++;
+  lock_release (&pcache_lock);
+  return pg;
+}
+
+/* Returns page INDEX of INODE, with a reference taken and its
+   lock held, if it is cached and has been read in.  Returns a
+   null pointer otherwise, without caching it. */
+struct pcache_page *
+pcache_lookup (struct inode *inode, size_t index)
+{
+  struct pcache_page *pg;
+
+  lock_acquire (&pcache_lock);
+  pg = radix_lookup (inode_get_pages (inode), index);
+  if (pg != NULL)
+    {
+      stats.hit_cnt++;
+      pg->ref_cnt++;
+      pg->accessed = true;
+    }
+  lock_release (&pcache_lock);
+
+  if (pg != NULL)
+    {
+      lock_acquire (&pg->lock);
+      if (!pg->valid)
+        {
+          pcache_put (pg);
+          pg = NULL;
+        }
+    }
+  return pg;
+}
+
+/* Returns true if page INDEX of INODE is cached, at the moment
+   of the call. */
+bool
+pcache_contains (struct inode *inode, size_t index)
+{
+  bool found;
+
+  lock_acquire (&pcache_lock);
+  found = radix_lookup (inode_get_pages (inode), index) != NULL;
+  lock_release (&pcache_lock);
+  return found;
+}
+
+/* Releases PG's lock, if the caller holds it, and drops a
+   reference to PG. */
+void
+pcache_put (struct pcache_page *pg)
+{
+  if (lock_held_by_current_thread (&pg->lock))
+    lock_release (&pg->lock);
+
+  lock_acquire (&pcache_lock);
+  ASSERT (pg->ref_cnt > 0);
+  if (--pg->ref_cnt == 0)
+    cond_broadcast (&page_released, &pcache_lock);
+  lock_release (&pcache_lock);
+}
+
+/* Marks PG, whose lock must be held, as dirty.  The caller must
+   have recorded in PG's `sectors' where the bytes it changed go
+   on disk. */
+void
+pcache_mark_dirty (struct pcache_page *pg)
+{
+  ASSERT (lock_held_by_current_thread (&pg->lock));
+  ASSERT (pg->valid);
+
+  lock_acquire (&pcache_lock);
+  if (!pg->dirty)
+    {
+      pg->dirty = true;
+      radix_tag_set (inode_get_pages (pg->inode), pg->index, TAG_DIRTY);
+      dirty_cnt++;
+    }
+  lock_release (&pcache_lock);
+}
+
+/* Called after a write dirties the cache, holding no page's
+   lock.  Past DIRTY_LOW dirty pages, queues write-back in the
+   background; past DIRTY_HIGH, writes them back before
+   returning. */
+void
+pcache_throttle (void)
+{
+  size_t cnt;
+
+  lock_acquire (&pcache_lock);
+  cnt = dirty_cnt;
+  lock_release (&pcache_lock);
+
+  if (cnt >= DIRTY_HIGH)
+    pcache_flush ();
+  else if (cnt >= DIRTY_LOW)
+    work_queue (&write_back_work, write_back, NULL);
+}
+
+/* Counts PG, to which the caller holds a reference, as mapped
+   into a user address space, and returns true, unless
+   PCACHE_MAP_MAX pages are mapped or pinned already, in which
+   case returns false.  Mapped pages keep a reference for as long
+   as they are mapped, so they are never evicted; the limit leaves
+   pages for read() and write(). */
+bool
+pcache_map (struct pcache_page *pg)
+{
+  bool success;
+
+  lock_acquire (&pcache_lock);
+  ASSERT (pg->ref_cnt > 0);
+  success = mapped_cnt + pinned_cnt < PCACHE_MAP_MAX;
+  if (success)
+    mapped_cnt++;
+  lock_release (&pcache_lock);
+  return success;
+}
+
+/* Undoes pcache_map() for PG. */
+void
+pcache_unmap (struct pcache_page *pg UNUSED)
+{
+  lock_acquire (&pcache_lock);
+  ASSERT (mapped_cnt > 0);
+  mapped_cnt--;
+  lock_release (&pcache_lock);
+}
+
+/* Pins PG, to which the caller holds a reference, in the cache,
+   by taking another reference that pcache_unpin_inode() drops,
+   and returns true.  Returns false if PCACHE_MAP_MAX pages are
+   mapped or pinned already.  A pinned page may still be written
+   and written back. */
+bool
+pcache_pin (struct pcache_page *pg)
+{
+  bool success = true;
+
+  lock_acquire (&pcache_lock);
+  ASSERT (pg->ref_cnt > 0);
+  if (!pg->pinned)
+    {
+      success = mapped_cnt + pinned_cnt < PCACHE_MAP_MAX;
+      if (success)
+        {
+          pg->pinned = true;
+          pg->ref_cnt++;
+          pinned_cnt++;
+        }
+    }
+  lock_release (&pcache_lock);
+  return success;
+}
+
+/* Unpins all of INODE's pinned pages, so that they may be
+   evicted again. */
+void
+pcache_unpin_inode (struct inode *inode)
+{
+  struct pcache_page *found[PCACHE_SIZE];
+  size_t cnt, i;
+
+  lock_acquire (&pcache_lock);
+  cnt = radix_gang_lookup (inode_get_pages (inode), 0, (void **) found,
+                           PCACHE_SIZE);
+  for (i = 0; i < cnt; i++)
+    if (found[i]->pinned)
+      {
+        found[i]->pinned = false;
+        pinned_cnt--;
+        if (--found[i]->ref_cnt == 0)
+          cond_broadcast (&page_released, &pcache_lock);
+      }
+  lock_release (&pcache_lock);
+}
+
+/* Writes every dirty page back. */
+void
+pcache_flush (void)
+{
+  struct pcache_page *dirty[PCACHE_SIZE];
+  size_t cnt = 0;
+  size_t i;
+
+  lock_acquire (&pcache_lock);
+  for (i = 0; i < PCACHE_SIZE; i++)
+    if (cache[i].dirty)
+      {
+        cache[i].ref_cnt++;
+        dirty[cnt++] = &cache[i];
+      }
+  lock_release (&pcache_lock);
+
+  flush_pages (dirty, cnt);
+}
+
+/* Writes INODE's dirty pages back.  Only the pages tagged dirty
+   in INODE's tree are looked at. */
+void
+pcache_flush_inode (struct inode *inode)
+{
+  struct pcache_page *dirty[PCACHE_SIZE];
+  size_t cnt;
+  size_t i;
+
+  lock_acquire (&pcache_lock);
+  cnt = radix_gang_lookup_tag (inode_get_pages (inode), 0, TAG_DIRTY,
+                               (void **) dirty, PCACHE_SIZE);
+  for (i = 0; i < cnt; i++)
+    dirty[i]->ref_cnt++;
+  lock_release (&pcache_lock);
+
+  flush_pages (dirty, cnt);
+}
+
+/* Removes all of INODE's pages from the cache, first writing
+   back the dirty ones if WRITE_BACK is true, or discarding them
+   otherwise, as for a removed file.  Waits for their references
+   to be dropped.  Called when INODE is about to be freed. */
+void
+pcache_drop_inode (struct inode *inode, bool write_back)
+{
+  struct radix_tree *tree = inode_get_pages (inode);
+
+  if (write_back)
+    pcache_flush_inode (inode);
+
+  lock_acquire (&pcache_lock);
+  for (;;)
+    {
+      struct pcache_page *found[PCACHE_SIZE];
+      size_t cnt = radix_gang_lookup (tree, 0, (void **) found,
+                                      PCACHE_SIZE);
+      bool busy = false;
+      size_t i;
+
+      if (cnt == 0)
+        break;
+      for (i = 0; i < cnt; i++)
+        {
+          struct pcache_page *pg = found[i];
+
+          if (pg->ref_cnt > 0 || !lock_try_acquire (&pg->lock))
+            busy = true;
+          else
+            {
+              discard (pg, write_back);
+              lock_release (&pg->lock);
+            }
+        }
+      if (busy)
+        cond_wait (&page_released, &pcache_lock);
+    }
+  lock_release (&pcache_lock);
+}
+
+/* Prints the page cache's statistics. */
+void
+pcache_print_stats (void)
+{
+  printf ("Page cache: %"PRIu64" hits, %"PRIu64" misses, "
+          "%"PRIu64" evictions, %"PRIu64" write-backs\n",
+          stats.hit_cnt, stats.miss_cnt, stats.evict_cnt,
+          stats.writeback_cnt);
+}
+
+/* Picks a page to reuse as may_evict() decides, among the pages
+   that nobody holds a reference to, writes it back if it is
+   dirty, and removes it from its inode's tree.  Returns it with
+   its lock held, or a null pointer if every page is in use.
+   pcache_lock must be held. */
+static struct pcache_page *
+pcache_evict (void)
+{
+  size_t n;
+
+  for (n = 0; n < 3 * PCACHE_SIZE; n++)
+    {
+      struct pcache_page *pg = &cache[clock_hand];
+
+      clock_hand = (clock_hand + 1) % PCACHE_SIZE;
+      if (pg->ref_cnt > 0)
+        continue;
+      if (pg->inode != NULL && !may_evict (pg, n))
+        continue;
+      if (!lock_try_acquire (&pg->lock))
+        continue;
+
+      if (pg->inode != NULL)
+        {
+          stats.evict_cnt++;
+          if (!pg->hot)
+            ghost_add (&ghosts, page_key (pg->inode, pg->index));
+          discard (pg, true);
+        }
+      return pg;
+    }
+  return NULL;
+}
+
+/* Returns true if the clock hand, on the SCANNED'th step of its
+   search, may take PG, a cached page that nobody holds a
+   reference to.  While probation is over COLD_MAX, the first
+   sweep takes only probation pages; otherwise the first two
+   sweeps take only protected pages not accessed since the hand
+   last passed them, clearing the accessed bits of the others.
+   Later sweeps take either kind.  pcache_lock must be held. */
+static bool
+may_evict (struct pcache_page *pg, size_t scanned)
+{
+  size_t sweep = scanned / PCACHE_SIZE;
+  bool cold_first = cold_cnt > COLD_MAX;
+
+  if (!pg->hot)
+    return cold_first || sweep >= 2;
+  if (cold_first && sweep == 0)
+    return false;
+  if (pg->accessed)
+    {
+      pg->accessed = false;
+      return false;
+    }
+  return true;
+}
+
+/* Returns the key under which page INDEX of INODE goes in the
+   ghost list.  Inode numbers outlive the inodes in memory. */
+static uint64_t
+page_key (struct inode *inode, size_t index)
+{
+  return ((uint64_t) inode_get_inumber (inode) << 32) | index;
+}
+
+/* Removes PG from its inode's tree, writing it back first if it
+   is dirty and WRITE is true.  No reference to PG may be held.
+   pcache_lock and PG's lock must be held. */
+static void
+discard (struct pcache_page *pg, bool write)
+{
+  ASSERT (pg->ref_cnt == 0);
+  ASSERT (lock_held_by_current_thread (&pg->lock));
+
+  if (pg->dirty)
+    {
+      if (write)
+        {
+          write_page (pg);
+          stats.writeback_cnt++;
+        }
+      mark_clean (pg);
+    }
+  if (!pg->hot)
+    cold_cnt--;
+  radix_delete (inode_get_pages (pg->inode), pg->index);
+  pg->inode = NULL;
+  pg->valid = false;
+}
+
+/* Writes PG, whose lock must be held, to the disk sectors
+   recorded for it, after zeroing its bytes past end of file.
+   Each run of consecutive sectors is written with one call. */
+static void
+write_page (struct pcache_page *pg)
+{
+  size_t i, n;
+
+  ASSERT (lock_held_by_current_thread (&pg->lock));
+
+  memset (pg->data + pg->size, 0, PGSIZE - pg->size);
+  for (i = 0; i < PAGE_SECTORS; i += n)
+    {
+      n = 1;
+      if (pg->sectors[i] == 0)
+        continue;
+      while (i + n < PAGE_SECTORS
+             && pg->sectors[i + n] == pg->sectors[i] + n)
+        n++;
+      cache_write_direct (pg->sectors[i], n,
+                          pg->data + i * BLOCK_SECTOR_SIZE);
+    }
+}
+
+/* Marks PG as clean and forgets its sectors.  pcache_lock and
+   PG's lock must be held. */
+static void
+mark_clean (struct pcache_page *pg)
+{
+  ASSERT (pg->dirty);
+
+  pg->dirty = false;
+  radix_tag_clear (inode_get_pages (pg->inode), pg->index, TAG_DIRTY);
+  dirty_cnt--;
+  memset (pg->sectors, 0, sizeof pg->sectors);
+}
+
+/* Writes back those of the CNT pages in PAGES that are still
+   dirty by the time their locks are acquired, and drops the
+   reference to each that the caller took. */
+static void
+flush_pages (struct pcache_page *pages[], size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      struct pcache_page *pg = pages[i];
+
+      lock_acquire (&pg->lock);
+      if (pg->dirty)
+        {
+          write_page (pg);
+          lock_acquire (&pcache_lock);
+          mark_clean (pg);
+          stats.writeback_cnt++;
+          lock_release (&pcache_lock);
+        }
+      pcache_put (pg);
+    }
+}
+
+/* Periodic write-behind. */
+static void
+flush_behind (struct work *w, void *aux UNUSED)
+{
+  pcache_flush ();
+  work_queue_delayed (w, WRITE_BEHIND_MS * TIMER_FREQ / 1000,
+                      flush_behind, NULL);
+}
+
+/* Write-back work queued by pcache_throttle(). */
+static void
+write_back (struct work *w UNUSED, void *aux UNUSED)
+{
+  pcache_flush ();
+}
@@ -0,0 +1,76 @@
+#ifndef FILESYS_PCACHE_H
+#define FILESYS_PCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/block.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+struct frame;
+struct inode;
+
+/* Number of pages held in the page cache. */
+#define PCACHE_SIZE 32
+
+/* Most pages that the virtual memory system may keep mapped and
+   that pinned files may keep at once, together, leaving the rest
+   for read() and write(). */
+#define PCACHE_MAP_MAX (PCACHE_SIZE - 8)
+
+/* Sectors per page. */
+#define PAGE_SECTORS (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* A page of file data in the page cache.
+
+   Only inode.c knows how a page's bytes map to disk sectors.
+   Whenever a page is modified, it records in SECTORS where each
+   of its sectors goes on disk, so that the page can be written
+   back without consulting the inode.  The sectors must not move
+   while the page is dirty, so the few operations that move or
+   share a file's sectors call pcache_flush_inode() first.
+
+   Bytes of the page past the end of file are zero when it is
+   read in and are zeroed again before it is written back. */
+struct pcache_page
+  {
+    /* Owned by pcache.c; pcache_lock protects these.  DIRTY
+       changes only while LOCK is held as well. */
+    struct inode *inode;        /* Inode whose data this is, or null. */
+    size_t index;               /* Page number within INODE. */
+    unsigned ref_cnt;           /* Users, including a mapping frame. */
+    bool accessed;              /* Used since clock hand passed? */
+    bool hot;                   /* Protected, not on probation? */
+    bool pinned;                /* Kept by a pinned file? */
+    bool dirty;                 /* Modified since written back? */
+
+    /* LOCK is held while the following are read or written. */
+    struct lock lock;
+    bool valid;                 /* DATA read in? */
+    uint8_t *data;              /* One page of file data. */
+    size_t size;                /* Bytes of DATA within the file. */
+    block_sector_t sectors[PAGE_SECTORS];  /* Disk sectors, or 0. */
+
+    /* Owned by vm/frame.c, protected by its frame_lock. */
+    struct frame *frame;        /* Frame mapping DATA, or null. */
+  };
+
+void pcache_init (void);
+void pcache_done (void);
+struct pcache_page *pcache_get (struct inode *, size_t index);
+struct pcache_page *pcache_lookup (struct inode *, size_t index);
+bool pcache_contains (struct inode *, size_t index);
+void pcache_put (struct pcache_page *);
+void pcache_mark_dirty (struct pcache_page *);
+void pcache_throttle (void);
+bool pcache_map (struct pcache_page *);
+void pcache_unmap (struct pcache_page *);
+bool pcache_pin (struct pcache_page *);
+void pcache_unpin_inode (struct inode *);
+void pcache_flush (void);
+void pcache_flush_inode (struct inode *);
+void pcache_drop_inode (struct inode *, bool write_back);
+void pcache_print_stats (void);
+
+#endif /* filesys/pcache.h */
@@ -0,0 +1,233 @@
+#include "filesys/pipe.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include "threads/waitq.h"
+
+/* A pipe: a ring buffer of one page in kernel memory, written at
+   one end and read at the other.
+
+   Reads block while the pipe is empty and some writer still has
+   it open, and then return whatever is there, up to the size
+   asked for; once the last writer closes, an empty pipe reads as
+   end of file.  Writes block while the pipe is full and some
+   reader still has it open, and return only when everything has
+   been written or the last reader has closed.
+
+   The pipe itself does not know which files or processes refer to
+   it, only how many readers and writers there are, and it is freed
+   when both counts drop to zero.
+
+   Threads in poll() wait on WAITERS, which is woken along with
+   `readable' and `writable'. */
+
+/* Size of a pipe's buffer, in bytes. */
+#define PIPE_SIZE PGSIZE
+
+struct pipe
+  {
+    struct lock lock;           /* Protects all members. */
+    struct condition readable;  /* Signaled when data or EOF arrives. */
+    struct condition writable;  /* Signaled when room is made. */
+    struct wait_queue waiters;  /* Woken when either is signaled. */
+    uint8_t *buf;               /* PIPE_SIZE bytes of data. */
+    size_t head;                /* Offset in BUF of the next byte read. */
+    size_t used;                /* Number of bytes in BUF. */
+    int reader_cnt;             /* Number of open read ends. */
+    int writer_cnt;             /* Number of open write ends. */
+  };
+
+/* Creates and returns a new, empty pipe with no ends open yet.
+   Returns a null pointer if memory is not available. */
+struct pipe *
+pipe_create (void) 
+{
+  struct pipe *p = malloc (sizeof *p);
+  if (p == NULL)
+    return NULL;
+  p->buf = palloc_get_page (0);
+  if (p->buf == NULL)
+    {
+      free (p);
+      return NULL;
+    }
+  lock_init (&p->lock);
+  cond_init (&p->readable);
+  cond_init (&p->writable);
+  waitq_init (&p->waiters);
+  p->head = 0;
+  p->used = 0;
+  p->reader_cnt = 0;
+  p->writer_cnt = 0;
+  return p;
+}
+
+/* Opens another read end of P, or a write end if WRITER is
+   true. */
+void
+pipe_open (struct pipe *p, bool writer) 
+{
+  lock_acquire (&p->lock);
+  if (writer)
+    p->writer_cnt++;
+  else
+    p->reader_cnt++;
+  lock_release (&p->lock);
+}
+
+/* Closes a read end of P, or a write end if WRITER is true.
+   Frees P if that was its last end. */
+void
+pipe_close (struct pipe *p, bool writer) 
+{
+  bool last;
+
+  lock_acquire (&p->lock);
+  if (writer)
+    {
+      ASSERT (p->writer_cnt > 0);
+      if (--p->writer_cnt == 0)
+        {
+          cond_broadcast (&p->readable, &p->lock);
+          waitq_wake (&p->waiters);
+        }
+    }
+  else
+    {
+      ASSERT (p->reader_cnt > 0);
+      if (--p->reader_cnt == 0)
+        {
+          cond_broadcast (&p->writable, &p->lock);
+          waitq_wake (&p->waiters);
+        }
+    }
+  last = p->reader_cnt == 0 && p->writer_cnt == 0;
+  lock_release (&p->lock);
+
+  if (last)
+    {
+      palloc_free_page (p->buf);
+      free (p);
+    }
+}
+
+/* Reads up to SIZE bytes from P into BUFFER, waiting until there
+   is at least one byte to read or no writer is left.  Returns the
+   number of bytes read, which is 0 only at end of file. */
+off_t
+pipe_read (struct pipe *p, void *buffer_, off_t size) 
+{
+  uint8_t *buffer = buffer_;
+  off_t bytes_read = 0;
+
+  lock_acquire (&p->lock);
+  while (p->used == 0 && p->writer_cnt > 0 && size > 0)
+    cond_wait (&p->readable, &p->lock);
+  while (size > 0 && p->used > 0)
+    {
+      size_t chunk = PIPE_SIZE - p->head;
+      if (chunk > p->used)
+        chunk = p->used;
+      if (chunk > (size_t) size)
+        chunk = size;
+
+      memcpy (buffer + bytes_read, p->buf + p->head, chunk);
+      p->head = (p->head + chunk) % PIPE_SIZE;
+      p->used -= chunk;
+      bytes_read += chunk;
+      size -= chunk;
+    }
+  if (bytes_read > 0)
+    {
+      cond_broadcast (&p->writable, &p->lock);
+      waitq_wake (&p->waiters);
+    }
+  lock_release (&p->lock);
+
+  return bytes_read;
+}
+
+/* Writes SIZE bytes from BUFFER into P, waiting for room as
+   needed.  Returns the number of bytes written, which is less
+   than SIZE only if every reader has closed P, or -1 if none
+   could be written for that reason. */
+off_t
+pipe_write (struct pipe *p, const void *buffer_, off_t size) 
+{
+  const uint8_t *buffer = buffer_;
+  off_t bytes_written = 0;
+
+  lock_acquire (&p->lock);
+  while (size > 0)
+    {
+      size_t tail, chunk;
+
+      while (p->used == PIPE_SIZE && p->reader_cnt > 0)
+        cond_wait (&p->writable, &p->lock);
+      if (p->reader_cnt == 0)
+        break;
+
+      tail = (p->head + p->used) % PIPE_SIZE;
+      if (tail < p->head)
+        chunk = p->head - tail;
+      else
+        chunk = PIPE_SIZE - tail;
+      if (chunk > (size_t) size)
+        chunk = size;
+
+      memcpy (p->buf + tail, buffer + bytes_written, chunk);
+      p->used += chunk;
+      bytes_written += chunk;
+      size -= chunk;
+      cond_broadcast (&p->readable, &p->lock);
+      waitq_wake (&p->waiters);
+    }
+  lock_release (&p->lock);
+
+  return bytes_written > 0 || size == 0 ? bytes_written : -1;
+}
+
+/* Returns the number of bytes that can be read from P without
+   waiting. */
+off_t
+pipe_available (struct pipe *p) 
+{
+  off_t used;
+
+  lock_acquire (&p->lock);
+  used = p->used;
+  lock_release (&p->lock);
+  return used;
+}
+
+/* Returns the poll() events that are true of P's read end, or of
+   its write end if WRITER is true.  If PT is nonnull, first puts
+   PT on P's wait queue. */
+int
+pipe_poll (struct pipe *p, bool writer, struct poll_table *pt)
+{
+  int events = 0;
+
+  lock_acquire (&p->lock);
+  if (pt != NULL)
+    poll_register (pt, &p->waiters);
+  if (writer)
+    {
+      if (p->reader_cnt == 0)
+        events |= POLLERR;
+      else if (p->used < PIPE_SIZE)
+        events |= POLLOUT;
+    }
+  else
+    {
+      if (p->used > 0)
+        events |= POLLIN;
+      if (p->writer_cnt == 0)
+        events |= POLLHUP;
+    }
+  lock_release (&p->lock);
+  return events;
+}
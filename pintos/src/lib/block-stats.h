@@ -0,0 +1,33 @@
+#ifndef __LIB_BLOCK_STATS_H
+#define __LIB_BLOCK_STATS_H
+
+#include <stdint.h>
+
+/* Number of buckets in a latency histogram. */
+#define BLOCK_LATENCY_BUCKETS 32
+
+/* Statistics for a block device, as returned by the
+   block_stats() system call.  Times are in CPU cycles as counted
+   by the time-stamp counter.  Shared by user programs and the
+   kernel. */
+struct block_stats
+  {
+    char name[16];              /* Device name, e.g. "hda1". */
+    uint64_t read_cnt;          /* Sectors read. */
+    uint64_t write_cnt;         /* Sectors written. */
+    uint64_t request_cnt;       /* Requests completed. */
+
+    /* latency[I] counts the completed requests that took from
+       2**I to 2**(I+1) - 1 cycles between submission and
+       completion.  The first bucket also counts quicker ones
+       and the last slower ones. */
+    uint64_t latency[BLOCK_LATENCY_BUCKETS];
+
+    /* Dividing these by `elapsed' gives the share of time with
+       a request in flight and the mean number in flight. */
+    uint64_t busy;              /* Time with a request in flight. */
+    uint64_t depth;             /* Requests in flight times time. */
+    uint64_t elapsed;           /* Time since the device appeared. */
+  };
+
+#endif /* lib/block-stats.h */
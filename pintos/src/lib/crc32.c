@@ -0,0 +1,71 @@
+#include "crc32.h"
+#include <stdbool.h>
+
+/* CRC-32, as used by Ethernet, zlib, and PNG, computed 8 bytes
+   at a time by "slicing-by-8".
+
+   TABLE[0][B] is the CRC of byte B alone, which is enough to
+   compute the CRC a byte at a time, but that costs a table
+   lookup that depends on the one before it for every byte.
+   TABLE[K][B] is the CRC of byte B followed by K zero bytes, so
+   that the 8 table lookups for 8 bytes of input are independent
+   of one another and their results can simply be XORed
+   together.  The tables take 8 kB. */
+static uint32_t table[8][256];
+
+/* Set once TABLE is filled in.  Threads that race to fill it in
+   all store the same values, so no lock is needed. */
+static bool table_ready;
+
+/* The CRC-32 polynomial, with bit 0 as the x**31 coefficient. */
+#define POLYNOMIAL 0xedb88320
+
+/* Fills in TABLE. */
+static void
+init_table (void)
+{
+  int i, k;
+
+  for (i = 0; i < 256; i++)
+    {
+      uint32_t c = i;
+      for (k = 0; k < 8; k++)
+        c = c & 1 ? (c >> 1) ^ POLYNOMIAL : c >> 1;
+      table[0][i] = c;
+    }
+  for (i = 0; i < 256; i++)
+    for (k = 1; k < 8; k++)
+      table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+
+  /* Make the tables' contents visible before TABLE_READY. */
+  asm volatile ("" : : : "memory");
+  table_ready = true;
+}
+
+/* Returns the CRC-32 of the SIZE bytes in BUF, continuing from
+   CRC, which is 0 to start a new CRC or the CRC of data that BUF
+   follows. */
+uint32_t
+crc32 (uint32_t crc, const void *buf_, size_t size)
+{
+  const uint8_t *buf = buf_;
+
+  if (!table_ready)
+    init_table ();
+
+  crc = ~crc;
+  for (; size > 0 && (uintptr_t) buf % 4 != 0; size--)
+    crc = table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+  for (; size >= 8; size -= 8, buf += 8)
+    {
+      uint32_t lo = *(const uint32_t *) buf ^ crc;
+      uint32_t hi = *(const uint32_t *) (buf + 4);
+      crc = (table[7][lo & 0xff] ^ table[6][(lo >> 8) & 0xff]
+             ^ table[5][(lo >> 16) & 0xff] ^ table[4][lo >> 24]
+             ^ table[3][hi & 0xff] ^ table[2][(hi >> 8) & 0xff]
+             ^ table[1][(hi >> 16) & 0xff] ^ table[0][hi >> 24]);
+    }
+  for (; size > 0; size--)
+    crc = table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
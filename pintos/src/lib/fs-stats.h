@@ -0,0 +1,31 @@
+#ifndef __LIB_FS_STATS_H
+#define __LIB_FS_STATS_H
+
+#include <stdint.h>
+
+/* Statistics for the file system's buffer cache, counted in
+   sectors since boot. */
+struct cache_stats
+  {
+    uint64_t hit_cnt;           /* Accesses to cached sectors. */
+    uint64_t miss_cnt;          /* Accesses to uncached sectors. */
+    uint64_t evict_cnt;         /* Sectors pushed out of the cache. */
+    uint64_t writeback_cnt;     /* Dirty sectors written to disk. */
+    uint64_t read_ahead_cnt;    /* Sectors read ahead. */
+    uint64_t read_ahead_hit_cnt;    /* ...and then used. */
+    uint64_t read_ahead_wasted_cnt; /* ...and evicted unused. */
+  };
+
+/* Statistics for the file system, as returned by the fs_stats()
+   system call.  Shared by user programs and the kernel. */
+struct fs_stats
+  {
+    struct cache_stats cache;   /* Buffer cache. */
+
+    /* Bytes read from and written to the file passed, counting
+       every opener since its inode was last read from disk. */
+    uint64_t read_bytes;
+    uint64_t write_bytes;
+  };
+
+#endif /* lib/fs-stats.h */
@@ -0,0 +1,40 @@
+#ifndef __LIB_KDATA_H
+#define __LIB_KDATA_H
+
+#include <stdint.h>
+
+/* Kernel data page.
+
+   The kernel maps one of these read-only into every user process
+   at KDATA_ADDR and keeps it current while the process runs, so
+   that a program can read the time or its own pid with a memory
+   load instead of a system call.  For finer time, a program reads
+   the CPU's time-stamp counter itself and scales it by
+   CYCLES_PER_SEC.
+
+   The 64-bit counters cannot be read atomically, so the kernel
+   makes SEQ odd while it updates the page and even again after.
+   A reader that sees SEQ odd, or changed across its read, must
+   retry.
+
+   SYSENTER tells the system call stubs whether they may enter the
+   kernel with SYSENTER instead of "int $0x31".  It does not
+   change while the process runs. */
+struct kdata
+  {
+    unsigned seq;               /* Update sequence number. */
+    int tid;                    /* Process identifier. */
+    int ticks_per_sec;          /* Timer ticks per second. */
+    uint64_t cycles_per_sec;    /* Time-stamp counter cycles a second. */
+    int64_t ticks;              /* Timer ticks since boot. */
+    int64_t idle_ticks;         /* Timer ticks spent idle. */
+    int64_t kernel_ticks;       /* Timer ticks in kernel threads. */
+    int64_t user_ticks;         /* Timer ticks in user programs. */
+    int sysenter;               /* Nonzero if SYSENTER may be used. */
+  };
+
+/* User virtual address of the kernel data page, just below where
+   programs are normally loaded. */
+#define KDATA_ADDR ((const struct kdata *) 0x08000000)
+
+#endif /* lib/kdata.h */
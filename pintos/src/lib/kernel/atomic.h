@@ -0,0 +1,75 @@
+#ifndef __LIB_KERNEL_ATOMIC_H
+#define __LIB_KERNEL_ATOMIC_H
+
+#include <stdbool.h>
+
+/* Atomic operations on ordinary integer and pointer variables.
+
+   These are thin wrappers around the compiler's built-in atomic
+   operations, for variables of 1, 2 or 4 bytes.  Without the FPU,
+   which the kernel does not use, the compiler cannot load or
+   store 8 bytes atomically, so the atomic64_ operations below
+   instead build on CMPXCHG8B.  A variable
+   that is ever changed by one of them while another CPU, or an
+   interrupt handler, may access it should be read and written
+   only through them.
+
+   atomic_load(), atomic_store() and atomic_add() order nothing
+   but their own access, which suits statistics counters.  The
+   _acquire and _release forms order the accesses that follow
+   or precede them, as a lock would, and the read-modify-write
+   operations order everything. */
+
+/* Loads. */
+#define atomic_load(P) __atomic_load_n (P, __ATOMIC_RELAXED)
+#define atomic_load_acquire(P) __atomic_load_n (P, __ATOMIC_ACQUIRE)
+
+/* Stores. */
+#define atomic_store(P, V) __atomic_store_n (P, V, __ATOMIC_RELAXED)
+#define atomic_store_release(P, V) \
+        __atomic_store_n (P, V, __ATOMIC_RELEASE)
+
+/* Adds V to *P without ordering other accesses, for counters. */
+#define atomic_add(P, V) \
+        ((void) __atomic_add_fetch (P, V, __ATOMIC_RELAXED))
+#define atomic_inc(P) atomic_add (P, 1)
+
+/* Adds V to or subtracts V from *P and returns the old value. */
+#define atomic_fetch_add(P, V) __atomic_fetch_add (P, V, __ATOMIC_SEQ_CST)
+#define atomic_fetch_sub(P, V) __atomic_fetch_sub (P, V, __ATOMIC_SEQ_CST)
+
+/* Stores V in *P and returns the old value. */
+#define atomic_xchg(P, V) __atomic_exchange_n (P, V, __ATOMIC_SEQ_CST)
+
+/* If *P equals *OLD, stores NEW in *P and returns true.
+   Otherwise, stores *P in *OLD and returns false. */
+#define atomic_cmpxchg(P, OLD, NEW)                                     \
+        __atomic_compare_exchange_n (P, OLD, NEW, false,                \
+                                     __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+
+/* Memory barriers.  smp_mb() orders all earlier loads and stores
+   before all later ones.  smp_rmb() orders earlier loads before
+   later loads, and smp_wmb() earlier stores before later stores;
+   on the 80x86 they only keep the compiler from reordering. */
+#define smp_mb() __atomic_thread_fence (__ATOMIC_SEQ_CST)
+#define smp_rmb() __atomic_thread_fence (__ATOMIC_ACQUIRE)
+#define smp_wmb() __atomic_thread_fence (__ATOMIC_RELEASE)
+
+/* 8-byte operations, which also order everything.  A load is a
+   compare-and-swap that changes nothing, so it needs *P to be
+   writable. */
+#define atomic64_load(P) __sync_val_compare_and_swap (P, 0, 0)
+#define atomic64_cmpxchg(P, OLD, NEW) \
+        __sync_bool_compare_and_swap (P, OLD, NEW)
+#define atomic64_add(P, V)                                              \
+        do                                                              \
+          {                                                             \
+            __typeof__ (*(P)) old_ = *(P), seen_;                       \
+            while ((seen_ = __sync_val_compare_and_swap (P, old_,       \
+                                                         old_ + (V)))   \
+                   != old_)                                             \
+              old_ = seen_;                                             \
+          }                                                             \
+        while (0)
+
+#endif /* lib/kernel/atomic.h */
@@ -69,6 +69,61 @@ last_mask (const struct bitmap *b)
   return last_bits ? ((elem_type) 1 << last_bits) - 1 : (elem_type) -1;
 }
 
+/* Returns a mask of the bits in the element holding bit
+   END - 1 that lie below END, that is, that come before bit END
+   in the bitmap. */
+static inline elem_type
+range_mask (size_t end) 
+{
+  int bits = end % ELEM_BITS;
+  return bits ? ((elem_type) 1 << bits) - 1 : (elem_type) -1;
+}
+
+/* Returns the number of 1-bits in WORD, adding them up in
+   parallel within ever wider fields of WORD. */
+static inline size_t
+popcount (elem_type word) 
+{
+  const elem_type m1 = (elem_type) -1 / 3;      /* 0x55...55 */
+  const elem_type m2 = (elem_type) -1 / 5;      /* 0x33...33 */
+  const elem_type m4 = (elem_type) -1 / 17;     /* 0x0f...0f */
+  const elem_type h01 = (elem_type) -1 / 255;   /* 0x01...01 */
+
+  word -= (word >> 1) & m1;
+  word = (word & m2) + ((word >> 2) & m2);
+  word = (word + (word >> 4)) & m4;
+  return (word * h01) >> (ELEM_BITS - CHAR_BIT);
+}
+
+/* Returns the index of the first bit at or after START in B
+   that is set to VALUE, or B's size if there is none.  Whole
+   elements without such a bit are skipped a word at a time. */
+static size_t
+find_next (const struct bitmap *b, size_t start, bool value) 
+{
+  elem_type flip = value ? 0 : (elem_type) -1;
+  size_t idx = elem_idx (start);
+  size_t cnt = elem_cnt (b->bit_cnt);
+  elem_type word;
+
+  if (start >= b->bit_cnt)
+    return b->bit_cnt;
+
+  /* In the first element, ignore the bits before START. */
+  word = (b->bits[idx] ^ flip) & ~(bit_mask (start) - 1);
+  while (word == 0)
+    {
+      if (++idx >= cnt)
+        return b->bit_cnt;
+      word = b->bits[idx] ^ flip;
+    }
+
+  /* Padding bits past the end of B may be found when looking
+     for false bits. */
+  start = idx * ELEM_BITS + __builtin_ctzl (word);
+  return start < b->bit_cnt ? start : b->bit_cnt;
+}
+
 /* Creation and destruction. */
 
 /* Initializes B to be a bitmap of BIT_CNT bits
@@ -233,17 +288,24 @@ bitmap_set_multiple (struct bitmap *b, size_t start, size_t cnt, bool value)
 size_t
 bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i, value_cnt;
+  size_t end = start + cnt;
+  size_t idx, value_cnt;
 
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
-  ASSERT (start + cnt <= b->bit_cnt);
+  ASSERT (end <= b->bit_cnt);
 
+  /* Count the set bits a word at a time, trimming the partial
+     words at either end of the range. */
   value_cnt = 0;
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      value_cnt++;
-  return value_cnt;
+  for (idx = start; idx < end; idx = (elem_idx (idx) + 1) * ELEM_BITS)
+    {
+      elem_type word = b->bits[elem_idx (idx)] & ~(bit_mask (idx) - 1);
+      if (elem_idx (idx) == elem_idx (end - 1))
+        word &= range_mask (end);
+      value_cnt += popcount (word);
+    }
+  return value ? value_cnt : cnt - value_cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -251,16 +313,11 @@ bitmap_count (const struct bitmap *b, size_t start, size_t cnt, bool value)
 bool
 bitmap_contains (const struct bitmap *b, size_t start, size_t cnt, bool value) 
 {
-  size_t i;
-  
   ASSERT (b != NULL);
   ASSERT (start <= b->bit_cnt);
   ASSERT (start + cnt <= b->bit_cnt);
 
-  for (i = 0; i < cnt; i++)
-    if (bitmap_test (b, start + i) == value)
-      return true;
-  return false;
+  return cnt > 0 && find_next (b, start, value) < start + cnt;
 }
 
 /* Returns true if any bits in B between START and START + CNT,
@@ -302,10 +359,24 @@ bitmap_scan (const struct bitmap *b, size_t start, size_t cnt, bool value)
   if (cnt <= b->bit_cnt) 
     {
       size_t last = b->bit_cnt - cnt;
-      size_t i;
-      for (i = start; i <= last; i++)
-        if (!bitmap_contains (b, i, cnt, !value))
-          return i; 
+      size_t i = start;
+
+      /* Jump to the start of each run of VALUE bits, then to its
+         end, until a run is long enough. */
+      if (cnt == 0)
+        return i <= last ? i : BITMAP_ERROR;
+      for (;;)
+        {
+          size_t run_end;
+
+          i = find_next (b, i, value);
+          if (i > last)
+            break;
+          run_end = find_next (b, i, !value);
+          if (run_end - i >= cnt)
+            return i;
+          i = run_end;
+        }
     }
   return BITMAP_ERROR;
 }
@@ -325,7 +396,42 @@ bitmap_scan_and_flip (struct bitmap *b, size_t start, size_t cnt, bool value)
     bitmap_set_multiple (b, idx, cnt, !value);
   return idx;
 }
-
+
+/* Like bitmap_scan(), but "next fit": starts at *CURSOR instead
+   of a fixed index, wrapping around to the beginning of B if
+   nothing is found after it, and on success moves *CURSOR just
+   past the group found.  A caller that keeps CURSOR between
+   calls thus does not rescan a full prefix of B each time. */
+size_t
+bitmap_scan_next (const struct bitmap *b, size_t *cursor, size_t cnt,
+                  bool value) 
+{
+  size_t start, idx;
+
+  ASSERT (b != NULL);
+  ASSERT (cursor != NULL);
+
+  start = *cursor <= b->bit_cnt ? *cursor : 0;
+  idx = bitmap_scan (b, start, cnt, value);
+  if (idx == BITMAP_ERROR && start != 0)
+    idx = bitmap_scan (b, 0, cnt, value);
+  if (idx != BITMAP_ERROR)
+    *cursor = idx + cnt;
+  return idx;
+}
+
+/* Like bitmap_scan_and_flip(), but searches next fit from
+   *CURSOR as bitmap_scan_next() does. */
+size_t
+bitmap_scan_and_flip_next (struct bitmap *b, size_t *cursor, size_t cnt,
+                           bool value)
+{
+  size_t idx = bitmap_scan_next (b, cursor, cnt, value);
+  if (idx != BITMAP_ERROR) 
+    bitmap_set_multiple (b, idx, cnt, !value);
+  return idx;
+}
+
 /* File input and output. */
 
 #ifdef FILESYS
@@ -359,6 +465,56 @@ bitmap_write (const struct bitmap *b, struct file *file)
   off_t size = byte_cnt (b->bit_cnt);
   return file_write_at (file, b->bits, size, 0) == size;
 }
+
+/* Reads the part of B that holds the CNT bits starting at START
+   from FILE, leaving the rest of B as it is.  Bits in the same
+   elements as the range are read too, so callers that care about
+   them should keep START and CNT to multiples of 32.  Return true
+   if successful, false otherwise. */
+bool
+bitmap_read_range (struct bitmap *b, struct file *file,
+                   size_t start, size_t cnt)
+{
+  size_t first, last;
+  off_t ofs, size;
+
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return true;
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  ofs = first * sizeof *b->bits;
+  size = (last - first + 1) * sizeof *b->bits;
+  if (file_read_at (file, &b->bits[first], size, ofs) != size)
+    return false;
+  if (last == elem_cnt (b->bit_cnt) - 1)
+    b->bits[last] &= last_mask (b);
+  return true;
+}
+
+/* Writes the part of B that holds the CNT bits starting at START
+   to FILE, which must already hold the rest of B.  Return true if
+   successful, false otherwise. */
+bool
+bitmap_write_range (const struct bitmap *b, struct file *file,
+                    size_t start, size_t cnt)
+{
+  size_t first, last;
+  off_t ofs, size;
+
+  ASSERT (start <= b->bit_cnt);
+  ASSERT (start + cnt <= b->bit_cnt);
+
+  if (cnt == 0)
+    return true;
+  first = elem_idx (start);
+  last = elem_idx (start + cnt - 1);
+  ofs = first * sizeof *b->bits;
+  size = (last - first + 1) * sizeof *b->bits;
+  return file_write_at (file, &b->bits[first], size, ofs) == size;
+}
 #endif /* FILESYS */
 
 /* Debugging. */
@@ -1,14 +1,26 @@
 #include <console.h>
+#include <atomic.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
 #include "devices/vga.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
+#include "threads/workqueue.h"
 
 static void vprintf_helper (char, void *);
+static void vprintf_buf_helper (const char *, size_t, void *);
+static void log_buf_helper (char, void *);
+static void log_buf_buf_helper (const char *, size_t, void *);
 static void putchar_have_lock (uint8_t c);
+static void putbuf_have_lock (const char *, size_t);
+static void acquire_console (void);
+static void release_console (void);
+static void log_write (const char *, size_t);
+static void log_drain (void);
+static work_func log_drain_work;
 
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
@@ -56,9 +68,55 @@ static bool use_console_lock;
    counter. */
 static int console_lock_depth;
 
+/* False if output should go only to the serial port, as for a
+   machine with no display. */
+static bool use_vga = true;
+
 /* Number of characters written to console. */
 static int64_t write_cnt;
 
+/* Kernel log.
+
+   Once console_start() has been called, and until a panic,
+   output is not written to the devices by the thread that prints
+   it, which could make it wait for the serial port while holding
+   the console lock and stall every other thread that prints.
+   Instead, it is appended to LOG_RING, a ring buffer, and LOG_WORK, at
+   the lowest work priority, copies it to the devices while
+   holding the console lock.
+
+   A writer reserves space by advancing LOG_RESERVED with a
+   compare-and-swap, copies its bytes in, and then, once the
+   writers that reserved space before it are done, advances
+   LOG_COMMITTED past them.  It does all this with interrupts
+   off, so that a writer on the same CPU never waits for one it
+   interrupted.  Only the holder of the console lock reads the log
+   and advances LOG_DRAINED.  The counters run freely; a byte's
+   position in LOG_RING is its count modulo LOG_SIZE.
+
+   A writer that finds the log full drains it itself, or in an
+   interrupt handler, which cannot, drops its output and counts
+   it in LOG_LOST.  printf() formats into a buffer on the stack
+   and appends it at once, so output of different threads is
+   interleaved only at LOG_CHUNK boundaries. */
+#define LOG_SIZE 16384          /* Bytes in the ring.  Power of 2. */
+#define LOG_CHUNK 256           /* Most bytes appended at once. */
+static char log_ring[LOG_SIZE];
+static unsigned log_reserved;   /* Bytes reserved by writers. */
+static unsigned log_committed;  /* Bytes written by writers. */
+static unsigned log_drained;    /* Bytes written to the devices. */
+static int64_t log_lost;        /* Bytes dropped. */
+static bool use_log;            /* Append to log? */
+static struct work log_work;
+
+/* Buffer for vprintf() in log mode. */
+struct log_buf
+  {
+    char data[LOG_CHUNK];
+    size_t len;
+    int char_cnt;
+  };
+
 /* Enable console locking. */
 void
 console_init (void) 
@@ -67,20 +125,59 @@ console_init (void)
   use_console_lock = true;
 }
 
+/* Starts sending output through the kernel log.  The
+   workqueue must be running. */
+void
+console_start (void)
+{
+  work_init (&log_work, WORK_LOW);
+  use_log = true;
+}
+
+/* Writes everything in the kernel log to the devices before
+   returning. */
+void
+console_flush (void)
+{
+  if (use_log && !intr_context ())
+    {
+      acquire_console ();
+      log_drain ();
+      release_console ();
+    }
+}
+
 /* Notifies the console that a kernel panic is underway,
    which warns it to avoid trying to take the console lock from
-   now on. */
+   now on.  Output waiting in the kernel log is written out, and
+   from now on output goes straight to the devices. */
 void
 console_panic (void) 
 {
   use_console_lock = false;
+  if (use_log)
+    {
+      use_log = false;
+      log_drain ();
+    }
+}
+
+/* Stops writing console output to the VGA display, leaving only
+   the serial port. */
+void
+console_disable_vga (void)
+{
+  use_vga = false;
 }
 
 /* Prints console statistics. */
 void
 console_print_stats (void) 
 {
+  console_flush ();
   printf ("Console: %lld characters output\n", write_cnt);
+  if (log_lost > 0)
+    printf ("Console: %lld characters dropped\n", log_lost);
 }
 
 /* Acquires the console lock. */
@@ -127,8 +224,20 @@ vprintf (const char *format, va_list args)
 {
   int char_cnt = 0;
 
+  if (use_log)
+    {
+      struct log_buf b;
+
+      b.len = 0;
+      b.char_cnt = 0;
+      __vprintf_buf (format, args, log_buf_helper, log_buf_buf_helper, &b);
+      log_write (b.data, b.len);
+      return b.char_cnt;
+    }
+
   acquire_console ();
-  __vprintf (format, args, vprintf_helper, &char_cnt);
+  __vprintf_buf (format, args, vprintf_helper, vprintf_buf_helper,
+                 &char_cnt);
   release_console ();
 
   return char_cnt;
@@ -139,6 +248,13 @@ vprintf (const char *format, va_list args)
 int
 puts (const char *s) 
 {
+  if (use_log)
+    {
+      log_write (s, strlen (s));
+      log_write ("\n", 1);
+      return 0;
+    }
+
   acquire_console ();
   while (*s != '\0')
     putchar_have_lock (*s++);
@@ -148,13 +264,19 @@ puts (const char *s)
   return 0;
 }
 
-/* Writes the N characters in BUFFER to the console. */
+/* Writes the N characters in BUFFER to the console, handing all
+   of them to each output device at once. */
 void
 putbuf (const char *buffer, size_t n) 
 {
+  if (use_log)
+    {
+      log_write (buffer, n);
+      return;
+    }
+
   acquire_console ();
-  while (n-- > 0)
-    putchar_have_lock (*buffer++);
+  putbuf_have_lock (buffer, n);
   release_console ();
 }
 
@@ -162,6 +284,13 @@ putbuf (const char *buffer, size_t n)
 int
 putchar (int c) 
 {
+  if (use_log)
+    {
+      char ch = c;
+      log_write (&ch, 1);
+      return c;
+    }
+
   acquire_console ();
   putchar_have_lock (c);
   release_console ();
@@ -178,6 +307,16 @@ vprintf_helper (char c, void *char_cnt_)
   putchar_have_lock (c);
 }
 
+/* Helper function for vprintf() that writes N characters at
+   once. */
+static void
+vprintf_buf_helper (const char *buffer, size_t n, void *char_cnt_)
+{
+  int *char_cnt = char_cnt_;
+  *char_cnt += n;
+  putbuf_have_lock (buffer, n);
+}
+
 /* Writes C to the vga display and serial port.
    The caller has already acquired the console lock if
    appropriate. */
@@ -187,5 +326,136 @@ putchar_have_lock (uint8_t c)
   ASSERT (console_locked_by_current_thread ());
   write_cnt++;
   serial_putc (c);
-  vga_putc (c);
+  if (use_vga)
+    vga_putc (c);
+}
+
+/* Writes the N characters in BUFFER to the vga display and
+   serial port.  The caller has already acquired the console lock
+   if appropriate. */
+static void
+putbuf_have_lock (const char *buffer, size_t n) 
+{
+  ASSERT (console_locked_by_current_thread ());
+  write_cnt += n;
+  serial_putbuf ((const uint8_t *) buffer, n);
+  if (use_vga)
+    vga_putbuf (buffer, n);
+}
+
+/* Helper function for vprintf() in log mode. */
+static void
+log_buf_helper (char c, void *b)
+{
+  log_buf_buf_helper (&c, 1, b);
+}
+
+/* Helper function for vprintf() in log mode that adds N
+   characters at once, sending the buffer to the log whenever it
+   fills. */
+static void
+log_buf_buf_helper (const char *buffer, size_t n, void *b_)
+{
+  struct log_buf *b = b_;
+
+  b->char_cnt += n;
+  while (n > 0)
+    {
+      size_t chunk = sizeof b->data - b->len;
+      if (chunk > n)
+        chunk = n;
+      memcpy (b->data + b->len, buffer, chunk);
+      b->len += chunk;
+      buffer += chunk;
+      n -= chunk;
+      if (b->len == sizeof b->data)
+        {
+          log_write (b->data, b->len);
+          b->len = 0;
+        }
+    }
+}
+
+/* Tries to append the N bytes in BUFFER, no more than LOG_CHUNK,
+   to the kernel log.  Returns false if there is no room. */
+static bool
+log_append (const char *buffer, size_t n)
+{
+  enum intr_level old_level;
+  unsigned start, ofs;
+  size_t first;
+
+  ASSERT (n <= LOG_CHUNK);
+
+  old_level = intr_disable ();
+  start = atomic_load (&log_reserved);
+  do
+    if (start + n - atomic_load_acquire (&log_drained) > LOG_SIZE)
+      {
+        intr_set_level (old_level);
+        return false;
+      }
+  while (!atomic_cmpxchg (&log_reserved, &start, start + n));
+
+  ofs = start % LOG_SIZE;
+  first = n < LOG_SIZE - ofs ? n : LOG_SIZE - ofs;
+  memcpy (log_ring + ofs, buffer, first);
+  memcpy (log_ring, buffer + first, n - first);
+
+  while (atomic_load_acquire (&log_committed) != start)
+    asm volatile ("pause" : : : "memory");
+  atomic_store_release (&log_committed, start + n);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Appends the N bytes in BUFFER to the kernel log and arranges
+   for them to be written to the devices. */
+static void
+log_write (const char *buffer, size_t n)
+{
+  while (n > 0)
+    {
+      size_t chunk = n < LOG_CHUNK ? n : LOG_CHUNK;
+      if (log_append (buffer, chunk))
+        {
+          buffer += chunk;
+          n -= chunk;
+        }
+      else if (intr_context ())
+        {
+          atomic64_add (&log_lost, n);
+          break;
+        }
+      else
+        console_flush ();
+    }
+  work_queue (&log_work, log_drain_work, NULL);
+}
+
+/* Writes everything committed to the kernel log to the devices.
+   The caller must hold the console lock, if it is in use. */
+static void
+log_drain (void)
+{
+  unsigned committed;
+
+  while ((committed = atomic_load_acquire (&log_committed)) != log_drained)
+    {
+      unsigned ofs = log_drained % LOG_SIZE;
+      size_t n = committed - log_drained;
+      if (n > LOG_SIZE - ofs)
+        n = LOG_SIZE - ofs;
+      putbuf_have_lock (log_ring + ofs, n);
+      atomic_store_release (&log_drained, log_drained + n);
+    }
+}
+
+/* Drains the kernel log, in a worker thread. */
+static void
+log_drain_work (struct work *w UNUSED, void *aux UNUSED)
+{
+  acquire_console ();
+  log_drain ();
+  release_console ();
 }
@@ -2,7 +2,10 @@
 #define __LIB_KERNEL_CONSOLE_H
 
 void console_init (void);
+void console_start (void);
+void console_flush (void);
 void console_panic (void);
+void console_disable_vga (void);
 void console_print_stats (void);
 
 #endif /* lib/kernel/console.h */
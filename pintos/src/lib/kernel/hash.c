@@ -7,6 +7,7 @@
 
 #include "hash.h"
 #include "../debug.h"
+#include <string.h>
 #include "threads/malloc.h"
 
 #define list_elem_to_hash_elem(LIST_ELEM)                       \
@@ -300,6 +301,100 @@ hash_int (int i)
 {
   return hash_bytes (&i, sizeof i);
 }
+
+/* MurmurHash3 constants. */
+#define MURMUR_C1 0xcc9e2d51u
+#define MURMUR_C2 0x1b873593u
+
+/* A 32-bit word that may sit at any address and alias any
+   type. */
+typedef uint32_t unaligned_word __attribute__ ((aligned (1), may_alias));
+
+/* Returns X rotated left by R bits, 0 < R < 32. */
+static inline uint32_t
+rotl32 (uint32_t x, int r) 
+{
+  return (x << r) | (x >> (32 - r));
+}
+
+/* Mixes word K into a MurmurHash3 state. */
+static inline uint32_t
+murmur_mix (uint32_t k) 
+{
+  return rotl32 (k * MURMUR_C1, 15) * MURMUR_C2;
+}
+
+/* Returns H with every input bit made to affect every output
+   bit: the MurmurHash3 finalizer. */
+static inline uint32_t
+murmur_final (uint32_t h) 
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return h;
+}
+
+/* Returns a hash of the SIZE bytes in BUF, like hash_bytes(),
+   but consuming BUF four bytes at a time.  This is
+   MurmurHash3_x86_32 with a seed of 0, much faster than
+   hash_bytes() for keys longer than a few bytes. */
+unsigned
+hash_bytes_fast (const void *buf_, size_t size) 
+{
+  const unsigned char *buf = buf_;
+  const unsigned char *tail;
+  uint32_t hash = 0;
+  uint32_t k = 0;
+  size_t i;
+
+  ASSERT (buf != NULL || size == 0);
+
+  for (i = 0; i + 4 <= size; i += 4)
+    {
+      hash ^= murmur_mix (*(const unaligned_word *) (buf + i));
+      hash = rotl32 (hash, 13) * 5 + 0xe6546b64u;
+    }
+
+  /* Fold in the last 1 to 3 bytes. */
+  tail = buf + i;
+  switch (size & 3)
+    {
+    case 3:
+      k ^= tail[2] << 16;
+      /* Fall through. */
+    case 2:
+      k ^= tail[1] << 8;
+      /* Fall through. */
+    case 1:
+      k ^= tail[0];
+      hash ^= murmur_mix (k);
+    }
+
+  return murmur_final (hash ^ size);
+}
+
+/* Returns a hash of string S, like hash_string() but computed
+   with hash_bytes_fast(). */
+unsigned
+hash_string_fast (const char *s) 
+{
+  ASSERT (s != NULL);
+
+  return hash_bytes_fast (s, strlen (s));
+}
+
+/* Returns a hash of pointer P itself, not of what it points to.
+   A few multiplies and shifts spread the address bits over the
+   whole value, so the hash is just as good for page-aligned
+   pointers, whose low bits are all zero, as for any other. */
+unsigned
+hash_ptr (const void *p) 
+{
+  return murmur_final ((uintptr_t) p);
+}
 
 /* Returns the bucket in H that E belongs in. */
 static struct list *
@@ -99,5 +99,8 @@ bool hash_empty (struct hash *);
 unsigned hash_bytes (const void *, size_t);
 unsigned hash_string (const char *);
 unsigned hash_int (int);
+unsigned hash_bytes_fast (const void *, size_t);
+unsigned hash_string_fast (const char *);
+unsigned hash_ptr (const void *);
 
 #endif /* lib/kernel/hash.h */
@@ -0,0 +1,197 @@
+#include "heap.h"
+#include "../debug.h"
+
+/* A pairing heap is a tree, in which every element is no less
+   than its parent, stored as each element's list of children:
+   CHILD points to the first child and NEXT along the siblings.
+   PREV points back along the siblings, from the first child to
+   the parent, so that an element can be cut out of the tree
+   without a search.  The root has no siblings and a null PREV.
+
+   Two trees are merged by making the one with the greater root
+   the first child of the other.  Popping the root leaves its
+   children, which are merged in pairs from left to right and
+   then, from right to left, into a single tree; this two-pass
+   merge is what gives the heap its amortized bounds [Fredman
+   et al., "The pairing heap: a new form of self-adjusting heap",
+   Algorithmica 1 (1986)]. */
+
+static struct heap_elem *merge (struct heap *,
+                                struct heap_elem *, struct heap_elem *);
+static struct heap_elem *merge_pairs (struct heap *, struct heap_elem *);
+static void cut (struct heap_elem *);
+
+/* Initializes HEAP as an empty heap ordered by LESS, given
+   auxiliary data AUX. */
+void
+heap_init (struct heap *heap, heap_less_func *less, void *aux)
+{
+  ASSERT (heap != NULL);
+  ASSERT (less != NULL);
+
+  heap->root = NULL;
+  heap->size = 0;
+  heap->less = less;
+  heap->aux = aux;
+}
+
+/* Returns true if HEAP is empty, false otherwise. */
+bool
+heap_empty (const struct heap *heap)
+{
+  return heap->root == NULL;
+}
+
+/* Returns the number of elements in HEAP. */
+size_t
+heap_size (const struct heap *heap)
+{
+  return heap->size;
+}
+
+/* Returns the least element in HEAP, which must not be empty,
+   without removing it.  Of equal elements, any one may be
+   returned. */
+struct heap_elem *
+heap_min (const struct heap *heap)
+{
+  ASSERT (!heap_empty (heap));
+  return heap->root;
+}
+
+/* Inserts ELEM, which must not be in any heap, into HEAP. */
+void
+heap_push (struct heap *heap, struct heap_elem *elem)
+{
+  ASSERT (elem != NULL);
+
+  elem->child = elem->next = elem->prev = NULL;
+  heap->root = merge (heap, heap->root, elem);
+  heap->size++;
+}
+
+/* Removes the least element from HEAP, which must not be empty,
+   and returns it. */
+struct heap_elem *
+heap_pop_min (struct heap *heap)
+{
+  struct heap_elem *min;
+
+  ASSERT (!heap_empty (heap));
+
+  min = heap->root;
+  heap->root = merge_pairs (heap, min->child);
+  heap->size--;
+  return min;
+}
+
+/* Restores HEAP's order after the key of ELEM, which is in HEAP,
+   has decreased.  Behavior is undefined if the key increased. */
+void
+heap_decrease_key (struct heap *heap, struct heap_elem *elem)
+{
+  ASSERT (elem != NULL);
+
+  if (elem == heap->root)
+    return;
+  cut (elem);
+  heap->root = merge (heap, heap->root, elem);
+}
+
+/* Removes ELEM, which must be in HEAP, from HEAP. */
+void
+heap_remove (struct heap *heap, struct heap_elem *elem)
+{
+  ASSERT (elem != NULL);
+
+  if (elem == heap->root)
+    heap_pop_min (heap);
+  else
+    {
+      cut (elem);
+      heap->root = merge (heap, heap->root, merge_pairs (heap, elem->child));
+      heap->size--;
+    }
+}
+
+/* Merges the trees rooted at A and B, either of which may be
+   null, and returns the root of the result.  A and B must have
+   no siblings. */
+static struct heap_elem *
+merge (struct heap *heap, struct heap_elem *a, struct heap_elem *b)
+{
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+
+  /* Make A the root, preferring the old root on ties so that
+     equal elements come out in the order they went in. */
+  if (heap->less (b, a, heap->aux))
+    {
+      struct heap_elem *t = a;
+      a = b;
+      b = t;
+    }
+
+  b->prev = a;
+  b->next = a->child;
+  if (a->child != NULL)
+    a->child->prev = b;
+  a->child = b;
+  a->next = a->prev = NULL;
+  return a;
+}
+
+/* Merges the list of sibling trees starting at FIRST, which may
+   be null, into one tree by the two-pass method, and returns its
+   root. */
+static struct heap_elem *
+merge_pairs (struct heap *heap, struct heap_elem *first)
+{
+  struct heap_elem *pairs = NULL;
+  struct heap_elem *root = NULL;
+
+  /* Left to right, merge each pair, pushing each result onto a
+     stack linked through `next'. */
+  while (first != NULL)
+    {
+      struct heap_elem *a = first;
+      struct heap_elem *b = a->next;
+      struct heap_elem *m;
+
+      first = b != NULL ? b->next : NULL;
+      a->next = a->prev = NULL;
+      if (b != NULL)
+        b->next = b->prev = NULL;
+      m = merge (heap, a, b);
+      m->next = pairs;
+      pairs = m;
+    }
+
+  /* Right to left, merge the results into one. */
+  while (pairs != NULL)
+    {
+      struct heap_elem *m = pairs;
+      pairs = m->next;
+      m->next = NULL;
+      root = merge (heap, root, m);
+    }
+  return root;
+}
+
+/* Detaches ELEM, which must not be a root, and the subtree below
+   it from its parent and siblings. */
+static void
+cut (struct heap_elem *elem)
+{
+  ASSERT (elem->prev != NULL);
+
+  if (elem->prev->child == elem)
+    elem->prev->child = elem->next;
+  else
+    elem->prev->next = elem->next;
+  if (elem->next != NULL)
+    elem->next->prev = elem->prev;
+  elem->next = elem->prev = NULL;
+}
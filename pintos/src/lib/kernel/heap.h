@@ -0,0 +1,87 @@
+#ifndef __LIB_KERNEL_HEAP_H
+#define __LIB_KERNEL_HEAP_H
+
+/* Pairing heap.
+
+   A priority queue that, like struct list, needs no dynamically
+   allocated memory: each structure that may be in a heap embeds
+   a struct heap_elem, and heap_entry() converts a pointer to the
+   member back to a pointer to the structure.  The order is given
+   by a heap_less_func, and heap_min() returns the least element.
+
+   Pushing an element, finding the minimum, and merging are O(1);
+   popping the minimum and removing an arbitrary element take
+   O(log n) amortized time, much better than the O(n) of
+   list_insert_ordered() for long queues.  When an element's key
+   decreases, heap_decrease_key() moves it up, also in O(1).  To
+   increase a key, remove the element and push it again.
+
+   For example:
+
+      struct foo
+        {
+          int64_t deadline;
+          struct heap_elem elem;
+        };
+
+      static bool
+      foo_less (const struct heap_elem *a, const struct heap_elem *b,
+                void *aux UNUSED)
+      {
+        return (heap_entry (a, struct foo, elem)->deadline
+                < heap_entry (b, struct foo, elem)->deadline);
+      }
+
+      struct heap foos;
+      heap_init (&foos, foo_less, NULL);
+      heap_push (&foos, &f->elem);
+      ...
+      f = heap_entry (heap_pop_min (&foos), struct foo, elem); */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Heap element. */
+struct heap_elem
+  {
+    struct heap_elem *child;    /* First child. */
+    struct heap_elem *next;     /* Next sibling. */
+    struct heap_elem *prev;     /* Previous sibling, or parent if first. */
+  };
+
+/* Converts pointer to heap element HEAP_ELEM into a pointer to
+   the structure that HEAP_ELEM is embedded inside.  Supply the
+   name of the outer structure STRUCT and the member name MEMBER
+   of the heap element. */
+#define heap_entry(HEAP_ELEM, STRUCT, MEMBER)           \
+        ((STRUCT *) ((uint8_t *) &(HEAP_ELEM)->child    \
+                     - offsetof (STRUCT, MEMBER.child)))
+
+/* Compares the value of two heap elements A and B, given
+   auxiliary data AUX.  Returns true if A is less than B, or
+   false if A is greater than or equal to B. */
+typedef bool heap_less_func (const struct heap_elem *a,
+                             const struct heap_elem *b,
+                             void *aux);
+
+/* Heap. */
+struct heap
+  {
+    struct heap_elem *root;     /* Least element, or null if empty. */
+    size_t size;                /* Number of elements. */
+    heap_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `less'. */
+  };
+
+void heap_init (struct heap *, heap_less_func *, void *aux);
+bool heap_empty (const struct heap *);
+size_t heap_size (const struct heap *);
+struct heap_elem *heap_min (const struct heap *);
+
+void heap_push (struct heap *, struct heap_elem *);
+struct heap_elem *heap_pop_min (struct heap *);
+void heap_decrease_key (struct heap *, struct heap_elem *);
+void heap_remove (struct heap *, struct heap_elem *);
+
+#endif /* lib/kernel/heap.h */
@@ -0,0 +1,477 @@
+/* Open-addressing hash table.
+
+   See ohash.h for basic information.
+
+   Elements live in a power-of-2 array of slots and are found by
+   linear probing from the slot selected by the low bits of their
+   hash value.  The table doubles when it would become more than
+   half full.  Deleting an element from the current slot array
+   shifts later elements of the same run back into the hole, so
+   the current array never needs "deleted" markers.
+
+   While the table grows, the old slot array is drained a few
+   slots at a time by every insertion and deletion, in slot
+   order.  New elements always go into the new array, so lookups
+   search both.  The old array is only ever emptied, never
+   refilled, so its vacated slots are simply marked with a
+   tombstone that probes step over; it is freed as soon as it
+   holds no more elements. */
+
+#include "ohash.h"
+#include "../debug.h"
+#include <string.h>
+#include "threads/malloc.h"
+
+/* Number of slots in a new table. */
+#define MIN_SLOTS 8
+
+/* Number of old slots moved by each insertion or deletion.  At a
+   load factor of one half this moves all of them long before the
+   new array fills up past its own limit. */
+#define MOVE_STEP 4
+
+/* Marks a vacated slot in the old slot array. */
+static struct hash_elem tombstone_elem;
+#define TOMBSTONE (&tombstone_elem)
+
+static struct ohash_slot *find_slot (struct ohash *, struct ohash_slot *,
+                                     size_t slot_cnt, unsigned hash,
+                                     struct hash_elem *);
+static struct ohash_slot *lookup (struct ohash *, unsigned hash,
+                                  struct hash_elem *);
+static void place (struct ohash *, unsigned hash, struct hash_elem *);
+static void remove_slot (struct ohash *, struct ohash_slot *);
+static bool grow (struct ohash *);
+static void move_old (struct ohash *, size_t cnt);
+static void free_old (struct ohash *);
+
+/* Returns true if SLOT holds an element. */
+static inline bool
+slot_used (const struct ohash_slot *slot)
+{
+  return slot->elem != NULL && slot->elem != TOMBSTONE;
+}
+
+/* Initializes hash table H to compute hash values using HASH and
+   compare hash elements using LESS, given auxiliary data AUX. */
+bool
+ohash_init (struct ohash *h,
+            hash_hash_func *hash, hash_less_func *less, void *aux)
+{
+  h->elem_cnt = 0;
+  h->used_cnt = 0;
+  h->slot_cnt = MIN_SLOTS;
+  h->slots = calloc (h->slot_cnt, sizeof *h->slots);
+  h->old_slots = NULL;
+  h->old_slot_cnt = 0;
+  h->old_used_cnt = 0;
+  h->move_idx = 0;
+  h->hash = hash;
+  h->less = less;
+  h->aux = aux;
+
+  /* Without slots, the first insertion will try again. */
+  if (h->slots == NULL)
+    {
+      h->slot_cnt = 0;
+      return false;
+    }
+  return true;
+}
+
+/* Removes all the elements from H.
+
+   If DESTRUCTOR is non-null, then it is called for each element
+   in the hash.  DESTRUCTOR may, if appropriate, deallocate the
+   memory used by the hash element.  However, modifying hash
+   table H while ohash_clear() is running, using any of the
+   functions ohash_clear(), ohash_destroy(), ohash_insert(),
+   ohash_replace(), or ohash_delete(), yields undefined behavior,
+   whether done in DESTRUCTOR or elsewhere. */
+void
+ohash_clear (struct ohash *h, hash_action_func *destructor)
+{
+  if (destructor != NULL)
+    ohash_apply (h, destructor);
+
+  free_old (h);
+  if (h->slots != NULL)
+    memset (h->slots, 0, sizeof *h->slots * h->slot_cnt);
+  h->used_cnt = 0;
+  h->elem_cnt = 0;
+}
+
+/* Destroys hash table H.
+
+   If DESTRUCTOR is non-null, then it is first called for each
+   element in the hash.  DESTRUCTOR may, if appropriate,
+   deallocate the memory used by the hash element.  However,
+   modifying hash table H while ohash_clear() is running, using
+   any of the functions ohash_clear(), ohash_destroy(),
+   ohash_insert(), ohash_replace(), or ohash_delete(), yields
+   undefined behavior, whether done in DESTRUCTOR or
+   elsewhere. */
+void
+ohash_destroy (struct ohash *h, hash_action_func *destructor)
+{
+  if (destructor != NULL)
+    ohash_apply (h, destructor);
+  free_old (h);
+  free (h->slots);
+}
+
+/* Inserts NEW into hash table H and returns a null pointer, if
+   no equal element is already in the table.
+   If an equal element is already in the table, returns it
+   without inserting NEW.
+   If the table is full and memory to grow it is not available,
+   returns NEW itself without inserting it. */
+struct hash_elem *
+ohash_insert (struct ohash *h, struct hash_elem *new)
+{
+  unsigned hash = h->hash (new, h->aux);
+  struct ohash_slot *slot = lookup (h, hash, new);
+
+  if (slot != NULL)
+    return slot->elem;
+  if (!grow (h))
+    return new;
+  place (h, hash, new);
+  move_old (h, MOVE_STEP);
+  return NULL;
+}
+
+/* Inserts NEW into hash table H, replacing any equal element
+   already in the table, which is returned.
+   If NEW is not equal to any element, the table is full, and
+   memory to grow it is not available, returns NEW itself without
+   inserting it. */
+struct hash_elem *
+ohash_replace (struct ohash *h, struct hash_elem *new)
+{
+  unsigned hash = h->hash (new, h->aux);
+  struct ohash_slot *slot = lookup (h, hash, new);
+
+  if (slot != NULL)
+    {
+      struct hash_elem *old = slot->elem;
+      slot->elem = new;
+      return old;
+    }
+  return ohash_insert (h, new);
+}
+
+/* Finds and returns an element equal to E in hash table H, or a
+   null pointer if no equal element exists in the table. */
+struct hash_elem *
+ohash_find (struct ohash *h, struct hash_elem *e)
+{
+  struct ohash_slot *slot = lookup (h, h->hash (e, h->aux), e);
+  return slot != NULL ? slot->elem : NULL;
+}
+
+/* Finds, removes, and returns an element equal to E in hash
+   table H.  Returns a null pointer if no equal element existed
+   in the table.
+
+   If the elements of the hash table are dynamically allocated,
+   or own resources that are, then it is the caller's
+   responsibility to deallocate them. */
+struct hash_elem *
+ohash_delete (struct ohash *h, struct hash_elem *e)
+{
+  unsigned hash = h->hash (e, h->aux);
+  struct hash_elem *found = NULL;
+  struct ohash_slot *slot;
+
+  slot = find_slot (h, h->slots, h->slot_cnt, hash, e);
+  if (slot != NULL)
+    {
+      found = slot->elem;
+      remove_slot (h, slot);
+      h->used_cnt--;
+    }
+  else
+    {
+      slot = find_slot (h, h->old_slots, h->old_slot_cnt, hash, e);
+      if (slot == NULL)
+        return NULL;
+      found = slot->elem;
+      slot->elem = TOMBSTONE;
+      if (--h->old_used_cnt == 0)
+        free_old (h);
+    }
+  h->elem_cnt--;
+  move_old (h, MOVE_STEP);
+  return found;
+}
+
+/* Calls ACTION for each element in hash table H in arbitrary
+   order.
+   Modifying hash table H while ohash_apply() is running, using
+   any of the functions ohash_clear(), ohash_destroy(),
+   ohash_insert(), ohash_replace(), or ohash_delete(), yields
+   undefined behavior, whether done from ACTION or elsewhere. */
+void
+ohash_apply (struct ohash *h, hash_action_func *action)
+{
+  struct ohash_iterator i;
+
+  ASSERT (action != NULL);
+
+  ohash_first (&i, h);
+  while (ohash_next (&i))
+    action (ohash_cur (&i), h->aux);
+}
+
+/* Initializes I for iterating hash table H.
+
+   Iteration idiom:
+
+      struct ohash_iterator i;
+
+      ohash_first (&i, h);
+      while (ohash_next (&i))
+        {
+          struct foo *f = hash_entry (ohash_cur (&i), struct foo, elem);
+          ...do something with f...
+        }
+
+   Modifying hash table H during iteration, using any of the
+   functions ohash_clear(), ohash_destroy(), ohash_insert(),
+   ohash_replace(), or ohash_delete(), invalidates all
+   iterators. */
+void
+ohash_first (struct ohash_iterator *i, struct ohash *h)
+{
+  ASSERT (i != NULL);
+  ASSERT (h != NULL);
+
+  i->hash = h;
+  i->slot = NULL;
+  i->elem = NULL;
+}
+
+/* Advances I to the next element in the hash table and returns
+   it.  Returns a null pointer if no elements are left.  Elements
+   are returned in arbitrary order: those still in the old slot
+   array, if any, come first.
+
+   Modifying a hash table H during iteration, using any of the
+   functions ohash_clear(), ohash_destroy(), ohash_insert(),
+   ohash_replace(), or ohash_delete(), invalidates all
+   iterators. */
+struct hash_elem *
+ohash_next (struct ohash_iterator *i)
+{
+  struct ohash *h;
+
+  ASSERT (i != NULL);
+
+  h = i->hash;
+  if (i->slot == NULL)
+    i->slot = h->old_slots != NULL ? h->old_slots : h->slots;
+  else
+    i->slot++;
+
+  for (;;)
+    {
+      if (h->old_slots != NULL && i->slot == h->old_slots + h->old_slot_cnt)
+        i->slot = h->slots;
+      if (i->slot == h->slots + h->slot_cnt)
+        {
+          i->elem = NULL;
+          break;
+        }
+      if (slot_used (i->slot))
+        {
+          i->elem = i->slot->elem;
+          break;
+        }
+      i->slot++;
+    }
+
+  return i->elem;
+}
+
+/* Returns the current element in the hash table iteration, or a
+   null pointer at the end of the table.  Undefined behavior
+   after calling ohash_first() but before ohash_next(). */
+struct hash_elem *
+ohash_cur (struct ohash_iterator *i)
+{
+  return i->elem;
+}
+
+/* Returns the number of elements in H. */
+size_t
+ohash_size (struct ohash *h)
+{
+  return h->elem_cnt;
+}
+
+/* Returns true if H contains no elements, false otherwise. */
+bool
+ohash_empty (struct ohash *h)
+{
+  return h->elem_cnt == 0;
+}
+
+/* Returns true if A and B are equal, according to H. */
+static inline bool
+is_equal (struct ohash *h, const struct hash_elem *a,
+          const struct hash_elem *b)
+{
+  return !h->less (a, b, h->aux) && !h->less (b, a, h->aux);
+}
+
+/* Searches the SLOT_CNT slots in SLOTS for an element equal to
+   E, whose hash value is HASH.  Returns its slot, or a null
+   pointer if there is none. */
+static struct ohash_slot *
+find_slot (struct ohash *h, struct ohash_slot *slots, size_t slot_cnt,
+           unsigned hash, struct hash_elem *e)
+{
+  size_t mask = slot_cnt - 1;
+  size_t idx;
+
+  if (slots == NULL)
+    return NULL;
+
+  for (idx = hash & mask; slots[idx].elem != NULL; idx = (idx + 1) & mask)
+    if (slots[idx].hash == hash && slots[idx].elem != TOMBSTONE
+        && is_equal (h, slots[idx].elem, e))
+      return &slots[idx];
+  return NULL;
+}
+
+/* Returns the slot of H holding an element equal to E, whose
+   hash value is HASH, in either slot array, or a null pointer if
+   there is none. */
+static struct ohash_slot *
+lookup (struct ohash *h, unsigned hash, struct hash_elem *e)
+{
+  struct ohash_slot *slot = find_slot (h, h->slots, h->slot_cnt, hash, e);
+  if (slot == NULL)
+    slot = find_slot (h, h->old_slots, h->old_slot_cnt, hash, e);
+  return slot;
+}
+
+/* Puts E, whose hash value is HASH, into the first empty slot of
+   its run in H's current slot array, which must have room. */
+static void
+place (struct ohash *h, unsigned hash, struct hash_elem *e)
+{
+  size_t mask = h->slot_cnt - 1;
+  size_t idx;
+
+  ASSERT (h->used_cnt + 1 < h->slot_cnt);
+
+  for (idx = hash & mask; h->slots[idx].elem != NULL; idx = (idx + 1) & mask)
+    continue;
+  h->slots[idx].hash = hash;
+  h->slots[idx].elem = e;
+  h->used_cnt++;
+  h->elem_cnt++;
+}
+
+/* Empties SLOT in H's current slot array, moving back any later
+   element of the same run that could no longer be reached past
+   the hole. */
+static void
+remove_slot (struct ohash *h, struct ohash_slot *slot)
+{
+  size_t mask = h->slot_cnt - 1;
+  size_t hole = slot - h->slots;
+  size_t idx = hole;
+
+  for (;;)
+    {
+      size_t home;
+
+      idx = (idx + 1) & mask;
+      if (h->slots[idx].elem == NULL)
+        break;
+
+      /* The element at IDX may move to HOLE unless its home slot
+         lies cyclically within (HOLE, IDX]. */
+      home = h->slots[idx].hash & mask;
+      if (((idx - home) & mask) >= ((idx - hole) & mask))
+        {
+          h->slots[hole] = h->slots[idx];
+          hole = idx;
+        }
+    }
+  h->slots[hole].elem = NULL;
+}
+
+/* Makes sure that H's current slot array has room for one more
+   element while staying at most half full, starting a resize if
+   needed.  Returns false only if there is no room at all and no
+   memory to add more. */
+static bool
+grow (struct ohash *h)
+{
+  struct ohash_slot *slots;
+  size_t slot_cnt;
+
+  if ((h->used_cnt + 1) * 2 <= h->slot_cnt)
+    return true;
+
+  /* A resize must finish before another can start.  This does
+     not happen at the load factor we keep, but is cheap to
+     allow. */
+  if (h->old_slots != NULL)
+    move_old (h, h->old_slot_cnt);
+
+  slot_cnt = h->slot_cnt > 0 ? h->slot_cnt * 2 : MIN_SLOTS;
+  slots = calloc (slot_cnt, sizeof *slots);
+  if (slots == NULL)
+    return h->used_cnt + 1 < h->slot_cnt;
+
+  if (h->used_cnt > 0)
+    {
+      h->old_slots = h->slots;
+      h->old_slot_cnt = h->slot_cnt;
+      h->old_used_cnt = h->used_cnt;
+      h->move_idx = 0;
+    }
+  else
+    free (h->slots);
+  h->slots = slots;
+  h->slot_cnt = slot_cnt;
+  h->used_cnt = 0;
+  return true;
+}
+
+/* Moves the elements of up to CNT more of H's old slots into its
+   current slot array. */
+static void
+move_old (struct ohash *h, size_t cnt)
+{
+  while (h->old_slots != NULL && cnt-- > 0)
+    {
+      struct ohash_slot *slot = &h->old_slots[h->move_idx++];
+
+      if (slot_used (slot))
+        {
+          place (h, slot->hash, slot->elem);
+          h->elem_cnt--;
+          slot->elem = TOMBSTONE;
+          if (--h->old_used_cnt == 0)
+            free_old (h);
+        }
+    }
+}
+
+/* Frees H's old slot array, if any.  Its elements must have been
+   moved or discarded. */
+static void
+free_old (struct ohash *h)
+{
+  free (h->old_slots);
+  h->old_slots = NULL;
+  h->old_slot_cnt = 0;
+  h->old_used_cnt = 0;
+  h->move_idx = 0;
+}
@@ -0,0 +1,87 @@
+#ifndef __LIB_KERNEL_OHASH_H
+#define __LIB_KERNEL_OHASH_H
+
+/* Open-addressing hash table.
+
+   This is an alternative to the chained table in hash.h with the
+   same interface: elements embed the same struct hash_elem, are
+   converted back with hash_entry(), and are hashed and compared
+   with the same hash_hash_func and hash_less_func.  A structure
+   can therefore move from a struct hash to a struct ohash by
+   changing only the hash_*() calls to ohash_*().
+
+   The table is an array of slots, each holding a pointer to an
+   element along with the element's hash value, searched by
+   linear probing.  A lookup compares the stored hash values of
+   neighbouring slots and only calls the comparison function on
+   an element whose hash matches, so it usually touches the slot
+   array and the one element found, instead of every element of
+   a chain.
+
+   When the table grows, the elements are not all moved at once.
+   The old slot array is kept beside the new one and every
+   insertion or deletion moves a few more of its elements across,
+   so that no single operation pays for a full rehash. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "hash.h"
+
+/* A slot in an open-addressing hash table. */
+struct ohash_slot
+  {
+    unsigned hash;              /* Hash value of ELEM. */
+    struct hash_elem *elem;     /* Element, or null if slot is empty. */
+  };
+
+/* Open-addressing hash table. */
+struct ohash
+  {
+    size_t elem_cnt;            /* Number of elements in table. */
+    size_t slot_cnt;            /* Number of slots, a power of 2. */
+    size_t used_cnt;            /* Number of elements in `slots'. */
+    struct ohash_slot *slots;   /* Array of `slot_cnt' slots. */
+
+    /* Slots from before the last resize, whose elements are
+       still being moved into `slots', or null. */
+    struct ohash_slot *old_slots;
+    size_t old_slot_cnt;        /* Number of slots in `old_slots'. */
+    size_t old_used_cnt;        /* Number of elements in `old_slots'. */
+    size_t move_idx;            /* Next slot of `old_slots' to move. */
+
+    hash_hash_func *hash;       /* Hash function. */
+    hash_less_func *less;       /* Comparison function. */
+    void *aux;                  /* Auxiliary data for `hash' and `less'. */
+  };
+
+/* An open-addressing hash table iterator. */
+struct ohash_iterator
+  {
+    struct ohash *hash;         /* The hash table. */
+    struct ohash_slot *slot;    /* Current slot. */
+    struct hash_elem *elem;     /* Current hash element. */
+  };
+
+/* Basic life cycle. */
+bool ohash_init (struct ohash *, hash_hash_func *, hash_less_func *,
+                 void *aux);
+void ohash_clear (struct ohash *, hash_action_func *);
+void ohash_destroy (struct ohash *, hash_action_func *);
+
+/* Search, insertion, deletion. */
+struct hash_elem *ohash_insert (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_replace (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_find (struct ohash *, struct hash_elem *);
+struct hash_elem *ohash_delete (struct ohash *, struct hash_elem *);
+
+/* Iteration. */
+void ohash_apply (struct ohash *, hash_action_func *);
+void ohash_first (struct ohash_iterator *, struct ohash *);
+struct hash_elem *ohash_next (struct ohash_iterator *);
+struct hash_elem *ohash_cur (struct ohash_iterator *);
+
+/* Information. */
+size_t ohash_size (struct ohash *);
+bool ohash_empty (struct ohash *);
+
+#endif /* lib/kernel/ohash.h */
@@ -0,0 +1,451 @@
+/* Radix tree.
+
+   See radix.h for basic information.
+
+   A tree of height H holds indexes 0 through max_index(H).  Its
+   root is a node of height H, whose slots point to nodes of
+   height H - 1, and so on down to nodes of height 1, whose slots
+   point to the items themselves.  Missing subtrees are null.
+
+   Each node counts its non-null slots, so that radix_delete()
+   can free nodes as they empty.  It also keeps, for each tag, a
+   bitmap of the slots that lead to at least one item with that
+   tag; ROOT_TAGS in the tree plays the same part for the root
+   pointer.  Setting a tag sets its bit all the way down the path
+   to the item, and clearing it clears bits back up the path only
+   as far as they no longer cover any tagged item. */
+
+#include "radix.h"
+#include "../debug.h"
+#include <round.h>
+#include "threads/malloc.h"
+
+/* Mask of the index bits consumed by one level. */
+#define RADIX_MASK (RADIX_SLOTS - 1)
+
+/* Greatest possible height. */
+#define MAX_HEIGHT DIV_ROUND_UP (sizeof (size_t) * 8, RADIX_SHIFT)
+
+/* Bit for slot I in a node's tag bitmaps, which limits
+   RADIX_SLOTS to 64. */
+#define SLOT_BIT(I) ((uint64_t) 1 << (I))
+
+/* A tree node. */
+struct radix_node
+  {
+    void *slots[RADIX_SLOTS];           /* Subtrees or items. */
+    uint64_t tags[RADIX_TAG_CNT];       /* Slots leading to each tag. */
+    unsigned count;                     /* Non-null slots. */
+  };
+
+/* One step of the path from the root down to an item. */
+struct path_step
+  {
+    struct radix_node *node;            /* Node. */
+    unsigned ofs;                       /* Slot taken in NODE. */
+  };
+
+static bool extend (struct radix_tree *, size_t index);
+static void shrink (struct radix_tree *);
+static void free_subtree (struct radix_node *, unsigned height);
+static void *find_path (const struct radix_tree *, size_t index,
+                        struct path_step[]);
+static void clear_tag_path (struct radix_tree *, struct path_step[],
+                            unsigned tag);
+static size_t gang_lookup (const struct radix_tree *, size_t first, int tag,
+                           void **items, size_t max);
+static size_t gang_lookup_node (const struct radix_node *, unsigned height,
+                                size_t base, size_t first, int tag,
+                                void **items, size_t max);
+
+/* Returns the largest index that a tree of HEIGHT can hold. */
+static inline size_t
+max_index (unsigned height)
+{
+  if (height * RADIX_SHIFT >= sizeof (size_t) * 8)
+    return SIZE_MAX;
+  return ((size_t) 1 << (height * RADIX_SHIFT)) - 1;
+}
+
+/* Returns the slot that INDEX takes in a node of HEIGHT. */
+static inline unsigned
+slot_ofs (size_t index, unsigned height)
+{
+  return (index >> ((height - 1) * RADIX_SHIFT)) & RADIX_MASK;
+}
+
+/* Initializes TREE as an empty radix tree. */
+void
+radix_init (struct radix_tree *tree)
+{
+  ASSERT (tree != NULL);
+
+  tree->root = NULL;
+  tree->height = 0;
+  tree->root_tags = 0;
+}
+
+/* Frees every node of TREE, leaving it empty.  The items
+   themselves are not touched. */
+void
+radix_destroy (struct radix_tree *tree)
+{
+  if (tree->height > 0 && tree->root != NULL)
+    free_subtree (tree->root, tree->height);
+  radix_init (tree);
+}
+
+/* Returns true if TREE holds no items. */
+bool
+radix_empty (const struct radix_tree *tree)
+{
+  return tree->root == NULL;
+}
+
+/* Stores ITEM, which must not be null, at INDEX in TREE, with no
+   tags.  Returns true if successful, false if INDEX already holds
+   an item or if memory is short, in which case TREE is
+   unchanged. */
+bool
+radix_insert (struct radix_tree *tree, size_t index, void *item)
+{
+  struct radix_node *parent = NULL;
+  struct radix_node *new_parent = NULL;
+  void **slot, **new_slot = NULL;
+  unsigned h, new_height = 0;
+
+  ASSERT (item != NULL);
+
+  if (index > max_index (tree->height) && !extend (tree, index))
+    return false;
+
+  slot = &tree->root;
+  for (h = tree->height; h > 0; h--)
+    {
+      if (*slot == NULL)
+        {
+          struct radix_node *n = calloc (1, sizeof *n);
+          if (n == NULL)
+            goto fail;
+          if (new_slot == NULL)
+            {
+              new_slot = slot;
+              new_parent = parent;
+              new_height = h;
+            }
+          *slot = n;
+          if (parent != NULL)
+            parent->count++;
+        }
+      parent = *slot;
+      slot = &parent->slots[slot_ofs (index, h)];
+    }
+  if (*slot != NULL)
+    return false;
+
+  *slot = item;
+  if (parent != NULL)
+    parent->count++;
+  return true;
+
+ fail:
+  /* Take back the nodes added on the way down. */
+  if (new_slot != NULL)
+    {
+      free_subtree (*new_slot, new_height);
+      *new_slot = NULL;
+      if (new_parent != NULL)
+        new_parent->count--;
+    }
+  if (tree->root == NULL)
+    tree->height = 0;
+  return false;
+}
+
+/* Returns the item at INDEX in TREE, or a null pointer if there
+   is none. */
+void *
+radix_lookup (const struct radix_tree *tree, size_t index)
+{
+  void *p = tree->root;
+  unsigned h;
+
+  if (index > max_index (tree->height))
+    return NULL;
+  for (h = tree->height; h > 0 && p != NULL; h--)
+    p = ((struct radix_node *) p)->slots[slot_ofs (index, h)];
+  return p;
+}
+
+/* Removes the item at INDEX from TREE, along with its tags, and
+   returns it.  Returns a null pointer if there is none. */
+void *
+radix_delete (struct radix_tree *tree, size_t index)
+{
+  struct path_step path[MAX_HEIGHT];
+  void *item = find_path (tree, index, path);
+  unsigned tag, i;
+
+  if (item == NULL)
+    return NULL;
+
+  for (tag = 0; tag < RADIX_TAG_CNT; tag++)
+    clear_tag_path (tree, path, tag);
+
+  /* Unlink ITEM, then free the nodes that it leaves empty. */
+  for (i = tree->height; ; i--)
+    {
+      struct radix_node *n;
+
+      if (i == 0)
+        {
+          tree->root = NULL;
+          tree->height = 0;
+          break;
+        }
+      n = path[i - 1].node;
+      n->slots[path[i - 1].ofs] = NULL;
+      if (--n->count > 0)
+        break;
+      free (n);
+    }
+  shrink (tree);
+
+  return item;
+}
+
+/* Stores in ITEMS up to MAX items from TREE, in ascending order
+   of index, starting from the first at or after index FIRST.
+   Returns the number stored. */
+size_t
+radix_gang_lookup (const struct radix_tree *tree, size_t first,
+                   void **items, size_t max)
+{
+  return gang_lookup (tree, first, -1, items, max);
+}
+
+/* Sets TAG on the item at INDEX in TREE, which must exist. */
+void
+radix_tag_set (struct radix_tree *tree, size_t index, unsigned tag)
+{
+  struct path_step path[MAX_HEIGHT];
+  void *item = find_path (tree, index, path);
+  unsigned i;
+
+  ASSERT (tag < RADIX_TAG_CNT);
+  ASSERT (item != NULL);
+
+  for (i = 0; i < tree->height; i++)
+    path[i].node->tags[tag] |= SLOT_BIT (path[i].ofs);
+  tree->root_tags |= 1u << tag;
+}
+
+/* Clears TAG on the item at INDEX in TREE, if there is one. */
+void
+radix_tag_clear (struct radix_tree *tree, size_t index, unsigned tag)
+{
+  struct path_step path[MAX_HEIGHT];
+
+  ASSERT (tag < RADIX_TAG_CNT);
+
+  if (find_path (tree, index, path) != NULL)
+    clear_tag_path (tree, path, tag);
+}
+
+/* Returns true if TREE holds an item at INDEX with TAG set. */
+bool
+radix_tag_get (const struct radix_tree *tree, size_t index, unsigned tag)
+{
+  struct path_step path[MAX_HEIGHT];
+  const struct path_step *leaf;
+
+  ASSERT (tag < RADIX_TAG_CNT);
+
+  if (find_path (tree, index, path) == NULL)
+    return false;
+  if (tree->height == 0)
+    return (tree->root_tags & (1u << tag)) != 0;
+  leaf = &path[tree->height - 1];
+  return (leaf->node->tags[tag] & SLOT_BIT (leaf->ofs)) != 0;
+}
+
+/* Returns true if any item in TREE has TAG set. */
+bool
+radix_tagged (const struct radix_tree *tree, unsigned tag)
+{
+  ASSERT (tag < RADIX_TAG_CNT);
+
+  return (tree->root_tags & (1u << tag)) != 0;
+}
+
+/* Stores in ITEMS up to MAX items from TREE that have TAG set, in
+   ascending order of index, starting from the first at or after
+   index FIRST.  Returns the number stored.  Subtrees without any
+   such item are skipped without being visited. */
+size_t
+radix_gang_lookup_tag (const struct radix_tree *tree, size_t first,
+                       unsigned tag, void **items, size_t max)
+{
+  ASSERT (tag < RADIX_TAG_CNT);
+
+  return gang_lookup (tree, first, tag, items, max);
+}
+
+/* Adds levels on top of TREE until it can hold INDEX.  Returns
+   false if memory is short, leaving TREE taller than before but
+   otherwise unchanged. */
+static bool
+extend (struct radix_tree *tree, size_t index)
+{
+  unsigned height = tree->height + 1;
+
+  while (index > max_index (height))
+    height++;
+
+  /* An empty tree needs no nodes until something goes in. */
+  if (tree->root == NULL)
+    {
+      tree->height = height;
+      return true;
+    }
+
+  while (tree->height < height)
+    {
+      struct radix_node *n = calloc (1, sizeof *n);
+      unsigned tag;
+
+      if (n == NULL)
+        return false;
+      n->slots[0] = tree->root;
+      n->count = 1;
+      for (tag = 0; tag < RADIX_TAG_CNT; tag++)
+        if (tree->root_tags & (1u << tag))
+          n->tags[tag] = SLOT_BIT (0);
+      tree->root = n;
+      tree->height++;
+    }
+  return true;
+}
+
+/* Removes levels from the top of TREE for as long as the root
+   node uses only its first slot. */
+static void
+shrink (struct radix_tree *tree)
+{
+  while (tree->height > 0)
+    {
+      struct radix_node *n = tree->root;
+
+      if (n->count != 1 || n->slots[0] == NULL)
+        break;
+      tree->root = n->slots[0];
+      tree->height--;
+      free (n);
+    }
+}
+
+/* Frees node N, of HEIGHT, and all the nodes below it. */
+static void
+free_subtree (struct radix_node *n, unsigned height)
+{
+  if (height > 1)
+    {
+      unsigned i;
+
+      for (i = 0; i < RADIX_SLOTS; i++)
+        if (n->slots[i] != NULL)
+          free_subtree (n->slots[i], height - 1);
+    }
+  free (n);
+}
+
+/* Records in PATH, which must have room for MAX_HEIGHT steps,
+   the way from TREE's root down to the item at INDEX.  Returns
+   the item, or a null pointer if there is none. */
+static void *
+find_path (const struct radix_tree *tree, size_t index,
+           struct path_step path[])
+{
+  void *p = tree->root;
+  unsigned h;
+
+  if (index > max_index (tree->height))
+    return NULL;
+  for (h = tree->height; h > 0; h--)
+    {
+      struct radix_node *n = p;
+
+      if (n == NULL)
+        return NULL;
+      path->node = n;
+      path->ofs = slot_ofs (index, h);
+      p = n->slots[path->ofs];
+      path++;
+    }
+  return p;
+}
+
+/* Clears TAG for the last step of PATH, found by find_path() in
+   TREE, and for each step above it that no longer leads to any
+   item with TAG. */
+static void
+clear_tag_path (struct radix_tree *tree, struct path_step path[],
+                unsigned tag)
+{
+  unsigned i;
+
+  for (i = tree->height; i > 0; i--)
+    {
+      struct radix_node *n = path[i - 1].node;
+
+      n->tags[tag] &= ~SLOT_BIT (path[i - 1].ofs);
+      if (n->tags[tag] != 0)
+        return;
+    }
+  tree->root_tags &= ~(1u << tag);
+}
+
+/* Common code for radix_gang_lookup() and
+   radix_gang_lookup_tag().  A negative TAG matches every item. */
+static size_t
+gang_lookup (const struct radix_tree *tree, size_t first, int tag,
+             void **items, size_t max)
+{
+  if (max == 0 || tree->root == NULL || first > max_index (tree->height))
+    return 0;
+  if (tag >= 0 && !(tree->root_tags & (1u << tag)))
+    return 0;
+  if (tree->height == 0)
+    {
+      items[0] = tree->root;
+      return 1;
+    }
+  return gang_lookup_node (tree->root, tree->height, 0, first, tag,
+                           items, max);
+}
+
+/* Stores in ITEMS up to MAX matching items below node N, of
+   HEIGHT, whose first slot covers index BASE, starting from
+   index FIRST.  Returns the number stored. */
+static size_t
+gang_lookup_node (const struct radix_node *n, unsigned height, size_t base,
+                  size_t first, int tag, void **items, size_t max)
+{
+  unsigned shift = (height - 1) * RADIX_SHIFT;
+  unsigned i = first > base ? (first - base) >> shift : 0;
+  size_t cnt = 0;
+
+  for (; i < RADIX_SLOTS && cnt < max; i++)
+    {
+      void *p = n->slots[i];
+
+      if (p == NULL || (tag >= 0 && !(n->tags[tag] & SLOT_BIT (i))))
+        continue;
+      if (height == 1)
+        items[cnt++] = p;
+      else
+        cnt += gang_lookup_node (p, height - 1, base + ((size_t) i << shift),
+                                 first, tag, items + cnt, max - cnt);
+    }
+  return cnt;
+}
@@ -0,0 +1,66 @@
+#ifndef __LIB_KERNEL_RADIX_H
+#define __LIB_KERNEL_RADIX_H
+
+/* Radix tree.
+
+   Maps size_t indexes, such as page numbers within a file, to
+   non-null pointers.  Unlike a hash table, a radix tree keeps its
+   items in index order, so that a range of indexes can be
+   scanned cheaply, and its size tracks the span of indexes in
+   use rather than a load factor, so that it never needs to be
+   rehashed.
+
+   Each level of the tree consumes RADIX_SHIFT bits of the index,
+   most significant first.  The tree is only as tall as the
+   largest index requires: a tree whose only item has index 0
+   stores it in the root pointer without allocating any node, and
+   one whose indexes are all below RADIX_SLOTS needs one node.
+
+   Every item may also carry up to RADIX_TAG_CNT tags, whose
+   meaning is up to the user (for example, "dirty" and "under
+   writeback").  Every node records which of its slots lead to a
+   tagged item, so radix_gang_lookup_tag() finds the tagged items
+   of a large, mostly untagged tree without visiting the rest.
+
+   The tree allocates its nodes with malloc(), so radix_insert()
+   can fail.  It does no locking of its own. */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Index bits consumed by each level, and slots per node. */
+#define RADIX_SHIFT 6
+#define RADIX_SLOTS (1 << RADIX_SHIFT)
+
+/* Number of distinct tags per item. */
+#define RADIX_TAG_CNT 2
+
+struct radix_node;
+
+/* Radix tree. */
+struct radix_tree
+  {
+    void *root;                 /* Top node, or the item if HEIGHT is 0. */
+    unsigned height;            /* Levels of nodes. */
+    uint8_t root_tags;          /* Bit T set if any item has tag T. */
+  };
+
+void radix_init (struct radix_tree *);
+void radix_destroy (struct radix_tree *);
+bool radix_empty (const struct radix_tree *);
+
+bool radix_insert (struct radix_tree *, size_t index, void *item);
+void *radix_lookup (const struct radix_tree *, size_t index);
+void *radix_delete (struct radix_tree *, size_t index);
+size_t radix_gang_lookup (const struct radix_tree *, size_t first,
+                          void **items, size_t max);
+
+void radix_tag_set (struct radix_tree *, size_t index, unsigned tag);
+void radix_tag_clear (struct radix_tree *, size_t index, unsigned tag);
+bool radix_tag_get (const struct radix_tree *, size_t index, unsigned tag);
+bool radix_tagged (const struct radix_tree *, unsigned tag);
+size_t radix_gang_lookup_tag (const struct radix_tree *, size_t first,
+                              unsigned tag, void **items, size_t max);
+
+#endif /* lib/kernel/radix.h */
@@ -0,0 +1,24 @@
+#ifndef __LIB_POLL_H
+#define __LIB_POLL_H
+
+/* One file descriptor for poll(), and what to wait for on it.
+   Shared by user programs and the kernel. */
+struct pollfd
+  {
+    int fd;                     /* File descriptor. */
+    short events;               /* Events to wait for. */
+    short revents;              /* Events that happened. */
+  };
+
+/* Events.  POLLERR, POLLHUP and POLLNVAL are reported in
+   `revents' whether or not they are asked for in `events'. */
+#define POLLIN 0x001            /* Data may be read without waiting. */
+#define POLLOUT 0x004           /* Data may be written without waiting. */
+#define POLLERR 0x008           /* Write end of a pipe with no reader. */
+#define POLLHUP 0x010           /* Read end of a pipe with no writer. */
+#define POLLNVAL 0x020          /* FD is not open. */
+
+/* Maximum number of descriptors in one poll() call. */
+#define POLL_MAX 16
+
+#endif /* lib/poll.h */
@@ -0,0 +1,26 @@
+#ifndef __LIB_RUSAGE_H
+#define __LIB_RUSAGE_H
+
+#include <stdint.h>
+
+/* Resources used by a process, as returned by the getrusage()
+   system call.  Counted for each thread and summed over all the
+   threads of a process, past and present, plus those of the
+   children it has waited for.  Shared by user programs and the
+   kernel. */
+struct rusage
+  {
+    uint64_t ticks;             /* Timer ticks spent running. */
+    uint64_t page_faults;       /* Page faults taken. */
+    uint64_t read_sectors;      /* Disk sectors read. */
+    uint64_t write_sectors;     /* Disk sectors written. */
+    uint64_t syscalls;          /* System calls made. */
+    uint64_t evictions;         /* Frames taken from other pages. */
+    uint64_t swap_ins;          /* Pages read back from swap. */
+    uint64_t swap_outs;         /* Pages written to swap. */
+    uint64_t user_ns;           /* Nanoseconds in user mode. */
+    uint64_t kernel_ns;         /* Nanoseconds in the kernel. */
+    uint64_t intr_ns;           /* Nanoseconds in interrupts. */
+  };
+
+#endif /* lib/rusage.h */
@@ -0,0 +1,36 @@
+#ifndef __LIB_SCHED_STATS_H
+#define __LIB_SCHED_STATS_H
+
+#include <stdint.h>
+
+/* Scheduling classes, for set_sched_class().  A batch thread
+   runs only when no normal thread is ready, with a long time
+   slice, and never preempts another thread.  A deadline thread,
+   which set_deadline() makes, runs ahead of all the others, the
+   one whose period ends soonest first, for up to its budget in
+   each period. */
+#define SCHED_NORMAL 0          /* Round-robin or MLFQS (default). */
+#define SCHED_BATCH 1           /* Background, CPU-bound. */
+#define SCHED_DEADLINE 2        /* Periodic, earliest deadline first. */
+
+/* Number of buckets in the wakeup latency histogram. */
+#define SCHED_LATENCY_BUCKETS 32
+
+/* Scheduler statistics, as returned by the sched_stats() system
+   call.  Times are in CPU cycles as counted by the time-stamp
+   counter.  Shared by user programs and the kernel. */
+struct sched_stats
+  {
+    /* For the thread asked about, since it was created. */
+    uint64_t ready_time;        /* Time ready to run but not running. */
+    uint64_t voluntary_cnt;     /* Switches away because it blocked. */
+    uint64_t involuntary_cnt;   /* Switches away while still ready. */
+
+    /* For all threads since boot.  latency[I] counts the threads
+       woken by thread_unblock() that took from 2**I to
+       2**(I+1) - 1 cycles to start running.  The first bucket
+       also counts quicker ones and the last slower ones. */
+    uint64_t latency[SCHED_LATENCY_BUCKETS];
+  };
+
+#endif /* lib/sched-stats.h */
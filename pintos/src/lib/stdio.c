@@ -14,6 +14,7 @@ struct vsnprintf_aux
   };
 
 static void vsnprintf_helper (char, void *);
+static void vsnprintf_buf_helper (const char *, size_t, void *);
 
 /* Like vprintf(), except that output is stored into BUFFER,
    which must have space for BUF_SIZE characters.  Writes at most
@@ -32,7 +33,8 @@ vsnprintf (char *buffer, size_t buf_size, const char *format, va_list args)
   aux.max_length = buf_size > 0 ? buf_size - 1 : 0;
 
   /* Do most of the work. */
-  __vprintf (format, args, vsnprintf_helper, &aux);
+  __vprintf_buf (format, args, vsnprintf_helper, vsnprintf_buf_helper,
+                 &aux);
 
   /* Add null terminator. */
   if (buf_size > 0)
@@ -51,6 +53,23 @@ vsnprintf_helper (char ch, void *aux_)
     *aux->p++ = ch;
 }
 
+/* Helper function for vsnprintf() that stores the N characters
+   in BUFFER at once. */
+static void
+vsnprintf_buf_helper (const char *buffer, size_t n, void *aux_)
+{
+  struct vsnprintf_aux *aux = aux_;
+  int left = aux->max_length - aux->length;
+
+  if (left > 0)
+    {
+      size_t copy_cnt = n < (size_t) left ? n : (size_t) left;
+      memcpy (aux->p, buffer, copy_cnt);
+      aux->p += copy_cnt;
+    }
+  aux->length += n;
+}
+
 /* Like printf(), except that output is stored into BUFFER,
    which must have space for BUF_SIZE characters.  Writes at most
    BUF_SIZE - 1 characters to BUFFER, followed by a null
@@ -152,19 +171,45 @@ static void output_dup (char ch, size_t cnt,
 static void format_string (const char *string, int length,
                            struct printf_conversion *,
                            void (*output) (char, void *), void *aux);
+static bool format_simple (char conversion, va_list *,
+                           void (*output) (char, void *),
+                           void (*output_buf) (const char *, size_t,
+                                               void *),
+                           void *aux);
+static void output_str (const char *string, size_t length,
+                        void (*output) (char, void *),
+                        void (*output_buf) (const char *, size_t, void *),
+                        void *aux);
 
 void
 __vprintf (const char *format, va_list args,
            void (*output) (char, void *), void *aux)
 {
-  for (; *format != '\0'; format++)
+  __vprintf_buf (format, args, output, NULL, aux);
+}
+
+/* Like __vprintf(), but if OUTPUT_BUF is nonnull, hands it runs
+   of literal text and the results of plain %d, %s, and %x
+   conversions as whole strings, instead of calling OUTPUT once
+   per character. */
+void
+__vprintf_buf (const char *format, va_list args,
+               void (*output) (char, void *),
+               void (*output_buf) (const char *, size_t, void *),
+               void *aux)
+{
+  while (*format != '\0')
     {
       struct printf_conversion c;
+      const char *run;
 
-      /* Literally copy non-conversions to output. */
-      if (*format != '%') 
+      /* Literally copy non-conversions to output, a run at a
+         time. */
+      for (run = format; *format != '\0' && *format != '%'; format++)
+        continue;
+      if (format > run)
         {
-          output (*format, aux);
+          output_str (run, format - run, output, output_buf, aux);
           continue;
         }
       format++;
@@ -173,6 +218,14 @@ __vprintf (const char *format, va_list args,
       if (*format == '%') 
         {
           output ('%', aux);
+          format++;
+          continue;
+        }
+
+      /* Take a shortcut for the most common conversions. */
+      if (format_simple (*format, &args, output, output_buf, aux))
+        {
+          format++;
           continue;
         }
 
@@ -329,9 +382,85 @@ __vprintf (const char *format, va_list args,
           __printf ("<<no %%%c conversion>>", output, aux, *format);
           break;
         }
+      format++;
     }
 }
 
+/* If CONVERSION, the character following a `%', is `d', `s',
+   or `x', so that the conversion has no flags, field width,
+   precision, or type modifier, formats the next argument in
+   *ARGS and writes it to OUTPUT_BUF (or OUTPUT) with auxiliary
+   data AUX all at once, and returns true.  Otherwise, returns
+   false without consuming an argument. */
+static bool
+format_simple (char conversion, va_list *args,
+               void (*output) (char, void *),
+               void (*output_buf) (const char *, size_t, void *),
+               void *aux)
+{
+  char buf[16], *cp = buf + sizeof buf;
+
+  switch (conversion)
+    {
+    case 'd':
+      {
+        int value = va_arg (*args, int);
+        unsigned int abs = value;
+
+        if (value < 0)
+          abs = -abs;
+
+        do
+          *--cp = '0' + abs % 10;
+        while ((abs /= 10) != 0);
+        if (value < 0)
+          *--cp = '-';
+      }
+      break;
+
+    case 'x':
+      {
+        unsigned int value = va_arg (*args, unsigned int);
+
+        do
+          *--cp = base_x.digits[value & 0xf];
+        while ((value >>= 4) != 0);
+      }
+      break;
+
+    case 's':
+      {
+        const char *s = va_arg (*args, char *);
+        if (s == NULL)
+          s = "(null)";
+        output_str (s, strlen (s), output, output_buf, aux);
+      }
+      return true;
+
+    default:
+      return false;
+    }
+
+  output_str (cp, buf + sizeof buf - cp, output, output_buf, aux);
+  return true;
+}
+
+/* Writes the LENGTH characters starting at STRING to OUTPUT_BUF,
+   if it is nonnull, or to OUTPUT one at a time, with auxiliary
+   data AUX. */
+static void
+output_str (const char *string, size_t length,
+            void (*output) (char, void *),
+            void (*output_buf) (const char *, size_t, void *),
+            void *aux)
+{
+  if (output_buf != NULL)
+    output_buf (string, length, aux);
+  else
+    while (length-- > 0)
+      output (*string++, aux);
+}
+
 /* Parses conversion option characters starting at FORMAT and
    initializes C appropriately.  Returns the character in FORMAT
    that indicates the conversion (e.g. the `d' in `%d').  Uses
@@ -3,6 +3,7 @@
 #include <random.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Converts a string representation of a signed decimal integer
    in S into an `int', which is returned. */
@@ -52,7 +53,7 @@ compare_thunk (const void *a, const void *b, void *aux)
    using COMPARE.  When COMPARE is passed a pair of elements A
    and B, respectively, it must return a strcmp()-type result,
    i.e. less than zero if A < B, zero if A == B, greater than
-   zero if A > B.  Runs in O(n lg n) time and O(1) space in
+   zero if A > B.  Runs in O(n lg n) time and O(lg n) space in
    CNT. */
 void
 qsort (void *array, size_t cnt, size_t size,
@@ -61,21 +62,41 @@ qsort (void *array, size_t cnt, size_t size,
   sort (array, cnt, size, compare_thunk, &compare);
 }
 
-/* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
-   with elements of SIZE bytes each. */
+/* Swaps the SIZE-byte elements at A and B, a word at a time if
+   both are word-aligned and SIZE is a multiple of the word
+   size. */
 static void
-do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
+swap_elems (unsigned char *a, unsigned char *b, size_t size)
 {
-  unsigned char *a = array + (a_idx - 1) * size;
-  unsigned char *b = array + (b_idx - 1) * size;
   size_t i;
 
-  for (i = 0; i < size; i++)
+  if ((((uintptr_t) a | (uintptr_t) b | size) & (sizeof (uint32_t) - 1)) == 0)
     {
-      unsigned char t = a[i];
-      a[i] = b[i];
-      b[i] = t;
+      uint32_t *wa = (uint32_t *) a;
+      uint32_t *wb = (uint32_t *) b;
+
+      for (i = 0; i < size / sizeof (uint32_t); i++)
+        {
+          uint32_t t = wa[i];
+          wa[i] = wb[i];
+          wb[i] = t;
+        }
     }
+  else
+    for (i = 0; i < size; i++)
+      {
+        unsigned char t = a[i];
+        a[i] = b[i];
+        b[i] = t;
+      }
+}
+
+/* Swaps elements with 1-based indexes A_IDX and B_IDX in ARRAY
+   with elements of SIZE bytes each. */
+static void
+do_swap (unsigned char *array, size_t a_idx, size_t b_idx, size_t size)
+{
+  swap_elems (array + (a_idx - 1) * size, array + (b_idx - 1) * size, size);
 }
 
 /* Compares elements with 1-based indexes A_IDX and B_IDX in
@@ -122,33 +143,146 @@ heapify (unsigned char *array, size_t i, size_t cnt, size_t size,
     }
 }
 
+/* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
+   by heapsort, using COMPARE to compare elements, passing AUX as
+   auxiliary data. */
+static void
+heap_sort (unsigned char *array, size_t cnt, size_t size,
+           int (*compare) (const void *, const void *, void *aux),
+           void *aux) 
+{
+  size_t i;
+
+  /* Build a heap. */
+  for (i = cnt / 2; i > 0; i--)
+    heapify (array, i, cnt, size, compare, aux);
+
+  /* Sort the heap. */
+  for (i = cnt; i > 1; i--) 
+    {
+      do_swap (array, 1, i, size);
+      heapify (array, 1, i - 1, size, compare, aux); 
+    }
+}
+
+/* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
+   by insertion sort, using COMPARE to compare elements, passing
+   AUX as auxiliary data. */
+static void
+insertion_sort (unsigned char *array, size_t cnt, size_t size,
+                int (*compare) (const void *, const void *, void *aux),
+                void *aux) 
+{
+  size_t i, j;
+
+  for (i = 1; i < cnt; i++)
+    for (j = i; j > 0; j--)
+      {
+        unsigned char *a = array + (j - 1) * size;
+        if (compare (a, a + size, aux) <= 0)
+          break;
+        swap_elems (a, a + size, size);
+      }
+}
+
+/* Ranges of at most this many elements are insertion sorted. */
+#define INSERTION_SORT_MAX 12
+
+/* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
+   using COMPARE to compare elements, passing AUX as auxiliary
+   data, by quicksort, switching to heapsort once DEPTH levels of
+   partitioning have failed to finish the job. */
+static void
+intro_sort (unsigned char *array, size_t cnt, size_t size,
+            int (*compare) (const void *, const void *, void *aux),
+            void *aux, int depth) 
+{
+  while (cnt > INSERTION_SORT_MAX)
+    {
+      unsigned char *mid = array + cnt / 2 * size;
+      unsigned char *last = array + (cnt - 1) * size;
+      size_t i, j;
+
+      if (depth-- == 0)
+        {
+          heap_sort (array, cnt, size, compare, aux);
+          return;
+        }
+
+      /* Order the first, middle, and last elements, then use
+         their median, moved to the front, as the pivot.  LAST is
+         then no less than the pivot, which stops the upward scan
+         below. */
+      if (compare (mid, array, aux) < 0)
+        swap_elems (mid, array, size);
+      if (compare (last, mid, aux) < 0)
+        {
+          swap_elems (last, mid, size);
+          if (compare (mid, array, aux) < 0)
+            swap_elems (mid, array, size);
+        }
+      swap_elems (array, mid, size);
+
+      /* Partition around the pivot, stopping on elements equal
+         to it so that runs of equal keys split evenly. */
+      i = 0;
+      j = cnt;
+      for (;;)
+        {
+          while (compare (array + ++i * size, array, aux) < 0)
+            continue;
+          while (compare (array + --j * size, array, aux) > 0)
+            continue;
+          if (i >= j)
+            break;
+          swap_elems (array + i * size, array + j * size, size);
+        }
+      swap_elems (array, array + j * size, size);
+
+      /* Recurse into the smaller side and loop on the larger, so
+         that the stack stays O(lg n) deep. */
+      if (j < cnt - j - 1)
+        {
+          intro_sort (array, j, size, compare, aux, depth);
+          array += (j + 1) * size;
+          cnt -= j + 1;
+        }
+      else
+        {
+          intro_sort (array + (j + 1) * size, cnt - j - 1, size,
+                      compare, aux, depth);
+          cnt = j;
+        }
+    }
+  insertion_sort (array, cnt, size, compare, aux);
+}
+
 /* Sorts ARRAY, which contains CNT elements of SIZE bytes each,
    using COMPARE to compare elements, passing AUX as auxiliary
    data.  When COMPARE is passed a pair of elements A and B,
    respectively, it must return a strcmp()-type result, i.e. less
    than zero if A < B, zero if A == B, greater than zero if A >
-   B.  Runs in O(n lg n) time and O(1) space in CNT. */
+   B.
+
+   Uses introsort: median-of-three quicksort that falls back to
+   heapsort if partitioning goes badly, with insertion sort for
+   short ranges.  Runs in O(n lg n) time and O(lg n) space in
+   CNT. */
 void
 sort (void *array, size_t cnt, size_t size,
       int (*compare) (const void *, const void *, void *aux),
       void *aux) 
 {
-  size_t i;
+  int depth = 0;
+  size_t n;
 
   ASSERT (array != NULL || cnt == 0);
   ASSERT (compare != NULL);
   ASSERT (size > 0);
 
-  /* Build a heap. */
-  for (i = cnt / 2; i > 0; i--)
-    heapify (array, i, cnt, size, compare, aux);
-
-  /* Sort the heap. */
-  for (i = cnt; i > 1; i--) 
-    {
-      do_swap (array, 1, i, size);
-      heapify (array, 1, i - 1, size, compare, aux); 
-    }
+  for (n = cnt; n > 1; n /= 2)
+    depth += 2;
+  intro_sort (array, cnt, size, compare, aux, depth);
 }
 
 /* Searches ARRAY, which contains CNT elements of SIZE bytes
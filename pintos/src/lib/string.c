@@ -1,5 +1,38 @@
 #include <string.h>
 #include <debug.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* The memory and string functions below work a 32-bit word at a
+   time where they can, falling back to bytes only for the
+   unaligned head and the tail of a block.  The i386 string
+   instructions do the bulk copying and filling.
+
+   A `word' may alias any other type, since the functions access
+   bytes of arbitrary objects through it. */
+typedef uint32_t word __attribute__ ((may_alias));
+
+#define WORD_SIZE sizeof (word)
+
+/* A word with every byte set to 0x01, and to 0x80. */
+#define ONES ((word) 0x01010101)
+#define HIGHS ((word) 0x80808080)
+
+/* Returns true if ADDR is aligned on a word boundary. */
+static inline bool
+word_aligned (const void *addr) 
+{
+  return ((uintptr_t) addr & (WORD_SIZE - 1)) == 0;
+}
+
+/* Returns nonzero if and only if some byte of W is zero.  The
+   lowest zero byte borrows when 1 is subtracted from every byte,
+   and ~W rules out bytes whose high bit was set already. */
+static inline word
+has_zero (word w) 
+{
+  return (w - ONES) & ~w & HIGHS;
+}
 
 /* Copies SIZE bytes from SRC to DST, which must not overlap.
    Returns DST. */
@@ -12,8 +45,23 @@ memcpy (void *dst_, const void *src_, size_t size)
   ASSERT (dst != NULL || size == 0);
   ASSERT (src != NULL || size == 0);
 
-  while (size-- > 0)
-    *dst++ = *src++;
+  /* Align DST, so that at least the stores are aligned, then
+     move words and finally the leftover bytes. */
+  if (size >= 2 * WORD_SIZE)
+    {
+      size_t head = -(uintptr_t) dst & (WORD_SIZE - 1);
+      size_t word_cnt;
+
+      size -= head;
+      asm volatile ("rep movsb"
+                    : "+D" (dst), "+S" (src), "+c" (head) : : "memory");
+      word_cnt = size / WORD_SIZE;
+      asm volatile ("rep movsl"
+                    : "+D" (dst), "+S" (src), "+c" (word_cnt) : : "memory");
+      size %= WORD_SIZE;
+    }
+  asm volatile ("rep movsb"
+                : "+D" (dst), "+S" (src), "+c" (size) : : "memory");
 
   return dst_;
 }
@@ -58,6 +106,14 @@ memcmp (const void *a_, const void *b_, size_t size)
   ASSERT (a != NULL || size == 0);
   ASSERT (b != NULL || size == 0);
 
+  /* Skip equal words, then find the differing byte. */
+  if (word_aligned (a) && word_aligned (b))
+    for (; size >= WORD_SIZE && *(const word *) a == *(const word *) b;
+         size -= WORD_SIZE)
+      {
+        a += WORD_SIZE;
+        b += WORD_SIZE;
+      }
   for (; size-- > 0; a++, b++)
     if (*a != *b)
       return *a > *b ? +1 : -1;
@@ -98,6 +154,15 @@ memchr (const void *block_, int ch_, size_t size)
 
   ASSERT (block != NULL || size == 0);
 
+  /* Once BLOCK is aligned, skip words that do not hold CH: a
+     byte equal to CH becomes a zero byte in the word XORed with
+     CH repeated. */
+  for (; size > 0 && !word_aligned (block); size--, block++)
+    if (*block == ch)
+      return (void *) block;
+  for (; size >= WORD_SIZE; size -= WORD_SIZE, block += WORD_SIZE)
+    if (has_zero (*(const word *) block ^ (ch * ONES)))
+      break;
   for (; size-- > 0; block++)
     if (*block == ch)
       return (void *) block;
@@ -281,9 +346,26 @@ memset (void *dst_, int value, size_t size)
   unsigned char *dst = dst_;
 
   ASSERT (dst != NULL || size == 0);
-  
-  while (size-- > 0)
-    *dst++ = value;
+
+  /* A word-aligned block of whole words, such as a page being
+     zeroed, is filled with words alone.  Otherwise align DST,
+     store words, and finish with the leftover bytes. */
+  if (size >= 2 * WORD_SIZE || (word_aligned (dst) && size % WORD_SIZE == 0))
+    {
+      size_t head = -(uintptr_t) dst & (WORD_SIZE - 1);
+      word pattern = (unsigned char) value * ONES;
+      size_t word_cnt;
+
+      size -= head;
+      asm volatile ("rep stosb"
+                    : "+D" (dst), "+c" (head) : "a" (pattern) : "memory");
+      word_cnt = size / WORD_SIZE;
+      asm volatile ("rep stosl"
+                    : "+D" (dst), "+c" (word_cnt) : "a" (pattern) : "memory");
+      size %= WORD_SIZE;
+    }
+  asm volatile ("rep stosb"
+                : "+D" (dst), "+c" (size) : "a" (value) : "memory");
 
   return dst_;
 }
@@ -296,7 +378,15 @@ strlen (const char *string)
 
   ASSERT (string != NULL);
 
-  for (p = string; *p != '\0'; p++)
+  /* Step to a word boundary, then a word at a time up to the
+     word holding the null terminator.  An aligned word never
+     straddles a page, so reading past the terminator is safe. */
+  for (p = string; !word_aligned (p); p++)
+    if (*p == '\0')
+      return p - string;
+  while (!has_zero (*(const word *) p))
+    p += WORD_SIZE;
+  for (; *p != '\0'; p++)
     continue;
   return p - string;
 }
@@ -0,0 +1,20 @@
+#ifndef __LIB_SYSCALL_BATCH_H
+#define __LIB_SYSCALL_BATCH_H
+
+/* One request in a batch passed to the batch() system call.
+   NUMBER is SYS_READ, SYS_WRITE, SYS_SEEK, or SYS_CLOSE and ARGS
+   are its arguments, as for the ordinary system call.  The kernel
+   stores the system call's return value in RESULT, or -1 if
+   NUMBER cannot be batched.  Shared by user programs and the
+   kernel. */
+struct batch_entry
+  {
+    int number;                 /* System call number. */
+    int args[3];                /* Arguments. */
+    int result;                 /* Return value, set by kernel. */
+  };
+
+/* Maximum number of requests in one batch() call. */
+#define BATCH_MAX 64
+
+#endif /* lib/syscall-batch.h */
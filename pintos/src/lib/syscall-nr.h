@@ -28,7 +28,46 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_PREAD,                  /* Read from a file at an offset. */
+    SYS_PWRITE,                 /* Write to a file at an offset. */
+    SYS_READV,                  /* Read from a file into several buffers. */
+    SYS_WRITEV,                 /* Write several buffers to a file. */
+    SYS_COPY_FILE_RANGE,        /* Copy data from one file to another. */
+    SYS_BATCH,                  /* Run several system calls at once. */
+    SYS_STDIN_MODE,             /* Set how reads from the console end. */
+    SYS_BLOCK_STATS,            /* Get statistics for a block device. */
+    SYS_PREALLOCATE,            /* Reserve disk space for a file. */
+    SYS_FSYNC,                  /* Write a file's data to disk. */
+    SYS_SYNC,                   /* Write all file system data to disk. */
+    SYS_FS_STATS,               /* Get file system statistics. */
+    SYS_READDIR_MANY,           /* Reads several directory entries. */
+    SYS_REFLINK,                /* Clone a file without copying its data. */
+    SYS_COMPRESS,               /* Compress a file's data on disk. */
+    SYS_FUTEX_WAIT,             /* Sleep if an int has a given value. */
+    SYS_FUTEX_WAKE,             /* Wake threads sleeping on an int. */
+    SYS_UTHREAD_CREATE,         /* Start a thread in this process. */
+    SYS_UTHREAD_EXIT,           /* End the calling thread. */
+    SYS_UTHREAD_JOIN,           /* Wait for a thread to end. */
+    SYS_SCHED_STATS,            /* Get scheduler statistics. */
+    SYS_SET_SCHED_CLASS,        /* Change scheduling class. */
+    SYS_SET_AFFINITY,           /* Restrict a thread to some CPUs. */
+    SYS_GETRUSAGE,              /* Get process resource usage. */
+    SYS_SBRK,                   /* Grow or shrink the heap. */
+    SYS_PIPE,                   /* Create a pipe. */
+    SYS_SHM_CREATE,             /* Create a shared memory segment. */
+    SYS_SHM_MAP,                /* Map a shared memory segment. */
+    SYS_FORK,                   /* Copy this process. */
+    SYS_POLL,                   /* Wait for one of several files. */
+    SYS_WAIT_ANY,               /* Wait for whichever child exits. */
+    SYS_WAIT_MANY,              /* Reap several exited children. */
+    SYS_SPAWN_MANY,             /* Start several processes at once. */
+    SYS_SET_DEADLINE,           /* Join the deadline class. */
+    SYS_PIN,                    /* Keep a file's data in the cache. */
+    SYS_UNPIN,                  /* Let a pinned file be evicted. */
+    SYS_EXEC_ASYNC              /* Start a process without waiting. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -25,12 +25,62 @@ hprintf (int handle, const char *format, ...)
   return retval;
 }
 
+/* Standard output buffer.
+
+   printf(), puts(), and putchar() collect output to
+   STDOUT_FILENO here instead of making a system call for each
+   piece.  By default, the buffer is written out at each new-line,
+   so that a process killed by the kernel still loses at most an
+   unfinished line; stdout_mode() can select full buffering or
+   none.  exit(), uthread_exit(), exec(), halt(), and read() from
+   the console flush it, so that output appears in order with that of other
+   processes and prompts appear before input is read.
+
+   User threads of one process share the buffer.  A thread that
+   finds another using it writes its output directly instead of
+   waiting, so that output is never lost or corrupted, though it
+   may come out of order. */
+static char stdout_buf[256];
+static size_t stdout_len;
+static int stdout_buffering = STDOUT_LINE;
+static volatile int stdout_busy;
+
+static void stdout_write (const char *, size_t);
+static void stdout_drain (void);
+
+/* Sets the buffering of standard output to MODE, one of
+   STDOUT_UNBUFFERED, STDOUT_LINE, and STDOUT_FULL, after flushing
+   what is buffered.  Returns the previous mode. */
+int
+stdout_mode (int mode) 
+{
+  int old_mode = stdout_buffering;
+
+  stdout_flush ();
+  stdout_buffering = mode;
+  return old_mode;
+}
+
+/* Writes out all buffered standard output. */
+void
+stdout_flush (void) 
+{
+  int busy = 1;
+
+  asm volatile ("xchgl %0, %1" : "+r" (busy), "+m" (stdout_busy)
+                : : "memory");
+  if (busy)
+    return;
+  stdout_drain ();
+  stdout_busy = 0;
+}
+
 /* Writes string S to the console, followed by a new-line
    character. */
 int
 puts (const char *s) 
 {
-  write (STDOUT_FILENO, s, strlen (s));
+  stdout_write (s, strlen (s));
   putchar ('\n');
 
   return 0;
@@ -41,9 +91,49 @@ int
 putchar (int c) 
 {
   char c2 = c;
-  write (STDOUT_FILENO, &c2, 1);
+  stdout_write (&c2, 1);
   return c;
 }
+
+/* Adds the SIZE bytes in BUF to the standard output buffer,
+   writing it out as the buffering mode requires. */
+static void
+stdout_write (const char *buf, size_t size) 
+{
+  int busy = 1;
+
+  asm volatile ("xchgl %0, %1" : "+r" (busy), "+m" (stdout_busy)
+                : : "memory");
+  if (busy || stdout_buffering == STDOUT_UNBUFFERED
+      || size > sizeof stdout_buf)
+    {
+      if (!busy)
+        {
+          stdout_drain ();
+          stdout_busy = 0;
+        }
+      write (STDOUT_FILENO, buf, size);
+      return;
+    }
+
+  if (stdout_len + size > sizeof stdout_buf)
+    stdout_drain ();
+  memcpy (stdout_buf + stdout_len, buf, size);
+  stdout_len += size;
+  if (stdout_buffering == STDOUT_LINE && memchr (buf, '\n', size) != NULL)
+    stdout_drain ();
+  stdout_busy = 0;
+}
+
+/* Writes out the standard output buffer.  The caller must have
+   set stdout_busy. */
+static void
+stdout_drain (void) 
+{
+  if (stdout_len > 0)
+    write (STDOUT_FILENO, stdout_buf, stdout_len);
+  stdout_len = 0;
+}
 
 /* Auxiliary data for vhprintf_helper(). */
 struct vhprintf_aux 
@@ -55,6 +145,7 @@ struct vhprintf_aux
   };
 
 static void add_char (char, void *);
+static void add_buf (const char *, size_t, void *);
 static void flush (struct vhprintf_aux *);
 
 /* Formats the printf() format specification FORMAT with
@@ -67,7 +158,7 @@ vhprintf (int handle, const char *format, va_list args)
   aux.p = aux.buf;
   aux.char_cnt = 0;
   aux.handle = handle;
-  __vprintf (format, args, add_char, &aux);
+  __vprintf_buf (format, args, add_char, add_buf, &aux);
   flush (&aux);
   return aux.char_cnt;
 }
@@ -84,11 +175,39 @@ add_char (char c, void *aux_)
   aux->char_cnt++;
 }
 
-/* Flushes the buffer in AUX. */
+/* Adds the N characters in BUFFER to the buffer in AUX,
+   flushing it each time it fills up. */
+static void
+add_buf (const char *buffer, size_t n, void *aux_) 
+{
+  struct vhprintf_aux *aux = aux_;
+
+  aux->char_cnt += n;
+  while (n > 0)
+    {
+      size_t space = aux->buf + sizeof aux->buf - aux->p;
+      size_t chunk = n < space ? n : space;
+
+      memcpy (aux->p, buffer, chunk);
+      aux->p += chunk;
+      buffer += chunk;
+      n -= chunk;
+      if (aux->p >= aux->buf + sizeof aux->buf)
+        flush (aux);
+    }
+}
+
+/* Flushes the buffer in AUX, into the standard output buffer if
+   that is where the output goes. */
 static void
 flush (struct vhprintf_aux *aux)
 {
   if (aux->p > aux->buf)
-    write (aux->handle, aux->buf, aux->p - aux->buf);
+    {
+      if (aux->handle == STDOUT_FILENO)
+        stdout_write (aux->buf, aux->p - aux->buf);
+      else
+        write (aux->handle, aux->buf, aux->p - aux->buf);
+    }
   aux->p = aux->buf;
 }
@@ -0,0 +1,55 @@
+#include <syscall.h>
+#include <kdata.h>
+
+/* Copies the kernel data page into *KD, retrying if the kernel
+   updates it in the middle. */
+void
+kdata_read (struct kdata *kd)
+{
+  volatile const struct kdata *page = KDATA_ADDR;
+  unsigned seq;
+
+  do
+    {
+      seq = page->seq;
+      kd->tid = page->tid;
+      kd->ticks_per_sec = page->ticks_per_sec;
+      kd->cycles_per_sec = page->cycles_per_sec;
+      kd->ticks = page->ticks;
+      kd->idle_ticks = page->idle_ticks;
+      kd->kernel_ticks = page->kernel_ticks;
+      kd->user_ticks = page->user_ticks;
+    }
+  while ((seq & 1) != 0 || page->seq != seq);
+  kd->seq = seq;
+}
+
+/* Returns the number of timer ticks since boot. */
+int64_t
+get_ticks (void)
+{
+  struct kdata kd;
+
+  kdata_read (&kd);
+  return kd.ticks;
+}
+
+/* Returns the number of nanoseconds since the time-stamp counter
+   started, read without a system call at the CPU's cycle
+   resolution. */
+uint64_t
+get_ns (void)
+{
+  uint64_t hz = KDATA_ADDR->cycles_per_sec;
+  uint64_t tsc;
+
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc / hz * 1000000000 + tsc % hz * 1000000000 / hz;
+}
+
+/* Returns the process identifier of the calling process. */
+pid_t
+getpid (void)
+{
+  return KDATA_ADDR->tid;
+}
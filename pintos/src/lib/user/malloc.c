@@ -0,0 +1,298 @@
+#include <malloc.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A user-space malloc() on top of sbrk().
+
+   Each block starts with a header that records its size.  A
+   request of up to MAX_SMALL bytes, counting the header, is
+   rounded up to one of the power-of-2 size classes from 16 bytes
+   to 2 kB.  Each class keeps a free list of blocks of its size.
+   When that is empty, malloc() grows the heap by one CHUNK_SIZE
+   chunk and cuts it into blocks for that class.  Small blocks
+   go back on their class's free list when freed.  They are never
+   returned to the kernel.
+
+   A bigger request takes whole pages.  Freed big blocks go on a
+   list of their own, searched first-fit, and a free big block at
+   the top of the heap shrinks the heap with sbrk().
+
+   All of a process's threads share the heap behind one lock.
+   User threads have no thread-local storage, so there is nowhere
+   to keep per-thread caches like the kernel's magazines. */
+
+/* Magic number for detecting heap corruption. */
+#define BLOCK_MAGIC 0x6ba1e5e1
+
+/* Block header, 8 bytes so that payloads are 8-byte aligned. */
+struct header
+  {
+    unsigned magic;             /* BLOCK_MAGIC. */
+    size_t size;                /* Block size, including header. */
+  };
+
+/* Free block. */
+struct free_block
+  {
+    struct header header;
+    struct free_block *next;    /* Next free block in its list. */
+  };
+
+#define MIN_CLASS 16            /* Smallest block size. */
+#define MAX_SMALL 2048          /* Largest small block size. */
+#define CLASS_CNT 8             /* Classes from MIN_CLASS to MAX_SMALL. */
+#define CHUNK_SIZE 4096         /* Heap growth for small blocks. */
+#define PAGE_SIZE 4096
+
+static struct free_block *small_free[CLASS_CNT];
+static struct free_block *big_free;
+
+/* Heap lock: 0 if free, 1 if held, 2 if held with waiters. */
+static int heap_lock;
+
+static void lock_heap (void);
+static void unlock_heap (void);
+static void *grow_heap (size_t size);
+static struct header *get_small (int class);
+static struct header *get_big (size_t size);
+static void put_big (struct header *);
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc (size_t size) 
+{
+  struct header *h;
+  size_t need;
+  int class;
+
+  if (size == 0 || size > SIZE_MAX - PAGE_SIZE)
+    return NULL;
+  need = size + sizeof *h;
+
+  lock_heap ();
+  if (need <= MAX_SMALL)
+    {
+      for (class = 0; (size_t) MIN_CLASS << class < need; class++)
+        continue;
+      h = get_small (class);
+    }
+  else
+    h = get_big (ROUND_UP (need, PAGE_SIZE));
+  unlock_heap ();
+
+  return h != NULL ? h + 1 : NULL;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc (size_t a, size_t b) 
+{
+  void *p;
+
+  if (b != 0 && a > SIZE_MAX / b)
+    return NULL;
+  p = malloc (a * b);
+  if (p != NULL)
+    memset (p, 0, a * b);
+  return p;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.  If successful, returns the new
+   block; on failure, returns a null pointer.  A call with null
+   OLD_BLOCK is equivalent to malloc(NEW_SIZE).  A call with
+   zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *
+realloc (void *old_block, size_t new_size) 
+{
+  struct header *h;
+  size_t old_size;
+  void *new_block;
+
+  if (new_size == 0)
+    {
+      free (old_block);
+      return NULL;
+    }
+  if (old_block == NULL)
+    return malloc (new_size);
+
+  h = (struct header *) old_block - 1;
+  ASSERT (h->magic == BLOCK_MAGIC);
+  old_size = h->size - sizeof *h;
+  if (new_size <= old_size)
+    return old_block;
+
+  new_block = malloc (new_size);
+  if (new_block != NULL)
+    {
+      memcpy (new_block, old_block, old_size);
+      free (old_block);
+    }
+  return new_block;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free (void *p) 
+{
+  struct header *h;
+
+  if (p == NULL)
+    return;
+
+  h = (struct header *) p - 1;
+  ASSERT (h->magic == BLOCK_MAGIC);
+
+  lock_heap ();
+  if (h->size <= MAX_SMALL)
+    {
+      struct free_block *b = (struct free_block *) h;
+      int class;
+
+      for (class = 0; (size_t) MIN_CLASS << class < h->size; class++)
+        continue;
+      b->next = small_free[class];
+      small_free[class] = b;
+    }
+  else
+    put_big (h);
+  unlock_heap ();
+}
+
+/* Returns a free block of class CLASS, refilling the class's
+   free list from a new chunk if it is empty. */
+static struct header *
+get_small (int class) 
+{
+  size_t block_size = (size_t) MIN_CLASS << class;
+  struct free_block *b;
+
+  if (small_free[class] == NULL)
+    {
+      uint8_t *chunk = grow_heap (CHUNK_SIZE);
+      size_t ofs;
+
+      if (chunk == NULL)
+        return NULL;
+      for (ofs = 0; ofs + block_size <= CHUNK_SIZE; ofs += block_size)
+        {
+          b = (struct free_block *) (chunk + ofs);
+          b->header.magic = BLOCK_MAGIC;
+          b->header.size = block_size;
+          b->next = small_free[class];
+          small_free[class] = b;
+        }
+    }
+
+  b = small_free[class];
+  small_free[class] = b->next;
+  return &b->header;
+}
+
+/* Returns a big block of SIZE bytes, a multiple of PAGE_SIZE,
+   split off the first free big block that is large enough, or
+   else newly added to the heap. */
+static struct header *
+get_big (size_t size) 
+{
+  struct free_block **bp;
+  struct header *h;
+
+  for (bp = &big_free; *bp != NULL; bp = &(*bp)->next)
+    {
+      struct free_block *b = *bp;
+
+      if (b->header.size >= size)
+        {
+          *bp = b->next;
+          if (b->header.size > size)
+            {
+              h = (struct header *) ((uint8_t *) b + size);
+              h->magic = BLOCK_MAGIC;
+              h->size = b->header.size - size;
+              b->header.size = size;
+              put_big (h);
+            }
+          return &b->header;
+        }
+    }
+
+  h = grow_heap (size);
+  if (h != NULL)
+    {
+      h->magic = BLOCK_MAGIC;
+      h->size = size;
+    }
+  return h;
+}
+
+/* Frees big block H, giving it back to the kernel if it ends the
+   heap. */
+static void
+put_big (struct header *h) 
+{
+  struct free_block *b = (struct free_block *) h;
+
+  if ((uint8_t *) h + h->size == sbrk (0) && sbrk (-h->size) != (void *) -1)
+    return;
+  b->next = big_free;
+  big_free = b;
+}
+
+/* Grows the heap by SIZE bytes, starting at an 8-byte boundary,
+   and returns the start of the new space, or a null pointer if
+   the kernel refuses. */
+static void *
+grow_heap (size_t size) 
+{
+  uint8_t *brk = sbrk (0);
+  size_t pad = ROUND_UP ((uintptr_t) brk, 8) - (uintptr_t) brk;
+
+  if (brk == (void *) -1 || sbrk (pad + size) == (void *) -1)
+    return NULL;
+  return brk + pad;
+}
+
+/* Atomically sets *P to NEW if it is OLD.  Returns the value *P
+   had. */
+static inline int
+compare_exchange (int *p, int old, int new) 
+{
+  asm volatile ("lock cmpxchgl %2, %1"
+                : "+a" (old), "+m" (*p) : "r" (new) : "memory");
+  return old;
+}
+
+/* Acquires the heap lock, sleeping in futex_wait() while another
+   thread holds it. */
+static void
+lock_heap (void) 
+{
+  int c = compare_exchange (&heap_lock, 0, 1);
+
+  while (c != 0)
+    {
+      if (c == 2 || compare_exchange (&heap_lock, 1, 2) != 0)
+        futex_wait (&heap_lock, 2);
+      c = compare_exchange (&heap_lock, 0, 2);
+    }
+}
+
+/* Releases the heap lock, waking a waiter if there may be one. */
+static void
+unlock_heap (void) 
+{
+  int c;
+
+  asm volatile ("xchgl %0, %1" : "=r" (c), "+m" (heap_lock) : "0" (0)
+                : "memory");
+  if (c == 2)
+    futex_wake (&heap_lock, 1);
+}
@@ -4,4 +4,13 @@
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
+/* Modes for stdout_mode(), saying when output to STDOUT_FILENO
+   is written out. */
+#define STDOUT_UNBUFFERED 0     /* At once. */
+#define STDOUT_LINE 1           /* At each new-line (default). */
+#define STDOUT_FULL 2           /* When the buffer fills. */
+
+int stdout_mode (int mode);
+void stdout_flush (void);
+
 #endif /* lib/user/stdio.h */
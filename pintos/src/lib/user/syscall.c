@@ -1,31 +1,51 @@
 #include <syscall.h>
+#include <kdata.h>
+#include <stdio.h>
 #include "../syscall-nr.h"
 
+/* Enters the kernel with the number of a system call in %eax and
+   its arguments in %ebx, %esi, %edi, and %ebp.  The kernel data
+   page says whether SYSENTER works, which needs the stack pointer
+   in %ecx and the address to return to in %edx; otherwise
+   "int $0x31" does the job.  The asm statements below that use
+   this must list the [sysenter] input and clobber %ecx and %edx.
+   The kernel still accepts the number and arguments pushed on the
+   stack through "int $0x30", which some tests use directly. */
+#define SYSCALL_TRAP                                            \
+        "cmpl $0, %[sysenter]; je 1f; "                         \
+        "movl %%esp, %%ecx; movl $2f, %%edx; sysenter; "        \
+        "1: int $0x31; 2:"
+
+/* The [sysenter] input for SYSCALL_TRAP. */
+#define SYSCALL_SYSENTER [sysenter] "m" (KDATA_ADDR->sysenter)
+
 /* Invokes syscall NUMBER, passing no arguments, and returns the
    return value as an `int'. */
 #define syscall0(NUMBER)                                        \
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
-            ("pushl %[number]; int $0x30; addl $4, %%esp"       \
+            (SYSCALL_TRAP                                       \
                : "=a" (retval)                                  \
-               : [number] "i" (NUMBER)                          \
-               : "memory");                                     \
+               : "0" (NUMBER),                                  \
+                 SYSCALL_SYSENTER                               \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
 /* Invokes syscall NUMBER, passing argument ARG0, and returns the
    return value as an `int'. */
-#define syscall1(NUMBER, ARG0)                                           \
-        ({                                                               \
-          int retval;                                                    \
-          asm volatile                                                   \
-            ("pushl %[arg0]; pushl %[number]; int $0x30; addl $8, %%esp" \
-               : "=a" (retval)                                           \
-               : [number] "i" (NUMBER),                                  \
-                 [arg0] "g" (ARG0)                                       \
-               : "memory");                                              \
-          retval;                                                        \
+#define syscall1(NUMBER, ARG0)                                  \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            (SYSCALL_TRAP                                       \
+               : "=a" (retval)                                  \
+               : "0" (NUMBER),                                  \
+                 "b" (ARG0),                                    \
+                 SYSCALL_SYSENTER                               \
+               : "ecx", "edx", "memory");                       \
+          retval;                                               \
         })
 
 /* Invokes syscall NUMBER, passing arguments ARG0 and ARG1, and
@@ -34,13 +54,13 @@
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
-            ("pushl %[arg1]; pushl %[arg0]; "                   \
-             "pushl %[number]; int $0x30; addl $12, %%esp"      \
+            (SYSCALL_TRAP                                       \
                : "=a" (retval)                                  \
-               : [number] "i" (NUMBER),                         \
-                 [arg0] "g" (ARG0),                             \
-                 [arg1] "g" (ARG1)                              \
-               : "memory");                                     \
+               : "0" (NUMBER),                                  \
+                 "b" (ARG0),                                    \
+                 "S" (ARG1),                                    \
+                 SYSCALL_SYSENTER                               \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
@@ -50,20 +70,43 @@
         ({                                                      \
           int retval;                                           \
           asm volatile                                          \
-            ("pushl %[arg2]; pushl %[arg1]; pushl %[arg0]; "    \
-             "pushl %[number]; int $0x30; addl $16, %%esp"      \
+            (SYSCALL_TRAP                                       \
                : "=a" (retval)                                  \
-               : [number] "i" (NUMBER),                         \
-                 [arg0] "g" (ARG0),                             \
-                 [arg1] "g" (ARG1),                             \
-                 [arg2] "g" (ARG2)                              \
-               : "memory");                                     \
+               : "0" (NUMBER),                                  \
+                 "b" (ARG0),                                    \
+                 "S" (ARG1),                                    \
+                 "D" (ARG2),                                    \
+                 SYSCALL_SYSENTER                               \
+               : "ecx", "edx", "memory");                       \
+          retval;                                               \
+        })
+
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'.  %ebp may
+   be the frame pointer, so it cannot be an asm operand; we save
+   it on the stack and load ARG3 into it by way of %edx, before
+   any push can move a stack-relative ARG3. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("movl %[arg3], %%edx; pushl %%ebp; "               \
+             "movl %%edx, %%ebp; " SYSCALL_TRAP "; popl %%ebp"  \
+               : "=a" (retval)                                  \
+               : "0" (NUMBER),                                  \
+                 "b" (ARG0),                                    \
+                 "S" (ARG1),                                    \
+                 "D" (ARG2),                                    \
+                 [arg3] "g" (ARG3),                             \
+                 SYSCALL_SYSENTER                               \
+               : "ecx", "edx", "memory");                       \
           retval;                                               \
         })
 
 void
 halt (void) 
 {
+  stdout_flush ();
   syscall0 (SYS_HALT);
   NOT_REACHED ();
 }
@@ -71,6 +114,7 @@ halt (void)
 void
 exit (int status)
 {
+  stdout_flush ();
   syscall1 (SYS_EXIT, status);
   NOT_REACHED ();
 }
@@ -78,9 +122,17 @@ exit (int status)
 pid_t
 exec (const char *file)
 {
+  stdout_flush ();
   return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
+pid_t
+exec_async (const char *file)
+{
+  stdout_flush ();
+  return (pid_t) syscall1 (SYS_EXEC_ASYNC, file);
+}
+
 int
 wait (pid_t pid)
 {
@@ -114,6 +166,8 @@ filesize (int fd)
 int
 read (int fd, void *buffer, unsigned size)
 {
+  if (fd == STDIN_FILENO)
+    stdout_flush ();
   return syscall3 (SYS_READ, fd, buffer, size);
 }
 
@@ -182,3 +236,237 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+int
+pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+copy_file_range (int fd_in, int fd_out, unsigned length)
+{
+  return syscall3 (SYS_COPY_FILE_RANGE, fd_in, fd_out, length);
+}
+
+int
+batch (struct batch_entry *entries, int cnt)
+{
+  return syscall2 (SYS_BATCH, entries, cnt);
+}
+
+int
+stdin_mode (int mode)
+{
+  return syscall1 (SYS_STDIN_MODE, mode);
+}
+
+bool
+block_stats (int index, struct block_stats *stats)
+{
+  return syscall2 (SYS_BLOCK_STATS, index, stats);
+}
+
+bool
+preallocate (int fd, unsigned length)
+{
+  return syscall2 (SYS_PREALLOCATE, fd, length);
+}
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+void
+sync (void)
+{
+  syscall0 (SYS_SYNC);
+}
+
+bool
+fs_stats (int fd, struct fs_stats *stats)
+{
+  return syscall2 (SYS_FS_STATS, fd, stats);
+}
+
+int
+readdir_many (int fd, char names[][READDIR_MAX_LEN + 1], int cnt)
+{
+  return syscall3 (SYS_READDIR_MANY, fd, names, cnt);
+}
+
+bool
+reflink (const char *from, const char *to)
+{
+  return syscall2 (SYS_REFLINK, from, to);
+}
+
+bool
+compress (int fd)
+{
+  return syscall1 (SYS_COMPRESS, fd);
+}
+
+bool
+pin (int fd)
+{
+  return syscall1 (SYS_PIN, fd);
+}
+
+bool
+unpin (int fd)
+{
+  return syscall1 (SYS_UNPIN, fd);
+}
+
+int
+futex_wait (int *addr, int expected)
+{
+  return syscall2 (SYS_FUTEX_WAIT, addr, expected);
+}
+
+int
+futex_wake (int *addr, int cnt)
+{
+  return syscall2 (SYS_FUTEX_WAKE, addr, cnt);
+}
+
+/* Runs FUNC (AUX) in the new thread, then ends it with FUNC's
+   return value. */
+static void
+uthread_start (uthread_func *func, void *aux)
+{
+  uthread_exit (func (aux));
+}
+
+/* Starts a thread of this process running FUNC (AUX) on the SIZE
+   bytes of STACK, which must stay allocated until it exits. */
+tid_t
+uthread_create (uthread_func *func, void *aux, void *stack, size_t size)
+{
+  void **sp = (void **) (((uintptr_t) stack + size) & ~(uintptr_t) 15);
+
+  /* Call frame for uthread_start(), with null return address. */
+  *--sp = aux;
+  *--sp = func;
+  *--sp = NULL;
+  return syscall2 (SYS_UTHREAD_CREATE, uthread_start, sp);
+}
+
+void
+uthread_exit (int status)
+{
+  stdout_flush ();
+  syscall1 (SYS_UTHREAD_EXIT, status);
+  NOT_REACHED ();
+}
+
+int
+uthread_join (tid_t tid)
+{
+  return syscall1 (SYS_UTHREAD_JOIN, tid);
+}
+
+bool
+sched_stats (tid_t tid, struct sched_stats *stats)
+{
+  return syscall2 (SYS_SCHED_STATS, tid, stats);
+}
+
+int
+set_sched_class (int sched_class)
+{
+  return syscall1 (SYS_SET_SCHED_CLASS, sched_class);
+}
+
+bool
+set_deadline (int period_ms, int budget_ms)
+{
+  return syscall2 (SYS_SET_DEADLINE, period_ms, budget_ms);
+}
+
+bool
+set_affinity (tid_t tid, unsigned cpu_mask)
+{
+  return syscall2 (SYS_SET_AFFINITY, tid, cpu_mask);
+}
+
+void
+getrusage (struct rusage *usage)
+{
+  syscall1 (SYS_GETRUSAGE, usage);
+}
+
+void *
+sbrk (intptr_t increment)
+{
+  return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+int
+pipe (int fds[2])
+{
+  return syscall1 (SYS_PIPE, fds);
+}
+
+int
+shm_create (size_t size)
+{
+  return syscall1 (SYS_SHM_CREATE, size);
+}
+
+bool
+shm_map (int id, void *addr)
+{
+  return syscall2 (SYS_SHM_MAP, id, addr);
+}
+
+pid_t
+fork (void)
+{
+  return syscall0 (SYS_FORK);
+}
+
+int
+poll (struct pollfd *fds, int n, int timeout)
+{
+  return syscall3 (SYS_POLL, fds, n, timeout);
+}
+
+pid_t
+wait_any (int *status)
+{
+  return syscall1 (SYS_WAIT_ANY, status);
+}
+
+int
+wait_many (pid_t *pids, int *statuses, int cnt)
+{
+  return syscall3 (SYS_WAIT_MANY, pids, statuses, cnt);
+}
+
+int
+spawn_many (const char *cmd_lines[], int n, pid_t pids[])
+{
+  return syscall3 (SYS_SPAWN_MANY, cmd_lines, n, pids);
+}
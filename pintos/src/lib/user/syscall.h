@@ -3,17 +3,41 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <block-stats.h>
+#include <fs-stats.h>
+#include <kdata.h>
+#include <poll.h>
+#include <rusage.h>
+#include <sched-stats.h>
+#include <syscall-batch.h>
+#include <uio.h>
 
 /* Process identifier. */
 typedef int pid_t;
 #define PID_ERROR ((pid_t) -1)
 
+/* Thread identifier. */
+typedef int tid_t;
+#define TID_ERROR ((tid_t) -1)
+
+/* Function run by a thread from uthread_create().  What it
+   returns is the thread's exit status. */
+typedef int uthread_func (void *aux);
+
 /* Map region identifier. */
 typedef int mapid_t;
 #define MAP_FAILED ((mapid_t) -1)
 
 /* Maximum characters in a filename written by readdir(). */
-#define READDIR_MAX_LEN 14
+#define READDIR_MAX_LEN 63
+
+/* Modes for stdin_mode(), saying when read() from the console
+   returns. */
+#define STDIN_RAW 0             /* After all requested bytes (default). */
+#define STDIN_LINE 1            /* After a new-line. */
+#define STDIN_NONBLOCK 2        /* At once, with what has been typed. */
 
 /* Typical return values from main() and arguments to exit(). */
 #define EXIT_SUCCESS 0          /* Successful execution. */
@@ -23,7 +47,11 @@ typedef int mapid_t;
 void halt (void) NO_RETURN;
 void exit (int status) NO_RETURN;
 pid_t exec (const char *file);
+pid_t exec_async (const char *file);
+int spawn_many (const char *cmd_lines[], int n, pid_t pids[]);
 int wait (pid_t);
+pid_t wait_any (int *status);
+int wait_many (pid_t *pids, int *statuses, int cnt);
 bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
 int open (const char *file);
@@ -42,7 +70,48 @@ void munmap (mapid_t);
 bool chdir (const char *dir);
 bool mkdir (const char *dir);
 bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
+int readdir_many (int fd, char names[][READDIR_MAX_LEN + 1], int cnt);
+bool reflink (const char *from, const char *to);
+bool compress (int fd);
+bool pin (int fd);
+bool unpin (int fd);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range (int fd_in, int fd_out, unsigned length);
+int batch (struct batch_entry *entries, int cnt);
+int stdin_mode (int mode);
+bool block_stats (int index, struct block_stats *);
+bool preallocate (int fd, unsigned length);
+bool fsync (int fd);
+void sync (void);
+bool fs_stats (int fd, struct fs_stats *);
+int futex_wait (int *addr, int expected);
+int futex_wake (int *addr, int cnt);
+tid_t uthread_create (uthread_func *, void *aux, void *stack, size_t size);
+void uthread_exit (int status) NO_RETURN;
+int uthread_join (tid_t);
+bool sched_stats (tid_t, struct sched_stats *);
+int set_sched_class (int sched_class);
+bool set_deadline (int period_ms, int budget_ms);
+bool set_affinity (tid_t, unsigned cpu_mask);
+void getrusage (struct rusage *);
+void *sbrk (intptr_t increment);
+int pipe (int fds[2]);
+int shm_create (size_t size);
+bool shm_map (int id, void *addr);
+pid_t fork (void);
+int poll (struct pollfd *fds, int n, int timeout);
+
+/* Read from kernel data page, without system call. */
+void kdata_read (struct kdata *);
+int64_t get_ticks (void);
+uint64_t get_ns (void);
+pid_t getpid (void);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,74 @@
+/* Writes a file of repetitive log text, compresses it, and
+   checks that it reads back the same, in order and at random
+   offsets.  Then writes into the middle of it, which moves its
+   data back out uncompressed, and checks the result. */
+
+#include <random.h>
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 20000
+
+static char data[FILE_SIZE];
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  size_t ofs = 0;
+  int line = 0;
+  int fd;
+  int i;
+
+  while (ofs < FILE_SIZE)
+    {
+      char text[64];
+      size_t len = snprintf (text, sizeof text,
+                             "log line %d: request served in %d ms\n",
+                             line, line % 17);
+      if (len > FILE_SIZE - ofs)
+        len = FILE_SIZE - ofs;
+      memcpy (data + ofs, text, len);
+      ofs += len;
+      line++;
+    }
+
+  CHECK (create ("log", 0), "create \"log\"");
+  CHECK ((fd = open ("log")) > 1, "open \"log\"");
+  CHECK (write (fd, data, FILE_SIZE) == FILE_SIZE,
+         "write %d bytes", FILE_SIZE);
+  CHECK (compress (fd), "compress \"log\"");
+  CHECK (!compress (fd), "compress again fails");
+  CHECK (filesize (fd) == FILE_SIZE, "filesize is %d", FILE_SIZE);
+
+  seek (fd, 0);
+  if (read (fd, buf, FILE_SIZE) != FILE_SIZE)
+    fail ("read of compressed file failed");
+  compare_bytes (buf, data, FILE_SIZE, 0, "log");
+  msg ("compressed file reads back");
+
+  random_init (0);
+  for (i = 0; i < 50; i++)
+    {
+      size_t size = random_ulong () % 3000 + 1;
+      size_t pos = random_ulong () % (FILE_SIZE - size);
+      seek (fd, pos);
+      if (read (fd, buf, size) != (int) size)
+        fail ("read of %zu bytes at %zu failed", size, pos);
+      compare_bytes (buf, data + pos, size, pos, "log");
+    }
+  msg ("random reads match");
+
+  memset (data + 9000, 'x', 100);
+  seek (fd, 9000);
+  CHECK (write (fd, data + 9000, 100) == 100, "write into middle");
+  seek (fd, 0);
+  if (read (fd, buf, FILE_SIZE) != FILE_SIZE)
+    fail ("read of written file failed");
+  compare_bytes (buf, data, FILE_SIZE, 0, "log");
+  msg ("written file reads back");
+  close (fd);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(compress) begin
+(compress) create "log"
+(compress) open "log"
+(compress) write 20000 bytes
+(compress) compress "log"
+(compress) compress again fails
+(compress) filesize is 20000
+(compress) compressed file reads back
+(compress) random reads match
+(compress) write into middle
+(compress) written file reads back
+(compress) end
+EOF
+pass;
@@ -0,0 +1,75 @@
+/* Creates many files in one directory, removes and re-creates
+   some of them, and checks that each name is found exactly when
+   it should be. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+
+static void
+make_name (char name[16], int i) 
+{
+  snprintf (name, 16, "f%d", i);
+}
+
+/* Checks that file I can be opened if EXISTS is true, and that
+   it cannot otherwise. */
+static void
+check_entry (int i, bool exists) 
+{
+  char name[16];
+  int fd;
+
+  make_name (name, i);
+  fd = open (name);
+  if (exists && fd < 2)
+    fail ("open \"%s\" failed", name);
+  else if (!exists && fd != -1)
+    fail ("open \"%s\" succeeded after removal", name);
+  if (fd > 1)
+    close (fd);
+}
+
+void
+test_main (void) 
+{
+  char name[16];
+  int i;
+
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      make_name (name, i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+  msg ("created %d files", FILE_CNT);
+
+  for (i = 0; i < FILE_CNT; i += 2)
+    {
+      make_name (name, i);
+      if (!remove (name))
+        fail ("remove \"%s\" failed", name);
+    }
+  msg ("removed even-numbered files");
+
+  for (i = 0; i < FILE_CNT; i++)
+    check_entry (i, i % 2 != 0);
+  msg ("checked files");
+
+  for (i = 0; i < FILE_CNT; i += 4)
+    {
+      make_name (name, i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+      if (create (name, 0))
+        fail ("create \"%s\" succeeded twice", name);
+    }
+  msg ("re-created every fourth file");
+
+  for (i = 0; i < FILE_CNT; i++)
+    check_entry (i, i % 2 != 0 || i % 4 == 0);
+  msg ("checked files again");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-many) begin
+(dir-many) created 200 files
+(dir-many) removed even-numbered files
+(dir-many) checked files
+(dir-many) re-created every fourth file
+(dir-many) checked files again
+(dir-many) end
+EOF
+pass;
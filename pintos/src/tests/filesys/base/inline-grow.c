@@ -0,0 +1,50 @@
+/* Writes a file small enough to live inside its inode, checks it,
+   then grows it well past that with a write beyond end of file
+   and checks that the old data survived the move out of the
+   inode and that the gap reads as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define GROW_OFS 1500
+
+static char buf[GROW_OFS + 16];
+
+void
+test_main (void) 
+{
+  static const char data[] = "small file data";
+  static const char tail[] = "tail";
+  size_t i;
+  int fd;
+
+  CHECK (create ("inline", 0), "create \"inline\"");
+  CHECK ((fd = open ("inline")) > 1, "open \"inline\"");
+  CHECK (write (fd, data, sizeof data) == sizeof data,
+         "write %zu bytes", sizeof data);
+  seek (fd, 0);
+  if (read (fd, buf, sizeof data) != sizeof data
+      || memcmp (buf, data, sizeof data))
+    fail ("small file did not read back");
+  msg ("small file reads back");
+
+  seek (fd, GROW_OFS);
+  CHECK (write (fd, tail, sizeof tail) == sizeof tail,
+         "write at offset %d", GROW_OFS);
+  CHECK (filesize (fd) == GROW_OFS + (int) sizeof tail,
+         "filesize is %d", GROW_OFS + (int) sizeof tail);
+  seek (fd, 0);
+  if (read (fd, buf, GROW_OFS + sizeof tail) != GROW_OFS + sizeof tail)
+    fail ("read of grown file failed");
+  if (memcmp (buf, data, sizeof data))
+    fail ("old data lost when file grew");
+  for (i = sizeof data; i < GROW_OFS; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu is %d, not zero", i, buf[i]);
+  if (memcmp (buf + GROW_OFS, tail, sizeof tail))
+    fail ("new data did not read back");
+  msg ("grown file reads back");
+  close (fd);
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(inline-grow) begin
+(inline-grow) create "inline"
+(inline-grow) open "inline"
+(inline-grow) write 16 bytes
+(inline-grow) small file reads back
+(inline-grow) write at offset 1500
+(inline-grow) filesize is 1505
+(inline-grow) grown file reads back
+(inline-grow) end
+EOF
+pass;
@@ -0,0 +1,53 @@
+/* Writes a large file in small pieces, so that some of it is
+   still in the buffer cache, then reads it back with single
+   reads big enough to bypass the cache, into a buffer that is
+   not word-aligned and at a file offset that is not
+   sector-aligned, and checks the data. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 65536
+#define CHUNK 1000
+
+static char data[FILE_SIZE];
+static char buf[FILE_SIZE + 1];
+
+/* Reads SIZE bytes at OFS from FD into BUF + 1 in one read and
+   compares them with what was written. */
+static void
+check_read (int fd, size_t ofs, size_t size) 
+{
+  seek (fd, ofs);
+  if (read (fd, buf + 1, size) != (int) size)
+    fail ("read %zu bytes at offset %zu failed", size, ofs);
+  compare_bytes (buf + 1, data + ofs, size, ofs, "lg-read-direct");
+}
+
+void
+test_main (void) 
+{
+  size_t ofs;
+  int fd;
+
+  random_init (0);
+  random_bytes (data, sizeof data);
+
+  CHECK (create ("lg-read-direct", 0), "create \"lg-read-direct\"");
+  CHECK ((fd = open ("lg-read-direct")) > 1, "open \"lg-read-direct\"");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += CHUNK)
+    {
+      size_t size = FILE_SIZE - ofs < CHUNK ? FILE_SIZE - ofs : CHUNK;
+      if (write (fd, data + ofs, size) != (int) size)
+        fail ("write %zu bytes at offset %zu failed", size, ofs);
+    }
+  msg ("wrote %d bytes", FILE_SIZE);
+
+  check_read (fd, 0, FILE_SIZE);
+  check_read (fd, 100, FILE_SIZE - 300);
+  msg ("read back %d bytes", FILE_SIZE);
+  close (fd);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(lg-read-direct) begin
+(lg-read-direct) create "lg-read-direct"
+(lg-read-direct) open "lg-read-direct"
+(lg-read-direct) wrote 65536 bytes
+(lg-read-direct) read back 65536 bytes
+(lg-read-direct) end
+EOF
+pass;
@@ -0,0 +1,56 @@
+/* Pins a small file in the page cache, then writes and reads a
+   file larger than the whole cache, and checks that the pinned
+   file still reads back without a single sector read from disk.
+   Also checks that a file too large to fit cannot be pinned. */
+
+#include <inttypes.h>
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HOT_SIZE (8 * 1024)
+#define SCAN_SIZE (192 * 1024)
+
+static char data[SCAN_SIZE];
+static char buf[SCAN_SIZE];
+
+void
+test_main (void) 
+{
+  struct rusage before, after;
+  int hot, scan;
+
+  random_init (0);
+  random_bytes (data, sizeof data);
+
+  CHECK (create ("hot", 0), "create \"hot\"");
+  CHECK ((hot = open ("hot")) > 1, "open \"hot\"");
+  CHECK (write (hot, data, HOT_SIZE) == HOT_SIZE,
+         "write %d bytes", HOT_SIZE);
+  CHECK (pin (hot), "pin \"hot\"");
+
+  CHECK (create ("scan", 0), "create \"scan\"");
+  CHECK ((scan = open ("scan")) > 1, "open \"scan\"");
+  CHECK (write (scan, data, SCAN_SIZE) == SCAN_SIZE,
+         "write %d bytes", SCAN_SIZE);
+  CHECK (!pin (scan), "pin \"scan\" fails");
+  seek (scan, 0);
+  CHECK (read (scan, buf, SCAN_SIZE) == SCAN_SIZE,
+         "read %d bytes", SCAN_SIZE);
+
+  getrusage (&before);
+  seek (hot, 0);
+  if (read (hot, buf, HOT_SIZE) != HOT_SIZE)
+    fail ("read of pinned file failed");
+  getrusage (&after);
+  compare_bytes (buf, data, HOT_SIZE, 0, "hot");
+  if (after.read_sectors != before.read_sectors)
+    fail ("reading pinned file read %"PRIu64" sectors from disk",
+          after.read_sectors - before.read_sectors);
+  msg ("pinned file read from cache");
+
+  CHECK (unpin (hot), "unpin \"hot\"");
+  close (scan);
+  close (hot);
+}
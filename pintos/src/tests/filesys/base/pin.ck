@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pin) begin
+(pin) create "hot"
+(pin) open "hot"
+(pin) write 8192 bytes
+(pin) pin "hot"
+(pin) create "scan"
+(pin) open "scan"
+(pin) write 196608 bytes
+(pin) pin "scan" fails
+(pin) read 196608 bytes
+(pin) pinned file read from cache
+(pin) unpin "hot"
+(pin) end
+EOF
+pass;
@@ -0,0 +1,72 @@
+/* Clones a multi-sector file with reflink(), then writes to part
+   of the clone and part of the original and checks that each
+   write shows up only in the file it was made to.  Finally
+   removes the original and checks that the clone still reads
+   back. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 8192
+
+static char orig[FILE_SIZE];
+static char copy[FILE_SIZE];
+static char buf[FILE_SIZE];
+
+/* Checks that file NAME holds FILE_SIZE bytes matching EXPECT. */
+static void
+check_contents (const char *name, const char *expect)
+{
+  int fd;
+
+  CHECK ((fd = open (name)) > 1, "open \"%s\"", name);
+  if (read (fd, buf, FILE_SIZE) != FILE_SIZE)
+    fail ("read of \"%s\" failed", name);
+  compare_bytes (buf, expect, FILE_SIZE, 0, name);
+  msg ("\"%s\" reads back", name);
+  close (fd);
+}
+
+void
+test_main (void) 
+{
+  int fd;
+
+  random_init (0);
+  random_bytes (orig, sizeof orig);
+  memcpy (copy, orig, sizeof copy);
+
+  CHECK (create ("orig", 0), "create \"orig\"");
+  CHECK ((fd = open ("orig")) > 1, "open \"orig\"");
+  CHECK (write (fd, orig, FILE_SIZE) == FILE_SIZE,
+         "write %d bytes", FILE_SIZE);
+  close (fd);
+
+  CHECK (reflink ("orig", "copy"), "reflink \"orig\" to \"copy\"");
+  CHECK (!reflink ("orig", "copy"), "reflink to existing name fails");
+  CHECK (!reflink ("missing", "other"), "reflink of missing name fails");
+  check_contents ("copy", orig);
+
+  /* Part of one sector and all of the next, in the clone. */
+  CHECK ((fd = open ("copy")) > 1, "open \"copy\"");
+  memset (copy + 700, 'c', 1000);
+  seek (fd, 700);
+  CHECK (write (fd, copy + 700, 1000) == 1000, "write to \"copy\"");
+  close (fd);
+
+  /* A sector the clone still shares, in the original. */
+  CHECK ((fd = open ("orig")) > 1, "open \"orig\"");
+  memset (orig + 5000, 'o', 100);
+  seek (fd, 5000);
+  CHECK (write (fd, orig + 5000, 100) == 100, "write to \"orig\"");
+  close (fd);
+
+  check_contents ("orig", orig);
+  check_contents ("copy", copy);
+
+  CHECK (remove ("orig"), "remove \"orig\"");
+  check_contents ("copy", copy);
+}
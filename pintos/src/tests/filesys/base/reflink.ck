@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(reflink) begin
+(reflink) create "orig"
+(reflink) open "orig"
+(reflink) write 8192 bytes
+(reflink) reflink "orig" to "copy"
+(reflink) reflink to existing name fails
+(reflink) reflink of missing name fails
+(reflink) open "copy"
+(reflink) "copy" reads back
+(reflink) open "copy"
+(reflink) write to "copy"
+(reflink) open "orig"
+(reflink) write to "orig"
+(reflink) open "orig"
+(reflink) "orig" reads back
+(reflink) open "copy"
+(reflink) "copy" reads back
+(reflink) remove "orig"
+(reflink) open "copy"
+(reflink) "copy" reads back
+(reflink) end
+EOF
+pass;
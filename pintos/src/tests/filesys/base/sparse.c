@@ -0,0 +1,56 @@
+/* Creates a file larger than the whole disk, which works only if
+   its sectors are allocated as they are written, then writes a
+   little data far into it and checks that everything else reads
+   back as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (4 * 1024 * 1024)
+#define DATA_OFS (3 * 1024 * 1024 + 100)
+
+static char buf[1024];
+
+/* Reads sizeof buf bytes at OFS from FD and checks that they are
+   all zero. */
+static void
+check_zeros (int fd, int ofs) 
+{
+  size_t i;
+
+  seek (fd, ofs);
+  if (read (fd, buf, sizeof buf) != (int) sizeof buf)
+    fail ("read %zu bytes at offset %d failed", sizeof buf, ofs);
+  for (i = 0; i < sizeof buf; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu at offset %d is %d, not zero", i, ofs, buf[i]);
+}
+
+void
+test_main (void) 
+{
+  static const char data[] = "sparse";
+  int fd;
+
+  CHECK (create ("sparse", FILE_SIZE), "create \"sparse\"");
+  CHECK ((fd = open ("sparse")) > 1, "open \"sparse\"");
+  CHECK (filesize (fd) == FILE_SIZE, "filesize is %d", FILE_SIZE);
+  check_zeros (fd, 0);
+  check_zeros (fd, FILE_SIZE / 2);
+  msg ("hole reads as zeros");
+
+  seek (fd, DATA_OFS);
+  CHECK (write (fd, data, sizeof data) == sizeof data,
+         "write at offset %d", DATA_OFS);
+  seek (fd, DATA_OFS);
+  if (read (fd, buf, sizeof data) != sizeof data
+      || memcmp (buf, data, sizeof data))
+    fail ("data at offset %d did not read back", DATA_OFS);
+  check_zeros (fd, DATA_OFS - sizeof buf);
+  check_zeros (fd, DATA_OFS + sizeof data);
+  check_zeros (fd, FILE_SIZE - sizeof buf);
+  msg ("data reads back among zeros");
+  close (fd);
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sparse) begin
+(sparse) create "sparse"
+(sparse) open "sparse"
+(sparse) filesize is 4194304
+(sparse) hole reads as zeros
+(sparse) write at offset 3145828
+(sparse) data reads back among zeros
+(sparse) end
+EOF
+pass;
@@ -0,0 +1,45 @@
+/* Timing helpers shared by the file system benchmarks.
+
+   Each benchmark brackets a measured phase with bench_start() and
+   bench_report(), which prints one line starting with "BENCH" for
+   "make bench" to collect.  Timer ticks are coarse, so each phase
+   should run for many of them. */
+
+#include "tests/filesys/bench/bench.h"
+#include <kdata.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Waits for the start of a timer tick, so that a measured phase
+   does not begin part way through one, and returns the tick
+   count. */
+int64_t
+bench_start (void) 
+{
+  int64_t start = get_ticks ();
+
+  while (get_ticks () == start)
+    continue;
+  return start + 1;
+}
+
+/* Reports the phase called NAME, begun at tick START, which did
+   OPS operations transferring BYTES bytes of file data in all:
+   the ticks it took, the ticks per 1000 operations, and, if
+   BYTES is nonzero, the throughput in kB/s.  A phase quicker than
+   a tick is counted as taking one. */
+void
+bench_report (const char *name, int64_t start, long ops, long long bytes) 
+{
+  int64_t ticks = get_ticks () - start;
+  int64_t div = ticks > 0 ? ticks : 1;
+
+  if (bytes > 0)
+    msg ("BENCH %s: %ld ops, %lld bytes, %lld ticks, "
+         "%lld ticks/1000 ops, %lld kB/s",
+         name, ops, bytes, ticks, ticks * 1000 / (ops > 0 ? ops : 1),
+         bytes * KDATA_ADDR->ticks_per_sec / 1024 / div);
+  else
+    msg ("BENCH %s: %ld ops, %lld ticks, %lld ticks/1000 ops",
+         name, ops, ticks, ticks * 1000 / (ops > 0 ? ops : 1));
+}
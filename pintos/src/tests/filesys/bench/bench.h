@@ -0,0 +1,10 @@
+#ifndef TESTS_FILESYS_BENCH_BENCH_H
+#define TESTS_FILESYS_BENCH_BENCH_H
+
+#include <stdint.h>
+
+int64_t bench_start (void);
+void bench_report (const char *name, int64_t start, long ops,
+                   long long bytes);
+
+#endif /* tests/filesys/bench/bench.h */
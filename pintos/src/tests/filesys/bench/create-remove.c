@@ -0,0 +1,37 @@
+/* Creates and removes files as fast as it can, keeping a few of
+   them at a time, and reports the time per operation. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ROUND_CNT 500
+#define LIVE_CNT 8
+
+void
+test_main (void) 
+{
+  char name[16];
+  int64_t start;
+  int i;
+
+  start = bench_start ();
+  for (i = 0; i < ROUND_CNT + LIVE_CNT; i++)
+    {
+      if (i < ROUND_CNT)
+        {
+          snprintf (name, sizeof name, "f%d", i);
+          if (!create (name, 0))
+            fail ("create \"%s\" failed", name);
+        }
+      if (i >= LIVE_CNT)
+        {
+          snprintf (name, sizeof name, "f%d", i - LIVE_CNT);
+          if (!remove (name))
+            fail ("remove \"%s\" failed", name);
+        }
+    }
+  bench_report ("create-remove", start, 2 * ROUND_CNT, 0);
+}
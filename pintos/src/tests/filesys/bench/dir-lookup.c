@@ -0,0 +1,44 @@
+/* Fills one directory with files, then opens them in random
+   order, and reports the time taken per lookup. */
+
+#include <random.h>
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 200
+#define LOOKUP_CNT 2000
+
+void
+test_main (void) 
+{
+  char name[32];
+  int64_t start;
+  int i;
+
+  CHECK (mkdir ("dir"), "mkdir \"dir\"");
+  start = bench_start ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "dir/file%d", i);
+      if (!create (name, 0))
+        fail ("create \"%s\" failed", name);
+    }
+  bench_report ("dir-fill", start, FILE_CNT, 0);
+
+  start = bench_start ();
+  for (i = 0; i < LOOKUP_CNT; i++)
+    {
+      int fd;
+
+      snprintf (name, sizeof name, "dir/file%lu",
+                random_ulong () % FILE_CNT);
+      fd = open (name);
+      if (fd < 2)
+        fail ("open \"%s\" failed", name);
+      close (fd);
+    }
+  bench_report ("dir-lookup", start, LOOKUP_CNT, 0);
+}
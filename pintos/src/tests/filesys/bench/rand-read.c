@@ -0,0 +1,40 @@
+/* Reads 512-byte blocks at random offsets in a file too big for
+   the buffer cache, and reports the time taken. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (512 * 1024)
+#define BLOCK_SIZE 512
+#define READ_CNT 2000
+
+static char buf[4096];
+
+void
+test_main (void) 
+{
+  size_t ofs;
+  int64_t start;
+  int fd, i;
+
+  CHECK (create ("rand", FILE_SIZE), "create \"rand\"");
+  CHECK ((fd = open ("rand")) > 1, "open \"rand\"");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += sizeof buf)
+    if (write (fd, buf, sizeof buf) != sizeof buf)
+      fail ("write at %zu failed", ofs);
+  fsync (fd);
+
+  start = bench_start ();
+  for (i = 0; i < READ_CNT; i++)
+    {
+      unsigned pos = random_ulong () % (FILE_SIZE / BLOCK_SIZE) * BLOCK_SIZE;
+      if (pread (fd, buf, BLOCK_SIZE, pos) != BLOCK_SIZE)
+        fail ("read at %u failed", pos);
+    }
+  bench_report ("rand-read-512", start, READ_CNT,
+                (long long) READ_CNT * BLOCK_SIZE);
+  close (fd);
+}
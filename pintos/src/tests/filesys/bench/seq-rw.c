@@ -0,0 +1,52 @@
+/* Writes a file sequentially and reads it back, at each of
+   several block sizes, and reports the time for each. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE (512 * 1024)
+#define MAX_BLOCK 65536
+
+static char buf[MAX_BLOCK];
+
+static const int block_sizes[] = {512, 4096, 65536};
+
+void
+test_main (void) 
+{
+  size_t i;
+
+  for (i = 0; i < sizeof block_sizes / sizeof *block_sizes; i++)
+    {
+      int size = block_sizes[i];
+      int cnt = FILE_SIZE / size;
+      char name[32];
+      int64_t start;
+      int fd, j;
+
+      CHECK (create ("seq", 0), "create \"seq\"");
+      CHECK ((fd = open ("seq")) > 1, "open \"seq\"");
+
+      snprintf (name, sizeof name, "seq-write-%d", size);
+      start = bench_start ();
+      for (j = 0; j < cnt; j++)
+        if (write (fd, buf, size) != size)
+          fail ("write %d failed", j);
+      fsync (fd);
+      bench_report (name, start, cnt, FILE_SIZE);
+
+      snprintf (name, sizeof name, "seq-read-%d", size);
+      seek (fd, 0);
+      start = bench_start ();
+      for (j = 0; j < cnt; j++)
+        if (read (fd, buf, size) != size)
+          fail ("read %d failed", j);
+      bench_report (name, start, cnt, FILE_SIZE);
+
+      close (fd);
+      CHECK (remove ("seq"), "remove \"seq\"");
+    }
+}
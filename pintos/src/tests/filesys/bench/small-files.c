@@ -0,0 +1,48 @@
+/* Writes many small files, then reads them all back, and reports
+   the time for each pass. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/filesys/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 150
+#define FILE_SIZE 1024
+
+static char buf[FILE_SIZE];
+
+void
+test_main (void) 
+{
+  char name[16];
+  int64_t start;
+  int fd, i;
+
+  start = bench_start ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "s%d", i);
+      if (!create (name, 0) || (fd = open (name)) < 2)
+        fail ("create \"%s\" failed", name);
+      if (write (fd, buf, FILE_SIZE) != FILE_SIZE)
+        fail ("write \"%s\" failed", name);
+      close (fd);
+    }
+  sync ();
+  bench_report ("small-write", start, FILE_CNT,
+                (long long) FILE_CNT * FILE_SIZE);
+
+  start = bench_start ();
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      snprintf (name, sizeof name, "s%d", i);
+      if ((fd = open (name)) < 2)
+        fail ("open \"%s\" failed", name);
+      if (read (fd, buf, FILE_SIZE) != FILE_SIZE)
+        fail ("read \"%s\" failed", name);
+      close (fd);
+    }
+  bench_report ("small-read", start, FILE_CNT,
+                (long long) FILE_CNT * FILE_SIZE);
+}
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($fs);
+foreach my $i (0...7) {
+    $fs->{'d'}{chr (ord ('a') + $i) x ($i % 2 ? 63 : 1)} = [''];
+}
+check_archive ($fs);
+pass;
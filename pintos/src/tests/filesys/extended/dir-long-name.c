@@ -0,0 +1,52 @@
+/* Creates files with names of the longest length allowed in a
+   directory mixed with short ones, checks that a longer name is
+   refused, and checks that readdir() lists the long names
+   whole. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Stores in NAME the path "/d/" followed by LEN copies of C. */
+static void
+make_name (char *name, int len, char c)
+{
+  strlcpy (name, "/d/", 4);
+  memset (name + 3, c, len);
+  name[3 + len] = '\0';
+}
+
+void
+test_main (void) 
+{
+  char path[4 + READDIR_MAX_LEN + 1];
+  char name[READDIR_MAX_LEN + 1];
+  int fd, cnt, i;
+
+  CHECK (mkdir ("/d"), "mkdir \"/d\"");
+  for (i = 0; i < 8; i++)
+    {
+      make_name (path, i % 2 ? READDIR_MAX_LEN : 1, 'a' + i);
+      if (!create (path, 0))
+        fail ("create \"%s\" failed", path);
+    }
+  msg ("created 8 files");
+
+  make_name (path, READDIR_MAX_LEN + 1, 'z');
+  CHECK (!create (path, 0), "create file with too long name (must fail)");
+
+  CHECK ((fd = open ("/d")) > 1, "open \"/d\"");
+  cnt = 0;
+  while (readdir (fd, name))
+    {
+      i = name[0] - 'a';
+      if (i >= 0 && i < 8)
+        make_name (path, i % 2 ? READDIR_MAX_LEN : 1, 'a' + i);
+      if (i < 0 || i >= 8 || strcmp (name, path + 3))
+        fail ("unexpected name \"%s\"", name);
+      cnt++;
+    }
+  close (fd);
+  CHECK (cnt == 8, "readdir lists all 8 names");
+}
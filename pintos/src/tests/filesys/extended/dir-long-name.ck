@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-long-name) begin
+(dir-long-name) mkdir "/d"
+(dir-long-name) created 8 files
+(dir-long-name) create file with too long name (must fail)
+(dir-long-name) open "/d"
+(dir-long-name) readdir lists all 8 names
+(dir-long-name) end
+EOF
+pass;
@@ -0,0 +1,56 @@
+/* Creates a directory with many files, then lists it with
+   readdir_many() several names at a time and checks that every
+   file shows up exactly once. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 50
+#define BATCH 16
+
+void
+test_main (void) 
+{
+  char names[BATCH][READDIR_MAX_LEN + 1];
+  bool seen[FILE_CNT];
+  int total = 0;
+  int fd, n, i;
+
+  CHECK (mkdir ("/x"), "mkdir /x");
+  for (i = 0; i < FILE_CNT; i++) 
+    {
+      char file_name[32];
+      snprintf (file_name, sizeof file_name, "/x/file%d", i);
+      if (!create (file_name, 0))
+        fail ("create \"%s\" failed", file_name);
+      seen[i] = false;
+    }
+  msg ("created %d files", FILE_CNT);
+
+  CHECK ((fd = open ("/x")) > 1, "open \"/x\"");
+  while ((n = readdir_many (fd, names, BATCH)) > 0)
+    for (i = 0; i < n; i++) 
+      {
+        int idx;
+        if (memcmp (names[i], "file", 4)
+            || (idx = atoi (names[i] + 4)) < 0 || idx >= FILE_CNT)
+          fail ("unexpected name \"%s\"", names[i]);
+        if (seen[idx])
+          fail ("\"%s\" listed twice", names[i]);
+        seen[idx] = true;
+        total++;
+      }
+  if (n < 0)
+    fail ("readdir_many failed");
+  if (total != FILE_CNT)
+    fail ("listed %d files, expected %d", total, FILE_CNT);
+  msg ("listed every file once");
+
+  CHECK (readdir_many (fd, names, BATCH) == 0, "end of directory");
+  close (fd);
+  CHECK (readdir_many (fd, names, BATCH) == -1, "closed fd fails");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(dir-readdir-many) begin
+(dir-readdir-many) mkdir /x
+(dir-readdir-many) created 50 files
+(dir-readdir-many) open "/x"
+(dir-readdir-many) listed every file once
+(dir-readdir-many) end of directory
+(dir-readdir-many) closed fd fails
+(dir-readdir-many) end
+EOF
+pass;
@@ -0,0 +1,333 @@
+/* Microbenchmarks for kernel data structures.
+
+   Times hash tables at several sizes, list_sort(), bitmap_scan()
+   over fragmented bitmaps, malloc() and free() for each block
+   size class, and palloc_get_multiple() with the pool cut into
+   pieces, and prints the mean CPU cycles per operation of each,
+   so that a change to one of them can be judged by numbers.
+
+   Like the other tests in this directory, this is not a test we
+   will run on your submitted projects.  The numbers depend on
+   the machine, so there is nothing to check them against.
+*/
+
+#undef NDEBUG
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <list.h>
+#include <random.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/test.h"
+
+/* Times each group of operations is repeated. */
+#define ROUNDS 4
+
+/* A hash table or list element. */
+struct value
+  {
+    struct hash_elem h_elem;    /* Hash table element. */
+    struct list_elem l_elem;    /* List element. */
+    int value;                  /* Key. */
+  };
+
+static void bench_hash (size_t cnt);
+static void bench_list_sort (size_t cnt);
+static void bench_bitmap_scan (size_t bits, int busy_pct, size_t cnt);
+static void bench_malloc (size_t size);
+static void bench_palloc (size_t page_cnt);
+static void report (const char *name, size_t arg, uint64_t cycles,
+                    uint64_t ops);
+static void shuffle (int *, size_t);
+
+/* Runs each benchmark. */
+void
+test (void)
+{
+  static const size_t hash_cnts[] = {64, 1024, 16384};
+  static const size_t list_cnts[] = {100, 1000, 10000};
+  static const int busy_pcts[] = {50, 90, 99};
+  static const size_t scan_cnts[] = {1, 4, 16};
+  static const size_t malloc_sizes[] = {16, 64, 256, 1024, 4096};
+  static const size_t palloc_cnts[] = {1, 2, 4, 8};
+  size_t i, j;
+
+  for (i = 0; i < sizeof hash_cnts / sizeof *hash_cnts; i++)
+    bench_hash (hash_cnts[i]);
+  for (i = 0; i < sizeof list_cnts / sizeof *list_cnts; i++)
+    bench_list_sort (list_cnts[i]);
+  for (i = 0; i < sizeof busy_pcts / sizeof *busy_pcts; i++)
+    for (j = 0; j < sizeof scan_cnts / sizeof *scan_cnts; j++)
+      bench_bitmap_scan (16384, busy_pcts[i], scan_cnts[j]);
+  for (i = 0; i < sizeof malloc_sizes / sizeof *malloc_sizes; i++)
+    bench_malloc (malloc_sizes[i]);
+  for (i = 0; i < sizeof palloc_cnts / sizeof *palloc_cnts; i++)
+    bench_palloc (palloc_cnts[i]);
+
+  printf ("bench: done\n");
+}
+
+/* Hash function and comparison for struct value. */
+static unsigned
+value_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct value, h_elem)->value);
+}
+
+static bool
+value_hash_less (const struct hash_elem *a, const struct hash_elem *b,
+                 void *aux UNUSED)
+{
+  return (hash_entry (a, struct value, h_elem)->value
+          < hash_entry (b, struct value, h_elem)->value);
+}
+
+/* Times hash_insert() of CNT elements in random order into an
+   empty table, which grows as they go in, and then hash_find()
+   of each of them and of as many keys that are absent. */
+static void
+bench_hash (size_t cnt)
+{
+  struct value *values = malloc (cnt * sizeof *values);
+  int *keys = malloc (cnt * sizeof *keys);
+  uint64_t insert = 0, hit = 0, miss = 0;
+  int round;
+  size_t i;
+
+  ASSERT (values != NULL && keys != NULL);
+  for (i = 0; i < cnt; i++)
+    keys[i] = i * 2;
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      struct hash h;
+      struct value probe;
+      uint64_t start;
+
+      shuffle (keys, cnt);
+      for (i = 0; i < cnt; i++)
+        values[i].value = keys[i];
+      ASSERT (hash_init (&h, value_hash, value_hash_less, NULL));
+
+      start = timer_cycles ();
+      for (i = 0; i < cnt; i++)
+        hash_insert (&h, &values[i].h_elem);
+      insert += timer_cycles () - start;
+
+      shuffle (keys, cnt);
+      start = timer_cycles ();
+      for (i = 0; i < cnt; i++)
+        {
+          probe.value = keys[i];
+          ASSERT (hash_find (&h, &probe.h_elem) != NULL);
+        }
+      hit += timer_cycles () - start;
+
+      start = timer_cycles ();
+      for (i = 0; i < cnt; i++)
+        {
+          probe.value = keys[i] + 1;
+          ASSERT (hash_find (&h, &probe.h_elem) == NULL);
+        }
+      miss += timer_cycles () - start;
+
+      hash_destroy (&h, NULL);
+    }
+
+  report ("hash_insert", cnt, insert, ROUNDS * cnt);
+  report ("hash_find hit", cnt, hit, ROUNDS * cnt);
+  report ("hash_find miss", cnt, miss, ROUNDS * cnt);
+  free (keys);
+  free (values);
+}
+
+/* Comparison for list_sort(). */
+static bool
+value_list_less (const struct list_elem *a, const struct list_elem *b,
+                 void *aux UNUSED)
+{
+  return (list_entry (a, struct value, l_elem)->value
+          < list_entry (b, struct value, l_elem)->value);
+}
+
+/* Times list_sort() of a list of CNT elements in random order,
+   per element. */
+static void
+bench_list_sort (size_t cnt)
+{
+  struct value *values = malloc (cnt * sizeof *values);
+  int *keys = malloc (cnt * sizeof *keys);
+  uint64_t cycles = 0;
+  int round;
+  size_t i;
+
+  ASSERT (values != NULL && keys != NULL);
+  for (i = 0; i < cnt; i++)
+    keys[i] = i;
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      struct list list;
+      uint64_t start;
+
+      shuffle (keys, cnt);
+      list_init (&list);
+      for (i = 0; i < cnt; i++)
+        {
+          values[i].value = keys[i];
+          list_push_back (&list, &values[i].l_elem);
+        }
+
+      start = timer_cycles ();
+      list_sort (&list, value_list_less, NULL);
+      cycles += timer_cycles () - start;
+
+      ASSERT (list_entry (list_front (&list), struct value, l_elem)->value
+              == 0);
+    }
+
+  report ("list_sort per element", cnt, cycles, ROUNDS * cnt);
+  free (keys);
+  free (values);
+}
+
+/* Times bitmap_scan() for CNT consecutive free bits, from random
+   starting points, in a bitmap of BITS bits of which BUSY_PCT
+   percent, chosen at random, are set. */
+static void
+bench_bitmap_scan (size_t bits, int busy_pct, size_t cnt)
+{
+  struct bitmap *b = bitmap_create (bits);
+  enum { SCANS = 1000 };
+  uint64_t cycles = 0;
+  char name[32];
+  int round, i;
+  size_t j;
+
+  ASSERT (b != NULL);
+  for (round = 0; round < ROUNDS; round++)
+    {
+      uint64_t start;
+
+      for (j = 0; j < bits; j++)
+        bitmap_set (b, j, (int) (random_ulong () % 100) < busy_pct);
+
+      start = timer_cycles ();
+      for (i = 0; i < SCANS; i++)
+        bitmap_scan (b, random_ulong () % bits, cnt, false);
+      cycles += timer_cycles () - start;
+    }
+
+  snprintf (name, sizeof name, "bitmap_scan %d%% busy, run", busy_pct);
+  report (name, cnt, cycles, ROUNDS * SCANS);
+  bitmap_destroy (b);
+}
+
+/* Times a mix of malloc() and free() calls for blocks of SIZE
+   bytes: allocates a batch of blocks, frees half of them in
+   random order, allocates them again, and frees them all. */
+static void
+bench_malloc (size_t size)
+{
+  enum { BATCH = 256 };
+  static void *blocks[BATCH];
+  static int order[BATCH];
+  uint64_t cycles = 0;
+  int round, i;
+
+  for (i = 0; i < BATCH; i++)
+    order[i] = i;
+  for (round = 0; round < ROUNDS; round++)
+    {
+      uint64_t start;
+
+      shuffle (order, BATCH);
+      start = timer_cycles ();
+      for (i = 0; i < BATCH; i++)
+        blocks[i] = malloc (size);
+      for (i = 0; i < BATCH / 2; i++)
+        free (blocks[order[i]]);
+      for (i = 0; i < BATCH / 2; i++)
+        blocks[order[i]] = malloc (size);
+      for (i = 0; i < BATCH; i++)
+        free (blocks[order[i]]);
+      cycles += timer_cycles () - start;
+    }
+
+  /* Each round makes BATCH * 1.5 calls to each function. */
+  report ("malloc+free, bytes", size, cycles, ROUNDS * BATCH * 3);
+}
+
+/* Times palloc_get_multiple() of PAGE_CNT pages, and freeing
+   them, with the kernel pool cut into pieces: a batch of single
+   pages is allocated and every other one freed, so that runs of
+   free pages are scarce. */
+static void
+bench_palloc (size_t page_cnt)
+{
+  enum { PIECES = 64, ALLOCS = 32 };
+  static void *pieces[PIECES];
+  static void *runs[ALLOCS];
+  uint64_t cycles = 0;
+  int round, i, got = 0;
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      uint64_t start;
+
+      for (i = 0; i < PIECES; i++)
+        pieces[i] = palloc_get_page (0);
+      for (i = 0; i < PIECES; i += 2)
+        {
+          palloc_free_page (pieces[i]);
+          pieces[i] = NULL;
+        }
+
+      start = timer_cycles ();
+      for (i = 0; i < ALLOCS; i++)
+        runs[i] = palloc_get_multiple (0, page_cnt);
+      for (i = 0; i < ALLOCS; i++)
+        if (runs[i] != NULL)
+          {
+            palloc_free_multiple (runs[i], page_cnt);
+            got++;
+          }
+      cycles += timer_cycles () - start;
+
+      for (i = 0; i < PIECES; i++)
+        palloc_free_page (pieces[i]);
+    }
+
+  report ("palloc_get_multiple+free, pages", page_cnt, cycles,
+          ROUNDS * ALLOCS);
+  if (got < ROUNDS * ALLOCS)
+    printf ("  (%d of %d allocations failed)\n",
+            ROUNDS * ALLOCS - got, ROUNDS * ALLOCS);
+}
+
+/* Prints the mean of CYCLES over OPS operations for the
+   benchmark NAME run with parameter ARG. */
+static void
+report (const char *name, size_t arg, uint64_t cycles, uint64_t ops)
+{
+  printf ("%s %zu: %"PRIu64" cycles/op\n", name, arg, cycles / ops);
+}
+
+/* Shuffles the CNT elements in ARRAY into random order. */
+static void
+shuffle (int *array, size_t cnt)
+{
+  size_t i;
+
+  for (i = 0; i < cnt; i++)
+    {
+      size_t j = i + random_ulong () % (cnt - i);
+      int t = array[j];
+      array[j] = array[i];
+      array[i] = t;
+    }
+}
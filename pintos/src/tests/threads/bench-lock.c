@@ -0,0 +1,60 @@
+/* Measures handing a contended lock from thread to thread.
+   Several threads each take the lock many times and yield while
+   holding it, so that the others queue up on it and every release
+   passes it to a waiter.  Reports the cycles for each acquisition,
+   for a few numbers of threads. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define MAX_THREAD_CNT 16
+#define ACQUIRE_CNT 1000
+
+static thread_func lock_thread;
+static struct lock lock;
+static struct semaphore done;
+
+void
+test_bench_lock (void) 
+{
+  int thread_cnt;
+
+  lock_init (&lock);
+  sema_init (&done, 0);
+  for (thread_cnt = 2; thread_cnt <= MAX_THREAD_CNT; thread_cnt *= 2)
+    {
+      char name[32];
+      uint64_t start;
+      int i;
+
+      start = timer_cycles ();
+      for (i = 0; i < thread_cnt; i++)
+        {
+          snprintf (name, sizeof name, "locker %d", i);
+          thread_create (name, thread_get_priority (), lock_thread, NULL);
+        }
+      for (i = 0; i < thread_cnt; i++)
+        sema_down (&done);
+
+      snprintf (name, sizeof name, "lock-handoff-%d", thread_cnt);
+      bench_msg (name, timer_cycles () - start,
+                 (long) thread_cnt * ACQUIRE_CNT);
+    }
+}
+
+static void
+lock_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ACQUIRE_CNT; i++)
+    {
+      lock_acquire (&lock);
+      thread_yield ();
+      lock_release (&lock);
+    }
+  sema_up (&done);
+}
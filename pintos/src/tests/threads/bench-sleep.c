@@ -0,0 +1,40 @@
+/* Measures how late timer_sleep() wakes a thread.  Sleeps many
+   times for each of a few lengths, each starting just after a
+   tick, and reports the cycles by which each sleep overran the
+   length asked for. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define SLEEP_CNT 20
+
+void
+test_bench_sleep (void) 
+{
+  static const int lengths[] = {1, 2, 5, 10};
+  size_t i;
+
+  for (i = 0; i < sizeof lengths / sizeof *lengths; i++)
+    {
+      uint64_t wanted = timer_cycles_per_sec () * lengths[i] / TIMER_FREQ;
+      uint64_t late = 0;
+      char name[32];
+      int j;
+
+      for (j = 0; j < SLEEP_CNT; j++)
+        {
+          uint64_t start, slept;
+
+          timer_sleep (1);
+          start = timer_cycles ();
+          timer_sleep (lengths[i]);
+          slept = timer_cycles () - start;
+          late += slept > wanted ? slept - wanted : 0;
+        }
+
+      snprintf (name, sizeof name, "sleep-%d-late", lengths[i]);
+      bench_msg (name, late, SLEEP_CNT);
+    }
+}
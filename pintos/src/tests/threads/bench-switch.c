@@ -0,0 +1,50 @@
+/* Measures the round trip between two threads that take turns
+   through a pair of semaphores, each turn a wakeup and a context
+   switch, and reports the cycles for each round trip. */
+
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+#define ROUND_CNT 10000
+
+static thread_func pong_thread;
+
+/* PING wakes the other thread, which answers through PONG. */
+static struct semaphore ping, pong;
+
+void
+test_bench_switch (void) 
+{
+  uint64_t start;
+  int i;
+
+  sema_init (&ping, 0);
+  sema_init (&pong, 0);
+  thread_create ("pong", thread_get_priority (), pong_thread, NULL);
+
+  /* One round to get the other thread going. */
+  sema_up (&ping);
+  sema_down (&pong);
+
+  start = timer_cycles ();
+  for (i = 0; i < ROUND_CNT; i++)
+    {
+      sema_up (&ping);
+      sema_down (&pong);
+    }
+  bench_msg ("switch-round-trip", timer_cycles () - start, ROUND_CNT);
+}
+
+static void
+pong_thread (void *aux UNUSED) 
+{
+  int i;
+
+  for (i = 0; i < ROUND_CNT + 1; i++)
+    {
+      sema_down (&ping);
+      sema_up (&pong);
+    }
+}
@@ -1,7 +1,9 @@
 #include "tests/threads/tests.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <string.h>
 #include <stdio.h>
+#include "devices/timer.h"
 
 struct test 
   {
@@ -38,6 +40,9 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"bench-switch", test_bench_switch},
+    {"bench-lock", test_bench_lock},
+    {"bench-sleep", test_bench_sleep},
   };
 
 static const char *test_name;
@@ -93,6 +98,18 @@ fail (const char *format, ...)
   PANIC ("test failed");
 }
 
+/* Prints a line starting with "BENCH", for "make bench" to
+   collect, reporting that OPS operations called NAME took CYCLES
+   timer_cycles() in all: the cycles and nanoseconds for each. */
+void
+bench_msg (const char *name, uint64_t cycles, long ops) 
+{
+  uint64_t per_op = cycles / (ops > 0 ? ops : 1);
+
+  msg ("BENCH %s: %ld ops, %"PRIu64" cycles/op, %"PRIu64" ns/op",
+       name, ops, per_op, timer_cycles_to_ns (per_op));
+}
+
 /* Prints a message indicating the current test passed. */
 void
 pass (void) 
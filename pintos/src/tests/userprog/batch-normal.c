@@ -0,0 +1,39 @@
+/* Runs several reads, a seek, and a close in one batch() call
+   and checks each result. */
+
+#include <syscall.h>
+#include <syscall-nr.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf1[16], buf2[16];
+
+void
+test_main (void) 
+{
+  struct batch_entry e[5] =
+    {
+      {SYS_READ, {0, (int) buf1, sizeof buf1}, 0},
+      {SYS_SEEK, {0, 0, 0}, 0},
+      {SYS_READ, {0, (int) buf2, sizeof buf2}, 0},
+      {SYS_HALT, {0, 0, 0}, 0},
+      {SYS_CLOSE, {0, 0, 0}, 0},
+    };
+  int handle, i;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  for (i = 0; i < 5; i++)
+    e[i].args[0] = handle;
+
+  CHECK (batch (e, 5) == 5, "batch");
+  if (e[0].result != sizeof buf1 || e[2].result != sizeof buf2)
+    fail ("batched reads returned %d and %d", e[0].result, e[2].result);
+  compare_bytes (buf1, sample, sizeof buf1, 0, "sample.txt");
+  compare_bytes (buf2, sample, sizeof buf2, 0, "sample.txt");
+  if (e[3].result != -1)
+    fail ("batched halt returned %d", e[3].result);
+  if (read (handle, buf1, sizeof buf1) != -1)
+    fail ("batched close left file open");
+  msg ("batch results correct");
+}
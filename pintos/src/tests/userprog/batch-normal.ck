@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(batch-normal) begin
+(batch-normal) open "sample.txt"
+(batch-normal) batch
+(batch-normal) batch results correct
+(batch-normal) end
+batch-normal: exit(0)
+EOF
+pass;
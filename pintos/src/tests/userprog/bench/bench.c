@@ -0,0 +1,34 @@
+/* Timing helpers shared by the system call benchmarks.
+
+   Each benchmark brackets a measured loop with bench_start() and
+   bench_report(), which prints one line starting with "BENCH" for
+   "make bench" to collect.  Times come from get_ns(), which reads
+   the time-stamp counter without a system call, so even a loop
+   shorter than a timer tick is measured fairly. */
+
+#include "tests/userprog/bench/bench.h"
+#include <inttypes.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Returns the time at which a measured loop starts. */
+uint64_t
+bench_start (void) 
+{
+  return get_ns ();
+}
+
+/* Reports the loop called NAME, begun at time START, which did
+   OPS iterations: the time per iteration and the iterations per
+   second. */
+void
+bench_report (const char *name, uint64_t start, long ops) 
+{
+  uint64_t ns = get_ns () - start;
+
+  if (ns == 0)
+    ns = 1;
+  msg ("BENCH %s: %ld ops, %"PRIu64" ns/op, %"PRIu64" ops/s",
+       name, ops, ns / (ops > 0 ? ops : 1),
+       (uint64_t) ops * 1000000000 / ns);
+}
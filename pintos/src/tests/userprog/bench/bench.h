@@ -0,0 +1,9 @@
+#ifndef TESTS_USERPROG_BENCH_BENCH_H
+#define TESTS_USERPROG_BENCH_BENCH_H
+
+#include <stdint.h>
+
+uint64_t bench_start (void);
+void bench_report (const char *name, uint64_t start, long ops);
+
+#endif /* tests/userprog/bench/bench.h */
@@ -0,0 +1,22 @@
+/* Runs a trivial child and waits for it, over and over, and
+   reports the time for each round trip. */
+
+#include <syscall.h>
+#include "tests/userprog/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_CNT 50
+
+void
+test_main (void) 
+{
+  uint64_t start;
+  int i;
+
+  start = bench_start ();
+  for (i = 0; i < CHILD_CNT; i++)
+    if (wait (exec ("child-simple")) != 81)
+      fail ("child-simple failed");
+  bench_report ("exec-wait", start, CHILD_CNT);
+}
@@ -0,0 +1,25 @@
+/* Times tell(), about the least work a system call can do, so
+   that the result is mostly the cost of entering and leaving the
+   kernel. */
+
+#include <syscall.h>
+#include "tests/userprog/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CALL_CNT 20000
+
+void
+test_main (void) 
+{
+  uint64_t start;
+  int fd, i;
+
+  CHECK (create ("null", 0), "create \"null\"");
+  CHECK ((fd = open ("null")) > 1, "open \"null\"");
+
+  start = bench_start ();
+  for (i = 0; i < CALL_CNT; i++)
+    tell (fd);
+  bench_report ("null-syscall", start, CALL_CNT);
+}
@@ -0,0 +1,27 @@
+/* Opens and closes the same file over and over, and reports the
+   time for each pair. */
+
+#include <syscall.h>
+#include "tests/userprog/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define OPEN_CNT 2000
+
+void
+test_main (void) 
+{
+  uint64_t start;
+  int fd, i;
+
+  CHECK (create ("oc", 0), "create \"oc\"");
+
+  start = bench_start ();
+  for (i = 0; i < OPEN_CNT; i++)
+    {
+      if ((fd = open ("oc")) < 2)
+        fail ("open \"oc\" failed");
+      close (fd);
+    }
+  bench_report ("open-close", start, OPEN_CNT);
+}
@@ -0,0 +1,69 @@
+/* Writes and then reads a cached file in transfers from 1 byte to
+   64 kB, and reports the time for each size.  Each size moves the
+   same amount of data, except that small sizes do at least
+   MIN_CNT transfers. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/userprog/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define MAX_SIZE (64 * 1024)
+#define TOTAL_SIZE (256 * 1024)
+#define MIN_CNT 1000
+
+static char buf[MAX_SIZE];
+
+/* Does CNT transfers of SIZE bytes through FD, wrapping back to
+   the start of the file as it reaches the end, with WRITE_ or
+   else read(). */
+static void
+transfer (int fd, size_t size, long cnt, bool write_) 
+{
+  size_t ofs = 0;
+  long i;
+
+  seek (fd, 0);
+  for (i = 0; i < cnt; i++)
+    {
+      if (ofs + size > MAX_SIZE)
+        {
+          seek (fd, 0);
+          ofs = 0;
+        }
+      if ((size_t) (write_ ? write (fd, buf, size)
+                    : read (fd, buf, size)) != size)
+        fail ("%s of %zu bytes at %zu failed",
+              write_ ? "write" : "read", size, ofs);
+      ofs += size;
+    }
+}
+
+void
+test_main (void) 
+{
+  size_t size;
+  int fd;
+
+  CHECK (create ("rw", MAX_SIZE), "create \"rw\"");
+  CHECK ((fd = open ("rw")) > 1, "open \"rw\"");
+  transfer (fd, MAX_SIZE, 1, true);
+
+  for (size = 1; size <= MAX_SIZE; size *= 4)
+    {
+      long cnt = TOTAL_SIZE / size > MIN_CNT ? TOTAL_SIZE / size : MIN_CNT;
+      char name[32];
+      uint64_t start;
+
+      snprintf (name, sizeof name, "write-%zu", size);
+      start = bench_start ();
+      transfer (fd, size, cnt, true);
+      bench_report (name, start, cnt);
+
+      snprintf (name, sizeof name, "read-%zu", size);
+      start = bench_start ();
+      transfer (fd, size, cnt, false);
+      bench_report (name, start, cnt);
+    }
+}
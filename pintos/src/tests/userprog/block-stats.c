@@ -0,0 +1,31 @@
+/* Reads the statistics of the first block device and checks
+   that they are consistent, then checks that asking for a
+   device that does not exist fails. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct block_stats s;
+  uint64_t total = 0;
+  int i;
+
+  CHECK (block_stats (0, &s), "block_stats(0)");
+  if (s.name[0] == '\0')
+    fail ("device has no name");
+  if (s.request_cnt == 0 || s.read_cnt == 0)
+    fail ("loading this program did not read %s", s.name);
+
+  for (i = 0; i < BLOCK_LATENCY_BUCKETS; i++)
+    total += s.latency[i];
+  if (total != s.request_cnt)
+    fail ("latency histogram does not add up to request count");
+  if (s.busy > s.elapsed)
+    fail ("busy for longer than elapsed time");
+  msg ("statistics consistent");
+
+  CHECK (!block_stats (1000, &s), "block_stats(1000) fails");
+}
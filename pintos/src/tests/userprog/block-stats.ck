@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(block-stats) begin
+(block-stats) block_stats(0)
+(block-stats) statistics consistent
+(block-stats) block_stats(1000) fails
+(block-stats) end
+block-stats: exit(0)
+EOF
+pass;
@@ -0,0 +1,35 @@
+/* Child process run by pipe-normal test.
+
+   Writes PIPE_TOTAL bytes to the write end of a pipe inherited
+   from its parent, whose descriptor is the first command-line
+   argument, more than the pipe holds at once. */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/userprog/pipe.h"
+
+const char *test_name = "child-pipe";
+
+int
+main (int argc UNUSED, char *argv[]) 
+{
+  static char buf[PIPE_CHUNK];
+  int fd, ofs, i;
+
+  msg ("begin");
+  if (!isdigit (*argv[1]))
+    fail ("bad command-line arguments");
+  fd = atoi (argv[1]);
+  for (ofs = 0; ofs < PIPE_TOTAL; ofs += PIPE_CHUNK)
+    {
+      for (i = 0; i < PIPE_CHUNK; i++)
+        buf[i] = pipe_byte (ofs + i);
+      if (write (fd, buf, PIPE_CHUNK) != PIPE_CHUNK)
+        fail ("write at offset %d failed", ofs);
+    }
+  msg ("end");
+
+  return 0;
+}
@@ -0,0 +1,26 @@
+/* Copies a file with copy_file_range() and verifies the copy. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int in, out, byte_cnt;
+
+  CHECK ((in = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (create ("copy.txt", 0), "create \"copy.txt\"");
+  CHECK ((out = open ("copy.txt")) > 1, "open \"copy.txt\"");
+
+  /* Ask for more than there is: copy stops at end of file. */
+  byte_cnt = copy_file_range (in, out, sizeof sample * 2);
+  if (byte_cnt != (int) (sizeof sample - 1))
+    fail ("copy_file_range() returned %d instead of %zu",
+          byte_cnt, sizeof sample - 1);
+  msg ("copy_file_range");
+
+  seek (out, 0);
+  check_file_handle (out, "copy.txt", sample, sizeof sample - 1);
+}
@@ -0,0 +1,25 @@
+/* Starts child processes with exec_async(), which returns before
+   they load, and checks that wait() returns the exit status of
+   one that loads and -1 for one whose program is missing. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  pid_t pid;
+
+  /* Children print as they load and run, so report only once
+     each is done. */
+  pid = exec_async ("child-simple");
+  if (pid == -1)
+    fail ("exec_async(\"child-simple\") returned -1");
+  msg ("wait(exec_async(\"child-simple\")) = %d", wait (pid));
+
+  pid = exec_async ("no-such-file");
+  if (pid == -1)
+    fail ("exec_async(\"no-such-file\") returned -1");
+  msg ("wait(exec_async(\"no-such-file\")) = %d", wait (pid));
+}
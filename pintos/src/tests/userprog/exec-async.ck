@@ -0,0 +1,25 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF']);
+(exec-async) begin
+(child-simple) run
+child-simple: exit(81)
+(exec-async) wait(exec_async("child-simple")) = 81
+load: no-such-file: open failed
+no-such-file: exit(-1)
+(exec-async) wait(exec_async("no-such-file")) = -1
+(exec-async) end
+exec-async: exit(0)
+EOF
+(exec-async) begin
+(child-simple) run
+child-simple: exit(81)
+(exec-async) wait(exec_async("child-simple")) = 81
+load: no-such-file: open failed
+(exec-async) wait(exec_async("no-such-file")) = -1
+(exec-async) end
+exec-async: exit(0)
+EOF
+pass;
@@ -0,0 +1,49 @@
+/* Forks a child, which checks that it starts with copies of the
+   parent's data, stack and open file, changes them and exits.
+   Then checks that the parent's copies did not change. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Initialized data, and several pages of zero-filled data. */
+static int data = 42;
+static char bss[4096 * 4];
+
+void
+test_main (void) 
+{
+  char buf[16];
+  int local = 7;
+  int handle;
+  pid_t pid;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (read (handle, buf, 5) == 5, "read 5 bytes");
+  memset (bss, 'p', sizeof bss);
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      /* Child. */
+      msg ("child: data = %d, local = %d", data, local);
+      if (bss[0] != 'p' || bss[sizeof bss - 1] != 'p')
+        fail ("child sees wrong bss contents");
+      if (read (handle, buf, 10) != 10 || memcmp (buf, sample + 5, 10))
+        fail ("child read wrong data from inherited file");
+      data = 1;
+      local = 2;
+      memset (bss, 'c', sizeof bss);
+      msg ("child done");
+      exit (81);
+    }
+
+  msg ("wait(fork()) = %d", wait (pid));
+  CHECK (data == 42 && local == 7, "parent's data and stack unchanged");
+  CHECK (bss[0] == 'p' && bss[sizeof bss - 1] == 'p',
+         "parent's bss unchanged");
+  CHECK (read (handle, buf, 5) == 5 && !memcmp (buf, sample + 5, 5),
+         "parent's file position unchanged");
+}
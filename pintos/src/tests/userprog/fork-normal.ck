@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-normal) begin
+(fork-normal) open "sample.txt"
+(fork-normal) read 5 bytes
+(fork-normal) child: data = 42, local = 7
+(fork-normal) child done
+fork-normal: exit(81)
+(fork-normal) wait(fork()) = 81
+(fork-normal) parent's data and stack unchanged
+(fork-normal) parent's bss unchanged
+(fork-normal) parent's file position unchanged
+(fork-normal) end
+fork-normal: exit(0)
+EOF
+pass;
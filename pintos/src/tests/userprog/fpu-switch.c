@@ -0,0 +1,88 @@
+/* Has two threads in one process take turns, many times, each
+   keeping its own value on the FPU stack while the other runs,
+   and checks that neither ever sees the other's value. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ROUNDS 20
+#define STACK_SIZE 4096
+
+static char stack[STACK_SIZE];
+
+/* Whose turn it is: 0 for the main thread, 1 for the other. */
+static int turn;
+
+/* Pushes VALUE onto a freshly initialized FPU stack. */
+static void
+fpu_push (int value)
+{
+  asm volatile ("fninit; fildl %0" : : "m" (value));
+}
+
+/* Pops and returns the value on top of the FPU stack. */
+static int
+fpu_pop (void)
+{
+  int value;
+
+  asm volatile ("fistpl %0" : "=m" (value));
+  return value;
+}
+
+/* Gives the turn to thread TO and waits to get it back. */
+static void
+pass_turn (int to)
+{
+  turn = to;
+  futex_wake (&turn, 1);
+  while (turn == to)
+    futex_wait (&turn, to);
+}
+
+/* The other thread.  Returns the number of rounds in which its
+   value did not survive. */
+static int
+other (void *aux UNUSED)
+{
+  int bad_cnt = 0;
+  int i;
+
+  while (turn != 1)
+    futex_wait (&turn, 0);
+  for (i = 0; i < ROUNDS; i++)
+    {
+      fpu_push (2000 + i);
+      pass_turn (0);
+      if (fpu_pop () != 2000 + i)
+        bad_cnt++;
+    }
+  return bad_cnt;
+}
+
+void
+test_main (void) 
+{
+  tid_t tid;
+  int i;
+
+  CHECK ((tid = uthread_create (other, NULL, stack, STACK_SIZE))
+         != TID_ERROR, "uthread_create");
+  for (i = 0; i < ROUNDS; i++)
+    {
+      int value;
+
+      fpu_push (1000 + i);
+      pass_turn (1);
+      value = fpu_pop ();
+      if (value != 1000 + i)
+        fail ("main thread's FPU value is %d, not %d", value, 1000 + i);
+    }
+  msg ("main thread's FPU values kept");
+
+  /* Let the other thread check its last value. */
+  turn = 1;
+  futex_wake (&turn, 1);
+  CHECK (uthread_join (tid) == 0, "other thread's FPU values kept");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fpu-switch) begin
+(fpu-switch) uthread_create
+(fpu-switch) main thread's FPU values kept
+(fpu-switch) other thread's FPU values kept
+(fpu-switch) end
+fpu-switch: exit(0)
+EOF
+pass;
@@ -0,0 +1,39 @@
+/* Writes and reads back a file, then checks that the file
+   system statistics count the bytes moved and some cache
+   activity, and that asking about a bad fd fails. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct fs_stats s;
+  int handle;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+  CHECK (write (handle, sample, sizeof sample - 1)
+         == (int) (sizeof sample - 1), "write sample");
+  check_file_handle (handle, "test.txt", sample, sizeof sample - 1);
+
+  CHECK (fs_stats (handle, &s), "fs_stats(\"test.txt\")");
+  if (s.write_bytes != sizeof sample - 1)
+    fail ("%llu bytes written, expected %zu", s.write_bytes,
+          sizeof sample - 1);
+  if (s.read_bytes < sizeof sample - 1)
+    fail ("only %llu bytes read", s.read_bytes);
+  if (s.cache.hit_cnt + s.cache.miss_cnt == 0)
+    fail ("no cache accesses counted");
+  if (s.cache.read_ahead_hit_cnt + s.cache.read_ahead_wasted_cnt
+      > s.cache.read_ahead_cnt)
+    fail ("more read-ahead sectors used or wasted than read");
+  msg ("statistics consistent");
+
+  CHECK (fs_stats (-1, &s), "fs_stats(-1)");
+  if (s.read_bytes != 0 || s.write_bytes != 0)
+    fail ("fs_stats(-1) counted file bytes");
+  CHECK (!fs_stats (1234, &s), "fs_stats(1234) fails");
+}
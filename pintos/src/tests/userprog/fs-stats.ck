@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fs-stats) begin
+(fs-stats) create "test.txt"
+(fs-stats) open "test.txt"
+(fs-stats) write sample
+(fs-stats) verified contents of "test.txt"
+(fs-stats) fs_stats("test.txt")
+(fs-stats) statistics consistent
+(fs-stats) fs_stats(-1)
+(fs-stats) fs_stats(1234) fails
+(fs-stats) end
+fs-stats: exit(0)
+EOF
+pass;
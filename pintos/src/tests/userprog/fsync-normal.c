@@ -0,0 +1,24 @@
+/* Writes a file, forces it to disk with fsync() and sync(), and
+   checks that its contents are intact afterward. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  int handle;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+  CHECK (write (handle, sample, sizeof sample - 1)
+         == (int) (sizeof sample - 1), "write sample");
+  CHECK (fsync (handle), "fsync \"test.txt\"");
+  CHECK (!fsync (0), "fsync stdin fails");
+  CHECK (!fsync (1234), "fsync bad fd fails");
+  sync ();
+  msg ("sync");
+  check_file_handle (handle, "test.txt", sample, sizeof sample - 1);
+}
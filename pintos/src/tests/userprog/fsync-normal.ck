@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fsync-normal) begin
+(fsync-normal) create "test.txt"
+(fsync-normal) open "test.txt"
+(fsync-normal) write sample
+(fsync-normal) fsync "test.txt"
+(fsync-normal) fsync stdin fails
+(fsync-normal) fsync bad fd fails
+(fsync-normal) sync
+(fsync-normal) verified contents of "test.txt"
+(fsync-normal) end
+fsync-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,21 @@
+/* Checks the cases of futex_wait and futex_wake that a
+   single-threaded process can reach: waiting on an int that no
+   longer holds the expected value, on a misaligned or unmapped
+   address, and waking an int nobody waits on. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static int word = 5;
+
+void
+test_main (void) 
+{
+  CHECK (futex_wait (&word, 4) == -1, "futex_wait with stale value");
+  CHECK (futex_wait ((int *) ((char *) &word + 1), 5) == -1,
+         "futex_wait on misaligned address");
+  CHECK (futex_wait ((int *) 0xc0000000, 0) == -1,
+         "futex_wait on kernel address");
+  CHECK (futex_wake (&word, 1) == 0, "futex_wake with no waiters");
+}
@@ -0,0 +1,38 @@
+/* Reads the calling process's resource usage, runs a child, and
+   checks that the counts went up by the system calls made in
+   between and did not go down, and that the CPU time spent in
+   them was counted.  Then passes a kernel address,
+   which must kill the process. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct rusage before, after;
+
+  getrusage (&before);
+  msg ("wait(exec()) = %d", wait (exec ("child-simple")));
+  getrusage (&after);
+
+  if (before.syscalls == 0)
+    fail ("no system calls counted");
+  if (after.syscalls < before.syscalls + 3)
+    fail ("system calls between getrusage() calls not counted");
+  if (after.ticks < before.ticks
+      || after.page_faults < before.page_faults
+      || after.read_sectors < before.read_sectors
+      || after.write_sectors < before.write_sectors
+      || after.user_ns < before.user_ns
+      || after.kernel_ns < before.kernel_ns
+      || after.intr_ns < before.intr_ns)
+    fail ("resource usage went down");
+  if (after.kernel_ns == before.kernel_ns)
+    fail ("kernel time between getrusage() calls not counted");
+  msg ("usage consistent");
+
+  getrusage ((struct rusage *) 0xc0000000);
+  fail ("should have exited with -1");
+}
@@ -0,0 +1,39 @@
+/* Reads the time and pid from the kernel data page and checks
+   that the kernel keeps the time current, and that the
+   nanosecond clock moves on by about as much as the ticks. */
+
+#include <inttypes.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct kdata kd;
+  int64_t start;
+  uint64_t start_ns, ns;
+
+  start = get_ticks ();
+  CHECK (start > 0, "get_ticks");
+  CHECK (getpid () > 0, "getpid");
+
+  /* Without any system call, time must still move on. */
+  start_ns = get_ns ();
+  while (get_ticks () < start + 2)
+    continue;
+  ns = get_ns () - start_ns;
+  msg ("ticks advanced");
+
+  /* At least one whole tick went by, but not a whole second. */
+  kdata_read (&kd);
+  if (ns < 1000000000u / kd.ticks_per_sec || ns >= 1000000000)
+    fail ("%"PRIu64" ns went by in 1 to 2 ticks", ns);
+  msg ("ns advanced");
+
+  if (kd.tid != getpid ())
+    fail ("kdata_read() returned pid %d, getpid() %d", kd.tid, getpid ());
+  if (kd.ticks < start || kd.user_ticks <= 0)
+    fail ("kdata_read() returned bad counters");
+  msg ("kdata_read");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(kdata-normal) begin
+(kdata-normal) get_ticks
+(kdata-normal) getpid
+(kdata-normal) ticks advanced
+(kdata-normal) ns advanced
+(kdata-normal) kdata_read
+(kdata-normal) end
+kdata-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,85 @@
+/* Allocates blocks of many sizes, small and big, fills them,
+   frees and grows some, and checks that no block's contents were
+   disturbed.  Then checks that freeing a big block at the top of
+   the heap shrinks it, and that sbrk() refuses to shrink the heap
+   below its start. */
+
+#include <malloc.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 64
+
+static char *blocks[BLOCK_CNT];
+static size_t sizes[BLOCK_CNT];
+
+/* Checks that block I holds SIZE copies of its fill byte. */
+static void
+check_block (int i, size_t size) 
+{
+  size_t j;
+
+  for (j = 0; j < size; j++)
+    if (blocks[i][j] != (char) i)
+      fail ("block %d of %zu bytes corrupted at byte %zu", i, sizes[i], j);
+}
+
+void
+test_main (void) 
+{
+  char *big, *top;
+  int *zeros;
+  int i;
+
+  CHECK (sbrk (0) != (void *) -1, "sbrk(0)");
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      sizes[i] = (i * 97) % 4000 + 1;
+      blocks[i] = malloc (sizes[i]);
+      if (blocks[i] == NULL || (uintptr_t) blocks[i] % 8 != 0)
+        fail ("malloc(%zu) returned %p", sizes[i], blocks[i]);
+      memset (blocks[i], i, sizes[i]);
+    }
+  for (i = 0; i < BLOCK_CNT; i++)
+    check_block (i, sizes[i]);
+  msg ("malloc");
+
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    free (blocks[i]);
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    {
+      size_t old_size = sizes[i];
+
+      sizes[i] = old_size * 3;
+      blocks[i] = realloc (blocks[i], sizes[i]);
+      if (blocks[i] == NULL)
+        fail ("realloc to %zu bytes failed", sizes[i]);
+      check_block (i, old_size);
+      memset (blocks[i], i, sizes[i]);
+    }
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    check_block (i, sizes[i]);
+  msg ("free and realloc");
+
+  zeros = calloc (1000, sizeof *zeros);
+  CHECK (zeros != NULL, "calloc");
+  for (i = 0; i < 1000; i++)
+    if (zeros[i] != 0)
+      fail ("calloc'd memory not zeroed");
+  free (zeros);
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    free (blocks[i]);
+
+  big = malloc (64 * 1024);
+  CHECK (big != NULL, "malloc(64 kB)");
+  top = sbrk (0);
+  free (big);
+  if ((char *) sbrk (0) >= top)
+    fail ("freeing big block at top of heap did not shrink it");
+  msg ("heap shrank");
+
+  CHECK (sbrk (-0x10000000) == (void *) -1, "sbrk(-256 MB) fails");
+}
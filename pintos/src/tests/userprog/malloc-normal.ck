@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-normal) begin
+(malloc-normal) sbrk(0)
+(malloc-normal) malloc
+(malloc-normal) free and realloc
+(malloc-normal) calloc
+(malloc-normal) malloc(64 kB)
+(malloc-normal) heap shrank
+(malloc-normal) sbrk(-256 MB) fails
+(malloc-normal) end
+malloc-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,41 @@
+/* Opens more files than fit in the file descriptor slots kept in
+   struct process, so that the table must grow, and checks that
+   every descriptor is distinct and still reads the file, that a
+   closed descriptor is the next one handed out, and that exiting
+   with them all open is clean. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_CNT 40
+
+void
+test_main (void) 
+{
+  int fds[FILE_CNT];
+  char c;
+  int i, j;
+
+  msg ("open \"sample.txt\" %d times", FILE_CNT);
+  for (i = 0; i < FILE_CNT; i++)
+    {
+      fds[i] = open ("sample.txt");
+      if (fds[i] < 2)
+        fail ("open #%d returned %d", i, fds[i]);
+      for (j = 0; j < i; j++)
+        if (fds[i] == fds[j])
+          fail ("opens #%d and #%d both returned %d", j, i, fds[i]);
+    }
+
+  msg ("read from each");
+  for (i = 0; i < FILE_CNT; i++)
+    if (read (fds[i], &c, 1) != 1 || c != '"')
+      fail ("read from fd %d failed", fds[i]);
+
+  msg ("close and reopen");
+  close (fds[3]);
+  CHECK (open ("sample.txt") == fds[3], "reopen reuses inline fd");
+  close (fds[FILE_CNT - 1]);
+  CHECK (open ("sample.txt") == fds[FILE_CNT - 1], "reopen reuses grown fd");
+}
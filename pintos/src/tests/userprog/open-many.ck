@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(open-many) begin
+(open-many) open "sample.txt" 40 times
+(open-many) read from each
+(open-many) close and reopen
+(open-many) reopen reuses inline fd
+(open-many) reopen reuses grown fd
+(open-many) end
+open-many: exit(0)
+EOF
+pass;
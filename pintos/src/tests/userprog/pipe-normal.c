@@ -0,0 +1,51 @@
+/* Streams data through pipes: first within one process, then
+   from a child started by exec, which inherits the write end
+   and writes more than fits in the pipe at once.  Then checks
+   that writing to a pipe without readers fails. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/userprog/pipe.h"
+
+void
+test_main (void) 
+{
+  static char buf[PIPE_CHUNK];
+  char child_cmd[128];
+  int fds[2];
+  pid_t pid;
+  int total, n, i;
+
+  CHECK (pipe (fds) == 0 && fds[0] > 1 && fds[1] > 1, "pipe");
+  CHECK (write (fds[1], "hello", 5) == 5, "write 5 bytes");
+  CHECK (filesize (fds[0]) == 5, "filesize = 5");
+  CHECK (read (fds[0], buf, sizeof buf) == 5 && !memcmp (buf, "hello", 5),
+         "read them back");
+
+  snprintf (child_cmd, sizeof child_cmd, "child-pipe %d", fds[1]);
+  msg ("exec child-pipe");
+  pid = exec (child_cmd);
+  close (fds[1]);
+
+  /* The child's end closes when it exits, which ends the data. */
+  total = 0;
+  while ((n = read (fds[0], buf, sizeof buf)) > 0)
+    {
+      for (i = 0; i < n; i++)
+        if (buf[i] != pipe_byte (total + i))
+          fail ("byte %d is %d, expected %d",
+                total + i, buf[i], pipe_byte (total + i));
+      total += n;
+    }
+  msg ("read %d bytes", total);
+  msg ("wait(exec()) = %d", wait (pid));
+  close (fds[0]);
+
+  CHECK (pipe (fds) == 0, "pipe");
+  close (fds[0]);
+  CHECK (write (fds[1], "x", 1) == -1, "write without readers fails");
+  close (fds[1]);
+}
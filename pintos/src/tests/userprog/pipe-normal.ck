@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(pipe-normal) begin
+(pipe-normal) pipe
+(pipe-normal) write 5 bytes
+(pipe-normal) filesize = 5
+(pipe-normal) read them back
+(pipe-normal) exec child-pipe
+(child-pipe) begin
+(child-pipe) end
+child-pipe: exit(0)
+(pipe-normal) read 20000 bytes
+(pipe-normal) wait(exec()) = 0
+(pipe-normal) pipe
+(pipe-normal) write without readers fails
+(pipe-normal) end
+pipe-normal: exit(0)
+EOF
+pass;
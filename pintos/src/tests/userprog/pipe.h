@@ -0,0 +1,15 @@
+#ifndef TESTS_USERPROG_PIPE_H
+#define TESTS_USERPROG_PIPE_H
+
+/* Bytes child-pipe writes at a time, and in all. */
+#define PIPE_CHUNK 1000
+#define PIPE_TOTAL 20000
+
+/* Returns the byte at offset OFS in what child-pipe writes. */
+static inline char
+pipe_byte (int ofs) 
+{
+  return ofs % 251;
+}
+
+#endif /* tests/userprog/pipe.h */
@@ -0,0 +1,45 @@
+/* Polls the ends of a pipe as data goes in and out and the write
+   end closes, checks that a poll with nothing ready times out,
+   and that a bad descriptor is reported. */
+
+#include <poll.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct pollfd fds[2];
+  int64_t start;
+  int ends[2];
+  char c;
+
+  CHECK (pipe (ends) == 0, "pipe");
+  fds[0].fd = ends[0];
+  fds[0].events = POLLIN;
+  fds[1].fd = ends[1];
+  fds[1].events = POLLOUT;
+  CHECK (poll (fds, 2, 0) == 1 && fds[0].revents == 0
+         && fds[1].revents == POLLOUT, "only write end is ready");
+
+  start = get_ticks ();
+  CHECK (poll (fds, 1, 50) == 0 && fds[0].revents == 0,
+         "empty read end times out");
+  if (get_ticks () == start)
+    fail ("poll returned without waiting");
+
+  CHECK (write (ends[1], "x", 1) == 1, "write 1 byte");
+  CHECK (poll (fds, 1, -1) == 1 && fds[0].revents == POLLIN,
+         "read end is ready");
+  CHECK (read (ends[0], &c, 1) == 1 && c == 'x', "read it back");
+
+  close (ends[1]);
+  CHECK (poll (fds, 1, -1) == 1 && fds[0].revents == POLLHUP,
+         "read end hangs up after write end closes");
+  close (ends[0]);
+
+  fds[0].fd = 1234;
+  CHECK (poll (fds, 1, 0) == 1 && fds[0].revents == POLLNVAL,
+         "bad fd is reported");
+}
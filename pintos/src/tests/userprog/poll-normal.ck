@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(poll-normal) begin
+(poll-normal) pipe
+(poll-normal) only write end is ready
+(poll-normal) empty read end times out
+(poll-normal) write 1 byte
+(poll-normal) read end is ready
+(poll-normal) read it back
+(poll-normal) read end hangs up after write end closes
+(poll-normal) bad fd is reported
+(poll-normal) end
+poll-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,27 @@
+/* Reads a file at an offset with pread() and checks that the
+   file position is left alone. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char buf[sizeof sample];
+  int handle, byte_cnt;
+  size_t ofs = 10;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+
+  byte_cnt = pread (handle, buf, sizeof sample - 1 - ofs, ofs);
+  if (byte_cnt != (int) (sizeof sample - 1 - ofs))
+    fail ("pread() returned %d instead of %zu",
+          byte_cnt, sizeof sample - 1 - ofs);
+  compare_bytes (buf, sample + ofs, byte_cnt, ofs, "sample.txt");
+
+  if (tell (handle) != 0)
+    fail ("pread() moved file position to %u", tell (handle));
+  msg ("file position unchanged");
+}
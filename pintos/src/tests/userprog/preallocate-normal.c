@@ -0,0 +1,46 @@
+/* Preallocates space for an empty file, appends to it, and
+   checks that its size follows the writes and that a gap left
+   in the preallocated space reads back as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PREALLOC_SIZE 8192
+#define GAP_END 6000
+
+static char buf[GAP_END];
+
+void
+test_main (void) 
+{
+  int handle;
+  int i;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+  CHECK (preallocate (handle, PREALLOC_SIZE), "preallocate %d bytes",
+         PREALLOC_SIZE);
+  if (filesize (handle) != 0)
+    fail ("preallocate() changed file size to %d", filesize (handle));
+  CHECK (!preallocate (0, PREALLOC_SIZE), "preallocate stdin fails");
+
+  CHECK (write (handle, sample, sizeof sample - 1)
+         == (int) (sizeof sample - 1), "append sample");
+  check_file_handle (handle, "test.txt", sample, sizeof sample - 1);
+
+  seek (handle, GAP_END);
+  CHECK (write (handle, "x", 1) == 1, "write at offset %d", GAP_END);
+  CHECK (filesize (handle) == GAP_END + 1, "filesize is %d", GAP_END + 1);
+  seek (handle, 0);
+  if (read (handle, buf, GAP_END) != GAP_END)
+    fail ("read of %d bytes failed", GAP_END);
+  if (memcmp (buf, sample, sizeof sample - 1))
+    fail ("sample did not read back");
+  for (i = sizeof sample - 1; i < GAP_END; i++)
+    if (buf[i] != 0)
+      fail ("byte %d in gap is %d, not zero", i, buf[i]);
+  msg ("gap reads as zeros");
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(preallocate-normal) begin
+(preallocate-normal) create "test.txt"
+(preallocate-normal) open "test.txt"
+(preallocate-normal) preallocate 8192 bytes
+(preallocate-normal) preallocate stdin fails
+(preallocate-normal) append sample
+(preallocate-normal) verified contents of "test.txt"
+(preallocate-normal) write at offset 6000
+(preallocate-normal) filesize is 6001
+(preallocate-normal) gap reads as zeros
+(preallocate-normal) end
+preallocate-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,27 @@
+/* Writes a file out of order with pwrite() and verifies the
+   result. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  size_t half = (sizeof sample - 1) / 2;
+  int handle;
+
+  CHECK (create ("test.txt", sizeof sample - 1), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  /* Write second half first, then first half. */
+  CHECK (pwrite (handle, sample + half, sizeof sample - 1 - half, half)
+         == (int) (sizeof sample - 1 - half), "pwrite second half");
+  CHECK (pwrite (handle, sample, half, 0) == (int) half,
+         "pwrite first half");
+  if (tell (handle) != 0)
+    fail ("pwrite() moved file position to %u", tell (handle));
+
+  check_file_handle (handle, "test.txt", sample, sizeof sample - 1);
+}
@@ -0,0 +1,67 @@
+/* Grows the heap by 12 MB with sbrk(), which with -hugepages maps
+   the aligned 4 MB parts of it as large pages, and checks that
+   every page is zeroed and keeps what is written to it.  Then
+   shrinks the heap into the middle of a large page and grows it
+   again, and checks that the pages left keep their contents and
+   the new ones are zeroed. */
+
+#include <stdint.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define MB (1024 * 1024)
+#define PAGE_SIZE 4096
+#define WORDS_PER_PAGE (PAGE_SIZE / sizeof (int))
+
+/* Checks that the pages of HEAP from FIRST up to END hold their
+   own page numbers if FILLED is true, or zeros if not. */
+static void
+check_pages (int *heap, size_t first, size_t end, bool filled)
+{
+  size_t i;
+
+  for (i = first; i < end; i++)
+    {
+      int want = filled ? (int) i : 0;
+      int got = heap[i * WORDS_PER_PAGE + i % WORDS_PER_PAGE];
+      if (got != want)
+        fail ("page %zu holds %d, not %d", i, got, want);
+    }
+}
+
+/* Writes its page number into each page of HEAP from FIRST up to
+   END. */
+static void
+fill_pages (int *heap, size_t first, size_t end)
+{
+  size_t i;
+
+  for (i = first; i < end; i++)
+    heap[i * WORDS_PER_PAGE + i % WORDS_PER_PAGE] = i;
+}
+
+void
+test_main (void) 
+{
+  size_t page_cnt = 12 * MB / PAGE_SIZE;
+  int *heap;
+
+  /* Start on a page boundary, so that page numbers count whole
+     pages of the heap. */
+  sbrk (PAGE_SIZE - (uintptr_t) sbrk (0) % PAGE_SIZE);
+  heap = sbrk (12 * MB);
+  CHECK (heap != NULL, "grow heap by 12 MB");
+  check_pages (heap, 0, page_cnt, false);
+  fill_pages (heap, 0, page_cnt);
+  check_pages (heap, 0, page_cnt, true);
+
+  CHECK (sbrk (-6 * MB) != NULL, "shrink heap by 6 MB");
+  check_pages (heap, 0, page_cnt / 2, true);
+
+  CHECK (sbrk (6 * MB) != NULL, "grow heap by 6 MB again");
+  check_pages (heap, 0, page_cnt / 2, true);
+  check_pages (heap, page_cnt / 2, page_cnt, false);
+  fill_pages (heap, page_cnt / 2, page_cnt);
+  check_pages (heap, 0, page_cnt, true);
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sbrk-large) begin
+(sbrk-large) grow heap by 12 MB
+(sbrk-large) shrink heap by 6 MB
+(sbrk-large) grow heap by 6 MB again
+(sbrk-large) end
+sbrk-large: exit(0)
+EOF
+pass;
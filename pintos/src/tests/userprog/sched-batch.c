@@ -0,0 +1,21 @@
+/* Moves the process into the batch scheduling class and back,
+   checking the class returned each time, and checks that a
+   batch process can still run and wait for a child.  Then checks
+   that an unknown class is rejected. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  CHECK (set_sched_class (SCHED_BATCH) == SCHED_NORMAL,
+         "set_sched_class(SCHED_BATCH)");
+  CHECK (set_sched_class (SCHED_BATCH) == SCHED_BATCH,
+         "set_sched_class(SCHED_BATCH) again");
+  msg ("wait(exec()) = %d", wait (exec ("child-simple")));
+  CHECK (set_sched_class (SCHED_NORMAL) == SCHED_BATCH,
+         "set_sched_class(SCHED_NORMAL)");
+  CHECK (set_sched_class (42) == -1, "set_sched_class(42) fails");
+}
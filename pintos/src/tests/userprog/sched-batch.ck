@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-batch) begin
+(sched-batch) set_sched_class(SCHED_BATCH)
+(sched-batch) set_sched_class(SCHED_BATCH) again
+(child-simple) run
+child-simple: exit(81)
+(sched-batch) wait(exec()) = 81
+(sched-batch) set_sched_class(SCHED_NORMAL)
+(sched-batch) set_sched_class(42) fails
+(sched-batch) end
+sched-batch: exit(0)
+EOF
+pass;
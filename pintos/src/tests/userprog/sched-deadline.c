@@ -0,0 +1,28 @@
+/* Checks that set_deadline() rejects a budget that is not
+   positive, one longer than the period, and one that takes more
+   of the CPU than deadline threads may have.  Then joins the
+   deadline class, spins long enough to run out of budget a few
+   times, checks that a deadline process can still wait for a
+   child, and leaves the class again. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  volatile int i;
+
+  CHECK (!set_deadline (100, 0), "set_deadline(100, 0) fails");
+  CHECK (!set_deadline (100, 200), "set_deadline(100, 200) fails");
+  CHECK (!set_deadline (100, 100), "set_deadline(100, 100) fails");
+  CHECK (set_deadline (100, 20), "set_deadline(100, 20)");
+  CHECK (set_deadline (100, 50), "set_deadline(100, 50) again");
+  for (i = 0; i < 50000000; i++)
+    continue;
+  msg ("spun");
+  msg ("wait(exec()) = %d", wait (exec ("child-simple")));
+  CHECK (set_sched_class (SCHED_NORMAL) == SCHED_DEADLINE,
+         "set_sched_class(SCHED_NORMAL)");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-deadline) begin
+(sched-deadline) set_deadline(100, 0) fails
+(sched-deadline) set_deadline(100, 200) fails
+(sched-deadline) set_deadline(100, 100) fails
+(sched-deadline) set_deadline(100, 20)
+(sched-deadline) set_deadline(100, 50) again
+(sched-deadline) spun
+(child-simple) run
+child-simple: exit(81)
+(sched-deadline) wait(exec()) = 81
+(sched-deadline) set_sched_class(SCHED_NORMAL)
+(sched-deadline) end
+sched-deadline: exit(0)
+EOF
+pass;
@@ -0,0 +1,42 @@
+/* Reads the calling thread's scheduler statistics, blocks by
+   waiting for a child, and checks that the statistics counted
+   the wait and the wakeup after it.  Then checks that asking
+   for a thread that does not exist fails. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Returns the number of wakeups counted in S's histogram. */
+static uint64_t
+wakeup_cnt (const struct sched_stats *s)
+{
+  uint64_t cnt = 0;
+  int i;
+
+  for (i = 0; i < SCHED_LATENCY_BUCKETS; i++)
+    cnt += s->latency[i];
+  return cnt;
+}
+
+void
+test_main (void) 
+{
+  struct sched_stats before, after;
+
+  CHECK (sched_stats (0, &before), "sched_stats(0)");
+  msg ("wait(exec()) = %d", wait (exec ("child-simple")));
+  CHECK (sched_stats (0, &after), "sched_stats(0) again");
+
+  if (after.voluntary_cnt <= before.voluntary_cnt)
+    fail ("waiting for child not counted as blocking");
+  if (after.involuntary_cnt < before.involuntary_cnt)
+    fail ("involuntary switch count went down");
+  if (after.ready_time < before.ready_time)
+    fail ("time ready went down");
+  if (wakeup_cnt (&after) <= wakeup_cnt (&before))
+    fail ("wakeup not counted in latency histogram");
+  msg ("statistics consistent");
+
+  CHECK (!sched_stats (100000, &after), "sched_stats(100000) fails");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sched-stats) begin
+(sched-stats) sched_stats(0)
+(child-simple) run
+child-simple: exit(81)
+(sched-stats) wait(exec()) = 81
+(sched-stats) sched_stats(0) again
+(sched-stats) statistics consistent
+(sched-stats) sched_stats(100000) fails
+(sched-stats) end
+sched-stats: exit(0)
+EOF
+pass;
@@ -0,0 +1,18 @@
+/* Pins the process to CPU 0, which always runs threads, checks
+   that it keeps running and can wait for a child, and widens the
+   mask again.  Then checks that a mask allowing no CPU that runs
+   threads, and a thread that does not exist, are rejected. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  CHECK (set_affinity (0, 1), "set_affinity(0, 1)");
+  msg ("wait(exec()) = %d", wait (exec ("child-simple")));
+  CHECK (set_affinity (0, (unsigned) -1), "set_affinity(0, all)");
+  CHECK (!set_affinity (0, 0), "set_affinity(0, 0) fails");
+  CHECK (!set_affinity (1000, 1), "set_affinity(1000, 1) fails");
+}
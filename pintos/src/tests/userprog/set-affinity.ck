@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(set-affinity) begin
+(set-affinity) set_affinity(0, 1)
+(child-simple) run
+child-simple: exit(81)
+(set-affinity) wait(exec()) = 81
+(set-affinity) set_affinity(0, all)
+(set-affinity) set_affinity(0, 0) fails
+(set-affinity) set_affinity(1000, 1) fails
+(set-affinity) end
+set-affinity: exit(0)
+EOF
+pass;
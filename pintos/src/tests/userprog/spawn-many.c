@@ -0,0 +1,27 @@
+/* Starts several child processes with one spawn_many() call and
+   waits for each of them, then checks that a missing program
+   gets a pid of -1. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  const char *cmds[] = {"child-simple", "child-simple", "child-simple"};
+  const char *missing[] = {"no-such-file"};
+  pid_t pids[3];
+  int loaded, i;
+
+  /* Children print as they run, so report only once all are
+     done. */
+  loaded = spawn_many (cmds, 3, pids);
+  for (i = 0; i < 3; i++)
+    if (wait (pids[i]) != 81)
+      fail ("child %d did not exit with 81", i);
+  CHECK (loaded == 3, "spawn_many() three children");
+
+  CHECK (spawn_many (missing, 1, pids) == 0 && pids[0] == -1,
+         "spawn_many() missing program");
+}
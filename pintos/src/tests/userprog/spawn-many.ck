@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF', <<'EOF']);
+(spawn-many) begin
+(child-simple) run
+(child-simple) run
+(child-simple) run
+(spawn-many) spawn_many() three children
+load: no-such-file: open failed
+(spawn-many) spawn_many() missing program
+(spawn-many) end
+EOF
+(spawn-many) begin
+(child-simple) run
+(child-simple) run
+(child-simple) run
+(spawn-many) spawn_many() three children
+(spawn-many) spawn_many() missing program
+(spawn-many) end
+EOF
+pass;
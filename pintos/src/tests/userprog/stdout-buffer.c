@@ -0,0 +1,27 @@
+/* Prints a line a character at a time with putchar() and checks,
+   with getrusage(), that it took a single write() system call
+   instead of one per character. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  struct rusage before, after;
+  int i;
+
+  getrusage (&before);
+  for (i = 0; i < 40; i++)
+    putchar ('a' + i % 26);
+  putchar ('\n');
+  getrusage (&after);
+
+  /* One write() for the line and the second getrusage(). */
+  if (after.syscalls - before.syscalls > 2)
+    fail ("printing one line took %d system calls",
+          (int) (after.syscalls - before.syscalls - 1));
+  msg ("line written at once");
+}
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(stdout-buffer) begin
+abcdefghijklmnopqrstuvwxyzabcdefghijklmn
+(stdout-buffer) line written at once
+(stdout-buffer) end
+stdout-buffer: exit(0)
+EOF
+pass;
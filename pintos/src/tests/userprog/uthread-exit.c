@@ -0,0 +1,25 @@
+/* Has a thread call exit() while the main thread sleeps in
+   futex_wait(), which must end the whole process with the
+   thread's status. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char stack[4096];
+static int word;
+
+static int
+exit_process (void *aux UNUSED)
+{
+  exit (57);
+}
+
+void
+test_main (void) 
+{
+  CHECK (uthread_create (exit_process, NULL, stack, sizeof stack)
+         != TID_ERROR, "uthread_create");
+  for (;;)
+    futex_wait (&word, 0);
+}
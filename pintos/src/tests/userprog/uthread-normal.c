@@ -0,0 +1,81 @@
+/* Runs threads in one process that each sum part of a shared
+   array, and checks their sums and the statuses uthread_join()
+   returns for them.  Then checks that a file one thread opens is
+   open in the others too, and that a thread can wake another
+   through a futex. */
+
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define THREAD_CNT 4
+#define PART_SIZE 1024
+#define STACK_SIZE 4096
+
+static int data[THREAD_CNT * PART_SIZE];
+static int sums[THREAD_CNT];
+static char stacks[THREAD_CNT][STACK_SIZE];
+static int flag;
+
+/* Sums part AUX of DATA into SUMS[AUX]. */
+static int
+sum_part (void *aux)
+{
+  int part = (int) aux;
+  int i, sum = 0;
+
+  for (i = part * PART_SIZE; i < (part + 1) * PART_SIZE; i++)
+    sum += data[i];
+  sums[part] = sum;
+  return part + 1;
+}
+
+static int
+open_sample (void *aux UNUSED)
+{
+  return open ("sample.txt");
+}
+
+static int
+wake_main (void *aux UNUSED)
+{
+  flag = 1;
+  futex_wake (&flag, 1);
+  return 0;
+}
+
+void
+test_main (void) 
+{
+  tid_t tids[THREAD_CNT];
+  tid_t tid;
+  int i, fd, sum;
+
+  for (i = 0; i < THREAD_CNT * PART_SIZE; i++)
+    data[i] = i;
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK ((tids[i] = uthread_create (sum_part, (void *) i, stacks[i],
+                                      STACK_SIZE)) != TID_ERROR,
+           "uthread_create #%d", i);
+  for (i = 0; i < THREAD_CNT; i++)
+    CHECK (uthread_join (tids[i]) == i + 1, "uthread_join #%d", i);
+  for (i = 0; i < THREAD_CNT; i++)
+    {
+      sum = PART_SIZE * (i * PART_SIZE) + PART_SIZE * (PART_SIZE - 1) / 2;
+      if (sums[i] != sum)
+        fail ("sum of part %d is %d, not %d", i, sums[i], sum);
+    }
+  msg ("sums correct");
+  CHECK (uthread_join (tids[0]) == -1, "uthread_join #0 again fails");
+
+  tid = uthread_create (open_sample, NULL, stacks[0], STACK_SIZE);
+  CHECK ((fd = uthread_join (tid)) > 1, "open \"sample.txt\" in thread");
+  check_file_handle (fd, "sample.txt", sample, sizeof sample - 1);
+
+  CHECK (uthread_create (wake_main, NULL, stacks[0], STACK_SIZE)
+         != TID_ERROR, "uthread_create waker");
+  while (flag == 0)
+    futex_wait (&flag, 0);
+  msg ("woken by thread");
+}
@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(uthread-normal) begin
+(uthread-normal) uthread_create #0
+(uthread-normal) uthread_create #1
+(uthread-normal) uthread_create #2
+(uthread-normal) uthread_create #3
+(uthread-normal) uthread_join #0
+(uthread-normal) uthread_join #1
+(uthread-normal) uthread_join #2
+(uthread-normal) uthread_join #3
+(uthread-normal) sums correct
+(uthread-normal) uthread_join #0 again fails
+(uthread-normal) open "sample.txt" in thread
+(uthread-normal) verified contents of "sample.txt"
+(uthread-normal) uthread_create waker
+(uthread-normal) woken by thread
+(uthread-normal) end
+uthread-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,63 @@
+/* Forks children that exit out of the order they were started
+   in, and checks that wait_any() reaps each as it exits.  Then
+   reaps several children with wait_many(), and checks that both
+   fail once no child is left. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Forks a child that exits with STATUS, after reading a byte
+   from FD if FD is not -1. */
+static pid_t
+spawn (int status, int fd)
+{
+  pid_t pid = fork ();
+  char c;
+
+  if (pid == 0)
+    {
+      if (fd != -1)
+        read (fd, &c, 1);
+      exit (status);
+    }
+  if (pid == PID_ERROR)
+    fail ("fork failed");
+  return pid;
+}
+
+void
+test_main (void) 
+{
+  pid_t pids[4], slow, fast;
+  int statuses[4];
+  int fds[2];
+  int status, sum, cnt, n, i;
+
+  CHECK (pipe (fds) == 0, "pipe");
+  slow = spawn (1, fds[0]);
+  fast = spawn (2, -1);
+  CHECK (wait_any (&status) == fast && status == 2,
+         "wait_any() reaps second child first");
+  CHECK (write (fds[1], "x", 1) == 1, "let first child go");
+  CHECK (wait_any (&status) == slow && status == 1,
+         "wait_any() reaps first child");
+
+  spawn (3, -1);
+  spawn (4, -1);
+  spawn (5, -1);
+  sum = 0;
+  for (n = 0; n < 3; n += cnt)
+    {
+      cnt = wait_many (pids, statuses, 4);
+      if (cnt <= 0 || n + cnt > 3)
+        fail ("wait_many() returned %d", cnt);
+      for (i = 0; i < cnt; i++)
+        sum += statuses[i];
+    }
+  CHECK (sum == 3 + 4 + 5, "wait_many() reaps three children");
+
+  CHECK (wait_any (&status) == -1, "wait_any() with no children");
+  CHECK (wait_many (pids, statuses, 4) == -1,
+         "wait_many() with no children");
+}
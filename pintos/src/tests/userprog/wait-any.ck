@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(wait-any) begin
+(wait-any) pipe
+(wait-any) wait_any() reaps second child first
+(wait-any) let first child go
+(wait-any) wait_any() reaps first child
+(wait-any) wait_many() reaps three children
+(wait-any) wait_any() with no children
+(wait-any) wait_many() with no children
+(wait-any) end
+EOF
+pass;
@@ -0,0 +1,44 @@
+/* Writes a file from three fragments with writev(), reads it
+   back into two buffers split at a different place with readv(),
+   and verifies the result. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[sizeof sample];
+
+void
+test_main (void) 
+{
+  size_t size = sizeof sample - 1;
+  struct iovec iov[3];
+  int handle;
+
+  CHECK (create ("test.txt", 0), "create \"test.txt\"");
+  CHECK ((handle = open ("test.txt")) > 1, "open \"test.txt\"");
+
+  iov[0].iov_base = (void *) sample;
+  iov[0].iov_len = 10;
+  iov[1].iov_base = (void *) (sample + 10);
+  iov[1].iov_len = 0;
+  iov[2].iov_base = (void *) (sample + 10);
+  iov[2].iov_len = size - 10;
+  CHECK (writev (handle, iov, 3) == (int) size, "writev \"test.txt\"");
+  if (tell (handle) != size)
+    fail ("writev() left file position at %u", tell (handle));
+
+  seek (handle, 0);
+  iov[0].iov_base = buf;
+  iov[0].iov_len = size / 2;
+  iov[1].iov_base = buf + size / 2;
+  iov[1].iov_len = sizeof buf - size / 2;
+  CHECK (readv (handle, iov, 2) == (int) size, "readv \"test.txt\"");
+  if (memcmp (buf, sample, size))
+    fail ("readv() returned different data");
+
+  seek (handle, 0);
+  check_file_handle (handle, "test.txt", sample, size);
+}
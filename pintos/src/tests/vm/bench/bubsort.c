@@ -0,0 +1,35 @@
+/* Runs child-bubsort over arrays that take from half to twice
+   the user pool, whose size in pages is the only argument, and
+   reports what each run costs.  Only the first few passes of each
+   sort are made, since a whole bubble sort of a large array would
+   take hours. */
+
+#include "tests/vm/bench/workload.h"
+#include <stdio.h>
+
+#define PAGE_SIZE 4096
+
+/* Passes made over each array. */
+#define PASSES 4
+
+/* Working-set sizes, in percent of the user pool. */
+static const int percents[] = {50, 100, 150, 200};
+
+int
+main (int argc, char *argv[]) 
+{
+  int pool_pages = workload_pool_pages (argc, argv);
+  size_t i;
+
+  for (i = 0; i < sizeof percents / sizeof *percents; i++)
+    {
+      int pages = pool_pages * percents[i] / 100;
+      int size = pages * (PAGE_SIZE / 4);
+      char cmd_line[64];
+
+      snprintf (cmd_line, sizeof cmd_line, "child-bubsort %d %d",
+                size, PASSES);
+      workload_run (cmd_line, pages, pool_pages, size - PASSES);
+    }
+  return 0;
+}
@@ -0,0 +1,40 @@
+/* Makes PASSES bubble sort passes, the second argument, over an
+   array of SIZE ints, the first, that starts in descending order,
+   as examples/bubsort does for a whole sort.  Each pass reads the
+   array from end to end, which is the worst case for a working
+   set larger than memory.  Exits with the element that the last
+   pass put in place, SIZE - PASSES. */
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+int
+main (int argc, char *argv[]) 
+{
+  int size, passes, i, j, tmp;
+  int *array;
+
+  test_name = "child-bubsort";
+  quiet = true;
+  CHECK (argc == 3 && (size = atoi (argv[1])) > 0
+         && (passes = atoi (argv[2])) > 0 && passes <= size,
+         "parse SIZE PASSES");
+  CHECK ((array = malloc (size * sizeof *array)) != NULL,
+         "malloc array");
+
+  for (i = 0; i < size; i++)
+    array[i] = size - i - 1;
+
+  for (i = 0; i < passes; i++)
+    for (j = 0; j < size - 1 - i; j++)
+      if (array[j] > array[j + 1])
+        {
+          tmp = array[j];
+          array[j] = array[j + 1];
+          array[j + 1] = tmp;
+        }
+
+  return array[size - passes];
+}
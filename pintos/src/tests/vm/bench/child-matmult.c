@@ -0,0 +1,40 @@
+/* Multiplies two DIM by DIM matrices, where DIM is the first
+   argument, as examples/matmult does, and exits with the last
+   element of the product, (DIM - 1) * (DIM - 1) * DIM.  The
+   columns of the second matrix are walked over and over, so a
+   working set larger than memory keeps faulting. */
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+int
+main (int argc, char *argv[]) 
+{
+  int dim, i, j, k;
+  int *a, *b, *c;
+
+  test_name = "child-matmult";
+  quiet = true;
+  CHECK (argc == 2 && (dim = atoi (argv[1])) > 0, "parse DIM");
+  a = malloc (dim * dim * sizeof *a);
+  b = malloc (dim * dim * sizeof *b);
+  c = malloc (dim * dim * sizeof *c);
+  CHECK (a != NULL && b != NULL && c != NULL, "malloc matrices");
+
+  for (i = 0; i < dim; i++)
+    for (j = 0; j < dim; j++)
+      {
+        a[i * dim + j] = i;
+        b[i * dim + j] = j;
+        c[i * dim + j] = 0;
+      }
+
+  for (i = 0; i < dim; i++)
+    for (j = 0; j < dim; j++)
+      for (k = 0; k < dim; k++)
+        c[i * dim + j] += a[i * dim + k] * b[k * dim + j];
+
+  return c[dim * dim - 1];
+}
@@ -0,0 +1,34 @@
+/* Runs child-matmult with matrices that take half, all, and one
+   and a half times the user pool, whose size in pages is the
+   only argument, and reports what each run costs. */
+
+#include "tests/vm/bench/workload.h"
+#include <round.h>
+#include <stdio.h>
+
+#define PAGE_SIZE 4096
+
+/* Working-set sizes, in percent of the user pool. */
+static const int percents[] = {50, 100, 150};
+
+int
+main (int argc, char *argv[]) 
+{
+  int pool_pages = workload_pool_pages (argc, argv);
+  size_t i;
+
+  for (i = 0; i < sizeof percents / sizeof *percents; i++)
+    {
+      int ints = pool_pages * percents[i] / 100 * (PAGE_SIZE / 4) / 3;
+      int dim = 1;
+      char cmd_line[64];
+
+      /* The largest DIM whose three matrices fit the working set. */
+      while ((dim + 1) * (dim + 1) <= ints)
+        dim++;
+      snprintf (cmd_line, sizeof cmd_line, "child-matmult %d", dim);
+      workload_run (cmd_line, DIV_ROUND_UP (3 * dim * dim * 4, PAGE_SIZE),
+                    pool_pages, (dim - 1) * (dim - 1) * dim);
+    }
+  return 0;
+}
@@ -0,0 +1,25 @@
+/* Touches each page of a large zeroed array once, so that every
+   access takes a page fault that brings in a fresh page, and
+   reports the time for each fault. */
+
+#include <syscall.h>
+#include "tests/userprog/bench/bench.h"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGE_SIZE 4096
+#define PAGE_CNT 256
+
+static char pages[PAGE_CNT][PAGE_SIZE];
+
+void
+test_main (void) 
+{
+  uint64_t start;
+  int i;
+
+  start = bench_start ();
+  for (i = 0; i < PAGE_CNT; i++)
+    pages[i][0] = 1;
+  bench_report ("page-fault", start, PAGE_CNT);
+}
@@ -0,0 +1,34 @@
+/* Runs each of the page-merge tests in tests/vm, which sort about
+   1 MB of data with the help of child processes, one at a time or
+   several at once, with the user pool whose size in pages is the
+   only argument, and reports what each run costs. */
+
+#include "tests/vm/bench/workload.h"
+#include <stddef.h>
+
+/* A page-merge test and the pages it and its children touch at
+   once: two buffers of 1 MB, plus 128 kB for each child. */
+struct merge
+  {
+    const char *name;
+    int ws_pages;
+  };
+
+static const struct merge merges[] =
+  {
+    {"page-merge-seq", 504 + 32},
+    {"page-merge-par", 512 + 8 * 32},
+    {"page-merge-stk", 512 + 8 * 32},
+    {"page-merge-mm", 512 + 8 * 32},
+  };
+
+int
+main (int argc, char *argv[]) 
+{
+  int pool_pages = workload_pool_pages (argc, argv);
+  size_t i;
+
+  for (i = 0; i < sizeof merges / sizeof *merges; i++)
+    workload_run (merges[i].name, merges[i].ws_pages, pool_pages, 0);
+  return 0;
+}
@@ -0,0 +1,59 @@
+/* Helpers shared by the working-set benchmarks.
+
+   Each benchmark runs a workload as a child process, with its
+   working set sized against the user pool that the kernel was
+   given with -ul, and prints one line starting with "BENCH" for
+   "make bench" to collect: the time the child took and the page
+   faults, evictions and swap traffic it caused.  These come from
+   getrusage(), which counts the children a process has waited
+   for, so a workload that runs children of its own is measured
+   whole. */
+
+#include "tests/vm/bench/workload.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+/* Returns the size of the user pool, in pages, passed as the
+   benchmark's only argument. */
+int
+workload_pool_pages (int argc, char *argv[]) 
+{
+  int pool_pages;
+
+  test_name = argv[0];
+  if (argc != 2 || (pool_pages = atoi (argv[1])) <= 0)
+    fail ("usage: %s POOL-PAGES", argv[0]);
+  return pool_pages;
+}
+
+/* Runs CMD_LINE, which touches about WS_PAGES pages, in a child
+   process and waits for it to exit with EXIT_STATUS, then reports
+   what it cost with a user pool of POOL_PAGES pages. */
+void
+workload_run (const char *cmd_line, int ws_pages, int pool_pages,
+              int exit_status) 
+{
+  struct rusage before, after;
+  uint64_t start, ns;
+  pid_t child;
+
+  getrusage (&before);
+  start = get_ns ();
+  quiet = true;
+  CHECK ((child = exec (cmd_line)) != -1, "exec \"%s\"", cmd_line);
+  CHECK (wait (child) == exit_status, "wait for \"%s\"", cmd_line);
+  quiet = false;
+  ns = get_ns () - start;
+  getrusage (&after);
+
+  msg ("BENCH %s: %d of %d pages, %"PRIu64" ms, %"PRIu64" faults, "
+       "%"PRIu64" evictions, %"PRIu64" swapped in, "
+       "%"PRIu64" swapped out",
+       cmd_line, ws_pages, pool_pages, ns / 1000000,
+       after.page_faults - before.page_faults,
+       after.evictions - before.evictions,
+       after.swap_ins - before.swap_ins,
+       after.swap_outs - before.swap_outs);
+}
@@ -0,0 +1,8 @@
+#ifndef TESTS_VM_BENCH_WORKLOAD_H
+#define TESTS_VM_BENCH_WORKLOAD_H
+
+int workload_pool_pages (int argc, char *argv[]);
+void workload_run (const char *cmd_line, int ws_pages, int pool_pages,
+                   int exit_status);
+
+#endif /* tests/vm/bench/workload.h */
@@ -0,0 +1,35 @@
+/* Child process run by shm-normal test.
+
+   Maps the shared memory segment whose id is the first
+   command-line argument, checks that it holds what the parent
+   wrote, and complements every byte. */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/vm/shm.h"
+
+const char *test_name = "child-shm";
+
+int
+main (int argc UNUSED, char *argv[])
+{
+  char *shm = SHM_CHILD_ADDR;
+  int i;
+
+  msg ("begin");
+  if (!isdigit (*argv[1]))
+    fail ("bad command-line arguments");
+  if (!shm_map (atoi (argv[1]), shm))
+    fail ("shm_map failed");
+  for (i = 0; i < SHM_SIZE; i++)
+    {
+      if (shm[i] != shm_byte (i))
+        fail ("byte %d is %d, expected %d", i, shm[i], shm_byte (i));
+      shm[i] = ~shm[i];
+    }
+  msg ("end");
+
+  return 0;
+}
@@ -0,0 +1,39 @@
+/* Creates a shared memory segment, fills it in, and runs
+   child-shm, which maps the same segment at another address,
+   checks what the parent wrote and replaces it.  Then checks
+   that the child's writes show through the parent's mapping,
+   and that bad mappings are refused. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+#include "tests/vm/shm.h"
+
+void
+test_main (void)
+{
+  char *shm = SHM_PARENT_ADDR;
+  char child_cmd[128];
+  int id, i;
+
+  CHECK ((id = shm_create (SHM_SIZE)) >= 0, "shm_create");
+  CHECK (!shm_map (id, shm + 1), "misaligned shm_map fails");
+  CHECK (!shm_map (id + 1, shm), "shm_map of bad id fails");
+  CHECK (shm_map (id, shm), "shm_map");
+  CHECK (!shm_map (id, shm + 4096), "overlapping shm_map fails");
+  for (i = 0; i < SHM_SIZE; i++)
+    if (shm[i] != 0)
+      fail ("byte %d is %d, expected 0", i, shm[i]);
+  for (i = 0; i < SHM_SIZE; i++)
+    shm[i] = shm_byte (i);
+
+  snprintf (child_cmd, sizeof child_cmd, "child-shm %d", id);
+  msg ("exec child-shm");
+  msg ("wait(exec()) = %d", wait (exec (child_cmd)));
+
+  for (i = 0; i < SHM_SIZE; i++)
+    if (shm[i] != (char) ~shm_byte (i))
+      fail ("byte %d is %d, expected %d", i, shm[i], (char) ~shm_byte (i));
+  msg ("child's writes are visible");
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(shm-normal) begin
+(shm-normal) shm_create
+(shm-normal) misaligned shm_map fails
+(shm-normal) shm_map of bad id fails
+(shm-normal) shm_map
+(shm-normal) overlapping shm_map fails
+(shm-normal) exec child-shm
+(child-shm) begin
+(child-shm) end
+child-shm: exit(0)
+(shm-normal) wait(exec()) = 0
+(shm-normal) child's writes are visible
+(shm-normal) end
+shm-normal: exit(0)
+EOF
+pass;
@@ -0,0 +1,15 @@
+#ifndef TESTS_VM_SHM_H
+#define TESTS_VM_SHM_H
+
+/* Size of the segment shared by shm-normal and child-shm: two
+   and a half pages, so it ends partway through a page. */
+#define SHM_SIZE (4096 * 2 + 2048)
+
+/* Where each of them maps it. */
+#define SHM_PARENT_ADDR ((char *) 0x10000000)
+#define SHM_CHILD_ADDR ((char *) 0x20000000)
+
+/* Byte at offset OFS in the segment as filled by the parent. */
+static inline char shm_byte (int ofs) { return ofs % 241; }
+
+#endif /* tests/vm/shm.h */
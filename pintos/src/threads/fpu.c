@@ -0,0 +1,137 @@
+#include "threads/fpu.h"
+#include <debug.h>
+#include <stdbool.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Lazy FPU context switching.
+
+   switch_threads() saves only the integer registers, so the x87
+   FPU's registers belong to one thread at a time, the FPU's
+   "owner".  Whenever any other thread is switched in, the TS
+   (Task Switched) bit in CR0 is set, so that the first FPU
+   instruction that thread executes raises #NM (Device Not
+   Available).  The handler saves the owner's registers in the
+   owner's struct thread, loads the current thread's, clears TS,
+   and makes the current thread the owner.
+
+   Thus a thread that does not use the FPU costs nothing more
+   than TS being set when it is switched in.  That includes
+   every kernel thread, since the kernel is built with
+   -msoft-float.  The FPU is saved and restored only when user
+   threads that use it take turns with one another. */
+
+/* CR0 bits. */
+#define CR0_MP 0x00000002       /* Monitor coprocessor: WAIT obeys TS. */
+#define CR0_EM 0x00000004       /* (Floating-point) Emulation. */
+#define CR0_TS 0x00000008       /* Task Switched. */
+#define CR0_NE 0x00000020       /* Report FPU errors as #MF. */
+
+/* Thread whose registers are in the FPU, or a null pointer. */
+static struct thread *fpu_owner;
+
+static intr_handler_func fpu_trap;
+static uint32_t read_cr0 (void);
+static void write_cr0 (uint32_t);
+
+/* Turns on the FPU, which start.S left off by setting CR0.EM, so
+   that user programs can use it, and registers the #NM handler
+   that hands it from thread to thread. */
+void
+fpu_init (void)
+{
+  write_cr0 ((read_cr0 () & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+  intr_register_int (7, 0, INTR_OFF, fpu_trap,
+                     "#NM Device Not Available Exception");
+}
+
+/* Lets thread T, which is being switched in, use the FPU
+   directly if its registers are already there, and otherwise
+   makes its first use trap.  Interrupts must be off. */
+void
+fpu_activate (struct thread *t)
+{
+  uint32_t cr0 = read_cr0 ();
+  uint32_t want = t == fpu_owner ? cr0 & ~CR0_TS : cr0 | CR0_TS;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (want != cr0)
+    write_cr0 (want);
+}
+
+/* Forgets dying thread T's FPU registers, if they are in the
+   FPU, so that they are never saved into its freed struct
+   thread.  Interrupts must be off. */
+void
+fpu_release (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (fpu_owner == t)
+    fpu_owner = NULL;
+}
+
+/* Gives thread DST a copy of thread SRC's FPU registers, as for
+   the thread of a process created by fork(). */
+void
+fpu_copy (struct thread *dst, struct thread *src)
+{
+  enum intr_level old_level = intr_disable ();
+
+  dst->fpu_used = src->fpu_used;
+  if (fpu_owner == src)
+    {
+      /* FNSAVE reinitializes the FPU, so load the registers right
+         back, then trap again unless the current thread owns
+         them. */
+      asm volatile ("clts");
+      asm volatile ("fnsave %0" : "=m" (dst->fpu));
+      asm volatile ("frstor %0" : : "m" (dst->fpu));
+      fpu_activate (thread_current ());
+    }
+  else if (src->fpu_used)
+    dst->fpu = src->fpu;
+  intr_set_level (old_level);
+}
+
+/* #NM handler.  Saves the FPU owner's registers, then gives the
+   FPU to the current thread, with its own registers if it has
+   used the FPU before or freshly initialized ones otherwise. */
+static void
+fpu_trap (struct intr_frame *f UNUSED)
+{
+  struct thread *cur = thread_current ();
+
+  asm volatile ("clts");
+  if (fpu_owner == cur)
+    return;
+
+  if (fpu_owner != NULL)
+    asm volatile ("fnsave %0" : "=m" (fpu_owner->fpu));
+  if (cur->fpu_used)
+    asm volatile ("frstor %0" : : "m" (cur->fpu));
+  else
+    {
+      asm volatile ("fninit");
+      cur->fpu_used = true;
+    }
+  fpu_owner = cur;
+}
+
+/* Returns the value of CR0. */
+static uint32_t
+read_cr0 (void)
+{
+  uint32_t cr0;
+
+  asm volatile ("movl %%cr0, %0" : "=r" (cr0));
+  return cr0;
+}
+
+/* Sets CR0 to CR0. */
+static void
+write_cr0 (uint32_t cr0)
+{
+  asm volatile ("movl %0, %%cr0" : : "r" (cr0) : "memory");
+}
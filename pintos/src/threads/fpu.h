@@ -0,0 +1,22 @@
+#ifndef THREADS_FPU_H
+#define THREADS_FPU_H
+
+#include <stdint.h>
+
+struct thread;
+
+/* A thread's x87 FPU registers, in the 108-byte layout that the
+   FNSAVE and FRSTOR instructions use in 32-bit protected mode.
+   See [IA32-v1] 8.1.10 "Saving the x87 FPU's State with
+   FSTENV/FNSTENV and FSAVE/FNSAVE". */
+struct fpu_state
+  {
+    uint8_t data[108];
+  };
+
+void fpu_init (void);
+void fpu_activate (struct thread *);
+void fpu_release (struct thread *);
+void fpu_copy (struct thread *dst, struct thread *src);
+
+#endif /* threads/fpu.h */
@@ -15,17 +15,27 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
+#include "threads/mp.h"
 #include "threads/palloc.h"
+#include "threads/vmalloc.h"
+#include "threads/profile.h"
 #include "threads/pte.h"
+#include "threads/rcu.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/workqueue.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #else
@@ -34,13 +44,29 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/virtio-blk.h"
+#include "filesys/defrag.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
+#include "filesys/inode.h"
+#endif
+#ifdef VM
+#include "vm/frame.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#include "vm/swap.h"
 #endif
 
 /* Page directory with kernel mappings only. */
 uint32_t *init_page_dir;
 
+/* Large and global page support. */
+#define CPUID_PSE 0x00000008    /* CPUID 1 EDX: 4 MB pages supported. */
+#define CPUID_PGE 0x00002000    /* CPUID 1 EDX: global pages supported. */
+#define CR4_PSE 0x00000010      /* Page size extensions. */
+#define CR4_PGE 0x00000080      /* Page global enable. */
+
 #ifdef FILESYS
 /* -f: Format the file system? */
 static bool format_filesys;
@@ -49,6 +75,12 @@ static bool format_filesys;
    overriding the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
+
+/* -ramdisk: Size of RAM disk to create, in kB, or 0 for none. */
+static size_t ramdisk_kb;
+
+/* -cksum: Check file system and swap sectors against checksums? */
+static bool verify_sectors;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
@@ -57,17 +89,62 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+#ifdef USERPROG
+/* -j: Start consecutive `run' actions together, then wait for
+   them all? */
+static bool parallel_runs;
+
+/* Most `run' actions started together. */
+#define PARALLEL_RUN_MAX 16
+#endif
+
+/* -boot-stats: Print how long each step of booting took? */
+static bool boot_stats;
+
+/* Steps of booting timed by BOOT_PHASE, in order.  Recorded
+   always, since reading the time-stamp counter is cheap, but
+   printed only with -boot-stats, because the counter's rate is
+   unknown until timer_calibrate(). */
+#define BOOT_PHASE_MAX 40
+struct boot_phase
+  {
+    const char *call;           /* Source text of the call. */
+    uint64_t cycles;            /* Time taken, in timer_cycles(). */
+  };
+static struct boot_phase boot_phases[BOOT_PHASE_MAX];
+static size_t boot_phase_cnt;
+static uint64_t boot_start;     /* timer_cycles() on entry to main(). */
+
+/* Runs CALL, a step of booting, and records how long it took. */
+#define BOOT_PHASE(CALL)                                        \
+        do                                                      \
+          {                                                     \
+            uint64_t start_ = timer_cycles ();                  \
+            CALL;                                               \
+            boot_phase_add (#CALL, timer_cycles () - start_);   \
+          }                                                     \
+        while (0)
+
 static void bss_init (void);
+static void boot_phase_add (const char *call, uint64_t cycles);
+static void boot_print_stats (void);
 static void paging_init (void);
+static uint32_t cpu_features (void);
 
 static char **read_command_line (void);
 static char **parse_options (char **argv);
 static void run_actions (char **argv);
 static void usage (void);
+static void parse_time_slices (char *);
+static uint64_t parse_rate (const char *name, const char *value);
+#ifdef USERPROG
+static void parse_kernel_pool (const char *value);
+#endif
 
 #ifdef FILESYS
 static void locate_block_devices (void);
 static void locate_block_device (enum block_type, const char *name);
+static void enable_checksums (enum block_type);
 #endif
 
 int main (void) NO_RETURN;
@@ -80,6 +157,7 @@ main (void)
 
   /* Clear BSS. */  
   bss_init ();
+  boot_start = timer_cycles ();
 
   /* Break command line into arguments and parse options. */
   argv = read_command_line ();
@@ -87,46 +165,72 @@ main (void)
 
   /* Initialize ourselves as a thread so we can use locks,
      then enable console locking. */
-  thread_init ();
-  console_init ();  
+  BOOT_PHASE (thread_init ());
+  BOOT_PHASE (console_init ());
+  BOOT_PHASE (workqueue_init ());
+  BOOT_PHASE (rcu_init ());
 
   /* Greet user. */
   printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
           init_ram_pages * PGSIZE / 1024);
 
   /* Initialize memory system. */
-  palloc_init (user_page_limit);
-  malloc_init ();
-  paging_init ();
+  BOOT_PHASE (palloc_init (user_page_limit));
+  BOOT_PHASE (malloc_init ());
+  BOOT_PHASE (slab_init ());
+  BOOT_PHASE (paging_init ());
+  BOOT_PHASE (vmalloc_init ());
 
   /* Segmentation. */
 #ifdef USERPROG
-  tss_init ();
-  gdt_init ();
+  BOOT_PHASE (tss_init ());
+  BOOT_PHASE (gdt_init ());
+  BOOT_PHASE (pagedir_init ());
 #endif
 
   /* Initialize interrupt handlers. */
-  intr_init ();
-  timer_init ();
-  kbd_init ();
-  input_init ();
+  BOOT_PHASE (intr_init ());
+  BOOT_PHASE (fpu_init ());
+  BOOT_PHASE (timer_init ());
+  BOOT_PHASE (kbd_init ());
+  BOOT_PHASE (input_init ());
 #ifdef USERPROG
-  exception_init ();
-  syscall_init ();
+  BOOT_PHASE (exception_init ());
+  BOOT_PHASE (syscall_init ());
+  BOOT_PHASE (process_init ());
 #endif
 
   /* Start thread scheduler and enable interrupts. */
-  thread_start ();
-  serial_init_queue ();
-  timer_calibrate ();
+  BOOT_PHASE (thread_start ());
+  BOOT_PHASE (workqueue_start ());
+  BOOT_PHASE (console_start ());
+  BOOT_PHASE (serial_init_queue ());
+  BOOT_PHASE (timer_calibrate ());
+
+  /* Start the other processors, if any. */
+  BOOT_PHASE (mp_init ());
+  BOOT_PHASE (trace_init ());
+  BOOT_PHASE (profile_init ());
 
 #ifdef FILESYS
   /* Initialize file system. */
-  ide_init ();
-  locate_block_devices ();
-  filesys_init (format_filesys);
+  BOOT_PHASE (ide_init ());
+  BOOT_PHASE (virtio_blk_init ());
+  BOOT_PHASE (ramdisk_init (ramdisk_kb));
+  BOOT_PHASE (locate_block_devices ());
+  BOOT_PHASE (filesys_init (format_filesys));
 #endif
 
+#ifdef VM
+  /* Initialize virtual memory. */
+  BOOT_PHASE (page_init ());
+  BOOT_PHASE (frame_init ());
+  BOOT_PHASE (swap_init ());
+  BOOT_PHASE (shm_init ());
+#endif
+
+  if (boot_stats)
+    boot_print_stats ();
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
@@ -150,14 +254,64 @@ bss_init (void)
   memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Records that the step of booting CALL took CYCLES. */
+static void
+boot_phase_add (const char *call, uint64_t cycles)
+{
+  ASSERT (boot_phase_cnt < BOOT_PHASE_MAX);
+  boot_phases[boot_phase_cnt].call = call;
+  boot_phases[boot_phase_cnt].cycles = cycles;
+  boot_phase_cnt++;
+}
+
+/* Prints how long each step of booting took, in microseconds and
+   as a share of the time since main() began.  Time between steps,
+   such as printing the greeting, shows up as "other". */
+static void
+boot_print_stats (void)
+{
+  uint64_t total = timer_cycles () - boot_start;
+  uint64_t other = total;
+  size_t i;
+
+  printf ("Boot time: %'"PRIu64" us\n", timer_cycles_to_ns (total) / 1000);
+  for (i = 0; i < boot_phase_cnt; i++)
+    {
+      const struct boot_phase *b = &boot_phases[i];
+
+      printf ("  %-24.*s %'10"PRIu64" us %3"PRIu64"%%\n",
+              (int) strcspn (b->call, " ("), b->call,
+              timer_cycles_to_ns (b->cycles) / 1000,
+              b->cycles * 100 / total);
+      other -= b->cycles;
+    }
+  printf ("  %-24s %'10"PRIu64" us %3"PRIu64"%%\n", "other",
+          timer_cycles_to_ns (other) / 1000, other * 100 / total);
+}
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports large pages, each whole 4 MB of RAM above
+   the kernel text is mapped by a single page directory entry
+   instead of a page table.  The 4 MB that hold the kernel text
+   keep 4 kB pages, so that the text stays read-only.
+
+   If the CPU supports it, the kernel mappings are marked global,
+   so that the TLB keeps them when a process switch reloads CR3.
+   Every page directory shares these mappings, so this is safe
+   as long as kernel mappings are changed only with invlpg, as
+   lapic_init() does. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
+  uint32_t features = cpu_features ();
+  uint32_t global = features & CPUID_PGE ? PTE_G : 0;
+  bool large = (features & CPUID_PSE) != 0;
+  uint32_t cr4;
   size_t page;
   extern char _start, _end_kernel_text;
 
@@ -171,15 +325,33 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (large && pte_idx == 0 && vaddr >= &_end_kernel_text
+          && page + PTSPAN / PGSIZE <= init_ram_pages)
+        {
+          pd[pde_idx] = pde_create_large (vaddr) | global;
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
           pd[pde_idx] = pde_create (pt);
         }
 
-      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text);
+      pt[pte_idx] = pte_create_kernel (vaddr, !in_kernel_text) | global;
     }
 
+  /* Turn on large and global pages before using them.  See
+     [IA32-v3a] 3.6.1 "Paging Options" and 3.12 "Translation
+     Lookaside Buffers (TLBs)". */
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  if (large)
+    cr4 |= CR4_PSE;
+  if (global)
+    cr4 |= CR4_PGE;
+  asm volatile ("movl %0, %%cr4" : : "r" (cr4) : "memory");
+
   /* Store the physical address of the page directory into CR3
      aka PDBR (page directory base register).  This activates our
      new page tables immediately.  See [IA32-v2a] "MOV--Move
@@ -188,6 +360,17 @@ paging_init (void)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
 }
 
+/* Returns the feature flags that CPUID function 1 reports in
+   EDX. */
+static uint32_t
+cpu_features (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  return edx;
+}
+
 /* Breaks the kernel command line into words and returns them as
    an argv-like array. */
 static char **
@@ -247,18 +430,76 @@ parse_options (char **argv)
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-ramdisk"))
+        ramdisk_kb = atoi (value);
+      else if (!strcmp (name, "-extents"))
+        inode_extents = true;
+      else if (!strcmp (name, "-defrag"))
+        defrag_enabled = true;
+      else if (!strcmp (name, "-cksum"))
+        verify_sectors = true;
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
+      else if (!strcmp (name, "-zswap"))
+        swap_zcache_limit = (size_t) atoi (value) * 1024;
 #endif
 #endif
+      else if (!strcmp (name, "-no-vga"))
+        console_disable_vga ();
       else if (!strcmp (name, "-rs"))
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-hz"))
+        {
+          timer_freq = value != NULL ? atoi (value) : 0;
+          if (timer_freq < TIMER_FREQ_MIN || timer_freq > TIMER_FREQ_MAX)
+            PANIC ("-hz must be from %d to %d", TIMER_FREQ_MIN,
+                   TIMER_FREQ_MAX);
+        }
+      else if (!strcmp (name, "-ts"))
+        parse_time_slices (value);
+      else if (!strcmp (name, "-lps"))
+        timer_preset_lps = parse_rate (name, value);
+      else if (!strcmp (name, "-cps"))
+        timer_preset_cps = parse_rate (name, value);
+      else if (!strcmp (name, "-trace"))
+        trace_enabled = true;
+      else if (!strcmp (name, "-boot-stats"))
+        boot_stats = true;
+      else if (!strcmp (name, "-profile"))
+        profile_enabled = true;
+      else if (!strcmp (name, "-lockstats"))
+        lock_stats_enabled = true;
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-kp"))
+        parse_kernel_pool (value);
+      else if (!strcmp (name, "-kr"))
+        palloc_reserve_pages = atoi (value);
+      else if (!strcmp (name, "-rusage"))
+        process_report_usage = true;
+      else if (!strcmp (name, "-no-sysenter"))
+        syscall_sysenter = false;
+      else if (!strcmp (name, "-j"))
+        parallel_runs = true;
+      else if (!strcmp (name, "-hugepages"))
+        palloc_large_pages = (cpu_features () & CPUID_PSE) != 0;
+#endif
+#ifdef VM
+      else if (!strcmp (name, "-stack"))
+        page_stack_limit = (size_t) atoi (value) * 1024;
+      else if (!strcmp (name, "-evict"))
+        {
+          if (value != NULL && !strcmp (value, "clock"))
+            frame_evict_policy = EVICT_CLOCK;
+          else if (value != NULL && !strcmp (value, "aging"))
+            frame_evict_policy = EVICT_AGING;
+          else
+            PANIC ("-evict must be `clock' or `aging'");
+        }
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -277,6 +518,82 @@ parse_options (char **argv)
   return argv;
 }
 
+/* Returns VALUE, the argument of option NAME, as a positive
+   number.  Allows commas between digits, so that a rate can be
+   copied as the "Calibrating timer..." line prints it. */
+static uint64_t
+parse_rate (const char *name, const char *value)
+{
+  uint64_t rate = 0;
+  const char *p;
+
+  if (value == NULL || *value == '\0')
+    PANIC ("%s requires a value", name);
+  for (p = value; *p != '\0'; p++)
+    if (*p >= '0' && *p <= '9')
+      rate = rate * 10 + (*p - '0');
+    else if (*p != ',')
+      PANIC ("%s: bad rate `%s'", name, value);
+  if (rate == 0)
+    PANIC ("%s must be positive", name);
+  return rate;
+}
+
+#ifdef USERPROG
+/* Sets the kernel pool size from VALUE, the argument of the
+   "-kp" option: a number of pages, or a percentage of free
+   memory followed by `%'. */
+static void
+parse_kernel_pool (const char *value)
+{
+  const char *end;
+  size_t n = 0;
+
+  if (value == NULL)
+    PANIC ("-kp requires a value");
+  for (end = value; *end >= '0' && *end <= '9'; end++)
+    n = n * 10 + (*end - '0');
+  if (n == 0)
+    PANIC ("-kp: bad size `%s'", value);
+  if (*end == '%' && end[1] == '\0' && n <= 100)
+    {
+      palloc_kernel_percent = n;
+      palloc_kernel_pages = 0;
+    }
+  else if (*end == '\0')
+    palloc_kernel_pages = n;
+  else
+    PANIC ("-kp: bad size `%s'", value);
+}
+#endif
+
+/* Sets the time slices from VALUE, the argument of the "-ts"
+   option: either one slice in milliseconds for all priorities,
+   or THREAD_SLICE_BANDS of them separated by commas, for bands
+   of priorities from lowest to highest. */
+static void
+parse_time_slices (char *value)
+{
+  int slices[THREAD_SLICE_BANDS];
+  char *token, *save_ptr;
+  int cnt = 0;
+  int i;
+
+  if (value != NULL)
+    for (token = strtok_r (value, ",", &save_ptr); token != NULL;
+         token = strtok_r (NULL, ",", &save_ptr))
+      {
+        if (cnt == THREAD_SLICE_BANDS || (slices[cnt] = atoi (token)) <= 0)
+          PANIC ("bad -ts value (use -h for help)");
+        cnt++;
+      }
+  if (cnt != 1 && cnt != THREAD_SLICE_BANDS)
+    PANIC ("bad -ts value (use -h for help)");
+
+  for (i = 0; i < THREAD_SLICE_BANDS; i++)
+    thread_slice_ms[i] = slices[cnt == 1 ? 0 : i];
+}
+
 /* Runs the task specified in ARGV[1]. */
 static void
 run_task (char **argv)
@@ -292,8 +609,46 @@ run_task (char **argv)
   printf ("Execution of '%s' complete.\n", task);
 }
 
+#ifdef USERPROG
+/* `run' actions started with -j and not yet waited for. */
+struct parallel_run
+  {
+    const char *task;                   /* Command line. */
+    tid_t tid;                          /* Process, or TID_ERROR. */
+  };
+
+/* Starts the task specified in ARGV[1] without waiting for it,
+   as the next of the CNT entries in RUNS. */
+static void
+start_task (char **argv, struct parallel_run runs[], size_t *cnt)
+{
+  struct parallel_run *r = &runs[(*cnt)++];
+
+  r->task = argv[1];
+  printf ("Executing '%s':\n", r->task);
+  r->tid = process_execute (r->task);
+}
+
+/* Waits for each of the CNT tasks in RUNS, in the order they
+   were started, and empties RUNS. */
+static void
+finish_tasks (struct parallel_run runs[], size_t *cnt)
+{
+  size_t i;
+
+  for (i = 0; i < *cnt; i++)
+    {
+      process_wait (runs[i].tid);
+      printf ("Execution of '%s' complete.\n", runs[i].task);
+    }
+  *cnt = 0;
+}
+#endif
+
 /* Executes all of the actions specified in ARGV[]
-   up to the null pointer sentinel. */
+   up to the null pointer sentinel.  With -j, each run of
+   consecutive `run' actions is started together, and all of
+   them are waited for before the next action. */
 static void
 run_actions (char **argv) 
 {
@@ -313,11 +668,16 @@ run_actions (char **argv)
       {"ls", 1, fsutil_ls},
       {"cat", 2, fsutil_cat},
       {"rm", 2, fsutil_rm},
+      {"pin", 2, fsutil_pin},
       {"extract", 1, fsutil_extract},
       {"append", 2, fsutil_append},
 #endif
       {NULL, 0, NULL},
     };
+#ifdef USERPROG
+  struct parallel_run runs[PARALLEL_RUN_MAX];
+  size_t run_cnt = 0;
+#endif
 
   while (*argv != NULL)
     {
@@ -337,10 +697,24 @@ run_actions (char **argv)
           PANIC ("action `%s' requires %d argument(s)", *argv, a->argc - 1);
 
       /* Invoke action and advance. */
+#ifdef USERPROG
+      if (parallel_runs && a->function == run_task)
+        {
+          if (run_cnt == PARALLEL_RUN_MAX)
+            finish_tasks (runs, &run_cnt);
+          start_task (argv, runs, &run_cnt);
+          argv += a->argc;
+          continue;
+        }
+      finish_tasks (runs, &run_cnt);
+#endif
       a->function (argv);
       argv += a->argc;
     }
-  
+#ifdef USERPROG
+  finish_tasks (runs, &run_cnt);
+#endif
+
 }
 
 /* Prints a kernel command line help message and powers off the
@@ -351,6 +725,9 @@ usage (void)
   printf ("\nCommand line syntax: [OPTION...] [ACTION...]\n"
           "Options must precede actions.\n"
           "Actions are executed in the order specified.\n"
+#ifdef USERPROG
+          "With -j, consecutive `run' actions are executed together.\n"
+#endif
           "\nAvailable actions:\n"
 #ifdef USERPROG
           "  run 'PROG [ARG...]' Run PROG and wait for it to complete.\n"
@@ -361,6 +738,7 @@ usage (void)
           "  ls                 List files in the root directory.\n"
           "  cat FILE           Print FILE to the console.\n"
           "  rm FILE            Delete FILE.\n"
+          "  pin FILE           Keep FILE's data in the page cache.\n"
           "Use these actions indirectly via `pintos' -g and -p options:\n"
           "  extract            Untar from scratch device into file system.\n"
           "  append FILE        Append FILE to tar file on scratch device.\n"
@@ -373,14 +751,45 @@ usage (void)
           "  -f                 Format file system device during startup.\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -ramdisk=KB        Create KB-kilobyte RAM disk ram0, for use\n"
+          "                     with -filesys or -scratch.\n"
+          "  -extents           Store new files' data as extents.\n"
+          "  -defrag            Defragment files while the disk is idle.\n"
+          "  -cksum             Check file system and swap sectors\n"
+          "                     against checksums as they are read.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+          "  -zswap=KB          Keep up to KB kilobytes of swapped pages\n"
+          "                     compressed in memory.\n"
 #endif
 #endif
+          "  -no-vga            Write console output to serial port only.\n"
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -hz=FREQ           Take FREQ timer interrupts a second (19-1000).\n"
+          "  -ts=MS[,MS,MS]     Use MS-ms time slices, for all priorities\n"
+          "                     or for low, middle and high priorities.\n"
+          "  -lps=N -cps=N      Skip calibrating busy-wait loops or CPU\n"
+          "                     cycles per second, as printed at boot.\n"
+          "  -trace             Trace kernel events, saved to scratch.\n"
+          "  -profile           Sample code locations on timer ticks.\n"
+          "  -boot-stats        Print how long each step of booting took.\n"
+          "  -lockstats         Count lock acquisitions and waits.\n"
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -kp=COUNT|PCT%%    Give COUNT pages or PCT%% of memory to the\n"
+          "                     kernel pool (default 50%%).\n"
+          "  -kr=COUNT          Hold COUNT kernel pages for paging.\n"
+          "  -rusage            Print resource usage of each process.\n"
+          "  -no-sysenter       Make system calls with int $0x31 only.\n"
+          "  -j                 Run consecutive `run' actions in parallel.\n"
+          "  -hugepages         Map large aligned parts of user heaps\n"
+          "                     with 4 MB pages, unless built with VM.\n"
+#endif
+#ifdef VM
+          "  -stack=KB          Limit user stacks to KB kilobytes.\n"
+          "  -evict=POLICY      Replace pages by `clock' (default) or\n"
+          "                     `aging' counters that prefer clean pages.\n"
 #endif
           );
   shutdown_power_off ();
@@ -396,12 +805,33 @@ locate_block_devices (void)
 #ifdef VM
   locate_block_device (BLOCK_SWAP, swap_bdev_name);
 #endif
+
+  if (verify_sectors)
+    {
+      enable_checksums (BLOCK_FILESYS);
+#ifdef VM
+      enable_checksums (BLOCK_SWAP);
+#endif
+    }
+}
+
+/* Starts checking the sectors of the block device in ROLE, if
+   there is one, against checksums. */
+static void
+enable_checksums (enum block_type role)
+{
+  struct block *block = block_get_role (role);
+
+  if (block != NULL && !block_enable_checksums (block))
+    PANIC ("can't allocate checksums for %s", block_name (block));
 }
 
 /* Figures out what block device to use for the given ROLE: the
    block device with the given NAME, if NAME is non-null,
-   otherwise the first block device in probe order of type
-   ROLE. */
+   otherwise the first block device in probe order of type ROLE.
+   Without a NAME, a device on a different channel from the file
+   system device is preferred, so that, for example, swapping
+   does not hold up file system I/O. */
 static void
 locate_block_device (enum block_type role, const char *name)
 {
@@ -415,9 +845,21 @@ locate_block_device (enum block_type role, const char *name)
     }
   else
     {
-      for (block = block_first (); block != NULL; block = block_next (block))
-        if (block_type (block) == role)
-          break;
+      struct block *filesys = block_get_role (BLOCK_FILESYS);
+      struct block *b;
+
+      for (b = block_first (); b != NULL; b = block_next (b))
+        if (block_type (b) == role)
+          {
+            if (block == NULL)
+              block = b;
+            if (role == BLOCK_FILESYS || filesys == NULL
+                || block_channel (b) != block_channel (filesys))
+              {
+                block = b;
+                break;
+              }
+          }
     }
 
   if (block != NULL)
@@ -6,9 +6,15 @@
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/rcu.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #include "devices/timer.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#include "userprog/process.h"
+#endif
 
 /* Programmable Interrupt Controller (PIC) registers.
    A PC has two PICs, called the master and slave PICs, with the
@@ -37,6 +43,15 @@ static const char *intr_names[INTR_CNT];
    unexpected interrupt is one that has no registered handler. */
 static unsigned int unexpected_cnt[INTR_CNT];
 
+/* Statistics for each vector: number of times intr_handler() ran
+   it, and the total and largest timer_cycles() that its handler
+   took.  An internal handler that sleeps, as a system call may,
+   is charged for the time that it slept, and one that an external
+   interrupt interrupts is charged for that too. */
+static long long intr_cnt[INTR_CNT];
+static uint64_t intr_cycles[INTR_CNT];
+static uint64_t intr_max_cycles[INTR_CNT];
+
 /* External interrupts are those generated by devices outside the
    CPU, such as the timer.  External interrupts run with
    interrupts turned off, so they never nest, nor are they ever
@@ -47,6 +62,20 @@ static unsigned int unexpected_cnt[INTR_CNT];
 static bool in_external_intr;   /* Are we processing an external interrupt? */
 static bool yield_on_return;    /* Should we yield on interrupt return? */
 
+/* Deferred handlers.  An external interrupt handler should only
+   do what must be done with interrupts off, such as acknowledging
+   its device, and leave the rest to an intr_deferred that it
+   queues with intr_defer().  Just before the outermost external
+   interrupt returns, after it has been acknowledged on the PIC,
+   the queued deferred handlers run with interrupts turned back
+   on, so that other interrupts need not wait for them.  They
+   still count as interrupt context: they may not sleep, and a
+   nested interrupt neither runs them again nor yields until they
+   are done.  They must turn interrupts off themselves around data
+   that interrupt handlers touch. */
+static struct list deferred_list; /* Queued deferred handlers. */
+static bool in_deferred;        /* Are we running deferred handlers? */
+
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
 static void pic_end_of_interrupt (int irq);
@@ -58,6 +87,8 @@ static inline uint64_t make_idtr_operand (uint16_t limit, void *base);
 
 /* Interrupt handlers. */
 void intr_handler (struct intr_frame *args);
+static void run_deferred (void);
+static void account_handler (uint8_t vec, uint64_t cycles);
 static void unexpected_interrupt (const struct intr_frame *);
 
 /* Returns the current interrupt status. */
@@ -88,7 +119,7 @@ enum intr_level
 intr_enable (void) 
 {
   enum intr_level old_level = intr_get_level ();
-  ASSERT (!intr_context ());
+  ASSERT (!in_external_intr);
 
   /* Enable interrupts by setting the interrupt flag.
 
@@ -113,25 +144,33 @@ intr_disable (void)
   return old_level;
 }
 
+/* Loads the IDT into the current CPU's IDT register.  Called by
+   intr_init() and by each application processor as it starts. */
+void
+intr_load_idt (void)
+{
+  uint64_t idtr_operand;
+
+  /* See [IA32-v2a] "LIDT" and [IA32-v3a] 5.10 "Interrupt
+     Descriptor Table (IDT)". */
+  idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
+  asm volatile ("lidt %0" : : "m" (idtr_operand));
+}
+
 /* Initializes the interrupt system. */
 void
 intr_init (void)
 {
-  uint64_t idtr_operand;
   int i;
 
   /* Initialize interrupt controller. */
   pic_init ();
+  list_init (&deferred_list);
 
   /* Initialize IDT. */
   for (i = 0; i < INTR_CNT; i++)
     idt[i] = make_intr_gate (intr_stubs[i], 0);
-
-  /* Load IDT register.
-     See [IA32-v2a] "LIDT" and [IA32-v3a] 5.10 "Interrupt
-     Descriptor Table (IDT)". */
-  idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
-  asm volatile ("lidt %0" : : "m" (idtr_operand));
+  intr_load_idt ();
 
   /* Initialize intr_names. */
   for (i = 0; i < INTR_CNT; i++)
@@ -206,24 +245,59 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
   register_handler (vec_no, dpl, level, handler, name);
 }
 
-/* Returns true during processing of an external interrupt
-   and false at all other times. */
+/* Returns true during processing of an external interrupt,
+   including its deferred handlers, and false at all other
+   times. */
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  return in_external_intr || in_deferred;
 }
 
 /* During processing of an external interrupt, directs the
    interrupt handler to yield to a new process just before
-   returning from the interrupt.  May not be called at any other
-   time. */
+   returning from the interrupt, after any deferred handlers have
+   run.  May not be called at any other time. */
 void
 intr_yield_on_return (void) 
 {
   ASSERT (intr_context ());
   yield_on_return = true;
 }
+
+/* Initializes D to call FUNC with auxiliary data AUX when
+   queued with intr_defer(). */
+void
+intr_deferred_init (struct intr_deferred *d, intr_deferred_func *func,
+                    void *aux)
+{
+  ASSERT (d != NULL);
+  ASSERT (func != NULL);
+
+  d->func = func;
+  d->aux = aux;
+  d->pending = false;
+}
+
+/* Queues D to run, with interrupts on, just before the current
+   external interrupt returns.  Does nothing if D is already
+   queued.  May only be called from an external interrupt
+   handler or a deferred handler. */
+void
+intr_defer (struct intr_deferred *d)
+{
+  enum intr_level old_level;
+
+  ASSERT (intr_context ());
+
+  old_level = intr_disable ();
+  if (!d->pending)
+    {
+      d->pending = true;
+      list_push_back (&deferred_list, &d->elem);
+    }
+  intr_set_level (old_level);
+}
 
 /* 8259A Programmable Interrupt Controller. */
 
@@ -346,23 +420,33 @@ intr_handler (struct intr_frame *frame)
 {
   bool external;
   intr_handler_func *handler;
+  enum cpu_mode old_mode;
+  uint64_t start;
+
+  TRACE (TRACE_INTR, frame->vec_no, frame->eip);
 
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
      and they need to be acknowledged on the PIC (see below).
      An external interrupt handler cannot sleep. */
   external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+  old_mode = thread_set_cpu_mode (external ? CPU_INTR : CPU_KERNEL);
   if (external) 
     {
       ASSERT (intr_get_level () == INTR_OFF);
-      ASSERT (!intr_context ());
+      ASSERT (!in_external_intr);
 
       in_external_intr = true;
-      yield_on_return = false;
+      if (!in_deferred)
+        yield_on_return = false;
+
+      /* Catch up on timer ticks skipped while idle. */
+      timer_idle_exit ();
     }
 
   /* Invoke the interrupt's handler. */
   handler = intr_handlers[frame->vec_no];
+  start = timer_cycles ();
   if (handler != NULL)
     handler (frame);
   else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
@@ -373,6 +457,7 @@ intr_handler (struct intr_frame *frame)
     }
   else
     unexpected_interrupt (frame);
+  account_handler (frame->vec_no, timer_cycles () - start);
 
   /* Complete the processing of an external interrupt. */
   if (external) 
@@ -383,9 +468,62 @@ intr_handler (struct intr_frame *frame)
       in_external_intr = false;
       pic_end_of_interrupt (frame->vec_no); 
 
-      if (yield_on_return) 
-        thread_yield (); 
+      /* An interrupt that arrived while deferred handlers were
+         running leaves them, and any yield, to the interrupt
+         that they are running for. */
+      if (!in_deferred)
+        {
+          run_deferred ();
+          if (yield_on_return && rcu_may_yield ())
+            thread_yield ();
+        }
     }
+
+#ifdef USERPROG
+  /* A thread whose process is ending must not go back to it. */
+  if (frame->cs == SEL_UCSEG)
+    process_check_exiting ();
+#endif
+
+  thread_set_cpu_mode (old_mode);
+}
+
+/* Charges CYCLES to vector VEC.  Interrupts are turned off
+   around the update, because a thread in a system call could
+   otherwise be preempted halfway through it by another thread
+   updating the same counters. */
+static void
+account_handler (uint8_t vec, uint64_t cycles)
+{
+  enum intr_level old_level = intr_disable ();
+
+  intr_cnt[vec]++;
+  intr_cycles[vec] += cycles;
+  if (cycles > intr_max_cycles[vec])
+    intr_max_cycles[vec] = cycles;
+  intr_set_level (old_level);
+}
+
+/* Runs the queued deferred handlers, including any queued while
+   they run, with interrupts on.  Interrupts must be off and are
+   off again on return. */
+static void
+run_deferred (void)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!in_deferred);
+
+  in_deferred = true;
+  while (!list_empty (&deferred_list))
+    {
+      struct intr_deferred *d = list_entry (list_pop_front (&deferred_list),
+                                            struct intr_deferred, elem);
+      d->pending = false;
+      intr_enable ();
+      d->func (d->aux);
+      intr_disable ();
+    }
+  in_deferred = false;
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -430,6 +568,21 @@ intr_dump_frame (const struct intr_frame *f)
           f->cs, f->ds, f->es, f->ss);
 }
 
+/* Prints, for each vector that has run, how many times it ran
+   and the mean and largest timer_cycles() its handler took. */
+void
+intr_print_stats (void)
+{
+  int vec;
+
+  printf ("Interrupts:\n");
+  for (vec = 0; vec < INTR_CNT; vec++)
+    if (intr_cnt[vec] > 0)
+      printf ("  0x%02x %s: %lld calls, %"PRIu64" cycles avg, "
+              "%"PRIu64" max\n", vec, intr_names[vec], intr_cnt[vec],
+              intr_cycles[vec] / intr_cnt[vec], intr_max_cycles[vec]);
+}
+
 /* Returns the name of interrupt VEC. */
 const char *
 intr_name (uint8_t vec) 
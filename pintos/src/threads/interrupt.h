@@ -1,6 +1,7 @@
 #ifndef THREADS_INTERRUPT_H
 #define THREADS_INTERRUPT_H
 
+#include <list.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -57,14 +58,30 @@ struct intr_frame
 
 typedef void intr_handler_func (struct intr_frame *);
 
+/* Deferred part of an external interrupt handler, queued with
+   intr_defer(). */
+typedef void intr_deferred_func (void *aux);
+struct intr_deferred
+  {
+    struct list_elem elem;      /* Element in deferred list. */
+    intr_deferred_func *func;   /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    bool pending;               /* Queued but not yet run? */
+  };
+
 void intr_init (void);
+void intr_load_idt (void);
 void intr_register_ext (uint8_t vec, intr_handler_func *, const char *name);
 void intr_register_int (uint8_t vec, int dpl, enum intr_level,
                         intr_handler_func *, const char *name);
 bool intr_context (void);
 void intr_yield_on_return (void);
+void intr_deferred_init (struct intr_deferred *, intr_deferred_func *,
+                         void *aux);
+void intr_defer (struct intr_deferred *);
 
 void intr_dump_frame (const struct intr_frame *);
 const char *intr_name (uint8_t vec);
+void intr_print_stats (void);
 
 #endif /* threads/interrupt.h */
@@ -5,9 +5,12 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "threads/vmalloc.h"
 
 /* A simple implementation of malloc().
 
@@ -28,19 +31,64 @@
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
-   We can't handle blocks bigger than 2 kB using this scheme,
-   because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
-   with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   Blocks of 2 kB and more don't fit well in a single page, so
+   their sizes step up by halves instead (2, 3, 6, and 12 kB) and
+   their arenas span several pages, mapped with vmalloc_aligned()
+   so that the pages need not be physically contiguous.  Such an
+   arena starts at a multiple of MULTI_ARENA_ALIGN, which is how a
+   block finds its arena.
+
+   We can't handle blocks bigger than 12 kB using this scheme.
+   We handle those by allocating contiguous pages with the page
+   allocator, or with vmalloc_aligned() if the pool is too
+   fragmented, and sticking the allocation size at the beginning
+   of the allocated block's arena header.
+
+   In front of each single-page descriptor, every thread keeps a
+   "magazine" of a few free blocks of that size in its struct
+   thread.  malloc() and free() normally just pop and push the
+   current thread's magazine, without taking the descriptor's lock.
+   Only when a magazine runs empty or fills up is its descriptor
+   locked, to move half a magazine of blocks at once.  Blocks in
+   a magazine still count as in use in their arena.  A thread's
+   magazines go back to the descriptors when it exits.
+
+   Each descriptor counts the blocks malloc() hands out and free()
+   takes back, and big blocks are counted together, for
+   malloc_print_stats().
+
+   Memory that a system call needs only until it returns, such as
+   the kernel copies of its string arguments, comes instead from
+   the thread's scratch arena with scratch_alloc(), which just
+   bumps a pointer through a few pages of its own and takes no
+   lock.  Nothing in the arena is freed on its own: the system
+   call handler empties it all at once with scratch_reset() as
+   the call returns, keeping SCRATCH_KEEP pages for the next
+   call, and malloc_thread_exit() frees it when a thread exits,
+   even from the middle of a call. */
+
+/* Allocation counts for one block size. */
+struct malloc_stats
+  {
+    unsigned long long alloc_cnt;       /* Number of allocations. */
+    unsigned long long free_cnt;        /* Number of frees. */
+    size_t live;                        /* Bytes now allocated. */
+    size_t peak;                        /* Maximum of `live'. */
+  };
+
+/* Alignment of arenas in the vmalloc() window.  Must be at least
+   as big as the biggest arena. */
+#define MULTI_ARENA_ALIGN (16 * PGSIZE)
 
 /* Descriptor. */
 struct desc
   {
     size_t block_size;          /* Size of each element in bytes. */
+    size_t arena_pages;         /* Number of pages in an arena. */
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+    struct malloc_stats stats;  /* Statistics. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -60,27 +108,157 @@ struct block
     struct list_elem free_elem; /* Free list element. */
   };
 
+/* Sizes of blocks in multi-page arenas, and the number of pages
+   in each of their arenas. */
+static const struct 
+  {
+    size_t block_size;
+    size_t arena_pages;
+  }
+multi_page_classes[] = 
+  {
+    {2048, 4}, {3072, 4}, {6144, 8}, {12288, 16},
+  };
+
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[12];   /* Descriptors. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* Statistics for blocks too big for any descriptor. */
+static struct malloc_stats big_stats;
+
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
+static struct block *desc_get (struct desc *);
+static void desc_put (struct desc *, struct block *);
+static void *arena_alloc (struct desc *);
+static void arena_free (struct desc *, struct arena *);
+static struct magazine *desc_magazine (struct desc *);
+static void magazine_flush (struct desc *, struct magazine *, unsigned cnt);
+static void count_alloc (struct malloc_stats *, size_t size);
+static void count_free (struct malloc_stats *, size_t size);
+static void init_desc (size_t block_size, size_t arena_pages);
 
 /* Initializes the malloc() descriptors. */
 void
 malloc_init (void) 
 {
   size_t block_size;
+  size_t i;
 
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
+    init_desc (block_size, 1);
+  ASSERT (desc_cnt == MAG_CLASS_CNT);
+  for (i = 0; i < sizeof multi_page_classes / sizeof *multi_page_classes;
+       i++)
+    init_desc (multi_page_classes[i].block_size,
+               multi_page_classes[i].arena_pages);
+}
+
+/* Adds a descriptor for blocks of BLOCK_SIZE bytes, in arenas of
+   ARENA_PAGES pages. */
+static void
+init_desc (size_t block_size, size_t arena_pages) 
+{
+  struct desc *d = &descs[desc_cnt++];
+
+  ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+  ASSERT (arena_pages * PGSIZE <= MULTI_ARENA_ALIGN);
+  d->block_size = block_size;
+  d->arena_pages = arena_pages;
+  d->blocks_per_arena = ((arena_pages * PGSIZE - sizeof (struct arena))
+                         / block_size);
+  list_init (&d->free_list);
+  lock_init (&d->lock);
+}
+
+/* Returns the blocks in the running thread's magazines to their
+   descriptors and frees its scratch arena.  Called by
+   thread_exit(), after which the thread must not allocate or
+   free memory. */
+void
+malloc_thread_exit (void) 
+{
+  struct scratch *s = &thread_current ()->scratch;
+  size_t i;
+
+  for (i = 0; i < MAG_CLASS_CNT; i++)
     {
-      struct desc *d = &descs[desc_cnt++];
-      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
-      d->block_size = block_size;
-      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
-      lock_init (&d->lock);
+      struct magazine *m = desc_magazine (&descs[i]);
+      magazine_flush (&descs[i], m, m->cnt);
+    }
+  for (i = 0; i < s->page_cnt; i++)
+    palloc_free_page (s->pages[i]);
+  s->page_cnt = 0;
+}
+
+/* Allocates SIZE bytes, at most a page, from the running
+   thread's scratch arena, and returns them, or a null pointer if
+   the arena is full or memory runs out.  The block stays valid
+   until the next scratch_reset(). */
+void *
+scratch_alloc (size_t size)
+{
+  struct scratch *s = &thread_current ()->scratch;
+  void *block;
+
+  size = ROUND_UP (size, sizeof (void *));
+  if (size > PGSIZE)
+    return NULL;
+  if (s->page_cnt == 0 || s->used + size > PGSIZE)
+    {
+      size_t next = s->page_cnt == 0 ? 0 : s->cur + 1;
+
+      if (next >= SCRATCH_PAGES)
+        return NULL;
+      if (next == s->page_cnt)
+        {
+          s->pages[next] = palloc_get_page (0);
+          if (s->pages[next] == NULL)
+            return NULL;
+          s->page_cnt++;
+        }
+      s->cur = next;
+      s->used = 0;
+    }
+  block = (uint8_t *) s->pages[s->cur] + s->used;
+  s->used += size;
+  return block;
+}
+
+/* Frees everything in the running thread's scratch arena,
+   keeping its first SCRATCH_KEEP pages for later calls. */
+void
+scratch_reset (void)
+{
+  struct scratch *s = &thread_current ()->scratch;
+
+  while (s->page_cnt > SCRATCH_KEEP)
+    palloc_free_page (s->pages[--s->page_cnt]);
+  s->cur = 0;
+  s->used = 0;
+}
+
+/* Prints malloc() statistics for each block size in use. */
+void
+malloc_print_stats (void) 
+{
+  size_t i;
+
+  for (i = 0; i <= desc_cnt; i++)
+    {
+      const struct malloc_stats *s;
+
+      s = i < desc_cnt ? &descs[i].stats : &big_stats;
+
+      if (s->alloc_cnt == 0)
+        continue;
+      if (i < desc_cnt)
+        printf ("Malloc: %zu-byte blocks:", descs[i].block_size);
+      else
+        printf ("Malloc: big blocks:");
+      printf (" %llu allocs, %llu frees, %zu bytes used (max %zu)\n",
+              s->alloc_cnt, s->free_cnt, s->live, s->peak);
     }
 }
 
@@ -90,6 +268,7 @@ void *
 malloc (size_t size) 
 {
   struct desc *d;
+  struct magazine *m;
   struct block *b;
   struct arena *a;
 
@@ -108,6 +287,8 @@ malloc (size_t size)
          Allocate enough pages to hold SIZE plus an arena. */
       size_t page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
       a = palloc_get_multiple (0, page_cnt);
+      if (a == NULL)
+        a = vmalloc_aligned (page_cnt * PGSIZE, MULTI_ARENA_ALIGN);
       if (a == NULL)
         return NULL;
 
@@ -116,41 +297,42 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+      count_alloc (&big_stats, page_cnt * PGSIZE);
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
-
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  /* Blocks from multi-page arenas are not kept in magazines. */
+  if (d - descs >= MAG_CLASS_CNT)
     {
-      size_t i;
-
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
-        {
-          lock_release (&d->lock);
-          return NULL; 
-        }
+      lock_acquire (&d->lock);
+      b = desc_get (d);
+      lock_release (&d->lock);
+      if (b == NULL)
+        return NULL;
+      count_alloc (&d->stats, d->block_size);
+      return b;
+    }
 
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
+  /* Refill an empty magazine to half full, taking the lock just
+     once. */
+  m = desc_magazine (d);
+  if (m->cnt == 0)
+    {
+      lock_acquire (&d->lock);
+      while (m->cnt < MAG_SIZE / 2)
         {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
+          b = desc_get (d);
+          if (b == NULL)
+            break;
+          m->blocks[m->cnt++] = b;
         }
+      lock_release (&d->lock);
+      if (m->cnt == 0)
+        return NULL;
     }
 
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
-  lock_release (&d->lock);
-  return b;
+  count_alloc (&d->stats, d->block_size);
+  return m->blocks[--m->cnt];
 }
 
 /* Allocates and return A times B bytes initialized to zeroes.
@@ -182,7 +364,7 @@ block_size (void *block)
   struct arena *a = block_to_arena (b);
   struct desc *d = a->desc;
 
-  return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
+  return d != NULL ? d->block_size : PGSIZE * a->free_cnt - sizeof *a;
 }
 
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
@@ -233,41 +415,188 @@ free (void *p)
           memset (b, 0xcc, d->block_size);
 #endif
   
-          lock_acquire (&d->lock);
+          struct magazine *m;
 
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
-
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+          count_free (&d->stats, d->block_size);
+          if (d - descs >= MAG_CLASS_CNT)
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              lock_acquire (&d->lock);
+              desc_put (d, b);
+              lock_release (&d->lock);
+              return;
             }
 
-          lock_release (&d->lock);
+          /* Keep the block in the running thread's magazine,
+             first emptying a full magazine down to half. */
+          m = desc_magazine (d);
+          if (m->cnt == MAG_SIZE)
+            magazine_flush (d, m, MAG_SIZE / 2);
+          m->blocks[m->cnt++] = b;
         }
       else
         {
           /* It's a big block.  Free its pages. */
-          palloc_free_multiple (a, a->free_cnt);
+          count_free (&big_stats, a->free_cnt * PGSIZE);
+          if (is_vmalloc_vaddr (a))
+            vfree (a);
+          else
+            palloc_free_multiple (a, a->free_cnt);
           return;
         }
     }
 }
 
+/* Removes a block from D's free list and returns it, first
+   filling the list from a new arena if it is empty.  Returns a
+   null pointer if memory is not available.  D's lock must be
+   held. */
+static struct block *
+desc_get (struct desc *d) 
+{
+  struct block *b;
+  struct arena *a;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* If the free list is empty, create a new arena. */
+  if (list_empty (&d->free_list))
+    {
+      size_t i;
+
+      /* Allocate an arena. */
+      a = arena_alloc (d);
+      if (a == NULL) 
+        return NULL; 
+
+      /* Initialize arena and add its blocks to the free list. */
+      a->magic = ARENA_MAGIC;
+      a->desc = d;
+      a->free_cnt = d->blocks_per_arena;
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_push_back (&d->free_list, &b->free_elem);
+        }
+    }
+
+  /* Get a block from free list. */
+  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+  a = block_to_arena (b);
+  a->free_cnt--;
+  return b;
+}
+
+/* Adds block B to D's free list, freeing its arena if that
+   leaves the arena entirely unused.  D's lock must be held. */
+static void
+desc_put (struct desc *d, struct block *b) 
+{
+  struct arena *a = block_to_arena (b);
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  /* Add block to free list. */
+  list_push_front (&d->free_list, &b->free_elem);
+
+  /* If the arena is now entirely unused, free it. */
+  if (++a->free_cnt >= d->blocks_per_arena) 
+    {
+      size_t i;
+
+      ASSERT (a->free_cnt == d->blocks_per_arena);
+      for (i = 0; i < d->blocks_per_arena; i++) 
+        {
+          struct block *b = arena_to_block (a, i);
+          list_remove (&b->free_elem);
+        }
+      arena_free (d, a);
+    }
+}
+
+/* Obtains the memory for a new arena for D, or returns a null
+   pointer if memory is not available. */
+static void *
+arena_alloc (struct desc *d) 
+{
+  if (d->arena_pages == 1)
+    return palloc_get_page (0);
+  else
+    return vmalloc_aligned (d->arena_pages * PGSIZE, MULTI_ARENA_ALIGN);
+}
+
+/* Frees arena A of D. */
+static void
+arena_free (struct desc *d, struct arena *a) 
+{
+  if (d->arena_pages == 1)
+    palloc_free_page (a);
+  else
+    vfree (a);
+}
+
+/* Returns the running thread's magazine for descriptor D.
+   Magazines belong to threads, so they cannot be used from an
+   interrupt handler, which would find the interrupted thread's
+   magazine perhaps half updated. */
+static struct magazine *
+desc_magazine (struct desc *d) 
+{
+  ASSERT (!intr_context ());
+  ASSERT (d - descs < MAG_CLASS_CNT);
+  return &thread_current ()->magazines[d - descs];
+}
+
+/* Moves the top CNT blocks of magazine M back to descriptor D,
+   taking D's lock once. */
+static void
+magazine_flush (struct desc *d, struct magazine *m, unsigned cnt) 
+{
+  ASSERT (cnt <= m->cnt);
+
+  if (cnt == 0)
+    return;
+  lock_acquire (&d->lock);
+  while (cnt-- > 0)
+    desc_put (d, m->blocks[--m->cnt]);
+  lock_release (&d->lock);
+}
+
+/* Counts an allocation of SIZE bytes in S.  Threads update the
+   counts without a lock, so interrupts are turned off to keep
+   the updates whole. */
+static void
+count_alloc (struct malloc_stats *s, size_t size) 
+{
+  enum intr_level old_level = intr_disable ();
+  s->alloc_cnt++;
+  s->live += size;
+  if (s->live > s->peak)
+    s->peak = s->live;
+  intr_set_level (old_level);
+}
+
+/* Counts a free of SIZE bytes in S. */
+static void
+count_free (struct malloc_stats *s, size_t size) 
+{
+  enum intr_level old_level = intr_disable ();
+  s->free_cnt++;
+  s->live -= size;
+  intr_set_level (old_level);
+}
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
 {
-  struct arena *a = pg_round_down (b);
+  struct arena *a;
+  size_t ofs;
+
+  if (is_vmalloc_vaddr (b))
+    a = (struct arena *) ROUND_DOWN ((uintptr_t) b, MULTI_ARENA_ALIGN);
+  else
+    a = pg_round_down (b);
+  ofs = (uint8_t *) b - (uint8_t *) a;
 
   /* Check that the arena is valid. */
   ASSERT (a != NULL);
@@ -275,8 +604,8 @@ block_to_arena (struct block *b)
 
   /* Check that the block is properly aligned for the arena. */
   ASSERT (a->desc == NULL
-          || (pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
-  ASSERT (a->desc != NULL || pg_ofs (b) == sizeof *a);
+          || (ofs - sizeof *a) % a->desc->block_size == 0);
+  ASSERT (a->desc != NULL || ofs == sizeof *a);
 
   return a;
 }
@@ -4,10 +4,40 @@
 #include <debug.h>
 #include <stddef.h>
 
+/* Per-thread magazines of free blocks, one for each of the
+   MAG_CLASS_CNT smallest block sizes.  A magazine holds up to
+   MAG_SIZE blocks.  See malloc.c. */
+#define MAG_CLASS_CNT 7
+#define MAG_SIZE 8
+
+struct magazine
+  {
+    unsigned cnt;               /* Number of blocks held. */
+    void *blocks[MAG_SIZE];     /* Free blocks, last one on top. */
+  };
+
+/* Per-thread scratch arena for memory that a system call needs
+   only until it returns, of up to SCRATCH_PAGES pages, of which
+   SCRATCH_KEEP are kept between calls.  See malloc.c. */
+#define SCRATCH_PAGES 4
+#define SCRATCH_KEEP 1
+
+struct scratch
+  {
+    void *pages[SCRATCH_PAGES]; /* Pages obtained so far. */
+    size_t page_cnt;            /* Number of pages in PAGES. */
+    size_t cur;                 /* Page allocated from now. */
+    size_t used;                /* Bytes used in page CUR. */
+  };
+
 void malloc_init (void);
+void malloc_thread_exit (void);
+void malloc_print_stats (void);
 void *malloc (size_t) __attribute__ ((malloc));
 void *calloc (size_t, size_t) __attribute__ ((malloc));
 void *realloc (void *, size_t);
 void free (void *);
+void *scratch_alloc (size_t);
+void scratch_reset (void);
 
 #endif /* threads/malloc.h */
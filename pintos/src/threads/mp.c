@@ -0,0 +1,299 @@
+#include "threads/mp.h"
+#include <debug.h>
+#include <packed.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/vaddr.h"
+
+/* Multiprocessor bring-up.
+
+   Finds the processors listed in the BIOS's MP configuration
+   table (see [MP] chapter 4 "MP Configuration Table") and starts
+   each application processor through its local APIC.
+
+   Only the bootstrap processor runs threads.  The scheduler and
+   the synchronization primitives still assume that turning off
+   interrupts excludes all other code, so an application
+   processor that starts only records that it is running and
+   then halts with interrupts disabled. */
+
+/* Maximum number of processors that we keep track of. */
+#define CPU_MAX 16
+
+/* MP floating pointer structure. */
+struct mp_float
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t config;            /* Physical address of config table. */
+    uint8_t length;             /* Length in 16-byte units. */
+    uint8_t spec_rev;           /* MP specification revision. */
+    uint8_t checksum;           /* Makes all bytes sum to 0. */
+    uint8_t type;               /* Default configuration, or 0. */
+    uint8_t features[4];        /* Feature bytes 2 through 5. */
+  } PACKED;
+
+/* MP configuration table header. */
+struct mp_config
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Base table length in bytes. */
+    uint8_t spec_rev;           /* MP specification revision. */
+    uint8_t checksum;           /* Makes base table sum to 0. */
+    char oem_id[8];             /* OEM name. */
+    char product_id[12];        /* Product family name. */
+    uint32_t oem_table;         /* Physical address of OEM table. */
+    uint16_t oem_table_size;    /* Size of OEM table. */
+    uint16_t entry_cnt;         /* Number of entries after header. */
+    uint32_t lapic_addr;        /* Physical address of local APICs. */
+    uint16_t ext_length;        /* Extended table length. */
+    uint8_t ext_checksum;       /* Extended table checksum. */
+    uint8_t reserved;
+  } PACKED;
+
+/* MP configuration table processor entry. */
+struct mp_proc
+  {
+    uint8_t type;               /* MP_PROC. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint8_t apic_ver;           /* Local APIC version. */
+    uint8_t flags;              /* MP_PROC_* flags. */
+    uint32_t signature;         /* CPUID signature. */
+    uint32_t features;          /* CPUID feature flags. */
+    uint32_t reserved[2];
+  } PACKED;
+
+/* Configuration table entry types.  Processor entries are 20
+   bytes long, the rest 8 bytes. */
+#define MP_PROC 0
+
+/* struct mp_proc flags. */
+#define MP_PROC_ENABLED 0x01    /* Processor usable. */
+#define MP_PROC_BSP 0x02        /* Bootstrap processor. */
+
+/* A processor. */
+struct cpu
+  {
+    uint8_t apic_id;            /* Local APIC ID. */
+    bool bsp;                   /* Bootstrap processor? */
+    bool started;               /* Running? */
+  };
+
+static struct cpu cpus[CPU_MAX];
+static size_t cpu_cnt = 1;      /* Just the bootstrap processor. */
+static size_t started_cnt = 1;
+
+/* Set by an application processor once it has started. */
+static volatile bool ap_started;
+
+void ap_main (void) NO_RETURN;
+
+static struct mp_float *find_float (void);
+static struct mp_float *search_float (uintptr_t, size_t);
+static struct mp_config *find_config (void);
+static bool checksum_ok (const void *, size_t);
+static void start_aps (void);
+
+/* Looks for other processors and starts them.  Must be called
+   after timer_calibrate(), and before any process is created,
+   because the local APIC mapping is added to init_page_dir. */
+void
+mp_init (void)
+{
+  struct mp_config *conf = find_config ();
+  const uint8_t *p, *end;
+  size_t i;
+
+  if (conf == NULL)
+    return;
+
+  /* Record enabled processors. */
+  cpu_cnt = 0;
+  p = (const uint8_t *) (conf + 1);
+  end = (const uint8_t *) conf + conf->length;
+  for (i = 0; i < conf->entry_cnt && p < end; i++)
+    if (*p == MP_PROC)
+      {
+        const struct mp_proc *proc = (const struct mp_proc *) p;
+        if ((proc->flags & MP_PROC_ENABLED) && cpu_cnt < CPU_MAX)
+          {
+            struct cpu *cpu = &cpus[cpu_cnt++];
+            cpu->apic_id = proc->apic_id;
+            cpu->bsp = (proc->flags & MP_PROC_BSP) != 0;
+            cpu->started = cpu->bsp;
+          }
+        p += sizeof *proc;
+      }
+    else
+      p += 8;
+
+  if (cpu_cnt <= 1)
+    {
+      cpu_cnt = 1;
+      return;
+    }
+
+  lapic_init (conf->lapic_addr != 0 ? conf->lapic_addr : LAPIC_DEFAULT_PADDR);
+  start_aps ();
+  printf ("%zu of %zu CPUs started.\n", started_cnt, cpu_cnt);
+}
+
+/* Returns the number of processors found, which is at least 1. */
+size_t
+mp_cpu_cnt (void)
+{
+  return cpu_cnt;
+}
+
+/* Returns the number of processors running, counting the
+   bootstrap processor. */
+size_t
+mp_started_cnt (void)
+{
+  return started_cnt;
+}
+
+/* Starts each application processor in turn and waits up to a
+   second for it to report in. */
+static void
+start_aps (void)
+{
+  extern char mpentry_start[], mpentry_end[], mpentry_cr3[], mpentry_cr4[];
+  extern char mpentry_stack[];
+  uint8_t *code = ptov (MPENTRY_PHYS);
+  uint32_t *boot_pd;
+  uint32_t cr4;
+  size_t i;
+
+  /* The startup code turns on paging while it is still running at
+     MPENTRY_PHYS, so it needs a page directory that maps low
+     memory at virtual address 0 as well as at PHYS_BASE. */
+  boot_pd = palloc_get_page (PAL_ASSERT);
+  memcpy (boot_pd, init_page_dir, PGSIZE);
+  boot_pd[0] = init_page_dir[pd_no (PHYS_BASE)];
+
+  memcpy (code, mpentry_start, mpentry_end - mpentry_start);
+  *(uint32_t *) (code + (mpentry_cr3 - mpentry_start)) = vtop (boot_pd);
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  *(uint32_t *) (code + (mpentry_cr4 - mpentry_start)) = cr4;
+
+  for (i = 0; i < cpu_cnt; i++)
+    {
+      struct cpu *cpu = &cpus[i];
+      uint8_t *stack;
+      int ms;
+
+      if (cpu->bsp)
+        continue;
+      stack = palloc_get_page (PAL_ZERO);
+      if (stack == NULL)
+        break;
+      *(uint32_t *) (code + (mpentry_stack - mpentry_start))
+        = (uint32_t) (stack + PGSIZE);
+
+      ap_started = false;
+      lapic_start_ap (cpu->apic_id, MPENTRY_PHYS);
+      for (ms = 0; ms < 1000 && !ap_started; ms += 10)
+        timer_msleep (10);
+
+      if (ap_started)
+        {
+          cpu->started = true;
+          started_cnt++;
+        }
+      else
+        palloc_free_page (stack);
+    }
+
+  palloc_free_page (boot_pd);
+}
+
+/* Entry point of an application processor, called by mpentry.S
+   on a private one-page stack.  Interrupts are off. */
+void
+ap_main (void)
+{
+  /* Leave the startup page directory for the kernel's own. */
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)) : "memory");
+  intr_load_idt ();
+  lapic_enable ();
+
+  ap_started = true;
+  for (;;)
+    asm volatile ("cli; hlt" : : : "memory");
+}
+
+/* Looks for the MP configuration table.  Returns its kernel
+   virtual address, or a null pointer if there is none or if the
+   floating pointer names one of the default configurations,
+   which just describe a pair of processors we could not tell
+   apart. */
+static struct mp_config *
+find_config (void)
+{
+  struct mp_float *mpf = find_float ();
+  struct mp_config *conf;
+
+  if (mpf == NULL || mpf->config == 0 || mpf->type != 0
+      || mpf->config >= init_ram_pages * PGSIZE)
+    return NULL;
+
+  conf = ptov (mpf->config);
+  if (memcmp (conf->signature, "PCMP", 4)
+      || (conf->spec_rev != 1 && conf->spec_rev != 4)
+      || !checksum_ok (conf, conf->length))
+    return NULL;
+  return conf;
+}
+
+/* Searches SIZE bytes of physical memory starting at PADDR for
+   the MP floating pointer structure. */
+static struct mp_float *
+search_float (uintptr_t paddr, size_t size)
+{
+  uint8_t *p = ptov (paddr);
+  uint8_t *end = p + size;
+
+  for (; p + sizeof (struct mp_float) <= end; p += 16)
+    if (!memcmp (p, "_MP_", 4) && checksum_ok (p, sizeof (struct mp_float)))
+      return (struct mp_float *) p;
+  return NULL;
+}
+
+/* Looks for the MP floating pointer structure in the places that
+   [MP] section 4.1 allows: the first kB of the extended BIOS data
+   area, the last kB of base memory, and the BIOS ROM. */
+static struct mp_float *
+find_float (void)
+{
+  uint16_t ebda_seg = *(uint16_t *) ptov (0x40e);
+  uint16_t base_kb = *(uint16_t *) ptov (0x413);
+  struct mp_float *mpf = NULL;
+
+  if (ebda_seg != 0)
+    mpf = search_float ((uintptr_t) ebda_seg << 4, 1024);
+  if (mpf == NULL && base_kb != 0)
+    mpf = search_float ((uintptr_t) base_kb * 1024 - 1024, 1024);
+  if (mpf == NULL)
+    mpf = search_float (0xf0000, 0x10000);
+  return mpf;
+}
+
+/* Returns true if the SIZE bytes at P sum to 0 modulo 256. */
+static bool
+checksum_ok (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum == 0;
+}
@@ -0,0 +1,17 @@
+#ifndef THREADS_MP_H
+#define THREADS_MP_H
+
+/* Physical address to which the application processor startup
+   code in mpentry.S is copied.  Must be page-aligned and below
+   1 MB, because application processors start in real mode. */
+#define MPENTRY_PHYS 0x1000
+
+#ifndef __ASSEMBLER__
+#include <stddef.h>
+
+void mp_init (void);
+size_t mp_cpu_cnt (void);
+size_t mp_started_cnt (void);
+#endif
+
+#endif /* threads/mp.h */
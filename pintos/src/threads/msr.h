@@ -0,0 +1,33 @@
+#ifndef THREADS_MSR_H
+#define THREADS_MSR_H
+
+#include <stdint.h>
+
+/* Model-specific registers.  See [IA32-v3a] 5.8.7 "Performing
+   Fast Calls to System Procedures with the SYSENTER and SYSEXIT
+   Instructions". */
+#define MSR_SYSENTER_CS  0x174  /* Kernel code selector for SYSENTER. */
+#define MSR_SYSENTER_ESP 0x175  /* Kernel stack pointer for SYSENTER. */
+#define MSR_SYSENTER_EIP 0x176  /* Kernel entry point for SYSENTER. */
+
+/* Writes VALUE to model-specific register MSR. */
+static inline void
+wrmsr (uint32_t msr, uint64_t value)
+{
+  /* See [IA32-v2b] "WRMSR". */
+  asm volatile ("wrmsr"
+                : : "c" (msr), "a" ((uint32_t) value),
+                    "d" ((uint32_t) (value >> 32)));
+}
+
+/* Returns the value of model-specific register MSR. */
+static inline uint64_t
+rdmsr (uint32_t msr)
+{
+  /* See [IA32-v2b] "RDMSR". */
+  uint32_t lo, hi;
+  asm volatile ("rdmsr" : "=a" (lo), "=d" (hi) : "c" (msr));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+#endif /* threads/msr.h */
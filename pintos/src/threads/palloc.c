@@ -2,12 +2,15 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
+#include "threads/pte.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
 
@@ -23,25 +26,162 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+   The split can be changed when building, by defining
+   PALLOC_KERNEL_PERCENT, or when booting, with "-kp".
+
+   A few kernel pool pages are held in reserve for allocations
+   made with PAL_RESERVE, which are those that handling a page
+   fault or evicting a page needs, so that a kernel pool full of
+   other allocations does not also stop user memory from being
+   paged.
+
+   With "-hugepages", the user pool is placed so that its first
+   page lies on a 4 MB boundary, moving a few pages into the
+   kernel pool to get there, so that the buddy blocks of 1024
+   pages in it are aligned for mapping as 4 MB pages.
+
+   Within a pool, free pages are managed by a binary buddy
+   allocator.  Free memory is kept as blocks of 2**ORDER pages
+   aligned to their own size (counting from the pool's base), on
+   one free list per order.  A request is served from the
+   smallest block big enough, splitting larger blocks as needed,
+   and the pages beyond the request are freed again at once, so
+   that callers can allocate and free any number of pages.  A
+   freed block merges with its "buddy", the other half of the
+   block of the next order up, whenever that is free too.  Both
+   take time proportional to the number of orders.
+
+   Pages of the user pool that hold user frames can be moved.  A
+   request for several user pages that finds no free block big
+   enough calls the compaction function, if one has been set with
+   palloc_set_compactor(), and tries again.  The compaction
+   function, vm/frame.c's under VM, picks a block with
+   palloc_choose_run() and moves the frames in it elsewhere.
+
+   The bitmap of used pages is kept only to check that pages are
+   not freed twice.
+
+   The free lists are also touched by thread_schedule_tail(),
+   which frees a dying thread's page and cannot block, so each
+   pool is protected by a spin lock rather than by a struct
+   lock.
+
+   Each pool also keeps a few single pages that are already
+   zeroed, so that PAL_ZERO requests for one page need not clear
+   it on the spot.  The idle thread tops them up by calling
+   palloc_zero_idle(), and they go back to the free lists if the
+   pool otherwise runs dry.
+
+   For sizing the pools, each pool counts the pages handed out,
+   in total and by the code that asked for them, which is
+   identified by return address.  palloc_print_stats() prints
+   the counts; the "backtrace" tool turns the addresses into
+   function names. */
+
+/* Number of block orders.  Enough for blocks up to 2 GB. */
+#define ORDER_CNT 20
+
+/* Number of pre-zeroed pages the idle thread keeps in each pool. */
+#define ZEROED_PAGES 8
+
+/* Default share of free memory for the kernel pool, in percent,
+   and default number of kernel pool pages held in reserve. */
+#ifndef PALLOC_KERNEL_PERCENT
+#define PALLOC_KERNEL_PERCENT 50
+#endif
+#ifndef PALLOC_RESERVE_PAGES
+#define PALLOC_RESERVE_PAGES 16
+#endif
+
+/* -kp: Number of pages, or if zero percentage of free memory, to
+   put into the kernel pool. */
+size_t palloc_kernel_pages;
+unsigned palloc_kernel_percent = PALLOC_KERNEL_PERCENT;
+
+/* -kr: Number of kernel pool pages only PAL_RESERVE may take. */
+size_t palloc_reserve_pages = PALLOC_RESERVE_PAGES;
+
+/* -hugepages: Align the user pool for 4 MB pages? */
+bool palloc_large_pages;
+
+/* Number of callers whose allocations are counted separately in
+   each pool.  The last entry counts everyone else. */
+#define CALLER_CNT 16
+
+/* Page counts for one caller, or for one pool. */
+struct page_stats
+  {
+    void *caller;                       /* Return address of caller. */
+    unsigned long long alloc_cnt;       /* Number of allocations. */
+    unsigned long long free_cnt;        /* Number of frees. */
+    size_t live;                        /* Pages now allocated. */
+    size_t peak;                        /* Maximum of `live'. */
+  };
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
-    struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct spinlock lock;               /* Protects everything below. */
+    struct bitmap *used_map;            /* Bitmap of used pages. */
     uint8_t *base;                      /* Base of pool. */
+    size_t page_cnt;                    /* Number of pages in pool. */
+    size_t reserve_cnt;                 /* Pages kept for PAL_RESERVE. */
+    struct list free[ORDER_CNT];        /* Free blocks of each order. */
+
+    /* For each page that starts a free block, 1 + the block's
+       order; 0 for all other pages. */
+    uint8_t *free_order;
+
+    /* Allocated pages that are all zeros, except for the list
+       element at the start of each. */
+    struct list zeroed;
+    size_t zeroed_cnt;
+
+    /* Statistics.  For each allocated page, `tag' holds 1 + the
+       index in `callers' of the caller that allocated it. */
+    struct page_stats stats;
+    struct page_stats callers[CALLER_CNT];
+    uint8_t *tag;
+  };
+
+/* Free block, stored in its own first page. */
+struct free_block
+  {
+    struct list_elem elem;              /* Element in pool's free list. */
   };
 
 /* Two pools: one for kernel data, one for user pages. */
 static struct pool kernel_pool, user_pool;
 
+/* Function that moves user pages out of the way of a request for
+   several contiguous ones, or null. */
+static palloc_compact_func *compactor;
+
+static size_t pool_meta_pages (size_t page_cnt);
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static bool pool_has_room (const struct pool *, size_t page_cnt,
+                           enum palloc_flags);
+static int block_order (size_t page_cnt);
+static size_t buddy_alloc (struct pool *, size_t page_cnt);
+static void buddy_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void free_block (struct pool *, size_t page_idx, int order);
+static void *zeroed_get (struct pool *, enum palloc_flags);
+static bool zeroed_release (struct pool *);
+static bool zeroed_refill (struct pool *);
+static void *get_multiple (enum palloc_flags, size_t page_cnt, void *caller);
+static void count_alloc (struct pool *, size_t page_idx, size_t page_cnt,
+                         void *caller);
+static void count_free (struct pool *, size_t page_idx, size_t page_cnt);
+static void print_pool_stats (const char *name, const struct pool *);
 
-/* Initializes the page allocator.  At most USER_PAGE_LIMIT
-   pages are put into the user pool. */
+/* Initializes the page allocator.  The kernel pool gets
+   palloc_kernel_pages pages or, if that is zero,
+   palloc_kernel_percent percent of free memory, and the user
+   pool the rest, but at most USER_PAGE_LIMIT pages; anything
+   beyond that goes back to the kernel pool. */
 void
 palloc_init (size_t user_page_limit)
 {
@@ -49,16 +189,55 @@ palloc_init (size_t user_page_limit)
   uint8_t *free_start = ptov (1024 * 1024);
   uint8_t *free_end = ptov (init_ram_pages * PGSIZE);
   size_t free_pages = (free_end - free_start) / PGSIZE;
-  size_t user_pages = free_pages / 2;
+  size_t user_pages;
   size_t kernel_pages;
+
+  if (palloc_kernel_pages != 0)
+    user_pages = (palloc_kernel_pages < free_pages
+                  ? free_pages - palloc_kernel_pages : 0);
+  else if (palloc_kernel_percent < 100)
+    user_pages = free_pages * (100 - palloc_kernel_percent) / 100;
+  else
+    user_pages = 0;
   if (user_pages > user_page_limit)
     user_pages = user_page_limit;
   kernel_pages = free_pages - user_pages;
 
-  /* Give half of memory to kernel, half to user. */
+  /* Give the kernel pool enough more pages that the user pool's
+     first page, past its bookkeeping, starts a 4 MB page, if the
+     user pool keeps room for one. */
+  if (palloc_large_pages)
+    {
+      size_t large_cnt = PTSPAN / PGSIZE;
+      size_t k = kernel_pages, u = user_pages;
+
+      for (;;)
+        {
+          uintptr_t base = (vtop (free_start) + k * PGSIZE
+                            + pool_meta_pages (u) * PGSIZE);
+          size_t shift = (ROUND_UP (base, PTSPAN) - base) / PGSIZE;
+
+          if (shift == 0)
+            {
+              kernel_pages = k;
+              user_pages = u;
+              break;
+            }
+          if (u < shift + large_cnt)
+            break;
+          k += shift;
+          u -= shift;
+        }
+    }
+
   init_pool (&kernel_pool, free_start, kernel_pages, "kernel pool");
   init_pool (&user_pool, free_start + kernel_pages * PGSIZE,
              user_pages, "user pool");
+
+  /* Never hold back more than half of the kernel pool. */
+  kernel_pool.reserve_cnt = palloc_reserve_pages;
+  if (kernel_pool.reserve_cnt > kernel_pool.page_cnt / 2)
+    kernel_pool.reserve_cnt = kernel_pool.page_cnt / 2;
 }
 
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
@@ -66,20 +245,155 @@ palloc_init (size_t user_page_limit)
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
    then the pages are filled with zeros.  If too few pages are
    available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
+   FLAGS, in which case the kernel panics.  Only if PAL_RESERVE
+   is set may the pool's reserved pages be used.
+
+   A request for several user pages that the user pool cannot
+   serve because its free pages are scattered first lets the
+   compaction function, if any, gather them, so it may sleep. */
 void *
 palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
+{
+  void *caller = __builtin_return_address (0);
+  void *pages;
+
+  if (compactor == NULL || !(flags & PAL_USER) || page_cnt < 2)
+    return get_multiple (flags, page_cnt, caller);
+
+  pages = get_multiple (flags & ~PAL_ASSERT, page_cnt, caller);
+  if (pages == NULL && compactor (page_cnt))
+    pages = get_multiple (flags & ~PAL_ASSERT, page_cnt, caller);
+  if (pages == NULL && (flags & PAL_ASSERT))
+    PANIC ("palloc_get: out of pages");
+  return pages;
+}
+
+/* Sets FUNC as the function that palloc_get_multiple() calls to
+   make room for a run of user pages.  FUNC may sleep, and
+   returns true if it may have made room. */
+void
+palloc_set_compactor (palloc_compact_func *func)
+{
+  compactor = func;
+}
+
+/* Returns the number of pages in the user pool. */
+size_t
+palloc_user_page_cnt (void)
+{
+  return user_pool.page_cnt;
+}
+
+/* Returns the index within the user pool of PAGE, which must come
+   from it. */
+size_t
+palloc_user_page_idx (const void *page)
+{
+  ASSERT (page_from_pool (&user_pool, (void *) page));
+  return pg_no (page) - pg_no (user_pool.base);
+}
+
+/* Chooses the block of the user pool that would be quickest to
+   free for a request for PAGE_CNT contiguous pages: of the
+   aligned blocks of the size that buddy allocation takes for such
+   a request, the one with the fewest pages in use, among those
+   whose pages in use are all marked in MOVABLE, which is indexed
+   like palloc_user_page_idx().  Returns the block's first page
+   and stores its size in pages in *BLOCK_CNT, or returns a null
+   pointer if every block has a page that cannot be moved. */
+void *
+palloc_choose_run (size_t page_cnt, const struct bitmap *movable,
+                   size_t *block_cnt)
+{
+  struct pool *pool = &user_pool;
+  size_t span = (size_t) 1 << block_order (page_cnt);
+  size_t best = BITMAP_ERROR, best_used = SIZE_MAX;
+  enum intr_level old_level;
+  size_t start, i;
+
+  ASSERT (bitmap_size (movable) == pool->page_cnt);
+
+  old_level = spin_lock_irqsave (&pool->lock);
+  zeroed_release (pool);
+  for (start = 0; start + span <= pool->page_cnt; start += span)
+    {
+      size_t used = 0;
+
+      for (i = start; i < start + span; i++)
+        if (bitmap_test (pool->used_map, i))
+          {
+            if (!bitmap_test (movable, i))
+              break;
+            used++;
+          }
+      if (i == start + span && used < best_used)
+        {
+          best = start;
+          best_used = used;
+        }
+    }
+  spin_unlock_irqrestore (&pool->lock, old_level);
+
+  if (best == BITMAP_ERROR)
+    return NULL;
+  *block_cnt = span;
+  return pool->base + best * PGSIZE;
+}
+
+/* Obtains a single free page and returns its kernel virtual
+   address.
+   If PAL_USER is set, the page is obtained from the user pool,
+   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
+   then the page is filled with zeros.  If no pages are
+   available, returns a null pointer, unless PAL_ASSERT is set in
+   FLAGS, in which case the kernel panics. */
+void *
+palloc_get_page (enum palloc_flags flags) 
+{
+  return get_multiple (flags, 1, __builtin_return_address (0));
+}
+
+/* Does the work of palloc_get_multiple(), counting the pages as
+   allocated by CALLER. */
+static void *
+get_multiple (enum palloc_flags flags, size_t page_cnt, void *caller)
 {
   struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+  enum intr_level old_level;
   void *pages;
   size_t page_idx;
 
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  if (page_cnt == 1 && (flags & PAL_ZERO))
+    {
+      pages = zeroed_get (pool, flags);
+      if (pages != NULL)
+        {
+          old_level = spin_lock_irqsave (&pool->lock);
+          count_alloc (pool, pg_no (pages) - pg_no (pool->base), 1, caller);
+          spin_unlock_irqrestore (&pool->lock, old_level);
+          return pages;
+        }
+    }
+
+  old_level = spin_lock_irqsave (&pool->lock);
+  if (!pool_has_room (pool, page_cnt, flags))
+    page_idx = BITMAP_ERROR;
+  else
+    {
+      page_idx = buddy_alloc (pool, page_cnt);
+      if (page_idx == BITMAP_ERROR && zeroed_release (pool))
+        page_idx = buddy_alloc (pool, page_cnt);
+    }
+  if (page_idx != BITMAP_ERROR)
+    {
+      ASSERT (bitmap_none (pool->used_map, page_idx, page_cnt));
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+      count_alloc (pool, page_idx, page_cnt, caller);
+    }
+  spin_unlock_irqrestore (&pool->lock, old_level);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -100,24 +414,12 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   return pages;
 }
 
-/* Obtains a single free page and returns its kernel virtual
-   address.
-   If PAL_USER is set, the page is obtained from the user pool,
-   otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
-   then the page is filled with zeros.  If no pages are
-   available, returns a null pointer, unless PAL_ASSERT is set in
-   FLAGS, in which case the kernel panics. */
-void *
-palloc_get_page (enum palloc_flags flags) 
-{
-  return palloc_get_multiple (flags, 1);
-}
-
 /* Frees the PAGE_CNT pages starting at PAGES. */
 void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -137,8 +439,12 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = spin_lock_irqsave (&pool->lock);
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  count_free (pool, page_idx, page_cnt);
+  buddy_free (pool, page_idx, page_cnt);
+  spin_unlock_irqrestore (&pool->lock, old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -148,25 +454,69 @@ palloc_free_page (void *page)
   palloc_free_multiple (page, 1);
 }
 
+/* Zeroes one more free page for a pool short of pre-zeroed
+   pages, with interrupts on.  Returns true if it did, false if
+   there was nothing to do.  Called by the idle thread. */
+bool
+palloc_zero_idle (void) 
+{
+  return zeroed_refill (&kernel_pool) || zeroed_refill (&user_pool);
+}
+
+/* Prints page allocation statistics. */
+void
+palloc_print_stats (void) 
+{
+  print_pool_stats ("kernel pool", &kernel_pool);
+  print_pool_stats ("user pool", &user_pool);
+}
+
+/* Returns the number of pages at the base of a pool of PAGE_CNT
+   pages that init_pool() takes for the pool's bookkeeping. */
+static size_t
+pool_meta_pages (size_t page_cnt)
+{
+  return DIV_ROUND_UP (bitmap_buf_size (page_cnt) + 2 * page_cnt, PGSIZE);
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map and its free_order and tag
+     arrays at its base.  Calculate the space needed for them and
+     subtract it from the pool's size. */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = pool_meta_pages (page_cnt);
+  enum intr_level old_level;
+  int order;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
 
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
-  /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  /* Initialize the pool, with every page free. */
+  spin_init (&p->lock);
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->free_order = (uint8_t *) base + bm_size;
+  memset (p->free_order, 0, page_cnt);
+  p->tag = p->free_order + page_cnt;
+  memset (p->tag, 0, page_cnt);
+  memset (&p->stats, 0, sizeof p->stats);
+  p->reserve_cnt = 0;
+  memset (p->callers, 0, sizeof p->callers);
   p->base = base + bm_pages * PGSIZE;
+  p->page_cnt = page_cnt;
+  for (order = 0; order < ORDER_CNT; order++)
+    list_init (&p->free[order]);
+  list_init (&p->zeroed);
+  p->zeroed_cnt = 0;
+  old_level = spin_lock_irqsave (&p->lock);
+  buddy_free (p, 0, page_cnt);
+  spin_unlock_irqrestore (&p->lock, old_level);
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +526,278 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool->page_cnt;
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns true if PAGE_CNT more pages may be allocated from POOL
+   with FLAGS without eating into its reserve, or if FLAGS
+   include PAL_RESERVE.  POOL's lock must be held. */
+static bool
+pool_has_room (const struct pool *pool, size_t page_cnt,
+               enum palloc_flags flags)
+{
+  ASSERT (spin_held_by_current_thread (&pool->lock));
+
+  return ((flags & PAL_RESERVE)
+          || pool->stats.live + page_cnt + pool->reserve_cnt
+             <= pool->page_cnt);
+}
+
+/* Returns the free block starting at page PAGE_IDX of POOL. */
+static struct free_block *
+idx_to_block (struct pool *pool, size_t page_idx)
+{
+  return (struct free_block *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the smallest block order that holds PAGE_CNT pages, or
+   ORDER_CNT if none does. */
+static int
+block_order (size_t page_cnt)
+{
+  int order;
+
+  for (order = 0; order < ORDER_CNT && ((size_t) 1 << order) < page_cnt;
+       order++)
+    continue;
+  return order;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if no free block is big
+   enough.  POOL's lock must be held. */
+static size_t
+buddy_alloc (struct pool *pool, size_t page_cnt)
+{
+  struct free_block *b;
+  size_t page_idx;
+  int order, want;
+
+  ASSERT (spin_held_by_current_thread (&pool->lock));
+
+  /* Find the smallest order that holds PAGE_CNT pages, then the
+     smallest free block at least that big. */
+  want = block_order (page_cnt);
+  for (order = want; order < ORDER_CNT; order++)
+    if (!list_empty (&pool->free[order]))
+      break;
+  if (order >= ORDER_CNT)
+    return BITMAP_ERROR;
+
+  b = list_entry (list_pop_front (&pool->free[order]),
+                  struct free_block, elem);
+  page_idx = ((uint8_t *) b - pool->base) / PGSIZE;
+  pool->free_order[page_idx] = 0;
+
+  /* Split off the upper halves we do not need. */
+  while (order > want)
+    {
+      order--;
+      free_block (pool, page_idx + ((size_t) 1 << order), order);
+    }
+
+  /* Give back the pages of the block beyond PAGE_CNT. */
+  buddy_free (pool, page_idx + page_cnt, ((size_t) 1 << want) - page_cnt);
+  return page_idx;
+}
+
+/* Frees the PAGE_CNT pages of POOL starting at PAGE_IDX, as the
+   largest aligned blocks that make up the range.  POOL's lock
+   must be held. */
+static void
+buddy_free (struct pool *pool, size_t page_idx, size_t page_cnt)
+{
+  ASSERT (spin_held_by_current_thread (&pool->lock));
+
+  while (page_cnt > 0)
+    {
+      int order = 0;
+
+      while (order + 1 < ORDER_CNT
+             && page_idx % ((size_t) 1 << (order + 1)) == 0
+             && ((size_t) 1 << (order + 1)) <= page_cnt)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += (size_t) 1 << order;
+      page_cnt -= (size_t) 1 << order;
+    }
+}
+
+/* Frees the block of 2**ORDER pages of POOL starting at PAGE_IDX,
+   merging it with its buddy as long as the buddy is free. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order)
+{
+  while (order + 1 < ORDER_CNT)
+    {
+      size_t buddy = page_idx ^ ((size_t) 1 << order);
+
+      if (buddy >= pool->page_cnt || pool->free_order[buddy] != order + 1)
+        break;
+      list_remove (&idx_to_block (pool, buddy)->elem);
+      pool->free_order[buddy] = 0;
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+
+  list_push_front (&pool->free[order], &idx_to_block (pool, page_idx)->elem);
+  pool->free_order[page_idx] = order + 1;
+}
+
+/* Removes and returns one of POOL's pre-zeroed pages, or a null
+   pointer if it has none or if FLAGS do not allow taking one. */
+static void *
+zeroed_get (struct pool *pool, enum palloc_flags flags) 
+{
+  struct list_elem *e = NULL;
+  enum intr_level old_level;
+
+  old_level = spin_lock_irqsave (&pool->lock);
+  if (!list_empty (&pool->zeroed) && pool_has_room (pool, 1, flags))
+    {
+      e = list_pop_front (&pool->zeroed);
+      pool->zeroed_cnt--;
+    }
+  spin_unlock_irqrestore (&pool->lock, old_level);
+
+  if (e != NULL)
+    memset (e, 0, sizeof *e);
+  return e;
+}
+
+/* Returns all of POOL's pre-zeroed pages to its free lists.
+   Returns true if there were any.  POOL's lock must be held. */
+static bool
+zeroed_release (struct pool *pool) 
+{
+  bool released = !list_empty (&pool->zeroed);
+
+  ASSERT (spin_held_by_current_thread (&pool->lock));
+
+  while (!list_empty (&pool->zeroed))
+    {
+      uint8_t *page = (uint8_t *) list_pop_front (&pool->zeroed);
+      size_t page_idx = (page - pool->base) / PGSIZE;
+
+      bitmap_reset (pool->used_map, page_idx);
+      buddy_free (pool, page_idx, 1);
+    }
+  pool->zeroed_cnt = 0;
+  return released;
+}
+
+/* If POOL has fewer than ZEROED_PAGES pre-zeroed pages, zeroes
+   one more and returns true.  Returns false if POOL is full
+   enough or out of free pages. */
+static bool
+zeroed_refill (struct pool *pool) 
+{
+  enum intr_level old_level;
+  size_t page_idx = BITMAP_ERROR;
+  uint8_t *page;
+
+  old_level = spin_lock_irqsave (&pool->lock);
+  if (pool->zeroed_cnt < ZEROED_PAGES)
+    page_idx = buddy_alloc (pool, 1);
+  if (page_idx != BITMAP_ERROR)
+    bitmap_mark (pool->used_map, page_idx);
+  spin_unlock_irqrestore (&pool->lock, old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  /* Clear the page with interrupts on, so that a thread that
+     becomes ready can preempt us. */
+  page = pool->base + PGSIZE * page_idx;
+  memset (page, 0, PGSIZE);
+
+  old_level = spin_lock_irqsave (&pool->lock);
+  list_push_back (&pool->zeroed, (struct list_elem *) page);
+  pool->zeroed_cnt++;
+  spin_unlock_irqrestore (&pool->lock, old_level);
+  return true;
+}
+
+/* Adds one allocation of PAGES pages to S. */
+static void
+stats_add (struct page_stats *s, size_t pages) 
+{
+  s->alloc_cnt++;
+  s->live += pages;
+  if (s->live > s->peak)
+    s->peak = s->live;
+}
+
+/* Counts the PAGE_CNT pages of POOL starting at PAGE_IDX as
+   allocated by CALLER.  POOL's lock must be held. */
+static void
+count_alloc (struct pool *pool, size_t page_idx, size_t page_cnt,
+             void *caller) 
+{
+  size_t i;
+
+  ASSERT (spin_held_by_current_thread (&pool->lock));
+
+  /* Find CALLER's entry, or claim a free one, or settle for the
+     last. */
+  for (i = 0; i < CALLER_CNT - 1; i++)
+    if (pool->callers[i].caller == caller || pool->callers[i].caller == NULL)
+      break;
+  if (pool->callers[i].caller == NULL && i < CALLER_CNT - 1)
+    pool->callers[i].caller = caller;
+
+  stats_add (&pool->stats, page_cnt);
+  stats_add (&pool->callers[i], page_cnt);
+  memset (pool->tag + page_idx, i + 1, page_cnt);
+}
+
+/* Counts the PAGE_CNT pages of POOL starting at PAGE_IDX as freed,
+   each against the caller that allocated it.  POOL's lock must
+   be held. */
+static void
+count_free (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  size_t i;
+
+  ASSERT (spin_held_by_current_thread (&pool->lock));
+
+  pool->stats.free_cnt++;
+  pool->stats.live -= page_cnt;
+  for (i = page_idx; i < page_idx + page_cnt; i++)
+    {
+      struct page_stats *s = &pool->callers[pool->tag[i] - 1];
+
+      ASSERT (pool->tag[i] != 0);
+      if (i == page_idx || pool->tag[i] != pool->tag[i - 1])
+        s->free_cnt++;
+      s->live--;
+      pool->tag[i] = 0;
+    }
+}
+
+/* Prints the statistics of POOL, called NAME. */
+static void
+print_pool_stats (const char *name, const struct pool *pool) 
+{
+  const struct page_stats *s = &pool->stats;
+  size_t i;
+
+  printf ("Palloc: %s: %zu of %zu pages used (max %zu), %zu pre-zeroed, "
+          "%zu reserved, %llu allocs, %llu frees\n",
+          name, s->live, pool->page_cnt, s->peak, pool->zeroed_cnt,
+          pool->reserve_cnt, s->alloc_cnt, s->free_cnt);
+  for (i = 0; i < CALLER_CNT; i++)
+    {
+      s = &pool->callers[i];
+      if (s->alloc_cnt == 0)
+        continue;
+      if (i < CALLER_CNT - 1)
+        printf ("Palloc:   %p:", s->caller);
+      else
+        printf ("Palloc:   others:");
+      printf (" %zu pages used (max %zu), %llu allocs, %llu frees\n",
+              s->live, s->peak, s->alloc_cnt, s->free_cnt);
+    }
+}
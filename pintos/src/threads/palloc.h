@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -8,13 +9,33 @@ enum palloc_flags
   {
     PAL_ASSERT = 001,           /* Panic on failure. */
     PAL_ZERO = 002,             /* Zero page contents. */
-    PAL_USER = 004              /* User page. */
+    PAL_USER = 004,             /* User page. */
+    PAL_RESERVE = 010           /* May use the reserved pages. */
   };
 
+struct bitmap;
+
+/* Moves user pages out of the way of a request for PAGE_CNT
+   contiguous ones.  Returns true if it may have made room. */
+typedef bool palloc_compact_func (size_t page_cnt);
+
+/* Pool sizing, set from the kernel command line. */
+extern size_t palloc_kernel_pages;
+extern unsigned palloc_kernel_percent;
+extern size_t palloc_reserve_pages;
+extern bool palloc_large_pages;
+
 void palloc_init (size_t user_page_limit);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_zero_idle (void);
+void palloc_set_compactor (palloc_compact_func *);
+size_t palloc_user_page_cnt (void);
+size_t palloc_user_page_idx (const void *);
+void *palloc_choose_run (size_t page_cnt, const struct bitmap *movable,
+                         size_t *block_cnt);
+void palloc_print_stats (void);
 
 #endif /* threads/palloc.h */
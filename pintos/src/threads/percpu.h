@@ -0,0 +1,67 @@
+#ifndef THREADS_PERCPU_H
+#define THREADS_PERCPU_H
+
+#include <atomic.h>
+#include <stddef.h>
+#include "threads/thread.h"
+
+/* Per-CPU variables.
+
+   A per-CPU variable has a copy for each CPU that may schedule
+   threads, each in a cache line of its own, so that CPUs that
+   update only their own copies never contend for a lock or a
+   cache line.  Declare one with PER_CPU, for example
+       static PER_CPU (long long, hit_cnt);
+   update the running CPU's copy with this_cpu_add(), and read
+   the total with per_cpu_sum().
+
+   Only a CPU's own code changes its copy, so an update needs no
+   atomic instruction, but it must not be interrupted by another
+   update of the same copy or move to another CPU halfway: update
+   from an interrupt handler or with interrupts off.  Sums read
+   each copy with atomic64_load(), so that 8-byte counters are
+   never seen half updated. */
+
+/* Size of a CPU cache line, in bytes. */
+#define CACHE_LINE_SIZE 64
+
+/* Declares per-CPU variable NAME of type TYPE. */
+#define PER_CPU(TYPE, NAME)                                     \
+        struct { TYPE value; }                                  \
+        __attribute__ ((aligned (CACHE_LINE_SIZE)))             \
+        NAME[THREAD_CPU_MAX]
+
+/* Returns the number of the CPU running the caller. */
+static inline size_t
+cpu_id (void)
+{
+  return running_thread ()->cpu;
+}
+
+/* Returns a pointer to CPU's copy of NAME. */
+#define per_cpu_ptr(NAME, CPU) (&(NAME)[CPU].value)
+
+/* Returns a pointer to the running CPU's copy of NAME. */
+#define this_cpu_ptr(NAME) per_cpu_ptr (NAME, cpu_id ())
+
+/* Adds V to the running CPU's copy of NAME.  Interrupts must be
+   off. */
+#define this_cpu_add(NAME, V) (*this_cpu_ptr (NAME) += (V))
+#define this_cpu_inc(NAME) this_cpu_add (NAME, 1)
+
+/* Iterates CPU over the CPUs that schedule threads. */
+#define for_each_cpu(CPU) \
+        for ((CPU) = 0; (CPU) < thread_cpu_cnt (); (CPU)++)
+
+/* Stores in SUM the total of every CPU's copy of NAME. */
+#define per_cpu_sum(NAME, SUM)                                  \
+        do                                                      \
+          {                                                     \
+            size_t cpu_;                                        \
+            (SUM) = 0;                                          \
+            for_each_cpu (cpu_)                                 \
+              (SUM) += atomic64_load (per_cpu_ptr (NAME, cpu_)); \
+          }                                                     \
+        while (0)
+
+#endif /* threads/percpu.h */
@@ -0,0 +1,176 @@
+#include "threads/profile.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Sampling profiler.
+
+   On every timer tick, the timer interrupt handler calls
+   profile_sample(), which records where the interrupted code
+   was: its eip and, for kernel code, up to PROFILE_DEPTH - 1
+   return addresses found by following the chain of saved frame
+   pointers.  Identical call stacks share one entry in a hash
+   table that counts how often each was seen.  At power-off,
+   profile_print_stats() prints the stacks, most frequent first,
+   one per line, in the form that utils/backtrace reads:
+
+        Profile: 57 samples: 0xc0102abc 0xc0101def ...
+
+   User code is sampled by eip alone, because following a user
+   stack from an interrupt handler could fault.  Samples are
+   taken at the timer frequency, which the "-hz" option raises.
+
+   The table is only touched by the timer interrupt handler, with
+   interrupts off, so it needs no lock. */
+
+#define PROFILE_DEPTH 8         /* Most addresses in a stack. */
+#define PROFILE_SLOTS 1024      /* Table size, a power of 2. */
+
+/* A call stack and the number of times it was sampled. */
+struct profile_entry
+  {
+    unsigned cnt;               /* Number of samples; 0 if free. */
+    unsigned depth;             /* Number of addresses in PCS. */
+    uintptr_t pcs[PROFILE_DEPTH]; /* Innermost first. */
+  };
+
+/* Set by kernel command-line option "-profile". */
+bool profile_enabled;
+
+static struct profile_entry *table;
+#define TABLE_PAGES DIV_ROUND_UP (PROFILE_SLOTS * sizeof *table, PGSIZE)
+
+/* Statistics. */
+static long long sample_cnt;    /* Samples taken. */
+static long long dropped_cnt;   /* Samples that did not fit in TABLE. */
+static size_t stack_cnt;        /* Entries in use in TABLE. */
+
+static unsigned hash_stack (const uintptr_t *, unsigned depth);
+static int compare_entries (const void *, const void *);
+
+/* Allocates the profile table, if profiling is enabled.  No
+   samples are taken before this is called. */
+void
+profile_init (void)
+{
+  if (!profile_enabled)
+    return;
+
+  table = palloc_get_multiple (PAL_ZERO, TABLE_PAGES);
+  if (table == NULL)
+    {
+      printf ("profile: out of memory, profiling disabled\n");
+      profile_enabled = false;
+    }
+}
+
+/* Records the code interrupted by timer interrupt frame F as one
+   sample.  Runs in the timer interrupt handler. */
+void
+profile_sample (const struct intr_frame *f)
+{
+  uintptr_t pcs[PROFILE_DEPTH];
+  unsigned depth = 0;
+  unsigned slot, i;
+
+  ASSERT (intr_context ());
+
+  if (table == NULL)
+    return;
+  sample_cnt++;
+
+  pcs[depth++] = (uintptr_t) f->eip;
+  if ((f->cs & 3) == 0)
+    {
+      /* Follow saved frame pointers as long as they stay on the
+         kernel stack we are running on and lead outward. */
+      uintptr_t stack = (uintptr_t) pg_round_down (f);
+      uintptr_t *frame = (uintptr_t *) f->ebp;
+
+      while (depth < PROFILE_DEPTH
+             && (uintptr_t) frame > (uintptr_t) f
+             && (uintptr_t) frame < stack + PGSIZE - 2 * sizeof *frame
+             && frame[1] != 0)
+        {
+          pcs[depth++] = frame[1];
+          if (frame[0] <= (uintptr_t) frame)
+            break;
+          frame = (uintptr_t *) frame[0];
+        }
+    }
+
+  /* Count it in the entry for this stack, or a free one. */
+  slot = hash_stack (pcs, depth);
+  for (i = 0; i < PROFILE_SLOTS; i++)
+    {
+      struct profile_entry *e = &table[(slot + i) % PROFILE_SLOTS];
+      if (e->cnt == 0)
+        {
+          e->depth = depth;
+          memcpy (e->pcs, pcs, depth * sizeof *pcs);
+          stack_cnt++;
+        }
+      else if (e->depth != depth
+               || memcmp (e->pcs, pcs, depth * sizeof *pcs))
+        continue;
+      e->cnt++;
+      return;
+    }
+  dropped_cnt++;
+}
+
+/* Prints the sampled call stacks, most frequent first. */
+void
+profile_print_stats (void)
+{
+  struct profile_entry *entries = table;
+  size_t i, j;
+
+  if (entries == NULL)
+    return;
+
+  /* Stop sampling, since sorting scrambles the hash table. */
+  table = NULL;
+
+  printf ("Profile: %lld samples, %zu call stacks, %lld dropped\n",
+          sample_cnt, stack_cnt, dropped_cnt);
+  qsort (entries, PROFILE_SLOTS, sizeof *entries, compare_entries);
+  for (i = 0; i < stack_cnt; i++)
+    {
+      printf ("Profile: %u samples:", entries[i].cnt);
+      for (j = 0; j < entries[i].depth; j++)
+        printf (" %#"PRIxPTR, entries[i].pcs[j]);
+      printf ("\n");
+    }
+  palloc_free_multiple (entries, TABLE_PAGES);
+}
+
+/* Returns a hash of the DEPTH addresses in PCS. */
+static unsigned
+hash_stack (const uintptr_t *pcs, unsigned depth)
+{
+  unsigned hash = depth;
+  unsigned i;
+
+  for (i = 0; i < depth; i++)
+    hash = hash * 31 + (pcs[i] >> 2);
+  return hash;
+}
+
+/* qsort() comparison function that puts entries with more
+   samples first. */
+static int
+compare_entries (const void *a_, const void *b_)
+{
+  const struct profile_entry *a = a_;
+  const struct profile_entry *b = b_;
+
+  return a->cnt < b->cnt ? 1 : a->cnt > b->cnt ? -1 : 0;
+}
@@ -0,0 +1,149 @@
+#include "threads/rcu.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+
+/* Grace periods.
+
+   A reader is never preempted and never sleeps, so a CPU that
+   switches threads, or whose timer interrupt finds it outside
+   any read-side critical section, or that is idle, has finished
+   every reader it was running.  thread.c counts these quiescent
+   states for each CPU, and a grace period has passed once every
+   CPU other than the caller's has gone through one or is
+   idle.  The caller's own CPU is
+   not running a reader while the caller runs outside one, so on
+   a single processor a grace period needs no waiting at all.
+
+   Callbacks given to call_rcu() are gathered into a batch that
+   a worker runs after waiting out a grace period of its own.
+   Callbacks that arrive meanwhile wait for the next batch. */
+
+/* Callbacks waiting for the next batch, protected by
+   CALLBACKS_LOCK. */
+static struct list callbacks;
+static struct spinlock callbacks_lock;
+
+/* Runs a batch of callbacks. */
+static struct work rcu_work;
+static work_func run_callbacks;
+
+/* Initializes RCU. */
+void
+rcu_init (void)
+{
+  list_init (&callbacks);
+  spin_init (&callbacks_lock);
+  work_init (&rcu_work, WORK_NORMAL);
+}
+
+/* Begins a read-side critical section.  Sections nest. */
+void
+rcu_read_lock (void)
+{
+  ASSERT (!intr_context ());
+  thread_current ()->rcu_depth++;
+  barrier ();
+}
+
+/* Ends a read-side critical section.  Yields the CPU if the
+   thread was due to be preempted while in it. */
+void
+rcu_read_unlock (void)
+{
+  struct thread *cur = thread_current ();
+
+  ASSERT (cur->rcu_depth > 0);
+  barrier ();
+  if (--cur->rcu_depth == 0 && cur->rcu_yield)
+    {
+      cur->rcu_yield = false;
+      thread_yield ();
+    }
+}
+
+/* Returns true if the running thread is in a read-side critical
+   section. */
+bool
+rcu_read_lock_held (void)
+{
+  return thread_current ()->rcu_depth > 0;
+}
+
+/* Returns true if the running thread may be preempted now.  If
+   it is in a read-side critical section, returns false and
+   arranges for it to yield when the section ends instead. */
+bool
+rcu_may_yield (void)
+{
+  struct thread *cur = thread_current ();
+
+  if (cur->rcu_depth == 0)
+    return true;
+  cur->rcu_yield = true;
+  return false;
+}
+
+/* Waits until every read-side critical section that was running
+   when it was called has ended.  Must not be called from inside
+   one. */
+void
+synchronize_rcu (void)
+{
+  unsigned seen[THREAD_CPU_MAX];
+  size_t self = thread_current ()->cpu;
+  size_t cpu_cnt = thread_cpu_cnt ();
+  size_t cpu;
+
+  ASSERT (!intr_context ());
+  ASSERT (!rcu_read_lock_held ());
+
+  /* Make earlier unlinks visible before sampling. */
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  for (cpu = 0; cpu < cpu_cnt; cpu++)
+    seen[cpu] = thread_cpu_quiescent_cnt (cpu);
+  for (cpu = 0; cpu < cpu_cnt; cpu++)
+    while (cpu != self && !thread_cpu_idle (cpu)
+           && thread_cpu_quiescent_cnt (cpu) == seen[cpu])
+      timer_sleep (1);
+}
+
+/* Arranges for FUNC to be called with HEAD, in a worker thread,
+   after a grace period. */
+void
+call_rcu (struct rcu_head *head, rcu_func *func)
+{
+  enum intr_level old_level;
+
+  head->func = func;
+  old_level = spin_lock_irqsave (&callbacks_lock);
+  list_push_back (&callbacks, &head->elem);
+  spin_unlock_irqrestore (&callbacks_lock, old_level);
+  work_queue (&rcu_work, run_callbacks, NULL);
+}
+
+/* Takes the waiting callbacks, waits out a grace period, and
+   calls them. */
+static void
+run_callbacks (struct work *w UNUSED, void *aux UNUSED)
+{
+  struct list batch;
+  enum intr_level old_level;
+
+  list_init (&batch);
+  old_level = spin_lock_irqsave (&callbacks_lock);
+  while (!list_empty (&callbacks))
+    list_push_back (&batch, list_pop_front (&callbacks));
+  spin_unlock_irqrestore (&callbacks_lock, old_level);
+
+  synchronize_rcu ();
+  while (!list_empty (&batch))
+    {
+      struct rcu_head *head = list_entry (list_pop_front (&batch),
+                                          struct rcu_head, elem);
+      head->func (head);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef THREADS_RCU_H
+#define THREADS_RCU_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Read-copy update, for tables that are read far more often than
+   they change.
+
+   A reader brackets its lookup with rcu_read_lock() and
+   rcu_read_unlock() and takes no other lock.  The thread is not
+   preempted in between, and it must not sleep.  A writer, which
+   still serializes against other writers with a lock of its own,
+   publishes a new object with rcu_assign_pointer() once the
+   object is fully initialized, and readers fetch pointers with
+   rcu_dereference().  An object that a writer unlinks may still
+   be in use by readers that found it earlier, so it is freed
+   only after a grace period, by which time every reader that
+   was running has finished: synchronize_rcu() waits for one,
+   and call_rcu() frees the object after one in the background. */
+
+struct rcu_head;
+
+/* Function called by call_rcu() after a grace period. */
+typedef void rcu_func (struct rcu_head *);
+
+/* Embedded in an object to be freed with call_rcu(). */
+struct rcu_head
+  {
+    struct list_elem elem;      /* Element in a callback batch. */
+    rcu_func *func;             /* Function to call. */
+  };
+
+/* Converts pointer to rcu_head RCU_HEAD into a pointer to the
+   structure that it is embedded inside, as list_entry() does. */
+#define rcu_entry(RCU_HEAD, STRUCT, MEMBER)             \
+        ((STRUCT *) ((uint8_t *) &(RCU_HEAD)->func      \
+                     - offsetof (STRUCT, MEMBER.func)))
+
+/* Stores pointer V in P, ordered after the stores that
+   initialized the object it points to. */
+#define rcu_assign_pointer(P, V) \
+        __atomic_store_n (&(P), (V), __ATOMIC_RELEASE)
+
+/* Loads and returns the pointer in P, for use in a read-side
+   critical section. */
+#define rcu_dereference(P) __atomic_load_n (&(P), __ATOMIC_ACQUIRE)
+
+void rcu_init (void);
+void rcu_read_lock (void);
+void rcu_read_unlock (void);
+bool rcu_read_lock_held (void);
+bool rcu_may_yield (void);
+void synchronize_rcu (void);
+void call_rcu (struct rcu_head *, rcu_func *);
+
+#endif /* threads/rcu.h */
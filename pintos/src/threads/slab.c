@@ -0,0 +1,252 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* A slab allocator.
+
+   malloc() rounds every request up to a power of 2, so an object
+   just over a power of 2 in size wastes nearly half its block.
+   A cache instead hands out objects of one exact size, packed
+   into pages called "slabs" obtained from the page allocator.
+   Each slab starts with a header, followed by as many objects as
+   fit.  A slab's free objects are chained through their first
+   bytes.
+
+   A cache keeps its slabs that have free objects on a list, so
+   allocation takes an object from the first such slab, creating
+   a new slab only when none has room.  When freeing empties a
+   slab, its page goes back to the page allocator.
+
+   Objects larger than a slab can hold even once are not
+   supported; use malloc() for those. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* A cache of objects of one size. */
+struct kmem_cache
+  {
+    const char *name;           /* For statistics. */
+    size_t obj_size;            /* Object size, rounded for alignment. */
+    size_t objs_per_slab;       /* Number of objects in a slab. */
+    kmem_ctor_func *ctor;       /* Initializes allocated objects. */
+    enum palloc_flags pal_flags; /* Flags for getting slab pages. */
+    struct list partial;        /* Slabs with free objects. */
+    struct lock lock;           /* Protects slabs and statistics. */
+    struct list_elem elem;      /* Element in all_caches. */
+
+    /* Statistics. */
+    unsigned long long alloc_cnt; /* Objects allocated so far. */
+    size_t live_cnt;            /* Objects allocated, not freed. */
+    size_t slab_cnt;            /* Slabs now held. */
+    size_t max_slab_cnt;        /* Most slabs ever held at once. */
+  };
+
+/* Header at the start of each slab page. */
+struct slab
+  {
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct kmem_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* Element in cache's partial list. */
+    size_t free_cnt;            /* Number of free objects. */
+    void *free;                 /* First free object, or null. */
+  };
+
+/* All caches, for kmem_print_stats(). */
+static struct list all_caches;
+static struct lock all_caches_lock;
+
+static struct slab *slab_create (struct kmem_cache *);
+static struct slab *obj_to_slab (void *);
+
+/* Initializes the slab allocator. */
+void
+slab_init (void)
+{
+  list_init (&all_caches);
+  lock_init (&all_caches_lock);
+}
+
+/* Creates and returns a cache of objects of SIZE bytes, called
+   NAME.  If CTOR is nonnull, each object is passed to it as it is
+   allocated.  Panics if memory is not available, because caches
+   are created at initialization time. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor_func *ctor)
+{
+  struct kmem_cache *c;
+
+  size = ROUND_UP (size < sizeof (void *) ? sizeof (void *) : size,
+                   sizeof (void *));
+  ASSERT (size <= PGSIZE - sizeof (struct slab));
+
+  c = malloc (sizeof *c);
+  if (c == NULL)
+    PANIC ("kmem_cache_create: out of memory creating \"%s\"", name);
+  c->name = name;
+  c->obj_size = size;
+  c->objs_per_slab = (PGSIZE - sizeof (struct slab)) / size;
+  c->ctor = ctor;
+  c->pal_flags = 0;
+  list_init (&c->partial);
+  lock_init (&c->lock);
+  c->alloc_cnt = 0;
+  c->live_cnt = 0;
+  c->slab_cnt = 0;
+  c->max_slab_cnt = 0;
+
+  lock_acquire (&all_caches_lock);
+  list_push_back (&all_caches, &c->elem);
+  lock_release (&all_caches_lock);
+  return c;
+}
+
+/* Lets cache C take its slabs from the page allocator's reserved
+   pages, for objects needed to handle page faults. */
+void
+kmem_cache_use_reserve (struct kmem_cache *c) 
+{
+  c->pal_flags |= PAL_RESERVE;
+}
+
+/* Allocates and returns an object from cache C, or a null
+   pointer if memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  ASSERT (!intr_context ());
+
+  lock_acquire (&c->lock);
+  if (list_empty (&c->partial))
+    {
+      s = slab_create (c);
+      if (s == NULL)
+        {
+          lock_release (&c->lock);
+          return NULL;
+        }
+    }
+  else
+    s = list_entry (list_front (&c->partial), struct slab, elem);
+
+  /* Take the slab's first free object, and retire the slab from
+     the partial list if that was its last. */
+  obj = s->free;
+  s->free = *(void **) obj;
+  if (--s->free_cnt == 0)
+    list_remove (&s->elem);
+  c->alloc_cnt++;
+  c->live_cnt++;
+  lock_release (&c->lock);
+
+  if (c->ctor != NULL)
+    c->ctor (obj);
+  return obj;
+}
+
+/* Frees OBJ, which must have been allocated from cache C.  Does
+   nothing if OBJ is a null pointer. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  if (obj == NULL)
+    return;
+  s = obj_to_slab (obj);
+  ASSERT (s->cache == c);
+
+#ifndef NDEBUG
+  /* Clear the object to help detect use-after-free bugs. */
+  memset (obj, 0xcc, c->obj_size);
+#endif
+
+  lock_acquire (&c->lock);
+  *(void **) obj = s->free;
+  s->free = obj;
+  if (s->free_cnt++ == 0)
+    list_push_front (&c->partial, &s->elem);
+  c->live_cnt--;
+
+  /* Give back a slab with nothing in it. */
+  if (s->free_cnt == c->objs_per_slab)
+    {
+      list_remove (&s->elem);
+      c->slab_cnt--;
+      palloc_free_page (s);
+    }
+  lock_release (&c->lock);
+}
+
+/* Prints statistics for every cache. */
+void
+kmem_print_stats (void)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&all_caches); e != list_end (&all_caches);
+       e = list_next (e))
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+      printf ("Slab: %s: %zu-byte objects, %llu allocated, %zu live, "
+              "%zu slabs (max %zu)\n", c->name, c->obj_size, c->alloc_cnt,
+              c->live_cnt, c->slab_cnt, c->max_slab_cnt);
+    }
+}
+
+/* Obtains a new slab for cache C, chains all of its objects onto
+   its free list, and puts it on C's partial list.  Returns the
+   slab, or a null pointer if memory is not available.  C's lock
+   must be held. */
+static struct slab *
+slab_create (struct kmem_cache *c)
+{
+  struct slab *s;
+  uint8_t *obj;
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&c->lock));
+
+  s = palloc_get_page (c->pal_flags);
+  if (s == NULL)
+    return NULL;
+  s->magic = SLAB_MAGIC;
+  s->cache = c;
+  s->free_cnt = c->objs_per_slab;
+  s->free = NULL;
+  obj = (uint8_t *) (s + 1) + c->objs_per_slab * c->obj_size;
+  for (i = 0; i < c->objs_per_slab; i++)
+    {
+      obj -= c->obj_size;
+      *(void **) obj = s->free;
+      s->free = obj;
+    }
+  list_push_front (&c->partial, &s->elem);
+
+  if (++c->slab_cnt > c->max_slab_cnt)
+    c->max_slab_cnt = c->slab_cnt;
+  return s;
+}
+
+/* Returns the slab that object OBJ is inside. */
+static struct slab *
+obj_to_slab (void *obj)
+{
+  struct slab *s = pg_round_down (obj);
+
+  ASSERT (s->magic == SLAB_MAGIC);
+  ASSERT ((pg_ofs (obj) - sizeof *s) % s->cache->obj_size == 0);
+  return s;
+}
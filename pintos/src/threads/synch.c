@@ -27,11 +27,30 @@
 */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+/* Maximum number of times lock_acquire() polls a lock whose
+   holder is running before it goes to sleep. */
+#define LOCK_SPIN_MAX 1000
+
+static bool thread_priority_less (const struct list_elem *,
+                                  const struct list_elem *, void *aux);
+static bool lock_spin (struct lock *);
+static bool lock_try_acquire_quiet (struct lock *);
+static void lock_count_acquire (struct lock *, bool contended,
+                                uint64_t start);
+
+/* Set by kernel command-line option "-lockstats". */
+bool lock_stats_enabled;
+
+/* All lock_stats that some lock has been initialized with. */
+static struct lock_stats *all_lock_stats;
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -102,7 +121,11 @@ sema_try_down (struct semaphore *sema)
 }
 
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any.  Waiters are chosen by their priority at wakeup
+   time, since donation may have changed it while they waited.
+   If the woken thread outranks the caller, yields to it
+   immediately (or, in an interrupt handler, on return).
 
    This function may be called from an interrupt handler. */
 void
@@ -114,10 +137,28 @@ sema_up (struct semaphore *sema)
 
   old_level = intr_disable ();
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *e = list_max (&sema->waiters,
+                                      thread_priority_less, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
   sema->value++;
   intr_set_level (old_level);
+
+  if (old_level == INTR_ON && !intr_context ())
+    thread_preempt ();
+}
+
+/* Returns true if thread A has lower priority than thread B. */
+static bool
+thread_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
 }
 
 static void sema_test_helper (void *sema_);
@@ -171,20 +212,41 @@ sema_test_helper (void *sema_)
    another one "up" it, but with a lock the same thread must both
    acquire and release it.  When these restrictions prove
    onerous, it's a good sign that a semaphore should be used,
-   instead of a lock. */
+   instead of a lock.
+
+   Called through the lock_init() macro, which supplies STATS for
+   the calling site. */
 void
-lock_init (struct lock *lock)
+lock_init_stats (struct lock *lock, struct lock_stats *stats)
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
+  ASSERT (stats != NULL);
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+  lock->stats = stats;
+  lock->acquired = 0;
+
+  old_level = intr_disable ();
+  if (!stats->registered)
+    {
+      stats->next = all_lock_stats;
+      all_lock_stats = stats;
+      stats->registered = true;
+    }
+  intr_set_level (old_level);
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   If LOCK's holder is running on another CPU, spins briefly
+   first, because a short critical section is likely to end
+   sooner than we could sleep and be woken up again.
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +254,62 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  uint64_t start = lock_stats_enabled ? timer_cycles () : 0;
+  bool contended;
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  contended = lock->holder != NULL;
+
+  if (lock_spin (lock))
+    {
+      lock_count_acquire (lock, contended, start);
+      return;
+    }
+
+  /* If the lock is taken, lend our priority to its holder (and
+     transitively to whoever that holder is waiting for) so that it
+     cannot be starved by medium-priority threads while we wait. */
+  old_level = intr_disable ();
+  if (lock->holder != NULL && !thread_mlfqs)
+    {
+      cur->wait_on_lock = lock;
+      list_push_back (&lock->holder->donations, &cur->donation_elem);
+      thread_donate_priority ();
+    }
+
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  cur->wait_on_lock = NULL;
+  lock->holder = cur;
+  intr_set_level (old_level);
+  lock_count_acquire (lock, true, start);
+}
+
+/* Polls LOCK for as long as its holder is running, up to
+   LOCK_SPIN_MAX times, and acquires it if it is released.
+   Returns true if LOCK was acquired, false if its holder stopped
+   running or we gave up.  A holder can only be running while we
+   are if it is on another CPU. */
+static bool
+lock_spin (struct lock *lock)
+{
+  int i;
+
+  for (i = 0; i < LOCK_SPIN_MAX; i++)
+    {
+      struct thread *holder = *(struct thread *volatile *) &lock->holder;
+
+      if (holder == NULL)
+        return lock_try_acquire_quiet (lock);
+      if (holder->status != THREAD_RUNNING)
+        return false;
+      asm volatile ("pause" : : : "memory");
+    }
+  return false;
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -208,6 +320,18 @@ lock_acquire (struct lock *lock)
    interrupt handler. */
 bool
 lock_try_acquire (struct lock *lock)
+{
+  bool success = lock_try_acquire_quiet (lock);
+
+  if (success)
+    lock_count_acquire (lock, false, 0);
+  return success;
+}
+
+/* Does the work of lock_try_acquire() without counting it in
+   LOCK's statistics. */
+static bool
+lock_try_acquire_quiet (struct lock *lock)
 {
   bool success;
 
@@ -220,6 +344,27 @@ lock_try_acquire (struct lock *lock)
   return success;
 }
 
+/* Counts an acquisition of LOCK, just made by the current thread,
+   in LOCK's statistics, if they are being kept.  CONTENDED says
+   whether the lock was held when we asked for it, at time
+   START. */
+static void
+lock_count_acquire (struct lock *lock, bool contended, uint64_t start)
+{
+  struct lock_stats *s = lock->stats;
+
+  if (!lock_stats_enabled)
+    return;
+
+  lock->acquired = timer_cycles ();
+  s->acquire_cnt++;
+  if (contended)
+    {
+      s->contended_cnt++;
+      s->wait_time += lock->acquired - start;
+    }
+}
+
 /* Releases LOCK, which must be owned by the current thread.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -228,11 +373,32 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  enum intr_level old_level;
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  if (lock_stats_enabled && lock->acquired != 0)
+    {
+      uint64_t hold = timer_cycles () - lock->acquired;
+      if (hold > lock->stats->max_hold_time)
+        lock->stats->max_hold_time = hold;
+    }
+
+  /* Give back the priority donated by this lock's waiters. */
+  old_level = intr_disable ();
+  if (!thread_mlfqs)
+    {
+      thread_remove_donations (lock);
+      thread_refresh_priority ();
+    }
+
   lock->holder = NULL;
   sema_up (&lock->semaphore);
+  intr_set_level (old_level);
+
+  if (old_level == INTR_ON)
+    thread_preempt ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -246,13 +412,53 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
+/* Prints the statistics for each place locks are initialized
+   that were ever acquired, those with the most time spent
+   waiting first. */
+void
+lock_print_stats (void)
+{
+  struct lock_stats *sorted = NULL;
+  struct lock_stats *s, **p;
+  enum intr_level old_level;
+
+  if (!lock_stats_enabled)
+    return;
+
+  /* Insertion-sort the list of all statistics. */
+  old_level = intr_disable ();
+  while (all_lock_stats != NULL)
+    {
+      s = all_lock_stats;
+      all_lock_stats = s->next;
+      for (p = &sorted; *p != NULL && (*p)->wait_time >= s->wait_time;
+           p = &(*p)->next)
+        continue;
+      s->next = *p;
+      *p = s;
+    }
+  all_lock_stats = sorted;
+  intr_set_level (old_level);
+
+  for (s = all_lock_stats; s != NULL; s = s->next)
+    if (s->acquire_cnt > 0)
+      printf ("Lock %s (%s:%d): %lld acquisitions, %lld contended, "
+              "%"PRIu64" cycles waiting, %"PRIu64" max cycles held\n",
+              s->name, s->file, s->line, s->acquire_cnt, s->contended_cnt,
+              s->wait_time, s->max_hold_time);
+}
+
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+static bool sema_elem_priority_less (const struct list_elem *,
+                                     const struct list_elem *, void *aux);
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -295,6 +501,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -302,7 +509,8 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
+   this function signals the one with the highest priority to
+   wake up from its wait.
    LOCK must be held before calling this function.
 
    An interrupt handler cannot acquire a lock, so it does not
@@ -317,8 +525,26 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters,
+                                      sema_elem_priority_less, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
+}
+
+/* Returns true if the thread waiting on semaphore_elem A has
+   lower priority than the one waiting on B. */
+static bool
+sema_elem_priority_less (const struct list_elem *a_,
+                         const struct list_elem *b_, void *aux UNUSED)
+{
+  const struct semaphore_elem *a = list_entry (a_, struct semaphore_elem,
+                                               elem);
+  const struct semaphore_elem *b = list_entry (b_, struct semaphore_elem,
+                                               elem);
+
+  return a->thread->priority < b->thread->priority;
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -336,3 +562,198 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes readers-writer lock RW.  Any number of readers may
+   hold RW at once, or a single writer.
+
+   A writer holds RW's write_lock for as long as it holds RW, and
+   a reader holds write_lock just long enough to count itself in.
+   So a thread that waits for a writer waits on an ordinary lock
+   and donates its priority to the writer as usual.  A writer that
+   is waiting for readers to leave already holds write_lock, which
+   keeps new readers out, so a steady stream of readers cannot
+   starve a writer.  Readers, of which there may be many, do not
+   receive donations. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->write_lock);
+  lock_init (&rw->lock);
+  cond_init (&rw->no_readers);
+  rw->reader_cnt = 0;
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it or
+   is waiting for it. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->write_lock);
+  lock_acquire (&rw->lock);
+  rw->reader_cnt++;
+  lock_release (&rw->lock);
+  lock_release (&rw->write_lock);
+}
+
+/* Releases RW, which the current thread holds for reading. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->reader_cnt > 0);
+  if (--rw->reader_cnt == 0)
+    cond_signal (&rw->no_readers, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until no reader or writer
+   holds it. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->write_lock);
+  lock_acquire (&rw->lock);
+  while (rw->reader_cnt > 0)
+    cond_wait (&rw->no_readers, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_held_for_write (rw));
+
+  lock_release (&rw->write_lock);
+}
+
+/* Returns true if the current thread holds RW for writing.
+   (Whether a particular thread holds RW for reading is not
+   recorded.) */
+bool
+rwlock_held_for_write (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return lock_held_by_current_thread (&rw->write_lock);
+}
+
+/* Atomically stores NEW in *P and returns the old value of *P.
+   XCHG with a memory operand locks the bus by itself, without a
+   LOCK prefix.  See [IA32-v2b] "XCHG". */
+static inline int
+atomic_xchg (volatile int *p, int new)
+{
+  asm volatile ("xchgl %0, %1" : "+r" (new), "+m" (*p) : : "memory");
+  return new;
+}
+
+/* Initializes spin lock LOCK.
+
+   A spin lock protects a short critical section without ever
+   sleeping: a CPU that finds it held busy-waits until the holder
+   lets go.  This makes it suitable for data touched by interrupt
+   handlers and by the scheduler itself, such as page allocator
+   pools and run queues, where a struct lock cannot be used.
+
+   A spin lock is only held with interrupts off.  That keeps the
+   holder from being preempted while others spin, and keeps an
+   interrupt handler on the same CPU from spinning on a lock that
+   the code it interrupted holds.  Use spin_lock_irqsave() and
+   spin_unlock_irqrestore() unless interrupts are already off.
+
+   Spin locks are not recursive: the holder must not acquire the
+   same lock again. */
+void
+spin_init (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+
+  lock->locked = 0;
+  lock->holder = NULL;
+}
+
+/* Acquires LOCK, busy-waiting until it is available.
+   Interrupts must be off, and the current thread must not
+   already hold LOCK. */
+void
+spin_lock (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!spin_held_by_current_thread (lock));
+
+  /* Spin on plain reads, which stay in our cache, and retry the
+     bus-locking exchange only once the lock looks free. */
+  while (atomic_xchg (&lock->locked, 1) != 0)
+    while (lock->locked)
+      asm volatile ("pause");
+  lock->holder = running_thread ();
+}
+
+/* Tries to acquire LOCK without spinning and returns true if
+   successful.  Interrupts must be off. */
+bool
+spin_try_lock (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!spin_held_by_current_thread (lock));
+
+  if (atomic_xchg (&lock->locked, 1) != 0)
+    return false;
+  lock->holder = running_thread ();
+  return true;
+}
+
+/* Releases LOCK, which must be held by the current thread. */
+void
+spin_unlock (struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+  ASSERT (spin_held_by_current_thread (lock));
+
+  lock->holder = NULL;
+  barrier ();
+  lock->locked = 0;
+}
+
+/* Turns interrupts off, acquires LOCK, and returns the previous
+   interrupt level for spin_unlock_irqrestore(). */
+enum intr_level
+spin_lock_irqsave (struct spinlock *lock)
+{
+  enum intr_level old_level = intr_disable ();
+  spin_lock (lock);
+  return old_level;
+}
+
+/* Releases LOCK and restores interrupt level OLD_LEVEL, as
+   returned by spin_lock_irqsave(). */
+void
+spin_unlock_irqrestore (struct spinlock *lock, enum intr_level old_level)
+{
+  spin_unlock (lock);
+  intr_set_level (old_level);
+}
+
+/* Returns true if the current thread holds LOCK, false
+   otherwise.  (Note that testing whether some other thread holds
+   a lock would be racy.)  Unlike lock_held_by_current_thread(),
+   this may be called in the middle of a thread switch. */
+bool
+spin_held_by_current_thread (const struct spinlock *lock)
+{
+  ASSERT (lock != NULL);
+
+  return lock->locked && lock->holder == running_thread ();
+}
@@ -3,6 +3,8 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
 
 /* A counting semaphore. */
 struct semaphore 
@@ -17,18 +19,52 @@ bool sema_try_down (struct semaphore *);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
+/* Lock statistics, kept when the kernel is booted with
+   "-lockstats".  Each place that calls lock_init() has its own
+   statistics, shared by all the locks it initializes, so that,
+   say, all inode locks are counted together.  Times are in CPU
+   cycles. */
+struct lock_stats
+  {
+    const char *name;           /* lock_init()'s argument, as written. */
+    const char *file;           /* Source file of the lock_init() call. */
+    int line;                   /* Line of the lock_init() call. */
+    struct lock_stats *next;    /* Next in list of all lock_stats. */
+    bool registered;            /* On list of all lock_stats? */
+    long long acquire_cnt;      /* Number of acquisitions. */
+    long long contended_cnt;    /* Acquisitions that found it held. */
+    uint64_t wait_time;         /* Total time spent waiting. */
+    uint64_t max_hold_time;     /* Longest time held. */
+  };
+
 /* Lock. */
 struct lock 
   {
     struct thread *holder;      /* Thread holding lock (for debugging). */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct lock_stats *stats;   /* Statistics for where it was made. */
+    uint64_t acquired;          /* When last acquired, for statistics. */
   };
 
-void lock_init (struct lock *);
+/* Set by kernel command-line option "-lockstats". */
+extern bool lock_stats_enabled;
+
+/* Initializes LOCK, with statistics for this call site. */
+#define lock_init(LOCK)                                                 \
+        do                                                              \
+          {                                                             \
+            static struct lock_stats lock_stats_ =                      \
+              { .name = #LOCK, .file = __FILE__, .line = __LINE__ };    \
+            lock_init_stats ((LOCK), &lock_stats_);                     \
+          }                                                             \
+        while (0)
+
+void lock_init_stats (struct lock *, struct lock_stats *);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
+void lock_print_stats (void);
 
 /* Condition variable. */
 struct condition 
@@ -41,6 +77,96 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock
+  {
+    struct lock write_lock;     /* Held by writer, or reader entering. */
+    struct lock lock;           /* Protects reader_cnt. */
+    struct condition no_readers; /* Signaled when reader_cnt drops to 0. */
+    int reader_cnt;             /* Number of readers inside. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
+/* Spin lock. */
+struct spinlock
+  {
+    volatile int locked;        /* Nonzero while held. */
+    struct thread *holder;      /* Thread holding lock (for debugging). */
+  };
+
+void spin_init (struct spinlock *);
+void spin_lock (struct spinlock *);
+bool spin_try_lock (struct spinlock *);
+void spin_unlock (struct spinlock *);
+enum intr_level spin_lock_irqsave (struct spinlock *);
+void spin_unlock_irqrestore (struct spinlock *, enum intr_level);
+bool spin_held_by_current_thread (const struct spinlock *);
+
+/* Sequence lock, for data that is read often, written rarely
+   and only by one writer at a time, and small enough to copy.
+   A writer brackets its update with seq_write_begin() and
+   seq_write_end(), which make SEQ odd and then even again.  A
+   reader takes no lock and never blocks a writer: it copies the
+   data between seq_read_begin() and seq_read_retry(), and
+   copies it again if the latter returns true.  Writers must
+   serialize among themselves, for example by running with
+   interrupts off, and a reader must not interrupt a writer on
+   its own CPU, or it would spin forever. */
+struct seqlock
+  {
+    unsigned seq;               /* Odd while a write is under way. */
+  };
+
+/* Initializes SL. */
+static inline void
+seq_init (struct seqlock *sl)
+{
+  sl->seq = 0;
+}
+
+/* Begins a read of the data that SL protects and returns the
+   sequence number to pass to seq_read_retry(). */
+static inline unsigned
+seq_read_begin (const struct seqlock *sl)
+{
+  unsigned seq;
+
+  while ((seq = __atomic_load_n (&sl->seq, __ATOMIC_ACQUIRE)) & 1)
+    asm volatile ("pause" : : : "memory");
+  return seq;
+}
+
+/* Returns true if the data that SL protects changed since
+   seq_read_begin() returned SEQ, so that the read must be
+   retried. */
+static inline bool
+seq_read_retry (const struct seqlock *sl, unsigned seq)
+{
+  __atomic_thread_fence (__ATOMIC_ACQUIRE);
+  return __atomic_load_n (&sl->seq, __ATOMIC_RELAXED) != seq;
+}
+
+/* Begins an update of the data that SL protects. */
+static inline void
+seq_write_begin (struct seqlock *sl)
+{
+  __atomic_store_n (&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+/* Ends an update of the data that SL protects. */
+static inline void
+seq_write_end (struct seqlock *sl)
+{
+  __atomic_store_n (&sl->seq, sl->seq + 1, __ATOMIC_RELEASE);
+}
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
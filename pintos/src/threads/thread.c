@@ -1,17 +1,26 @@
 #include "threads/thread.h"
 #include <debug.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/timer.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
+#include "threads/fpu.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
 #include "threads/palloc.h"
+#include "threads/percpu.h"
+#include "threads/rcu.h"
 #include "threads/switch.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
 #include "threads/vaddr.h"
 #ifdef USERPROG
+#include <kdata.h>
 #include "userprog/process.h"
 #endif
 
@@ -20,16 +29,76 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Run queues of processes in THREAD_READY state, that is,
+   processes that are ready to run but not actually running.
+
+   Each CPU that schedules threads has its own run queue, so that
+   a thread tends to keep running on the CPU whose cache it has
+   warmed.  A thread's `cpu' member names the CPU it last ran on,
+   or whose run queue it is on while ready.  A CPU whose queue is
+   empty steals the highest-priority thread from the busiest
+   other queue before it idles.  A thread is only ever queued on,
+   or stolen by, a CPU that its `affinity' mask allows.
+
+   Within a run queue there is one FIFO queue per priority level,
+   and bit P of `mask' is set if and only if queues[P] is
+   non-empty, so the highest-priority ready thread is found with a
+   single find-first-set instead of a list scan.  Batch threads
+   wait on a separate FIFO queue that is used only when every
+   priority queue is empty.  Deadline threads wait on a queue of
+   their own, in order of deadline, that is used before any of
+   the others.
+
+   Each run queue is protected by its spin lock, which is taken
+   with interrupts already off.  The lengths and masks of other
+   CPUs' queues are read without their locks when choosing where
+   to put or take a thread, since a stale value only makes the
+   choice a little worse. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1)
+#define READY_MASK_WORDS ((PRI_CNT + 31) / 32)
+#define RUNQ_MAX THREAD_CPU_MAX /* Maximum number of run queues. */
+struct runq
+  {
+    struct spinlock lock;               /* Protects queues, mask, cnt. */
+    struct list queues[PRI_CNT];        /* Ready threads, by priority. */
+    uint32_t mask[READY_MASK_WORDS];    /* Non-empty queues. */
+    struct list batch;                  /* Ready batch threads. */
+    struct list deadline;               /* Ready deadline threads. */
+    int cnt;                            /* Number of ready threads. */
+    struct thread *idle;                /* This CPU's idle thread. */
+    struct thread *curr;                /* Thread running on this CPU. */
+    unsigned quiescent_cnt;             /* Quiescent states, for rcu.c. */
+
+    /* Load-balancing statistics. */
+    long long steals;                   /* Threads taken from others. */
+    long long stolen;                   /* Threads taken by others. */
+    long long affine_wakeups;           /* Woken onto last-run CPU. */
+    long long moved_wakeups;            /* Woken onto waker's CPU. */
+    long long idle_wakeups;             /* Woken onto an idle CPU. */
+  };
+static struct runq runqs[RUNQ_MAX];
+
+/* Number of run queues in use.  Only the bootstrap processor
+   schedules threads so far; the other processors stay parked in
+   mp.c. */
+static size_t runq_cnt = 1;
+
+/* A thread that stopped running at most this many ticks ago is
+   assumed to still have its data in the cache of the CPU it ran
+   on. */
+#define CACHE_HOT_TICKS 2
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* Idle thread. */
-static struct thread *idle_thread;
+/* Hash table of all threads, indexed by tid, for
+   thread_lookup().  A thread is added when its tid is allocated
+   and removed when it exits.  Protected, like all_list, by
+   turning interrupts off.  The buckets are fixed, so that adding
+   and removing never allocate memory. */
+#define TID_BUCKETS 64          /* Number of buckets, a power of 2. */
+static struct list tid_buckets[TID_BUCKETS];
 
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
@@ -37,6 +106,17 @@ static struct thread *initial_thread;
 /* Lock used by allocate_tid(). */
 static struct lock tid_lock;
 
+/* Pages of dead threads, kept for thread_create() to reuse
+   instead of going back and forth to the page allocator.  The
+   first word of each cached page points to the next one.
+   init_thread() clears the struct thread at the bottom of a
+   reused page, but the stack above it keeps its old contents,
+   which nothing reads before writing. */
+#define THREAD_CACHE_MAX 8      /* Most pages kept. */
+static void *thread_cache;
+static size_t thread_cache_cnt;
+static struct spinlock thread_cache_lock;
+
 /* Stack frame for kernel_thread(). */
 struct kernel_thread_frame 
   {
@@ -45,31 +125,98 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
-
-/* Scheduling. */
-#define TIME_SLICE 4            /* # of timer ticks to give each thread. */
+/* Statistics, counted by each CPU as its own. */
+static PER_CPU (long long, idle_ticks);   /* Timer ticks spent idle. */
+static PER_CPU (long long, kernel_ticks); /* Ticks in kernel threads. */
+static PER_CPU (long long, user_ticks);   /* Ticks in user programs. */
+static PER_CPU (long long, voluntary_switches);   /* Blocking switches. */
+static PER_CPU (long long, involuntary_switches); /* Switches while ready. */
+
+/* wakeup_latency[I] counts the threads woken by thread_unblock()
+   that took from 2**I to 2**(I+1) - 1 CPU cycles to start
+   running.  Protected by turning interrupts off. */
+static uint64_t wakeup_latency[SCHED_LATENCY_BUCKETS];
+
+/* Scheduling.  A running thread is preempted once it has run
+   for the time slice of its priority band.  The slices are set in
+   milliseconds, and thread_start() converts them to ticks. */
+#define TIME_SLICE_MS 40        /* Default time slice. */
+int thread_slice_ms[THREAD_SLICE_BANDS] =
+  { TIME_SLICE_MS, TIME_SLICE_MS, TIME_SLICE_MS };
+static unsigned slice_ticks[THREAD_SLICE_BANDS]; /* Slices in ticks. */
 static unsigned thread_ticks;   /* # of timer ticks since last yield. */
 
+/* Batch threads get a long time slice, since they only compete
+   with each other, to cut down on switches between them. */
+#define BATCH_SLICE_MS 400      /* Batch thread time slice. */
+static unsigned batch_slice_ticks;
+
+/* Deadline threads.  Each runs for up to its budget in every
+   period, and the ready one whose period ends soonest runs
+   first.  Admission control keeps the sum of their budgets as
+   shares of their periods, in units of 1/DL_UTIL_SCALE, at most
+   DL_UTIL_MAX per CPU, so that each of them can meet its
+   deadlines and normal threads still get some time.  DL_UTIL is
+   protected by turning interrupts off. */
+#define DL_UTIL_SCALE 1000
+#define DL_UTIL_MAX 900
+static int dl_util;             /* Sum of admitted deadline threads. */
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* Multi-level feedback queue scheduler state.  Between the
+   once-per-second recomputations, only the recent_cpu of threads
+   that actually ran changes, so those threads are collected on
+   cpu_dirty_list and only their priorities are recomputed every
+   PRI_RECALC_TICKS ticks. */
+#define PRI_RECALC_TICKS 4      /* Ticks between priority updates. */
+static fixed_t load_avg;        /* System load average. */
+static struct list cpu_dirty_list;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
-static struct thread *running_thread (void);
 static struct thread *next_thread_to_run (void);
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
+static bool is_idle (const struct thread *);
+static bool is_batch (struct thread *);
+static bool is_deadline (const struct thread *);
+static int dl_share (int64_t period, int64_t budget);
+static void dl_refresh (struct thread *);
+static void dl_throttle (struct thread *);
+static timeout_func dl_timeout;
+static list_less_func deadline_less;
+static bool thread_outranks (struct thread *, struct thread *);
+static bool runq_outranks (struct runq *, struct thread *);
+static struct runq *runq_self (void);
+static bool runq_is_idle (const struct runq *);
+static bool cpu_allowed (const struct thread *, size_t cpu);
+static size_t choose_cpu (struct thread *);
+static void ready_push (struct thread *);
+static void ready_remove (struct thread *);
+static void runq_remove (struct runq *, struct thread *);
+static int ready_max_priority (const struct runq *);
+static struct thread *runq_first_allowed (struct list *, size_t cpu);
+static struct thread *runq_pop (struct runq *, size_t cpu);
+static struct thread *runq_steal (struct runq *);
+static void thread_change_priority (struct thread *, int priority);
+static void mlfqs_tick (struct thread *);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_update_recent_cpu (struct thread *, void *aux);
 static void schedule (void);
 void thread_schedule_tail (struct thread *prev);
 static tid_t allocate_tid (void);
+static void account_switch_out (struct thread *);
+static void account_switch_in (struct thread *);
+static int latency_bucket (uint64_t cycles);
+static struct list *tid_bucket (tid_t);
+static struct thread *thread_page_get (void);
+static void thread_page_free (struct thread *);
 
 /* Initializes the threading system by transforming the code
    that's currently running into a thread.  This can't work in
@@ -87,17 +234,34 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  size_t cpu;
+  int i;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  spin_init (&thread_cache_lock);
+  for (cpu = 0; cpu < RUNQ_MAX; cpu++)
+    {
+      spin_init (&runqs[cpu].lock);
+      for (i = 0; i < PRI_CNT; i++)
+        list_init (&runqs[cpu].queues[i]);
+      list_init (&runqs[cpu].batch);
+      list_init (&runqs[cpu].deadline);
+    }
   list_init (&all_list);
+  for (i = 0; i < TID_BUCKETS; i++)
+    list_init (&tid_buckets[i]);
+  list_init (&cpu_dirty_list);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  runqs[initial_thread->cpu].curr = initial_thread;
+  list_push_back (tid_bucket (initial_thread->tid),
+                  &initial_thread->tidelem);
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -107,13 +271,24 @@ thread_start (void)
 {
   /* Create the idle thread. */
   struct semaphore idle_started;
+  int band;
+
+  /* Convert time slices to ticks, rounding up. */
+  for (band = 0; band < THREAD_SLICE_BANDS; band++)
+    {
+      ASSERT (thread_slice_ms[band] > 0);
+      slice_ticks[band] = DIV_ROUND_UP (thread_slice_ms[band] * TIMER_FREQ,
+                                        1000);
+    }
+  batch_slice_ticks = DIV_ROUND_UP (BATCH_SLICE_MS * TIMER_FREQ, 1000);
+
   sema_init (&idle_started, 0);
   thread_create ("idle", PRI_MIN, idle, &idle_started);
 
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
-  /* Wait for the idle thread to initialize idle_thread. */
+  /* Wait for the idle thread to register itself. */
   sema_down (&idle_started);
 }
 
@@ -125,28 +300,185 @@ thread_tick (void)
   struct thread *t = thread_current ();
 
   /* Update statistics. */
-  if (t == idle_thread)
-    idle_ticks++;
+  if (is_idle (t))
+    this_cpu_inc (idle_ticks);
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    this_cpu_inc (user_ticks);
 #endif
   else
-    kernel_ticks++;
+    this_cpu_inc (kernel_ticks);
+  if (!is_idle (t))
+    t->usage.ticks++;
+
+  if (thread_mlfqs)
+    mlfqs_tick (t);
 
-  /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
+  /* A thread interrupted outside any read-side critical section
+     has finished the ones it was in. */
+  if (t->rcu_depth == 0)
+    runq_self ()->quiescent_cnt++;
+
+#ifdef USERPROG
+  thread_update_kdata (t);
+#endif
+
+  /* Enforce preemption.  A deadline thread has no time slice:
+     it runs until it blocks, a thread with an earlier deadline
+     wakes up, or it uses up its budget for the period, which
+     throttles it until the next one starts. */
+  if (is_deadline (t))
+    {
+      if (timer_ticks () >= t->dl_deadline)
+        dl_refresh (t);
+      if (--t->dl_remaining <= 0)
+        {
+          t->dl_throttled = true;
+          intr_yield_on_return ();
+        }
+    }
+  else if (++thread_ticks >= (is_batch (t)
+                              ? batch_slice_ticks
+                              : slice_ticks[t->priority * THREAD_SLICE_BANDS
+                                            / (PRI_MAX + 1)]))
     intr_yield_on_return ();
 }
 
+/* Called by the timer when it skipped CNT ticks, without calling
+   thread_tick(), because the idle thread had nothing to do. */
+void
+thread_idle_ticks (int64_t cnt)
+{
+  this_cpu_add (idle_ticks, cnt);
+}
+
 /* Prints thread statistics. */
 void
 thread_print_stats (void) 
 {
+  long long idle, kernel, user, voluntary, involuntary;
+  size_t cpu;
+
+  int i;
+
+  per_cpu_sum (idle_ticks, idle);
+  per_cpu_sum (kernel_ticks, kernel);
+  per_cpu_sum (user_ticks, user);
+  per_cpu_sum (voluntary_switches, voluntary);
+  per_cpu_sum (involuntary_switches, involuntary);
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
-          idle_ticks, kernel_ticks, user_ticks);
+          idle, kernel, user);
+  printf ("Thread: %lld voluntary switches, %lld involuntary switches, "
+          "wakeup latency", voluntary, involuntary);
+  for (i = 0; i < SCHED_LATENCY_BUCKETS; i++)
+    if (wakeup_latency[i] > 0)
+      printf (" %d:%"PRIu64, i, wakeup_latency[i]);
+  printf ("\n");
+  if (runq_cnt > 1)
+    for (cpu = 0; cpu < runq_cnt; cpu++)
+      {
+        struct runq *rq = &runqs[cpu];
+        printf ("CPU %zu: %lld steals, %lld stolen, "
+                "%lld affine wakeups, %lld moved wakeups, "
+                "%lld idle wakeups\n",
+                cpu, rq->steals, rq->stolen, rq->affine_wakeups,
+                rq->moved_wakeups, rq->idle_wakeups);
+      }
+}
+
+/* CPU time accounting.
+
+   Each thread is charged, in timer_cycles(), for the time it
+   spends running in each cpu_mode.  intr_handler() switches the
+   running thread into CPU_INTR or CPU_KERNEL on entry, and back
+   to what it interrupted on return, and the scheduler charges
+   the outgoing thread at each switch, so that the totals are
+   exact rather than sampled at timer ticks as the "ticks" in
+   struct rusage are. */
+
+/* Charges the running thread for the time since it was last
+   charged, in the mode it was in, and puts it into MODE.
+   Returns the mode it was in. */
+enum cpu_mode
+thread_set_cpu_mode (enum cpu_mode mode)
+{
+  struct thread *t = running_thread ();
+  enum intr_level old_level;
+  enum cpu_mode old_mode;
+  uint64_t now;
+
+  /* An exception before thread_init() finds no thread. */
+  if (!is_thread (t))
+    return mode;
+
+  old_level = intr_disable ();
+  now = timer_cycles ();
+  old_mode = t->cpu_mode;
+  t->cpu_time[old_mode] += now - t->cpu_since;
+  t->cpu_since = now;
+  t->cpu_mode = mode;
+  intr_set_level (old_level);
+  return old_mode;
+}
+
+/* Stores in *USAGE the resources T has used, with the CPU time
+   it has run so far, if it is the running thread, included. */
+void
+thread_get_usage (struct thread *t, struct rusage *usage)
+{
+  uint64_t cpu_time[CPU_MODE_CNT];
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  *usage = t->usage;
+  memcpy (cpu_time, t->cpu_time, sizeof cpu_time);
+  if (t == running_thread ())
+    cpu_time[t->cpu_mode] += timer_cycles () - t->cpu_since;
+  intr_set_level (old_level);
+
+  usage->user_ns = timer_cycles_to_ns (cpu_time[CPU_USER]);
+  usage->kernel_ns = timer_cycles_to_ns (cpu_time[CPU_KERNEL]);
+  usage->intr_ns = timer_cycles_to_ns (cpu_time[CPU_INTR]);
+}
+
+/* Resets the resources counted for T, which must be the running
+   thread, to zero. */
+void
+thread_clear_usage (struct thread *t)
+{
+  enum intr_level old_level = intr_disable ();
+
+  memset (&t->usage, 0, sizeof t->usage);
+  memset (t->cpu_time, 0, sizeof t->cpu_time);
+  t->cpu_since = timer_cycles ();
+  intr_set_level (old_level);
 }
 
+#ifdef USERPROG
+/* Brings T's kernel data page, if it has one, up to date.  Called
+   on every tick and whenever T's process is switched in, so the
+   page is current whenever the process can look at it. */
+void
+thread_update_kdata (struct thread *t) 
+{
+  struct kdata *kd = t->kdata;
+  enum intr_level old_level;
+
+  if (kd == NULL)
+    return;
+  old_level = intr_disable ();
+  kd->seq++;
+  barrier ();
+  kd->ticks = timer_ticks ();
+  per_cpu_sum (idle_ticks, kd->idle_ticks);
+  per_cpu_sum (kernel_ticks, kd->kernel_ticks);
+  per_cpu_sum (user_ticks, kd->user_ticks);
+  barrier ();
+  kd->seq++;
+  intr_set_level (old_level);
+}
+#endif
+
 /* Creates a new kernel thread named NAME with the given initial
    PRIORITY, which executes FUNCTION passing AUX as the argument,
    and adds it to the ready queue.  Returns the thread identifier
@@ -176,7 +508,7 @@ thread_create (const char *name, int priority,
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_page_get ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -188,6 +520,7 @@ thread_create (const char *name, int priority,
      Do this atomically so intermediate values for the 'stack' 
      member cannot be observed. */
   old_level = intr_disable ();
+  list_push_back (tid_bucket (tid), &t->tidelem);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -206,27 +539,9 @@ thread_create (const char *name, int priority,
 
   intr_set_level (old_level);
 
-  /* At child process's perspective, current process is parent process. */
-  t->parent_process = thread_current ();
-
-  /* Initialize semaphore and flag. */
-  t->is_load = false;
-  t->is_exit = false;
-  sema_init (&t->exit, 0);
-  sema_init (&t->load, 0);
-
-  /* Push child process to child process list. */
-  list_push_back (&thread_current ()->child_process, &t->childelem);
-
-  /* Initialize file descriptor table. 0 is STDIN, 1 is STDOUT. */
-  int i;
-  t->fdt = palloc_get_page(0);
-  t->next_fd = 2;
-  for (i = 0; i < 64; i++)
-    t->fdt[i] = NULL;
-
-  /* Add to run queue. */
+  /* Add to run queue, and run it right away if it outranks us. */
   thread_unblock (t);
+  thread_preempt ();
 
   return tid;
 }
@@ -254,7 +569,14 @@ thread_block (void)
    This function does not preempt the running thread.  This can
    be important: if the caller had disabled interrupts itself,
    it may expect that it can atomically unblock a thread and
-   update other data. */
+   update other data.  Call thread_preempt() afterward to give
+   up the CPU if T outranks the running thread.  (From an
+   interrupt handler, the yield is requested automatically and
+   happens when the handler returns.)
+
+   T goes on the run queue chosen by choose_cpu().  A deadline
+   thread that is out of budget stays blocked until its next
+   period starts instead. */
 void
 thread_unblock (struct thread *t) 
 {
@@ -264,11 +586,73 @@ thread_unblock (struct thread *t)
 
   old_level = intr_disable ();
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  if (is_deadline (t))
+    {
+      dl_refresh (t);
+      if (t->dl_throttled)
+        {
+          dl_throttle (t);
+          intr_set_level (old_level);
+          return;
+        }
+    }
+  t->cpu = choose_cpu (t);
+  ready_push (t);
   t->status = THREAD_READY;
+  t->ready_since = timer_cycles ();
+  t->woken = true;
+  if (intr_context () && thread_outranks (t, running_thread ()))
+    intr_yield_on_return ();
   intr_set_level (old_level);
 }
 
+/* Yields the CPU if a ready thread should preempt the running
+   thread.  In an interrupt handler, arranges for the yield to
+   happen when the handler returns. */
+void
+thread_preempt (void)
+{
+  enum intr_level old_level = intr_disable ();
+  bool outranked = runq_outranks (runq_self (), thread_current ());
+  intr_set_level (old_level);
+
+  if (!outranked)
+    return;
+  if (intr_context ())
+    intr_yield_on_return ();
+  else if (rcu_may_yield ())
+    thread_yield ();
+}
+
+/* Returns the number of CPUs that schedule threads. */
+size_t
+thread_cpu_cnt (void)
+{
+  return runq_cnt;
+}
+
+/* Returns the number of quiescent states that CPU has gone
+   through, for threads/rcu.c: context switches, and timer
+   interrupts that found it outside a read-side critical
+   section. */
+unsigned
+thread_cpu_quiescent_cnt (size_t cpu)
+{
+  ASSERT (cpu < runq_cnt);
+  return __atomic_load_n (&runqs[cpu].quiescent_cnt, __ATOMIC_ACQUIRE);
+}
+
+/* Returns true if CPU is running its idle thread, which may sit
+   in a tickless sleep without passing through quiescent
+   states. */
+bool
+thread_cpu_idle (size_t cpu)
+{
+  ASSERT (cpu < runq_cnt);
+  return (__atomic_load_n (&runqs[cpu].curr, __ATOMIC_ACQUIRE)
+          == runqs[cpu].idle);
+}
+
 /* Returns the name of the running thread. */
 const char *
 thread_name (void) 
@@ -312,16 +696,19 @@ thread_exit (void)
 #ifdef USERPROG
   process_exit ();
 #endif
+  malloc_thread_exit ();
 
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
   intr_disable ();
   list_remove (&thread_current()->allelem);
-
-  /* Change exit flag and continue parent process from process_wait */
-  thread_current ()->is_exit = true;
-  sema_up (&thread_current ()->exit);
+  list_remove (&thread_current ()->tidelem);
+  if (thread_current ()->cpu_dirty)
+    list_remove (&thread_current ()->cpu_dirty_elem);
+  if (is_deadline (thread_current ()))
+    dl_util -= dl_share (thread_current ()->dl_period,
+                         thread_current ()->dl_budget);
 
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -329,7 +716,9 @@ thread_exit (void)
 }
 
 /* Yields the CPU.  The current thread is not put to sleep and
-   may be scheduled again immediately at the scheduler's whim. */
+   may be scheduled again immediately at the scheduler's whim,
+   unless it is a deadline thread out of budget, which sleeps
+   until its next period starts. */
 void
 thread_yield (void) 
 {
@@ -339,9 +728,21 @@ thread_yield (void)
   ASSERT (!intr_context ());
 
   old_level = intr_disable ();
-  if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
-  cur->status = THREAD_READY;
+  if (is_deadline (cur) && cur->dl_throttled)
+    {
+      dl_throttle (cur);
+      cur->status = THREAD_BLOCKED;
+    }
+  else
+    {
+      if (!is_idle (cur)) 
+        {
+          if (!cpu_allowed (cur, cur->cpu))
+            cur->cpu = choose_cpu (cur);
+          ready_push (cur);
+        }
+      cur->status = THREAD_READY;
+    }
   schedule ();
   intr_set_level (old_level);
 }
@@ -363,11 +764,144 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Copies the scheduler statistics of the thread whose tid is
+   TID, and those of all threads together, to *STATS.  Returns
+   false if there is no such thread. */
+bool
+thread_get_sched_stats (tid_t tid, struct sched_stats *stats)
+{
+  enum intr_level old_level;
+  struct thread *t;
+
+  old_level = intr_disable ();
+  t = thread_lookup (tid);
+  if (t != NULL)
+    {
+      stats->ready_time = t->ready_time;
+      stats->voluntary_cnt = t->voluntary_cnt;
+      stats->involuntary_cnt = t->involuntary_cnt;
+      memcpy (stats->latency, wakeup_latency, sizeof stats->latency);
+    }
+  intr_set_level (old_level);
+  return t != NULL;
+}
+
+/* Returns the live thread whose tid is TID, or a null pointer if
+   there is none.  Since the thread may exit as soon as
+   interrupts are turned back on, this function must be called
+   with interrupts off, and the caller may use the thread only
+   until it turns them on. */
+struct thread *
+thread_lookup (tid_t tid)
+{
+  struct list *bucket = tid_bucket (tid);
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (bucket); e != list_end (bucket); e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, tidelem);
+      if (t->tid == tid)
+        return t;
+    }
+  return NULL;
+}
+
+/* Sets the current thread's base priority to NEW_PRIORITY, and
+   yields if it no longer has the highest priority.  Priority
+   donated to the current thread still applies on top of the new
+   base priority. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  enum intr_level old_level;
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  /* The 4.4BSD scheduler computes priorities itself. */
+  if (thread_mlfqs)
+    return;
+
+  old_level = intr_disable ();
+  thread_current ()->base_priority = new_priority;
+  thread_refresh_priority ();
+  intr_set_level (old_level);
+
+  thread_preempt ();
+}
+
+/* Donates the current thread's priority along the chain of lock
+   holders that starts with the holder of the lock it is waiting
+   for, following at most DONATION_DEPTH_MAX links.  Interrupts
+   must be off. */
+void
+thread_donate_priority (void)
+{
+  struct thread *t = thread_current ();
+  int depth;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (depth = 0; depth < DONATION_DEPTH_MAX; depth++)
+    {
+      struct thread *holder;
+
+      if (t->wait_on_lock == NULL || t->wait_on_lock->holder == NULL)
+        break;
+      holder = t->wait_on_lock->holder;
+      if (holder->priority >= t->priority && !holder->batch_queued)
+        break;
+
+      /* This also moves a ready batch holder, which now has a
+         donor, back among the normal threads. */
+      thread_change_priority (holder, (holder->priority > t->priority
+                                       ? holder->priority : t->priority));
+      t = holder;
+    }
+}
+
+/* Removes from the current thread's donor list every thread that
+   is waiting for LOCK, which the current thread is about to
+   release.  Interrupts must be off. */
+void
+thread_remove_donations (struct lock *lock)
+{
+  struct list *donations = &thread_current ()->donations;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (donations); e != list_end (donations); )
+    {
+      struct thread *donor = list_entry (e, struct thread, donation_elem);
+      if (donor->wait_on_lock == lock)
+        e = list_remove (e);
+      else
+        e = list_next (e);
+    }
+}
+
+/* Recomputes the current thread's effective priority as the
+   maximum of its base priority and the priorities of the threads
+   still donating to it.  Interrupts must be off. */
+void
+thread_refresh_priority (void)
+{
+  struct thread *cur = thread_current ();
+  int priority = cur->base_priority;
+  struct list_elem *e;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (e = list_begin (&cur->donations); e != list_end (&cur->donations);
+       e = list_next (e))
+    {
+      struct thread *donor = list_entry (e, struct thread, donation_elem);
+      if (donor->priority > priority)
+        priority = donor->priority;
+    }
+  cur->priority = priority;
 }
 
 /* Returns the current thread's priority. */
@@ -377,42 +911,249 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Puts the current thread in scheduling class SCHED_CLASS,
+   either SCHED_NORMAL or SCHED_BATCH, and returns its previous
+   class.  A batch thread yields at once if a normal thread is
+   ready.  A deadline thread gives up its share of the CPU. */
+int
+thread_set_sched_class (int sched_class)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int old_class;
+
+  ASSERT (sched_class == SCHED_NORMAL || sched_class == SCHED_BATCH);
+
+  old_level = intr_disable ();
+  old_class = cur->sched_class;
+  if (old_class == SCHED_DEADLINE)
+    dl_util -= dl_share (cur->dl_period, cur->dl_budget);
+  cur->sched_class = sched_class;
+  intr_set_level (old_level);
+
+  thread_preempt ();
+  return old_class;
+}
+
+/* Puts the current thread in the deadline scheduling class, to
+   run for BUDGET ticks in every period of PERIOD ticks, the
+   first of which starts now.  Returns false, changing nothing,
+   if BUDGET is not between 1 and PERIOD or if admitting the
+   thread would give deadline threads more of the CPU than
+   DL_UTIL_MAX allows.  A deadline thread may call this again to
+   change its parameters. */
+bool
+thread_set_deadline (int64_t period, int64_t budget)
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  int share, old_share = 0;
+  bool ok;
+
+  if (budget < 1 || budget > period)
+    return false;
+  share = dl_share (period, budget);
+
+  old_level = intr_disable ();
+  if (is_deadline (cur))
+    old_share = dl_share (cur->dl_period, cur->dl_budget);
+  ok = dl_util - old_share + share <= DL_UTIL_MAX * (int) runq_cnt;
+  if (ok)
+    {
+      dl_util += share - old_share;
+      cur->sched_class = SCHED_DEADLINE;
+      cur->dl_period = period;
+      cur->dl_budget = budget;
+      cur->dl_deadline = timer_ticks () + period;
+      cur->dl_remaining = budget;
+      cur->dl_throttled = false;
+    }
+  intr_set_level (old_level);
+
+  thread_preempt ();
+  return ok;
+}
+
+/* Restricts thread TID to the CPUs in AFFINITY, moving it off a
+   CPU it may no longer use: at once if it is ready or is the
+   running thread, otherwise the next time it wakes up or yields.
+   Returns false, changing nothing, if there is no such thread
+   or if AFFINITY allows none of the CPUs that run threads. */
+bool
+thread_set_affinity (tid_t tid, uint32_t affinity)
+{
+  enum intr_level old_level;
+  struct thread *t;
+  bool move_self = false;
+
+  old_level = intr_disable ();
+  t = thread_lookup (tid);
+  if (t == NULL || is_idle (t)
+      || (affinity & (((uint32_t) 1 << runq_cnt) - 1)) == 0)
+    {
+      intr_set_level (old_level);
+      return false;
+    }
+  t->affinity = affinity;
+  if (!cpu_allowed (t, t->cpu))
+    {
+      if (t->status == THREAD_READY)
+        {
+          ready_remove (t);
+          t->cpu = choose_cpu (t);
+          ready_push (t);
+        }
+      else if (t == thread_current ())
+        move_self = true;
+    }
+  intr_set_level (old_level);
+
+  if (move_self)
+    thread_yield ();
+  return true;
+}
+
+/* Sets the current thread's nice value to NICE, recomputes its
+   priority, and yields if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  old_level = intr_disable ();
+  cur->nice = nice;
+  if (thread_mlfqs)
+    cur->priority = mlfqs_priority (cur);
+  intr_set_level (old_level);
+
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int load = fp_round (load_avg * 100);
+  intr_set_level (old_level);
+  return load;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  enum intr_level old_level = intr_disable ();
+  int recent = fp_round (thread_current ()->recent_cpu * 100);
+  intr_set_level (old_level);
+  return recent;
+}
+
+/* Does the per-tick 4.4BSD scheduler bookkeeping for T, the
+   thread that was running when the timer interrupt arrived.
+
+   recent_cpu of the running thread grows every tick.  Every
+   second, load_avg and every thread's recent_cpu and priority are
+   recomputed.  Every PRI_RECALC_TICKS ticks, the priority of each
+   thread whose recent_cpu has changed since the last update is
+   recomputed. */
+static void
+mlfqs_tick (struct thread *t)
+{
+  int64_t now = timer_ticks ();
+
+  if (!is_idle (t))
+    {
+      t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+      if (!t->cpu_dirty)
+        {
+          t->cpu_dirty = true;
+          list_push_back (&cpu_dirty_list, &t->cpu_dirty_elem);
+        }
+    }
+
+  if (now % TIMER_FREQ == 0)
+    {
+      int ready_threads = !is_idle (t);
+      size_t cpu;
+
+      for (cpu = 0; cpu < runq_cnt; cpu++)
+        ready_threads += runqs[cpu].cnt;
+
+      load_avg = fp_mul (fp_div (fp_from_int (59), fp_from_int (60)),
+                         load_avg)
+                 + fp_from_int (ready_threads) / 60;
+      thread_foreach (mlfqs_update_recent_cpu, NULL);
+    }
+
+  if (now % PRI_RECALC_TICKS == 0)
+    {
+      while (!list_empty (&cpu_dirty_list))
+        {
+          struct thread *d = list_entry (list_pop_front (&cpu_dirty_list),
+                                         struct thread, cpu_dirty_elem);
+          d->cpu_dirty = false;
+          thread_change_priority (d, mlfqs_priority (d));
+        }
+      if (runq_outranks (runq_self (), t))
+        intr_yield_on_return ();
+    }
+}
+
+/* Returns the 4.4BSD scheduler priority for T, based on its
+   recent_cpu and nice values. */
+static int
+mlfqs_priority (const struct thread *t)
+{
+  int priority = PRI_MAX - fp_to_int (t->recent_cpu / 4) - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    priority = PRI_MIN;
+  else if (priority > PRI_MAX)
+    priority = PRI_MAX;
+  return priority;
+}
+
+/* Decays T's recent_cpu according to the current load average
+   and recomputes its priority.  Used with thread_foreach() once
+   per second. */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *aux UNUSED)
+{
+  fixed_t twice_load = load_avg * 2;
+
+  if (is_idle (t))
+    return;
+
+  t->recent_cpu = fp_add_int (fp_mul (fp_div (twice_load,
+                                              fp_add_int (twice_load, 1)),
+                                      t->recent_cpu),
+                              t->nice);
+  if (t->cpu_dirty)
+    {
+      list_remove (&t->cpu_dirty_elem);
+      t->cpu_dirty = false;
+    }
+  thread_change_priority (t, mlfqs_priority (t));
 }
 
 /* Idle thread.  Executes when no other thread is ready to run.
 
    The idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
+   point it registers itself as its CPU's idle thread, "up"s the
+   semaphore passed
    to it to enable thread_start() to continue, and immediately
    blocks.  After that, the idle thread never appears in the
    ready list.  It is returned by next_thread_to_run() as a
@@ -421,14 +1162,22 @@ static void
 idle (void *idle_started_ UNUSED) 
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  runq_self ()->idle = thread_current ();
   sema_up (idle_started);
 
   for (;;) 
     {
-      /* Let someone else run. */
+      /* Use the spare time to zero pages for palloc, a page at a
+         time so that a thread that becomes ready does not wait
+         long. */
+      while (palloc_zero_idle ())
+        continue;
+
+      /* Let someone else run.  Once nobody else wants to,
+         stop the timer from ticking for nothing. */
       intr_disable ();
       thread_block ();
+      timer_idle_enter ();
 
       /* Re-enable interrupts and wait for the next one.
 
@@ -457,7 +1206,9 @@ kernel_thread (thread_func *function, void *aux)
   thread_exit ();       /* If function() returns, kill the thread. */
 }
 
-/* Returns the running thread. */
+/* Returns the running thread, without the sanity checks in
+   thread_current(), so that it may be called in the middle of a
+   thread switch. */
 struct thread *
 running_thread (void) 
 {
@@ -491,12 +1242,26 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  t->affinity = AFFINITY_ALL;
+  t->cpu_since = timer_cycles ();
+  list_init (&t->donations);
+  if (t != initial_thread)
+    {
+      /* New threads inherit the creator's scheduling parameters
+         and start out on the creator's CPU. */
+      t->nice = thread_current ()->nice;
+      t->recent_cpu = thread_current ()->recent_cpu;
+      t->cpu = thread_current ()->cpu;
+      t->sched_class = thread_current ()->sched_class;
+      if (t->sched_class == SCHED_DEADLINE)
+        t->sched_class = SCHED_NORMAL;
+      t->affinity = thread_current ()->affinity;
+    }
+  if (thread_mlfqs)
+    t->priority = t->base_priority = mlfqs_priority (t);
   t->magic = THREAD_MAGIC;
   list_push_back (&all_list, &t->allelem);
-
-  /* Initialize child process list. */
-  list_init (&t->child_process);
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -512,18 +1277,376 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
+/* Sets T's effective priority to PRIORITY, moving T to the
+   matching run queue if it is ready.  Interrupts must be off. */
+static void
+thread_change_priority (struct thread *t, int priority)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->status == THREAD_READY)
+    {
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Returns true if T is the idle thread of the CPU it runs on. */
+static bool
+is_idle (const struct thread *t)
+{
+  return t == runqs[t->cpu].idle;
+}
+
+/* Returns true if T is to be scheduled as a batch thread.  A
+   batch thread that holds a lock some other thread is waiting
+   for is scheduled as a normal thread until it releases it, so
+   that it cannot hold up its donors for long. */
+static bool
+is_batch (struct thread *t)
+{
+  return t->sched_class == SCHED_BATCH && list_empty (&t->donations);
+}
+
+/* Returns true if T is in the deadline scheduling class.  A
+   thread started by a deadline thread is not, because it was
+   not admitted. */
+static bool
+is_deadline (const struct thread *t)
+{
+  return t->sched_class == SCHED_DEADLINE;
+}
+
+/* Returns the share of the CPU, in units of 1/DL_UTIL_SCALE,
+   taken by BUDGET ticks in every PERIOD ticks, rounded up. */
+static int
+dl_share (int64_t period, int64_t budget)
+{
+  return DIV_ROUND_UP (budget * DL_UTIL_SCALE, period);
+}
+
+/* Starts a new period for deadline thread T, with a full budget,
+   if its current period is over, or if T is waking up with more
+   budget left than it could use by its deadline without running
+   more than its share of the time since.  The latter is the
+   constant bandwidth server's rule: without it, a thread that
+   slept through most of a period could wake up and take all of
+   its budget at once, so the other deadline threads could miss
+   theirs.  Interrupts must be off. */
+static void
+dl_refresh (struct thread *t)
+{
+  int64_t now = timer_ticks ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (now >= t->dl_deadline
+      || (t->dl_remaining * t->dl_period
+          > (t->dl_deadline - now) * t->dl_budget))
+    {
+      t->dl_deadline = now + t->dl_period;
+      t->dl_remaining = t->dl_budget;
+      t->dl_throttled = false;
+    }
+}
+
+/* Arranges for deadline thread T, which is out of budget and is
+   blocked or about to block, to be unblocked when its period
+   ends.  Interrupts must be off. */
+static void
+dl_throttle (struct thread *t)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  timer_arm (&t->dl_timeout, t->dl_deadline - timer_ticks (), dl_timeout, t);
+}
+
+/* Timeout function that ends the throttling of the deadline
+   thread AUX. */
+static void
+dl_timeout (struct timeout *to UNUSED, void *t)
+{
+  thread_unblock (t);
+}
+
+/* Orders threads by deadline, for a run queue's deadline list. */
+static bool
+deadline_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED)
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->dl_deadline < b->dl_deadline;
+}
+
+/* Returns true if ready thread T should preempt running thread
+   CUR: a deadline thread preempts any other thread, as long as
+   it is not a deadline thread with an earlier or equal deadline;
+   a normal thread preempts a batch thread or a normal thread of
+   lower priority; and a batch thread never preempts. */
+static bool
+thread_outranks (struct thread *t, struct thread *cur)
+{
+  if (is_deadline (t))
+    return !is_deadline (cur) || t->dl_deadline < cur->dl_deadline;
+  if (is_deadline (cur) || is_batch (t))
+    return false;
+  return is_batch (cur) || t->priority > cur->priority;
+}
+
+/* Returns true if run queue RQ holds a thread that should
+   preempt running thread T, as in thread_outranks().  Interrupts
+   must be off. */
+static bool
+runq_outranks (struct runq *rq, struct thread *t)
+{
+  int priority = ready_max_priority (rq);
+
+  if (!list_empty (&rq->deadline))
+    {
+      struct list_elem *e = list_front (&rq->deadline);
+      if (thread_outranks (list_entry (e, struct thread, elem), t))
+        return true;
+    }
+  if (is_deadline (t))
+    return false;
+
+  return is_batch (t) ? priority >= PRI_MIN : priority > t->priority;
+}
+
+/* Returns the run queue of the CPU we are running on. */
+static struct runq *
+runq_self (void)
+{
+  return &runqs[running_thread ()->cpu];
+}
+
+/* Returns true if RQ's CPU is running its idle thread and has
+   nothing else to run. */
+static bool
+runq_is_idle (const struct runq *rq)
+{
+  return rq->curr == rq->idle && rq->cnt == 0;
+}
+
+/* Returns true if T's affinity allows it to run on CPU. */
+static bool
+cpu_allowed (const struct thread *t, size_t cpu)
+{
+  return cpu < runq_cnt && (t->affinity & ((uint32_t) 1 << cpu)) != 0;
+}
+
+/* Returns the CPU, among those T's affinity allows, whose run
+   queue T should join as it becomes ready.  T stays on the CPU it
+   last ran on if that CPU is idle, or if T ran recently enough
+   for its data to still be cached there and that CPU's queue is
+   not noticeably longer than the waker's.  Otherwise T goes to an
+   idle CPU if there is one, or else to the waker's CPU, or else
+   to the allowed CPU with the shortest queue.  Interrupts must
+   be off. */
+static size_t
+choose_cpu (struct thread *t)
+{
+  struct runq *waker = runq_self ();
+  struct runq *last = &runqs[t->cpu];
+  struct runq *best = NULL;
+  bool warm = timer_ticks () - t->stopped_tick <= CACHE_HOT_TICKS;
+  size_t cpu;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (cpu_allowed (t, t->cpu)
+      && (runq_is_idle (last) || (warm && last->cnt <= waker->cnt + 1)))
+    {
+      last->affine_wakeups++;
+      return t->cpu;
+    }
+  for (cpu = 0; cpu < runq_cnt; cpu++)
+    if (cpu_allowed (t, cpu) && runq_is_idle (&runqs[cpu]))
+      {
+        runqs[cpu].idle_wakeups++;
+        return cpu;
+      }
+  if (cpu_allowed (t, waker - runqs))
+    best = waker;
+  else
+    for (cpu = 0; cpu < runq_cnt; cpu++)
+      if (cpu_allowed (t, cpu)
+          && (best == NULL || runqs[cpu].cnt < best->cnt))
+        best = &runqs[cpu];
+  ASSERT (best != NULL);
+  best->moved_wakeups++;
+  return best - runqs;
+}
+
+/* Adds ready thread T to the back of the queue for its priority,
+   or of the batch queue, or to the deadline queue in order of
+   deadline, in the run queue of T->cpu.  Interrupts must be
+   off. */
+static void
+ready_push (struct thread *t)
+{
+  struct runq *rq = &runqs[t->cpu];
+  int level = t->priority - PRI_MIN;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (t->cpu < runq_cnt);
+
+  spin_lock (&rq->lock);
+  t->batch_queued = !is_deadline (t) && is_batch (t);
+  if (is_deadline (t))
+    list_insert_ordered (&rq->deadline, &t->elem, deadline_less, NULL);
+  else if (t->batch_queued)
+    list_push_back (&rq->batch, &t->elem);
+  else
+    {
+      list_push_back (&rq->queues[level], &t->elem);
+      rq->mask[level / 32] |= (uint32_t) 1 << (level % 32);
+    }
+  rq->cnt++;
+  spin_unlock (&rq->lock);
+}
+
+/* Removes ready thread T from run queue RQ, whose lock must be
+   held.  T->priority must still be the priority it was queued
+   at. */
+static void
+runq_remove (struct runq *rq, struct thread *t)
+{
+  int level = t->priority - PRI_MIN;
+
+  ASSERT (spin_held_by_current_thread (&rq->lock));
+
+  list_remove (&t->elem);
+  if (!t->batch_queued && !is_deadline (t)
+      && list_empty (&rq->queues[level]))
+    rq->mask[level / 32] &= ~((uint32_t) 1 << (level % 32));
+  rq->cnt--;
+}
+
+/* Removes ready thread T from its run queue.  T->priority must
+   still be the priority it was queued at.  Interrupts must be
+   off. */
+static void
+ready_remove (struct thread *t)
+{
+  struct runq *rq = &runqs[t->cpu];
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spin_lock (&rq->lock);
+  runq_remove (rq, t);
+  spin_unlock (&rq->lock);
+}
+
+/* Returns the priority of the highest-priority normal thread in
+   RQ, or PRI_MIN - 1 if RQ has none.  Interrupts must be off. */
+static int
+ready_max_priority (const struct runq *rq)
+{
+  int word;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  for (word = READY_MASK_WORDS - 1; word >= 0; word--)
+    if (rq->mask[word] != 0)
+      return PRI_MIN + word * 32 + (31 - __builtin_clz (rq->mask[word]));
+  return PRI_MIN - 1;
+}
+
+/* Returns the first thread in run queue list LIST that may run
+   on CPU, or a null pointer if there is none. */
+static struct thread *
+runq_first_allowed (struct list *list, size_t cpu)
+{
+  struct list_elem *e;
+
+  for (e = list_begin (list); e != list_end (list); e = list_next (e))
+    {
+      struct thread *t = list_entry (e, struct thread, elem);
+      if (cpu_allowed (t, cpu))
+        return t;
+    }
+  return NULL;
+}
+
+/* Removes and returns the deadline thread in RQ with the
+   earliest deadline that may run on CPU, or the highest-priority
+   such normal thread if there is none, or the first such batch
+   thread if there is neither, or a null pointer.  Every thread
+   on a CPU's own queue may run there, so for it this takes the
+   front of the highest non-empty queue.  Interrupts must be
+   off. */
+static struct thread *
+runq_pop (struct runq *rq, size_t cpu)
+{
+  struct thread *t = NULL;
+  int level;
+
+  spin_lock (&rq->lock);
+  t = runq_first_allowed (&rq->deadline, cpu);
+  for (level = ready_max_priority (rq) - PRI_MIN; level >= 0 && t == NULL;
+       level--)
+    if (rq->mask[level / 32] & ((uint32_t) 1 << (level % 32)))
+      t = runq_first_allowed (&rq->queues[level], cpu);
+  if (t == NULL)
+    t = runq_first_allowed (&rq->batch, cpu);
+  if (t != NULL)
+    runq_remove (rq, t);
+  spin_unlock (&rq->lock);
+  return t;
+}
+
+/* Takes the highest-priority thread that may run on SELF's CPU
+   from the longest run queue other than SELF and moves it to
+   SELF's CPU.  Returns the thread, or a null pointer if that
+   queue holds none.  Interrupts must be off. */
+static struct thread *
+runq_steal (struct runq *self)
+{
+  struct runq *busiest = NULL;
+  struct thread *t;
+  size_t cpu;
+
+  for (cpu = 0; cpu < runq_cnt; cpu++)
+    {
+      struct runq *rq = &runqs[cpu];
+      if (rq != self && rq->cnt > 0
+          && (busiest == NULL || rq->cnt > busiest->cnt))
+        busiest = rq;
+    }
+  if (busiest == NULL)
+    return NULL;
+
+  t = runq_pop (busiest, self - runqs);
+  if (t == NULL)
+    return NULL;
+  t->cpu = self - runqs;
+  busiest->stolen++;
+  self->steals++;
+  return t;
+}
+
 /* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
-   empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   return a thread from this CPU's run queue, or one stolen from
+   another CPU's, unless all run queues are empty.  (If the
+   running thread can continue running, then it will be in the
+   run queue.)  If the run queues are empty, return this CPU's
+   idle thread. */
 static struct thread *
 next_thread_to_run (void) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  struct runq *self = runq_self ();
+  struct thread *t = runq_pop (self, self - runqs);
+
+  if (t == NULL)
+    t = runq_steal (self);
+  return t != NULL ? t : self->idle;
 }
 
 /* Completes a thread switch by activating the new thread's page
@@ -551,9 +1674,16 @@ thread_schedule_tail (struct thread *prev)
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  runqs[cur->cpu].curr = cur;
+  runqs[cur->cpu].quiescent_cnt++;
 
   /* Start new time slice. */
   thread_ticks = 0;
+  if (prev != NULL)
+    account_switch_in (cur);
+
+  /* Make the FPU trap if it holds another thread's registers. */
+  fpu_activate (cur);
 
 #ifdef USERPROG
   /* Activate the new address space. */
@@ -568,8 +1698,8 @@ thread_schedule_tail (struct thread *prev)
   if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
     {
       ASSERT (prev != cur);
-      /* Disable free at schedule. Process descriptor will free by wait. */
-      //palloc_free_page (prev);
+      fpu_release (prev);
+      thread_page_free (prev);
     }
 }
 
@@ -589,10 +1719,15 @@ schedule (void)
 
   ASSERT (intr_get_level () == INTR_OFF);
   ASSERT (cur->status != THREAD_RUNNING);
+  ASSERT (cur->rcu_depth == 0);
   ASSERT (is_thread (next));
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      TRACE (TRACE_SWITCH, cur->tid, next->tid);
+      account_switch_out (cur);
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
@@ -609,6 +1744,117 @@ allocate_tid (void)
 
   return tid;
 }
+
+/* Counts CUR, which is about to be switched out, as blocking or
+   as preempted.  Interrupts must be off. */
+static void
+account_switch_out (struct thread *cur)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  cur->cpu_time[cur->cpu_mode] += timer_cycles () - cur->cpu_since;
+  if (is_idle (cur))
+    return;
+  cur->stopped_tick = timer_ticks ();
+  if (cur->status == THREAD_READY)
+    {
+      cur->involuntary_cnt++;
+      this_cpu_inc (involuntary_switches);
+      cur->ready_since = timer_cycles ();
+      cur->woken = false;
+    }
+  else if (cur->status == THREAD_BLOCKED)
+    {
+      cur->voluntary_cnt++;
+      this_cpu_inc (voluntary_switches);
+    }
+}
+
+/* Records the time that CUR, which has just been switched in,
+   spent ready to run.  Interrupts must be off. */
+static void
+account_switch_in (struct thread *cur)
+{
+  uint64_t wait;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  cur->cpu_since = timer_cycles ();
+  if (is_idle (cur))
+    return;
+  wait = cur->cpu_since - cur->ready_since;
+  cur->ready_time += wait;
+  if (cur->woken)
+    wakeup_latency[latency_bucket (wait)]++;
+}
+
+/* Returns the wakeup_latency bucket for a wait of CYCLES. */
+static int
+latency_bucket (uint64_t cycles)
+{
+  int bucket = 0;
+
+  while (bucket < SCHED_LATENCY_BUCKETS - 1 && cycles >= 2)
+    {
+      cycles >>= 1;
+      bucket++;
+    }
+  return bucket;
+}
+
+/* Returns the bucket of tid_buckets that holds the thread whose
+   tid is TID.  Tids are handed out in order, so their low bits
+   spread live threads evenly. */
+static struct list *
+tid_bucket (tid_t tid)
+{
+  return &tid_buckets[tid & (TID_BUCKETS - 1)];
+}
+
+/* Returns a page for a new thread, from the cache of dead
+   threads' pages if it has one, or a null pointer if no page is
+   available.  Only the struct thread at its bottom needs
+   initializing, which init_thread() does. */
+static struct thread *
+thread_page_get (void)
+{
+  enum intr_level old_level;
+  void **page;
+
+  old_level = spin_lock_irqsave (&thread_cache_lock);
+  page = thread_cache;
+  if (page != NULL)
+    {
+      thread_cache = *page;
+      thread_cache_cnt--;
+    }
+  spin_unlock_irqrestore (&thread_cache_lock, old_level);
+
+  return page != NULL ? (struct thread *) page : palloc_get_page (0);
+}
+
+/* Frees the page of dead thread T, keeping it in the cache if
+   there is room. */
+static void
+thread_page_free (struct thread *t)
+{
+  enum intr_level old_level;
+  bool cached = false;
+
+  old_level = spin_lock_irqsave (&thread_cache_lock);
+  if (thread_cache_cnt < THREAD_CACHE_MAX)
+    {
+      void **page = (void **) t;
+      *page = thread_cache;
+      thread_cache = page;
+      thread_cache_cnt++;
+      cached = true;
+    }
+  spin_unlock_irqrestore (&thread_cache_lock, old_level);
+
+  if (!cached)
+    palloc_free_page (t);
+}
 
 /* Offset of `stack' member within `struct thread'.
    Used by switch.S, which can't figure it out on its own. */
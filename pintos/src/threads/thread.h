@@ -2,8 +2,15 @@
 #define THREADS_THREAD_H
 
 #include <debug.h>
+#include <heap.h>
 #include <list.h>
+#include <ohash.h>
+#include <rusage.h>
+#include <sched-stats.h>
 #include <stdint.h>
+#include "devices/timer.h"
+#include "threads/fpu.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 
 /* States in a thread's life cycle. */
@@ -15,16 +22,42 @@ enum thread_status
     THREAD_DYING        /* About to be destroyed. */
   };
 
+/* What a running thread is doing, for CPU time accounting. */
+enum cpu_mode
+  {
+    CPU_KERNEL,         /* Kernel code, including system calls. */
+    CPU_USER,           /* User program. */
+    CPU_INTR,           /* External interrupt handler. */
+    CPU_MODE_CNT        /* Number of modes. */
+  };
+
 /* Thread identifier type.
    You can redefine this to whatever type you like. */
 typedef int tid_t;
 #define TID_ERROR ((tid_t) -1)          /* Error value for tid_t. */
 
+/* CPU affinity mask that allows every CPU.  Bit N of a thread's
+   affinity mask allows it to run on CPU N. */
+#define AFFINITY_ALL ((uint32_t) -1)
+
+/* Most CPUs that schedule threads. */
+#define THREAD_CPU_MAX 16
+
 /* Thread priorities. */
 #define PRI_MIN 0                       /* Lowest priority. */
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
 
+/* Thread nice values, for the multi-level feedback queue
+   scheduler. */
+#define NICE_MIN -20                    /* Nicest. */
+#define NICE_DEFAULT 0                  /* Default nice value. */
+#define NICE_MAX 20                     /* Least nice. */
+
+/* Maximum length of a priority donation chain that is followed
+   when a thread blocks on a lock. */
+#define DONATION_DEPTH_MAX 8
+
 /* A kernel thread or user process.
 
    Each thread structure is stored in its own 4 kB page.  The
@@ -88,37 +121,99 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Effective priority. */
+    int sched_class;                    /* SCHED_* class. */
+    bool batch_queued;                  /* On a run queue's batch list? */
     struct list_elem allelem;           /* List element for all threads list. */
+    struct list_elem tidelem;           /* List element in tid hash bucket. */
+    size_t cpu;                         /* CPU last run on, or queued on. */
+    uint32_t affinity;                  /* CPUs allowed to run it. */
+    int64_t stopped_tick;               /* When it last stopped running. */
+
+    /* Priority donation, shared between thread.c and synch.c. */
+    int base_priority;                  /* Priority before donations. */
+    struct lock *wait_on_lock;          /* Lock being waited for, if any. */
+    struct list donations;              /* Threads donating to us. */
+    struct list_elem donation_elem;     /* Element in holder's donations. */
+
+    /* Deadline scheduling class, owned by thread.c.  Times are
+       in timer ticks. */
+    int64_t dl_period;                  /* Length of a period. */
+    int64_t dl_budget;                  /* CPU time allowed per period. */
+    int64_t dl_deadline;                /* End of the current period. */
+    int64_t dl_remaining;               /* Budget left in this period. */
+    bool dl_throttled;                  /* Out of budget until DL_DEADLINE? */
+    struct timeout dl_timeout;          /* Ends throttling. */
+
+    /* Multi-level feedback queue scheduler, owned by thread.c. */
+    int nice;                           /* Niceness. */
+    int recent_cpu;                     /* Recent CPU use, 17.14 fixed point. */
+    bool cpu_dirty;                     /* On cpu_dirty_list? */
+    struct list_elem cpu_dirty_elem;    /* Element in cpu_dirty_list. */
+
+    /* Scheduler statistics, owned by thread.c. */
+    uint64_t ready_since;               /* When it last became ready. */
+    bool woken;                         /* Made ready by thread_unblock()? */
+    uint64_t ready_time;                /* Total time ready, not running. */
+    uint64_t voluntary_cnt;             /* Switches away by blocking. */
+    uint64_t involuntary_cnt;           /* Switches away while ready. */
+    enum cpu_mode cpu_mode;             /* What it is doing now. */
+    uint64_t cpu_since;                 /* When CPU_MODE was last charged. */
+    uint64_t cpu_time[CPU_MODE_CNT];    /* Cycles spent in each mode. */
+
+    /* Resource usage, counted where each resource is used, and
+       for a user thread, added to its process's when it exits. */
+    struct rusage usage;
+
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_tick;                /* Tick to wake up at when sleeping. */
+    struct heap_elem sleep_elem;        /* Element in sleep_heap. */
+
+    /* Owned by threads/fpu.c. */
+    bool fpu_used;                      /* Has used the FPU? */
+    struct fpu_state fpu;               /* Saved FPU registers. */
+
+    /* Owned by threads/malloc.c. */
+    struct magazine magazines[MAG_CLASS_CNT]; /* Cached free blocks. */
+    struct scratch scratch;             /* Arena for system calls. */
+
+    /* Owned by threads/rcu.c. */
+    int rcu_depth;                      /* Read-side sections entered. */
+    bool rcu_yield;                     /* Preempted while in one? */
 
     /* Shared between thread.c and synch.c. */
     struct list_elem elem;              /* List element. */
 
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
-    uint32_t *pagedir;                  /* Page directory. */
-
-    /* Connect parent process and child process. */
-    struct thread *parent_process;
-    struct list child_process;
-    struct list_elem childelem;
+    struct process *process;            /* User process, or NULL. */
 
-    /* Flag for check status. */
-    bool is_load;
-    bool is_exit;
+    /* The process's page directory and kernel data page, mapped
+       read-only at KDATA_ADDR, copied here for the scheduler.
+       Both are NULL until the thread starts running in its
+       process and once it leaves. */
+    uint32_t *pagedir;
+    struct kdata *kdata;
 
-    /* Control process flow. */
-    struct semaphore exit;
-    struct semaphore load;
+    /* CHILDREN maps pid to status record of each child this thread
+       started, made by first exec.  EXITED_CHILDREN holds those
+       that have exited but not been waited for, in order of exit,
+       and CHILD_EXITED counts them. */
+    struct ohash *children;
+    struct list exited_children;
+    struct semaphore child_exited;
 
-    /* Mark exit status. */
+    /* Mark exit status.  UTHREAD is this thread's record for
+       uthread_join(), or NULL for a process's first thread.
+       THREAD_ONLY is set by uthread_exit(), which leaves the rest
+       of the process running. */
     int exit_status;
-
-    /* File Descriptor Table. */
-    struct file **fdt;
-
-    /* Next position for save file into file descriptor table. */
-    int next_fd;
+    struct uthread *uthread;
+    bool thread_only;
+#endif
+#ifdef VM
+    /* Owned by vm/page.c. */
+    void *user_esp;                     /* User esp on entry to kernel. */
 #endif
 
     /* Owned by thread.c. */
@@ -130,19 +225,39 @@ struct thread
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* Time slices, in milliseconds, for equal bands of priorities
+   from lowest to highest.  Set by kernel command-line option
+   "-ts". */
+#define THREAD_SLICE_BANDS 3
+extern int thread_slice_ms[THREAD_SLICE_BANDS];
+
 void thread_init (void);
 void thread_start (void);
 
 void thread_tick (void);
+void thread_idle_ticks (int64_t cnt);
 void thread_print_stats (void);
+bool thread_get_sched_stats (tid_t, struct sched_stats *);
+enum cpu_mode thread_set_cpu_mode (enum cpu_mode);
+void thread_get_usage (struct thread *, struct rusage *);
+void thread_clear_usage (struct thread *);
+#ifdef USERPROG
+void thread_update_kdata (struct thread *);
+#endif
 
 typedef void thread_func (void *aux);
 tid_t thread_create (const char *name, int priority, thread_func *, void *);
 
 void thread_block (void);
 void thread_unblock (struct thread *);
+void thread_preempt (void);
+
+size_t thread_cpu_cnt (void);
+unsigned thread_cpu_quiescent_cnt (size_t cpu);
+bool thread_cpu_idle (size_t cpu);
 
 struct thread *thread_current (void);
+struct thread *running_thread (void);
 tid_t thread_tid (void);
 const char *thread_name (void);
 
@@ -152,9 +267,16 @@ void thread_yield (void);
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
 void thread_foreach (thread_action_func *, void *);
+struct thread *thread_lookup (tid_t);
 
 int thread_get_priority (void);
+int thread_set_sched_class (int);
+bool thread_set_deadline (int64_t period, int64_t budget);
+bool thread_set_affinity (tid_t, uint32_t affinity);
 void thread_set_priority (int);
+void thread_donate_priority (void);
+void thread_remove_donations (struct lock *);
+void thread_refresh_priority (void);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
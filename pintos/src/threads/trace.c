@@ -0,0 +1,121 @@
+#include "threads/trace.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/mp.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef FILESYS
+#include "devices/block.h"
+#include "filesys/fsutil.h"
+#endif
+
+/* Kernel event tracing.
+
+   Each CPU has a ring of TRACE_RECORDS trace records.  Once a
+   ring is full, each new record replaces the oldest.  A CPU only
+   writes its own ring, and it claims a slot by adding to the
+   ring's head with a single xadd instruction, which an interrupt
+   cannot split, so recording takes no lock and leaves interrupts
+   alone.  An interrupt handler's records may land between a
+   slot's claiming and its filling in, so records are not quite
+   in time order within a ring: order them by `tsc'.
+
+   At power-off, trace_dump() writes the rings to the scratch
+   device as file "trace" of a ustar archive, after any files
+   written by the "append" action, for offline analysis. */
+
+#define TRACE_RECORDS 4096      /* Records per CPU, a power of 2. */
+#define TRACE_CPU_MAX 8         /* Most CPUs traced. */
+#define RING_SIZE (TRACE_RECORDS * sizeof (struct trace_record))
+
+/* Set by kernel command-line option "-trace". */
+bool trace_enabled;
+
+/* TRACE_RECORDS records for each of RING_CNT CPUs, in one
+   allocation so that they can be dumped in one piece. */
+static struct trace_record *rings;
+static size_t ring_cnt;
+
+/* heads[CPU] counts the records CPU has ever claimed. */
+static uint32_t heads[TRACE_CPU_MAX];
+
+/* Allocates the trace rings, if tracing is enabled.  No records
+   are kept before this is called. */
+void
+trace_init (void)
+{
+  size_t cnt = mp_cpu_cnt ();
+
+  if (!trace_enabled)
+    return;
+
+  if (cnt > TRACE_CPU_MAX)
+    cnt = TRACE_CPU_MAX;
+  rings = palloc_get_multiple (PAL_ZERO,
+                               DIV_ROUND_UP (cnt * RING_SIZE, PGSIZE));
+  if (rings == NULL)
+    {
+      printf ("trace: out of memory, tracing disabled\n");
+      trace_enabled = false;
+      return;
+    }
+  ring_cnt = cnt;
+}
+
+/* Records EVENT with data A and B in the running CPU's ring.  Use
+   TRACE instead of calling this directly. */
+void
+trace_record (enum trace_event event, uint32_t a, uint32_t b)
+{
+  struct trace_record *r;
+  struct thread *t;
+  uint32_t *esp;
+  uint32_t slot = 1;
+
+  /* Find the running thread as running_thread() does, because
+     thread_current() insists on a running thread, which there is
+     not in the middle of a thread switch. */
+  asm ("mov %%esp, %0" : "=g" (esp));
+  t = pg_round_down (esp);
+  if (t->cpu >= ring_cnt)
+    return;
+
+  asm volatile ("xaddl %0, %1" : "+r" (slot), "+m" (heads[t->cpu]));
+  r = &rings[t->cpu * TRACE_RECORDS + slot % TRACE_RECORDS];
+  r->tsc = timer_cycles ();
+  r->event = event;
+  r->cpu = t->cpu;
+  r->pad = 0;
+  r->tid = t->tid;
+  r->a = a;
+  r->b = b;
+}
+
+/* Stops tracing and writes the trace records to the scratch
+   device, if there is one. */
+void
+trace_dump (void)
+{
+#ifdef FILESYS
+  size_t cpu;
+
+  if (ring_cnt == 0)
+    return;
+  trace_enabled = false;
+
+  if (block_get_role (BLOCK_SCRATCH) == NULL)
+    {
+      printf ("trace: no scratch device, records not saved\n");
+      return;
+    }
+  for (cpu = 0; cpu < ring_cnt; cpu++)
+    printf ("trace: CPU %zu recorded %"PRIu32" events, kept %"PRIu32"\n",
+            cpu, heads[cpu],
+            heads[cpu] < TRACE_RECORDS ? heads[cpu] : TRACE_RECORDS);
+  fsutil_append_data ("trace", rings, ring_cnt * RING_SIZE);
+#endif
+}
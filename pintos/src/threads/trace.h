@@ -0,0 +1,50 @@
+#ifndef THREADS_TRACE_H
+#define THREADS_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Kinds of trace records, and what their A and B hold. */
+enum trace_event
+  {
+    TRACE_SWITCH,               /* Thread switch: old tid, new tid. */
+    TRACE_INTR,                 /* Interrupt: vector, interrupted eip. */
+    TRACE_SYSCALL,              /* System call: number, user eip. */
+    TRACE_PAGE_FAULT,           /* Page fault: address, error code. */
+    TRACE_IDE_READ,             /* Disk read starts: sector, count. */
+    TRACE_IDE_WRITE,            /* Disk write starts: sector, count. */
+    TRACE_IDE_DONE              /* Disk transfer ends: sector, count. */
+  };
+
+/* A trace record, as stored in memory and in the dump on the
+   scratch device.  Slots that were never written are all
+   zeros. */
+struct trace_record
+  {
+    uint64_t tsc;               /* Time-stamp counter when recorded. */
+    uint16_t event;             /* A trace_event. */
+    uint8_t cpu;                /* CPU that recorded it. */
+    uint8_t pad;                /* Unused, always 0. */
+    int32_t tid;                /* Thread running at the time. */
+    uint32_t a, b;              /* Event-specific data. */
+  };
+
+/* Set by kernel command-line option "-trace". */
+extern bool trace_enabled;
+
+/* Records EVENT with data A and B, if tracing is enabled.  Costs
+   one test and branch otherwise.  Safe to use anywhere,
+   including in interrupt handlers and with interrupts off. */
+#define TRACE(EVENT, A, B)                                      \
+        do                                                      \
+          {                                                     \
+            if (trace_enabled)                                  \
+              trace_record ((EVENT), (uint32_t) (A), (uint32_t) (B)); \
+          }                                                     \
+        while (0)
+
+void trace_init (void);
+void trace_record (enum trace_event, uint32_t a, uint32_t b);
+void trace_dump (void);
+
+#endif /* threads/trace.h */
@@ -0,0 +1,202 @@
+#include "threads/vmalloc.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "threads/init.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Virtually contiguous allocator.
+
+   palloc_get_multiple() needs physically contiguous pages, which
+   a fragmented kernel pool may not have even when plenty of
+   single pages are free.  vmalloc() instead takes single pages
+   from the kernel pool and maps them at consecutive addresses in
+   a window of kernel virtual memory set aside for it.
+
+   The page tables for the whole window are allocated by
+   vmalloc_init(), before any process page directory is copied
+   from init_page_dir, so every page directory shares them and
+   mapping or unmapping a page changes every address space at
+   once.  Only the bootstrap processor runs kernel code, so
+   invlpg on it is enough to drop stale mappings.
+
+   Each allocation is followed by one unmapped guard page, which
+   catches overruns and also marks where the allocation ends, so
+   vfree() needs no size. */
+
+#define WINDOW_PAGES (VMALLOC_SIZE / PGSIZE)
+
+static struct lock vmalloc_lock;        /* Protects all below. */
+static struct bitmap *used_map;         /* Window pages in use. */
+static uint32_t *window_ptes;           /* PTEs for the window. */
+static size_t live_pages;               /* Pages now mapped. */
+static size_t peak_pages;               /* Maximum of live_pages. */
+
+static uint32_t *window_pte (const void *);
+static size_t alloc_range (size_t page_cnt, size_t align_pages);
+
+/* Allocates the page tables for the vmalloc() window and enters
+   them in init_page_dir.  Must be called after paging_init() and
+   before any page directory is created. */
+void
+vmalloc_init (void) 
+{
+  size_t pt_cnt = VMALLOC_SIZE / PTSPAN;
+  size_t i;
+
+  ASSERT (pg_ofs (VMALLOC_START) == 0
+          && (uintptr_t) VMALLOC_START % PTSPAN == 0);
+
+  lock_init (&vmalloc_lock);
+  used_map = bitmap_create (WINDOW_PAGES);
+  window_ptes = palloc_get_multiple (PAL_ASSERT | PAL_ZERO, pt_cnt);
+  if (used_map == NULL)
+    PANIC ("vmalloc_init: out of memory");
+  for (i = 0; i < pt_cnt; i++)
+    init_page_dir[pd_no (VMALLOC_START) + i]
+      = pde_create (window_ptes + i * (PGSIZE / sizeof *window_ptes));
+}
+
+/* Obtains and returns SIZE bytes of virtually contiguous kernel
+   memory, starting at a page boundary.  Returns a null pointer
+   if SIZE is 0 or memory is not available. */
+void *
+vmalloc (size_t size) 
+{
+  return vmalloc_aligned (size, PGSIZE);
+}
+
+/* Like vmalloc(), but the memory starts at a multiple of ALIGN,
+   which must be a power of 2 no smaller than PGSIZE. */
+void *
+vmalloc_aligned (size_t size, size_t align) 
+{
+  size_t page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  size_t first, i;
+  uint8_t *start;
+
+  ASSERT (align >= PGSIZE && (align & (align - 1)) == 0);
+  if (page_cnt == 0)
+    return NULL;
+
+  lock_acquire (&vmalloc_lock);
+  first = alloc_range (page_cnt + 1, align / PGSIZE);
+  lock_release (&vmalloc_lock);
+  if (first == BITMAP_ERROR)
+    return NULL;
+
+  start = (uint8_t *) VMALLOC_START + first * PGSIZE;
+  for (i = 0; i < page_cnt; i++)
+    {
+      void *kpage = palloc_get_page (0);
+      if (kpage == NULL)
+        {
+          /* Undo what we have done so far. */
+          while (i-- > 0)
+            {
+              uint32_t *pte = window_pte (start + i * PGSIZE);
+              palloc_free_page (pte_get_page (*pte));
+              *pte = 0;
+              asm volatile ("invlpg (%0)"
+                            : : "r" (start + i * PGSIZE) : "memory");
+            }
+          lock_acquire (&vmalloc_lock);
+          bitmap_set_multiple (used_map, first, page_cnt + 1, false);
+          lock_release (&vmalloc_lock);
+          return NULL;
+        }
+      *window_pte (start + i * PGSIZE) = pte_create_kernel (kpage, true);
+    }
+
+  lock_acquire (&vmalloc_lock);
+  live_pages += page_cnt;
+  if (live_pages > peak_pages)
+    peak_pages = live_pages;
+  lock_release (&vmalloc_lock);
+  return start;
+}
+
+/* Frees P, which must have been returned by vmalloc() or
+   vmalloc_aligned().  Does nothing if P is null. */
+void
+vfree (void *p) 
+{
+  uint8_t *page = p;
+  size_t page_cnt = 0;
+  uint32_t *pte;
+
+  if (p == NULL)
+    return;
+  ASSERT (is_vmalloc_vaddr (p) && pg_ofs (p) == 0);
+
+  for (; (*(pte = window_pte (page)) & PTE_P) != 0; page += PGSIZE) 
+    {
+      palloc_free_page (pte_get_page (*pte));
+      *pte = 0;
+      asm volatile ("invlpg (%0)" : : "r" (page) : "memory");
+      page_cnt++;
+    }
+  ASSERT (page_cnt > 0);
+
+  lock_acquire (&vmalloc_lock);
+  bitmap_set_multiple (used_map, pg_no (p) - pg_no (VMALLOC_START),
+                       page_cnt + 1, false);
+  live_pages -= page_cnt;
+  lock_release (&vmalloc_lock);
+}
+
+/* Returns the number of bytes mapped at P, which must have been
+   returned by vmalloc() or vmalloc_aligned(). */
+size_t
+vmalloc_size (const void *p) 
+{
+  const uint8_t *page = p;
+
+  ASSERT (is_vmalloc_vaddr (p) && pg_ofs (p) == 0);
+  while ((*window_pte (page) & PTE_P) != 0)
+    page += PGSIZE;
+  return page - (const uint8_t *) p;
+}
+
+/* Prints vmalloc() statistics. */
+void
+vmalloc_print_stats (void) 
+{
+  printf ("Vmalloc: %zu of %d pages used (max %zu)\n",
+          live_pages, WINDOW_PAGES, peak_pages);
+}
+
+/* Returns the PTE for VADDR in the window's page tables. */
+static uint32_t *
+window_pte (const void *vaddr) 
+{
+  ASSERT (is_vmalloc_vaddr (vaddr));
+  return &window_ptes[pg_no (vaddr) - pg_no (VMALLOC_START)];
+}
+
+/* Finds PAGE_CNT free window pages, the first of them at a
+   multiple of ALIGN_PAGES, marks them used, and returns the
+   index of the first.  Returns BITMAP_ERROR if there is no such
+   range.  vmalloc_lock must be held. */
+static size_t
+alloc_range (size_t page_cnt, size_t align_pages) 
+{
+  size_t start;
+
+  ASSERT (lock_held_by_current_thread (&vmalloc_lock));
+
+  if (align_pages == 1)
+    return bitmap_scan_and_flip (used_map, 0, page_cnt, false);
+  for (start = 0; start + page_cnt <= WINDOW_PAGES; start += align_pages)
+    if (bitmap_none (used_map, start, page_cnt))
+      {
+        bitmap_set_multiple (used_map, start, page_cnt, true);
+        return start;
+      }
+  return BITMAP_ERROR;
+}
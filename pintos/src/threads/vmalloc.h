@@ -0,0 +1,27 @@
+#ifndef THREADS_VMALLOC_H
+#define THREADS_VMALLOC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Start and size of the kernel virtual window for vmalloc(),
+   well above the mapping of physical memory at PHYS_BASE. */
+#define VMALLOC_START ((void *) 0xf0000000)
+#define VMALLOC_SIZE (16 * 1024 * 1024)
+
+void vmalloc_init (void);
+void *vmalloc (size_t) __attribute__ ((malloc));
+void *vmalloc_aligned (size_t, size_t align) __attribute__ ((malloc));
+void vfree (void *);
+size_t vmalloc_size (const void *);
+void vmalloc_print_stats (void);
+
+/* Returns true if VADDR lies in the vmalloc() window. */
+static inline bool
+is_vmalloc_vaddr (const void *vaddr)
+{
+  return (vaddr >= VMALLOC_START
+          && (char *) vaddr < (char *) VMALLOC_START + VMALLOC_SIZE);
+}
+
+#endif /* threads/vmalloc.h */
@@ -0,0 +1,94 @@
+#include "threads/waitq.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+
+static timeout_func poll_timeout;
+
+/* Initializes Q as an empty wait queue. */
+void
+waitq_init (struct wait_queue *q)
+{
+  list_init (&q->entries);
+}
+
+/* Wakes every thread waiting on Q.  May be called from an
+   interrupt handler. */
+void
+waitq_wake (struct wait_queue *q)
+{
+  enum intr_level old_level = intr_disable ();
+  struct list_elem *e;
+
+  for (e = list_begin (&q->entries); e != list_end (&q->entries);
+       e = list_next (e))
+    {
+      struct poll_entry *pe = list_entry (e, struct poll_entry, elem);
+      sema_up (&pe->table->woken);
+    }
+  intr_set_level (old_level);
+}
+
+/* Initializes PT as a poll table on no queues. */
+void
+poll_init (struct poll_table *pt)
+{
+  sema_init (&pt->woken, 0);
+  pt->entry_cnt = 0;
+}
+
+/* Puts PT on Q, so that waking Q ends a poll_wait() on PT.  Does
+   nothing if PT is already on as many queues as it can be, which
+   only makes poll_wait() rely on its timeout. */
+void
+poll_register (struct poll_table *pt, struct wait_queue *q)
+{
+  enum intr_level old_level;
+  struct poll_entry *pe;
+
+  if (pt->entry_cnt >= POLL_TABLE_MAX)
+    return;
+  pe = &pt->entries[pt->entry_cnt++];
+  pe->queue = q;
+  pe->table = pt;
+  old_level = intr_disable ();
+  list_push_back (&q->entries, &pe->elem);
+  intr_set_level (old_level);
+}
+
+/* Waits until one of PT's queues is woken, or for TICKS timer
+   ticks if TICKS is not negative.  Returns false if the time ran
+   out, true otherwise. */
+bool
+poll_wait (struct poll_table *pt, int64_t ticks)
+{
+  bool timed_out;
+
+  if (ticks == 0)
+    return false;
+  if (ticks > 0)
+    timer_arm (&pt->timeout, ticks, poll_timeout, pt);
+  sema_down (&pt->woken);
+  timed_out = ticks > 0 && !timer_cancel (&pt->timeout);
+  return !timed_out;
+}
+
+/* Takes PT off every queue it is on. */
+void
+poll_done (struct poll_table *pt)
+{
+  enum intr_level old_level = intr_disable ();
+  size_t i;
+
+  for (i = 0; i < pt->entry_cnt; i++)
+    list_remove (&pt->entries[i].elem);
+  pt->entry_cnt = 0;
+  intr_set_level (old_level);
+}
+
+/* Ends poll_wait() on the poll table AUX. */
+static void
+poll_timeout (struct timeout *t UNUSED, void *pt_)
+{
+  struct poll_table *pt = pt_;
+  sema_up (&pt->woken);
+}
@@ -0,0 +1,59 @@
+#ifndef THREADS_WAITQ_H
+#define THREADS_WAITQ_H
+
+#include <list.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/timer.h"
+#include "threads/synch.h"
+
+/* Wait queues, for waiting on several objects at once.
+
+   An object that a thread may wait on, such as a pipe or the
+   console input buffer, embeds a struct wait_queue and calls
+   waitq_wake() whenever it may have become ready.  A thread that
+   waits gathers its interest in a struct poll_table:  it checks
+   each object after registering the table on the object's queue
+   with poll_register(), so that a wakeup between the check and
+   the wait is not missed, then calls poll_wait() if none was
+   ready, and finally poll_done() to leave every queue.
+
+   Queues are protected by turning interrupts off, so waitq_wake()
+   may be called from an interrupt handler. */
+
+/* Most objects a poll table waits on, enough for one queue for
+   each descriptor poll() takes. */
+#define POLL_TABLE_MAX POLL_MAX
+
+struct wait_queue
+  {
+    struct list entries;        /* struct poll_entry's of waiters. */
+  };
+
+/* A poll table's place on one wait queue. */
+struct poll_entry
+  {
+    struct list_elem elem;      /* Element in QUEUE's `entries'. */
+    struct wait_queue *queue;   /* Queue it is on. */
+    struct poll_table *table;   /* Table it belongs to. */
+  };
+
+struct poll_table
+  {
+    struct semaphore woken;     /* Up'd by wakeups and the timeout. */
+    struct timeout timeout;     /* Ends poll_wait(). */
+    size_t entry_cnt;           /* Number of ENTRIES in use. */
+    struct poll_entry entries[POLL_TABLE_MAX];
+  };
+
+void waitq_init (struct wait_queue *);
+void waitq_wake (struct wait_queue *);
+
+void poll_init (struct poll_table *);
+void poll_register (struct poll_table *, struct wait_queue *);
+bool poll_wait (struct poll_table *, int64_t ticks);
+void poll_done (struct poll_table *);
+
+#endif /* threads/waitq.h */
@@ -0,0 +1,272 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Shared kernel workqueue.
+
+   Rather than start a thread of its own, kernel code that wants
+   something done in the background, now or after a delay, hands
+   a struct work to a small pool of WORKER_CNT worker threads.
+   Each priority has its own queue, and an idle worker takes the
+   oldest work from the highest-priority queue that has any and
+   runs it at that queue's thread priority.
+
+   A work is never run by two workers at once: queueing it while
+   it runs only tells its worker to queue it again once its
+   function returns.  So a work's function needs no locking
+   against itself.
+
+   Delayed work is queued from the timer interrupt, so the queues
+   are protected by turning interrupts off. */
+
+/* Number of worker threads. */
+#define WORKER_CNT 3
+
+/* A worker thread's state. */
+struct worker
+  {
+    struct work *current;       /* Work being run, or NULL. */
+    bool requeue;               /* Queue CURRENT again when done? */
+  };
+
+static struct worker workers[WORKER_CNT];
+
+/* Queued work, oldest first, one list per priority. */
+static struct list queues[WORK_PRI_CNT];
+
+/* Upped once for each work queued. */
+static struct semaphore work_ready;
+
+/* Thread priority at which work of each priority runs.  The
+   4.4BSD scheduler ignores these and computes its own. */
+static const int work_thread_pri[WORK_PRI_CNT] =
+  {
+    PRI_DEFAULT + 1,            /* WORK_HIGH. */
+    PRI_DEFAULT,                /* WORK_NORMAL. */
+    PRI_MIN                     /* WORK_LOW. */
+  };
+
+static thread_func worker_loop NO_RETURN;
+static timeout_func work_timeout;
+static void enqueue (struct work *);
+static struct worker *running_worker (const struct work *);
+
+/* Initializes the work queues.  Work may be queued from then on,
+   but none runs until workqueue_start() is called. */
+void
+workqueue_init (void)
+{
+  int i;
+
+  for (i = 0; i < WORK_PRI_CNT; i++)
+    list_init (&queues[i]);
+  sema_init (&work_ready, 0);
+}
+
+/* Starts the worker threads. */
+void
+workqueue_start (void)
+{
+  size_t i;
+
+  for (i = 0; i < WORKER_CNT; i++)
+    {
+      char name[16];
+
+      snprintf (name, sizeof name, "worker%zu", i);
+      thread_create (name, PRI_DEFAULT, worker_loop, &workers[i]);
+    }
+}
+
+/* Initializes W as work of the given PRIORITY, not yet queued. */
+void
+work_init (struct work *w, enum work_priority priority)
+{
+  ASSERT (w != NULL);
+  ASSERT (priority < WORK_PRI_CNT);
+
+  w->func = NULL;
+  w->aux = NULL;
+  w->priority = priority;
+  w->pending = false;
+  w->timeout.armed = false;
+}
+
+/* Queues W to call FUNC with auxiliary data AUX in a worker
+   thread.  Returns true if successful, false if W was already
+   queued or delayed, in which case it runs only once, with the
+   FUNC and AUX it was first queued with.
+
+   This function may be called from an interrupt handler. */
+bool
+work_queue (struct work *w, work_func *func, void *aux)
+{
+  enum intr_level old_level;
+  bool queued;
+
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  old_level = intr_disable ();
+  queued = !w->pending;
+  if (queued)
+    {
+      w->func = func;
+      w->aux = aux;
+      w->pending = true;
+      enqueue (w);
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Like work_queue(), but queues W only after approximately TICKS
+   timer ticks, from the timer interrupt handler.
+
+   This function may be called from an interrupt handler. */
+bool
+work_queue_delayed (struct work *w, int64_t ticks, work_func *func,
+                    void *aux)
+{
+  enum intr_level old_level;
+  bool queued;
+
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  old_level = intr_disable ();
+  queued = !w->pending;
+  if (queued)
+    {
+      w->func = func;
+      w->aux = aux;
+      w->pending = true;
+      timer_arm (&w->timeout, ticks, work_timeout, w);
+    }
+  intr_set_level (old_level);
+  return queued;
+}
+
+/* Cancels W if it is queued or delayed.  Returns true if it was,
+   false otherwise.  If W is running, lets it finish without
+   waiting for it.
+
+   This function may be called from an interrupt handler. */
+bool
+work_cancel (struct work *w)
+{
+  enum intr_level old_level;
+  bool cancelled;
+
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  cancelled = w->pending;
+  if (cancelled && !timer_cancel (&w->timeout))
+    {
+      /* Queued, either on its list or, if running, by its
+         worker. */
+      struct worker *worker = running_worker (w);
+      if (worker != NULL)
+        worker->requeue = false;
+      else
+        list_remove (&w->elem);
+    }
+  w->pending = false;
+  intr_set_level (old_level);
+  return cancelled;
+}
+
+/* Worker thread SELF_.  Runs queued work, highest priority
+   first. */
+static void
+worker_loop (void *self_)
+{
+  struct worker *self = self_;
+
+  for (;;)
+    {
+      struct work *w = NULL;
+      work_func *func = NULL;
+      void *aux = NULL;
+      enum work_priority priority = WORK_NORMAL;
+      enum intr_level old_level;
+      int i;
+
+      sema_down (&work_ready);
+
+      /* Cancelled work leaves the semaphore upped with nothing
+         to take. */
+      old_level = intr_disable ();
+      for (i = 0; i < WORK_PRI_CNT && w == NULL; i++)
+        if (!list_empty (&queues[i]))
+          w = list_entry (list_pop_front (&queues[i]), struct work, elem);
+      if (w != NULL)
+        {
+          func = w->func;
+          aux = w->aux;
+          priority = w->priority;
+          w->pending = false;
+          self->current = w;
+          self->requeue = false;
+        }
+      intr_set_level (old_level);
+      if (w == NULL)
+        continue;
+
+      thread_set_priority (work_thread_pri[priority]);
+      func (w, aux);
+
+      /* FUNC may have freed W, but not if W was queued again. */
+      old_level = intr_disable ();
+      if (self->requeue)
+        {
+          list_push_back (&queues[w->priority], &w->elem);
+          sema_up (&work_ready);
+        }
+      self->current = NULL;
+      intr_set_level (old_level);
+    }
+}
+
+/* Timeout function for delayed work AUX. */
+static void
+work_timeout (struct timeout *t UNUSED, void *aux)
+{
+  enqueue (aux);
+}
+
+/* Puts pending work W on its queue and wakes a worker, unless a
+   worker is running W, in which case that worker queues it when
+   done.  Interrupts must be off. */
+static void
+enqueue (struct work *w)
+{
+  struct worker *worker = running_worker (w);
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (worker != NULL)
+    worker->requeue = true;
+  else
+    {
+      list_push_back (&queues[w->priority], &w->elem);
+      sema_up (&work_ready);
+    }
+}
+
+/* Returns the worker running W, or a null pointer if none is.
+   Interrupts must be off. */
+static struct worker *
+running_worker (const struct work *w)
+{
+  size_t i;
+
+  for (i = 0; i < WORKER_CNT; i++)
+    if (workers[i].current == w)
+      return &workers[i];
+  return NULL;
+}
@@ -0,0 +1,50 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "devices/timer.h"
+
+/* Priorities of deferred work, highest first.  Queued work of a
+   higher priority always starts before work of a lower one, and
+   runs at a matching thread priority. */
+enum work_priority
+  {
+    WORK_HIGH,                  /* Someone is likely to wait for it. */
+    WORK_NORMAL,                /* Ordinary background work. */
+    WORK_LOW,                   /* Only when nothing else wants the CPU. */
+    WORK_PRI_CNT                /* Number of priorities. */
+  };
+
+struct work;
+
+/* Function that does work W, given auxiliary data AUX.  Runs in
+   a worker thread, so it may sleep. */
+typedef void work_func (struct work *w, void *aux);
+
+/* A piece of deferred work, initialized with work_init() and
+   then queued with work_queue() or work_queue_delayed() as often
+   as needed.  The caller owns the storage; it must stay valid
+   while the work is queued, but the work's function may free
+   it. */
+struct work
+  {
+    struct list_elem elem;      /* Element in a work queue. */
+    work_func *func;            /* Function to call. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    enum work_priority priority; /* Queue to wait in. */
+    bool pending;               /* Queued or delayed, not yet started? */
+    struct timeout timeout;     /* Delay before work_queue_delayed() queues. */
+  };
+
+void workqueue_init (void);
+void workqueue_start (void);
+
+void work_init (struct work *, enum work_priority);
+bool work_queue (struct work *, work_func *, void *aux);
+bool work_queue_delayed (struct work *, int64_t ticks, work_func *,
+                         void *aux);
+bool work_cancel (struct work *);
+
+#endif /* threads/workqueue.h */
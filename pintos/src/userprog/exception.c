@@ -2,13 +2,23 @@
 #include <inttypes.h>
 #include <stdio.h>
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
+#include "userprog/usercopy.h"
+#ifdef VM
+#include "vm/page.h"
+#endif
 
 /* Number of page faults processed. */
 static long long page_fault_cnt;
 
 static void kill (struct intr_frame *);
+static void debug (struct intr_frame *);
 static void page_fault (struct intr_frame *);
 
 /* Registers handlers for interrupts that can be caused by user
@@ -43,10 +53,8 @@ exception_init (void)
      caused indirectly, e.g. #DE can be caused by dividing by
      0.  */
   intr_register_int (0, 0, INTR_ON, kill, "#DE Divide Error");
-  intr_register_int (1, 0, INTR_ON, kill, "#DB Debug Exception");
+  intr_register_int (1, 0, INTR_ON, debug, "#DB Debug Exception");
   intr_register_int (6, 0, INTR_ON, kill, "#UD Invalid Opcode Exception");
-  intr_register_int (7, 0, INTR_ON, kill,
-                     "#NM Device Not Available Exception");
   intr_register_int (11, 0, INTR_ON, kill, "#NP Segment Not Present");
   intr_register_int (12, 0, INTR_ON, kill, "#SS Stack Fault Exception");
   intr_register_int (13, 0, INTR_ON, kill, "#GP General Protection Exception");
@@ -108,6 +116,24 @@ kill (struct intr_frame *f)
     }
 }
 
+/* Handler for a debug exception.  SYSENTER does not clear the
+   trap flag, so a user program that single-steps into it traps
+   in the kernel, at the start of sysenter_entry.  We let the
+   system call go on untraced instead of treating that as a
+   kernel bug. */
+static void
+debug (struct intr_frame *f)
+{
+  extern char sysenter_entry[], sysenter_entry_end[];
+  char *eip = (char *) f->eip;
+
+  if (f->cs == SEL_KCSEG && eip >= sysenter_entry
+      && eip < sysenter_entry_end)
+    f->eflags &= ~FLAG_TF;
+  else
+    kill (f);
+}
+
 /* Page fault handler.  This is a skeleton that must be filled in
    to implement virtual memory.  Some solutions to project 2 may
    also require modifying this code.
@@ -135,6 +161,7 @@ page_fault (struct intr_frame *f)
      [IA32-v3a] 5.15 "Interrupt 14--Page Fault Exception
      (#PF)". */
   asm ("movl %%cr2, %0" : "=r" (fault_addr));
+  TRACE (TRACE_PAGE_FAULT, fault_addr, f->error_code);
 
   /* Turn interrupts back on (they were only off so that we could
      be assured of reading CR2 before it changed). */
@@ -142,12 +169,55 @@ page_fault (struct intr_frame *f)
 
   /* Count page faults. */
   page_fault_cnt++;
+  thread_current ()->usage.page_faults++;
 
   /* Determine cause. */
   not_present = (f->error_code & PF_P) == 0;
   write = (f->error_code & PF_W) != 0;
   user = (f->error_code & PF_U) != 0;
-  
+
+#ifdef VM
+  /* A fault on a page the process owns usually just means the
+     page has not been read in yet, or is a write to the shared
+     zero page.  Threads of one process take turns, so that only
+     one of them brings in a page.  A page that is present by the
+     time this thread's turn comes, because another thread brought
+     it in or frame_compact() finished moving it, needs nothing
+     more; the access is simply retried. */
+  if (is_user_vaddr (fault_addr) && thread_current ()->process != NULL)
+    {
+      struct lock *page_lock = &thread_current ()->process->page_lock;
+      void *esp = user ? f->esp : thread_current ()->user_esp;
+      struct page *p;
+      bool handled;
+
+      lock_acquire (page_lock);
+      p = page_lookup (fault_addr);
+      if (p != NULL)
+        handled = ((not_present
+                    && pagedir_get_page (thread_current ()->pagedir,
+                                         fault_addr) != NULL)
+                   || page_fault_in (p, not_present, write));
+      else
+        handled = not_present && page_grow_stack (fault_addr, esp);
+      lock_release (page_lock);
+      if (handled)
+        return;
+    }
+#endif
+
+  /* A fault inside one of the user-copy primitives on an address
+     the process may not touch: make the primitive fail. */
+  if (!user)
+    {
+      void *fixup = usercopy_fixup (f->eip);
+      if (fixup != NULL)
+        {
+          f->eip = fixup;
+          return;
+        }
+    }
+
   exit(-1);
 
   /* To implement virtual memory, delete the rest of the function
@@ -0,0 +1,160 @@
+#include "userprog/futex.h"
+#include <hash.h>
+#include <list.h>
+#include <stdint.h>
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+#include "userprog/usercopy.h"
+
+/* Fast user-space mutexes.
+
+   A user program keeps the state of a mutex or condition
+   variable in an ordinary int in its own memory, and changes it
+   with atomic instructions.  Only when it has to wait does it
+   call futex_wait(), which sleeps if the int still holds the
+   value the program last saw; a thread that changes the int
+   calls futex_wake() to wake the sleepers.
+
+   Waiters are identified by the page directory of their process
+   and the user address of the int, and kept in a hash table of
+   FUTEX_BUCKET_CNT wait queues.  The value is checked under the
+   queue's lock, which futex_wake() also takes, so a wake-up that
+   follows a change of the value cannot be lost between the check
+   and going to sleep.  When a process ends, futex_wake_all()
+   wakes all of its sleepers. */
+
+#define FUTEX_BUCKET_CNT 64
+
+/* A wait queue. */
+struct futex_bucket
+  {
+    struct lock lock;           /* Protects `waiters'. */
+    struct list waiters;        /* List of struct futex_waiter. */
+  };
+
+/* A thread sleeping in futex_wait(). */
+struct futex_waiter
+  {
+    struct list_elem elem;      /* Element in bucket's `waiters'. */
+    uint32_t *pagedir;          /* Waiter's address space. */
+    const int *uaddr;           /* User address waited on. */
+    struct semaphore sema;      /* Upped to wake the waiter. */
+  };
+
+static struct futex_bucket buckets[FUTEX_BUCKET_CNT];
+
+/* Initializes the futex wait queues. */
+void
+futex_init (void)
+{
+  size_t i;
+
+  for (i = 0; i < FUTEX_BUCKET_CNT; i++)
+    {
+      lock_init (&buckets[i].lock);
+      list_init (&buckets[i].waiters);
+    }
+}
+
+/* Returns the wait queue for UADDR in address space PAGEDIR. */
+static struct futex_bucket *
+bucket_for (uint32_t *pagedir, const int *uaddr)
+{
+  uintptr_t key[2] = { (uintptr_t) pagedir, (uintptr_t) uaddr };
+  return &buckets[hash_bytes (key, sizeof key) % FUTEX_BUCKET_CNT];
+}
+
+/* If the int at user address UADDR equals EXPECTED, sleeps until
+   woken by futex_wake() and returns 0.  Otherwise, or if UADDR
+   is misaligned or cannot be read, or if the process is ending,
+   returns -1 at once. */
+int
+futex_wait (const int *uaddr, int expected)
+{
+  struct thread *cur = thread_current ();
+  struct futex_bucket *b;
+  struct futex_waiter w;
+  int value;
+
+  if ((uintptr_t) uaddr % sizeof *uaddr != 0)
+    return -1;
+
+  b = bucket_for (cur->pagedir, uaddr);
+  lock_acquire (&b->lock);
+  if (cur->process->exiting
+      || !copy_from_user (&value, uaddr, sizeof value) || value != expected)
+    {
+      lock_release (&b->lock);
+      return -1;
+    }
+  w.pagedir = cur->pagedir;
+  w.uaddr = uaddr;
+  sema_init (&w.sema, 0);
+  list_push_back (&b->waiters, &w.elem);
+  lock_release (&b->lock);
+
+  sema_down (&w.sema);
+  return 0;
+}
+
+/* Wakes up to CNT threads of the current process sleeping in
+   futex_wait() on user address UADDR, longest sleeper first.
+   Returns the number woken. */
+int
+futex_wake (const int *uaddr, int cnt)
+{
+  uint32_t *pagedir = thread_current ()->pagedir;
+  struct futex_bucket *b = bucket_for (pagedir, uaddr);
+  struct list_elem *e;
+  int woken = 0;
+
+  lock_acquire (&b->lock);
+  for (e = list_begin (&b->waiters);
+       e != list_end (&b->waiters) && woken < cnt; )
+    {
+      struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+      if (w->pagedir == pagedir && w->uaddr == uaddr)
+        {
+          e = list_remove (e);
+          sema_up (&w->sema);
+          woken++;
+        }
+      else
+        e = list_next (e);
+    }
+  lock_release (&b->lock);
+  return woken;
+}
+
+/* Wakes every thread sleeping in futex_wait() in address space
+   PAGEDIR.  A process that has started ending calls this after
+   marking itself so, which futex_wait() checks under the same
+   lock, so none of its threads can go to sleep afterward. */
+void
+futex_wake_all (uint32_t *pagedir)
+{
+  size_t i;
+
+  for (i = 0; i < FUTEX_BUCKET_CNT; i++)
+    {
+      struct futex_bucket *b = &buckets[i];
+      struct list_elem *e;
+
+      lock_acquire (&b->lock);
+      for (e = list_begin (&b->waiters); e != list_end (&b->waiters); )
+        {
+          struct futex_waiter *w = list_entry (e, struct futex_waiter, elem);
+
+          if (w->pagedir == pagedir)
+            {
+              e = list_remove (e);
+              sema_up (&w->sema);
+            }
+          else
+            e = list_next (e);
+        }
+      lock_release (&b->lock);
+    }
+}
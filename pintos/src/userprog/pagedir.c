@@ -1,13 +1,107 @@
 #include "userprog/pagedir.h"
+#include <hash.h>
+#include <list.h>
+#include <ohash.h>
+#include <round.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/loader.h"
+#include "threads/malloc.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/percpu.h"
+#include "threads/synch.h"
+
+/* Page directories.
+
+   Every page directory maps kernel virtual memory the same way,
+   with the kernel PDEs of init_page_dir, which point to page
+   tables that all page directories share.  Those PDEs are all in
+   place before the first process starts (see vmalloc_init() and
+   lapic_init()), so the kernel half of a page directory never
+   changes.  A page directory whose user half has been cleared is
+   therefore as good as new, and pagedir_destroy() keeps a few of
+   them for pagedir_create() to hand out again without copying
+   anything.
+
+   Each page directory also records which of its user PDEs are in
+   use, so that tearing down or copying a small address space
+   touches only those.
+
+   With "-hugepages", and only without VM, whose frames are each
+   evicted and shared on their own, pagedir_add_large() maps 4 MB
+   of user memory with a single PDE, saving the page table and
+   the TLB entries that 1024 small pages would take.  A large page
+   is split into small ones, with the same frames behind them, as
+   soon as anything changes the mapping of part of it, so that the
+   functions here that work on single pages need not know about
+   large ones.
+
+   Page tables are recycled too.  pagedir_destroy() clears each
+   page table as it frees the pages it maps, which touches every
+   entry anyway, and keeps it on the running CPU's list of zeroed
+   page tables, from which lookup_page() takes new ones without
+   going to the allocator or clearing anything. */
+
+/* Number of PDEs for user virtual addresses. */
+#define USER_PDE_CNT (LOADER_PHYS_BASE >> PDSHIFT)
+
+/* Most page directories kept for reuse. */
+#define PAGEDIR_CACHE_CNT 8
+
+/* Most zeroed page tables kept for reuse on each CPU. */
+#define PT_CACHE_CNT 16
+
+/* Bookkeeping for a page directory. */
+struct pagedir
+  {
+    struct hash_elem elem;      /* Element in `pagedirs'. */
+    struct list_elem free_elem; /* Element in `free_pagedirs'. */
+    uint32_t *pd;               /* The page directory. */
+    uint32_t used[USER_PDE_CNT / 32]; /* User PDEs in use. */
+  };
+
+/* Page directories in use, and cleared ones kept for reuse,
+   protected by PAGEDIRS_LOCK. */
+static struct ohash pagedirs;
+static struct list free_pagedirs;
+static size_t free_pagedir_cnt;
+static struct lock pagedirs_lock;
+
+/* Zeroed page tables kept for reuse on a CPU.  Each one's first
+   entry points to the next, and is cleared again when the page
+   table is taken.  Only touched with interrupts off. */
+struct pt_cache
+  {
+    uint32_t *head;             /* First page table, or null. */
+    size_t cnt;                 /* Number of page tables. */
+  };
+static PER_CPU (struct pt_cache, pt_caches);
 
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static struct pagedir *find_pagedir (uint32_t *pd);
+static size_t next_used_pde (const struct pagedir *, size_t idx);
+static void mark_used_pde (uint32_t *pd, size_t idx, bool used);
+static uint32_t *large_pde (uint32_t *pd, const void *vaddr);
+static bool split_large (uint32_t *pd, uint32_t *pde);
+static void *get_large_page (void);
+static uint32_t *get_pt (void);
+static void free_pt (uint32_t *pt);
+static hash_hash_func pagedir_hash;
+static hash_less_func pagedir_less;
+
+/* Initializes the page directory bookkeeping. */
+void
+pagedir_init (void)
+{
+  ohash_init (&pagedirs, pagedir_hash, pagedir_less, NULL);
+  list_init (&free_pagedirs);
+  lock_init (&pagedirs_lock);
+}
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -16,10 +110,38 @@ static void invalidate_pagedir (uint32_t *);
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
-  if (pd != NULL)
-    memcpy (pd, init_page_dir, PGSIZE);
-  return pd;
+  struct pagedir *p = NULL;
+
+  lock_acquire (&pagedirs_lock);
+  if (!list_empty (&free_pagedirs))
+    {
+      p = list_entry (list_pop_front (&free_pagedirs),
+                      struct pagedir, free_elem);
+      free_pagedir_cnt--;
+    }
+  lock_release (&pagedirs_lock);
+
+  if (p == NULL)
+    {
+      p = malloc (sizeof *p);
+      if (p == NULL)
+        return NULL;
+      p->pd = palloc_get_page (0);
+      if (p->pd == NULL)
+        {
+          free (p);
+          return NULL;
+        }
+      memset (p->pd, 0, USER_PDE_CNT * sizeof *p->pd);
+      memcpy (p->pd + USER_PDE_CNT, init_page_dir + USER_PDE_CNT,
+              PGSIZE - USER_PDE_CNT * sizeof *p->pd);
+      memset (p->used, 0, sizeof p->used);
+    }
+
+  lock_acquire (&pagedirs_lock);
+  ohash_insert (&pagedirs, &p->elem);
+  lock_release (&pagedirs_lock);
+  return p->pd;
 }
 
 /* Destroys page directory PD, freeing all the pages it
@@ -27,24 +149,121 @@ pagedir_create (void)
 void
 pagedir_destroy (uint32_t *pd) 
 {
-  uint32_t *pde;
+  struct pagedir *p;
+  size_t idx;
 
   if (pd == NULL)
     return;
 
   ASSERT (pd != init_page_dir);
-  for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
-    if (*pde & PTE_P) 
-      {
-        uint32_t *pt = pde_get_pt (*pde);
-        uint32_t *pte;
-        
-        for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
+
+  /* pagedir_switch() may have left PD active under a kernel
+     thread. */
+  if (active_pd () == pd)
+    pagedir_activate (NULL);
+
+  p = find_pagedir (pd);
+  for (idx = next_used_pde (p, 0); idx < USER_PDE_CNT;
+       idx = next_used_pde (p, idx + 1))
+    {
+      uint32_t *pt, *pte;
+
+      if (pd[idx] & PTE_PS)
+        {
+          palloc_free_multiple (pde_get_large (pd[idx]), PTSPAN / PGSIZE);
+          pd[idx] = 0;
+          continue;
+        }
+      pt = pde_get_pt (pd[idx]);
+      for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
+        {
           if (*pte & PTE_P) 
             palloc_free_page (pte_get_page (*pte));
-        palloc_free_page (pt);
-      }
-  palloc_free_page (pd);
+          *pte = 0;
+        }
+      free_pt (pt);
+      pd[idx] = 0;
+    }
+  memset (p->used, 0, sizeof p->used);
+
+  /* Keep PD, whose user half is now clear, for reuse. */
+  lock_acquire (&pagedirs_lock);
+  ohash_delete (&pagedirs, &p->elem);
+  if (free_pagedir_cnt < PAGEDIR_CACHE_CNT)
+    {
+      list_push_front (&free_pagedirs, &p->free_elem);
+      free_pagedir_cnt++;
+      p = NULL;
+    }
+  lock_release (&pagedirs_lock);
+
+  if (p != NULL)
+    {
+      palloc_free_page (p->pd);
+      free (p);
+    }
+}
+
+/* Returns the bookkeeping for page directory PD. */
+static struct pagedir *
+find_pagedir (uint32_t *pd)
+{
+  struct pagedir key;
+  struct hash_elem *e;
+
+  key.pd = pd;
+  lock_acquire (&pagedirs_lock);
+  e = ohash_find (&pagedirs, &key.elem);
+  lock_release (&pagedirs_lock);
+  ASSERT (e != NULL);
+  return hash_entry (e, struct pagedir, elem);
+}
+
+/* Returns the index of the first user PDE at or after IDX that
+   has a page table in P, or USER_PDE_CNT if there is none. */
+static size_t
+next_used_pde (const struct pagedir *p, size_t idx)
+{
+  while (idx < USER_PDE_CNT)
+    {
+      uint32_t bits = p->used[idx / 32] >> (idx % 32);
+      if (bits != 0)
+        return idx + __builtin_ctz (bits);
+      idx = ROUND_DOWN (idx, 32) + 32;
+    }
+  return USER_PDE_CNT;
+}
+
+/* Records in PD's bookkeeping whether its user PDE IDX is in use,
+   according to USED. */
+static void
+mark_used_pde (uint32_t *pd, size_t idx, bool used)
+{
+  struct pagedir *p = find_pagedir (pd);
+
+  if (used)
+    p->used[idx / 32] |= 1u << (idx % 32);
+  else
+    p->used[idx / 32] &= ~(1u << (idx % 32));
+}
+
+/* Returns a hash value for the page directory of struct pagedir
+   E. */
+static unsigned
+pagedir_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct pagedir *p = hash_entry (e, struct pagedir, elem);
+  return hash_int ((uintptr_t) p->pd >> PGBITS);
+}
+
+/* Returns true if the page directory of struct pagedir A
+   precedes B's. */
+static bool
+pagedir_less (const struct hash_elem *a, const struct hash_elem *b,
+              void *aux UNUSED)
+{
+  return (hash_entry (a, struct pagedir, elem)->pd
+          < hash_entry (b, struct pagedir, elem)->pd);
 }
 
 /* Returns the address of the page table entry for virtual
@@ -52,7 +271,9 @@ pagedir_destroy (uint32_t *pd)
    If PD does not have a page table for VADDR, behavior depends
    on CREATE.  If CREATE is true, then a new page table is
    created and a pointer into it is returned.  Otherwise, a null
-   pointer is returned. */
+   pointer is returned.  If VADDR is in a large page, the large
+   page is split first, and a null pointer is returned if that
+   runs out of memory. */
 static uint32_t *
 lookup_page (uint32_t *pd, const void *vaddr, bool create)
 {
@@ -70,21 +291,71 @@ lookup_page (uint32_t *pd, const void *vaddr, bool create)
     {
       if (create)
         {
-          pt = palloc_get_page (PAL_ZERO);
+          pt = get_pt ();
           if (pt == NULL) 
             return NULL; 
       
           *pde = pde_create (pt);
+          mark_used_pde (pd, pd_no (vaddr), true);
         }
       else
         return NULL;
     }
+  else if (*pde & PTE_PS)
+    {
+      ASSERT (is_user_vaddr (vaddr));
+      if (!split_large (pd, pde))
+        return NULL;
+    }
 
   /* Return the page table entry. */
   pt = pde_get_pt (*pde);
   return &pt[pt_no (vaddr)];
 }
 
+/* Returns a zeroed page table, from the running CPU's cache if
+   it has one, or a null pointer if memory runs out. */
+static uint32_t *
+get_pt (void)
+{
+  enum intr_level old_level = intr_disable ();
+  struct pt_cache *c = this_cpu_ptr (pt_caches);
+  uint32_t *pt = c->head;
+
+  if (pt != NULL)
+    {
+      c->head = (uint32_t *) pt[0];
+      c->cnt--;
+      pt[0] = 0;
+    }
+  intr_set_level (old_level);
+
+  if (pt == NULL)
+    pt = palloc_get_page (PAL_ZERO | PAL_RESERVE);
+  return pt;
+}
+
+/* Frees page table PT, which must be all zeros, keeping it in
+   the running CPU's cache if there is room. */
+static void
+free_pt (uint32_t *pt)
+{
+  enum intr_level old_level = intr_disable ();
+  struct pt_cache *c = this_cpu_ptr (pt_caches);
+
+  if (c->cnt < PT_CACHE_CNT)
+    {
+      pt[0] = (uint32_t) c->head;
+      c->head = pt;
+      c->cnt++;
+      pt = NULL;
+    }
+  intr_set_level (old_level);
+
+  if (pt != NULL)
+    palloc_free_page (pt);
+}
+
 /* Adds a mapping in page directory PD from user virtual page
    UPAGE to the physical frame identified by kernel virtual
    address KPAGE.
@@ -118,6 +389,132 @@ pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool writable)
     return false;
 }
 
+/* Maps the CNT user virtual pages starting at UPAGE in page
+   directory PD to the frames at kernel virtual addresses
+   KPAGES[0] through KPAGES[CNT - 1], writable if WRITABLE is
+   true, read-only otherwise.  Looks up each page table just once.
+   Returns true if successful, false if one of the pages is
+   already mapped or memory for a page table runs out, in which
+   case none of them is left mapped. */
+bool
+pagedir_map_range (uint32_t *pd, void *upage, void *const kpages[],
+                   size_t cnt, bool writable)
+{
+  uint8_t *addr = upage;
+  size_t done = 0;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (cnt <= ((uintptr_t) PHYS_BASE - (uintptr_t) upage) / PGSIZE);
+  ASSERT (pd != init_page_dir);
+
+  while (done < cnt)
+    {
+      size_t run = PGSIZE / sizeof (uint32_t) - pt_no (addr);
+      uint32_t *pte = lookup_page (pd, addr, true);
+      size_t i;
+
+      if (run > cnt - done)
+        run = cnt - done;
+      if (pte == NULL)
+        goto error;
+      for (i = 0; i < run; i++)
+        {
+          void *kpage = kpages[done];
+
+          ASSERT (pg_ofs (kpage) == 0);
+          ASSERT (vtop (kpage) >> PTSHIFT < init_ram_pages);
+          if (pte[i] & PTE_P)
+            goto error;
+          pte[i] = pte_create_user (kpage, writable);
+          done++;
+        }
+      addr += run * PGSIZE;
+    }
+  return true;
+
+ error:
+  pagedir_unmap_range (pd, upage, done);
+  return false;
+}
+
+/* Marks the CNT user virtual pages starting at UPAGE "not
+   present" in page directory PD, as pagedir_clear_page() does for
+   one page, looking up each page table just once and flushing the
+   TLB at most once.  Pages that are not mapped are skipped. */
+void
+pagedir_unmap_range (uint32_t *pd, void *upage, size_t cnt)
+{
+  uint8_t *addr = upage;
+  bool flush = false;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  while (cnt > 0)
+    {
+      size_t run = PGSIZE / sizeof (uint32_t) - pt_no (addr);
+      uint32_t *pte = lookup_page (pd, addr, false);
+      size_t i;
+
+      if (run > cnt)
+        run = cnt;
+      if (pte != NULL)
+        for (i = 0; i < run; i++)
+          if (pte[i] & PTE_P)
+            {
+              pte[i] &= ~PTE_P;
+              flush = true;
+            }
+      addr += run * PGSIZE;
+      cnt -= run;
+    }
+  if (flush)
+    invalidate_pagedir (pd);
+}
+
+/* Makes those of the CNT user virtual pages starting at UPAGE
+   that are mapped in page directory PD writable if WRITABLE is
+   true, read-only otherwise, looking up each page table just once
+   and flushing the TLB at most once. */
+void
+pagedir_protect_range (uint32_t *pd, void *upage, size_t cnt,
+                       bool writable)
+{
+  uint8_t *addr = upage;
+  bool flush = false;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  while (cnt > 0)
+    {
+      size_t run = PGSIZE / sizeof (uint32_t) - pt_no (addr);
+      uint32_t *pte = lookup_page (pd, addr, false);
+      size_t i;
+
+      if (run > cnt)
+        run = cnt;
+      if (pte != NULL)
+        for (i = 0; i < run; i++)
+          {
+            if (!(pte[i] & PTE_P))
+              continue;
+            if (writable)
+              pte[i] |= PTE_W;
+            else if (pte[i] & PTE_W)
+              {
+                pte[i] &= ~(uint32_t) PTE_W;
+                flush = true;
+              }
+          }
+      addr += run * PGSIZE;
+      cnt -= run;
+    }
+  if (flush)
+    invalidate_pagedir (pd);
+}
+
 /* Looks up the physical address that corresponds to user virtual
    address UADDR in PD.  Returns the kernel virtual address
    corresponding to that physical address, or a null pointer if
@@ -128,6 +525,10 @@ pagedir_get_page (uint32_t *pd, const void *uaddr)
   uint32_t *pte;
 
   ASSERT (is_user_vaddr (uaddr));
+
+  pte = large_pde (pd, uaddr);
+  if (pte != NULL)
+    return pde_get_large (*pte) + ((uintptr_t) uaddr & (PTSPAN - 1));
   
   pte = lookup_page (pd, uaddr, false);
   if (pte != NULL && (*pte & PTE_P) != 0)
@@ -156,6 +557,212 @@ pagedir_clear_page (uint32_t *pd, void *upage)
     }
 }
 
+/* Maps a copy of every user page of SRC, with the same access
+   rights, into DST, which must have no user mappings.  The
+   copies come from the user pool.  A large page is copied into a
+   large page if one is free, otherwise into small pages.
+   Returns false if memory is exhausted; pagedir_destroy() then
+   frees the copies made so far along with DST. */
+bool
+pagedir_copy (uint32_t *dst, uint32_t *src)
+{
+  struct pagedir *p = find_pagedir (src);
+  size_t idx;
+
+  for (idx = next_used_pde (p, 0); idx < USER_PDE_CNT;
+       idx = next_used_pde (p, idx + 1))
+    {
+      uint32_t pde = src[idx];
+      uint32_t *pt = pde & PTE_PS ? NULL : pde_get_pt (pde);
+      uint32_t *dst_pt;
+      size_t i;
+
+      if (pt == NULL)
+        {
+          void *kpage = get_large_page ();
+          if (kpage != NULL)
+            {
+              memcpy (kpage, pde_get_large (pde), PTSPAN);
+              dst[idx] = pde_create_user_large (kpage, (pde & PTE_W) != 0);
+              mark_used_pde (dst, idx, true);
+              continue;
+            }
+        }
+
+      dst_pt = lookup_page (dst, (void *) (idx << PDSHIFT), true);
+      if (dst_pt == NULL)
+        return false;
+      for (i = 0; i < PGSIZE / sizeof *dst_pt; i++)
+        {
+          uint32_t pte = pt != NULL ? pt[i] : pde;
+          void *kpage;
+
+          if (!(pte & PTE_P))
+            continue;
+          kpage = palloc_get_page (PAL_USER);
+          if (kpage == NULL)
+            return false;
+          memcpy (kpage, (pt != NULL
+                          ? pte_get_page (pte)
+                          : (uint8_t *) pde_get_large (pde) + i * PGSIZE),
+                  PGSIZE);
+          ASSERT ((dst_pt[i] & PTE_P) == 0);
+          dst_pt[i] = pte_create_user (kpage, (pte & PTE_W) != 0);
+        }
+    }
+  return true;
+}
+
+/* Maps the 4 MB of user virtual memory starting at UPAGE, which
+   must be aligned on a 4 MB boundary, in page directory PD to a
+   newly allocated large page of zeros from the user pool,
+   read/write if WRITABLE is true, read-only otherwise.  Returns
+   false, changing nothing, if large pages are not enabled, if
+   anything is mapped in those 4 MB already, or if the user pool
+   has no free run of pages aligned for a large page. */
+bool
+pagedir_add_large (uint32_t *pd, void *upage, bool writable)
+{
+  uint32_t *pde = pd + pd_no (upage);
+  void *kpage;
+
+  ASSERT (((uintptr_t) upage & (PTSPAN - 1)) == 0);
+  ASSERT (is_user_vaddr (upage));
+  ASSERT (pd != init_page_dir);
+
+  if (*pde != 0)
+    return false;
+  kpage = get_large_page ();
+  if (kpage == NULL)
+    return false;
+  memset (kpage, 0, PTSPAN);
+  *pde = pde_create_user_large (kpage, writable);
+  mark_used_pde (pd, pd_no (upage), true);
+  return true;
+}
+
+/* Unmaps the large page at UPAGE, which pagedir_add_large() or
+   pagedir_copy() mapped in PD, and frees its memory. */
+void
+pagedir_remove_large (uint32_t *pd, void *upage)
+{
+  uint32_t *pde = large_pde (pd, upage);
+  void *kpage;
+
+  ASSERT (pde != NULL);
+  ASSERT (((uintptr_t) upage & (PTSPAN - 1)) == 0);
+
+  kpage = pde_get_large (*pde);
+  *pde = 0;
+  mark_used_pde (pd, pd_no (upage), false);
+  invalidate_pagedir (pd);
+  palloc_free_multiple (kpage, PTSPAN / PGSIZE);
+}
+
+/* Returns true if user virtual address UADDR is in a large page
+   in PD. */
+bool
+pagedir_is_large (uint32_t *pd, const void *uaddr)
+{
+  return large_pde (pd, uaddr) != NULL;
+}
+
+/* Splits a large page that maps user virtual address UADDR in
+   PD into small pages, backed by the same memory, if there is
+   one.  Returns false if memory for the page table runs out. */
+bool
+pagedir_split_large (uint32_t *pd, const void *uaddr)
+{
+  uint32_t *pde = large_pde (pd, uaddr);
+  return pde == NULL || split_large (pd, pde);
+}
+
+/* Returns the PDE in PD for user virtual address VADDR if it
+   maps a large page, otherwise a null pointer. */
+static uint32_t *
+large_pde (uint32_t *pd, const void *vaddr)
+{
+  uint32_t *pde = pd + pd_no (vaddr);
+
+  ASSERT (is_user_vaddr (vaddr));
+  return (*pde & (PTE_P | PTE_PS)) == (PTE_P | PTE_PS) ? pde : NULL;
+}
+
+/* Replaces the large page that user PDE in PD maps by a page
+   table of small pages over the same memory, with the same access
+   rights and accessed and dirty bits.  Returns false if memory
+   for the page table runs out. */
+static bool
+split_large (uint32_t *pd, uint32_t *pde)
+{
+  uint32_t flags = *pde & (PTE_P | PTE_W | PTE_U | PTE_A | PTE_D);
+  uint8_t *kpage = pde_get_large (*pde);
+  uint32_t *pt = palloc_get_page (PAL_RESERVE);
+  size_t i;
+
+  if (pt == NULL)
+    return false;
+  for (i = 0; i < PGSIZE / sizeof *pt; i++)
+    pt[i] = vtop (kpage + i * PGSIZE) | flags;
+  *pde = pde_create (pt);
+
+  /* The TLB must not hold both the large translation and small
+     ones for the same addresses.  See [IA32-v3a] 3.12
+     "Translation Lookaside Buffers (TLBs)". */
+  invalidate_pagedir (pd);
+  return true;
+}
+
+/* Returns a run of PTSPAN / PGSIZE pages from the user pool,
+   aligned on a 4 MB boundary for use as a large page, or a null
+   pointer if large pages are not enabled or there is no such
+   run. */
+static void *
+get_large_page (void)
+{
+  void *kpage;
+
+  if (!palloc_large_pages)
+    return NULL;
+  kpage = palloc_get_multiple (PAL_USER, PTSPAN / PGSIZE);
+  if (kpage != NULL && (vtop (kpage) & (PTSPAN - 1)) != 0)
+    {
+      palloc_free_multiple (kpage, PTSPAN / PGSIZE);
+      kpage = NULL;
+    }
+  return kpage;
+}
+
+/* Returns true if virtual page VPAGE is mapped in PD and user
+   code may write to it. */
+bool
+pagedir_is_writable (uint32_t *pd, const void *vpage)
+{
+  uint32_t *pte = large_pde (pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
+  return pte != NULL && (*pte & (PTE_P | PTE_W)) == (PTE_P | PTE_W);
+}
+
+/* Makes the mapping of virtual page VPAGE in PD read/write if
+   WRITABLE is true, read-only otherwise.  VPAGE need not be
+   mapped. */
+void
+pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable)
+{
+  uint32_t *pte = lookup_page (pd, vpage, false);
+  if (pte != NULL)
+    {
+      if (writable)
+        *pte |= PTE_W;
+      else
+        {
+          *pte &= ~(uint32_t) PTE_W;
+          invalidate_pagedir (pd);
+        }
+    }
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PD is dirty,
    that is, if the page has been modified since the PTE was
    installed.
@@ -163,7 +770,9 @@ pagedir_clear_page (uint32_t *pd, void *upage)
 bool
 pagedir_is_dirty (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = large_pde (pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_D) != 0;
 }
 
@@ -192,7 +801,9 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
 bool
 pagedir_is_accessed (uint32_t *pd, const void *vpage) 
 {
-  uint32_t *pte = lookup_page (pd, vpage, false);
+  uint32_t *pte = large_pde (pd, vpage);
+  if (pte == NULL)
+    pte = lookup_page (pd, vpage, false);
   return pte != NULL && (*pte & PTE_A) != 0;
 }
 
@@ -230,6 +841,20 @@ pagedir_activate (uint32_t *pd)
   asm volatile ("movl %0, %%cr3" : : "r" (vtop (pd)) : "memory");
 }
 
+/* Activates PD, as pagedir_activate() does, for a thread being
+   switched in, but skips the reload of CR3 and the TLB flush that
+   goes with it if PD is already active, as it is when switching
+   between threads of one process.  A null PD, for a kernel
+   thread, keeps whatever page directory is active, since every
+   page directory maps the kernel the same way and a kernel
+   thread does not touch user memory. */
+void
+pagedir_switch (uint32_t *pd)
+{
+  if (pd != NULL && active_pd () != pd)
+    pagedir_activate (pd);
+}
+
 /* Returns the currently active page directory. */
 static uint32_t *
 active_pd (void) 
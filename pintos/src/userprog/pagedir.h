@@ -2,17 +2,32 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+void pagedir_init (void);
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
 void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
+bool pagedir_map_range (uint32_t *pd, void *upage, void *const kpages[],
+                        size_t cnt, bool rw);
+void pagedir_unmap_range (uint32_t *pd, void *upage, size_t cnt);
+void pagedir_protect_range (uint32_t *pd, void *upage, size_t cnt,
+                            bool rw);
+bool pagedir_copy (uint32_t *dst, uint32_t *src);
+bool pagedir_add_large (uint32_t *pd, void *upage, bool rw);
+void pagedir_remove_large (uint32_t *pd, void *upage);
+bool pagedir_is_large (uint32_t *pd, const void *uaddr);
+bool pagedir_split_large (uint32_t *pd, const void *uaddr);
+bool pagedir_is_writable (uint32_t *pd, const void *upage);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
+void pagedir_switch (uint32_t *pd);
 
 #endif /* userprog/pagedir.h */
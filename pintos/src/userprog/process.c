@@ -1,28 +1,119 @@
 #include "userprog/process.h"
+#include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <kdata.h>
 #include <round.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "userprog/futex.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
 #include "userprog/syscall.h"
+#include "devices/input.h"
+#include "devices/timer.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/inode.h"
 #include "threads/flags.h"
 #include "threads/init.h"
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/shm.h"
+#include "vm/page.h"
+#endif
+
+/* Space below PHYS_BASE kept for the stack, which the heap may
+   not grow into. */
+#ifdef VM
+#define HEAP_STACK_GAP page_stack_limit
+#else
+#define HEAP_STACK_GAP PGSIZE
+#endif
+
+/* Cache of child status records. */
+static struct kmem_cache *child_status_cache;
+
+/* Cache of processes. */
+static struct kmem_cache *process_cache;
+
+/* Print each process's resource usage when it ends? */
+bool process_report_usage;
+
+/* A thread started by uthread_create(), as seen by
+   uthread_join().  It stays in its process's `uthreads' until it
+   is joined or the process ends, so it outlives the thread. */
+struct uthread
+  {
+    tid_t tid;                  /* Thread's tid. */
+    bool done;                  /* Has the thread exited? */
+    bool joined;                /* Is a thread waiting for it? */
+    int exit_status;            /* Thread's exit status, once done. */
+    struct process *process;    /* Thread's process, until started. */
+    void (*eip) (void);         /* User entry point, until started. */
+    void *esp;                  /* User stack pointer, until started. */
+    struct list_elem elem;      /* Element in process's `uthreads'. */
+  };
+
+/* Command line split in place into null-terminated words. */
+struct cmd_args
+  {
+    char *start;                /* First word, the program name. */
+    size_t len;                 /* Bytes from START to end of last word. */
+    int argc;                   /* Number of words. */
+  };
 
 static thread_func start_process NO_RETURN;
+static thread_func start_uthread NO_RETURN;
+static thread_func start_fork NO_RETURN;
+static struct process *process_create (void);
+static void process_free (struct process *);
+static bool init_children (struct thread *);
+static void free_fdt (struct process *);
+static bool inherit_files (struct process *child, struct process *parent,
+                           bool all);
+static bool copy_address_space (struct process *parent);
+static bool setup_kdata (void);
+static void start_exit (struct process *, int status);
+static void parse_args (char *line, struct cmd_args *);
+static bool push_args (const struct cmd_args *, void **esp);
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
-struct thread *get_child_process (int pid);
+static void release_child_status (struct child_status *cs);
+static void watch_child (struct child_status *cs);
+static void queue_exited_child (struct child_status *cs);
+static void rusage_add (struct rusage *, const struct rusage *);
+static bool heap_add_page (void *upage);
+static void heap_remove_page (void *upage);
+static void heap_remove_range (uint8_t *start, uint8_t *end);
+#ifndef VM
+static bool heap_add_large (uint8_t *upage, uint8_t *end);
+#endif
+static thread_action_func add_thread_usage;
+static hash_hash_func child_hash;
+static hash_less_func child_less;
+static hash_action_func child_release;
+
+/* Initializes the process module. */
+void
+process_init (void)
+{
+  child_status_cache = kmem_cache_create ("child_status",
+                                          sizeof (struct child_status),
+                                          NULL);
+  process_cache = kmem_cache_create ("process", sizeof (struct process),
+                                     NULL);
+}
 
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
@@ -33,6 +124,15 @@ process_execute (const char *file_name)
 {
   char *fn_copy;
   tid_t tid;
+  struct thread *cur = thread_current ();
+  struct child_status *cs;
+  struct process *p;
+  char thread_name[16];
+  const char *name;
+  size_t name_len;
+
+  if (!init_children (cur))
+    return TID_ERROR;
 
   /* Make a copy of FILE_NAME.
      Otherwise there's a race between the caller and load(). */
@@ -41,127 +141,348 @@ process_execute (const char *file_name)
     return TID_ERROR;
   strlcpy (fn_copy, file_name, PGSIZE);
 
-  /* Parse file name and Give it to thread_create (). */
-  int name_size;
-  name_size = strlen (file_name) + 1;
-
-  char file_name_copy[name_size];
-  strlcpy (file_name_copy, file_name, name_size);
-
-  char *save_ptr;
-  char *thread_name;
-  thread_name = strtok_r (file_name_copy, " ", &save_ptr);
+  /* Make status record shared with child, and child's process,
+     which starts in our working directory.  Child finds its
+     command line and process in the record. */
+  cs = kmem_cache_alloc (child_status_cache);
+  if (cs == NULL)
+  {
+    palloc_free_page (fn_copy);
+    return TID_ERROR;
+  }
+  p = process_create ();
+  if (p == NULL)
+  {
+    palloc_free_page (fn_copy);
+    kmem_cache_free (child_status_cache, cs);
+    return TID_ERROR;
+  }
+  if ((cur->process != NULL && cur->process->cwd != NULL
+       && (p->cwd = dir_reopen (cur->process->cwd)) == NULL)
+      || (cur->process != NULL && !inherit_files (p, cur->process, false)))
+  {
+    palloc_free_page (fn_copy);
+    kmem_cache_free (child_status_cache, cs);
+    process_free (p);
+    return TID_ERROR;
+  }
+  p->child_status = cs;
+  cs->process = p;
+  cs->cmd_line = fn_copy;
+  cs->is_load = false;
+  cs->exit_status = -1;
+  sema_init (&cs->load, 0);
+  sema_init (&cs->exit, 0);
+  cs->ref_cnt = 2;
+  cs->exited = false;
+  cs->queued = false;
+  cs->parent = NULL;
+
+  /* Give first word of FILE_NAME to thread_create () as name,
+     truncated to fit.  Child parses the whole line itself. */
+  name = file_name + strspn (file_name, " ");
+  name_len = strcspn (name, " ");
+  if (name_len > sizeof thread_name - 1)
+    name_len = sizeof thread_name - 1;
+  strlcpy (thread_name, name, name_len + 1);
 
   /* Create a new thread to execute FILE_NAME. */
-  tid = thread_create (thread_name, PRI_DEFAULT, start_process, fn_copy);
+  tid = thread_create (thread_name, PRI_DEFAULT, start_process, cs);
   if (tid == TID_ERROR)
+  {
     palloc_free_page (fn_copy);
+    process_free (p);
+    kmem_cache_free (child_status_cache, cs);
+    return TID_ERROR;
+  }
+
+  /* Child can not be waited for until exec returns, so it is fine
+     to record it only now.  If the child table cannot grow, the
+     child runs but cannot be waited for. */
+  cs->tid = tid;
+  if (ohash_insert (cur->children, &cs->elem) != NULL)
+    release_child_status (cs);
+  else
+    watch_child (cs);
   return tid;
 }
 
-/* A thread function that loads a user process and starts it
-   running. */
-static void
-start_process (void *file_name_)
-{
-  char *file_name = file_name_;
-  struct intr_frame if_;
-  bool success;
+/* What process_fork() hands to the new process's thread. */
+struct fork_args
+  {
+    struct child_status *cs;    /* Child's status record. */
+    struct thread *thread;      /* Thread calling fork(). */
+    struct intr_frame *frame;   /* Its user context. */
+  };
 
-  char *fn_copy;
-  char *token;
-  char *save_ptr;
-  char **parse;
-  int count;
-  int i;
+/* Starts a new process that is a copy of the current one, as it
+   is at the time of the call.  Under VM the copy shares the
+   resident pages of the current process, copy-on-write, instead
+   of copying them.  Every open file is reopened in the copy under
+   the same file descriptor, at the same position, but the
+   positions move independently afterward; memory-mapped files
+   are not inherited.  Only the calling thread is copied, and in
+   the new process fork() returns 0.  Returns the new process's
+   pid, once it has its copy, or TID_ERROR if it cannot be
+   created. */
+tid_t
+process_fork (void)
+{
+  struct thread *cur = thread_current ();
+  struct process *parent = cur->process;
+  struct fork_args fa;
+  struct child_status *cs;
+  struct process *p;
+  tid_t tid;
 
-  /* Allocate page for fn_copy. strtok_r() modify page information, so we use copy of it.
-     If fails, free page and exit thread. */
-  fn_copy = palloc_get_page (0);
-  if (fn_copy == NULL)
+  if (!init_children (cur))
+    return TID_ERROR;
+  cs = kmem_cache_alloc (child_status_cache);
+  if (cs == NULL)
+    return TID_ERROR;
+  p = process_create ();
+  if (p == NULL)
   {
-    palloc_free_page (file_name);
-    thread_exit ();
+    kmem_cache_free (child_status_cache, cs);
+    return TID_ERROR;
   }
-  strlcpy (fn_copy, file_name, PGSIZE);
-
-  count = 0;
-  /* Allocate page for storing parsed fn_copy.
-     If fails, free page and exit thread. */
-  parse = palloc_get_page(0);
-  if (parse == NULL)
+  if ((parent->cwd != NULL && (p->cwd = dir_reopen (parent->cwd)) == NULL)
+      || !inherit_files (p, parent, true)
+      || (p->exec_file = file_reopen (parent->exec_file)) == NULL)
   {
-    palloc_free_page (file_name);
-    palloc_free_page (fn_copy);
-    thread_exit ();
+    kmem_cache_free (child_status_cache, cs);
+    process_free (p);
+    return TID_ERROR;
   }
-
-  /* Tokenize fn_copy. If page allocation error occur,
-     free all allocated page, and exit thread. */
-  for (token = strtok_r (fn_copy, " ", &save_ptr) ; token != NULL ;
-        token = strtok_r (NULL, " ", &save_ptr))
+  file_deny_write (p->exec_file);
+  lock_acquire (&parent->lock);
+  p->heap_start = parent->heap_start;
+  p->brk = parent->brk;
+  lock_release (&parent->lock);
+  p->stdin_mode = parent->stdin_mode;
+
+  p->child_status = cs;
+  cs->process = p;
+  cs->cmd_line = NULL;
+  cs->is_load = false;
+  cs->exit_status = -1;
+  sema_init (&cs->load, 0);
+  sema_init (&cs->exit, 0);
+  cs->ref_cnt = 2;
+  cs->exited = false;
+  cs->queued = false;
+  cs->parent = NULL;
+
+  /* The system call's entry saved the user context at the top of
+     our kernel stack. */
+  fa.cs = cs;
+  fa.thread = cur;
+  fa.frame = (struct intr_frame *) ((uint8_t *) cur + PGSIZE) - 1;
+  tid = thread_create (cur->name, PRI_DEFAULT, start_fork, &fa);
+  if (tid == TID_ERROR)
   {
-    parse[count] = palloc_get_page (0);
+    process_free (p);
+    kmem_cache_free (child_status_cache, cs);
+    return TID_ERROR;
+  }
 
-    /* Check if page allocation error occur. */
-    if (parse[count] == NULL)
-    {
-      int j;
-      for (j = 0; j < count; j++)
-        palloc_free_page (parse[j]);
-      palloc_free_page (parse);
-      palloc_free_page (fn_copy);
-      palloc_free_page (file_name);
-      thread_exit ();
-    }
-    /* Save tokenized fn_copy into parse. */
-    strlcpy (parse[count], token, PGSIZE);
-    count++;
+  /* FA must live until the child has made its copy. */
+  sema_down (&cs->load);
+  cs->tid = tid;
+  if (!cs->is_load)
+  {
+    release_child_status (cs);
+    return TID_ERROR;
   }
+  if (ohash_insert (cur->children, &cs->elem) != NULL)
+    release_child_status (cs);
+  else
+    watch_child (cs);
+  return tid;
+}
+
+/* A thread function that gives a process from process_fork() a
+   copy of its parent's address space, then resumes it in user
+   mode where the parent called fork(). */
+static void
+start_fork (void *fa_)
+{
+  struct fork_args *fa = fa_;
+  struct child_status *cs = fa->cs;
+  struct thread *t = thread_current ();
+  struct intr_frame if_ = *fa->frame;
+  bool success;
+
+  t->process = cs->process;
+  t->process->pid = t->tid;
+  cs->process = NULL;
+
+  fpu_copy (t, fa->thread);
+  success = copy_address_space (fa->thread->process);
+
+  /* FA is gone once the parent wakes up. */
+  cs->is_load = success;
+  sema_up (&cs->load);
+  if (!success)
+    thread_exit ();
+
+  /* fork() returns 0 in the child.  Enter user mode as
+     start_process() does. */
+  if_.eax = 0;
+  thread_set_cpu_mode (CPU_USER);
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Gives the current process, just created by process_fork(), a
+   page directory and a copy of PARENT's address space.  Returns
+   false if memory is exhausted. */
+static bool
+copy_address_space (struct process *parent)
+{
+  struct thread *t = thread_current ();
+  struct process *p = t->process;
+#ifdef VM
+  bool success;
+#endif
+
+  t->pagedir = p->pagedir = pagedir_create ();
+  if (t->pagedir == NULL)
+    return false;
+  process_activate ();
+
+#ifdef VM
+  lock_acquire (&parent->page_lock);
+  success = page_table_fork (parent) && shm_fork (parent);
+  lock_release (&parent->page_lock);
+  return success && setup_kdata ();
+#else
+  /* Without VM every page is copied now, and the copy of the
+     kernel data page becomes the child's own. */
+  if (!pagedir_copy (p->pagedir, parent->pagedir))
+    return false;
+  t->kdata = p->kdata = pagedir_get_page (p->pagedir, KDATA_ADDR);
+  t->kdata->tid = p->pid;
+  thread_update_kdata (t);
+  return true;
+#endif
+}
+
+/* A thread function that loads a user process and starts it
+   running. */
+static void
+start_process (void *cs_)
+{
+  struct child_status *cs = cs_;
+  struct thread *t = thread_current ();
+  char *cmd_line = cs->cmd_line;
+  struct cmd_args args;
+  struct intr_frame if_;
+  bool success;
+
+  t->process = cs->process;
+  t->process->pid = t->tid;
+  cs->process = NULL;
+
+  /* Split command line into words in place, once.  First word is
+     file to load. */
+  parse_args (cmd_line, &args);
 
   /* Initialize interrupt frame and load executable. */
   memset (&if_, 0, sizeof if_);
   if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
-  success = load (parse[0], &if_.eip, &if_.esp);
+  success = args.argc > 0 && load (args.start, &if_.eip, &if_.esp);
+
+  /* If load success, put arguments into stack pointer. */
+  if (success)
+    success = push_args (&args, &if_.esp);
 
   /* If load end, continue parent process.
      Change load flag here, because immediate sema_up after load can cause ordering error. */
-  thread_current()->is_load = success;
-  sema_up(&thread_current()->load);
-
-  /* If load success, put tokenized file into stack pointer. */
-  if (success)
-    argument_stack (parse, count, &if_.esp);
+  cs->cmd_line = NULL;
+  cs->is_load = success;
+  sema_up (&cs->load);
 
   /* If load failed, quit. */
-  palloc_free_page (file_name);
+  palloc_free_page (cmd_line);
   if (!success)
-  {
-    for(i = 0 ; i < count ; i++)
-      palloc_free_page (parse[i]);
-    palloc_free_page (parse);
-    palloc_free_page (fn_copy);
     thread_exit ();
-  }
-
-  /* Always do free allocated page at the end of function . */
-  for (i = 0 ; i < count ; i++)
-    palloc_free_page (parse[i]);
-  palloc_free_page (parse);
-  palloc_free_page (fn_copy);
 
   /* Start the user process by simulating a return from an
      interrupt, implemented by intr_exit (in
      threads/intr-stubs.S).  Because intr_exit takes all of its
      arguments on the stack in the form of a `struct intr_frame',
      we just point the stack pointer (%esp) to our stack frame
-     and jump to it. */
+     and jump to it.  From then on the thread's time counts as
+     user time. */
+  thread_set_cpu_mode (CPU_USER);
   asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
   NOT_REACHED ();
 }
 
+/* Split LINE in place into null-terminated words and describe them
+   in ARGS. */
+static void
+parse_args (char *line, struct cmd_args *args)
+{
+  char *token, *save_ptr, *last = NULL;
+
+  args->start = NULL;
+  args->argc = 0;
+  for (token = strtok_r (line, " ", &save_ptr); token != NULL;
+       token = strtok_r (NULL, " ", &save_ptr))
+  {
+    if (args->start == NULL)
+      args->start = token;
+    last = token;
+    args->argc++;
+  }
+  args->len = last != NULL ? last + strlen (last) + 1 - args->start : 0;
+}
+
+/* Copy words in ARGS to top of user stack at *ESP in one piece,
+   then build argv pointing into that copy, argc and fake return
+   address below them.  Return false if they do not fit in stack
+   page. */
+static bool
+push_args (const struct cmd_args *args, void **esp)
+{
+  char *str, *end, *p;
+  char **argv;
+  int i;
+
+  /* String copy, word aligned argv with null sentinel, and argv,
+     argc, return address must all fit in first stack page. */
+  str = (char *) *esp - args->len;
+  argv = (char **) ((uintptr_t) str & ~3u) - (args->argc + 1);
+  if ((uint8_t *) PHYS_BASE - (uint8_t *) (argv - 3) > PGSIZE)
+    return false;
+
+  memcpy (str, args->start, args->len);
+
+  /* Words in copy are separated by null and, where command line had
+     several spaces in a row, by spaces. */
+  end = str + args->len;
+  p = str;
+  for (i = 0; i < args->argc; i++)
+  {
+    while (p < end && (*p == ' ' || *p == '\0'))
+      p++;
+    argv[i] = p;
+    p += strlen (p) + 1;
+  }
+  argv[args->argc] = NULL;
+
+  /* Push argv, argc and fake return address. */
+  argv[-1] = (char *) argv;
+  ((int *) argv)[-2] = args->argc;
+  argv[-3] = NULL;
+  *esp = argv - 3;
+  return true;
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -174,58 +495,201 @@ start_process (void *file_name_)
 int
 process_wait (tid_t child_tid UNUSED) 
 {
-  struct thread *cp;
+  struct child_status *cs;
   int status;
 
   /* Get child process using child's tid. */
-  cp = get_child_process (child_tid);
+  cs = get_child_process (child_tid);
 
   /* If fail, return abnormal result(-1) . */
-  if (cp == NULL)
+  if (cs == NULL)
     return -1;
 
   /* Waits until child process end. */
-  sema_down (&cp->exit);
+  sema_down (&cs->exit);
 
   /* Check if child process end normally. */
-  status = cp->exit_status;
+  status = cs->exit_status;
+  rusage_add (&thread_current ()->usage, &cs->usage);
 
   /* Remove finished child process. */
-  remove_child_process (cp);
+  remove_child_process (cs);
   return status;
 }
 
-/* Free the current process's resources. */
+/* Waits for any child of the current thread to exit, or, if
+   BLOCK is false, only checks for one that already has.  Children
+   are reaped in the order they exit, however they were started.
+   Stores the child's exit status in *STATUS and returns its pid.
+   Returns TID_ERROR at once if there is no child left to wait
+   for, or, if BLOCK is false, none has exited yet. */
+tid_t
+process_wait_any (int *status, bool block)
+{
+  struct thread *cur = thread_current ();
+  struct child_status *cs;
+  enum intr_level old_level;
+  tid_t tid;
+
+  if (cur->children == NULL || ohash_empty (cur->children))
+    return TID_ERROR;
+  if (block)
+    sema_down (&cur->child_exited);
+  else if (!sema_try_down (&cur->child_exited))
+    return TID_ERROR;
+
+  old_level = intr_disable ();
+  ASSERT (!list_empty (&cur->exited_children));
+  cs = list_entry (list_pop_front (&cur->exited_children),
+                   struct child_status, exit_elem);
+  cs->queued = false;
+  intr_set_level (old_level);
+
+  tid = cs->tid;
+  *status = cs->exit_status;
+  rusage_add (&cur->usage, &cs->usage);
+  remove_child_process (cs);
+  return tid;
+}
+
+/* Frees the current thread's share of its process's resources,
+   and the process's own resources if it is the last thread to go.
+   Unless it exits with uthread_exit(), a thread going ends the
+   whole process: the other threads exit on their way back to
+   user mode, or, if asleep in futex_wait() or uthread_join(),
+   as soon as they wake up. */
 void
 process_exit (void)
 {
   struct thread *cur = thread_current ();
+  struct process *p = cur->process;
+  struct child_status *cs;
+  struct list_elem *e;
+  struct rusage usage;
+  enum intr_level old_level;
   uint32_t *pd;
+  bool last, report = false;
 
-  /* Close all file in process by using next file descriptor position.
-     And free file descriptor table. */
-  int i;
-  for (i = 2; i < cur->next_fd; i++){
-      process_close_file (i);
-  }
-  palloc_free_page(cur->fdt);
+  /* Drop references to children's status records. */
+  if (cur->children != NULL)
+    {
+      ohash_destroy (cur->children, child_release);
+      free (cur->children);
+      cur->children = NULL;
+    }
 
-  /* Destroy the current process's page directory and switch back
-     to the kernel-only page directory. */
-  pd = cur->pagedir;
+  if (p == NULL)
+    return;
+
+  /* Leave the address space before counting ourselves out, since
+     the last thread destroys it as soon as it is alone.  We must
+     set cur->pagedir to NULL before switching page directories,
+     so that a timer interrupt can't switch back to the process
+     page directory. */
+  cur->pagedir = NULL;
+  cur->kdata = NULL;
+  pagedir_activate (NULL);
+
+  lock_acquire (&p->lock);
+  thread_get_usage (cur, &usage);
+  rusage_add (&p->usage, &usage);
+  thread_clear_usage (cur);
+  last = --p->thread_cnt == 0;
+  if (!p->exiting && (last || !cur->thread_only))
+    {
+      /* exit() has reported the end already unless the last
+         thread left by uthread_exit(). */
+      report = cur->thread_only;
+      start_exit (p, cur->exit_status);
+    }
+  if (cur->uthread != NULL)
+    {
+      cur->uthread->exit_status = cur->exit_status;
+      cur->uthread->done = true;
+    }
+  cond_broadcast (&p->thread_exited, &p->lock);
+  lock_release (&p->lock);
+
+  if (report)
+    printf ("%s: exit(%d)\n", cur->name, p->exit_status);
+  if (last && process_report_usage)
+    printf ("%s: rusage: %"PRIu64" ticks, %"PRIu64" page faults, "
+            "%"PRIu64" sectors read, %"PRIu64" sectors written, "
+            "%"PRIu64" syscalls, %"PRIu64" evictions, "
+            "%"PRIu64" pages swapped in, %"PRIu64" swapped out, "
+            "%"PRIu64" us user, %"PRIu64" us kernel, "
+            "%"PRIu64" us interrupts\n",
+            cur->name, p->usage.ticks, p->usage.page_faults,
+            p->usage.read_sectors, p->usage.write_sectors,
+            p->usage.syscalls, p->usage.evictions, p->usage.swap_ins,
+            p->usage.swap_outs, p->usage.user_ns / 1000,
+            p->usage.kernel_ns / 1000, p->usage.intr_ns / 1000);
+  if (!last)
+    {
+      cur->process = NULL;
+      return;
+    }
+
+  /* Close all open files and free file descriptor table. */
+  free_fdt (p);
+
+  dir_close (p->cwd);
+
+#ifdef VM
+  /* Write back and drop memory-mapped files and let go of shared
+     memory, then release user frames through the frame table
+     before the page directory that maps them goes away. */
+  mmap_unmap_all ();
+  shm_detach_all ();
+  page_table_destroy (&p->pages);
+#endif
+
+  /* Closing the executable allows writes to it again.  Its pages
+     may be mapped from the page cache, which a last close waits
+     to see released, so it comes after the page table. */
+  file_close (p->exec_file);
+
+  /* Destroy the process's page directory.  Page directory must
+     be NULL first, so that eviction finds no mapping left in
+     it. */
+  pd = p->pagedir;
   if (pd != NULL) 
     {
-      /* Correct ordering here is crucial.  We must set
-         cur->pagedir to NULL before switching page directories,
-         so that a timer interrupt can't switch back to the
-         process page directory.  We must activate the base page
-         directory before destroying the process's page
-         directory, or our active page directory will be one
-         that's been freed (and cleared). */
-      cur->pagedir = NULL;
-      pagedir_activate (NULL);
+      p->pagedir = NULL;
+      p->kdata = NULL;
       pagedir_destroy (pd);
     }
+
+  /* Free threads nobody joined. */
+  while (!list_empty (&p->uthreads))
+    {
+      e = list_pop_front (&p->uthreads);
+      free (list_entry (e, struct uthread, elem));
+    }
+
+  /* Hand exit status to parent, also waking it up from exec if
+     this process ended before it finished loading. */
+  cs = p->child_status;
+  if (cs != NULL)
+    {
+      if (cs->cmd_line != NULL)
+        {
+          cs->cmd_line = NULL;
+          sema_up (&cs->load);
+        }
+      old_level = intr_disable ();
+      cs->exit_status = p->exit_status;
+      cs->usage = p->usage;
+      cs->exited = true;
+      if (cs->parent != NULL)
+        queue_exited_child (cs);
+      intr_set_level (old_level);
+      sema_up (&cs->exit);
+      release_child_status (cs);
+    }
+
+  cur->process = NULL;
+  kmem_cache_free (process_cache, p);
 }
 
 /* Sets up the CPU for running user code in the current
@@ -236,13 +700,362 @@ process_activate (void)
 {
   struct thread *t = thread_current ();
 
-  /* Activate thread's page tables. */
-  pagedir_activate (t->pagedir);
+  /* Activate thread's page tables, unless they are active
+     already. */
+  pagedir_switch (t->pagedir);
+
+  /* Catch the kernel data page up on time spent switched out. */
+  thread_update_kdata (t);
 
   /* Set thread's kernel stack for use in processing
      interrupts. */
   tss_update ();
 }
+
+/* Starts a new thread of the current process running user code at
+   EIP with stack pointer ESP.  Bad addresses kill the process as
+   soon as the thread uses them.  Returns the new thread's tid, or
+   TID_ERROR if it cannot be created or the process is ending. */
+tid_t
+process_thread_create (void (*eip) (void), void *esp)
+{
+  struct thread *cur = thread_current ();
+  struct process *p = cur->process;
+  struct uthread *ut;
+  tid_t tid;
+
+  ut = malloc (sizeof *ut);
+  if (ut == NULL)
+    return TID_ERROR;
+  ut->tid = TID_ERROR;
+  ut->done = false;
+  ut->joined = false;
+  ut->exit_status = -1;
+  ut->process = p;
+  ut->eip = eip;
+  ut->esp = esp;
+
+  /* Count the thread in before it can run, so that the process
+     cannot end under it. */
+  lock_acquire (&p->lock);
+  if (p->exiting)
+    {
+      lock_release (&p->lock);
+      free (ut);
+      return TID_ERROR;
+    }
+  p->thread_cnt++;
+  list_push_back (&p->uthreads, &ut->elem);
+  lock_release (&p->lock);
+
+  tid = thread_create (cur->name, PRI_DEFAULT, start_uthread, ut);
+
+  lock_acquire (&p->lock);
+  if (tid == TID_ERROR)
+    {
+      p->thread_cnt--;
+      list_remove (&ut->elem);
+      free (ut);
+    }
+  else
+    ut->tid = tid;
+  lock_release (&p->lock);
+  return tid;
+}
+
+/* A thread function that joins a new thread to the process in its
+   uthread record UT_ and starts it running user code. */
+static void
+start_uthread (void *ut_)
+{
+  struct uthread *ut = ut_;
+  struct thread *t = thread_current ();
+  struct process *p = ut->process;
+  struct intr_frame if_;
+
+  t->process = p;
+  t->pagedir = p->pagedir;
+  t->kdata = p->kdata;
+  t->uthread = ut;
+  process_activate ();
+  process_check_exiting ();
+
+  memset (&if_, 0, sizeof if_);
+  if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
+  if_.cs = SEL_UCSEG;
+  if_.eflags = FLAG_IF | FLAG_MBS;
+  if_.eip = ut->eip;
+  if_.esp = ut->esp;
+
+  /* Enter user mode as start_process() does. */
+  thread_set_cpu_mode (CPU_USER);
+  asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+  NOT_REACHED ();
+}
+
+/* Ends the current thread with STATUS, for uthread_join(), and
+   leaves the rest of its process running.  If it is the last
+   thread, the process ends as if by exit(STATUS). */
+void
+process_thread_exit (int status)
+{
+  struct thread *cur = thread_current ();
+
+  cur->exit_status = status;
+  cur->thread_only = true;
+  thread_exit ();
+}
+
+/* Waits for thread TID of the current process, started by
+   uthread_create(), to exit and returns its exit status.  Returns
+   -1 at once if TID is not such a thread, is the caller, or is
+   already being waited for, and -1 as soon as the process starts
+   ending. */
+int
+process_thread_join (tid_t tid)
+{
+  struct thread *cur = thread_current ();
+  struct process *p = cur->process;
+  struct uthread *ut = NULL;
+  struct list_elem *e;
+  int status = -1;
+
+  lock_acquire (&p->lock);
+  for (e = list_begin (&p->uthreads); e != list_end (&p->uthreads);
+       e = list_next (e))
+    if (list_entry (e, struct uthread, elem)->tid == tid)
+      {
+        ut = list_entry (e, struct uthread, elem);
+        break;
+      }
+
+  if (ut != NULL && ut != cur->uthread && !ut->joined)
+    {
+      ut->joined = true;
+      while (!ut->done && !p->exiting)
+        cond_wait (&p->thread_exited, &p->lock);
+      if (ut->done)
+        {
+          status = ut->exit_status;
+          list_remove (&ut->elem);
+          free (ut);
+        }
+      else
+        ut->joined = false;
+    }
+  lock_release (&p->lock);
+  return status;
+}
+
+/* Starts ending the current process with STATUS, so that its other
+   threads exit.  Returns false if the process was already ending,
+   so that exit() reports how a process ended only once. */
+bool
+process_begin_exit (int status)
+{
+  struct process *p = thread_current ()->process;
+  bool first;
+
+  if (p == NULL)
+    return true;
+  lock_acquire (&p->lock);
+  first = !p->exiting;
+  if (first)
+    start_exit (p, status);
+  lock_release (&p->lock);
+  return first;
+}
+
+/* Exits the current thread if its process is ending.  Called on
+   the way back to user mode. */
+void
+process_check_exiting (void)
+{
+  struct process *p = thread_current ()->process;
+
+  if (p != NULL && p->exiting)
+    {
+      intr_enable ();
+      thread_exit ();
+    }
+}
+
+/* Stores in *USAGE the resources used so far by the current
+   process: those of its exited threads plus those of its live
+   ones, each of which includes the children it waited for. */
+void
+process_get_usage (struct rusage *usage)
+{
+  struct process *p = thread_current ()->process;
+  enum intr_level old_level;
+
+  ASSERT (p != NULL);
+
+  lock_acquire (&p->lock);
+  *usage = p->usage;
+  old_level = intr_disable ();
+  thread_foreach (add_thread_usage, usage);
+  intr_set_level (old_level);
+  lock_release (&p->lock);
+}
+
+/* Moves the current process's program break by INCREMENT bytes,
+   adding zeroed pages to the heap as it grows and freeing them as
+   it shrinks.  Without VM, each aligned 4 MB of new heap is
+   mapped as one large page if it can be.  Returns the old break,
+   or NULL if the break would fall below the start of the heap,
+   run into the stack area or a page already in use, or if memory
+   is exhausted. */
+void *
+process_sbrk (intptr_t increment)
+{
+  struct process *p = thread_current ()->process;
+  uint8_t *old_brk, *new_brk, *upage;
+  uint8_t *limit = (uint8_t *) PHYS_BASE - HEAP_STACK_GAP;
+
+  lock_acquire (&p->lock);
+  old_brk = p->brk;
+  new_brk = old_brk + increment;
+  if (old_brk == NULL
+      || (increment > 0 && (new_brk < old_brk || new_brk > limit))
+      || (increment < 0 && (new_brk > old_brk || new_brk < p->heap_start)))
+    goto fail;
+
+  for (upage = pg_round_up (old_brk); upage < new_brk; upage += PGSIZE)
+    {
+#ifndef VM
+      if (heap_add_large (upage, new_brk))
+        {
+          upage += PTSPAN - PGSIZE;
+          continue;
+        }
+#endif
+      if (!heap_add_page (upage))
+        {
+          heap_remove_range (pg_round_up (old_brk), upage);
+          goto fail;
+        }
+    }
+
+  /* Shrinking into the middle of a large page first splits it,
+     which may run out of memory.  Large pages wholly above the
+     new break go all at once. */
+  upage = pg_round_up (new_brk);
+#ifndef VM
+  if (upage < old_brk
+      && !pagedir_split_large (thread_current ()->pagedir, upage))
+    goto fail;
+#endif
+  heap_remove_range (upage, old_brk);
+
+  p->brk = new_brk;
+  lock_release (&p->lock);
+  return old_brk;
+
+ fail:
+  lock_release (&p->lock);
+  return NULL;
+}
+
+/* Adds the usage of thread T to *AUX, a struct rusage, if T
+   belongs to the current process. */
+static void
+add_thread_usage (struct thread *t, void *aux)
+{
+  struct rusage usage;
+
+  if (t->process == thread_current ()->process)
+    {
+      thread_get_usage (t, &usage);
+      rusage_add (aux, &usage);
+    }
+}
+
+/* Adds the counts in B to those in A. */
+static void
+rusage_add (struct rusage *a, const struct rusage *b)
+{
+  a->ticks += b->ticks;
+  a->page_faults += b->page_faults;
+  a->read_sectors += b->read_sectors;
+  a->write_sectors += b->write_sectors;
+  a->syscalls += b->syscalls;
+  a->evictions += b->evictions;
+  a->swap_ins += b->swap_ins;
+  a->swap_outs += b->swap_outs;
+  a->user_ns += b->user_ns;
+  a->kernel_ns += b->kernel_ns;
+  a->intr_ns += b->intr_ns;
+}
+
+/* Marks P, whose lock must be held, as ending with STATUS, and
+   wakes its threads asleep in futex_wait() and uthread_join() so
+   that they can exit. */
+static void
+start_exit (struct process *p, int status)
+{
+  ASSERT (lock_held_by_current_thread (&p->lock));
+
+  p->exiting = true;
+  p->exit_status = status;
+  cond_broadcast (&p->thread_exited, &p->lock);
+  futex_wake_all (p->pagedir);
+}
+
+/* Returns a new process with a single thread yet to start, no
+   address space and no open files, or a null pointer if memory
+   is exhausted. */
+static struct process *
+process_create (void)
+{
+  struct process *p = kmem_cache_alloc (process_cache);
+
+  if (p == NULL)
+    return NULL;
+  p->pid = TID_ERROR;
+  p->pagedir = NULL;
+  p->kdata = NULL;
+  lock_init (&p->lock);
+  p->thread_cnt = 1;
+  list_init (&p->uthreads);
+  cond_init (&p->thread_exited);
+  p->exiting = false;
+  p->exit_status = -1;
+  memset (&p->usage, 0, sizeof p->usage);
+  p->heap_start = p->brk = NULL;
+  p->child_status = NULL;
+  ASSERT (bitmap_buf_size (FD_INLINE_CNT) <= sizeof p->fd_map_inline);
+  p->fdt = p->fdt_inline;
+  p->fd_map = bitmap_create_in_buf (FD_INLINE_CNT, p->fd_map_inline,
+                                    sizeof p->fd_map_inline);
+  p->fd_cnt = FD_INLINE_CNT;
+  memset (p->fdt_inline, 0, sizeof p->fdt_inline);
+  bitmap_set_multiple (p->fd_map, 0, 2, true);
+  p->stdin_mode = INPUT_RAW;
+  p->exec_file = NULL;
+  p->cwd = NULL;
+#ifdef VM
+  lock_init (&p->page_lock);
+  page_table_init (&p->pages);
+  list_init (&p->mmaps);
+  p->next_mapid = 0;
+  list_init (&p->shms);
+#endif
+  return p;
+}
+
+/* Frees P, a process from process_create() that never started. */
+static void
+process_free (struct process *p)
+{
+  free_fdt (p);
+  dir_close (p->cwd);
+#ifdef VM
+  page_table_destroy (&p->pages);
+#endif
+  file_close (p->exec_file);
+  kmem_cache_free (process_cache, p);
+}
 
 /* We load ELF binaries.  The following definitions are taken
    from the ELF specification, [ELF1], more-or-less verbatim.  */
@@ -307,12 +1120,50 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
+/* An executable's validated headers, reduced to what load() needs
+   to map it.  The plan is cached with the executable's inode
+   until the file is written, so that exec'ing the same program
+   again skips reading and checking its headers.  It is followed
+   in memory by SEG_CNT struct exec_segments. */
+struct exec_plan
+  {
+    uint32_t entry;             /* Entry point. */
+    uint8_t *heap_start;        /* Just past the highest segment. */
+    size_t seg_cnt;             /* Number of loadable segments. */
+  };
+
+/* A loadable segment, in the form taken by load_segment(). */
+struct exec_segment
+  {
+    uint32_t file_page;         /* Page-aligned offset in file. */
+    uint32_t mem_page;          /* Page-aligned user address. */
+    uint32_t read_bytes;        /* Bytes to read from the file. */
+    uint32_t zero_bytes;        /* Bytes to zero after those. */
+    bool writable;              /* Writable by the process? */
+  };
+
+/* Returns the segments that follow PLAN. */
+static inline struct exec_segment *
+plan_segments (struct exec_plan *plan)
+{
+  return (struct exec_segment *) (plan + 1);
+}
+
+static struct exec_plan *read_plan (struct file *, const char *file_name,
+                                    size_t *size);
 static bool setup_stack (void **esp);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
+#ifdef VM
+/* Pages at the start of each read-only segment that load() asks
+   to have read in while the process starts, so that most of the
+   page faults it takes on them find the data already cached. */
+#define EXEC_PREFETCH_PAGES 8
+#endif
+
 /* Loads an ELF executable from FILE_NAME into the current thread.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
@@ -321,35 +1172,108 @@ bool
 load (const char *file_name, void (**eip) (void), void **esp) 
 {
   struct thread *t = thread_current ();
-  struct Elf32_Ehdr ehdr;
+  struct inode *inode;
+  struct exec_plan *plan = NULL;
   struct file *file = NULL;
-  off_t file_ofs;
+  size_t plan_size;
   bool success = false;
-  int i;
+  size_t i;
 
   /* Allocate and activate page directory. */
-  t->pagedir = pagedir_create ();
+  t->pagedir = t->process->pagedir = pagedir_create ();
   if (t->pagedir == NULL) 
     goto done;
   process_activate ();
 
-  /* Acquire Lock to avoid multiple access. */
-  lock_acquire (&filesys_lock);
-
   /* Open executable file. */
   file = filesys_open (file_name);
   if (file == NULL) 
   {
-    /* release lock before end. */
-    lock_release (&filesys_lock);
     printf ("load: %s: open failed\n", file_name);
     goto done; 
   }
   /* Deny write to avoid file change. */
   file_deny_write (file);
 
-  /* After file open done, release lock. */
-  lock_release (&filesys_lock);
+  /* Use the load plan left by the last exec of this file, or read
+     and check its headers to make one. */
+  inode = file_get_inode (file);
+  plan = inode_get_exec_plan (inode, &plan_size);
+  if (plan == NULL)
+    {
+      plan = read_plan (file, file_name, &plan_size);
+      if (plan == NULL)
+        goto done;
+      inode_set_exec_plan (inode, plan, plan_size);
+      plan = inode_get_exec_plan (inode, &plan_size);
+      if (plan == NULL)
+        goto done;
+    }
+
+  /* Map the segments. */
+  for (i = 0; i < plan->seg_cnt; i++)
+    {
+      struct exec_segment *s = &plan_segments (plan)[i];
+      if (!load_segment (file, s->file_page, (void *) s->mem_page,
+                         s->read_bytes, s->zero_bytes, s->writable))
+        goto done;
+#ifdef VM
+      if (!s->writable)
+        {
+          size_t page_cnt = DIV_ROUND_UP (s->read_bytes, PGSIZE);
+          if (page_cnt > EXEC_PREFETCH_PAGES)
+            page_cnt = EXEC_PREFETCH_PAGES;
+          inode_prefetch (inode, s->file_page / PGSIZE,
+                          s->file_page / PGSIZE + page_cnt);
+        }
+#endif
+    }
+
+  /* The heap starts out empty, just past the highest segment. */
+  t->process->heap_start = t->process->brk = plan->heap_start;
+
+  /* Set up stack. */
+  if (!setup_stack (esp))
+    goto done;
+
+  /* Map kernel data page. */
+  if (!setup_kdata ())
+    goto done;
+
+  /* Start address. */
+  *eip = (void (*) (void)) plan->entry;
+
+  success = true;
+
+ done:
+  /* We arrive here whether the load is successful or not.  The
+     file stays open for the life of the process, both to keep
+     writes denied and so that pages can be read from it on
+     demand; process_exit() closes it. */
+  t->process->exec_file = file;
+  free (plan);
+  return success;
+}
+
+/* load() helpers. */
+
+#ifndef VM
+static bool install_page (void *upage, void *kpage, bool writable);
+#endif
+
+/* Reads and verifies the headers of the ELF executable in FILE,
+   named FILE_NAME in error messages, and returns a load plan for
+   it, allocated with malloc(), storing its size in *SIZE.
+   Returns a null pointer if the executable is invalid or if
+   memory cannot be allocated. */
+static struct exec_plan *
+read_plan (struct file *file, const char *file_name, size_t *size)
+{
+  struct Elf32_Ehdr ehdr;
+  struct exec_plan *plan;
+  size_t seg_max = 4;
+  off_t file_ofs;
+  int i;
 
   /* Read and verify executable header. */
   if (file_read (file, &ehdr, sizeof ehdr) != sizeof ehdr
@@ -361,9 +1285,16 @@ load (const char *file_name, void (**eip) (void), void **esp)
       || ehdr.e_phnum > 1024) 
     {
       printf ("load: %s: error loading executable\n", file_name);
-      goto done; 
+      return NULL;
     }
 
+  plan = malloc (sizeof *plan + seg_max * sizeof (struct exec_segment));
+  if (plan == NULL)
+    return NULL;
+  plan->entry = ehdr.e_entry;
+  plan->heap_start = NULL;
+  plan->seg_cnt = 0;
+
   /* Read program headers. */
   file_ofs = ehdr.e_phoff;
   for (i = 0; i < ehdr.e_phnum; i++) 
@@ -371,11 +1302,11 @@ load (const char *file_name, void (**eip) (void), void **esp)
       struct Elf32_Phdr phdr;
 
       if (file_ofs < 0 || file_ofs > file_length (file))
-        goto done;
+        goto error;
       file_seek (file, file_ofs);
 
       if (file_read (file, &phdr, sizeof phdr) != sizeof phdr)
-        goto done;
+        goto error;
       file_ofs += sizeof phdr;
       switch (phdr.p_type) 
         {
@@ -389,15 +1320,27 @@ load (const char *file_name, void (**eip) (void), void **esp)
         case PT_DYNAMIC:
         case PT_INTERP:
         case PT_SHLIB:
-          goto done;
+          goto error;
         case PT_LOAD:
           if (validate_segment (&phdr, file)) 
             {
-              bool writable = (phdr.p_flags & PF_W) != 0;
-              uint32_t file_page = phdr.p_offset & ~PGMASK;
-              uint32_t mem_page = phdr.p_vaddr & ~PGMASK;
               uint32_t page_offset = phdr.p_vaddr & PGMASK;
               uint32_t read_bytes, zero_bytes;
+              struct exec_segment *s;
+              uint8_t *end;
+
+              if (plan->seg_cnt >= seg_max)
+                {
+                  struct exec_plan *bigger;
+
+                  seg_max *= 2;
+                  bigger = realloc (plan, sizeof *plan + (seg_max
+                                    * sizeof (struct exec_segment)));
+                  if (bigger == NULL)
+                    goto error;
+                  plan = bigger;
+                }
+
               if (phdr.p_filesz > 0)
                 {
                   /* Normal segment.
@@ -413,34 +1356,30 @@ load (const char *file_name, void (**eip) (void), void **esp)
                   read_bytes = 0;
                   zero_bytes = ROUND_UP (page_offset + phdr.p_memsz, PGSIZE);
                 }
-              if (!load_segment (file, file_page, (void *) mem_page,
-                                 read_bytes, zero_bytes, writable))
-                goto done;
+
+              s = &plan_segments (plan)[plan->seg_cnt++];
+              s->file_page = phdr.p_offset & ~PGMASK;
+              s->mem_page = phdr.p_vaddr & ~PGMASK;
+              s->read_bytes = read_bytes;
+              s->zero_bytes = zero_bytes;
+              s->writable = (phdr.p_flags & PF_W) != 0;
+              end = (uint8_t *) s->mem_page + read_bytes + zero_bytes;
+              if (end > plan->heap_start)
+                plan->heap_start = end;
             }
           else
-            goto done;
+            goto error;
           break;
         }
     }
 
-  /* Set up stack. */
-  if (!setup_stack (esp))
-    goto done;
-
-  /* Start address. */
-  *eip = (void (*) (void)) ehdr.e_entry;
+  *size = sizeof *plan + plan->seg_cnt * sizeof (struct exec_segment);
+  return plan;
 
-  success = true;
-
- done:
-  /* We arrive here whether the load is successful or not. */
-  file_close (file);
-  return success;
+ error:
+  free (plan);
+  return NULL;
 }
-
-/* load() helpers. */
-
-static bool install_page (void *upage, void *kpage, bool writable);
 
 /* Checks whether PHDR describes a valid, loadable segment in
    FILE and returns true if so, false otherwise. */
@@ -501,15 +1440,27 @@ validate_segment (const struct Elf32_Phdr *phdr, struct file *file)
 
    Return true if successful, false if a memory allocation error
    or disk read error occurs. */
+#ifndef VM
+/* Pages that load_segment() reads before mapping them together. */
+#define LOAD_BATCH 16
+#endif
+
 static bool
 load_segment (struct file *file, off_t ofs, uint8_t *upage,
               uint32_t read_bytes, uint32_t zero_bytes, bool writable) 
 {
+#ifndef VM
+  void *kpages[LOAD_BATCH];
+  size_t kpage_cnt = 0;
+#endif
+
   ASSERT ((read_bytes + zero_bytes) % PGSIZE == 0);
   ASSERT (pg_ofs (upage) == 0);
   ASSERT (ofs % PGSIZE == 0);
 
+#ifndef VM
   file_seek (file, ofs);
+#endif
   while (read_bytes > 0 || zero_bytes > 0) 
     {
       /* Calculate how to fill this page.
@@ -518,25 +1469,39 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
       size_t page_zero_bytes = PGSIZE - page_read_bytes;
 
+#ifdef VM
+      /* Record where the page comes from; page_fault() reads it
+         in the first time it is touched.  Pages with nothing to
+         read start out backed by the shared zero page. */
+      if (page_read_bytes == 0
+          ? !page_add_zero (upage, writable)
+          : !page_add_file (upage, file, ofs, page_read_bytes,
+                            page_zero_bytes, writable))
+        return false;
+      ofs += page_read_bytes;
+#else
       /* Get a page of memory. */
       uint8_t *kpage = palloc_get_page (PAL_USER);
       if (kpage == NULL)
-        return false;
+        goto error;
+      kpages[kpage_cnt++] = kpage;
 
       /* Load this page. */
       if (file_read (file, kpage, page_read_bytes) != (int) page_read_bytes)
-        {
-          palloc_free_page (kpage);
-          return false; 
-        }
+        goto error;
       memset (kpage + page_read_bytes, 0, page_zero_bytes);
 
-      /* Add the page to the process's address space. */
-      if (!install_page (upage, kpage, writable)) 
+      /* Add the pages read so far to the process's address space,
+         once there are LOAD_BATCH of them or the segment ends. */
+      if (kpage_cnt == LOAD_BATCH || read_bytes + zero_bytes == PGSIZE)
         {
-          palloc_free_page (kpage);
-          return false; 
+          if (!pagedir_map_range (thread_current ()->pagedir,
+                                  upage - (kpage_cnt - 1) * PGSIZE,
+                                  kpages, kpage_cnt, writable))
+            goto error;
+          kpage_cnt = 0;
         }
+#endif
 
       /* Advance. */
       read_bytes -= page_read_bytes;
@@ -544,13 +1509,124 @@ load_segment (struct file *file, off_t ofs, uint8_t *upage,
       upage += PGSIZE;
     }
   return true;
+
+#ifndef VM
+ error:
+  while (kpage_cnt > 0)
+    palloc_free_page (kpages[--kpage_cnt]);
+  return false;
+#endif
+}
+
+/* Adds a zeroed, writable page at UPAGE to the current process's
+   heap.  Returns false if UPAGE is in use or memory is
+   exhausted. */
+static bool
+heap_add_page (void *upage)
+{
+#ifdef VM
+  struct lock *page_lock = &thread_current ()->process->page_lock;
+  bool success;
+
+  lock_acquire (page_lock);
+  success = page_add_zero (upage, true);
+  lock_release (page_lock);
+  return success;
+#else
+  uint8_t *kpage = palloc_get_page (PAL_USER | PAL_ZERO);
+
+  if (kpage == NULL)
+    return false;
+  if (!install_page (upage, kpage, true))
+    {
+      palloc_free_page (kpage);
+      return false;
+    }
+  return true;
+#endif
+}
+
+/* Removes the page at UPAGE from the current process's heap and
+   frees it. */
+static void
+heap_remove_page (void *upage)
+{
+#ifdef VM
+  struct lock *page_lock = &thread_current ()->process->page_lock;
+  struct page *p;
+
+  lock_acquire (page_lock);
+  p = page_lookup (upage);
+  if (p != NULL)
+    page_remove (p);
+  lock_release (page_lock);
+#else
+  uint32_t *pd = thread_current ()->pagedir;
+  void *kpage = pagedir_get_page (pd, upage);
+
+  if (kpage != NULL)
+    {
+      pagedir_clear_page (pd, upage);
+      palloc_free_page (kpage);
+    }
+#endif
+}
+
+/* Removes the pages of the current process's heap from START up
+   to END from it and frees them.  A large page must lie wholly
+   within the range. */
+static void
+heap_remove_range (uint8_t *start, uint8_t *end)
+{
+  uint8_t *upage;
+
+  for (upage = start; upage < end; upage += PGSIZE)
+    {
+#ifndef VM
+      uint32_t *pd = thread_current ()->pagedir;
+
+      if (pagedir_is_large (pd, upage))
+        {
+          ASSERT (((uintptr_t) upage & (PTSPAN - 1)) == 0);
+          ASSERT ((size_t) (end - upage) >= PTSPAN);
+          pagedir_remove_large (pd, upage);
+          upage += PTSPAN - PGSIZE;
+          continue;
+        }
+#endif
+      heap_remove_page (upage);
+    }
+}
+
+#ifndef VM
+/* Adds a zeroed, writable large page at UPAGE to the current
+   process's heap, if UPAGE is aligned for one, the heap is to
+   reach END or beyond it, and large pages are enabled and free.
+   Returns true if successful. */
+static bool
+heap_add_large (uint8_t *upage, uint8_t *end)
+{
+  return (((uintptr_t) upage & (PTSPAN - 1)) == 0
+          && end > upage && (size_t) (end - upage) >= PTSPAN
+          && pagedir_add_large (thread_current ()->pagedir, upage, true));
 }
+#endif
 
 /* Create a minimal stack by mapping a zeroed page at the top of
    user virtual memory. */
 static bool
 setup_stack (void **esp) 
 {
+#ifdef VM
+  uint8_t *upage = ((uint8_t *) PHYS_BASE) - PGSIZE;
+
+  /* The stack page is needed right away for the arguments, so
+     bring it in now rather than on first fault. */
+  if (!page_add_zero (upage, true) || !page_load (page_lookup (upage)))
+    return false;
+  *esp = PHYS_BASE;
+  return true;
+#else
   uint8_t *kpage;
   bool success = false;
 
@@ -564,8 +1640,45 @@ setup_stack (void **esp)
         palloc_free_page (kpage);
     }
   return success;
+#endif
 }
 
+/* Map a zeroed, read-only kernel data page at KDATA_ADDR.  It is
+   not in the supplemental page table, so it never leaves memory,
+   and pagedir_destroy () frees it along with the page directory. */
+static bool
+setup_kdata (void)
+{
+  struct thread *t = thread_current ();
+  void *upage = (void *) KDATA_ADDR;
+  struct kdata *kd;
+
+  /* Executable must not have put anything there. */
+#ifdef VM
+  if (page_lookup (upage) != NULL)
+    return false;
+#endif
+  if (pagedir_get_page (t->pagedir, upage) != NULL)
+    return false;
+
+  kd = palloc_get_page (PAL_ZERO);
+  if (kd == NULL)
+    return false;
+  if (!pagedir_set_page (t->pagedir, upage, kd, false))
+    {
+      palloc_free_page (kd);
+      return false;
+    }
+  kd->tid = t->process->pid;
+  kd->ticks_per_sec = TIMER_FREQ;
+  kd->cycles_per_sec = timer_cycles_per_sec ();
+  kd->sysenter = syscall_sysenter;
+  t->kdata = t->process->kdata = kd;
+  thread_update_kdata (t);
+  return true;
+}
+
+#ifndef VM
 /* Adds a mapping from user virtual address UPAGE to kernel
    virtual address KPAGE to the page table.
    If WRITABLE is true, the user process may modify the page;
@@ -585,126 +1698,270 @@ install_page (void *upage, void *kpage, bool writable)
   return (pagedir_get_page (t->pagedir, upage) == NULL
           && pagedir_set_page (t->pagedir, upage, kpage, writable));
 }
+#endif
+
+/* Get status record of child process by using pid.
+   If pid is not a child of current process, return NULL. */
+struct child_status *
+get_child_process (int pid)
+{
+  struct ohash *children = thread_current ()->children;
+  struct child_status key;
+  struct hash_elem *e;
+
+  if (children == NULL)
+    return NULL;
+  key.tid = pid;
+  e = ohash_find (children, &key.elem);
+  return e != NULL ? hash_entry (e, struct child_status, elem) : NULL;
+}
 
-/* Save data into user stack. */
+/* Remove given child process from current process's children. */
 void
-argument_stack(char **parse, int count, void **esp)
+remove_child_process (struct child_status *cs)
 {
-  int i, j;
-  char *argv;
-  char *argv_each[count];
-  int word_count;
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
-  /* word_count check how many word in file name. */
-  word_count = 0;
+  /* If given child process is invalid, return. */
+  if (cs == NULL)
+    return;
 
-  /* Push file name in stack. */
-  for (i = count - 1 ; i > -1 ; i--)
-  {
-    for (j = strlen(parse[i]) ; j > -1 ; j--)
+  /* Take it off the exited queue too, if reaped by pid. */
+  old_level = intr_disable ();
+  cs->parent = NULL;
+  if (cs->queued)
     {
-      *esp = *esp - 1;
-      **(char **)esp = parse[i][j];
-      word_count++;
+      cs->queued = false;
+      list_remove (&cs->exit_elem);
+      sema_try_down (&cur->child_exited);
     }
-    /* Save each start point of argv into array. */
-    argv_each[i] = *esp;
-  }
+  intr_set_level (old_level);
+
+  ohash_delete (cur->children, &cs->elem);
+  release_child_status (cs);
+}
+
+/* Have child CS, just entered in the current thread's
+   `children', queued for process_wait_any() when it exits, or at
+   once if it already has. */
+static void
+watch_child (struct child_status *cs)
+{
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  cs->parent = thread_current ();
+  if (cs->exited)
+    queue_exited_child (cs);
+  intr_set_level (old_level);
+}
+
+/* Queues exited child CS on its parent's `exited_children' and
+   wakes the parent.  Interrupts must be off. */
+static void
+queue_exited_child (struct child_status *cs)
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  cs->queued = true;
+  list_push_back (&cs->parent->exited_children, &cs->exit_elem);
+  sema_up (&cs->parent->child_exited);
+}
+
+/* Drop one reference to CS, freeing it when both parent and
+   child are done with it. */
+static void
+release_child_status (struct child_status *cs)
+{
+  enum intr_level old_level;
+  bool last;
+
+  old_level = intr_disable ();
+  last = --cs->ref_cnt == 0;
+  intr_set_level (old_level);
+
+  if (last)
+    kmem_cache_free (child_status_cache, cs);
+}
+
+/* Returns hash value of child status E. */
+static unsigned
+child_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  return hash_int (hash_entry (e, struct child_status, elem)->tid);
+}
+
+/* Returns true if child status A has smaller pid than B. */
+static bool
+child_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct child_status, elem)->tid
+          < hash_entry (b, struct child_status, elem)->tid);
+}
+
+/* Drop parent's reference to child status E. */
+static void
+child_release (struct hash_elem *e, void *aux UNUSED)
+{
+  struct child_status *cs = hash_entry (e, struct child_status, elem);
+  enum intr_level old_level;
 
-  /* Align pointer to be multiple of 4 */
-  for (i = 0 ; i < (4 - word_count % 4) % 4 ; i++)
+  old_level = intr_disable ();
+  cs->parent = NULL;
+  intr_set_level (old_level);
+  release_child_status (cs);
+}
+
+/* Double the size of P's file descriptor table, moving it out of
+   the inline slots the first time.  Return false if memory is not
+   enough. */
+static bool
+grow_fdt (struct process *p)
+{
+  int cnt = p->fd_cnt * 2;
+  struct file **fdt;
+  struct bitmap *fd_map;
+
+  fdt = calloc (cnt, sizeof *fdt);
+  fd_map = bitmap_create (cnt);
+  if (fdt == NULL || fd_map == NULL)
   {
-    *esp = *esp - 1;
-    **(uint8_t **)esp = 0;
+    free (fdt);
+    if (fd_map != NULL)
+      bitmap_destroy (fd_map);
+    return false;
   }
-  
-  /* Last argv is always null. */
-  *esp = *esp - 4;
-  **(char ***)esp = 0;
 
-  /* Put argv[0] to argv[count - 1] */
-  for (i = count - 1 ; i > -1 ; i--)
+  /* Table only grows when full, so every old slot is used. */
+  memcpy (fdt, p->fdt, p->fd_cnt * sizeof *fdt);
+  bitmap_set_multiple (fd_map, 0, p->fd_cnt, true);
+  if (p->fdt != p->fdt_inline)
   {
-    *esp = *esp - 4;
-    **(char ***)esp = argv_each[i];
+    free (p->fdt);
+    bitmap_destroy (p->fd_map);
   }
+  p->fdt = fdt;
+  p->fd_map = fd_map;
+  p->fd_cnt = cnt;
+  return true;
+}
 
-  /* Save current stack top pointer which is argv. */
-  argv = *esp;
-  *esp = *esp - 4;
-  **(char ***)esp = argv;
-
-  /* argc is equal to count. */
-  *esp = *esp - 4;
-  **(int **)esp = count;
+/* Close every file open in P, which no thread is using any more,
+   and free its file descriptor table if it is on the heap. */
+static void
+free_fdt (struct process *p)
+{
+  size_t fd;
 
-  /* Put fake address. */
-  *esp = *esp - 4;
-  **(char ***)esp = 0;
+  for (fd = bitmap_scan (p->fd_map, 2, 1, true); fd != BITMAP_ERROR;
+       fd = bitmap_scan (p->fd_map, fd + 1, 1, true))
+    file_close (p->fdt[fd]);
+  if (p->fdt != p->fdt_inline)
+  {
+    free (p->fdt);
+    bitmap_destroy (p->fd_map);
+  }
 }
 
-/* Get child process by using pid.
-   Compare pid with all process in child process list. */
-struct thread *
-get_child_process (int pid)
+/* Make child table of thread T on its first exec or fork.
+   Return false if memory is not enough. */
+static bool
+init_children (struct thread *t)
 {
-  struct list_elem *e;
-  struct list *child_list;
-  struct thread *cp;
-
-  /* Get current process's child process list and compare with pid. */
-  child_list = &thread_current ()->child_process;
-  for (e = list_begin (child_list); e != list_end (child_list); e = list_next (e))
+  if (t->children != NULL)
+    return true;
+  t->children = malloc (sizeof *t->children);
+  if (t->children == NULL)
+    return false;
+  if (!ohash_init (t->children, child_hash, child_less, NULL))
   {
-    cp = list_entry (e, struct thread, childelem);
-    if (cp->tid == pid)
-      return cp;
+    free (t->children);
+    t->children = NULL;
+    return false;
   }
-  /* If no correspond child process, return NULL. */
-  return NULL;
+  list_init (&t->exited_children);
+  sema_init (&t->child_exited, 0);
+  return true;
 }
 
-/* Remove given child process. */
-void
-remove_child_process (struct thread *cp)
+/* Give CHILD, a process not yet started, its own ends of the
+   pipes open in PARENT, under the same file descriptors.  If ALL
+   is true, do the same for every other open file, at the same
+   position; otherwise they are not passed on.  Return false if
+   memory is not enough. */
+static bool
+inherit_files (struct process *child, struct process *parent, bool all)
 {
-  /* If given child process is invalid, return. */
-  if (cp == NULL)
-    return;
+  bool success = true;
+  int fd;
 
-  /* remove child process from parent process's child list, and free. */
-  list_remove (&cp->childelem);
-  palloc_free_page (cp);
+  lock_acquire (&parent->lock);
+  for (fd = 2; fd < parent->fd_cnt && success; fd++)
+  {
+    struct file *f = parent->fdt[fd];
+    if (f == NULL || (!all && !file_is_pipe (f)))
+      continue;
+    while (success && fd >= child->fd_cnt)
+      success = grow_fdt (child);
+    if (success && (child->fdt[fd] = file_reopen (f)) == NULL)
+      success = false;
+    if (success)
+    {
+      if (!file_is_pipe (f))
+        file_seek (child->fdt[fd], file_tell (f));
+      bitmap_mark (child->fd_map, fd);
+    }
+  }
+  lock_release (&parent->lock);
+  return success;
 }
 
-/* Put file into file descriptor table and change next position of addition. */
+/* Put file into lowest free slot of file descriptor table.
+   Return file descriptor, or -1 if table can not grow. */
 int
 process_add_file (struct file *f)
 {
-  /* Next position for addition. */ 
-  int next_fd;
+  struct process *p = thread_current ()->process;
+  size_t fd;
 
-  /* Put file into file descriptor table. */
-  next_fd = thread_current ()->next_fd;
-  thread_current ()->fdt[next_fd] = f;
+  lock_acquire (&p->lock);
 
-  /* Point next empty space in file descriptor table. */
-  thread_current ()->next_fd += 1;
+  /* Find lowest free slot, growing table if every slot is used. */
+  fd = bitmap_scan_and_flip (p->fd_map, 0, 1, false);
+  if (fd == BITMAP_ERROR)
+  {
+    if (!grow_fdt (p))
+    {
+      lock_release (&p->lock);
+      return -1;
+    }
+    fd = bitmap_scan_and_flip (p->fd_map, 0, 1, false);
+  }
 
-  /* Return where file is. */
-  return next_fd;
+  /* Put file into file descriptor table and return where file is. */
+  p->fdt[fd] = f;
+  lock_release (&p->lock);
+  return fd;
 }
 
 /* Get file from file descriptor table.
-   If there is no file in corresponding position, return NULL */
+   If there is no file in corresponding position, return NULL.
+   The file stays usable only while no other thread of the
+   process closes FD. */
 struct file *
 process_get_file (int fd)
 {
-  /* If fd is invalid, return NULL. */
-  if (fd >= thread_current ()->next_fd)
-    return NULL;
-  /* If fd is valid, return file in file descriptor table. */
-  return thread_current ()->fdt[fd];
+  struct process *p = thread_current ()->process;
+  struct file *f = NULL;
+
+  /* If fd is valid, take file in file descriptor table. */
+  lock_acquire (&p->lock);
+  if (fd >= 0 && fd < p->fd_cnt)
+    f = p->fdt[fd];
+  lock_release (&p->lock);
+  return f;
 }
 
 /* Close corresponding file in file descriptor table.
@@ -712,16 +1969,19 @@ process_get_file (int fd)
 void
 process_close_file (int fd)
 {
-  struct file *del_file;
-
-  /* Get file from file descriptor table using fd. */
-  del_file = process_get_file (fd);
+  struct process *p = thread_current ()->process;
+  struct file *del_file = NULL;
 
-  /* If there is no file, return. */
-  if (del_file == NULL)
-    return;
+  /* Take file out of file descriptor table and free the slot. */
+  lock_acquire (&p->lock);
+  if (fd >= 0 && fd < p->fd_cnt && p->fdt[fd] != NULL)
+  {
+    del_file = p->fdt[fd];
+    p->fdt[fd] = NULL;
+    bitmap_reset (p->fd_map, fd);
+  }
+  lock_release (&p->lock);
 
-  /* Close file and initialize corresponding entry. */
-  file_close(del_file);
-  thread_current ()->fdt[fd] = NULL;
+  /* Close file outside the lock, since that may write to disk. */
+  file_close (del_file);
 }
@@ -1,18 +1,128 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include <list.h>
+#include <ohash.h>
+#include "threads/synch.h"
 #include "threads/thread.h"
 
+/* File descriptor slots held in struct process itself, enough
+   for most processes, before a table is allocated. */
+#define FD_INLINE_CNT 8
+
+/* Status of a child process, shared by child and its parent so
+   that it outlives whichever of them exits first.  It is much
+   smaller than the child's thread page, which is freed as soon as
+   the child exits. */
+struct child_status
+  {
+    tid_t tid;                  /* Child's pid. */
+    char *cmd_line;             /* Command line, until loaded. */
+    struct process *process;    /* Child's process, until it starts. */
+    bool is_load;               /* Did load succeed? */
+    int exit_status;            /* Child's exit status. */
+    struct rusage usage;        /* Child's resource usage, at exit. */
+    struct semaphore load;      /* Up'd when child finishes loading. */
+    struct semaphore exit;      /* Up'd when child exits. */
+    int ref_cnt;                /* Parent and child still using it. */
+    struct hash_elem elem;      /* Element in parent's `children'. */
+
+    /* With interrupts off, the child sets EXITED and, if PARENT is
+       set, queues the record on the parent's `exited_children'
+       for process_wait_any(). */
+    bool exited;                /* Has the child exited? */
+    bool queued;                /* In parent's `exited_children'? */
+    struct thread *parent;      /* Waiting parent, or NULL. */
+    struct list_elem exit_elem; /* Element in `exited_children'. */
+  };
+
+/* A user process: the address space, open files and other state
+   shared by all of its threads.  The first thread is started by
+   exec, the others by uthread_create, and the last of them to
+   exit frees it. */
+struct process
+  {
+    tid_t pid;                  /* Process id, the first thread's tid. */
+    uint32_t *pagedir;          /* Page directory. */
+    struct kdata *kdata;        /* Kernel data page, or NULL. */
+
+    /* Threads, protected by LOCK.  Once EXITING is set, by exit()
+       or by a thread being killed, every other thread exits on its
+       way back to user mode. */
+    struct lock lock;           /* Protects members up to `fd_cnt'. */
+    int thread_cnt;             /* Threads that have not exited. */
+    struct list uthreads;       /* Joinable threads' struct uthread. */
+    struct condition thread_exited; /* Broadcast when a thread exits. */
+    bool exiting;               /* Is the process ending? */
+    int exit_status;            /* Status handed to parent. */
+    struct rusage usage;        /* Resources used by exited threads. */
+
+    /* Heap, from the end of the executable's segments up to the
+       program break, which sbrk() moves. */
+    uint8_t *heap_start;
+    uint8_t *brk;
+
+    /* This process's own status record, shared with parent, or
+       NULL if it was not started by exec. */
+    struct child_status *child_status;
+
+    /* File Descriptor Table.  FDT and FD_MAP start out in the
+       inline slots and buffer below, and move to the heap the
+       first time every slot is used, doubling each time after.
+       FD_MAP marks used slots, including 0 and 1, so that only
+       open descriptors are looked at when they are closed. */
+    struct file **fdt;
+    struct bitmap *fd_map;
+    int fd_cnt;                 /* Number of slots in `fdt'. */
+    struct file *fdt_inline[FD_INLINE_CNT];
+    uint32_t fd_map_inline[4];  /* Holds FD_MAP while inline. */
+
+    /* When reads from the console return, an enum input_mode. */
+    int stdin_mode;
+
+    /* Running executable, kept open (and write-denied) until exit. */
+    struct file *exec_file;
+
+    /* Working directory, or NULL for the root directory. */
+    struct dir *cwd;
+
+#ifdef VM
+    /* Owned by vm/page.c.  PAGE_LOCK serializes page faults and
+       changes to the supplemental page table among the threads. */
+    struct lock page_lock;
+    struct ohash pages;         /* Supplemental page table. */
+
+    /* Owned by vm/mmap.c, protected by PAGE_LOCK. */
+    struct list mmaps;          /* Memory-mapped files. */
+    int next_mapid;             /* Next mapping identifier. */
+
+    /* Owned by vm/shm.c, protected by PAGE_LOCK. */
+    struct list shms;           /* Shared memory segments held. */
+#endif
+  };
+
+/* Set by kernel command-line option "-rusage". */
+extern bool process_report_usage;
+
+void process_init (void);
 tid_t process_execute (const char *file_name);
+tid_t process_fork (void);
 int process_wait (tid_t);
+tid_t process_wait_any (int *status, bool block);
 void process_exit (void);
 void process_activate (void);
 
-void argument_stack (char **parse, int count, void **esp);
+tid_t process_thread_create (void (*eip) (void), void *esp);
+void process_thread_exit (int status) NO_RETURN;
+int process_thread_join (tid_t);
+bool process_begin_exit (int status);
+void process_check_exiting (void);
+void process_get_usage (struct rusage *);
+void *process_sbrk (intptr_t increment);
 
-struct thread *get_child_process (int pid);
+struct child_status *get_child_process (int pid);
 struct file *process_get_file (int fd);
-void remove_child_process (struct thread *cp);
+void remove_child_process (struct child_status *cs);
 int process_add_file (struct file *f);
 void process_close_file (int fd);
 
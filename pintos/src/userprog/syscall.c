@@ -1,401 +1,1892 @@
 #include "userprog/syscall.h"
 #include "userprog/process.h"
+#include <limits.h>
+#include <poll.h>
+#include <round.h>
 #include <stdio.h>
+#include <string.h>
+#include <syscall-batch.h>
 #include <syscall-nr.h>
+#include <uio.h>
 #include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/msr.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
+#include "threads/trace.h"
+#include "threads/vaddr.h"
+#include "threads/waitq.h"
+#include "userprog/futex.h"
+#include "userprog/gdt.h"
+#include "userprog/pagedir.h"
+#include "userprog/tss.h"
+#include "userprog/usercopy.h"
+#include "devices/block.h"
 #include "devices/input.h"
+#include "devices/shutdown.h"
+#include "devices/timer.h"
+#include "filesys/cache.h"
+#include "filesys/directory.h"
 #include "filesys/file.h"
+#include "filesys/filesys.h"
+#include "filesys/inode.h"
+#ifdef VM
+#include "vm/mmap.h"
+#include "vm/page.h"
+#include "vm/shm.h"
+#endif
 
 static void syscall_handler (struct intr_frame *);
 
-void check_address (void *addr);
 void get_argument (void *esp, int *arg, int count);
+char *get_string (const char *ustr);
+bool pin_buffer (void *buffer, unsigned size, bool to_user);
+void check_buffer (void *buffer, unsigned size, bool to_user);
+void release_buffer (void *buffer, unsigned size);
+struct iovec *get_iovec (const struct iovec *uiov, int iovcnt, bool to_user);
+void release_iovec (struct iovec *iov, int iovcnt);
+struct file *get_inode_file (int fd);
+struct file *get_data_file (int fd);
 void halt (void);
 void exit (int status);
 bool create (const char *file, unsigned initial_size);
 bool remove (const char *file);
 tid_t exec (const char *cmd_line);
+tid_t exec_async (const char *cmd_line);
+int spawn_many (const char **cmd_lines, int n, tid_t *pids);
 int wait (tid_t tid);
+tid_t wait_any (int *status);
+int wait_many (tid_t *pids, int *statuses, int cnt);
 int open (const char *file);
 int filesize(int fd);
 int read (int fd, void *buffer, unsigned size);
+static int read_direct (struct file *f, uint8_t *buffer, unsigned size);
 int write (int fd, void *buffer, unsigned size);
 void seek (int fd, unsigned position);
 unsigned tell (int fd);
 void close (int fd);
+bool chdir (const char *dir);
+bool mkdir (const char *dir);
+bool readdir (int fd, char *name);
+int readdir_many (int fd, char (*names)[NAME_MAX + 1], int cnt);
+bool isdir (int fd);
+int inumber (int fd);
+int pread (int fd, void *buffer, unsigned size, unsigned offset);
+int pwrite (int fd, void *buffer, unsigned size, unsigned offset);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range (int fd_in, int fd_out, unsigned size);
+int batch (struct batch_entry *entries, int cnt);
+int stdin_mode (int mode);
+bool block_stats (int index, struct block_stats *stats);
+bool preallocate (int fd, unsigned length);
+bool fsync (int fd);
+void sync (void);
+bool fs_stats (int fd, struct fs_stats *stats);
+bool sched_stats (tid_t tid, struct sched_stats *stats);
+int set_sched_class (int sched_class);
+bool set_deadline (int period_ms, int budget_ms);
+bool set_affinity (tid_t tid, unsigned cpu_mask);
+void getrusage (struct rusage *usage);
+void *sbrk (intptr_t increment);
+int pipe (int *fds);
+tid_t fork (void);
+int poll (struct pollfd *fds, int n, int timeout);
+bool reflink (const char *from, const char *to);
+bool compress (int fd);
+bool pin (int fd);
+bool unpin (int fd);
+bool batch_one (struct batch_entry *e);
+#ifdef VM
+mapid_t mmap (int fd, void *addr);
+void munmap (mapid_t mapid);
+int shm_create (size_t size);
+bool shm_map (int id, void *addr);
+#endif
+
+/* System Call handler takes its arguments, already fetched and
+   checked, and returns value for eax. */
+typedef int syscall_func (int *arg);
+
+static syscall_func sys_halt, sys_exit, sys_exec, sys_wait, sys_create,
+  sys_remove, sys_open, sys_filesize, sys_read, sys_write, sys_seek,
+  sys_tell, sys_close, sys_pread, sys_pwrite, sys_readv, sys_writev,
+  sys_copy_file_range, sys_batch, sys_stdin_mode, sys_block_stats,
+  sys_preallocate, sys_fsync, sys_sync, sys_fs_stats, sys_reflink,
+  sys_compress, sys_futex_wait, sys_futex_wake, sys_uthread_create,
+  sys_uthread_exit, sys_uthread_join, sys_sched_stats,
+  sys_set_sched_class, sys_set_affinity, sys_getrusage, sys_sbrk, sys_pipe,
+  sys_fork, sys_poll, sys_wait_any, sys_wait_many, sys_spawn_many,
+  sys_set_deadline, sys_pin, sys_unpin, sys_exec_async, sys_chdir,
+  sys_mkdir, sys_readdir, sys_readdir_many, sys_isdir, sys_inumber;
+#ifdef VM
+static syscall_func sys_mmap, sys_munmap, sys_shm_create, sys_shm_map;
+#endif
+
+/* Reads of at least this many bytes from a file skip the buffer
+   cache for sectors it does not already hold. */
+#define DIRECT_READ_MIN (16 * BLOCK_SECTOR_SIZE)
+
+/* Most names readdir_many () returns per call. */
+#define READDIR_MANY_MAX 64
+
+/* Most children wait_many () reaps per call. */
+#define WAIT_MANY_MAX 32
+
+/* Most processes spawn_many () starts per call. */
+#define SPAWN_MANY_MAX 32
+
+/* Most pages of user buffer read_direct () passes down at once. */
+#define DIRECT_READ_PAGES 16
+
+/* Which arguments are pointers that syscall_handler () checks
+   before call.  ARG_STR is string, copied into kernel and freed
+   after.  ARG_IN and ARG_OUT are buffer whose size is next
+   argument, which kernel reads or writes, checked and released
+   like check_buffer ().  A call has at most one pointer argument
+   of these kinds; calls with more check their own. */
+#define ARG_STR(N) (1u << (N))
+#define ARG_IN(N) (1u << ((N) + 4))
+#define ARG_OUT(N) (1u << ((N) + 8))
+
+/* One entry of dispatch table. */
+struct syscall
+  {
+    const char *name;                   /* For statistics. */
+    syscall_func *func;                 /* Handler. */
+    int arg_cnt;                        /* Number of arguments. */
+    unsigned ptr_mask;                  /* ARG_* of pointer arguments. */
+  };
+
+/* Dispatch table, indexed by system call number. */
+static const struct syscall syscall_table[] =
+  {
+    [SYS_HALT] = {"halt", sys_halt, 0, 0},
+    [SYS_EXIT] = {"exit", sys_exit, 1, 0},
+    [SYS_EXEC] = {"exec", sys_exec, 1, ARG_STR (0)},
+    [SYS_WAIT] = {"wait", sys_wait, 1, 0},
+    [SYS_CREATE] = {"create", sys_create, 2, ARG_STR (0)},
+    [SYS_REMOVE] = {"remove", sys_remove, 1, ARG_STR (0)},
+    [SYS_OPEN] = {"open", sys_open, 1, ARG_STR (0)},
+    [SYS_FILESIZE] = {"filesize", sys_filesize, 1, 0},
+    [SYS_READ] = {"read", sys_read, 3, ARG_OUT (1)},
+    [SYS_WRITE] = {"write", sys_write, 3, ARG_IN (1)},
+    [SYS_SEEK] = {"seek", sys_seek, 2, 0},
+    [SYS_TELL] = {"tell", sys_tell, 1, 0},
+    [SYS_CLOSE] = {"close", sys_close, 1, 0},
+#ifdef VM
+    [SYS_MMAP] = {"mmap", sys_mmap, 2, 0},
+    [SYS_MUNMAP] = {"munmap", sys_munmap, 1, 0},
+#endif
+    [SYS_CHDIR] = {"chdir", sys_chdir, 1, ARG_STR (0)},
+    [SYS_MKDIR] = {"mkdir", sys_mkdir, 1, ARG_STR (0)},
+    [SYS_READDIR] = {"readdir", sys_readdir, 2, 0},
+    [SYS_ISDIR] = {"isdir", sys_isdir, 1, 0},
+    [SYS_INUMBER] = {"inumber", sys_inumber, 1, 0},
+    [SYS_PREAD] = {"pread", sys_pread, 4, ARG_OUT (1)},
+    [SYS_PWRITE] = {"pwrite", sys_pwrite, 4, ARG_IN (1)},
+    [SYS_READV] = {"readv", sys_readv, 3, 0},
+    [SYS_WRITEV] = {"writev", sys_writev, 3, 0},
+    [SYS_COPY_FILE_RANGE] = {"copy_file_range", sys_copy_file_range, 3, 0},
+    [SYS_BATCH] = {"batch", sys_batch, 2, 0},
+    [SYS_STDIN_MODE] = {"stdin_mode", sys_stdin_mode, 1, 0},
+    [SYS_BLOCK_STATS] = {"block_stats", sys_block_stats, 2, 0},
+    [SYS_PREALLOCATE] = {"preallocate", sys_preallocate, 2, 0},
+    [SYS_FSYNC] = {"fsync", sys_fsync, 1, 0},
+    [SYS_SYNC] = {"sync", sys_sync, 0, 0},
+    [SYS_FS_STATS] = {"fs_stats", sys_fs_stats, 2, 0},
+    [SYS_READDIR_MANY] = {"readdir_many", sys_readdir_many, 3, 0},
+    [SYS_REFLINK] = {"reflink", sys_reflink, 2, 0},
+    [SYS_COMPRESS] = {"compress", sys_compress, 1, 0},
+    [SYS_FUTEX_WAIT] = {"futex_wait", sys_futex_wait, 2, 0},
+    [SYS_FUTEX_WAKE] = {"futex_wake", sys_futex_wake, 2, 0},
+    [SYS_UTHREAD_CREATE] = {"uthread_create", sys_uthread_create, 2, 0},
+    [SYS_UTHREAD_EXIT] = {"uthread_exit", sys_uthread_exit, 1, 0},
+    [SYS_UTHREAD_JOIN] = {"uthread_join", sys_uthread_join, 1, 0},
+    [SYS_SCHED_STATS] = {"sched_stats", sys_sched_stats, 2, 0},
+    [SYS_SET_SCHED_CLASS] = {"set_sched_class", sys_set_sched_class, 1, 0},
+    [SYS_SET_AFFINITY] = {"set_affinity", sys_set_affinity, 2, 0},
+    [SYS_GETRUSAGE] = {"getrusage", sys_getrusage, 1, 0},
+    [SYS_SBRK] = {"sbrk", sys_sbrk, 1, 0},
+    [SYS_PIPE] = {"pipe", sys_pipe, 1, 0},
+    [SYS_FORK] = {"fork", sys_fork, 0, 0},
+    [SYS_POLL] = {"poll", sys_poll, 3, 0},
+    [SYS_WAIT_ANY] = {"wait_any", sys_wait_any, 1, 0},
+    [SYS_WAIT_MANY] = {"wait_many", sys_wait_many, 3, 0},
+    [SYS_SPAWN_MANY] = {"spawn_many", sys_spawn_many, 3, 0},
+    [SYS_SET_DEADLINE] = {"set_deadline", sys_set_deadline, 2, 0},
+    [SYS_PIN] = {"pin", sys_pin, 1, 0},
+    [SYS_UNPIN] = {"unpin", sys_unpin, 1, 0},
+    [SYS_EXEC_ASYNC] = {"exec_async", sys_exec_async, 1, ARG_STR (0)},
+#ifdef VM
+    [SYS_SHM_CREATE] = {"shm_create", sys_shm_create, 1, 0},
+    [SYS_SHM_MAP] = {"shm_map", sys_shm_map, 2, 0},
+#endif
+  };
+
+/* Number of entries in dispatch table. */
+#define SYSCALL_CNT (sizeof syscall_table / sizeof *syscall_table)
+
+/* Number of times each system call was made. */
+static long long syscall_cnt[SYSCALL_CNT];
+
+bool syscall_sysenter = true;
+
+static bool sysenter_supported (void);
 
 void
 syscall_init (void) 
 {
-  /* filesys_lock control accessibility for file system. */
-  lock_init (&filesys_lock);
+  extern char sysenter_entry[];
+
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
+  intr_register_int (0x31, 3, INTR_ON, syscall_handler,
+                     "syscall (registers)");
+  futex_init ();
+
+  /* Only the bootstrap processor runs user programs, so only its
+     MSRs need setting. */
+  if (syscall_sysenter && !sysenter_supported ())
+    syscall_sysenter = false;
+  if (syscall_sysenter)
+    {
+      wrmsr (MSR_SYSENTER_CS, SEL_KCSEG);
+      wrmsr (MSR_SYSENTER_EIP, (uint32_t) sysenter_entry);
+      tss_enable_sysenter ();
+    }
+}
+
+/* Returns true if the CPU implements SYSENTER and SYSEXIT.  The
+   Pentium Pro claims to in CPUID but does not.  See [IA32-v2b]
+   "SYSENTER". */
+static bool
+sysenter_supported (void)
+{
+  uint32_t eax = 1, ebx, ecx, edx;
+  uint32_t family, model, stepping;
+
+  asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+  family = (eax >> 8) & 0xf;
+  model = (eax >> 4) & 0xf;
+  stepping = eax & 0xf;
+  return (edx & 0x800) != 0 && !(family == 6 && model < 3 && stepping < 3);
+}
+
+/* Print how many times each system call was made. */
+void
+syscall_print_stats (void)
+{
+  size_t i;
+
+  printf ("Syscall:");
+  for (i = 0; i < SYSCALL_CNT; i++)
+    if (syscall_cnt[i] > 0)
+      printf (" %lld %s", syscall_cnt[i], syscall_table[i].name);
+  printf ("\n");
+}
+
+/* System Call handler takes data from stack, or from registers,
+   and do corresponing job as dispatch table says.
+
+   "int $0x30" passes the system call number and arguments on the
+   user stack.  "int $0x31" and SYSENTER pass the number in %eax
+   and the arguments in %ebx, %esi, %edi, and %ebp, which the
+   interrupt frame holds, so that scalar arguments need no access
+   to user memory.  (SYSENTER takes %ecx and %edx for itself.) */
+
+static void
+syscall_handler (struct intr_frame *f) 
+{
+  /* System Call Can have at most 4 values. */
+  int arg[4];
+  /* which job to do? */
+  int syscall_number;
+  const struct syscall *sc;
+  int i;
+
+#ifdef VM
+  /* Page faults taken in the kernel need the user's stack
+     pointer to tell stack growth from a bad access. */
+  thread_current ()->user_esp = f->esp;
+#endif
+
+  /* Takes Syscall Number.  If it is unknown, exit thread. */
+  if (f->vec_no == 0x31)
+    syscall_number = f->eax;
+  else if (!copy_from_user (&syscall_number, f->esp,
+                            sizeof syscall_number))
+    exit (-1);
+  if (syscall_number < 0 || (size_t) syscall_number >= SYSCALL_CNT
+      || syscall_table[syscall_number].func == NULL)
+    thread_exit ();
+  sc = &syscall_table[syscall_number];
+  syscall_cnt[syscall_number]++;
+  thread_current ()->usage.syscalls++;
+  TRACE (TRACE_SYSCALL, syscall_number, f->eip);
+
+  /* Take arguments and check pointer arguments. */
+  if (f->vec_no == 0x31)
+    {
+      arg[0] = f->ebx;
+      arg[1] = f->esi;
+      arg[2] = f->edi;
+      arg[3] = f->ebp;
+    }
+  else
+    get_argument (f->esp, arg, sc->arg_cnt);
+  for (i = 0; i < sc->arg_cnt; i++)
+    if (sc->ptr_mask & ARG_STR (i))
+      arg[i] = (int) get_string ((const char *) arg[i]);
+    else if (sc->ptr_mask & (ARG_IN (i) | ARG_OUT (i)))
+      check_buffer ((void *) arg[i], (unsigned) arg[i + 1],
+                    (sc->ptr_mask & ARG_OUT (i)) != 0);
+
+  f->eax = sc->func (arg);
+
+  for (i = 0; i < sc->arg_cnt; i++)
+    if (sc->ptr_mask & (ARG_IN (i) | ARG_OUT (i)))
+      release_buffer ((void *) arg[i], (unsigned) arg[i + 1]);
+
+  /* Free the string arguments and anything else the call took
+     from the scratch arena. */
+  scratch_reset ();
+}
+
+/* Handlers in dispatch table.  Each one takes arguments from ARG
+   and calls function doing the job. */
+
+static int
+sys_halt (int *arg UNUSED)
+{
+  halt ();
+  NOT_REACHED ();
+}
+
+static int
+sys_exit (int *arg)
+{
+  exit (arg[0]);
+  NOT_REACHED ();
+}
+
+static int
+sys_exec (int *arg)
+{
+  return exec ((const char *) arg[0]);
+}
+
+static int
+sys_exec_async (int *arg)
+{
+  return exec_async ((const char *) arg[0]);
+}
+
+static int
+sys_wait (int *arg)
+{
+  return wait ((tid_t) arg[0]);
+}
+
+static int
+sys_create (int *arg)
+{
+  return create ((const char *) arg[0], (unsigned) arg[1]);
+}
+
+static int
+sys_remove (int *arg)
+{
+  return remove ((const char *) arg[0]);
+}
+
+static int
+sys_open (int *arg)
+{
+  return open ((const char *) arg[0]);
+}
+
+static int
+sys_filesize (int *arg)
+{
+  return filesize (arg[0]);
+}
+
+static int
+sys_read (int *arg)
+{
+  return read (arg[0], (void *) arg[1], (unsigned) arg[2]);
+}
+
+static int
+sys_write (int *arg)
+{
+  return write (arg[0], (void *) arg[1], (unsigned) arg[2]);
+}
+
+static int
+sys_seek (int *arg)
+{
+  seek (arg[0], (unsigned) arg[1]);
+  return 0;
+}
+
+static int
+sys_tell (int *arg)
+{
+  return tell (arg[0]);
+}
+
+static int
+sys_close (int *arg)
+{
+  close (arg[0]);
+  return 0;
+}
+
+static int
+sys_chdir (int *arg)
+{
+  return chdir ((const char *) arg[0]);
+}
+
+static int
+sys_mkdir (int *arg)
+{
+  return mkdir ((const char *) arg[0]);
+}
+
+static int
+sys_readdir (int *arg)
+{
+  return readdir (arg[0], (char *) arg[1]);
+}
+
+static int
+sys_readdir_many (int *arg)
+{
+  return readdir_many (arg[0], (char (*)[NAME_MAX + 1]) arg[1], arg[2]);
+}
+
+static int
+sys_isdir (int *arg)
+{
+  return isdir (arg[0]);
+}
+
+static int
+sys_inumber (int *arg)
+{
+  return inumber (arg[0]);
+}
+
+static int
+sys_pread (int *arg)
+{
+  return pread (arg[0], (void *) arg[1], (unsigned) arg[2],
+                (unsigned) arg[3]);
+}
+
+static int
+sys_pwrite (int *arg)
+{
+  return pwrite (arg[0], (void *) arg[1], (unsigned) arg[2],
+                 (unsigned) arg[3]);
+}
+
+/* Read File into several buffers. */
+static int
+sys_readv (int *arg)
+{
+  struct iovec *iov = get_iovec ((const struct iovec *) arg[1], arg[2], true);
+  int result = iov != NULL ? readv (arg[0], iov, arg[2]) : -1;
+
+  release_iovec (iov, arg[2]);
+  return result;
+}
+
+/* Write several buffers to File. */
+static int
+sys_writev (int *arg)
+{
+  struct iovec *iov = get_iovec ((const struct iovec *) arg[1], arg[2],
+                                 false);
+  int result = iov != NULL ? writev (arg[0], iov, arg[2]) : -1;
+
+  release_iovec (iov, arg[2]);
+  return result;
+}
+
+static int
+sys_copy_file_range (int *arg)
+{
+  return copy_file_range (arg[0], arg[1], (unsigned) arg[2]);
+}
+
+static int
+sys_batch (int *arg)
+{
+  return batch ((struct batch_entry *) arg[0], arg[1]);
+}
+
+static int
+sys_stdin_mode (int *arg)
+{
+  return stdin_mode (arg[0]);
+}
+
+static int
+sys_block_stats (int *arg)
+{
+  return block_stats (arg[0], (struct block_stats *) arg[1]);
+}
+
+static int
+sys_preallocate (int *arg)
+{
+  return preallocate (arg[0], (unsigned) arg[1]);
+}
+
+static int
+sys_fsync (int *arg)
+{
+  return fsync (arg[0]);
+}
+
+static int
+sys_sync (int *arg UNUSED)
+{
+  sync ();
+  return 0;
+}
+
+static int
+sys_fs_stats (int *arg)
+{
+  return fs_stats (arg[0], (struct fs_stats *) arg[1]);
+}
+
+static int
+sys_reflink (int *arg)
+{
+  return reflink ((const char *) arg[0], (const char *) arg[1]);
+}
+
+static int
+sys_compress (int *arg)
+{
+  return compress (arg[0]);
+}
+
+static int
+sys_futex_wait (int *arg)
+{
+  return futex_wait ((const int *) arg[0], arg[1]);
+}
+
+static int
+sys_futex_wake (int *arg)
+{
+  return futex_wake ((const int *) arg[0], arg[1]);
+}
+
+static int
+sys_uthread_create (int *arg)
+{
+  return process_thread_create ((void (*) (void)) arg[0], (void *) arg[1]);
+}
+
+static int
+sys_uthread_exit (int *arg)
+{
+  process_thread_exit (arg[0]);
+  NOT_REACHED ();
+}
+
+static int
+sys_uthread_join (int *arg)
+{
+  return process_thread_join (arg[0]);
+}
+
+static int
+sys_sched_stats (int *arg)
+{
+  return sched_stats (arg[0], (struct sched_stats *) arg[1]);
+}
+
+static int
+sys_set_sched_class (int *arg)
+{
+  return set_sched_class (arg[0]);
+}
+
+static int
+sys_set_affinity (int *arg)
+{
+  return set_affinity (arg[0], arg[1]);
+}
+
+static int
+sys_getrusage (int *arg)
+{
+  getrusage ((struct rusage *) arg[0]);
+  return 0;
+}
+
+static int
+sys_sbrk (int *arg)
+{
+  return (int) sbrk (arg[0]);
+}
+
+static int
+sys_pipe (int *arg)
+{
+  return pipe ((int *) arg[0]);
+}
+
+static int
+sys_fork (int *arg UNUSED)
+{
+  return fork ();
+}
+
+static int
+sys_poll (int *arg)
+{
+  return poll ((struct pollfd *) arg[0], arg[1], arg[2]);
+}
+
+static int
+sys_wait_any (int *arg)
+{
+  return wait_any ((int *) arg[0]);
+}
+
+static int
+sys_wait_many (int *arg)
+{
+  return wait_many ((tid_t *) arg[0], (int *) arg[1], arg[2]);
+}
+
+static int
+sys_spawn_many (int *arg)
+{
+  return spawn_many ((const char **) arg[0], arg[1], (tid_t *) arg[2]);
+}
+
+static int
+sys_set_deadline (int *arg)
+{
+  return set_deadline (arg[0], arg[1]);
+}
+
+static int
+sys_pin (int *arg)
+{
+  return pin (arg[0]);
+}
+
+static int
+sys_unpin (int *arg)
+{
+  return unpin (arg[0]);
+}
+
+#ifdef VM
+static int
+sys_mmap (int *arg)
+{
+  return mmap (arg[0], (void *) arg[1]);
+}
+
+static int
+sys_munmap (int *arg)
+{
+  munmap ((mapid_t) arg[0]);
+  return 0;
+}
+
+static int
+sys_shm_create (int *arg)
+{
+  return shm_create ((size_t) arg[0]);
+}
+
+static int
+sys_shm_map (int *arg)
+{
+  return shm_map (arg[0], (void *) arg[1]);
+}
+#endif
+
+/* Get argument from stack for 4 byte each.
+   If any of them is not readable, exit process. */
+void
+get_argument (void *esp, int *arg, int count)
+{
+  if (!copy_from_user (arg, (int *)esp + 1, count * sizeof *arg))
+    exit (-1);
+}
+
+/* Copy string in user area into a page of the scratch arena,
+   which is freed when the system call returns.  If string is not
+   readable or too long, exit process. */
+char *
+get_string (const char *ustr)
+{
+  char *kstr;
+
+  kstr = scratch_alloc (PGSIZE);
+  if (kstr == NULL || strncpy_from_user (kstr, ustr, PGSIZE) < 0)
+    exit (-1);
+  return kstr;
+}
+
+/* Check whole buffer lies in User Area and can be accessed.
+   TO_USER is true if kernel will write into buffer.
+   Touching buffer also brings its pages in, and with virtual memory
+   pins them until release_buffer (), so file system code never
+   faults on them.  Return false if buffer is bad. */
+bool
+pin_buffer (void *buffer, unsigned size, bool to_user)
+{
+#ifdef VM
+  return page_pin_range (buffer, size, to_user);
+#else
+  return to_user ? user_writable (buffer, size)
+                 : user_readable (buffer, size);
+#endif
+}
+
+/* Like pin_buffer (), but exit process if buffer is bad. */
+void
+check_buffer (void *buffer, unsigned size, bool to_user)
+{
+  if (!pin_buffer (buffer, size, to_user))
+    exit (-1);
+}
+
+/* Release buffer checked by check_buffer (). */
+void
+release_buffer (void *buffer UNUSED, unsigned size UNUSED)
+{
+#ifdef VM
+  page_unpin_range (buffer, size);
+#endif
+}
+
+/* Copy IOVCNT iovecs at UIOV into kernel and check each buffer
+   like check_buffer (), so that whole array is validated once.
+   Return NULL if IOVCNT is not between 1 and IOV_MAX or total
+   length does not fit in return value.  If array or any buffer is
+   bad, exit process.  Caller must call release_iovec (). */
+struct iovec *
+get_iovec (const struct iovec *uiov, int iovcnt, bool to_user)
+{
+  struct iovec *iov;
+  size_t total = 0;
+  int i;
+
+  if (iovcnt < 1 || iovcnt > IOV_MAX)
+    return NULL;
+  iov = malloc (iovcnt * sizeof *iov);
+  if (iov == NULL)
+    return NULL;
+  if (!copy_from_user (iov, uiov, iovcnt * sizeof *iov))
+  {
+    free (iov);
+    exit (-1);
+  }
+
+  /* Total must fit in int, and no buffer may wrap it around. */
+  for (i = 0; i < iovcnt; i++)
+  {
+    if (iov[i].iov_len > INT_MAX - total)
+    {
+      free (iov);
+      return NULL;
+    }
+    total += iov[i].iov_len;
+  }
+
+  for (i = 0; i < iovcnt; i++)
+    if (!pin_buffer (iov[i].iov_base, iov[i].iov_len, to_user))
+    {
+      /* Let go of buffers already checked before exit. */
+      release_iovec (iov, i);
+      exit (-1);
+    }
+  return iov;
+}
+
+/* Release buffers checked by get_iovec () and free array.
+   IOV may be NULL. */
+void
+release_iovec (struct iovec *iov, int iovcnt)
+{
+  int i;
+
+  if (iov == NULL)
+    return;
+  for (i = 0; i < iovcnt; i++)
+    release_buffer (iov[i].iov_base, iov[i].iov_len);
+  free (iov);
+}
+
+/* Get file or directory open as fd.  Return NULL if fd is not
+   open or is a pipe end, which has no inode. */
+struct file *
+get_inode_file (int fd)
+{
+  struct file *f = process_get_file (fd);
+
+  if (f == NULL || file_is_pipe (f))
+    return NULL;
+  return f;
+}
+
+/* Get file open as fd for reading or writing its data.
+   Return NULL if fd is not open, is a pipe end, or is a
+   directory, whose entries can only be read with readdir (). */
+struct file *
+get_data_file (int fd)
+{
+  struct file *f = get_inode_file (fd);
+
+  if (f == NULL || inode_is_dir (file_get_inode (f)))
+    return NULL;
+  return f;
+}
+
+/* Halt Shutdown machine. */
+void
+halt (void)
+{
+  shutdown_power_off();
+}
+
+/* Exit current process. */
+void
+exit (int status)
+{
+  struct thread *cur = thread_current ();
+
+  /* Assign how current process ends. And exit thread.  Of
+     threads exiting one process at once, only first reports. */
+  cur->exit_status = status;
+  if (process_begin_exit (status))
+    printf ("%s: exit(%d)\n", cur->name, status);
+  thread_exit ();
+}
+
+/* Create file using filesys_create (). */
+bool
+create (const char *file, unsigned initial_size)
+{
+  /* If file is invalid, return false. */
+  if (file == NULL)
+    return false;
+  return filesys_create(file, initial_size);
+}
+
+/* Remove file using filesys_remove (). */
+bool
+remove (const char *file)
+{
+  /* If file is invalid, return false. */
+  if (file == NULL)
+    return false;
+  return filesys_remove(file);
+}
+
+/* Create child process and execute it.
+   If creation success, return pid. If fail, return -1.
+   Parent process waits until end of child process loading. */
+tid_t
+exec (const char *cmd_line)
+{
+  int tid;
+  struct child_status *cs;
+
+  /* Create child process which name is what cmdline point to. */
+  tid = process_execute (cmd_line);
+  cs = get_child_process (tid);
+
+  /* If creation fail, return -1. */
+  if (cs == NULL)
+    return -1;
+
+  /* Wait until end of loading child process. */
+  sema_down (&cs->load);
+
+  /* If load fail, return -1.  Nobody can wait for the child
+     without its pid, so drop its record now rather than keep it
+     until we exit. */
+  if (cs->is_load == false)
+    {
+      remove_child_process (cs);
+      return -1;
+    }
+
+  /* If success, return tid. */
+    return tid;
+}
+
+/* Like exec (), but return child's pid as soon as it is created,
+   without waiting for it to load, so that parent can go on while
+   child reads its executable.  If load fails, child exits with
+   status -1, which wait () returns.  Return -1 only if child
+   could not be created. */
+tid_t
+exec_async (const char *cmd_line)
+{
+  tid_t tid = process_execute (cmd_line);
+
+  /* A child that cannot be waited for is no use to caller, who
+     could not learn whether it loaded. */
+  if (get_child_process (tid) == NULL)
+    return -1;
+  return tid;
+}
+
+/* Like exec (), but start a child process for each of n command
+   lines in cmd_lines, at most SPAWN_MANY_MAX, and store its pid in
+   pids, or -1 if it could not be started or loaded.  All children
+   are created before waiting for any to load, so they load in
+   parallel.  Return number of children loaded, or -1 if n is out
+   of range.  If cmd_lines, a command line or pids is bad, exit
+   process. */
+int
+spawn_many (const char **cmd_lines, int n, tid_t *pids)
+{
+  const char *ucmds[SPAWN_MANY_MAX];
+  tid_t tids[SPAWN_MANY_MAX];
+  struct child_status *cs;
+  char *kcmd;
+  int loaded, i;
+
+  if (n < 0 || n > SPAWN_MANY_MAX)
+    return -1;
+  if (!copy_from_user (ucmds, cmd_lines, n * sizeof *ucmds)
+      || !user_writable (pids, n * sizeof *pids))
+    exit (-1);
+
+  /* Create every child.  process_execute () makes its own copy of
+     the command line, so one scratch page serves for all of them. */
+  kcmd = scratch_alloc (PGSIZE);
+  if (kcmd == NULL)
+    return -1;
+  for (i = 0; i < n; i++)
+  {
+    if (strncpy_from_user (kcmd, ucmds[i], PGSIZE) < 0)
+      exit (-1);
+    tids[i] = process_execute (kcmd);
+  }
+
+  /* Wait until each has finished loading. */
+  loaded = 0;
+  for (i = 0; i < n; i++)
+  {
+    cs = get_child_process (tids[i]);
+    if (cs == NULL)
+    {
+      tids[i] = -1;
+      continue;
+    }
+    sema_down (&cs->load);
+    if (cs->is_load)
+      loaded++;
+    else
+    {
+      remove_child_process (cs);
+      tids[i] = -1;
+    }
+  }
+
+  if (!copy_to_user (pids, tids, n * sizeof *tids))
+    exit (-1);
+  return loaded;
+}
+
+/* Wait until child process end by using process_wait() function. */
+int
+wait (tid_t tid)
+{
+  return process_wait (tid);
+}
+
+/* Wait until any child process ends, reaping children in the
+   order they exit rather than the order they were started.
+   Store its exit status in status, unless status is null, and
+   return its pid.  Return -1 if there is no child to wait for.
+   If status is bad, exit process. */
+tid_t
+wait_any (int *status)
+{
+  int kstatus;
+  tid_t tid;
+
+  tid = process_wait_any (&kstatus, true);
+  if (tid != TID_ERROR && status != NULL
+      && !copy_to_user (status, &kstatus, sizeof kstatus))
+    exit (-1);
+  return tid;
+}
+
+/* Like wait_any (), but then also reap every other child that
+   has already exited, up to cnt in all and at most WAIT_MANY_MAX
+   per call, storing their pids in pids and exit statuses in
+   statuses.  Return number of children reaped, or -1 if there is
+   no child to wait for or cnt is not positive.  If pids or
+   statuses is bad, exit process. */
+int
+wait_many (tid_t *pids, int *statuses, int cnt)
+{
+  tid_t kpids[WAIT_MANY_MAX];
+  int kstatuses[WAIT_MANY_MAX];
+  int n;
+
+  if (cnt <= 0)
+    return -1;
+  if (cnt > WAIT_MANY_MAX)
+    cnt = WAIT_MANY_MAX;
+
+  kpids[0] = process_wait_any (&kstatuses[0], true);
+  if (kpids[0] == TID_ERROR)
+    return -1;
+  for (n = 1; n < cnt; n++)
+  {
+    kpids[n] = process_wait_any (&kstatuses[n], false);
+    if (kpids[n] == TID_ERROR)
+      break;
+  }
+
+  if (!copy_to_user (pids, kpids, n * sizeof *kpids)
+      || !copy_to_user (statuses, kstatuses, n * sizeof *kstatuses))
+    exit (-1);
+  return n;
+}
+
+/* Open file. If success, return file descriptor, else, return -1. */
+int
+open (const char *file)
+{
+  /* If file name pointer is invalid, return -1. */
+  if (file == NULL)
+    return -1;
+
+  struct file *f;
+
+  /* Open file.  The file system does its own locking. */
+  f = filesys_open (file);
+
+  /* If file is invalid, return -1.  No need to deny writes to
+     running executable here: load () denies them on its inode,
+     which every opener shares, for as long as process runs. */
+  if (f == NULL)
+    return -1;
+
+  /* If file descriptor table can not grow, return -1.
+     If all condition is clear, return file descriptor. */
+  int results;
+  results = process_add_file (f);
+  if (results == -1)
+    file_close (f);
+  return results;
+}
+
+/* Give size of file in file descriptor table.
+   If success, return its size, else, return -1. */
+int
+filesize (int fd)
+{
+  struct file *f;
+
+  /* Search file using file descriptor. */
+  f = process_get_file (fd);
+
+  /* If file is invalid, return -1. */
+  if (f == NULL)
+    return -1;
+
+  /* If file is valid, return file size. */
+  return file_length (f);
+}
+
+/* Read file for certain size. Save it to buffer. */
+int
+read (int fd, void *buffer, unsigned size)
+{
+  struct file *f;
+
+  /* get file from file descriptor table. */
+  f = process_get_file (fd);
+
+  /* If file read from standard input, take keys in bulk from
+     input buffer, ending as process's stdin mode says. */
+  if(fd == 0)
+    return input_read (buffer, size,
+                       thread_current ()->process->stdin_mode);
+  /* If file read from certain file in file descriptor table, */
+  else
+  {
+    int sizes;
+    /* If file is invalid or a directory, return -1. */
+    if (f == NULL
+        || (!file_is_pipe (f) && inode_is_dir (file_get_inode (f))))
+      return -1;
+    /* Large read goes straight from disk into user pages, small one
+       through buffer cache by using file_read function, which also
+       waits for data written to a pipe. */
+    if (size >= DIRECT_READ_MIN && !file_is_pipe (f))
+      sizes = read_direct (f, buffer, size);
+    else
+      sizes = file_read (f, buffer, size);
+    return sizes;
+  }
+}
+
+/* Read SIZE bytes from F into user BUFFER, which caller has
+   pinned, with file_readv_direct ().  File system works on kernel
+   addresses, so hand it kernel alias of each page of buffer, up to
+   DIRECT_READ_PAGES pages at a time.  Return bytes read. */
+static int
+read_direct (struct file *f, uint8_t *buffer, unsigned size)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  int total = 0;
+
+  while (size > 0)
+  {
+    struct iovec iov[DIRECT_READ_PAGES];
+    int iovcnt = 0;
+    off_t want = 0, got;
+
+    for (; size > 0 && iovcnt < DIRECT_READ_PAGES; iovcnt++)
+    {
+      unsigned page_left = PGSIZE - pg_ofs (buffer);
+      unsigned n = size < page_left ? size : page_left;
+
+      iov[iovcnt].iov_base = pagedir_get_page (pd, buffer);
+      iov[iovcnt].iov_len = n;
+      buffer += n;
+      size -= n;
+      want += n;
+    }
+    got = file_readv_direct (f, iov, iovcnt);
+    total += got;
+    if (got < want)
+      break;
+  }
+  return total;
+}
+
+/* Write file for certain size. Contend is in buffer. */
+int
+write (int fd, void *buffer, unsigned size)
+{
+  struct file *f;
+
+  /* Get file from file descriptor table. */
+  f = process_get_file (fd);
+
+  /* If write file for standard output, */
+  if(fd == 1)
+  {
+    /* Using putbuf () function. */
+    putbuf (buffer, size);
+    return size;
+  }
+  /* If write file which is in file descriptor table, */
+  else
+  {
+    int sizes;
+    /* If file is invalid or a directory, return -1. */
+    if (f == NULL
+        || (!file_is_pipe (f) && inode_is_dir (file_get_inode (f))))
+      return -1;
+
+    /* write file by using file_write () function, which waits for
+       room in a pipe. */
+    sizes = file_write (f, buffer, size);
+    return sizes;
+  }
+}
+
+/* Change opened file's offset (Position). */
+void
+seek (int fd, unsigned position)
+{
+  struct file *f;
+
+  /* Get file from file descriptor table. */
+  f = process_get_file (fd);
+
+  /* Seek file by using file_seek () function. */
+  file_seek(f, position);
+}
+
+/* Search file using file descriptor and return offset. */
+unsigned
+tell (int fd)
+{
+  struct file *f;
+
+  /* Get file from file descriptor table. */
+  f = process_get_file (fd);
+
+  /* Return offset by using file_tell () function. */
+  return file_tell (f);
+}
+
+/* Close file by using process_close_file function. */
+void
+close (int fd)
+{
+  process_close_file (fd);
+}
+
+/* Change working directory of current process. */
+bool
+chdir (const char *dir)
+{
+  return filesys_chdir (dir);
+}
+
+/* Create directory using filesys_mkdir (). */
+bool
+mkdir (const char *dir)
+{
+  return filesys_mkdir (dir);
+}
+
+/* Read next entry of directory open as fd, other than "." and
+   "..", and copy its name to name.  Directory's position moves
+   past entry.  Return false if fd is not a directory or has no
+   more entries.  If name is bad, exit process. */
+bool
+readdir (int fd, char *name)
+{
+  struct file *f = get_inode_file (fd);
+  char kname[NAME_MAX + 1];
+  off_t pos;
+
+  if (f == NULL || !inode_is_dir (file_get_inode (f)))
+    return false;
+
+  pos = file_tell (f);
+  if (!dir_readdir_at (file_get_inode (f), &pos, kname))
+    return false;
+  file_seek (f, pos);
+
+  if (!copy_to_user (name, kname, strlen (kname) + 1))
+    exit (-1);
+  return true;
+}
+
+/* Like readdir (), but copy names of up to cnt entries to names
+   at once, reading directory many entries at a time, at most
+   READDIR_MANY_MAX per call.  Return number of names copied, 0 at
+   end of directory, or -1 if fd is not a directory, cnt is
+   negative, or memory is exhausted.  If names is bad, exit
+   process. */
+int
+readdir_many (int fd, char (*names)[NAME_MAX + 1], int cnt)
+{
+  struct file *f = get_inode_file (fd);
+  char (*knames)[NAME_MAX + 1];
+  off_t pos;
+  int n;
+
+  if (f == NULL || !inode_is_dir (file_get_inode (f)) || cnt < 0)
+    return -1;
+  if (cnt > READDIR_MANY_MAX)
+    cnt = READDIR_MANY_MAX;
+  if (cnt == 0)
+    return 0;
+
+  knames = scratch_alloc (cnt * sizeof *knames);
+  if (knames == NULL)
+    return -1;
+  pos = file_tell (f);
+  n = dir_readdir_many (file_get_inode (f), &pos, knames, cnt);
+  if (n > 0)
+    file_seek (f, pos);
+
+  if (n > 0 && !copy_to_user (names, knames, n * sizeof *knames))
+    exit (-1);
+  return n;
+}
+
+/* Tell whether fd is open as directory. */
+bool
+isdir (int fd)
+{
+  struct file *f = get_inode_file (fd);
+
+  return f != NULL && inode_is_dir (file_get_inode (f));
+}
+
+/* Return inode number of file open as fd, or -1 if it is not
+   open or is a pipe end. */
+int
+inumber (int fd)
+{
+  struct file *f = get_inode_file (fd);
+
+  if (f == NULL)
+    return -1;
+  return inode_get_inumber (file_get_inode (f));
+}
+
+/* Read file for certain size from offset. Save it to buffer.
+   Unlike read (), file position does not change. */
+int
+pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  struct file *f;
+
+  /* Console has no offset. */
+  if (fd == 0 || fd == 1)
+    return -1;
+
+  /* If file is invalid or offset is too big, return -1. */
+  f = get_data_file (fd);
+  if (f == NULL || (off_t) offset < 0)
+    return -1;
+
+  return file_read_at (f, buffer, size, offset);
+}
+
+/* Write file for certain size from offset. Content is in buffer.
+   Unlike write (), file position does not change. */
+int
+pwrite (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  struct file *f;
+
+  /* Console has no offset. */
+  if (fd == 0 || fd == 1)
+    return -1;
+
+  /* If file is invalid or offset is too big, return -1. */
+  f = get_data_file (fd);
+  if (f == NULL || (off_t) offset < 0)
+    return -1;
+
+  return file_write_at (f, buffer, size, offset);
+}
+
+/* Read file into IOVCNT buffers in IOV, in turn, like read ().
+   Whole file read is one file system operation. */
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  struct file *f;
+  int sizes = 0;
+  int i;
+
+  /* If file read from standard input, fill each buffer in turn. */
+  if (fd == 0)
+  {
+    for (i = 0; i < iovcnt; i++)
+      sizes += read (fd, iov[i].iov_base, iov[i].iov_len);
+    return sizes;
+  }
+
+  /* If file is invalid, return -1. */
+  f = get_data_file (fd);
+  if (f == NULL)
+    return -1;
+  return file_readv (f, iov, iovcnt);
+}
+
+/* Write IOVCNT buffers in IOV to file, one after another, like
+   write ().  Whole file write is one file system operation. */
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  struct file *f;
+  int sizes = 0;
+  int i;
+
+  /* If write file for standard output, write each buffer in turn. */
+  if (fd == 1)
+  {
+    for (i = 0; i < iovcnt; i++)
+      sizes += write (fd, iov[i].iov_base, iov[i].iov_len);
+    return sizes;
+  }
+
+  /* If file is invalid, return -1. */
+  f = get_data_file (fd);
+  if (f == NULL)
+    return -1;
+  return file_writev (f, iov, iovcnt);
 }
 
-/* System Call handler takes data from stack,
-   and do corresponing job. */
+/* Copy size bytes from fd_in to fd_out, both at their current
+   offsets, without passing data through user memory.
+   If success, return bytes copied, else, return -1. */
+int
+copy_file_range (int fd_in, int fd_out, unsigned size)
+{
+  struct file *in, *out;
+
+  /* Console has no offset, and file can not be copied to itself. */
+  if (fd_in == 0 || fd_in == 1 || fd_out == 0 || fd_out == 1
+      || fd_in == fd_out)
+    return -1;
 
-static void
-syscall_handler (struct intr_frame *f UNUSED) 
+  /* If file is invalid or size is too big, return -1. */
+  in = get_data_file (fd_in);
+  out = get_data_file (fd_out);
+  if (in == NULL || out == NULL || (off_t) size < 0)
+    return -1;
+
+  return file_copy (out, in, size);
+}
+
+/* Run cnt requests in entries, in order, in one kernel entry,
+   storing each one's return value in it.  Entries stay in user
+   memory, so program can queue next batch in same array.
+   Return number of requests run, or -1 if cnt is not between 1
+   and BATCH_MAX.  If entries or any buffer is bad, exit process. */
+int
+batch (struct batch_entry *entries, int cnt)
 {
-  /* System Call Can have at most 3 values. */
-  int arg[3];
-  /* which job to do? */
-  int syscall_number;
+  unsigned size = cnt * sizeof *entries;
+  int i;
+
+  if (cnt < 1 || cnt > BATCH_MAX)
+    return -1;
+  check_buffer (entries, size, true);
+
+  for (i = 0; i < cnt; i++)
+    if (!batch_one (&entries[i]))
+    {
+      /* Let go of whole batch before exit, like get_iovec (). */
+      release_buffer (entries, size);
+      exit (-1);
+    }
 
-  /* Check stack pointer point vaild address. */
-  check_address ((void *)(f->esp));
+  release_buffer (entries, size);
+  return cnt;
+}
+
+/* Run one request of batch () and store its result.
+   Return false if its buffer is bad. */
+bool
+batch_one (struct batch_entry *e)
+{
+  int *arg = e->args;
 
-  /* Takes Syscall Number from esp. */
-  syscall_number = *(int *)(f->esp);
-  switch(syscall_number)
+  switch (e->number)
   {
-    /* Halt Operation turn off system. */
-    case SYS_HALT:
-      halt();
-      break;
-    /* Exit Current Process. */
-    case SYS_EXIT:
-      get_argument(f->esp, arg, 1);
-      exit(arg[0]);
-      break;
-    /* Make Child Process. */
-    case SYS_EXEC:
-      get_argument(f->esp, arg, 1);
-      check_address((void *)arg[0]);
-      f->eax = exec((const char *)arg[0]);
-      break;
-    /* Wait until child process end. */
-    case SYS_WAIT:
-      get_argument(f->esp, arg, 1);
-      f->eax = wait((tid_t)arg[0]);
-      break;
-    /* Create file. */
-    case SYS_CREATE:
-      get_argument(f->esp, arg, 2);
-      check_address((void *)arg[0]);
-      f->eax = create((const char *)arg[0], (int)arg[1]);
-      break;
-    /* Remove file. */
-    case SYS_REMOVE:
-      get_argument(f->esp, arg, 1);
-      check_address((void *)arg[0]);
-      f->eax = remove((const char *)arg[0]);
-      break;
-    /* Open File. */
-    case SYS_OPEN:
-      get_argument(f->esp, arg, 1);
-      check_address((void *)arg[0]);
-      f->eax = open((const char *)arg[0]);
-      break;
-    /* Return Filesize. */
-    case SYS_FILESIZE:
-      get_argument(f->esp, arg, 1);
-      f->eax = filesize((int)arg[0]);
-      break;
-    /* Read File from command line or file. */
     case SYS_READ:
-      get_argument(f->esp, arg, 3);
-      check_address((void *)arg[1]);
-      f->eax = read((int)arg[0], (void *)arg[1], (unsigned)arg[2]);
-      break;
-    /* Write File at monitor or file. */
     case SYS_WRITE:
-      get_argument(f->esp, arg, 3);
-      check_address((void *)arg[1]);
-      f->eax = write((int)arg[0], (void *)arg[1], (unsigned)arg[2]);
+      {
+        bool to_user = e->number == SYS_READ;
+
+        if (!pin_buffer ((void *)arg[1], (unsigned)arg[2], to_user))
+          return false;
+        if (to_user)
+          e->result = read (arg[0], (void *)arg[1], (unsigned)arg[2]);
+        else
+          e->result = write (arg[0], (void *)arg[1], (unsigned)arg[2]);
+        release_buffer ((void *)arg[1], (unsigned)arg[2]);
+      }
       break;
-    /* Change offset. */
     case SYS_SEEK:
-      get_argument(f->esp, arg, 2);
-      seek((int)arg[0], (unsigned)arg[1]);
+      seek (arg[0], (unsigned)arg[1]);
+      e->result = 0;
       break;
-    /* Take Offset. */
-    case SYS_TELL:
-      get_argument(f->esp, arg, 1);
-      f->eax = tell((int)arg[0]);
-      break;
-    /* Close File. */
     case SYS_CLOSE:
-      get_argument(f->esp, arg, 1);
-      close((int)arg[0]);
+      close (arg[0]);
+      e->result = 0;
       break;
-    /* Else, exit thread. */
     default:
-      thread_exit();
+      e->result = -1;
       break;
   }
+  return true;
 }
 
-/* Check pointer points User Area. */
-void
-check_address (void *addr)
+/* Set when reads from standard input return to mode, one of
+   enum input_mode.  Return previous mode, or -1 if mode is bad. */
+int
+stdin_mode (int mode)
 {
-  /* If pointer points Kernel Area of invalid area, exit process. */
-  if ((unsigned)addr < 0x8048000 || (unsigned)addr >= 0xc0000000)
-    exit (-1);
-}
+  struct process *p = thread_current ()->process;
+  int old_mode = p->stdin_mode;
 
-/* Get argument from stack for 4 byte. */
-void
-get_argument (void *esp, int *arg, int count)
-{
-  int i;
-  for(i = 0; i < count; i++)
-  {
-    /* Always check if pointer points valid area. */
-    check_address (esp + 4 + 4 * i);
-    arg[i] = *(int *)(esp + 4 + 4 * i);
-  }
+  if (mode != INPUT_RAW && mode != INPUT_LINE && mode != INPUT_NONBLOCK)
+    return -1;
+  p->stdin_mode = mode;
+  return old_mode;
 }
 
-/* Halt Shutdown machine. */
-void
-halt (void)
+/* Copy statistics for block device number index, in probe
+   order, to stats.  Return false if there is no such device. */
+bool
+block_stats (int index, struct block_stats *stats)
 {
-  shutdown_power_off();
-}
+  struct block *b;
+  struct block_stats s;
 
-/* Exit current process. */
-void
-exit (int status)
-{
-  struct thread *cur = thread_current ();
+  for (b = block_first (); b != NULL && index > 0; b = block_next (b))
+    index--;
+  if (b == NULL || index < 0)
+    return false;
 
-  /* Assign how current process ends. And exit thread. */
-  cur->exit_status = status;
-  printf ("%s: exit(%d)\n", cur->name, status);
-  thread_exit ();
+  block_get_stats (b, &s);
+  if (!copy_to_user (stats, &s, sizeof s))
+    exit (-1);
+  return true;
 }
 
-/* Create file using filesys_create (). */
+/* Reserve disk space for file open as fd to grow to length
+   bytes, without changing its size, so that writes extending it
+   that far need not allocate.  Return false if fd is not an open
+   file, length is too big, or disk is full. */
 bool
-create (const char *file, unsigned initial_size)
+preallocate (int fd, unsigned length)
 {
-  /* If file is invalid, return false. */
-  if (file == NULL)
+  struct file *f = get_data_file (fd);
+
+  if (f == NULL || (off_t) length < 0)
     return false;
-  return filesys_create(file, initial_size);
+  return file_preallocate (f, length);
 }
 
-/* Remove file using filesys_remove (). */
+/* Write data of file open as fd to disk, and then metadata, so
+   that it survives a crash.  Return false if fd is not an open
+   file. */
 bool
-remove (const char *file)
+fsync (int fd)
 {
-  /* If file is invalid, return false. */
-  if (file == NULL)
+  struct file *f = get_data_file (fd);
+
+  if (f == NULL)
     return false;
-  return filesys_remove(file);
+  file_sync (f);
+  return true;
 }
 
-/* Create child process and execute it.
-   If creation success, return pid. If fail, return -1.
-   Parent process waits until end of child process loading. */
-tid_t
-exec (const char *cmd_line)
+/* Write all cached file system data to disk, data before
+   metadata. */
+void
+sync (void)
 {
-  int tid;
-  struct thread *cp;
+  filesys_sync ();
+}
 
-  /* Create child process which name is what cmdline point to. */
-  tid = process_execute (cmd_line);
-  cp = get_child_process (tid);
+/* Copy buffer cache statistics to stats, along with bytes read
+   from and written to file open as fd, or zeros for those if fd
+   is -1.  Return false if fd is neither -1 nor an open file. */
+bool
+fs_stats (int fd, struct fs_stats *stats)
+{
+  struct fs_stats s;
 
-  /* Wait until end of loading child process. */
-  sema_down (&cp->load);
+  memset (&s, 0, sizeof s);
+  if (fd != -1)
+  {
+    struct file *f = get_data_file (fd);
+    if (f == NULL)
+      return false;
+    inode_get_stats (file_get_inode (f), &s);
+  }
+  cache_get_stats (&s.cache);
+  if (!copy_to_user (stats, &s, sizeof s))
+    exit (-1);
+  return true;
+}
 
-  /* If creation fail, return -1. */
-  if (cp == NULL)
-    return -1;
+/* Copy scheduler statistics for thread tid, or for the calling
+   thread if tid is 0, to stats.  Return false if there is no
+   such thread. */
+bool
+sched_stats (tid_t tid, struct sched_stats *stats)
+{
+  struct sched_stats s;
 
-  /* If load fail, return -1. */
-  if (cp->is_load == false)
+  if (tid == 0)
+    tid = thread_current ()->tid;
+  if (!thread_get_sched_stats (tid, &s))
+    return false;
+  if (!copy_to_user (stats, &s, sizeof s))
+    exit (-1);
+  return true;
+}
+
+/* Put the calling thread in scheduling class sched_class, which
+   threads it creates inherit.  Return its previous class, or -1
+   if sched_class is not SCHED_NORMAL or SCHED_BATCH. */
+int
+set_sched_class (int sched_class)
+{
+  if (sched_class != SCHED_NORMAL && sched_class != SCHED_BATCH)
     return -1;
+  return thread_set_sched_class (sched_class);
+}
 
-  /* If success, return tid. */
-    return tid;
+/* Put the calling thread in the deadline scheduling class, to
+   run for budget_ms milliseconds of every period_ms, rounded up
+   to timer ticks.  Threads it creates do not inherit the class.
+   set_sched_class () takes it out again.  Return false if the
+   budget is not positive or exceeds the period, or if the CPU
+   does not have that much time to spare for deadline threads. */
+bool
+set_deadline (int period_ms, int budget_ms)
+{
+  if (period_ms <= 0 || budget_ms <= 0 || budget_ms > period_ms)
+    return false;
+  return thread_set_deadline (DIV_ROUND_UP ((int64_t) period_ms
+                                            * TIMER_FREQ, 1000),
+                              DIV_ROUND_UP ((int64_t) budget_ms
+                                            * TIMER_FREQ, 1000));
 }
 
-/* Wait until child process end by using process_wait() function. */
-int
-wait (tid_t tid)
+/* Allow thread tid, or the calling thread if tid is 0, to run
+   only on the CPUs whose bits are set in cpu_mask, bit N for
+   CPU N.  Return false if there is no such thread or if cpu_mask
+   allows no CPU that runs threads. */
+bool
+set_affinity (tid_t tid, unsigned cpu_mask)
 {
-  return process_wait (tid);
+  if (tid == 0)
+    tid = thread_current ()->tid;
+  return thread_set_affinity (tid, cpu_mask);
 }
 
-/* Open file. If success, return file descriptor, else, return -1. */
-int
-open (const char *file)
+/* Store in *usage the resources used so far by the calling
+   process and all of its threads, live or exited, and by the
+   children it has waited for.  If usage is a bad pointer, exit
+   process. */
+void
+getrusage (struct rusage *usage)
 {
-  /* If file name pointer is invalid, return -1. */
-  if (file == NULL)
-    return -1;
+  struct rusage u;
 
-  struct file *f;
+  process_get_usage (&u);
+  if (!copy_to_user (usage, &u, sizeof u))
+    exit (-1);
+}
 
-  /* Acquire Lock to avoid multiple access to file. */
-  lock_acquire (&filesys_lock);
+/* Move the end of the calling process's heap by increment bytes,
+   which may be negative, and return its old end.  New heap memory
+   is zeroed.  Return (void *) -1 if the heap cannot grow or
+   shrink that far. */
+void *
+sbrk (intptr_t increment)
+{
+  void *old_brk = process_sbrk (increment);
+  return old_brk != NULL ? old_brk : (void *) -1;
+}
 
-  /* Open file */
-  f = filesys_open (file);
+/* Create pipe and open its read end as fds[0] and its write end
+   as fds[1].  Both ends are passed on to children started by
+   exec, under the same numbers.  Return 0 if successful, -1 if
+   memory or file descriptors run out.  If fds is bad, exit
+   process. */
+int
+pipe (int *fds)
+{
+  struct file *ends[2];
+  int kfds[2];
 
-  /* If file is invalid, release lock and return -1. */
-  if (f == NULL)
+  if (!file_open_pipe (ends))
+    return -1;
+  kfds[0] = process_add_file (ends[0]);
+  kfds[1] = kfds[0] != -1 ? process_add_file (ends[1]) : -1;
+  if (kfds[1] == -1)
   {
-    lock_release (&filesys_lock);
+    if (kfds[0] != -1)
+      process_close_file (kfds[0]);
+    else
+      file_close (ends[0]);
+    file_close (ends[1]);
     return -1;
   }
+  if (!copy_to_user (fds, kfds, sizeof kfds))
+  {
+    process_close_file (kfds[0]);
+    process_close_file (kfds[1]);
+    exit (-1);
+  }
+  return 0;
+}
 
-  /* If file is as same as currently opened file, avoid multiple write. */
-  if (strcmp (file,thread_current ()->name) == 0)
-    file_deny_write(f);
-
-  /* If file descriptor table is full, return -1.
-     If all condition is clear, return file descriptor. */
-  int results;
-  results = process_add_file (f);
-
-  /* After all job finished, release lock. */
-  lock_release(&filesys_lock);
-  if (results == 64)
-    return -1;
-  return results;
+/* Create copy of this process, which continues from here with
+   return value 0.  Return child's pid, or -1 if it can not be
+   created. */
+tid_t
+fork (void)
+{
+  return process_fork ();
 }
 
-/* Give size of file in file descriptor table.
-   If success, return its size, else, return -1. */
-int
-filesize (int fd)
+/* Return poll () events true of FD, out of EVENTS, POLLERR,
+   POLLHUP and POLLNVAL, putting PT on wait queue of FD's
+   object if it may wait. */
+static short
+poll_fd (int fd, short events, struct poll_table *pt)
 {
   struct file *f;
+  int ready;
 
-  /* Search file using file descriptor. */
-  f = process_get_file (fd);
-
-  /* If file is invalid, return -1. */
-  if (f == NULL)
-    return -1;
-
-  /* If file is valid, return file size. */
-  return file_length (f);
+  if (fd == 0)
+    ready = input_poll (pt) ? POLLIN : 0;
+  else if (fd == 1)
+    ready = POLLOUT;
+  else if ((f = process_get_file (fd)) != NULL)
+    ready = file_poll (f, pt);
+  else
+    ready = POLLNVAL;
+  return ready & (events | POLLERR | POLLHUP | POLLNVAL);
 }
 
-/* Read file for certain size. Save it to buffer. */
+/* Wait until one of N descriptors in FDS is ready for events it
+   asks for, or for TIMEOUT milliseconds, or forever if TIMEOUT
+   is negative.  Set each descriptor's revents, and return number
+   of descriptors with any set, 0 on timeout, or -1 if N is bad.
+   Instead of busy looping, wait on wait queue of every pipe and
+   console input polled, and on timer for timeout. */
 int
-read (int fd, void *buffer, unsigned size)
+poll (struct pollfd *ufds, int n, int timeout)
 {
-  struct file *f;
-  int i;
-
-  /* Acquire lock to avoid multiple file access. */
-  lock_acquire (&filesys_lock);
+  struct pollfd fds[POLL_MAX];
+  struct poll_table pt;
+  int64_t start = timer_ticks ();
+  int64_t ticks = -1;
+  int ready, i;
 
-  /* get file from file descriptor table. */
-  f = process_get_file (fd);
+  if (n < 0 || n > POLL_MAX)
+    return -1;
+  if (!copy_from_user (fds, ufds, n * sizeof *fds))
+    exit (-1);
+  if (timeout >= 0)
+    ticks = DIV_ROUND_UP ((int64_t) timeout * TIMER_FREQ, 1000);
 
-  /* If file read from standard input, */
-  if(fd == 0)
+  for (;;)
   {
-    for (i = 0; i < size; i++)
+    int64_t left = -1;
+
+    if (ticks >= 0)
     {
-      /* using input_getc () function to read from keyboard input.*/
-      *(uint8_t *)(buffer + i) = input_getc ();
+      left = ticks - timer_elapsed (start);
+      if (left < 0)
+        left = 0;
     }
-    /* After reading, release lock and return size. */
-    lock_release (&filesys_lock);
-    return size;
-  }
-  /* If file read from certain file in file descriptor table, */
-  else
-  {
-    int sizes;
-    /* If file is invalid, return -1. */
-    if (f == NULL)
+
+    /* Register before checking, so wakeup in between is not lost. */
+    poll_init (&pt);
+    ready = 0;
+    for (i = 0; i < n; i++)
     {
-      /* Don't forget relase lock before end. */
-      lock_release (&filesys_lock);
-      return -1;
+      fds[i].revents = poll_fd (fds[i].fd, fds[i].events,
+                                ready == 0 && left != 0 ? &pt : NULL);
+      if (fds[i].revents != 0)
+        ready++;
     }
-    /* read file by using file_read function. */
-    sizes = file_read (f, buffer, size);
-    /* After reading, release lock and return size. */
-    lock_release (&filesys_lock);
-    return sizes;
+    if (ready == 0 && left != 0)
+      poll_wait (&pt, left);
+    poll_done (&pt);
+    if (ready > 0 || left == 0)
+      break;
   }
+
+  if (!copy_to_user (ufds, fds, n * sizeof *fds))
+    exit (-1);
+  return ready;
 }
 
-/* Write file for certain size. Contend is in buffer. */
-int
-write (int fd, void *buffer, unsigned size)
+/* Create file named to as clone of file named from, sharing its
+   data on disk until either is written.  Return true if
+   successful.  If either name is bad, exit process. */
+bool
+reflink (const char *from, const char *to)
 {
-  struct file *f;
+  return filesys_clone (get_string (from), get_string (to));
+}
 
-  /* Acquire lock to avoid multiple access. */
-  lock_acquire (&filesys_lock);
+/* Compress data of file open as fd on disk, until it is next
+   written.  Return false if fd is not an open file, or file can
+   not be compressed. */
+bool
+compress (int fd)
+{
+  struct file *f = get_data_file (fd);
 
-  /* Get file from file descriptor table. */
-  f = process_get_file (fd);
+  if (f == NULL)
+    return false;
+  return file_compress (f);
+}
 
-  /* If write file for standard output, */
-  if(fd == 1)
-  {
-    /* Using putbuf () function. */
-    putbuf (buffer, size);
-    /* After writing, release lock. And return size. */
-    lock_release (&filesys_lock);
-    return size;
-  }
-  /* If write file which is in file descriptor table, */
-  else
-  {
-    int sizes;
-    /* If file is invalid, return -1. */
-    if (f == NULL)
-    {
-      /* Don't forget release lock before end. */
-      lock_release (&filesys_lock);
-      return -1;
-    }
+/* Pin the data of the file open as fd in the page cache, so that
+   it stays cached, however much else is read, until unpin () is
+   called for it or the system halts.  The pin outlives fd.
+   Return false if fd is not an open file or if the file is too
+   large to pin. */
+bool
+pin (int fd)
+{
+  struct file *f = get_data_file (fd);
 
-    /* write file by using file_write () function. */
-    sizes = file_write (f, buffer, size);
-    /* After writing, release lock and return size. */
-    lock_release (&filesys_lock);
-    return sizes;
-  }
+  if (f == NULL)
+    return false;
+  return file_pin (f);
 }
 
-/* Change opened file's offset (Position). */
-void
-seek (int fd, unsigned position)
+/* Undo pin () for the file open as fd.  Return false if fd is
+   not an open file. */
+bool
+unpin (int fd)
 {
-  struct file *f;
-
-  /* Get file from file descriptor table. */
-  f = process_get_file (fd);
+  struct file *f = get_data_file (fd);
 
-  /* Seek file by using file_seek () function. */
-  file_seek(f, position);
+  if (f == NULL)
+    return false;
+  file_unpin (f);
+  return true;
 }
 
-/* Search file using file descriptor and return offset. */
-unsigned
-tell (int fd)
+#ifdef VM
+/* Map file open as fd into memory at addr.
+   If success, return mapping id, else, return -1. */
+mapid_t
+mmap (int fd, void *addr)
 {
-  struct file *f;
+  /* Console can not be mapped. */
+  if (fd == 0 || fd == 1)
+    return MAP_FAILED;
 
-  /* Get file from file descriptor table. */
-  f = process_get_file (fd);
-
-  /* Return offset by using file_tell () function. */
-  return file_tell (f);
+  /* Mapping keeps its own handle, so fd may be closed later.
+     Pipes can not be mapped either. */
+  return mmap_map (get_inode_file (fd), addr);
 }
 
-/* Close file by using process_close_file function. */
+/* Remove mapping, writing back what was changed. */
 void
-close (int fd)
+munmap (mapid_t mapid)
 {
-  process_close_file (fd);
+  mmap_unmap (mapid);
+}
+
+/* Create shared memory segment of size bytes.
+   If success, return its id, else, return -1. */
+int
+shm_create (size_t size)
+{
+  return shm_create_segment (size);
+}
+
+/* Map shared memory segment id at addr. */
+bool
+shm_map (int id, void *addr)
+{
+  return shm_map_segment (id, addr);
 }
+#endif
@@ -1,8 +1,13 @@
 #ifndef USERPROG_SYSCALL_H
 #define USERPROG_SYSCALL_H
 
-void syscall_init (void);
+#include <stdbool.h>
+
+/* Enter system calls with SYSENTER, when the CPU has it?
+   Cleared by kernel command-line option "-no-sysenter". */
+extern bool syscall_sysenter;
 
-struct lock filesys_lock;
+void syscall_init (void);
+void syscall_print_stats (void);
 
 #endif /* userprog/syscall.h */
@@ -1,7 +1,9 @@
 #include "userprog/tss.h"
 #include <debug.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include "userprog/gdt.h"
+#include "threads/msr.h"
 #include "threads/thread.h"
 #include "threads/palloc.h"
 #include "threads/vaddr.h"
@@ -75,6 +77,9 @@ struct tss
 /* Kernel TSS. */
 static struct tss *tss;
 
+/* Keep the SYSENTER stack pointer with ESP0? */
+static bool sysenter;
+
 /* Initializes the kernel TSS. */
 void
 tss_init (void) 
@@ -103,4 +108,16 @@ tss_update (void)
 {
   ASSERT (tss != NULL);
   tss->esp0 = (uint8_t *) thread_current () + PGSIZE;
+  if (sysenter)
+    wrmsr (MSR_SYSENTER_ESP, (uint32_t) tss->esp0);
+}
+
+/* Makes tss_update() also point the stack that SYSENTER switches
+   to at the end of the thread stack, where a system call made
+   with "int $0x31" would put its frame, and does so now. */
+void
+tss_enable_sysenter (void)
+{
+  sysenter = true;
+  tss_update ();
 }
@@ -0,0 +1,115 @@
+#include "userprog/usercopy.h"
+#include <debug.h>
+#include "threads/vaddr.h"
+
+/* Raw copy primitive and exception table, in user-access.S. */
+size_t usercopy_raw (void *dst, const void *src, size_t n);
+
+struct usercopy_entry
+  {
+    const void *insn;           /* Instruction that may fault. */
+    void *fixup;                /* Where to resume if it does. */
+  };
+extern const struct usercopy_entry usercopy_table[], usercopy_table_end[];
+
+static bool user_range (const void *uaddr, size_t size);
+
+/* Copies SIZE bytes from user address USRC to kernel buffer DST.
+   Returns false if any byte of the source is not readable by the
+   current process. */
+bool
+copy_from_user (void *dst, const void *usrc, size_t size)
+{
+  return user_range (usrc, size) && usercopy_raw (dst, usrc, size) == 0;
+}
+
+/* Copies SIZE bytes from kernel buffer SRC to user address UDST.
+   Returns false if any byte of the destination is not writable
+   by the current process. */
+bool
+copy_to_user (void *udst, const void *src, size_t size)
+{
+  return user_range (udst, size) && usercopy_raw (udst, src, size) == 0;
+}
+
+/* Copies the null-terminated string at user address USRC into
+   DST, which has room for SIZE bytes.  Returns the length of the
+   string, or -1 if it is unreadable or does not fit. */
+int
+strncpy_from_user (char *dst, const char *usrc, size_t size)
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    {
+      int c;
+
+      if (!is_user_vaddr (usrc + i)
+          || (c = get_user ((const uint8_t *) usrc + i)) < 0)
+        return -1;
+      dst[i] = c;
+      if (c == '\0')
+        return i;
+    }
+  return -1;
+}
+
+/* Returns true if every byte of the SIZE bytes at UADDR is
+   readable by the current process.  Touches one byte per page,
+   which also brings in any page that is not resident. */
+bool
+user_readable (const void *uaddr, size_t size)
+{
+  const uint8_t *p = uaddr;
+  const uint8_t *end = p + size;
+
+  if (!user_range (uaddr, size))
+    return false;
+  for (; p < end; p = (const uint8_t *) pg_round_down (p) + PGSIZE)
+    if (get_user (p) < 0)
+      return false;
+  return true;
+}
+
+/* Returns true if every byte of the SIZE bytes at UADDR is
+   writable by the current process.  Like user_readable(), but
+   writes back one byte per page, unchanged, to check. */
+bool
+user_writable (void *uaddr, size_t size)
+{
+  uint8_t *p = uaddr;
+  uint8_t *end = p + size;
+
+  if (!user_range (uaddr, size))
+    return false;
+  for (; p < end; p = (uint8_t *) pg_round_down (p) + PGSIZE)
+    {
+      int c = get_user (p);
+      if (c < 0 || put_user (p, c) < 0)
+        return false;
+    }
+  return true;
+}
+
+/* If EIP is an instruction in user-access.S that may fault on a user
+   address, returns the address at which to resume after such a
+   fault.  Otherwise, returns a null pointer. */
+void *
+usercopy_fixup (const void *eip)
+{
+  const struct usercopy_entry *e;
+
+  for (e = usercopy_table; e < usercopy_table_end; e++)
+    if (e->insn == eip)
+      return e->fixup;
+  return NULL;
+}
+
+/* Returns true if the SIZE bytes at UADDR lie entirely in user
+   virtual memory. */
+static bool
+user_range (const void *uaddr, size_t size)
+{
+  uintptr_t start = (uintptr_t) uaddr;
+  return start + size >= start && start + size <= (uintptr_t) PHYS_BASE;
+}
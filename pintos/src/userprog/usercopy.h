@@ -0,0 +1,21 @@
+#ifndef USERPROG_USERCOPY_H
+#define USERPROG_USERCOPY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Raw primitives, in user-access.S.  They do not check that their
+   user address is below PHYS_BASE. */
+int get_user (const uint8_t *uaddr);
+int put_user (uint8_t *uaddr, uint8_t byte);
+
+bool copy_from_user (void *dst, const void *usrc, size_t size);
+bool copy_to_user (void *udst, const void *src, size_t size);
+int strncpy_from_user (char *dst, const char *usrc, size_t size);
+bool user_readable (const void *uaddr, size_t size);
+bool user_writable (void *uaddr, size_t size);
+
+void *usercopy_fixup (const void *eip);
+
+#endif /* userprog/usercopy.h */
@@ -0,0 +1,1133 @@
+#include "vm/frame.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <limits.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "filesys/inode.h"
+#include "filesys/pcache.h"
+#include "threads/slab.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "threads/workqueue.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+#include "vm/swap.h"
+
+/* Page replacement policy. */
+enum evict_policy frame_evict_policy = EVICT_CLOCK;
+
+/* EVICT_AGING samples and clears the accessed bits of every frame
+   each AGING_MS milliseconds, shifting them into the top of the
+   frame's age, and evicts the frame with the smallest age.  A
+   newly filled frame starts at AGE_NEW, as if it had been used in
+   the last two periods, so that it is not evicted before its
+   process gets to touch it again.  Evicting a dirty frame costs a
+   write, so its age is weighed as if DIRTY_COST higher. */
+#define AGING_MS 100
+#define AGE_NEW 0xc0
+#define DIRTY_COST 0x20
+
+/* Periodic aging of frames, for EVICT_AGING. */
+static struct work aging_work;
+
+/* Write-back of mapped files.  A modified page of a mapped file
+   otherwise reaches the file only when it is evicted or unmapped,
+   so a process writing through a large mapping could leave most
+   of memory dirty and make every eviction wait for a write.
+   Every WRITE_BEHIND_MS, and early once MMAP_DIRTY_LOW writable
+   mapped-file pages have been brought in since the last pass,
+   frame_clean_mmaps() writes all modified ones back in the
+   background; a process that brings in a page at MMAP_DIRTY_HIGH
+   runs it itself before going on. */
+#define WRITE_BEHIND_MS 1000
+#define MMAP_DIRTY_LOW 32
+#define MMAP_DIRTY_HIGH 128
+
+static struct work write_behind_work;   /* Periodic pass. */
+static struct work mmap_flush_work;     /* Pass past MMAP_DIRTY_LOW. */
+static size_t mmap_dirty_cnt;           /* Pages in since last pass. */
+
+/* Every allocated frame, in clock order.  FRAME_LOCK guards the
+   list, the clock hand, every frame's fields, the FRAME member of
+   every page and the FRAME member of every page cache page. */
+static struct list frame_list;
+static struct lock frame_lock;
+
+/* Cache of frame table entries. */
+static struct kmem_cache *frame_cache;
+
+/* Clock hand: last frame considered for eviction. */
+static struct list_elem *clock_hand;
+
+/* Frames evicted along with another by frame_page_out(), holding
+   no page, kept for the next frame_get() calls.  Not in
+   FRAME_LIST. */
+static struct list spare_frames;
+
+static struct frame *frame_get (enum palloc_flags);
+static struct frame *frame_get_free (enum palloc_flags);
+static void frame_destroy (struct frame *);
+static struct frame *frame_evict (void);
+static struct frame *frame_evict_aging (void);
+static bool frame_needs_write (struct frame *);
+static work_func frame_age;
+static work_func frame_write_behind;
+static void frame_clean_mmaps (void);
+static bool frame_accessed (struct frame *);
+static bool frame_page_out (struct frame *);
+static size_t frame_gather_cluster (struct frame *, struct frame *[]);
+static bool frame_unmap (struct frame *, bool *to_swap);
+static void frame_remap (struct frame *);
+static void frame_set_slot (struct frame *, size_t slot);
+static void frame_write_back (struct frame *, struct page *);
+static void frame_attach (struct frame *, struct page *);
+static struct list_elem *clock_next (struct list_elem *);
+static palloc_compact_func frame_compact;
+static bool frame_movable (struct frame *);
+static bool frame_move (struct frame *, void *kpage);
+
+/* Initializes the frame table. */
+void
+frame_init (void)
+{
+  list_init (&frame_list);
+  list_init (&spare_frames);
+  lock_init (&frame_lock);
+  clock_hand = list_end (&frame_list);
+  frame_cache = kmem_cache_create ("frame", sizeof (struct frame), NULL);
+  kmem_cache_use_reserve (frame_cache);
+  palloc_set_compactor (frame_compact);
+
+  work_init (&write_behind_work, WORK_NORMAL);
+  work_init (&mmap_flush_work, WORK_NORMAL);
+  work_queue_delayed (&write_behind_work, WRITE_BEHIND_MS * TIMER_FREQ / 1000,
+                      frame_write_behind, NULL);
+
+  if (frame_evict_policy == EVICT_AGING)
+    {
+      work_init (&aging_work, WORK_NORMAL);
+      work_queue_delayed (&aging_work, AGING_MS * TIMER_FREQ / 1000,
+                          frame_age, NULL);
+    }
+}
+
+/* Obtains a user frame to hold page P of the current process.
+   If the user pool is exhausted, evicts another page according to
+   frame_evict_policy.  Returns a null pointer if no frame can be
+   found.
+
+   The new frame is pinned until frame_unpin() is called, so that
+   it cannot be evicted while it is being filled. */
+struct frame *
+frame_alloc (enum palloc_flags flags, struct page *p)
+{
+  struct frame *f;
+
+  ASSERT (flags & PAL_USER);
+
+  lock_acquire (&frame_lock);
+  f = frame_get (flags);
+  if (f != NULL)
+    {
+      f->pin_cnt = 1;
+      f->pcache = NULL;
+      f->shm = false;
+      frame_attach (f, p);
+    }
+  lock_release (&frame_lock);
+
+  return f;
+}
+
+/* Like frame_alloc(), but only takes a free page from the user
+   pool, never evicting another page, for reading P ahead of its
+   use.  Returns a null pointer if the pool is exhausted. */
+struct frame *
+frame_alloc_free (struct page *p)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_get_free (PAL_USER);
+  if (f != NULL)
+    {
+      f->age = AGE_NEW;
+      f->pin_cnt = 1;
+      f->pcache = NULL;
+      f->shm = false;
+      frame_attach (f, p);
+    }
+  lock_release (&frame_lock);
+
+  return f;
+}
+
+/* Obtains a zeroed user frame for a shared memory segment,
+   evicting another page if necessary.  The frame holds no page
+   yet and stays pinned until frame_free_shm().  Returns a null
+   pointer if no frame can be found. */
+struct frame *
+frame_alloc_shm (void)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = frame_get (PAL_USER | PAL_ZERO);
+  if (f != NULL)
+    {
+      f->pin_cnt = 1;
+      f->pcache = NULL;
+      f->shm = true;
+    }
+  lock_release (&frame_lock);
+
+  return f;
+}
+
+/* Records that shared memory frame F also holds page P. */
+void
+frame_add_page (struct frame *f, struct page *p)
+{
+  ASSERT (f->shm);
+
+  lock_acquire (&frame_lock);
+  frame_attach (f, p);
+  lock_release (&frame_lock);
+}
+
+/* Returns shared memory frame F, which no page may still hold,
+   to the user pool. */
+void
+frame_free_shm (struct frame *f)
+{
+  ASSERT (f->shm);
+
+  lock_acquire (&frame_lock);
+  ASSERT (list_empty (&f->pages));
+  frame_destroy (f);
+  lock_release (&frame_lock);
+}
+
+/* Takes a frame from the user pool, allocated with FLAGS, or
+   from the spare frames, or evicts one if neither has any.
+   Returns a null pointer if nothing works.  The caller must
+   initialize the frame's pin count and kind. */
+static struct frame *
+frame_get (enum palloc_flags flags)
+{
+  struct frame *f;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  f = frame_get_free (flags);
+  if (f == NULL)
+    {
+      if (!list_empty (&spare_frames))
+        {
+          f = list_entry (list_pop_front (&spare_frames), struct frame,
+                          elem);
+          list_push_back (&frame_list, &f->elem);
+        }
+      else
+        {
+          f = (frame_evict_policy == EVICT_AGING
+               ? frame_evict_aging () : frame_evict ());
+          if (f != NULL)
+            thread_current ()->usage.evictions++;
+        }
+      if (f != NULL && (flags & PAL_ZERO))
+        memset (f->kpage, 0, PGSIZE);
+    }
+  if (f != NULL)
+    f->age = AGE_NEW;
+  return f;
+}
+
+/* Takes a frame from the user pool, allocated with FLAGS, and
+   adds it to the frame list.  Returns a null pointer if the pool
+   is exhausted. */
+static struct frame *
+frame_get_free (enum palloc_flags flags)
+{
+  struct frame *f;
+  void *kpage;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  kpage = palloc_get_page (flags);
+  if (kpage == NULL)
+    return NULL;
+  f = kmem_cache_alloc (frame_cache);
+  if (f == NULL)
+    {
+      palloc_free_page (kpage);
+      return NULL;
+    }
+  f->kpage = kpage;
+  list_init (&f->pages);
+  list_push_back (&frame_list, &f->elem);
+  return f;
+}
+
+/* Removes F from the frame list and frees it along with its
+   page of memory, or gives back the page cache page it maps. */
+static void
+frame_destroy (struct frame *f)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (clock_hand == &f->elem)
+    clock_hand = list_prev (clock_hand);
+  list_remove (&f->elem);
+  if (f->pcache != NULL)
+    {
+      f->pcache->frame = NULL;
+      pcache_unmap (f->pcache);
+      pcache_put (f->pcache);
+    }
+  else
+    palloc_free_page (f->kpage);
+  kmem_cache_free (frame_cache, f);
+}
+
+/* Attaches page P, a page of a file that may be mapped straight
+   from the page cache, to the page cache frame for its contents,
+   reading them into the page cache first if necessary, and
+   returns the frame, pinned.  If FILL is false, only a frame that
+   some process maps already is used.  Returns a null pointer if
+   there is none to use, because the page cache cannot hold the
+   page or has too many pages mapped already, in which case P
+   needs a frame of its own. */
+struct frame *
+frame_share (struct page *p, bool fill)
+{
+  struct pcache_page *pg;
+  struct frame *f;
+
+  pg = inode_get_page (file_get_inode (p->file), p->ofs / PGSIZE, fill);
+  if (pg == NULL)
+    return NULL;
+
+  lock_acquire (&frame_lock);
+  f = pg->frame;
+  if (f == NULL && fill && pcache_map (pg))
+    {
+      f = kmem_cache_alloc (frame_cache);
+      if (f != NULL)
+        {
+          f->kpage = pg->data;
+          list_init (&f->pages);
+          f->pin_cnt = 0;
+          f->age = AGE_NEW;
+          f->pcache = pg;
+          f->shm = false;
+          list_push_back (&frame_list, &f->elem);
+          pg->frame = f;
+
+          /* F keeps our reference for as long as it exists. */
+          pg = NULL;
+        }
+      else
+        pcache_unmap (pg);
+    }
+  if (pg != NULL)
+    pcache_put (pg);
+  if (f != NULL)
+    {
+      f->pin_cnt++;
+      frame_attach (f, p);
+    }
+  lock_release (&frame_lock);
+
+  return f;
+}
+
+/* If page P is resident, unmaps it from its owner's page
+   directory and detaches it from its frame.  A modified
+   PAGE_MMAP page is first written back to its file.  The frame
+   returns to the user pool, or to the page cache, once no page is
+   left in it, unless a shared memory segment owns it. */
+void
+frame_free (struct page *p)
+{
+  struct frame *f;
+
+  lock_acquire (&frame_lock);
+  f = p->frame;
+  if (f != NULL)
+    {
+      if (p->owner->pagedir != NULL)
+        {
+          frame_write_back (f, p);
+          pagedir_clear_page (p->owner->pagedir, p->upage);
+        }
+      list_remove (&p->frame_elem);
+      p->frame = NULL;
+
+      if (list_empty (&f->pages) && !f->shm)
+        frame_destroy (f);
+    }
+  lock_release (&frame_lock);
+}
+
+/* If page P is resident, pins its frame so that it stays resident
+   until frame_unpin() and returns true.  Returns false if P is
+   not resident, or if WRITE is true and P is mapped read-only
+   because it shares its frame copy-on-write. */
+bool
+frame_pin (struct page *p, bool write)
+{
+  bool pinned = false;
+
+  lock_acquire (&frame_lock);
+  if (p->frame != NULL
+      && (!write || pagedir_is_writable (p->owner->pagedir, p->upage)))
+    {
+      p->frame->pin_cnt++;
+      pinned = true;
+    }
+  lock_release (&frame_lock);
+  return pinned;
+}
+
+/* Gives writable page P of the current process a frame of its
+   own, copying the contents, if it shares its frame
+   copy-on-write with pages of other processes, and lets the
+   process write to it.  Returns false if no frame can be found.
+   If P has been evicted meanwhile, does nothing and returns true,
+   so that the access faults again and reads the page back. */
+bool
+frame_copy_on_write (struct page *p)
+{
+  uint32_t *pd = p->owner->pagedir;
+  struct frame *f, *copy;
+  bool success = true;
+
+  ASSERT (p->writable);
+
+  lock_acquire (&frame_lock);
+  f = p->frame;
+  if (f != NULL && !f->shm)
+    {
+      /* Every mapping of a page cache frame sees the same data. */
+      if (list_size (&f->pages) > 1 && f->pcache == NULL)
+        {
+          /* Keep F itself from being chosen for eviction. */
+          f->pin_cnt++;
+          copy = frame_get (PAL_USER);
+          f->pin_cnt--;
+          if (copy != NULL)
+            {
+              memcpy (copy->kpage, f->kpage, PGSIZE);
+              copy->pin_cnt = 0;
+              copy->pcache = NULL;
+              copy->shm = false;
+              list_remove (&p->frame_elem);
+              pagedir_clear_page (pd, p->upage);
+              frame_attach (copy, p);
+              success = pagedir_set_page (pd, p->upage, copy->kpage, true);
+            }
+          else
+            success = false;
+        }
+      else
+        pagedir_set_writable (pd, p->upage, true);
+    }
+  lock_release (&frame_lock);
+
+  return success;
+}
+
+/* Gives page C, of a process being created by fork(), the
+   contents of page Q of its parent.  If Q is resident, C maps the
+   same frame, read-only; if Q is writable, it is mapped read-only
+   too, so that the first write by either process faults and
+   takes a private copy with frame_copy_on_write().  A frame that
+   the kernel has pinned, perhaps to write into it, is copied at
+   once instead.  If Q is in swap, C shares its slot.  Returns
+   false if memory or swap references are exhausted. */
+bool
+frame_fork (struct page *q, struct page *c)
+{
+  uint32_t *qpd = q->owner->pagedir;
+  uint32_t *cpd = c->owner->pagedir;
+  struct frame *f, *copy;
+  bool success = true;
+
+  ASSERT (!q->zero_mapped);
+
+  lock_acquire (&frame_lock);
+  f = q->frame;
+  if (f == NULL)
+    {
+      c->type = q->type;
+      if (q->swap_slot != BITMAP_ERROR)
+        {
+          success = swap_dup (q->swap_slot);
+          if (success)
+            c->swap_slot = q->swap_slot;
+        }
+    }
+  else if (q->writable && f->pin_cnt > 0)
+    {
+      copy = frame_get (PAL_USER);
+      if (copy != NULL)
+        {
+          memcpy (copy->kpage, f->kpage, PGSIZE);
+          copy->pin_cnt = 0;
+          copy->pcache = NULL;
+          copy->shm = false;
+          c->type = PAGE_SWAP;
+          success = pagedir_set_page (cpd, c->upage, copy->kpage, true);
+          if (success)
+            frame_attach (copy, c);
+          else
+            frame_destroy (copy);
+        }
+      else
+        success = false;
+    }
+  else
+    {
+      /* The two mappings have separate dirty bits, so a page
+         modified since it was read in must from now on be saved
+         to swap whichever of them is dirty. */
+      if (q->writable)
+        {
+          if (pagedir_is_dirty (qpd, q->upage))
+            q->type = PAGE_SWAP;
+          pagedir_set_writable (qpd, q->upage, false);
+        }
+      c->type = q->type;
+      success = pagedir_set_page (cpd, c->upage, f->kpage, false);
+      if (success)
+        frame_attach (f, c);
+    }
+  lock_release (&frame_lock);
+
+  return success;
+}
+
+/* Drops one pin on frame F, making it eligible for eviction
+   again once no pins remain. */
+void
+frame_unpin (struct frame *f)
+{
+  lock_acquire (&frame_lock);
+  ASSERT (f->pin_cnt > 0);
+  f->pin_cnt--;
+  lock_release (&frame_lock);
+}
+
+/* Chooses a victim with the second-chance clock algorithm,
+   detaches it from its pages and returns it for reuse.  A frame
+   whose accessed bit is set has the bit cleared and is passed
+   over once.  Returns a null pointer if no frame can be evicted
+   after two full sweeps. */
+static struct frame *
+frame_evict (void)
+{
+  size_t n = list_size (&frame_list) * 2;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  while (n-- > 0)
+    {
+      struct frame *f;
+
+      clock_hand = clock_next (clock_hand);
+      f = list_entry (clock_hand, struct frame, elem);
+
+      if (f->pin_cnt > 0 || f->pcache != NULL || frame_accessed (f)
+          || !frame_page_out (f))
+        continue;
+      return f;
+    }
+  return NULL;
+}
+
+/* Chooses a victim for EVICT_AGING, detaches it from its pages
+   and returns it for reuse.  The victim is the unpinned frame
+   with the smallest age, counting a frame accessed since the last
+   aging period as if it had just been aged, and charging dirty
+   frames DIRTY_COST.  A frame that cannot be paged out because
+   swap is full is given the greatest age and the choice repeats.
+   Returns a null pointer if no frame can be evicted. */
+static struct frame *
+frame_evict_aging (void)
+{
+  size_t n = list_size (&frame_list);
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  while (n-- > 0)
+    {
+      struct frame *victim = NULL;
+      unsigned victim_cost = UINT_MAX;
+      struct list_elem *e;
+
+      for (e = list_begin (&frame_list); e != list_end (&frame_list);
+           e = list_next (e))
+        {
+          struct frame *f = list_entry (e, struct frame, elem);
+          unsigned cost;
+
+          if (f->pin_cnt > 0 || f->pcache != NULL)
+            continue;
+          if (frame_accessed (f))
+            f->age = (f->age >> 1) | 0x80;
+          cost = f->age + (frame_needs_write (f) ? DIRTY_COST : 0);
+          if (cost < victim_cost)
+            {
+              victim = f;
+              victim_cost = cost;
+              if (cost == 0)
+                break;
+            }
+        }
+
+      if (victim == NULL)
+        return NULL;
+      if (frame_page_out (victim))
+        return victim;
+      victim->age = UINT8_MAX;
+    }
+  return NULL;
+}
+
+/* Aging work for EVICT_AGING.  Every AGING_MS milliseconds,
+   shifts each frame's age right by one bit, setting the top bit
+   if any of its pages was accessed in the meantime. */
+static void
+frame_age (struct work *w, void *aux UNUSED)
+{
+  struct list_elem *e;
+
+  lock_acquire (&frame_lock);
+  for (e = list_begin (&frame_list); e != list_end (&frame_list);
+       e = list_next (e))
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+      f->age = (f->age >> 1) | (frame_accessed (f) ? 0x80 : 0);
+    }
+  lock_release (&frame_lock);
+
+  work_queue_delayed (w, AGING_MS * TIMER_FREQ / 1000, frame_age, NULL);
+}
+
+/* Returns true if evicting F would require writing its contents
+   to swap or to a file first, as frame_page_out() does. */
+static bool
+frame_needs_write (struct frame *f)
+{
+  struct list_elem *e;
+
+  if (f->pcache != NULL)
+    return false;
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+
+      if (pagedir_is_dirty (p->owner->pagedir, p->upage)
+          || p->type == PAGE_SWAP)
+        return true;
+    }
+  return false;
+}
+
+/* Returns true if any page in F was accessed since the last
+   sweep, clearing all of their accessed bits. */
+static bool
+frame_accessed (struct frame *f)
+{
+  struct list_elem *e;
+  bool accessed = false;
+
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      if (pagedir_is_accessed (pd, p->upage))
+        {
+          pagedir_set_accessed (pd, p->upage, false);
+          accessed = true;
+        }
+    }
+  return accessed;
+}
+
+/* Detaches F from its pages, saving the contents first if they
+   cannot be recreated from the backing store: modified
+   mapped-file pages go back to their file, other modified pages
+   to swap.  Page cache frames are never paged out.  Returns
+   false, leaving F untouched, if swap is full.
+
+   A frame bound for swap takes along the frames right after it
+   in the frame list, up to SWAP_CLUSTER in all, that must be
+   saved to swap too and could be evicted at once.  The list is in
+   allocation order, so they often hold neighbouring pages of the
+   same process; they are written to consecutive slots, for
+   page_load() to read back together, and the frames other than F
+   are set aside in spare_frames for the allocations to come. */
+static bool
+frame_page_out (struct frame *f)
+{
+  struct frame *cluster[SWAP_CLUSTER];
+  void *kpages[SWAP_CLUSTER];
+  size_t slots[SWAP_CLUSTER];
+  size_t cnt, i;
+  struct page *p;
+  bool dirty, to_swap;
+
+  ASSERT (f->pcache == NULL);
+
+  dirty = frame_unmap (f, &to_swap);
+  p = list_entry (list_front (&f->pages), struct page, frame_elem);
+  if (p->type == PAGE_MMAP)
+    {
+      if (dirty)
+        file_write_at (p->file, f->kpage, p->read_bytes, p->ofs);
+    }
+  else if (dirty || to_swap)
+    {
+      cluster[0] = f;
+      cnt = 1 + frame_gather_cluster (f, cluster + 1);
+      for (i = 0; i < cnt; i++)
+        kpages[i] = cluster[i]->kpage;
+
+      if (!swap_out_cluster (kpages, cnt, slots))
+        {
+          for (i = 0; i < cnt; i++)
+            frame_remap (cluster[i]);
+          return false;
+        }
+
+      for (i = 0; i < cnt; i++)
+        frame_set_slot (cluster[i], slots[i]);
+      for (i = 1; i < cnt; i++)
+        {
+          struct frame *g = cluster[i];
+
+          if (clock_hand == &g->elem)
+            clock_hand = list_prev (clock_hand);
+          list_remove (&g->elem);
+          list_init (&g->pages);
+          list_push_back (&spare_frames, &g->elem);
+        }
+    }
+  list_init (&f->pages);
+  return true;
+}
+
+/* Collects into CLUSTER[] the frames that follow F in the frame
+   list, up to SWAP_CLUSTER - 1 of them, for frame_page_out() to
+   save to swap along with F, and unmaps them.  Stops at the first
+   frame that is pinned, a page cache frame, holds a mapped-file
+   page, was
+   accessed since its accessed bits were last cleared, or would
+   not need saving.  Returns the number of frames collected. */
+static size_t
+frame_gather_cluster (struct frame *f, struct frame *cluster[])
+{
+  struct list_elem *e = list_next (&f->elem);
+  size_t cnt = 0;
+
+  while (cnt < SWAP_CLUSTER - 1 && e != list_end (&frame_list))
+    {
+      struct frame *g = list_entry (e, struct frame, elem);
+      struct list_elem *pe;
+      bool to_swap;
+
+      if (g->pin_cnt > 0 || g->pcache != NULL || list_empty (&g->pages)
+          || !frame_needs_write (g))
+        break;
+      for (pe = list_begin (&g->pages); pe != list_end (&g->pages);
+           pe = list_next (pe))
+        {
+          struct page *p = list_entry (pe, struct page, frame_elem);
+          if (p->type == PAGE_MMAP
+              || pagedir_is_accessed (p->owner->pagedir, p->upage))
+            break;
+        }
+      if (pe != list_end (&g->pages))
+        break;
+
+      frame_unmap (g, &to_swap);
+      cluster[cnt++] = g;
+      e = list_next (e);
+    }
+  return cnt;
+}
+
+/* Unmaps every page held in F, first detaching it, so that if an
+   owner touches its page again it sees it as non-resident and
+   waits on FRAME_LOCK to read it back.  F itself keeps the list
+   of pages.  Returns true if any of them was modified, and sets
+   *TO_SWAP to true if any of them is backed only by swap.
+
+   F holds one page, or several pages of processes that fork()
+   left sharing it copy-on-write, which all have the same
+   contents and backing store.  Unmapping comes before any write
+   to swap, so that no owner can modify the page behind our
+   back. */
+static bool
+frame_unmap (struct frame *f, bool *to_swap)
+{
+  struct list_elem *e;
+  bool dirty = false;
+
+  *to_swap = false;
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->owner->pagedir;
+
+      dirty = dirty || pagedir_is_dirty (pd, p->upage);
+      *to_swap = *to_swap || p->type == PAGE_SWAP;
+      p->frame = NULL;
+      pagedir_clear_page (pd, p->upage);
+    }
+  return dirty;
+}
+
+/* Undoes frame_unmap() on F, because its contents could not be
+   saved. */
+static void
+frame_remap (struct frame *f)
+{
+  bool sole = list_size (&f->pages) == 1;
+  struct list_elem *e;
+
+  /* Clearing a mapping keeps its dirty bit. */
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->owner->pagedir;
+      bool dirty = pagedir_is_dirty (pd, p->upage);
+
+      p->frame = f;
+      pagedir_set_page (pd, p->upage, f->kpage, p->writable && sole);
+      pagedir_set_dirty (pd, p->upage, dirty);
+    }
+}
+
+/* Records that every page held in F, just unmapped, is now in
+   swap slot SLOT. */
+static void
+frame_set_slot (struct frame *f, size_t slot)
+{
+  struct list_elem *e;
+
+  /* A frame holds fewer pages than a slot can count. */
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      if (e != list_begin (&f->pages))
+        swap_dup (slot);
+      p->type = PAGE_SWAP;
+      p->swap_slot = slot;
+    }
+}
+
+/* Writes F back to the file if P, held in F, is a modified
+   PAGE_MMAP page, and marks P clean.  P is marked clean first, so
+   that a store made while the write is under way marks it dirty
+   again instead of being lost. */
+static void
+frame_write_back (struct frame *f, struct page *p)
+{
+  uint32_t *pd = p->owner->pagedir;
+
+  if (p->type == PAGE_MMAP && pagedir_is_dirty (pd, p->upage))
+    {
+      pagedir_set_dirty (pd, p->upage, false);
+      file_write_at (p->file, f->kpage, p->read_bytes, p->ofs);
+    }
+}
+
+/* Records that the current process has just brought in a
+   writable page of a mapped file, which it may go on to modify.
+   Starts background write-back at MMAP_DIRTY_LOW such pages and
+   writes back modified pages itself at MMAP_DIRTY_HIGH, so that
+   writers cannot dirty memory faster than the disk takes it. */
+void
+frame_throttle_mmap (void)
+{
+  size_t cnt;
+
+  lock_acquire (&frame_lock);
+  cnt = ++mmap_dirty_cnt;
+  if (cnt >= MMAP_DIRTY_HIGH)
+    frame_clean_mmaps ();
+  lock_release (&frame_lock);
+
+  if (cnt >= MMAP_DIRTY_LOW && cnt < MMAP_DIRTY_HIGH)
+    work_queue (&mmap_flush_work, frame_write_behind, NULL);
+}
+
+/* Write-back work: runs frame_clean_mmaps(), then, for the
+   periodic pass, waits WRITE_BEHIND_MS to run again. */
+static void
+frame_write_behind (struct work *w, void *aux UNUSED)
+{
+  lock_acquire (&frame_lock);
+  frame_clean_mmaps ();
+  lock_release (&frame_lock);
+
+  if (w == &write_behind_work)
+    work_queue_delayed (w, WRITE_BEHIND_MS * TIMER_FREQ / 1000,
+                        frame_write_behind, NULL);
+}
+
+/* Writes every modified page of a mapped file that is resident
+   and unpinned back to its file.  A page cache frame may hold
+   such pages of several processes, each with its own dirty
+   bit. */
+static void
+frame_clean_mmaps (void)
+{
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  for (e = list_begin (&frame_list); e != list_end (&frame_list);
+       e = list_next (e))
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+      struct list_elem *pe;
+
+      if (f->pin_cnt > 0)
+        continue;
+      for (pe = list_begin (&f->pages); pe != list_end (&f->pages);
+           pe = list_next (pe))
+        {
+          struct page *p = list_entry (pe, struct page, frame_elem);
+          if (p->type == PAGE_MMAP && p->owner->pagedir != NULL)
+            frame_write_back (f, p);
+        }
+    }
+  mmap_dirty_cnt = 0;
+}
+
+/* Compaction.  Called by palloc_get_multiple() when the user pool
+   has PAGE_CNT free pages but not together, it frees the block
+   of the user pool that palloc_choose_run() picks by moving each
+   frame in it to a free page elsewhere and updating the page
+   table entries that point to it, which user code never sees.
+   Returns true if the block was freed.
+
+   Free pages inside the block that the search for new homes turns
+   up are held until the end, so that they are not handed out
+   again.  Both kinds of free page are chained through their first
+   word meanwhile. */
+static bool
+frame_compact (size_t page_cnt)
+{
+  struct bitmap *movable = bitmap_create (palloc_user_page_cnt ());
+  void *held = NULL, *homes = NULL;
+  uint8_t *start, *end;
+  size_t block_cnt, need, i;
+  struct list_elem *e;
+  bool success = false;
+
+  if (movable == NULL)
+    return false;
+
+  lock_acquire (&frame_lock);
+
+  /* Spare frames hold no page, so give them back first. */
+  while (!list_empty (&spare_frames))
+    {
+      struct frame *f = list_entry (list_pop_front (&spare_frames),
+                                    struct frame, elem);
+      palloc_free_page (f->kpage);
+      kmem_cache_free (frame_cache, f);
+    }
+
+  for (e = list_begin (&frame_list); e != list_end (&frame_list);
+       e = list_next (e))
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+      if (frame_movable (f))
+        bitmap_mark (movable, palloc_user_page_idx (f->kpage));
+    }
+  start = palloc_choose_run (page_cnt, movable, &block_cnt);
+  if (start == NULL)
+    goto done;
+  end = start + block_cnt * PGSIZE;
+
+  /* Find a new home for every frame in the block. */
+  need = 0;
+  for (e = list_begin (&frame_list); e != list_end (&frame_list);
+       e = list_next (e))
+    {
+      uint8_t *kpage = list_entry (e, struct frame, elem)->kpage;
+      if (kpage >= start && kpage < end)
+        need++;
+    }
+  for (i = 0; i < need; )
+    {
+      uint8_t *page = palloc_get_page (PAL_USER);
+
+      if (page == NULL)
+        goto done;
+      if (page >= start && page < end)
+        {
+          *(void **) page = held;
+          held = page;
+        }
+      else
+        {
+          *(void **) page = homes;
+          homes = page;
+          i++;
+        }
+    }
+
+  /* Move them.  If a frame's owner is handling a fault, the frame
+     stays put and the block is not freed. */
+  success = true;
+  for (e = list_begin (&frame_list); e != list_end (&frame_list);
+       e = list_next (e))
+    {
+      struct frame *f = list_entry (e, struct frame, elem);
+      uint8_t *old = f->kpage;
+      void *home = homes;
+
+      if (old < start || old >= end)
+        continue;
+      if (frame_move (f, home))
+        {
+          homes = *(void **) home;
+          palloc_free_page (old);
+        }
+      else
+        success = false;
+    }
+
+ done:
+  while (homes != NULL)
+    {
+      void *page = homes;
+      homes = *(void **) page;
+      palloc_free_page (page);
+    }
+  while (held != NULL)
+    {
+      void *page = held;
+      held = *(void **) page;
+      palloc_free_page (page);
+    }
+  lock_release (&frame_lock);
+  bitmap_destroy (movable);
+  return success;
+}
+
+/* Returns true if frame_move() may be able to move F: it holds
+   pages of processes that are still running, is not pinned, and
+   belongs neither to the page cache nor to a shared memory
+   segment. */
+static bool
+frame_movable (struct frame *f)
+{
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  if (f->pin_cnt > 0 || f->pcache != NULL || f->shm
+      || list_empty (&f->pages))
+    return false;
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    if (list_entry (e, struct page, frame_elem)->owner->pagedir == NULL)
+      return false;
+  return true;
+}
+
+/* Copies movable frame F to KPAGE, a free page of the user pool,
+   and points every page held in F there instead, keeping their
+   access rights and accessed and dirty bits.  F's owners are
+   kept from handling page faults meanwhile, so that a thread that
+   touches one of the pages while it is unmapped waits and then
+   finds it mapped again.  Returns false, changing nothing, if an
+   owner is handling a fault already. */
+static bool
+frame_move (struct frame *f, void *kpage)
+{
+  bool sole = list_size (&f->pages) == 1;
+  struct list_elem *e, *locked;
+
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  for (locked = list_begin (&f->pages); locked != list_end (&f->pages);
+       locked = list_next (locked))
+    {
+      struct lock *l = &list_entry (locked, struct page,
+                                    frame_elem)->owner->page_lock;
+      if (lock_held_by_current_thread (l) || !lock_try_acquire (l))
+        break;
+    }
+  if (locked != list_end (&f->pages))
+    {
+      for (e = list_begin (&f->pages); e != locked; e = list_next (e))
+        lock_release (&list_entry (e, struct page,
+                                   frame_elem)->owner->page_lock);
+      return false;
+    }
+
+  /* Unmap every page before copying, so that no store is lost.
+     Clearing a mapping keeps its accessed and dirty bits. */
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      pagedir_clear_page (p->owner->pagedir, p->upage);
+    }
+  memcpy (kpage, f->kpage, PGSIZE);
+  for (e = list_begin (&f->pages); e != list_end (&f->pages);
+       e = list_next (e))
+    {
+      struct page *p = list_entry (e, struct page, frame_elem);
+      uint32_t *pd = p->owner->pagedir;
+      bool dirty = pagedir_is_dirty (pd, p->upage);
+      bool accessed = pagedir_is_accessed (pd, p->upage);
+      bool mapped;
+
+      mapped = pagedir_set_page (pd, p->upage, kpage, p->writable && sole);
+      ASSERT (mapped);
+      pagedir_set_dirty (pd, p->upage, dirty);
+      pagedir_set_accessed (pd, p->upage, accessed);
+      lock_release (&p->owner->page_lock);
+    }
+  f->kpage = kpage;
+  return true;
+}
+
+/* Records that F holds page P. */
+static void
+frame_attach (struct frame *f, struct page *p)
+{
+  ASSERT (lock_held_by_current_thread (&frame_lock));
+
+  list_push_back (&f->pages, &p->frame_elem);
+  p->frame = f;
+}
+
+/* Advances clock hand E by one frame, wrapping around. */
+static struct list_elem *
+clock_next (struct list_elem *e)
+{
+  if (e == list_end (&frame_list) || list_next (e) == list_end (&frame_list))
+    return list_begin (&frame_list);
+  return list_next (e);
+}
+
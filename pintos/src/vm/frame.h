@@ -0,0 +1,60 @@
+#ifndef VM_FRAME_H
+#define VM_FRAME_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+#include "threads/palloc.h"
+
+struct page;
+struct pcache_page;
+
+/* Page replacement policies, chosen with the "-evict" option. */
+enum evict_policy
+  {
+    EVICT_CLOCK,                /* Second-chance clock (default). */
+    EVICT_AGING                 /* Aging counters, clean pages first. */
+  };
+
+extern enum evict_policy frame_evict_policy;
+
+/* A frame of physical memory.
+
+   A frame normally holds one page of one process, in memory from
+   the user pool.  A page cache frame instead maps a page of file
+   data held by filesys/pcache.c: a read-only executable page or
+   a page of a mapped file, mapped by every process that maps the
+   same page of that file.  It is found through the page cache
+   page's FRAME member, is never evicted, and goes back to the
+   page cache when its last page lets go.  A shared memory frame
+   belongs to a segment in vm/shm.c, stays pinned for the
+   segment's lifetime and may hold any number of writable pages,
+   including none. */
+struct frame
+  {
+    void *kpage;                /* Kernel virtual address of frame. */
+    struct list pages;          /* Pages held here, via frame_elem. */
+    unsigned pin_cnt;           /* Exempt from eviction while nonzero. */
+    uint8_t age;                /* Aging counter, for EVICT_AGING. */
+    struct list_elem elem;      /* Element in frame list. */
+
+    struct pcache_page *pcache; /* Page cache page mapped, or null. */
+    bool shm;                   /* Owned by a shared memory segment? */
+  };
+
+void frame_init (void);
+struct frame *frame_alloc (enum palloc_flags, struct page *);
+struct frame *frame_alloc_free (struct page *);
+struct frame *frame_share (struct page *, bool fill);
+struct frame *frame_alloc_shm (void);
+void frame_add_page (struct frame *, struct page *);
+void frame_free_shm (struct frame *);
+void frame_free (struct page *);
+bool frame_pin (struct page *, bool write);
+bool frame_copy_on_write (struct page *);
+bool frame_fork (struct page *parent, struct page *child);
+void frame_unpin (struct frame *);
+void frame_throttle_mmap (void);
+
+#endif /* vm/frame.h */
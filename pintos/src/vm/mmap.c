@@ -0,0 +1,141 @@
+#include "vm/mmap.h"
+#include <debug.h>
+#include <kdata.h>
+#include <round.h>
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/page.h"
+
+static struct mmap *mmap_find (mapid_t);
+static void mmap_release (struct mmap *);
+
+/* Maps FILE into the current process's address space starting at
+   ADDR.  The pages are read in lazily on first access, and the
+   mapping keeps working even if the caller later closes FILE.
+   Returns the new mapping's identifier, or MAP_FAILED if FILE is
+   empty, ADDR is null or misaligned, or any page of the range is
+   already in use. */
+mapid_t
+mmap_map (struct file *file, void *addr)
+{
+  struct process *p = thread_current ()->process;
+  struct mmap *m;
+  off_t length;
+  size_t page_cnt, i;
+
+  if (file == NULL || addr == NULL || pg_ofs (addr) != 0)
+    return MAP_FAILED;
+  length = file_length (file);
+  if (length == 0
+      || (uint8_t *) addr + ROUND_UP (length, PGSIZE) > (uint8_t *) PHYS_BASE
+      || (uint8_t *) addr + ROUND_UP (length, PGSIZE) < (uint8_t *) addr)
+    return MAP_FAILED;
+
+  /* Must not cover the kernel data page. */
+  if ((const void *) KDATA_ADDR >= addr
+      && (uint8_t *) KDATA_ADDR - (uint8_t *) addr < length)
+    return MAP_FAILED;
+
+  m = malloc (sizeof *m);
+  if (m == NULL)
+    return MAP_FAILED;
+  m->file = file_reopen (file);
+  if (m->file == NULL)
+    {
+      free (m);
+      return MAP_FAILED;
+    }
+  m->addr = addr;
+  m->page_cnt = 0;
+  page_cnt = DIV_ROUND_UP ((size_t) length, PGSIZE);
+
+  /* Record one page at a time; a collision with an existing page
+     undoes the ones added so far. */
+  lock_acquire (&p->page_lock);
+  for (i = 0; i < page_cnt; i++)
+    {
+      off_t ofs = i * PGSIZE;
+      uint32_t read_bytes = length - ofs < PGSIZE ? length - ofs : PGSIZE;
+
+      if (!page_add_mmap ((uint8_t *) addr + ofs, m->file, ofs, read_bytes))
+        {
+          mmap_release (m);
+          lock_release (&p->page_lock);
+          return MAP_FAILED;
+        }
+      m->page_cnt++;
+    }
+
+  m->mapid = p->next_mapid++;
+  list_push_back (&p->mmaps, &m->elem);
+  lock_release (&p->page_lock);
+  return m->mapid;
+}
+
+/* Unmaps MAPID, writing its modified pages back to the file.
+   Does nothing if MAPID is not a mapping of the current
+   process. */
+void
+mmap_unmap (mapid_t mapid)
+{
+  struct lock *page_lock = &thread_current ()->process->page_lock;
+  struct mmap *m;
+
+  lock_acquire (page_lock);
+  m = mmap_find (mapid);
+  if (m != NULL)
+    {
+      list_remove (&m->elem);
+      mmap_release (m);
+    }
+  lock_release (page_lock);
+}
+
+/* Unmaps all of the current process's mappings, as on exit by
+   its last thread. */
+void
+mmap_unmap_all (void)
+{
+  struct list *mmaps = &thread_current ()->process->mmaps;
+
+  while (!list_empty (mmaps))
+    mmap_release (list_entry (list_pop_front (mmaps), struct mmap, elem));
+}
+
+/* Returns the current process's mapping with id MAPID, or a null
+   pointer. */
+static struct mmap *
+mmap_find (mapid_t mapid)
+{
+  struct list *mmaps = &thread_current ()->process->mmaps;
+  struct list_elem *e;
+
+  for (e = list_begin (mmaps); e != list_end (mmaps); e = list_next (e))
+    {
+      struct mmap *m = list_entry (e, struct mmap, elem);
+      if (m->mapid == mapid)
+        return m;
+    }
+  return NULL;
+}
+
+/* Removes M's pages, writing dirty ones back, then closes its
+   file and frees it.  M must not be in any list. */
+static void
+mmap_release (struct mmap *m)
+{
+  size_t i;
+
+  /* Unmap the whole range at once, with one TLB flush, rather
+     than page by page.  Clearing a mapping keeps its dirty bit,
+     so page_remove() still writes modified pages back. */
+  pagedir_unmap_range (thread_current ()->pagedir, m->addr, m->page_cnt);
+  for (i = 0; i < m->page_cnt; i++)
+    page_remove (page_lookup ((uint8_t *) m->addr + i * PGSIZE));
+  file_close (m->file);
+  free (m);
+}
@@ -0,0 +1,595 @@
+#include "vm/page.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <string.h>
+#include "filesys/file.h"
+#include "threads/palloc.h"
+#include "threads/slab.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+#include "vm/frame.h"
+#include "vm/swap.h"
+
+/* Number of pages, aligned to a multiple of itself, around a
+   faulting page that page_fault_in() tries to map in one go. */
+#define FAULT_AROUND_PAGES 16
+
+/* Default stack limit: 8 MB. */
+size_t page_stack_limit = 8 * 1024 * 1024;
+
+/* Page of zeros mapped read-only in place of every PAGE_ZERO page
+   that has been read but never written. */
+static void *zero_kpage;
+
+/* Cache of supplemental page table entries. */
+static struct kmem_cache *page_cache;
+
+static hash_hash_func page_hash;
+static hash_less_func page_less;
+static hash_action_func page_free;
+static struct page *page_create (void *upage, bool writable);
+static bool page_cacheable (const struct page *);
+static bool page_map_shared (struct page *, bool fill);
+static void page_fault_around (struct page *);
+static void page_swap_in (struct page *, void *kpage);
+static void unpin_pages (const uint8_t *start, const uint8_t *end);
+
+/* Initializes the supplemental page table module. */
+void
+page_init (void)
+{
+  zero_kpage = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+  page_cache = kmem_cache_create ("page", sizeof (struct page), NULL);
+}
+
+/* Initializes PAGES as an empty supplemental page table. */
+void
+page_table_init (struct ohash *pages)
+{
+  ohash_init (pages, page_hash, page_less, NULL);
+}
+
+/* Frees every entry in PAGES, along with the frames of those
+   that are resident.  Must be called before the owning page
+   directory is destroyed. */
+void
+page_table_destroy (struct ohash *pages)
+{
+  ohash_destroy (pages, page_free);
+}
+
+/* Returns the current process's supplemental page table entry
+   for the page containing UADDR, or a null pointer if UADDR is
+   not part of its address space. */
+struct page *
+page_lookup (const void *uaddr)
+{
+  struct page p;
+  struct hash_elem *e;
+
+  p.upage = pg_round_down (uaddr);
+  e = ohash_find (&thread_current ()->process->pages, &p.elem);
+  return e != NULL ? hash_entry (e, struct page, elem) : NULL;
+}
+
+/* Records that UPAGE is to be filled with READ_BYTES bytes read
+   from FILE starting at OFS, followed by ZERO_BYTES zeros.
+   Nothing is read until the page is first touched.  Returns
+   false if UPAGE is already in use or memory is exhausted. */
+bool
+page_add_file (void *upage, struct file *file, off_t ofs,
+               uint32_t read_bytes, uint32_t zero_bytes, bool writable)
+{
+  struct page *p;
+
+  ASSERT (read_bytes + zero_bytes == PGSIZE);
+
+  p = page_create (upage, writable);
+  if (p == NULL)
+    return false;
+  p->type = PAGE_FILE;
+  p->file = file;
+  p->ofs = ofs;
+  p->read_bytes = read_bytes;
+  p->zero_bytes = zero_bytes;
+  return true;
+}
+
+/* Records that UPAGE is to be filled with zeros when it is
+   first touched.  Returns false if UPAGE is already in use or
+   memory is exhausted. */
+bool
+page_add_zero (void *upage, bool writable)
+{
+  struct page *p = page_create (upage, writable);
+  if (p == NULL)
+    return false;
+  p->type = PAGE_ZERO;
+  return true;
+}
+
+/* Records that UPAGE maps READ_BYTES bytes of FILE starting at
+   OFS, with the rest of the page zero.  The page is writable; if
+   modified, it is written back to FILE rather than to swap.
+   Returns false if UPAGE is already in use or memory is
+   exhausted. */
+bool
+page_add_mmap (void *upage, struct file *file, off_t ofs,
+               uint32_t read_bytes)
+{
+  if (!page_add_file (upage, file, ofs, read_bytes, PGSIZE - read_bytes,
+                      true))
+    return false;
+  page_lookup (upage)->type = PAGE_MMAP;
+  return true;
+}
+
+/* Maps UPAGE, writable, to shared memory frame F, which stays
+   resident as long as its segment exists, so that the page never
+   faults.  Returns false if UPAGE is already in use or memory is
+   exhausted. */
+bool
+page_add_shm (void *upage, struct frame *f)
+{
+  struct page *p = page_create (upage, true);
+
+  if (p == NULL)
+    return false;
+  p->type = PAGE_SHM;
+  frame_add_page (f, p);
+  if (!pagedir_set_page (thread_current ()->pagedir, upage, f->kpage, true))
+    {
+      page_remove (p);
+      return false;
+    }
+  return true;
+}
+
+/* Removes P from the current process's address space, writing it
+   back first if it is a modified mapped-file page, and frees
+   it. */
+void
+page_remove (struct page *p)
+{
+  ohash_delete (&thread_current ()->process->pages, &p->elem);
+  page_free (&p->elem, NULL);
+}
+
+/* Resolves a page fault on P, a page of the current process.  A
+   read of a PAGE_ZERO page that was never written maps the shared
+   zero page read-only; a later write replaces it with a private
+   zeroed frame.  A write to a page that still shares its frame
+   with another process after fork() takes a private copy.  Any
+   other not-present fault loads P.  Returns
+   false if the access is not allowed, so the process must be
+   killed, or if P could not be loaded. */
+bool
+page_fault_in (struct page *p, bool not_present, bool write)
+{
+  struct thread *t = thread_current ();
+
+  if (write && !p->writable)
+    return false;
+
+  if (p->zero_mapped)
+    {
+      /* Copy on write.  There is nothing to copy: the new
+         private frame is simply zeroed. */
+      if (!write)
+        return false;
+      pagedir_clear_page (t->pagedir, p->upage);
+      p->zero_mapped = false;
+      return page_load (p);
+    }
+  /* A write to a resident page mapped read-only means that it
+     still shares its frame with another process after fork(). */
+  if (write && p->frame != NULL)
+    return frame_copy_on_write (p);
+  if (!not_present || p->frame != NULL)
+    return false;
+
+  if (p->type == PAGE_ZERO && !write)
+    {
+      if (!pagedir_set_page (t->pagedir, p->upage, zero_kpage, false))
+        return false;
+      p->zero_mapped = true;
+      return true;
+    }
+  if (!page_load (p))
+    return false;
+  if (p->type == PAGE_FILE && page_cacheable (p))
+    page_fault_around (p);
+  return true;
+}
+
+/* Maps the read-only executable neighbours of P, within its
+   FAULT_AROUND_PAGES-aligned window, whose contents another
+   process already maps from the page cache.  This costs no I/O
+   and saves a fault per page when a program's text is executed
+   or scanned sequentially. */
+static void
+page_fault_around (struct page *p)
+{
+  uint8_t *start = (uint8_t *) ((uintptr_t) p->upage
+                                & ~(FAULT_AROUND_PAGES * PGSIZE - 1));
+  int i;
+
+  for (i = 0; i < FAULT_AROUND_PAGES; i++)
+    {
+      struct page *q = page_lookup (start + i * PGSIZE);
+      if (q != NULL && q != p && q->frame == NULL && q->type == PAGE_FILE
+          && page_cacheable (q))
+        page_map_shared (q, false);
+    }
+}
+
+/* Maps P to the page cache frame for its contents, as found by
+   frame_share() with FILL, and returns true.  Returns false if
+   there is none or if mapping fails. */
+static bool
+page_map_shared (struct page *p, bool fill)
+{
+  struct frame *f = frame_share (p, fill);
+
+  if (f == NULL)
+    return false;
+  if (!pagedir_set_page (thread_current ()->pagedir, p->upage, f->kpage,
+                         p->writable))
+    {
+      frame_unpin (f);
+      frame_free (p);
+      return false;
+    }
+  frame_unpin (f);
+  return true;
+}
+
+/* Brings P into memory from its backing store and maps it into
+   the current process's page directory.  Returns true if
+   successful, false if no frame is available or the backing
+   store could not be read. */
+bool
+page_load (struct page *p)
+{
+  struct thread *t = thread_current ();
+  struct frame *f;
+  uint8_t *kpage;
+
+  ASSERT (p->frame == NULL);
+
+  /* File pages that every process sees alike come straight from
+     the page cache, where another process may have them
+     already. */
+  if (page_cacheable (p) && page_map_shared (p, true))
+    {
+      if (p->type == PAGE_MMAP && p->writable)
+        frame_throttle_mmap ();
+      return true;
+    }
+
+  /* Zero pages come from palloc's pre-zeroed pages when it has
+     some. */
+  f = frame_alloc (p->type == PAGE_ZERO ? PAL_USER | PAL_ZERO : PAL_USER, p);
+  if (f == NULL)
+    return false;
+  kpage = f->kpage;
+
+  switch (p->type)
+    {
+    case PAGE_FILE:
+    case PAGE_MMAP:
+      if (file_read_at (p->file, kpage, p->read_bytes, p->ofs)
+          != (int) p->read_bytes)
+        {
+          frame_free (p);
+          return false;
+        }
+      memset (kpage + p->read_bytes, 0, p->zero_bytes);
+      break;
+
+    case PAGE_ZERO:
+      break;
+
+    case PAGE_SWAP:
+      page_swap_in (p, kpage);
+      break;
+
+    default:
+      NOT_REACHED ();
+    }
+
+  if (!pagedir_set_page (t->pagedir, p->upage, kpage, p->writable))
+    {
+      frame_free (p);
+      return false;
+    }
+  frame_unpin (f);
+  if (p->type == PAGE_MMAP && p->writable)
+    frame_throttle_mmap ();
+  return true;
+}
+
+/* Reads P back from swap into KPAGE, along with the pages of the
+   current process right after P, up to SWAP_CLUSTER in all, that
+   are in the swap slots right after P's, as frame_page_out()
+   leaves runs of pages evicted together.  A neighbour is read
+   only if a free frame is at hand, so reading ahead never evicts
+   anything, and is mapped at once, saving it a fault. */
+static void
+page_swap_in (struct page *p, void *kpage)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  struct page *pages[SWAP_CLUSTER];
+  struct frame *frames[SWAP_CLUSTER];
+  void *kpages[SWAP_CLUSTER];
+  size_t cnt, i;
+
+  kpages[0] = kpage;
+  for (cnt = 1; cnt < SWAP_CLUSTER; cnt++)
+    {
+      struct page *q = page_lookup ((uint8_t *) p->upage + cnt * PGSIZE);
+
+      if (q == NULL || q->type != PAGE_SWAP || q->frame != NULL
+          || q->swap_slot != p->swap_slot + cnt)
+        break;
+      frames[cnt] = frame_alloc_free (q);
+      if (frames[cnt] == NULL)
+        break;
+      pages[cnt] = q;
+      kpages[cnt] = frames[cnt]->kpage;
+    }
+  swap_read_cluster (p->swap_slot, kpages, cnt);
+
+  /* A neighbour that cannot be mapped keeps its slot. */
+  for (i = 1; i < cnt; i++)
+    {
+      struct page *q = pages[i];
+
+      if (pagedir_set_page (pd, q->upage, kpages[i], q->writable))
+        {
+          swap_free (q->swap_slot);
+          q->swap_slot = BITMAP_ERROR;
+          frame_unpin (frames[i]);
+        }
+      else
+        frame_free (q);
+    }
+
+  swap_free (p->swap_slot);
+  p->swap_slot = BITMAP_ERROR;
+  p->zero_mapped = false;
+}
+
+/* Copies the supplemental page table of PARENT, whose PAGE_LOCK
+   the caller must hold, into the current process, which fork()
+   is creating and whose page directory has no user pages yet.
+   Resident pages share their frames, copy-on-write if writable;
+   the others are read in later from the same backing store as in
+   PARENT.  Memory-mapped files are not inherited, and shared
+   memory segments are left to shm_fork().  Returns false if
+   memory is exhausted. */
+bool
+page_table_fork (struct process *parent)
+{
+  struct process *child = thread_current ()->process;
+  struct ohash_iterator i;
+
+  ASSERT (lock_held_by_current_thread (&parent->page_lock));
+
+  ohash_first (&i, &parent->pages);
+  while (ohash_next (&i))
+    {
+      struct page *q = hash_entry (ohash_cur (&i), struct page, elem);
+      struct page *c;
+
+      if (q->type == PAGE_MMAP || q->type == PAGE_SHM)
+        continue;
+      c = page_create (q->upage, q->writable);
+      if (c == NULL)
+        return false;
+      c->type = q->type;
+      c->file = q->file == parent->exec_file ? child->exec_file : q->file;
+      c->ofs = q->ofs;
+      c->read_bytes = q->read_bytes;
+      c->zero_bytes = q->zero_bytes;
+      if (q->zero_mapped)
+        {
+          if (!pagedir_set_page (child->pagedir, c->upage, zero_kpage,
+                                 false))
+            return false;
+          c->zero_mapped = true;
+        }
+      else if (!frame_fork (q, c))
+        return false;
+    }
+  return true;
+}
+
+/* Handles a fault on UADDR, which is not part of the current
+   process's address space, as a stack access if it could be one:
+   UADDR must lie within page_stack_limit bytes of PHYS_BASE and
+   no more than 32 bytes below ESP, the most that PUSHA touches
+   ahead of moving the stack pointer.  If so, adds a zeroed page
+   and brings it in.  Returns true if the stack was grown. */
+bool
+page_grow_stack (void *uaddr, void *esp)
+{
+  void *upage = pg_round_down (uaddr);
+
+  if (!is_user_vaddr (uaddr)
+      || (uint8_t *) uaddr < (uint8_t *) PHYS_BASE - page_stack_limit
+      || (uint8_t *) uaddr < (uint8_t *) esp - 32)
+    return false;
+
+  if (!page_add_zero (upage, true))
+    return false;
+  return page_load (page_lookup (upage));
+}
+
+/* Brings every page of the SIZE bytes at UADDR into memory and
+   pins them, so that the kernel can access the range without
+   faulting, for instance while it holds file system locks.  If
+   WRITE is true, the range must be writable.  Returns false,
+   with nothing pinned, if some page is not part of the current
+   process's address space or cannot be brought in. */
+bool
+page_pin_range (const void *uaddr, size_t size, bool write)
+{
+  struct lock *page_lock = &thread_current ()->process->page_lock;
+  const uint8_t *start = pg_round_down (uaddr);
+  const uint8_t *end = (const uint8_t *) uaddr + size;
+  const uint8_t *upage;
+
+  if (end < start || end > (const uint8_t *) PHYS_BASE)
+    return false;
+
+  lock_acquire (page_lock);
+  for (upage = start; upage < end; upage += PGSIZE)
+    {
+      struct page *p = page_lookup (upage);
+
+      if (p == NULL)
+        {
+          if (!page_grow_stack ((void *) upage, thread_current ()->user_esp))
+            goto fail;
+          p = page_lookup (upage);
+        }
+      if (write && !p->writable)
+        goto fail;
+
+      /* Reads of a never-written zero page need no frame. */
+      if (!write && p->type == PAGE_ZERO && p->frame == NULL)
+        {
+          if (!p->zero_mapped && !page_fault_in (p, true, false))
+            goto fail;
+          continue;
+        }
+
+      /* Retry if the page is evicted before it can be pinned. */
+      while (!frame_pin (p, write))
+        if (!page_fault_in (p, !p->zero_mapped, write))
+          goto fail;
+    }
+  lock_release (page_lock);
+  return true;
+
+ fail:
+  unpin_pages (start, upage);
+  lock_release (page_lock);
+  return false;
+}
+
+/* Unpins the pages of the SIZE bytes at UADDR, which must have
+   been pinned with page_pin_range(). */
+void
+page_unpin_range (const void *uaddr, size_t size)
+{
+  struct lock *page_lock = &thread_current ()->process->page_lock;
+
+  lock_acquire (page_lock);
+  unpin_pages (pg_round_down (uaddr), (const uint8_t *) uaddr + size);
+  lock_release (page_lock);
+}
+
+/* Unpins the pinned pages from START, which is page-aligned, up
+   to END. */
+static void
+unpin_pages (const uint8_t *start, const uint8_t *end)
+{
+  const uint8_t *upage;
+
+  for (upage = start; upage < end; upage += PGSIZE)
+    {
+      struct page *p = page_lookup (upage);
+      if (p != NULL && p->frame != NULL)
+        frame_unpin (p->frame);
+    }
+}
+
+/* Allocates a new entry for UPAGE and inserts it into the
+   current process's table.  Returns a null pointer if UPAGE is
+   already present or memory is exhausted. */
+static struct page *
+page_create (void *upage, bool writable)
+{
+  struct page *p;
+
+  ASSERT (pg_ofs (upage) == 0);
+
+  p = kmem_cache_alloc (page_cache);
+  if (p == NULL)
+    return NULL;
+  p->upage = upage;
+  p->owner = thread_current ()->process;
+  p->frame = NULL;
+  p->writable = writable;
+  p->file = NULL;
+  p->ofs = 0;
+  p->read_bytes = 0;
+  p->zero_bytes = PGSIZE;
+  p->zero_mapped = false;
+  p->swap_slot = BITMAP_ERROR;
+  if (ohash_insert (&thread_current ()->process->pages, &p->elem) != NULL)
+    {
+      kmem_cache_free (page_cache, p);
+      return NULL;
+    }
+  return p;
+}
+
+/* Returns true if P may be mapped straight from the page cache,
+   sharing the frame with every other process that maps the same
+   page of the same file: a full, read-only page of an
+   executable, which cannot change while the executable runs, or
+   a page of a mapped file, whose changes every mapping and every
+   reader of the file is meant to see.  In either case, the page
+   holds nothing but file data, zero past end of file. */
+static bool
+page_cacheable (const struct page *p)
+{
+  if (p->ofs % PGSIZE != 0)
+    return false;
+  return ((p->type == PAGE_FILE && !p->writable
+           && p->read_bytes == PGSIZE)
+          || p->type == PAGE_MMAP);
+}
+
+/* Returns a hash value for page E. */
+static unsigned
+page_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct page *p = hash_entry (e, struct page, elem);
+  return hash_ptr (p->upage);
+}
+
+/* Returns true if page A precedes page B. */
+static bool
+page_less (const struct hash_elem *a_, const struct hash_elem *b_,
+           void *aux UNUSED)
+{
+  const struct page *a = hash_entry (a_, struct page, elem);
+  const struct page *b = hash_entry (b_, struct page, elem);
+  return a->upage < b->upage;
+}
+
+/* Frees page E and its frame or swap slot, if any. */
+static void
+page_free (struct hash_elem *e, void *aux UNUSED)
+{
+  struct page *p = hash_entry (e, struct page, elem);
+
+  /* The zero page must not be freed along with the page
+     directory. */
+  if (p->zero_mapped)
+    pagedir_clear_page (p->owner->pagedir, p->upage);
+
+  /* Free the frame first: an eviction in progress finishes
+     before frame_free() returns and may leave a swap slot.
+     frame_free() also writes back modified PAGE_MMAP pages. */
+  frame_free (p);
+  if (p->swap_slot != BITMAP_ERROR)
+    swap_free (p->swap_slot);
+  kmem_cache_free (page_cache, p);
+}
@@ -0,0 +1,72 @@
+#ifndef VM_PAGE_H
+#define VM_PAGE_H
+
+#include <ohash.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "filesys/off_t.h"
+
+struct frame;
+struct process;
+
+/* Where the contents of a non-resident user page come from. */
+enum page_type
+  {
+    PAGE_FILE,          /* Read from a file, zero-fill the rest. */
+    PAGE_ZERO,          /* All zeros. */
+    PAGE_SWAP,          /* Modified; lives in swap when evicted. */
+    PAGE_MMAP,          /* Mapped file; written back when evicted. */
+    PAGE_SHM            /* Shared memory segment; never evicted. */
+  };
+
+/* Supplemental page table entry.  One exists for every page of
+   user virtual memory a process may legitimately touch, whether
+   or not it is currently mapped in the page directory. */
+struct page
+  {
+    void *upage;                /* User virtual address (page aligned). */
+    struct process *owner;      /* Process whose page this is. */
+    struct frame *frame;        /* Frame holding the page, or NULL. */
+    struct list_elem frame_elem; /* Element in frame's `pages'. */
+    bool writable;              /* May the process write to the page? */
+    enum page_type type;        /* Backing store. */
+
+    /* PAGE_FILE and PAGE_MMAP backing. */
+    struct file *file;          /* File to read from. */
+    off_t ofs;                  /* Offset in FILE. */
+    uint32_t read_bytes;        /* Bytes to read from FILE. */
+    uint32_t zero_bytes;        /* Bytes to zero after READ_BYTES. */
+
+    /* PAGE_ZERO pages not yet written. */
+    bool zero_mapped;           /* Mapped read-only to the zero page? */
+
+    /* PAGE_SWAP backing. */
+    size_t swap_slot;           /* Swap slot, or BITMAP_ERROR if none. */
+
+    struct hash_elem elem;      /* Element in process's `pages'. */
+  };
+
+/* Maximum size of a user stack in bytes.  Controlled by kernel
+   command-line option "-stack=KB". */
+extern size_t page_stack_limit;
+
+void page_init (void);
+void page_table_init (struct ohash *);
+void page_table_destroy (struct ohash *);
+
+struct page *page_lookup (const void *uaddr);
+bool page_add_file (void *upage, struct file *, off_t ofs,
+                    uint32_t read_bytes, uint32_t zero_bytes, bool writable);
+bool page_add_zero (void *upage, bool writable);
+bool page_add_mmap (void *upage, struct file *, off_t ofs,
+                    uint32_t read_bytes);
+bool page_add_shm (void *upage, struct frame *);
+void page_remove (struct page *);
+bool page_load (struct page *);
+bool page_fault_in (struct page *, bool not_present, bool write);
+bool page_table_fork (struct process *parent);
+bool page_grow_stack (void *uaddr, void *esp);
+bool page_pin_range (const void *uaddr, size_t size, bool write);
+void page_unpin_range (const void *uaddr, size_t size);
+
+#endif /* vm/page.h */
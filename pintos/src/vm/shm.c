@@ -0,0 +1,295 @@
+#include "vm/shm.h"
+#include <debug.h>
+#include <kdata.h>
+#include <list.h>
+#include <round.h>
+#include <stdint.h>
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/process.h"
+#include "vm/frame.h"
+#include "vm/page.h"
+
+/* A shared memory segment: zeroed frames that any process may
+   map by the segment's id, so that processes can exchange data
+   without copying it through the kernel.  Every mapping of a
+   segment, in any process, uses the same frames, which are
+   pinned and never evicted.  The segment lasts until the last
+   process that created or mapped it exits. */
+struct shm
+  {
+    int id;                     /* Identifier returned to processes. */
+    size_t page_cnt;            /* Number of pages. */
+    struct frame **frames;      /* PAGE_CNT frames. */
+    int ref_cnt;                /* Attachments, protected by SHM_LOCK. */
+    struct list_elem elem;      /* Element in `segments'. */
+  };
+
+/* A process's hold on a segment, from creating it or from one
+   mapping of it. */
+struct shm_attach
+  {
+    struct shm *shm;            /* Segment. */
+    void *addr;                 /* First mapped page, or NULL. */
+    struct list_elem elem;      /* Element in process's `shms'. */
+  };
+
+/* All segments, and the next id to hand out, protected by
+   SHM_LOCK. */
+static struct list segments;
+static struct lock shm_lock;
+static int next_id;
+
+static struct shm *shm_find (int id);
+static bool shm_range_ok (const void *addr, size_t size);
+static void shm_release (struct shm *);
+static void shm_free (struct shm *);
+static void unmap_pages (uint8_t *addr, size_t page_cnt);
+
+/* Initializes the shared memory module. */
+void
+shm_init (void)
+{
+  list_init (&segments);
+  lock_init (&shm_lock);
+}
+
+/* Creates a segment of SIZE bytes, rounded up to whole pages and
+   initially zero, that the current process holds until it exits.
+   Returns the segment's id, for passing to shm_map_segment(), or
+   -1 if SIZE is 0 or more than SHM_MAX_SIZE or memory is
+   exhausted. */
+int
+shm_create_segment (size_t size)
+{
+  struct process *proc = thread_current ()->process;
+  struct shm *s;
+  struct shm_attach *a;
+  size_t i;
+
+  if (size == 0 || size > SHM_MAX_SIZE)
+    return -1;
+
+  s = malloc (sizeof *s);
+  a = malloc (sizeof *a);
+  if (s == NULL || a == NULL)
+    goto fail_struct;
+  s->page_cnt = DIV_ROUND_UP (size, PGSIZE);
+  s->frames = calloc (s->page_cnt, sizeof *s->frames);
+  if (s->frames == NULL)
+    goto fail_struct;
+  for (i = 0; i < s->page_cnt; i++)
+    {
+      s->frames[i] = frame_alloc_shm ();
+      if (s->frames[i] == NULL)
+        {
+          shm_free (s);
+          free (a);
+          return -1;
+        }
+    }
+  s->ref_cnt = 1;
+  a->shm = s;
+  a->addr = NULL;
+
+  lock_acquire (&shm_lock);
+  s->id = next_id++;
+  list_push_back (&segments, &s->elem);
+  lock_release (&shm_lock);
+
+  lock_acquire (&proc->page_lock);
+  list_push_back (&proc->shms, &a->elem);
+  lock_release (&proc->page_lock);
+  return s->id;
+
+ fail_struct:
+  free (s);
+  free (a);
+  return -1;
+}
+
+/* Maps segment ID into the current process's address space,
+   writable, starting at ADDR.  Returns false if there is no such
+   segment, ADDR is null or misaligned, or any page of the range
+   is already in use. */
+bool
+shm_map_segment (int id, void *addr)
+{
+  struct process *proc = thread_current ()->process;
+  struct shm *s;
+  struct shm_attach *a;
+  size_t i;
+
+  if (addr == NULL || pg_ofs (addr) != 0)
+    return false;
+  a = malloc (sizeof *a);
+  if (a == NULL)
+    return false;
+
+  lock_acquire (&shm_lock);
+  s = shm_find (id);
+  if (s != NULL && shm_range_ok (addr, s->page_cnt * PGSIZE))
+    s->ref_cnt++;
+  else
+    s = NULL;
+  lock_release (&shm_lock);
+  if (s == NULL)
+    {
+      free (a);
+      return false;
+    }
+
+  /* A collision with an existing page undoes the pages mapped so
+     far. */
+  lock_acquire (&proc->page_lock);
+  for (i = 0; i < s->page_cnt; i++)
+    if (!page_add_shm ((uint8_t *) addr + i * PGSIZE, s->frames[i]))
+      {
+        unmap_pages (addr, i);
+        lock_release (&proc->page_lock);
+        shm_release (s);
+        free (a);
+        return false;
+      }
+  a->shm = s;
+  a->addr = addr;
+  list_push_back (&proc->shms, &a->elem);
+  lock_release (&proc->page_lock);
+  return true;
+}
+
+/* Gives the current process, which fork() is creating, a hold on
+   each of PARENT's segments, mapped at the same addresses as in
+   PARENT.  The caller must hold PARENT's PAGE_LOCK.  Returns
+   false if memory is exhausted; shm_detach_all() then releases
+   what was taken. */
+bool
+shm_fork (struct process *parent)
+{
+  struct process *proc = thread_current ()->process;
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&parent->page_lock));
+
+  for (e = list_begin (&parent->shms); e != list_end (&parent->shms);
+       e = list_next (e))
+    {
+      struct shm_attach *pa = list_entry (e, struct shm_attach, elem);
+      struct shm_attach *a = malloc (sizeof *a);
+      size_t i;
+
+      if (a == NULL)
+        return false;
+      lock_acquire (&shm_lock);
+      pa->shm->ref_cnt++;
+      lock_release (&shm_lock);
+      a->shm = pa->shm;
+      a->addr = NULL;
+      list_push_back (&proc->shms, &a->elem);
+
+      if (pa->addr != NULL)
+        {
+          for (i = 0; i < pa->shm->page_cnt; i++)
+            if (!page_add_shm ((uint8_t *) pa->addr + i * PGSIZE,
+                               pa->shm->frames[i]))
+              {
+                unmap_pages (pa->addr, i);
+                return false;
+              }
+          a->addr = pa->addr;
+        }
+    }
+  return true;
+}
+
+/* Unmaps and releases all of the current process's segments, as
+   on exit by its last thread. */
+void
+shm_detach_all (void)
+{
+  struct list *shms = &thread_current ()->process->shms;
+
+  while (!list_empty (shms))
+    {
+      struct shm_attach *a = list_entry (list_pop_front (shms),
+                                         struct shm_attach, elem);
+      if (a->addr != NULL)
+        unmap_pages (a->addr, a->shm->page_cnt);
+      shm_release (a->shm);
+      free (a);
+    }
+}
+
+/* Returns the segment with id ID, or a null pointer. */
+static struct shm *
+shm_find (int id)
+{
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&shm_lock));
+
+  for (e = list_begin (&segments); e != list_end (&segments);
+       e = list_next (e))
+    {
+      struct shm *s = list_entry (e, struct shm, elem);
+      if (s->id == id)
+        return s;
+    }
+  return NULL;
+}
+
+/* Returns true if the SIZE bytes at page-aligned ADDR lie in user
+   space and do not cover the kernel data page. */
+static bool
+shm_range_ok (const void *addr, size_t size)
+{
+  const uint8_t *start = addr;
+
+  if (start + size > (const uint8_t *) PHYS_BASE || start + size < start)
+    return false;
+  return !((const void *) KDATA_ADDR >= addr
+           && (size_t) ((const uint8_t *) KDATA_ADDR - start) < size);
+}
+
+/* Drops one reference to S, freeing it if that was the last. */
+static void
+shm_release (struct shm *s)
+{
+  bool last;
+
+  lock_acquire (&shm_lock);
+  last = --s->ref_cnt == 0;
+  if (last)
+    list_remove (&s->elem);
+  lock_release (&shm_lock);
+
+  if (last)
+    shm_free (s);
+}
+
+/* Frees S and whichever of its frames have been allocated.  No
+   page may still map S. */
+static void
+shm_free (struct shm *s)
+{
+  size_t i;
+
+  for (i = 0; i < s->page_cnt; i++)
+    if (s->frames[i] != NULL)
+      frame_free_shm (s->frames[i]);
+  free (s->frames);
+  free (s);
+}
+
+/* Removes the PAGE_CNT pages of a segment mapped at ADDR in the
+   current process. */
+static void
+unmap_pages (uint8_t *addr, size_t page_cnt)
+{
+  size_t i;
+
+  for (i = 0; i < page_cnt; i++)
+    page_remove (page_lookup (addr + i * PGSIZE));
+}
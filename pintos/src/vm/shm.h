@@ -0,0 +1,19 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct process;
+
+/* Largest shared memory segment, in bytes.  Its frames stay
+   pinned for as long as the segment exists. */
+#define SHM_MAX_SIZE (1024 * 1024)
+
+void shm_init (void);
+int shm_create_segment (size_t size);
+bool shm_map_segment (int id, void *addr);
+bool shm_fork (struct process *parent);
+void shm_detach_all (void);
+
+#endif /* vm/shm.h */
@@ -0,0 +1,315 @@
+#include "vm/swap.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "filesys/lz.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Number of sectors in one page-sized swap slot. */
+#define SECTORS_PER_SLOT (PGSIZE / BLOCK_SECTOR_SIZE)
+
+/* Compressed swap cache.
+
+   With "-zswap", swap_out() first tries to compress the page and
+   keep it in kernel memory, up to swap_zcache_limit bytes in all,
+   and writes it to the swap device only if the cache is full or
+   the page does not shrink to ZCACHE_MAX_SIZE bytes.  Cached
+   pages have slot numbers after the device's, so the rest of the
+   VM system cannot tell the two apart, and reading one back costs
+   a decompression instead of a disk read.  A page, once cached,
+   stays in the cache until its last reference is dropped. */
+
+/* Largest compressed page worth caching. */
+#define ZCACHE_MAX_SIZE (PGSIZE * 3 / 4)
+
+/* Fewest bytes a cached page is assumed to take, which bounds the
+   number of cache slots. */
+#define ZCACHE_MIN_SIZE 64
+
+/* A compressed page in the cache. */
+struct zslot
+  {
+    void *data;                 /* Compressed contents. */
+    size_t size;                /* Bytes in DATA. */
+  };
+
+size_t swap_zcache_limit;
+
+static struct block *swap_device;    /* Swap device, or NULL. */
+static size_t disk_slot_cnt;         /* Slots on the swap device. */
+static struct bitmap *swap_map;      /* Device slots, one bit per slot. */
+static uint16_t *swap_refs;          /* Pages sharing each used slot. */
+static struct lock swap_lock;        /* Protects all of the above
+                                        and the zcache fields below. */
+static size_t swap_cursor;           /* Where the next search starts. */
+
+static struct bitmap *zcache_map;    /* Cache slots, one bit per slot. */
+static struct zslot *zcache_slots;   /* Cache slot contents. */
+static size_t zcache_cursor;         /* Where the next search starts. */
+static size_t zcache_used;           /* Bytes of compressed data. */
+
+/* Compression scratch space, protected by ZCACHE_LOCK. */
+static struct lock zcache_lock;
+static uint16_t zcache_hash[LZ_HASH_SIZE];
+static uint8_t zcache_buf[ZCACHE_MAX_SIZE];
+
+static size_t zcache_out (const void *kpage);
+static bool slot_in_use (size_t slot);
+
+/* Initializes the swap manager.  Without a swap device there are
+   no slots, so only clean pages can be evicted. */
+void
+swap_init (void)
+{
+  size_t zslot_cnt = swap_zcache_limit / ZCACHE_MIN_SIZE;
+
+  lock_init (&swap_lock);
+  lock_init (&zcache_lock);
+  swap_device = block_get_role (BLOCK_SWAP);
+  if (swap_device != NULL)
+    disk_slot_cnt = block_size (swap_device) / SECTORS_PER_SLOT;
+  else if (zslot_cnt == 0)
+    printf ("swap: no swap device, anonymous pages will not be evicted\n");
+  swap_map = bitmap_create (disk_slot_cnt);
+  zcache_map = bitmap_create (zslot_cnt);
+  zcache_slots = calloc (zslot_cnt + 1, sizeof *zcache_slots);
+
+  /* One spare entry, so that there is an array even without a
+     swap device. */
+  swap_refs = calloc (disk_slot_cnt + zslot_cnt + 1, sizeof *swap_refs);
+  if (swap_map == NULL || zcache_map == NULL || zcache_slots == NULL
+      || swap_refs == NULL)
+    PANIC ("bitmap creation failed--swap device is too large");
+}
+
+/* Writes the page at KPAGE to a free swap slot and returns the
+   slot's index, or BITMAP_ERROR if swap is full. */
+size_t
+swap_out (const void *kpage)
+{
+  void *kpages[1];
+  size_t slot;
+
+  kpages[0] = (void *) kpage;
+  return swap_out_cluster (kpages, 1, &slot) ? slot : BITMAP_ERROR;
+}
+
+/* Writes the CNT pages at KPAGES[], at most SWAP_CLUSTER, to free
+   swap slots, storing each page's slot in SLOTS[], and returns
+   true.  The pages that the compressed cache does not take go to
+   consecutive slots on the device, if there is a long enough run
+   of free slots, and their writes are submitted together so that
+   the driver merges them into one transfer.  Returns false, with
+   no slots allocated, if swap is full. */
+bool
+swap_out_cluster (void *const kpages[], size_t cnt, size_t slots[])
+{
+  struct block_request requests[SWAP_CLUSTER];
+  size_t disk[SWAP_CLUSTER];    /* Indexes of pages for the device. */
+  size_t disk_cnt = 0;
+  size_t first, i;
+  bool success = true;
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  for (i = 0; i < cnt; i++)
+    {
+      slots[i] = zcache_out (kpages[i]);
+      if (slots[i] == BITMAP_ERROR)
+        disk[disk_cnt++] = i;
+    }
+  if (disk_cnt == 0)
+    {
+      thread_current ()->usage.swap_outs += cnt;
+      return true;
+    }
+
+  /* Prefer one run of slots, but settle for scattered ones. */
+  lock_acquire (&swap_lock);
+  first = bitmap_scan_and_flip_next (swap_map, &swap_cursor, disk_cnt,
+                                     false);
+  for (i = 0; i < disk_cnt; i++)
+    {
+      size_t slot = first != BITMAP_ERROR ? first + i
+        : bitmap_scan_and_flip_next (swap_map, &swap_cursor, 1, false);
+      if (slot == BITMAP_ERROR)
+        {
+          success = false;
+          break;
+        }
+      slots[disk[i]] = slot;
+      swap_refs[slot] = 1;
+    }
+  lock_release (&swap_lock);
+
+  if (!success)
+    {
+      for (i = 0; i < cnt; i++)
+        if (slots[i] != BITMAP_ERROR)
+          swap_free (slots[i]);
+      return false;
+    }
+
+  for (i = 0; i < disk_cnt; i++)
+    {
+      block_request_init (&requests[i], swap_device,
+                          slots[disk[i]] * SECTORS_PER_SLOT,
+                          SECTORS_PER_SLOT, kpages[disk[i]], true);
+      block_submit (&requests[i]);
+    }
+  for (i = 0; i < disk_cnt; i++)
+    block_wait (&requests[i]);
+  thread_current ()->usage.swap_outs += cnt;
+  return true;
+}
+
+/* Reads swap slot SLOT into the page at KPAGE and drops the
+   caller's reference to the slot. */
+void
+swap_in (size_t slot, void *kpage)
+{
+  void *kpages[1];
+
+  kpages[0] = kpage;
+  swap_read_cluster (slot, kpages, 1);
+  swap_free (slot);
+}
+
+/* Reads the CNT swap slots starting at SLOT, at most
+   SWAP_CLUSTER, into the pages at KPAGES[].  The caller must hold
+   a reference to each slot, which is not dropped.  Reads from the
+   device are submitted together, so that the driver merges those
+   of consecutive slots into one transfer. */
+void
+swap_read_cluster (size_t slot, void *const kpages[], size_t cnt)
+{
+  struct block_request requests[SWAP_CLUSTER];
+  size_t n = 0;
+  size_t i;
+
+  ASSERT (cnt <= SWAP_CLUSTER);
+
+  thread_current ()->usage.swap_ins += cnt;
+  for (i = 0; i < cnt; i++, slot++)
+    if (slot >= disk_slot_cnt)
+      {
+        /* The caller's reference keeps the data from being freed. */
+        struct zslot *z = &zcache_slots[slot - disk_slot_cnt];
+        if (!lz_decompress (z->data, z->size, kpages[i], PGSIZE))
+          PANIC ("swap: corrupt compressed page in slot %zu", slot);
+      }
+    else
+      {
+        block_request_init (&requests[n], swap_device,
+                            slot * SECTORS_PER_SLOT, SECTORS_PER_SLOT,
+                            kpages[i], false);
+        block_submit (&requests[n++]);
+      }
+  for (i = 0; i < n; i++)
+    block_wait (&requests[i]);
+}
+
+/* Adds a reference to swap slot SLOT, for another page with the
+   same contents, as in a process created by fork().  Returns
+   false if the slot has as many references as it can count. */
+bool
+swap_dup (size_t slot)
+{
+  bool success;
+
+  lock_acquire (&swap_lock);
+  ASSERT (slot_in_use (slot));
+  success = swap_refs[slot] < UINT16_MAX;
+  if (success)
+    swap_refs[slot]++;
+  lock_release (&swap_lock);
+  return success;
+}
+
+/* Drops a reference to swap slot SLOT without reading it, and
+   marks the slot free once no page refers to it. */
+void
+swap_free (size_t slot)
+{
+  void *data = NULL;
+
+  lock_acquire (&swap_lock);
+  ASSERT (slot_in_use (slot));
+  if (--swap_refs[slot] == 0)
+    {
+      if (slot >= disk_slot_cnt)
+        {
+          struct zslot *z = &zcache_slots[slot - disk_slot_cnt];
+          data = z->data;
+          zcache_used -= z->size;
+          z->data = NULL;
+          bitmap_reset (zcache_map, slot - disk_slot_cnt);
+        }
+      else
+        bitmap_reset (swap_map, slot);
+    }
+  lock_release (&swap_lock);
+  free (data);
+}
+
+/* Tries to keep the page at KPAGE in the compressed swap cache.
+   Returns its slot, or BITMAP_ERROR if the cache is disabled or
+   full or the page does not compress well enough. */
+static size_t
+zcache_out (const void *kpage)
+{
+  size_t slot = BITMAP_ERROR;
+  size_t size;
+  void *data;
+
+  if (bitmap_size (zcache_map) == 0)
+    return BITMAP_ERROR;
+
+  lock_acquire (&zcache_lock);
+  size = lz_compress (kpage, PGSIZE, zcache_buf, sizeof zcache_buf,
+                      zcache_hash);
+  data = size > 0 ? malloc (size) : NULL;
+  if (data != NULL)
+    memcpy (data, zcache_buf, size);
+  lock_release (&zcache_lock);
+  if (data == NULL)
+    return BITMAP_ERROR;
+
+  lock_acquire (&swap_lock);
+  if (zcache_used + size <= swap_zcache_limit)
+    {
+      size_t i = bitmap_scan_and_flip_next (zcache_map, &zcache_cursor, 1,
+                                            false);
+      if (i != BITMAP_ERROR)
+        {
+          zcache_slots[i].data = data;
+          zcache_slots[i].size = size;
+          zcache_used += size;
+          slot = disk_slot_cnt + i;
+          swap_refs[slot] = 1;
+        }
+    }
+  lock_release (&swap_lock);
+
+  if (slot == BITMAP_ERROR)
+    free (data);
+  return slot;
+}
+
+/* Returns true if SLOT, on the device or in the cache, is in
+   use. */
+static bool
+slot_in_use (size_t slot)
+{
+  ASSERT (lock_held_by_current_thread (&swap_lock));
+
+  if (slot < disk_slot_cnt)
+    return bitmap_test (swap_map, slot);
+  return bitmap_test (zcache_map, slot - disk_slot_cnt);
+}
@@ -0,0 +1,22 @@
+#ifndef VM_SWAP_H
+#define VM_SWAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Most pages swapped out or read back in one go.  The IDE driver
+   merges up to this many adjacent requests into one transfer. */
+#define SWAP_CLUSTER 8
+
+/* Bytes of compressed swap cache, set by the "-zswap" option. */
+extern size_t swap_zcache_limit;
+
+void swap_init (void);
+size_t swap_out (const void *kpage);
+bool swap_out_cluster (void *const kpages[], size_t cnt, size_t slots[]);
+void swap_in (size_t slot, void *kpage);
+void swap_read_cluster (size_t slot, void *const kpages[], size_t cnt);
+bool swap_dup (size_t slot);
+void swap_free (size_t slot);
+
+#endif /* vm/swap.h */